@@ -16,9 +16,14 @@ Description: ASICamera Simulator and Basic Definition
 
 #include "atom/driver/macro.hpp"
 #include "atom/log/loguru.hpp"
+#include "atom/video/consumers.hpp"
 
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #define ASI_CAMERA_CONNECTION_CHECK                 \
     if (is_connected.load()) {                      \
@@ -44,7 +49,63 @@ Description: ASICamera Simulator and Basic Definition
         return false;                       \
     }
 
-using ImgBufferPtr = std::unique_ptr<unsigned char[]>;
+namespace {
+/**
+ * @brief Feeds ASI video mode frames into the capture pipeline.
+ */
+class ASIVideoSource : public atom::video::FrameSource {
+public:
+    ASIVideoSource(int camera_id, atom::memory::FrameBufferRing &frames,
+                   const atom::memory::FrameGeometry &geometry)
+        : m_camera_id(camera_id), m_frames(frames), m_geometry(geometry) {}
+
+    bool start() override {
+        auto err = ASIStartVideoCapture(m_camera_id);
+        if (err != ASI_SUCCESS) {
+            LOG_F(ERROR, "Unable to start video capture, error code: {}",
+                  err);
+            return false;
+        }
+        m_dropped = 0;
+        return true;
+    }
+
+    void stop() override { ASIStopVideoCapture(m_camera_id); }
+
+    atom::video::FrameHandle read(std::chrono::milliseconds timeout) override {
+        // 没有空闲缓冲区时丢弃这一帧，而不是阻塞相机
+        auto frame = m_frames.tryAcquire();
+        if (!frame) {
+            ++m_dropped;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return {};
+        }
+        auto size = static_cast<long>(m_geometry.bytes());
+        if (ASIGetVideoData(m_camera_id, frame.data(), size,
+                            static_cast<int>(timeout.count())) !=
+            ASI_SUCCESS) {
+            return {};
+        }
+        frame.setSize(size);
+        auto &info = frame.info();
+        info.geometry = m_geometry;
+        info.timestamp = std::chrono::system_clock::now();
+        return frame;
+    }
+
+    uint64_t droppedFrames() const override {
+        int sdk_dropped = 0;
+        ASIGetDroppedFrames(m_camera_id, &sdk_dropped);
+        return m_dropped.load() + static_cast<uint64_t>(sdk_dropped);
+    }
+
+private:
+    int m_camera_id;
+    atom::memory::FrameBufferRing &m_frames;
+    atom::memory::FrameGeometry m_geometry;
+    std::atomic<uint64_t> m_dropped{0};
+};
+}  // namespace
 
 ASICamera::ASICamera(const std::string &name) : AtomCamera(name) {}
 
@@ -110,6 +171,10 @@ bool ASICamera::connect(const json &params) {
                       errCode);
                 return false;
             }
+            if (!allocateFrameBuffers()) {
+                ASICloseCamera(ASICameraInfo.CameraID);
+                return false;
+            }
             setVariable("DEVICE_CONNECTED", true);
             is_connected.store(true);
             LOG_F(INFO, "Camera connected successfully\n");
@@ -130,18 +195,7 @@ bool ASICamera::disconnect(const json &params) { /*在关闭相机之前停止
     }
 
     if (is_videoing.load()) {
-        if ((errCode = ASIStopVideoCapture(m_camera_id)) !=
-            ASI_SUCCESS)  // 停止视频拍摄
-        {
-            LOG_F(ERROR,
-                  "Unable to stop video capture,error code is {},please try "
-                  "again.",
-                  errCode);
-            return false;
-        }
-        is_videoing.store(false);
-        setVariable("CCD_VIDEO_STATUS", false);
-        LOG_F(INFO, "Stop video capture");
+        stopVideo();  // 停止视频拍摄
     }
     if (is_exposing.load()) {
         if ((errCode = ASIStopExposure(m_camera_id)) !=
@@ -259,22 +313,45 @@ bool ASICamera::getExposureResult() {
     ASI_CAMERA_CONNECT_CHECK;
     ASI_CAMERA_EXPOSURE_CHECK;
 
-    GET_INT_VARIABLE(width);
-    GET_INT_VARIABLE(height);
-
-    long imgSize = width * height;
-    //* (1 + (ASICAMERA->ImageType == ASI_IMG_RAW16));
+    int width = 0;
+    int height = 0;
+    int bin = 1;
+    ASI_IMG_TYPE imgType = ASI_IMG_RAW8;
+    if ((errCode = ASIGetROIFormat(m_camera_id, &width, &height, &bin,
+                                   &imgType)) != ASI_SUCCESS) {
+        LOG_F(ERROR, "Unable to get ROI format, error code: {}", errCode);
+        return false;
+    }
+    long imgSize = static_cast<long>(width) * height * bytesPerPixel(imgType);
 
-    // 使用智能指针管理图像缓冲区内存
-    ImgBufferPtr imgBuf(new unsigned char[imgSize]);
+    // 从预分配的帧缓冲区中取一块，避免每次曝光都分配内存
+    auto frame = m_frames.acquireFor(std::chrono::seconds(5));
+    if (!frame) {
+        LOG_F(ERROR, "No free frame buffer, previous frames are still in use");
+        return false;
+    }
+    if (static_cast<size_t>(imgSize) > frame.capacity()) {
+        LOG_F(ERROR, "Image of {} bytes exceeds frame buffer of {} bytes",
+              imgSize, frame.capacity());
+        return false;
+    }
 
     /*曝光后获取图像信息*/
-    int errCode = ASIGetDataAfterExp(m_camera_id, imgBuf.get(), imgSize);
+    errCode = ASIGetDataAfterExp(m_camera_id, frame.data(), imgSize);
     if (errCode != ASI_SUCCESS) {
         // 获取图像失败
         LOG_F(ERROR, "Unable to get image from camera, error code: {}",
               errCode);
-        return;
+        return false;
+    }
+    frame.setSize(imgSize);
+    auto &info = frame.info();
+    info.geometry = frameGeometry(width, height, imgType);
+    info.sequence = ++m_frame_sequence;
+    info.timestamp = std::chrono::system_clock::now();
+    {
+        std::scoped_lock lock(m_frame_mutex);
+        m_last_frame = frame;
     }
 
     // 图像下载完成
@@ -286,11 +363,10 @@ bool ASICamera::getExposureResult() {
         std::string FitsName = "test.fits";
         LOG_F(INFO, "Upload mode is LOCAL, save image to {}", FitsName);
         /*将图像写入本地文件*/
+        // The FITS writer takes a copy of the frame handle, not the pixels.
         // auto res = getComponent("LITHIUM_IMAGE")
         //                ->runFunc("SaveImage", {{"filename", FitsName},
-        //                                       {"data", imgBuf},
-        //{ "size", imgSize }
-        //});
+        //                                       {"frame", frame}});
         // if (res.contains("error")) {
         //    LOG_F(ERROR, "Unable to save image to {}, error: {}", FitsName,
         //          res["error"].get<std::string>());
@@ -306,15 +382,154 @@ bool ASICamera::getExposureResult() {
     return true;
 }
 
+atom::memory::FrameHandle ASICamera::getLastFrame() const {
+    std::scoped_lock lock(m_frame_mutex);
+    return m_last_frame;
+}
+
+void ASICamera::addVideoConsumer(
+    std::shared_ptr<atom::video::FrameConsumer> consumer, int cpu) {
+    m_video_consumers.emplace_back(std::move(consumer), cpu);
+}
+
+size_t ASICamera::bytesPerPixel(ASI_IMG_TYPE type) {
+    switch (type) {
+        case ASI_IMG_RGB24:
+            return 3;
+        case ASI_IMG_RAW16:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+atom::memory::FrameGeometry ASICamera::frameGeometry(int width, int height,
+                                                     ASI_IMG_TYPE type) {
+    return {static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+            type == ASI_IMG_RGB24 ? 3u : 1u, type == ASI_IMG_RAW16 ? 16u : 8u};
+}
+
+bool ASICamera::allocateFrameBuffers() {
+    // 按传感器最大分辨率和支持的最宽像素格式分配，ROI 和 binning 都能放下
+    size_t bpp = 1;
+    for (auto format : ASICameraInfo.SupportedVideoFormat) {
+        if (format == ASI_IMG_END) {
+            break;
+        }
+        bpp = std::max(bpp, bytesPerPixel(format));
+    }
+    atom::memory::FrameGeometry geometry{
+        static_cast<uint32_t>(ASICameraInfo.MaxWidth),
+        static_cast<uint32_t>(ASICameraInfo.MaxHeight),
+        bpp == 3 ? 3u : 1u, bpp == 2 ? 16u : 8u};
+    try {
+        m_frames.configure(geometry, FRAME_BUFFER_COUNT, true);
+    } catch (const std::bad_alloc &) {
+        LOG_F(ERROR, "Unable to allocate {} frame buffers of {} bytes",
+              FRAME_BUFFER_COUNT, geometry.bytes());
+        return false;
+    }
+    LOG_F(INFO, "Allocated {} frame buffers of {} bytes{}",
+          FRAME_BUFFER_COUNT, m_frames.frameBytes(),
+          m_frames.hugePages() ? " on huge pages" : "");
+    return true;
+}
+
 bool ASICamera::saveExposureResult() { return true; }
 
-bool ASICamera::startVideo() { return true; }
+bool ASICamera::startVideo() {
+    ASI_CAMERA_CONNECT_CHECK;
+    ASI_CAMERA_EXPOSURE_CHECK;
+    ASI_CAMERA_VIDEO_CHECK;
 
-bool ASICamera::stopVideo() { return true; }
+    int width = 0;
+    int height = 0;
+    int bin = 1;
+    ASI_IMG_TYPE imgType = ASI_IMG_RAW8;
+    if ((errCode = ASIGetROIFormat(m_camera_id, &width, &height, &bin,
+                                   &imgType)) != ASI_SUCCESS) {
+        LOG_F(ERROR, "Unable to get ROI format, error code: {}", errCode);
+        return false;
+    }
+    auto geometry = frameGeometry(width, height, imgType);
+
+    // 视频模式需要更多缓冲区：每个消费者都有自己的队列，外加正在处理的
+    // 一帧。所有队列都满时相机仍要有空闲缓冲区，否则采集会停下来
+    const size_t consumers = m_video_consumers.size() + 1;  // 加上 "latest"
+    const size_t buffers =
+        std::max(VIDEO_BUFFER_COUNT,
+                 consumers * (MIN_VIDEO_QUEUE_DEPTH + 1) + VIDEO_SPARE_BUFFERS);
+    try {
+        m_frames.configure(geometry, buffers, true);
+    } catch (const std::bad_alloc &) {
+        LOG_F(ERROR, "Unable to allocate {} video buffers of {} bytes",
+              buffers, geometry.bytes());
+        allocateFrameBuffers();
+        return false;
+    }
 
-bool ASICamera::getVideoStatus() { return true; }
+    atom::video::CapturePipeline::Options options;
+    options.queue_depth = (buffers - VIDEO_SPARE_BUFFERS) / consumers - 1;
+    DLOG_F(INFO, "Video uses {} buffers, queue depth {} for {} consumers",
+           buffers, options.queue_depth, consumers);
+    m_video = std::make_unique<atom::video::CapturePipeline>(
+        std::make_shared<ASIVideoSource>(m_camera_id, m_frames, geometry),
+        options);
+    m_video->addConsumer(std::make_shared<atom::video::CallbackConsumer>(
+        "latest", [this](const atom::memory::FrameHandle &frame) {
+            std::scoped_lock lock(m_frame_mutex);
+            m_last_frame = frame;
+        }));
+    for (const auto &[consumer, cpu] : m_video_consumers) {
+        m_video->addConsumer(consumer, cpu);
+    }
+    if (!m_video->start()) {
+        m_video.reset();
+        allocateFrameBuffers();
+        return false;
+    }
+    is_videoing.store(true);
+    setVariable("CCD_VIDEO_STATUS", true);
+    LOG_F(INFO, "Start video capture at {}x{}", width, height);
+    return true;
+}
+
+bool ASICamera::stopVideo() {
+    if (!is_videoing.load() || !m_video) {
+        return true;
+    }
+    m_video->stop();
+    auto stats = m_video->stats();
+    LOG_F(INFO, "Stop video capture: {} frames at {:.1f} fps, {} dropped",
+          stats.captured, stats.fps, stats.source_dropped);
+    m_video.reset();
+    is_videoing.store(false);
+    setVariable("CCD_VIDEO_STATUS", false);
+    // 恢复单帧曝光使用的缓冲区
+    return allocateFrameBuffers();
+}
 
-bool ASICamera::getVideoResult() { return true; }
+bool ASICamera::getVideoStatus() {
+    if (!is_videoing.load() || !m_video) {
+        LOG_F(INFO, "Camera is not videoing");
+        return false;
+    }
+    auto stats = m_video->stats();
+    LOG_F(INFO, "Video: {} frames at {:.1f} fps, {} dropped by camera",
+          stats.captured, stats.fps, stats.source_dropped);
+    for (const auto &consumer : stats.consumers) {
+        LOG_F(INFO, "Video consumer {}: {} processed, {} dropped, {} queued",
+              consumer.name, consumer.processed, consumer.dropped,
+              consumer.queued);
+    }
+    return true;
+}
+
+bool ASICamera::getVideoResult() {
+    ASI_CAMERA_CONNECT_CHECK;
+    // 最新的一帧由流水线中的 "latest" 消费者更新
+    return static_cast<bool>(getLastFrame());
+}
 
 bool ASICamera::saveVideoResult() { return true; }
 
@@ -2,10 +2,15 @@
 #define ATOM_ASI_COMPONENT_HPP
 
 #include "atom/driver/camera.hpp"
+#include "atom/memory/framebuffer.hpp"
+#include "atom/video/pipeline.hpp"
 
 #include "driverlibs/libasi/ASICamera2.h"
 
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 class ASICamera : public AtomCamera {
 public:
@@ -95,9 +100,28 @@ public:
 
     bool setUploadMode(UploadMode mode) final;
 
+    /**
+     * @brief The most recent exposure, shared without copying the pixels.
+     */
+    atom::memory::FrameHandle getLastFrame() const;
+
+    /**
+     * @brief Add a stage (writer, preview, scorer) to the video pipeline.
+     * Stages added while streaming take effect at the next startVideo().
+     */
+    void addVideoConsumer(std::shared_ptr<atom::video::FrameConsumer> consumer,
+                          int cpu = -1);
+
 private:
     bool refreshCameraInfo();
 
+    bool allocateFrameBuffers();
+
+    static size_t bytesPerPixel(ASI_IMG_TYPE type);
+
+    static atom::memory::FrameGeometry frameGeometry(int width, int height,
+                                                     ASI_IMG_TYPE type);
+
     /*ASI相机参数*/
     ASI_CAMERA_INFO ASICameraInfo;
     ASI_ERROR_CODE errCode;
@@ -115,6 +139,23 @@ private:
 
     std::atomic<int> m_gain;
     std::atomic<int> m_offset;
+
+    /*帧缓冲区，连接时按传感器尺寸分配*/
+    static constexpr size_t FRAME_BUFFER_COUNT = 4;
+    atom::memory::FrameBufferRing m_frames;
+    atom::memory::FrameHandle m_last_frame;
+    mutable std::mutex m_frame_mutex;
+    uint64_t m_frame_sequence = 0;
+
+    /*视频流水线，采集线程把帧分发给各个消费者*/
+    static constexpr size_t VIDEO_BUFFER_COUNT = 32;
+    /*每个消费者队列的最小深度*/
+    static constexpr size_t MIN_VIDEO_QUEUE_DEPTH = 2;
+    /*不属于任何队列的缓冲区：m_last_frame 持有一帧，相机至少需要两帧*/
+    static constexpr size_t VIDEO_SPARE_BUFFERS = 3;
+    std::unique_ptr<atom::video::CapturePipeline> m_video;
+    std::vector<std::pair<std::shared_ptr<atom::video::FrameConsumer>, int>>
+        m_video_consumers;
 };
 
 #endif
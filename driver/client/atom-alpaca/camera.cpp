@@ -0,0 +1,81 @@
+/*
+ * camera.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-2
+
+Description: Alpaca Camera
+
+**************************************************/
+
+#include "camera.hpp"
+
+#include "atom/web/httppool.hpp"
+#include "exception.hpp"
+
+Camera::Camera(const std::string &address, int device_number,
+               const std::string &protocol)
+    : Device(address, "camera", device_number, protocol) {}
+
+atom::memory::FrameHandle Camera::allocateFrame(
+    const atom::memory::FrameGeometry &geometry) {
+    // The ring grows to the largest image seen and is reused from then on
+    if (!m_frames.configured() || m_frames.frameBytes() < geometry.bytes()) {
+        m_frames.configure(geometry, FRAME_BUFFER_COUNT, true);
+    }
+    return m_frames.acquireFor(std::chrono::seconds(5));
+}
+
+atom::memory::FrameHandle Camera::get_ImageArray(double tmo) {
+    std::lock_guard<std::mutex> lock(m_image_lock);
+    ImageArrayDecoder decoder(
+        [this](const atom::memory::FrameGeometry &geometry) {
+            return allocateFrame(geometry);
+        });
+
+    auto request = _request("GET", tmo);
+    request.headers.emplace_back("Accept", "application/imagebytes");
+    std::string error_body;
+    request.on_body = [&](const atom::web::PooledResponse &response,
+                          std::string_view chunk, size_t offset) {
+        if (response.status != 200) {
+            error_body.append(chunk);
+            return true;
+        }
+        if (offset == 0) {
+            auto type = response.header("Content-Type");
+            decoder.reset(type && type->find("application/imagebytes") !=
+                                      std::string_view::npos);
+        }
+        return decoder.feed(chunk);
+    };
+
+    auto response = atom::web::HttpConnectionPool::shared()
+                        .request(base_url + "/imagearray", std::move(request))
+                        .get();
+    if (!response.ok()) {
+        throw AlpacaRequestException(-1, decoder.errorMessage().empty()
+                                             ? response.error
+                                             : decoder.errorMessage());
+    }
+    if (response.status != 200) {
+        throw AlpacaRequestException(response.status, error_body);
+    }
+    if (!decoder.finish()) {
+        throw AlpacaRequestException(response.status, decoder.errorMessage());
+    }
+    if (decoder.errorNumber() != 0) {
+        throwAlpacaError(decoder.errorNumber(), decoder.errorMessage());
+    }
+    m_metadata = decoder.metadata();
+    return decoder.frame();
+}
+
+ImageMetadata Camera::get_ImageArrayInfo() const {
+    std::lock_guard<std::mutex> lock(m_image_lock);
+    return m_metadata;
+}
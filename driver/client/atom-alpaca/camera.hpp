@@ -1,74 +1,57 @@
-#include <iostream>
+/*
+ * camera.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
 
-enum ImageArrayElementTypes { INT, FLOAT }; // 假设ImageArrayElementTypes是一个枚举类型
+/*************************************************
 
-class ImageMetadata {
-private:
-    int metavers;
-    ImageArrayElementTypes imgtype;
-    ImageArrayElementTypes xmtype;
-    int rank;
-    int x_size;
-    int y_size;
-    int z_size;
+Date: 2024-7-2
 
-public:
-    explicit ImageMetadata(
-        int metadata_version,
-        ImageArrayElementTypes image_element_type,
-        ImageArrayElementTypes transmission_element_type,
-        int rank,
-        int num_x,
-        int num_y,
-        int num_z
-    ) :
-        metavers(metadata_version),
-        imgtype(image_element_type),
-        xmtype(transmission_element_type),
-        rank(rank),
-        x_size(num_x),
-        y_size(num_y),
-        z_size(num_z)
-    {}
+Description: Alpaca Camera
 
-    int get_MetadataVersion() {
-        return metavers;
-    }
+**************************************************/
 
-    ImageArrayElementTypes get_ImageElementType() {
-        return imgtype;
-    }
+#ifndef ATOM_ALPACA_CAMERA_HPP
+#define ATOM_ALPACA_CAMERA_HPP
 
-    ImageArrayElementTypes get_TransmissionElementType() {
-        return xmtype;
-    }
+#include "atom/memory/framebuffer.hpp"
+#include "device.hpp"
+#include "imagebytes.hpp"
 
-    int get_Rank() {
-        return rank;
-    }
+class Camera : public Device {
+public:
+    explicit Camera(const std::string &address, int device_number,
+                    const std::string &protocol);
+
+    /**
+     * @brief Downloads the last image.
+     *
+     * Asks for application/imagebytes and decodes the reply into a pooled
+     * frame buffer while it streams in. Servers that only speak the JSON
+     * ImageArray format are decoded the same way without building a DOM.
+     * Samples arrive as 8, 16 or 32 bit depending on the element types,
+     * see ImageArrayDecoder, in row-major order.
+     *
+     * @param tmo The timeout for the whole download.
+     * @return The image, valid until the caller drops the handle.
+     */
+    atom::memory::FrameHandle get_ImageArray(double tmo = 60.0);
+
+    /**
+     * @brief Metadata of the last downloaded image.
+     */
+    ImageMetadata get_ImageArrayInfo() const;
 
-    int get_Dimension1() {
-        return x_size;
-    }
+private:
+    static constexpr size_t FRAME_BUFFER_COUNT = 2;
 
-    int get_Dimension2() {
-        return y_size;
-    }
+    atom::memory::FrameHandle allocateFrame(
+        const atom::memory::FrameGeometry &geometry);
 
-    int get_Dimension3() {
-        return z_size;
-    }
+    atom::memory::FrameBufferRing m_frames;
+    ImageMetadata m_metadata;
+    mutable std::mutex m_image_lock;
 };
 
-int main() {
-    ImageMetadata metadata(1, INT, FLOAT, 2, 640, 480, 0);
-    std::cout << "Metadata version: " << metadata.get_MetadataVersion() << std::endl;
-    std::cout << "Image element type: " << metadata.get_ImageElementType() << std::endl;
-    std::cout << "Transmission element type: " << metadata.get_TransmissionElementType() << std::endl;
-    std::cout << "Rank: " << metadata.get_Rank() << std::endl;
-    std::cout << "Dimension 1: " << metadata.get_Dimension1() << std::endl;
-    std::cout << "Dimension 2: " << metadata.get_Dimension2() << std::endl;
-    std::cout << "Dimension 3: " << metadata.get_Dimension3() << std::endl;
-
-    return 0;
-}
+#endif
@@ -14,14 +14,18 @@ Description: Basic Device Definition of Alpaca
 
 #include "device.hpp"
 
+#include <charconv>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <random>
+#include <stdexcept>
+#include <string_view>
 
-
-#include "httplib.h"
-
-constexpr int API_VERSION = 1;
+#include "atom/utils/string.hpp"
+#include "atom/web/httppool.hpp"
+#include "exception.hpp"
+#include "reply.hpp"
 
 Device::Device(const std::string &address, const std::string &device_type,
                int device_number, const std::string &protocol)
@@ -55,17 +59,19 @@ std::string Device::CommandString(const std::string &Command, bool Raw) {
         .at("Value");
 }
 
-bool Device::get_Connected() const { return _get("connected") == "true"; }
+bool Device::get_Connected() const { return _get("connected").get<bool>(); }
 
 void Device::set_Connected(bool ConnectedState) {
     _put("connected", {{"Connected", ConnectedState}});
 }
 
-std::string Device::get_Description() const { return _get("description"); }
+std::string Device::get_Description() const {
+    return _get("description").get<std::string>();
+}
 
 std::vector<std::string> Device::get_DriverInfo() const {
     std::vector<std::string> driver_info;
-    std::string driver_info_str = _get("driverinfo");
+    std::string driver_info_str = _get("driverinfo").get<std::string>();
     size_t start_pos = 0;
     size_t end_pos = driver_info_str.find(',');
     while (end_pos != std::string::npos) {
@@ -78,16 +84,22 @@ std::vector<std::string> Device::get_DriverInfo() const {
     return driver_info;
 }
 
-std::string Device::get_DriverVersion() const { return _get("driverversion"); }
+std::string Device::get_DriverVersion() const {
+    return _get("driverversion").get<std::string>();
+}
 
 int Device::get_InterfaceVersion() const {
-    return std::stoi(_get("interfaceversion"));
+    return _get("interfaceversion").get<int>();
 }
 
-std::string Device::get_Name() const { return _get("name"); }
+std::string Device::get_Name() const { return _get("name").get<std::string>(); }
 
 std::vector<std::string> Device::get_SupportedActions() const {
-    std::string supported_actions_str = _get("supportedactions");
+    json actions = _get("supportedactions");
+    if (actions.is_array()) {
+        return actions.get<std::vector<std::string>>();
+    }
+    std::string supported_actions_str = actions.get<std::string>();
     std::vector<std::string> supported_actions;
     size_t start_pos = 0;
     size_t end_pos = supported_actions_str.find(',');
@@ -101,110 +113,129 @@ std::vector<std::string> Device::get_SupportedActions() const {
     return supported_actions;
 }
 
-json Device::_get(const std::string &attribute,
-                  const std::map<std::string, std::string> &data = {},
-                  double tmo = 5.0) const {
-    httplib::Client client(address.c_str());
-    std::string path = base_url + "/" + attribute;
-
-    std::lock_guard<std::mutex> lock(_ctid_lock);
-    std::string client_trans_id = std::to_string(_client_trans_id++);
-    std::string client_id = std::to_string(_client_id);
-
-    client.set_timeout(tmo);
+namespace {
+void checkStatus(const atom::web::PooledResponse &response) {
+    if (!response.ok() || response.status != 200) {
+        throw AlpacaRequestException(
+            response.ok() ? response.status : -1,
+            response.ok() ? response.body : response.error);
+    }
+}
 
-    httplib::Headers headers = {{"ClientTransactionID", client_trans_id},
-                                {"ClientID", client_id}};
+/* Map an Alpaca reply to its JSON body or the matching exception. */
+json checkResponse(const atom::web::PooledResponse &response) {
+    checkStatus(response);
+    json j = json::parse(response.body);
+    int error_number = j["ErrorNumber"];
+    if (error_number != 0) {
+        throwAlpacaError(error_number, j["ErrorMessage"]);
+    }
+    return j;
+}
 
-    httplib::Result response = client.Get(path.c_str(), headers, data);
+/* The parameter types Device passes to _put(). */
+json toJson(const std::any &value) {
+    if (value.type() == typeid(bool)) {
+        return std::any_cast<bool>(value);
+    }
+    if (value.type() == typeid(int)) {
+        return std::any_cast<int>(value);
+    }
+    if (value.type() == typeid(double)) {
+        return std::any_cast<double>(value);
+    }
+    if (value.type() == typeid(std::string)) {
+        return std::any_cast<std::string>(value);
+    }
+    if (value.type() == typeid(const char *)) {
+        return std::any_cast<const char *>(value);
+    }
+    if (value.type() == typeid(std::vector<std::string>)) {
+        return std::any_cast<std::vector<std::string>>(value);
+    }
+    if (value.type() == typeid(json)) {
+        return std::any_cast<json>(value);
+    }
+    throw std::invalid_argument(std::string("Unsupported parameter type ") +
+                                value.type().name());
+}
 
-    if (response && response->status == 200) {
-        json j = json::parse(response->body);
-        int error_number = j["ErrorNumber"];
-        std::string error_message = j["ErrorMessage"];
+/* Check a property read and return its Value field. */
+json replyValue(const atom::web::PooledResponse &response) {
+    checkStatus(response);
+    alpaca::ReplyFields fields;
+    if (!alpaca::scanReply(response.body, fields)) {
+        // Let the full parser report what is wrong with the reply
+        json j = json::parse(response.body);
+        int error_number = j.value("ErrorNumber", 0);
         if (error_number != 0) {
-            if (error_number == 0x0400)
-                throw NotImplementedException(error_message);
-            else if (error_number == 0x0401)
-                throw InvalidValueException(error_message);
-            else if (error_number == 0x0402)
-                throw ValueNotSetException(error_message);
-            else if (error_number == 0x0407)
-                throw NotConnectedException(error_message);
-            else if (error_number == 0x0408)
-                throw ParkedException(error_message);
-            else if (error_number == 0x0409)
-                throw SlavedException(error_message);
-            else if (error_number == 0x040B)
-                throw InvalidOperationException(error_message);
-            else if (error_number == 0x040C)
-                throw ActionNotImplementedException(error_message);
-            else if (error_number >= 0x500 && error_number <= 0xFFF)
-                throw DriverException(error_number, error_message);
-            else
-                throw DriverException(error_number, error_message);
+            throwAlpacaError(error_number,
+                             j.value("ErrorMessage", std::string()));
         }
-        return j;
-    } else {
-        throw AlpacaRequestException(
-            response ? response->status : -1,
-            response ? response->body : "Request failed");
+        return j.value("Value", json());
     }
+    int error_number = 0;
+    std::from_chars(fields.error_number.data(),
+                    fields.error_number.data() + fields.error_number.size(),
+                    error_number);
+    if (error_number != 0) {
+        json message = alpaca::parseValue(fields.error_message);
+        throwAlpacaError(error_number,
+                         message.is_string() ? message.get<std::string>()
+                                             : std::string());
+    }
+    return alpaca::parseValue(fields.value);
 }
+}  // namespace
 
-json Device::_put(const std::string &attribute,
-                  const std::map<std::string, std::any> &data = {},
-                  double tmo = 5.0) const {
-    httplib::Client client(address.c_str());
-    std::string path = base_url + "/" + attribute;
-
+atom::web::PooledRequest Device::_request(const std::string &method,
+                                          double tmo) const {
     std::lock_guard<std::mutex> lock(_ctid_lock);
-    std::string client_trans_id = std::to_string(_client_trans_id++);
-    std::string client_id = std::to_string(_client_id);
-
-    client.set_timeout(tmo);
-
-    httplib::Headers headers = {{"ClientTransactionID", client_trans_id},
-                                {"ClientID", client_id}};
+    atom::web::PooledRequest request;
+    request.method = method;
+    request.headers = {{"ClientTransactionID",
+                        std::to_string(_client_trans_id++)},
+                       {"ClientID", std::to_string(_client_id)}};
+    request.timeout =
+        std::chrono::milliseconds(static_cast<long long>(tmo * 1000));
+    return request;
+}
 
-    json json_data = data;
-    std::string body = json_data.dump();
+json Device::_get(const std::string &attribute,
+                  const std::map<std::string, std::string> &data,
+                  double tmo) const {
+    std::string url = base_url + "/" + attribute;
+    char separator = '?';
+    for (const auto &[key, value] : data) {
+        url += separator + atom::utils::urlEncode(key) + "=" +
+               atom::utils::urlEncode(value);
+        separator = '&';
+    }
 
-    httplib::Result response =
-        client.Put(path.c_str(), headers, body, "application/json");
+    // Polled properties share keep-alive connections, and identical reads
+    // already in flight are answered by a single round trip.
+    auto response = atom::web::HttpConnectionPool::shared()
+                        .request(url, _request("GET", tmo))
+                        .get();
+    return replyValue(response);
+}
 
-    if (response && response->status == 200) {
-        json j = json::parse(response->body);
-        int error_number = j["ErrorNumber"];
-        std::string error_message = j["ErrorMessage"];
-        if (error_number != 0) {
-            if (error_number == 0x0400)
-                throw NotImplementedException(error_message);
-            else if (error_number == 0x0401)
-                throw InvalidValueException(error_message);
-            else if (error_number == 0x0402)
-                throw ValueNotSetException(error_message);
-            else if (error_number == 0x0407)
-                throw NotConnectedException(error_message);
-            else if (error_number == 0x0408)
-                throw ParkedException(error_message);
-            else if (error_number == 0x0409)
-                throw SlavedException(error_message);
-            else if (error_number == 0x040B)
-                throw InvalidOperationException(error_message);
-            else if (error_number == 0x040C)
-                throw ActionNotImplementedException(error_message);
-            else if (error_number >= 0x500 && error_number <= 0xFFF)
-                throw DriverException(error_number, error_message);
-            else
-                throw DriverException(error_number, error_message);
-        }
-        return j;
-    } else {
-        throw AlpacaRequestException(
-            response ? response->status : -1,
-            response ? response->body : "Request failed");
+json Device::_put(const std::string &attribute,
+                  const std::map<std::string, std::any> &data,
+                  double tmo) const {
+    auto request = _request("PUT", tmo);
+    json json_data = json::object();
+    for (const auto &[key, value] : data) {
+        json_data[key] = toJson(value);
     }
+    request.body = json_data.dump();
+    request.headers.emplace_back("Content-Type", "application/json");
+
+    auto response = atom::web::HttpConnectionPool::shared()
+                        .request(base_url + "/" + attribute,
+                                 std::move(request))
+                        .get();
+    return checkResponse(response);
 }
 
 int Device::_client_id = std::random_device()();
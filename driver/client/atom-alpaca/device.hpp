@@ -17,9 +17,11 @@ Description: Basic Device Definition of Alpaca
 
 #include <any>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "atom/web/httppool.hpp"
 #include "json.hpp"
 using json = nlohmann::json;
 
@@ -145,10 +147,11 @@ public:
      * @param attribute The attribute to retrieve.
      * @param data The additional data to include in the request.
      * @param tmo The timeout for the request.
-     * @return The JSON response from the device.
+     * @return The "Value" field of the response.
      */
     json _get(const std::string &attribute,
-              const std::map<std::string, std::string> &data, double tmo) const;
+              const std::map<std::string, std::string> &data = {},
+              double tmo = 5.0) const;
 
     /**
      * @brief Sends a PUT request to the device with the specified attribute and
@@ -160,9 +163,17 @@ public:
      * @return The JSON response from the device.
      */
     json _put(const std::string &attribute,
-              const std::map<std::string, std::any> &data, double tmo) const;
+              const std::map<std::string, std::any> &data = {},
+              double tmo = 5.0) const;
+
+protected:
+    /**
+     * @brief Builds a pooled request carrying the Alpaca client and
+     * transaction ids.
+     */
+    atom::web::PooledRequest _request(const std::string &method,
+                                      double tmo) const;
 
-private:
     /** The address of the device. */
     std::string address;
 
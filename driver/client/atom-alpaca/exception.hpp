@@ -132,4 +132,29 @@ private:
     std::string message_;
 };
 
+/**
+ * @brief Throw the exception matching an Alpaca ErrorNumber.
+ */
+[[noreturn]] inline void throwAlpacaError(int error_number,
+                                          const std::string &error_message) {
+    if (error_number == 0x0400)
+        throw NotImplementedException(error_message);
+    else if (error_number == 0x0401)
+        throw InvalidValueException(error_message);
+    else if (error_number == 0x0402)
+        throw ValueNotSetException(error_message);
+    else if (error_number == 0x0407)
+        throw NotConnectedException(error_message);
+    else if (error_number == 0x0408)
+        throw ParkedException(error_message);
+    else if (error_number == 0x0409)
+        throw SlavedException(error_message);
+    else if (error_number == 0x040B)
+        throw InvalidOperationException(error_message);
+    else if (error_number == 0x040C)
+        throw ActionNotImplementedException(error_message);
+    else
+        throw DriverException(error_number, error_message);
+}
+
 #endif
@@ -0,0 +1,609 @@
+/*
+ * imagebytes.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-2
+
+Description: Streaming decoder for Alpaca ImageBytes and ImageArray replies
+
+**************************************************/
+
+#include "imagebytes.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace {
+/* Staging size for one block of columns before it is transposed. */
+constexpr size_t kBlockBytes = 1 << 20;
+constexpr size_t kMaxBlockColumns = 64;
+constexpr size_t kTile = 32;
+/*
+ * Servers put the data right after the metadata; a larger offset or error
+ * text is treated as a broken reply instead of being buffered.
+ */
+constexpr size_t kMaxDataStart = 1 << 16;
+constexpr size_t kMaxErrorBytes = 4096;
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * Convert little-endian samples to 8, 16 or 32 bit, clamping out of range
+ * and negative values. Loads go through memcpy because the payload has no
+ * alignment guarantee; the loop is plain enough for the compiler to
+ * vectorize it.
+ */
+template <typename Src, typename Dst>
+void convertSamples(const uint8_t *in, size_t count, Dst *out) {
+    constexpr auto kMax = std::numeric_limits<Dst>::max();
+    for (size_t i = 0; i < count; ++i) {
+        Src value;
+        std::memcpy(&value, in + i * sizeof(Src), sizeof(Src));
+        if constexpr (std::is_floating_point_v<Src>) {
+            out[i] = !(value > 0)    ? Dst(0)
+                     : value >= kMax ? kMax
+                                     : static_cast<Dst>(value + Src(0.5));
+        } else if constexpr (std::is_signed_v<Src>) {
+            auto wide = static_cast<int64_t>(value);
+            out[i] = static_cast<Dst>(wide < 0      ? 0
+                                      : wide > kMax ? kMax
+                                                    : wide);
+        } else {
+            out[i] = static_cast<Dst>(value > kMax ? kMax : value);
+        }
+    }
+}
+
+template <typename Dst>
+void convertSamples(ImageArrayElementTypes type, const uint8_t *in,
+                    size_t count, Dst *out) {
+    switch (type) {
+        case ImageArrayElementTypes::Int16:
+            return convertSamples<int16_t>(in, count, out);
+        case ImageArrayElementTypes::Int32:
+            return convertSamples<int32_t>(in, count, out);
+        case ImageArrayElementTypes::Double:
+            return convertSamples<double>(in, count, out);
+        case ImageArrayElementTypes::Single:
+            return convertSamples<float>(in, count, out);
+        case ImageArrayElementTypes::UInt64:
+            return convertSamples<uint64_t>(in, count, out);
+        case ImageArrayElementTypes::Byte:
+            return convertSamples<uint8_t>(in, count, out);
+        case ImageArrayElementTypes::Int64:
+            return convertSamples<int64_t>(in, count, out);
+        case ImageArrayElementTypes::UInt16:
+            return convertSamples<uint16_t>(in, count, out);
+        default:
+            return;
+    }
+}
+
+template <typename Dst, typename Src>
+Dst narrow(Src value) {
+    if constexpr (sizeof(Src) > sizeof(Dst)) {
+        constexpr auto kMax = std::numeric_limits<Dst>::max();
+        return static_cast<Dst>(value > kMax ? kMax : value);
+    } else {
+        return static_cast<Dst>(value);
+    }
+}
+
+/*
+ * Copy `count` columns of `height` x `planes` samples into a row-major
+ * frame `width` samples wide, starting at column x0, clamping them if the
+ * frame is narrower. Works in square tiles so both the columns and the
+ * frame rows stay in cache.
+ */
+template <typename Src, typename Dst>
+void transposeColumns(const Src *columns, size_t count, size_t height,
+                      size_t planes, Dst *frame, size_t width, size_t x0) {
+    for (size_t y0 = 0; y0 < height; y0 += kTile) {
+        size_t y1 = std::min(height, y0 + kTile);
+        for (size_t xb = 0; xb < count; xb += kTile) {
+            size_t x1 = std::min(count, xb + kTile);
+            for (size_t y = y0; y < y1; ++y) {
+                Dst *row = frame + (y * width + x0) * planes;
+                if (planes == 1) {
+                    for (size_t x = xb; x < x1; ++x) {
+                        row[x] = narrow<Dst>(columns[x * height + y]);
+                    }
+                    continue;
+                }
+                for (size_t x = xb; x < x1; ++x) {
+                    const Src *in = columns + (x * height + y) * planes;
+                    for (size_t p = 0; p < planes; ++p) {
+                        row[x * planes + p] = narrow<Dst>(in[p]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Bits needed for the values an element type can hold. Negative values are
+ * clamped to 0, so signed types need no more than their unsigned range.
+ */
+uint32_t sampleBits(ImageArrayElementTypes type) {
+    switch (type) {
+        case ImageArrayElementTypes::Byte:
+            return 8;
+        case ImageArrayElementTypes::Int16:
+        case ImageArrayElementTypes::UInt16:
+            return 16;
+        default:
+            return 32;
+    }
+}
+
+int32_t readInt32(const uint8_t *data) {
+    int32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+}  // namespace
+
+ImageMetadata ImageMetadata::parse(const uint8_t *data) {
+    ImageMetadata metadata;
+    metadata.metadata_version = readInt32(data);
+    metadata.error_number = readInt32(data + 4);
+    metadata.client_transaction_id =
+        static_cast<uint32_t>(readInt32(data + 8));
+    metadata.server_transaction_id =
+        static_cast<uint32_t>(readInt32(data + 12));
+    metadata.data_start = readInt32(data + 16);
+    metadata.image_element_type =
+        static_cast<ImageArrayElementTypes>(readInt32(data + 20));
+    metadata.transmission_element_type =
+        static_cast<ImageArrayElementTypes>(readInt32(data + 24));
+    metadata.rank = readInt32(data + 28);
+    metadata.dimension1 = readInt32(data + 32);
+    metadata.dimension2 = readInt32(data + 36);
+    metadata.dimension3 = readInt32(data + 40);
+    return metadata;
+}
+
+size_t elementSize(ImageArrayElementTypes type) {
+    switch (type) {
+        case ImageArrayElementTypes::Byte:
+            return 1;
+        case ImageArrayElementTypes::Int16:
+        case ImageArrayElementTypes::UInt16:
+            return 2;
+        case ImageArrayElementTypes::Int32:
+        case ImageArrayElementTypes::Single:
+            return 4;
+        case ImageArrayElementTypes::Double:
+        case ImageArrayElementTypes::Int64:
+        case ImageArrayElementTypes::UInt64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+ImageArrayDecoder::ImageArrayDecoder(Allocator allocate)
+    : m_allocate(std::move(allocate)) {}
+
+void ImageArrayDecoder::reset(bool binary) {
+    m_binary = binary;
+    m_failed = false;
+    m_error.clear();
+    m_metadata = ImageMetadata{};
+    m_frame.reset();
+    m_header.clear();
+    m_skipped = 0;
+    m_payload = false;
+    m_columns_done = 0;
+    m_staged = 0;
+    m_state = JsonState::OBJECT;
+    m_escape = false;
+    m_key.clear();
+    m_text.clear();
+    m_number_length = 0;
+    m_depth = 0;
+    m_columns = 0;
+    m_first_rows = 0;
+    m_first_elements = 0;
+    m_samples.clear();
+}
+
+bool ImageArrayDecoder::fail(std::string message) {
+    m_failed = true;
+    m_error = std::move(message);
+    m_frame.reset();
+    return false;
+}
+
+bool ImageArrayDecoder::feed(std::string_view chunk) {
+    if (m_failed) {
+        return false;
+    }
+    return m_binary ? feedBinary(chunk) : feedJson(chunk);
+}
+
+bool ImageArrayDecoder::startFrame(uint32_t width, uint32_t height,
+                                   uint32_t planes, uint32_t bits) {
+    atom::memory::FrameGeometry geometry{width, height, planes, bits};
+    m_frame = m_allocate ? m_allocate(geometry) : atom::memory::FrameHandle{};
+    if (!m_frame || m_frame.capacity() < geometry.bytes()) {
+        return fail("no frame buffer for a " + std::to_string(width) + "x" +
+                    std::to_string(height) + " image");
+    }
+    m_frame.setSize(geometry.bytes());
+    m_frame.info().geometry = geometry;
+    return true;
+}
+
+bool ImageArrayDecoder::feedBinary(std::string_view chunk) {
+    auto data = reinterpret_cast<const uint8_t *>(chunk.data());
+    size_t size = chunk.size();
+
+    if (!m_payload) {
+        if (m_header.size() < ImageMetadata::SIZE) {
+            size_t take = std::min(size, ImageMetadata::SIZE - m_header.size());
+            m_header.append(reinterpret_cast<const char *>(data), take);
+            data += take;
+            size -= take;
+            if (m_header.size() < ImageMetadata::SIZE) {
+                return true;
+            }
+            m_metadata = ImageMetadata::parse(
+                reinterpret_cast<const uint8_t *>(m_header.data()));
+            if (m_metadata.metadata_version != 1 ||
+                m_metadata.data_start <
+                    static_cast<int32_t>(ImageMetadata::SIZE) ||
+                static_cast<size_t>(m_metadata.data_start) > kMaxDataStart) {
+                return fail("unsupported ImageBytes metadata");
+            }
+        }
+        // Skip whatever lies between the metadata and the data
+        size_t gap = m_metadata.data_start - ImageMetadata::SIZE;
+        size_t skip = std::min(size, gap - m_skipped);
+        m_skipped += skip;
+        data += skip;
+        size -= skip;
+        if (m_skipped < gap) {
+            return true;
+        }
+        m_payload = true;
+        if (m_metadata.error_number == 0) {
+            auto &meta = m_metadata;
+            m_element = elementSize(meta.transmission_element_type);
+            bool planar = meta.rank == 3;
+            if (m_element == 0 || (meta.rank != 2 && !planar) ||
+                meta.dimension1 <= 0 || meta.dimension2 <= 0 ||
+                (planar && meta.dimension3 <= 0)) {
+                return fail("unsupported ImageBytes image");
+            }
+            uint32_t planes = planar ? meta.dimension3 : 1;
+            // The image type bounds the values even when they are sent in
+            // a wider transmission type
+            uint32_t bits =
+                std::min(sampleBits(meta.image_element_type),
+                         sampleBits(meta.transmission_element_type));
+            if (!startFrame(meta.dimension1, meta.dimension2, planes, bits)) {
+                return false;
+            }
+            m_column_bytes = static_cast<size_t>(meta.dimension2) * planes *
+                             m_element;
+            m_block_columns = std::clamp<size_t>(
+                kBlockBytes / m_column_bytes, 1, kMaxBlockColumns);
+            m_staging.resize(m_block_columns * m_column_bytes);
+            m_converted.resize(m_block_columns * meta.dimension2 * planes);
+        }
+    }
+
+    if (m_metadata.error_number != 0) {
+        m_error.append(reinterpret_cast<const char *>(data),
+                       std::min(size, kMaxErrorBytes - m_error.size()));
+        return true;
+    }
+
+    size_t width = m_metadata.dimension1;
+    while (size > 0) {
+        size_t remaining = width - m_columns_done;
+        if (m_staged == 0 && size >= m_column_bytes) {
+            // Whole columns can be converted straight from the chunk
+            size_t count = std::min({size / m_column_bytes, m_block_columns,
+                                     remaining});
+            if (count == 0) {
+                return fail("ImageBytes payload is too long");
+            }
+            flushColumns(data, count);
+            data += count * m_column_bytes;
+            size -= count * m_column_bytes;
+            continue;
+        }
+        size_t block = std::min(m_block_columns, remaining) * m_column_bytes;
+        if (block == 0) {
+            return fail("ImageBytes payload is too long");
+        }
+        size_t take = std::min(size, block - m_staged);
+        std::memcpy(m_staging.data() + m_staged, data, take);
+        m_staged += take;
+        data += take;
+        size -= take;
+        if (m_staged == block) {
+            flushColumns(m_staging.data(), block / m_column_bytes);
+            m_staged = 0;
+        }
+    }
+    return true;
+}
+
+void ImageArrayDecoder::flushColumns(const uint8_t *columns, size_t count) {
+    const auto &geometry = m_frame.info().geometry;
+    size_t samples = count * geometry.height * geometry.channels;
+    auto type = m_metadata.transmission_element_type;
+    auto flush = [&](auto *converted) {
+        using T = std::remove_pointer_t<decltype(converted)>;
+        convertSamples(type, columns, samples, converted);
+        transposeColumns(converted, count, geometry.height, geometry.channels,
+                         reinterpret_cast<T *>(m_frame.data()),
+                         geometry.width, m_columns_done);
+    };
+    if (geometry.bits_per_sample == 8) {
+        flush(reinterpret_cast<uint8_t *>(m_converted.data()));
+    } else if (geometry.bits_per_sample == 16) {
+        flush(reinterpret_cast<uint16_t *>(m_converted.data()));
+    } else {
+        flush(m_converted.data());
+    }
+    m_columns_done += count;
+}
+
+bool ImageArrayDecoder::feedJson(std::string_view chunk) {
+    for (char c : chunk) {
+        switch (m_state) {
+            case JsonState::OBJECT:
+                if (c == '{') {
+                    m_state = JsonState::KEY;
+                } else if (!isSpace(c)) {
+                    return fail("ImageArray reply is not a JSON object");
+                }
+                break;
+            case JsonState::KEY:
+                if (c == '"') {
+                    m_key.clear();
+                    m_state = JsonState::KEY_STRING;
+                } else if (c == '}') {
+                    m_state = JsonState::DONE;
+                } else if (!isSpace(c)) {
+                    return fail("bad key in ImageArray reply");
+                }
+                break;
+            case JsonState::KEY_STRING:
+                if (m_escape) {
+                    m_key += c;
+                    m_escape = false;
+                } else if (c == '\\') {
+                    m_escape = true;
+                } else if (c == '"') {
+                    m_state = JsonState::COLON;
+                } else {
+                    m_key += c;
+                }
+                break;
+            case JsonState::COLON:
+                if (c == ':') {
+                    m_state = JsonState::VALUE;
+                } else if (!isSpace(c)) {
+                    return fail("bad ImageArray reply");
+                }
+                break;
+            case JsonState::VALUE:
+                m_text.clear();
+                if (isSpace(c)) {
+                    break;
+                }
+                if (c == '"') {
+                    m_state = JsonState::STRING;
+                } else if (c == '[' && m_key == "Value") {
+                    m_depth = 1;
+                    m_state = JsonState::ARRAY;
+                } else if (c == '[' || c == '{') {
+                    m_depth = 1;
+                    m_state = JsonState::SKIP;
+                } else {
+                    m_text += c;
+                    m_state = JsonState::SCALAR;
+                }
+                break;
+            case JsonState::STRING:
+                if (m_escape) {
+                    m_text += c == 'n' ? '\n' : c == 't' ? '\t' : c;
+                    m_escape = false;
+                } else if (c == '\\') {
+                    m_escape = true;
+                } else if (c == '"') {
+                    jsonField();
+                    m_state = JsonState::AFTER;
+                } else {
+                    m_text += c;
+                }
+                break;
+            case JsonState::SCALAR:
+                if (c == ',' || c == '}' || isSpace(c)) {
+                    jsonField();
+                    m_state = c == ',' ? JsonState::KEY
+                              : c == '}' ? JsonState::DONE
+                                         : JsonState::AFTER;
+                } else {
+                    m_text += c;
+                }
+                break;
+            case JsonState::ARRAY:
+                if (!jsonArray(c)) {
+                    return false;
+                }
+                break;
+            case JsonState::SKIP:
+                if (c == '[' || c == '{') {
+                    ++m_depth;
+                } else if ((c == ']' || c == '}') && --m_depth == 0) {
+                    m_state = JsonState::AFTER;
+                }
+                break;
+            case JsonState::AFTER:
+                if (c == ',') {
+                    m_state = JsonState::KEY;
+                } else if (c == '}') {
+                    m_state = JsonState::DONE;
+                } else if (!isSpace(c)) {
+                    return fail("bad ImageArray reply");
+                }
+                break;
+            case JsonState::DONE:
+                if (!isSpace(c)) {
+                    return fail("trailing data after ImageArray reply");
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+bool ImageArrayDecoder::jsonArray(char c) {
+    if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+        c == 'e' || c == 'E') {
+        if (m_number_length == sizeof(m_number)) {
+            return fail("bad number in ImageArray");
+        }
+        m_number[m_number_length++] = c;
+        return true;
+    }
+    if (m_number_length > 0 && !jsonNumber()) {
+        return false;
+    }
+    if (c == '[') {
+        if (++m_depth > 3) {
+            return fail("ImageArray rank above 3");
+        }
+    } else if (c == ']') {
+        if (m_depth == 2) {
+            ++m_columns;
+        } else if (m_depth == 3 && m_columns == 0) {
+            ++m_first_rows;
+        }
+        if (--m_depth == 0) {
+            m_state = JsonState::AFTER;
+        }
+    } else if (c != ',' && !isSpace(c)) {
+        return fail("bad ImageArray element");
+    }
+    return true;
+}
+
+bool ImageArrayDecoder::jsonNumber() {
+    const char *first = m_number;
+    const char *last = m_number + m_number_length;
+    m_number_length = 0;
+    if (m_depth < 2) {
+        return fail("ImageArray rank below 2");
+    }
+    uint32_t sample;
+    if (std::find_if(first, last, [](char c) {
+            return c == '.' || c == 'e' || c == 'E';
+        }) == last) {
+        int64_t value;
+        if (std::from_chars(first, last, value).ptr != last) {
+            return fail("bad number in ImageArray");
+        }
+        convertSamples<int64_t>(reinterpret_cast<const uint8_t *>(&value), 1,
+                                &sample);
+    } else {
+        double value;
+        if (std::from_chars(first, last, value).ptr != last) {
+            return fail("bad number in ImageArray");
+        }
+        convertSamples<double>(reinterpret_cast<const uint8_t *>(&value), 1,
+                               &sample);
+    }
+    m_samples.push_back(sample);
+    if (m_columns == 0) {
+        ++m_first_elements;
+    }
+    return true;
+}
+
+void ImageArrayDecoder::jsonField() {
+    auto number = [this](int32_t &out) {
+        std::from_chars(m_text.data(), m_text.data() + m_text.size(), out);
+    };
+    if (m_key == "ErrorNumber") {
+        number(m_metadata.error_number);
+    } else if (m_key == "ErrorMessage") {
+        m_error = m_text;
+    } else if (m_key == "Rank") {
+        number(m_metadata.rank);
+    } else if (m_key == "Type") {
+        int32_t type = 0;
+        number(type);
+        m_metadata.image_element_type =
+            static_cast<ImageArrayElementTypes>(type);
+    }
+}
+
+bool ImageArrayDecoder::finish() {
+    if (m_failed) {
+        return false;
+    }
+    if (m_binary) {
+        if (!m_payload) {
+            return fail("truncated ImageBytes reply");
+        }
+        if (m_metadata.error_number != 0) {
+            return true;
+        }
+        if (m_staged > 0 || m_columns_done != m_frame.info().geometry.width) {
+            return fail("truncated ImageBytes payload");
+        }
+        return true;
+    }
+
+    if (m_state != JsonState::DONE) {
+        return fail("truncated ImageArray reply");
+    }
+    if (m_metadata.error_number != 0) {
+        return true;
+    }
+    size_t width = m_columns;
+    size_t height = m_first_rows > 0 ? m_first_rows : m_first_elements;
+    size_t planes = m_first_rows > 0 ? m_first_elements / m_first_rows : 1;
+    if (width == 0 || height == 0 || planes == 0 ||
+        m_samples.size() != width * height * planes) {
+        return fail("ImageArray is not rectangular");
+    }
+    m_metadata.rank = m_first_rows > 0 ? 3 : 2;
+    m_metadata.transmission_element_type = m_metadata.image_element_type;
+    m_metadata.dimension1 = static_cast<int32_t>(width);
+    m_metadata.dimension2 = static_cast<int32_t>(height);
+    m_metadata.dimension3 = m_first_rows > 0 ? static_cast<int32_t>(planes) : 0;
+    uint32_t bits = sampleBits(m_metadata.image_element_type);
+    if (!startFrame(width, height, planes, bits)) {
+        return false;
+    }
+    auto *frame = m_frame.data();
+    if (bits == 8) {
+        transposeColumns(m_samples.data(), width, height, planes, frame,
+                         width, 0);
+    } else if (bits == 16) {
+        transposeColumns(m_samples.data(), width, height, planes,
+                         reinterpret_cast<uint16_t *>(frame), width, 0);
+    } else {
+        transposeColumns(m_samples.data(), width, height, planes,
+                         reinterpret_cast<uint32_t *>(frame), width, 0);
+    }
+    return true;
+}
@@ -0,0 +1,179 @@
+/*
+ * imagebytes.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-2
+
+Description: Streaming decoder for Alpaca ImageBytes and ImageArray replies
+
+**************************************************/
+
+#ifndef ATOM_ALPACA_IMAGEBYTES_HPP
+#define ATOM_ALPACA_IMAGEBYTES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "atom/memory/framebuffer.hpp"
+
+/**
+ * @brief Element types used by ImageArray and ImageBytes.
+ */
+enum class ImageArrayElementTypes : int32_t {
+    Unknown = 0,
+    Int16 = 1,
+    Int32 = 2,
+    Double = 3,
+    Single = 4,
+    UInt64 = 5,
+    Byte = 6,
+    Int64 = 7,
+    UInt16 = 8
+};
+
+/**
+ * @brief The metadata block that starts an ImageBytes reply.
+ */
+struct ImageMetadata {
+    /** Size of the version 1 metadata block. */
+    static constexpr size_t SIZE = 44;
+
+    int32_t metadata_version = 1;
+    int32_t error_number = 0;
+    uint32_t client_transaction_id = 0;
+    uint32_t server_transaction_id = 0;
+    int32_t data_start = SIZE;
+    ImageArrayElementTypes image_element_type = ImageArrayElementTypes::Int32;
+    ImageArrayElementTypes transmission_element_type =
+        ImageArrayElementTypes::Int32;
+    int32_t rank = 2;
+    int32_t dimension1 = 0;
+    int32_t dimension2 = 0;
+    int32_t dimension3 = 0;
+
+    /**
+     * @brief Read the metadata from the first SIZE bytes of a reply.
+     */
+    static ImageMetadata parse(const uint8_t *data);
+};
+
+/**
+ * @brief Bytes per element of a transmission type, 0 if unsupported.
+ */
+size_t elementSize(ImageArrayElementTypes type);
+
+/**
+ * @brief Decodes an ImageArray download into a frame buffer as it arrives.
+ *
+ * Both the ImageBytes binary format and the JSON ImageArray reply are
+ * accepted. Samples are stored as 8, 16 or 32 bit, the smallest size that
+ * holds the range of the image element type or of the transmission type
+ * if that is narrower, so Int32 images keep their full range. Negative
+ * values, and 64 bit or floating point values beyond 32 bit, are clamped.
+ * They are transposed from Alpaca's [x][y][plane] order into row-major
+ * frames, one block of columns at a time, so the payload is never held in
+ * full and no JSON DOM is built.
+ */
+class ImageArrayDecoder {
+public:
+    /** Returns a buffer for a frame of the given geometry. */
+    using Allocator = std::function<atom::memory::FrameHandle(
+        const atom::memory::FrameGeometry &geometry)>;
+
+    explicit ImageArrayDecoder(Allocator allocate);
+
+    /**
+     * @brief Start a new reply.
+     * @param binary Whether the reply is application/imagebytes.
+     */
+    void reset(bool binary);
+
+    /**
+     * @brief Decode the next piece of the reply.
+     * @return false once the reply turned out to be malformed.
+     */
+    bool feed(std::string_view chunk);
+
+    /**
+     * @brief Finish the reply.
+     * @return Whether a complete frame or an Alpaca error was decoded.
+     */
+    bool finish();
+
+    const ImageMetadata &metadata() const { return m_metadata; }
+
+    /** The decoded frame, empty if the reply carried an error. */
+    const atom::memory::FrameHandle &frame() const { return m_frame; }
+
+    /** The Alpaca ErrorNumber of the reply. */
+    int errorNumber() const { return m_metadata.error_number; }
+
+    /** The Alpaca ErrorMessage, or what went wrong while decoding. */
+    const std::string &errorMessage() const { return m_error; }
+
+private:
+    bool fail(std::string message);
+    bool feedBinary(std::string_view chunk);
+    bool startFrame(uint32_t width, uint32_t height, uint32_t planes,
+                    uint32_t bits);
+    void flushColumns(const uint8_t *columns, size_t count);
+    bool feedJson(std::string_view chunk);
+    bool jsonArray(char c);
+    bool jsonNumber();
+    void jsonField();
+
+    Allocator m_allocate;
+    bool m_binary = true;
+    bool m_failed = false;
+    std::string m_error;
+    ImageMetadata m_metadata;
+    atom::memory::FrameHandle m_frame;
+
+    // ImageBytes
+    std::string m_header;
+    size_t m_skipped = 0;
+    bool m_payload = false;
+    size_t m_element = 0;
+    size_t m_column_bytes = 0;
+    size_t m_block_columns = 0;
+    size_t m_columns_done = 0;
+    std::vector<uint8_t> m_staging;
+    size_t m_staged = 0;
+    std::vector<uint32_t> m_converted;
+
+    // JSON ImageArray
+    enum class JsonState {
+        OBJECT,
+        KEY,
+        KEY_STRING,
+        COLON,
+        VALUE,
+        STRING,
+        SCALAR,
+        ARRAY,
+        SKIP,
+        AFTER,
+        DONE
+    };
+    JsonState m_state = JsonState::OBJECT;
+    bool m_escape = false;
+    std::string m_key;
+    std::string m_text;
+    char m_number[32] = {};
+    size_t m_number_length = 0;
+    int m_depth = 0;
+    size_t m_columns = 0;
+    size_t m_first_rows = 0;
+    size_t m_first_elements = 0;
+    std::vector<uint32_t> m_samples;
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * reply.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-1
+
+Description: Targeted parser for Alpaca property replies
+
+**************************************************/
+
+#include "reply.hpp"
+
+#include <charconv>
+#include <cstdint>
+
+namespace alpaca {
+namespace {
+constexpr auto npos = std::string_view::npos;
+
+size_t skipSpace(std::string_view s, size_t i) {
+    while (i < s.size() &&
+           (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == '\n')) {
+        ++i;
+    }
+    return i;
+}
+
+/* One past the string starting at s[i], which must be '"'. */
+size_t skipString(std::string_view s, size_t i) {
+    for (++i; i < s.size(); ++i) {
+        if (s[i] == '\\') {
+            ++i;
+        } else if (s[i] == '"') {
+            return i + 1;
+        }
+    }
+    return npos;
+}
+
+/* One past the JSON value starting at s[i]. */
+size_t skipValue(std::string_view s, size_t i) {
+    if (i >= s.size()) {
+        return npos;
+    }
+    if (s[i] == '"') {
+        return skipString(s, i);
+    }
+    if (s[i] == '[' || s[i] == '{') {
+        int depth = 0;
+        while (i < s.size()) {
+            char c = s[i];
+            if (c == '"') {
+                i = skipString(s, i);
+                if (i == npos) {
+                    return npos;
+                }
+                continue;
+            }
+            if (c == '[' || c == '{') {
+                ++depth;
+            } else if ((c == ']' || c == '}') && --depth == 0) {
+                return i + 1;
+            }
+            ++i;
+        }
+        return npos;
+    }
+    while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ']' &&
+           s[i] != ' ' && s[i] != '\t' && s[i] != '\r' && s[i] != '\n') {
+        ++i;
+    }
+    return i;
+}
+
+}  // namespace
+
+bool scanReply(std::string_view body, ReplyFields &fields) {
+    size_t i = skipSpace(body, 0);
+    if (i >= body.size() || body[i] != '{') {
+        return false;
+    }
+    i = skipSpace(body, i + 1);
+    if (i < body.size() && body[i] == '}') {
+        return true;
+    }
+    while (i < body.size() && body[i] == '"') {
+        size_t keyEnd = skipString(body, i);
+        if (keyEnd == npos) {
+            return false;
+        }
+        auto key = body.substr(i + 1, keyEnd - i - 2);
+        i = skipSpace(body, keyEnd);
+        if (i >= body.size() || body[i] != ':') {
+            return false;
+        }
+        i = skipSpace(body, i + 1);
+        size_t valueEnd = skipValue(body, i);
+        if (valueEnd == npos || valueEnd == i) {
+            return false;
+        }
+        auto value = body.substr(i, valueEnd - i);
+        if (key == "Value") {
+            fields.value = value;
+        } else if (key == "ErrorNumber") {
+            fields.error_number = value;
+        } else if (key == "ErrorMessage") {
+            fields.error_message = value;
+        }
+        i = skipSpace(body, valueEnd);
+        if (i < body.size() && body[i] == ',') {
+            i = skipSpace(body, i + 1);
+            continue;
+        }
+        return i < body.size() && body[i] == '}';
+    }
+    return false;
+}
+
+json parseValue(std::string_view raw) {
+    if (raw.empty() || raw == "null") {
+        return nullptr;
+    }
+    if (raw == "true") {
+        return true;
+    }
+    if (raw == "false") {
+        return false;
+    }
+    const char *first = raw.data();
+    const char *last = raw.data() + raw.size();
+    if (raw.front() == '"') {
+        if (raw.find('\\') == npos) {
+            return std::string(raw.substr(1, raw.size() - 2));
+        }
+    } else if (raw.find_first_of(".eE") == npos) {
+        int64_t value;
+        if (auto [ptr, ec] = std::from_chars(first, last, value);
+            ec == std::errc() && ptr == last) {
+            return value;
+        }
+    } else {
+        double value;
+        if (auto [ptr, ec] = std::from_chars(first, last, value);
+            ec == std::errc() && ptr == last) {
+            return value;
+        }
+    }
+    return json::parse(first, last);
+}
+}  // namespace alpaca
@@ -0,0 +1,56 @@
+/*
+ * reply.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-1
+
+Description: Targeted parser for Alpaca property replies
+
+**************************************************/
+
+#ifndef ATOM_ALPACA_REPLY_HPP
+#define ATOM_ALPACA_REPLY_HPP
+
+#include <string_view>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+namespace alpaca {
+/**
+ * @brief Raw text of the top level fields a property read cares about.
+ *
+ * The views point into the scanned body and are empty when the field is
+ * missing.
+ */
+struct ReplyFields {
+    std::string_view value;
+    std::string_view error_number;
+    std::string_view error_message;
+};
+
+/**
+ * @brief Walks the top level object of a reply and picks out Value,
+ * ErrorNumber and ErrorMessage.
+ *
+ * Nothing else is decoded, so reading a property does not build a DOM for
+ * the transaction ids and other bookkeeping fields. Fields of nested
+ * objects are skipped, not matched.
+ *
+ * @return false if the body is not a complete JSON object.
+ */
+bool scanReply(std::string_view body, ReplyFields &fields);
+
+/**
+ * @brief Decodes a raw JSON value. Scalars are converted directly and
+ * everything else is left to the JSON parser.
+ * @throw json::parse_error if the value is malformed.
+ */
+json parseValue(std::string_view raw);
+}  // namespace alpaca
+
+#endif
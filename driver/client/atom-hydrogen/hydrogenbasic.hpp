@@ -1,3 +1,5 @@
+#pragma once
+
 #ifdef NATIVE_HYDROGEN
 #include <libindi/baseclient.h>
 #include <libindi/basedevice.h>
@@ -7,3 +9,38 @@
 #include "hydrogen_core/property/hydrogenproperty.h"
 #include "hydrogen_core/property/hydrogenproperties.h"
 #endif
+
+#include <string>
+
+#include "atom/function/global_ptr.hpp"
+#include "atom/type/json.hpp"
+#include "device/property_cache.hpp"
+#include "utils/constant.hpp"
+
+// 把 Hydrogen 属性转换为 {"元素名": 值}
+inline nlohmann::json hydrogenToJson(const HYDROGEN::PropertyViewNumber *nvp) {
+    nlohmann::json result = nlohmann::json::object();
+    for (int i = 0; i < nvp->nnp; ++i) {
+        result[nvp->np[i].name] = nvp->np[i].value;
+    }
+    return result;
+}
+
+inline nlohmann::json hydrogenToJson(const HYDROGEN::PropertyViewSwitch *svp) {
+    nlohmann::json result = nlohmann::json::object();
+    for (int i = 0; i < svp->nsp; ++i) {
+        result[svp->sp[i].name] = svp->sp[i].s == ISS_ON;
+    }
+    return result;
+}
+
+// 把驱动收到的属性推送到设备属性缓存，读取方无需再轮询设备
+template <typename PropertyView>
+inline void pushHydrogenProperty(const std::string &device,
+                                 const PropertyView *property) {
+    if (auto cache = GetPtr<lithium::DevicePropertyCache>(
+            constants::LITHIUM_DEVICE_CACHE)) {
+        cache.value()->update(device, property->name,
+                              hydrogenToJson(property));
+    }
+}
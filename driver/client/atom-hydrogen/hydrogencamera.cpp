@@ -18,6 +18,11 @@ Description: Hydorgen Camera
 
 #include "atom/log/loguru.hpp"
 
+// Frames kept for exposures and video; each blob gets up to ten FITS
+// header blocks on top of the pixels.
+constexpr size_t FRAME_BUFFER_COUNT = 4;
+constexpr size_t FITS_HEADER_RESERVE = 10 * 2880;
+
 HydrogenCamera::HydrogenCamera(const std::string &name) : Camera(name) {
     DLOG_F(INFO, "Hydorgen camera {} init successfully", name);
     m_number_switch = std::make_unique<
@@ -27,6 +32,274 @@ HydrogenCamera::HydrogenCamera(const std::string &name) : Camera(name) {
     m_text_switch = std::make_unique<
         atom::utils::StringSwitch<HYDROGEN::PropertyViewText *>>();
 
+    m_switch_switch->registerCase(
+        "CONNECTION", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            m_connection_prop.reset(svp);
+            if (auto connectswitch = IUFindSwitch(svp, "CONNECT");
+                connectswitch->s == ISS_ON) {
+                SetVariable("connect", true);
+                is_connected.store(true);
+                DLOG_F(INFO, "{} is connected", GetName());
+            } else {
+                if (is_ready.load()) {
+                    ClearStatus();
+                    SetVariable("connect", false);
+                    is_connected.store(true);
+                    DLOG_F(INFO, "{} is disconnected", GetName());
+                }
+            }
+        });
+
+    m_switch_switch->registerCase(
+        "DEBUG", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            debug_prop.reset(svp);
+            if (auto debugswitch = IUFindSwitch(svp, "ENABLE");
+                debugswitch->s == ISS_ON) {
+                SetVariable("debug", true);
+                is_debug.store(true);
+                DLOG_F(INFO, "DEBUG mode of {} is enabled", GetName());
+            } else {
+                SetVariable("debug", false);
+                is_debug.store(false);
+                DLOG_F(INFO, "DEBUG mode of {} is disabled", GetName());
+            }
+        });
+
+    m_switch_switch->registerCase(
+        "CCD_FRAME_TYPE", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            frame_type_prop.reset(svp);
+            std::string type;
+            if (auto lightswitch = IUFindSwitch(svp, "FRAME_LIGHT");
+                lightswitch->s == ISS_ON)
+                type = "Light";
+            else if (auto darkswitch = IUFindSwitch(svp, "FRAME_DARK");
+                     darkswitch->s == ISS_ON)
+                type = "Dark";
+            else if (auto flatswitch = IUFindSwitch(svp, "FRAME_FLAT");
+                     flatswitch->s == ISS_ON)
+                type = "Flat";
+            else if (auto biasswitch = IUFindSwitch(svp, "FRAME_BIAS");
+                     biasswitch->s == ISS_ON)
+                type = "Bias";
+            SetVariable("frame_type", type);
+            frame.frame_type = type;
+            DLOG_F(INFO, "Current frame type of {} is {}", GetName(),
+                   frame.frame_type);
+        });
+
+    m_switch_switch->registerCase(
+        "CCD_TRANSFER_FORMAT", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            frame_format_prop.reset(svp);
+            std::string format;
+            if (auto fitsswitch = IUFindSwitch(svp, "FORMAT_FITS");
+                fitsswitch->s == ISS_ON)
+                format = "Fits";
+            else if (auto natswitch = IUFindSwitch(svp, "FORMAT_NATIVE");
+                     natswitch->s == ISS_ON)
+                format = "Raw";
+            else if (auto xisfswitch = IUFindSwitch(svp, "FORMAT_XISF");
+                     xisfswitch->s == ISS_ON)
+                format = "Xisf";
+            SetVariable("frame_format", format);
+            frame.frame_format = format;
+            DLOG_F(INFO, "Current frame format of {} is {}", GetName(),
+                   frame.frame_format);
+        });
+
+    m_switch_switch->registerCase(
+        "CCD_ABORT_EXPOSURE", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            abort_exposure_prop.reset(svp);
+            if (auto abortswitch = IUFindSwitch(svp, "ABORT_EXPOSURE");
+                abortswitch->s == ISS_ON) {
+                SetVariable("is_exposure", false);
+                is_exposure.store(false);
+                DLOG_F(INFO, "{} is stopped", GetName());
+            }
+        });
+
+    m_switch_switch->registerCase(
+        "UPLOAD_MODE", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            image_upload_mode_prop.reset(svp);
+            std::string mode;
+            if (auto clientswitch = IUFindSwitch(svp, "UPLOAD_CLIENT");
+                clientswitch->s == ISS_ON)
+                mode = "Client";
+            else if (auto localswitch = IUFindSwitch(svp, "UPLOAD_LOCAL");
+                     localswitch->s == ISS_ON)
+                mode = "Local";
+            else if (auto bothswitch = IUFindSwitch(svp, "UPLOAD_BOTH");
+                     bothswitch->s == ISS_ON)
+                mode = "Both";
+            frame.upload_mode = mode;
+            DLOG_F(INFO, "Current upload mode of {} is {}", GetName(),
+                   frame.upload_mode);
+        });
+
+    m_switch_switch->registerCase(
+        "CCD_FAST_TOGGLE", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            fast_read_out_prop.reset(svp);
+            if (auto enabledswitch = IUFindSwitch(svp, "HYDROGEN_ENABLED");
+                enabledswitch->s == ISS_ON) {
+                SetVariable("is_fastread", true);
+                frame.is_fastread.store(true);
+                DLOG_F(INFO, "Current fast readout mode of {} is enabled",
+                       GetName());
+            } else if (auto disabledswitch =
+                           IUFindSwitch(svp, "HYDROGEN_DISABLED");
+                       disabledswitch->s == ISS_ON) {
+                SetVariable("is_fastread", false);
+                frame.is_fastread.store(false);
+                DLOG_F(INFO, "Current fast readout mode of {} is disabled",
+                       GetName());
+            }
+        });
+
+    m_switch_switch->registerCase(
+        "CCD_VIDEO_STREAM", [this](HYDROGEN::PropertyViewSwitch *svp) {
+            video_prop.reset(svp);
+            if (auto onswitch = IUFindSwitch(svp, "STREAM_ON");
+                onswitch->s == ISS_ON) {
+                SetVariable("is_video", true);
+                is_video.store(true);
+                DLOG_F(INFO, "{} start video capture", GetName());
+            } else if (auto offswitch = IUFindSwitch(svp, "STREAM_OFF");
+                       offswitch->s == ISS_ON) {
+                SetVariable("is_video", false);
+                is_video.store(false);
+                DLOG_F(INFO, "{} stop video capture", GetName());
+            }
+        });
+
+    m_number_switch->registerCase(
+        "CCD_EXPOSURE", [this](HYDROGEN::PropertyViewNumber *nvp) {
+            const double exposure = nvp->np->value;
+            current_exposure.store(exposure);
+            DLOG_F(INFO, "Current CCD_EXPOSURE for {} is {}", GetName(),
+                   exposure);
+        });
+
+    m_number_switch->registerCase(
+        "CCD_INFO", [this](HYDROGEN::PropertyViewNumber *nvp) {
+            ccdinfo_prop.reset(nvp);
+            frame.pixel.store(IUFindNumber(nvp, "CCD_PIXEL_SIZE")->value);
+            frame.pixel_x.store(IUFindNumber(nvp, "CCD_PIXEL_SIZE_X")->value);
+            frame.pixel_y.store(IUFindNumber(nvp, "CCD_PIXEL_SIZE_Y")->value);
+            frame.max_frame_x.store(IUFindNumber(nvp, "CCD_MAX_X")->value);
+            frame.max_frame_y.store(IUFindNumber(nvp, "CCD_MAX_Y")->value);
+            frame.pixel_depth.store(
+                IUFindNumber(nvp, "CCD_BITSPERPIXEL")->value);
+
+            DLOG_F(INFO,
+                   "{} pixel {} pixel_x {} pixel_y {} max_frame_x {} "
+                   "max_frame_y {} pixel_depth {}",
+                   GetName(), frame.pixel.load(), frame.pixel_x.load(),
+                   frame.pixel_y.load(), frame.max_frame_x.load(),
+                   frame.max_frame_y.load(), frame.pixel_depth.load());
+
+            atom::memory::FrameGeometry geometry{
+                static_cast<uint32_t>(frame.max_frame_x.load()),
+                static_cast<uint32_t>(frame.max_frame_y.load()), 1,
+                static_cast<uint32_t>(frame.pixel_depth.load())};
+            if (geometry.bytes() + FITS_HEADER_RESERVE !=
+                frame_buffers.frameBytes()) {
+                frame_buffers.configure(geometry.bytes() + FITS_HEADER_RESERVE,
+                                        FRAME_BUFFER_COUNT, true);
+            }
+        });
+
+    m_number_switch->registerCase(
+        "CCD_BINNING", [this](HYDROGEN::PropertyViewNumber *nvp) {
+            hydrogen_binning_x.reset(IUFindNumber(nvp, "HOR_BIN"));
+            hydrogen_binning_y.reset(IUFindNumber(nvp, "VER_BIN"));
+            frame.binning_x.store(hydrogen_binning_x->value);
+            frame.binning_y.store(hydrogen_binning_y->value);
+            DLOG_F(INFO, "Current binning_x and y of {} are {} {}", GetName(),
+                   hydrogen_binning_x->value, hydrogen_binning_y->value);
+        });
+
+    m_number_switch->registerCase(
+        "CCD_FRAME", [this](HYDROGEN::PropertyViewNumber *nvp) {
+            hydrogen_frame_x.reset(IUFindNumber(nvp, "X"));
+            hydrogen_frame_y.reset(IUFindNumber(nvp, "Y"));
+            hydrogen_frame_width.reset(IUFindNumber(nvp, "WIDTH"));
+            hydrogen_frame_height.reset(IUFindNumber(nvp, "HEIGHT"));
+
+            frame.frame_x.store(hydrogen_frame_x->value);
+            frame.frame_y.store(hydrogen_frame_y->value);
+            frame.frame_height.store(hydrogen_frame_height->value);
+            frame.frame_width.store(hydrogen_frame_width->value);
+
+            DLOG_F(INFO, "Current frame of {} are {} {} {} {}", GetName(),
+                   hydrogen_frame_width->value, hydrogen_frame_y->value,
+                   hydrogen_frame_width->value, hydrogen_frame_height->value);
+        });
+
+    m_number_switch->registerCase(
+        "CCD_TEMPERATURE", [this](HYDROGEN::PropertyViewNumber *nvp) {
+            camera_temperature_prop.reset(nvp);
+            current_temperature.store(
+                IUFindNumber(nvp, "CCD_TEMPERATURE_VALUE")->value);
+            DLOG_F(INFO, "Current temperature of {} is {}", GetName(),
+                   current_temperature.load());
+        });
+
+    m_number_switch->registerCase(
+        "CCD_GAIN", [this](HYDROGEN::PropertyViewNumber *nvp) {
+            gain_prop.reset(nvp);
+            current_gain.store(IUFindNumber(nvp, "GAIN")->value);
+            SetVariable("gain", current_gain.load());
+            DLOG_F(INFO, "Current camera gain of {} is {}", GetName(),
+                   current_gain.load());
+        });
+
+    m_number_switch->registerCase(
+        "CCD_OFFSET", [this](HYDROGEN::PropertyViewNumber *nvp) {
+            offset_prop.reset(nvp);
+            current_offset.store(IUFindNumber(nvp, "OFFSET")->value);
+            SetVariable("offset", current_offset.load());
+            DLOG_F(INFO, "Current camera offset of {} is {}", GetName(),
+                   current_offset.load());
+        });
+
+    m_text_switch->registerCase(
+        hydrogen_camera_cmd + "CFA", [this](HYDROGEN::PropertyViewText *tvp) {
+            cfa_prop.reset(tvp);
+            cfa_type_prop.reset(IUFindText(tvp, "CFA_TYPE"));
+            if (cfa_type_prop && cfa_type_prop->text &&
+                *cfa_type_prop->text) {
+                DLOG_F(INFO, "{} CFA_TYPE is {}", GetName(),
+                       cfa_type_prop->text);
+                is_color = true;
+                SetVariable("is_color", true);
+            } else {
+                SetVariable("is_color", false);
+            }
+        });
+
+    m_text_switch->registerCase(
+        "DEVICE_PORT", [this](HYDROGEN::PropertyViewText *tvp) {
+            camera_prop.reset(tvp);
+            hydrogen_camera_port = tvp->tp->text;
+            SetVariable("port", hydrogen_camera_port);
+            DLOG_F(INFO, "Current device port of {} is {}", GetName(),
+                   camera_prop->tp->text);
+        });
+
+    m_text_switch->registerCase(
+        "DRIVER_INFO", [this](HYDROGEN::PropertyViewText *tvp) {
+            hydrogen_camera_exec = IUFindText(tvp, "DRIVER_EXEC")->text;
+            hydrogen_camera_version = IUFindText(tvp, "DRIVER_VERSION")->text;
+            hydrogen_camera_interface =
+                IUFindText(tvp, "DRIVER_INTERFACE")->text;
+            DLOG_F(INFO, "Camera Name : {} connected exec {}", GetName(),
+                   GetName(), hydrogen_camera_exec);
+        });
+
+    m_text_switch->registerCase(
+        "ACTIVE_DEVICES", [this](HYDROGEN::PropertyViewText *tvp) {
+            active_device_prop.reset(tvp);
+        });
+
     registerFunc("connect", &HydrogenCamera::connect, this);
     registerFunc("disconnect", &HydrogenCamera::disconnect, this);
     registerFunc("reconnect", &HydrogenCamera::reconnect, this);
@@ -35,7 +308,6 @@ HydrogenCamera::HydrogenCamera(const std::string &name) : Camera(name) {
     registerFunc("abortExposure", &HydrogenCamera::abortExposure, this);
     registerFunc("getExposureStatus", &HydrogenCamera::getExposureStatus, this);
     registerFunc("getExposureResult", &HydrogenCamera::getExposureResult, this);
-
 }
 
 HydrogenCamera::~HydrogenCamera() {}
@@ -177,10 +449,7 @@ void HydrogenCamera::updateProperty(HYDROGEN::Property property) {
         case HYDROGEN_BLOB: {
             // we go here every time a new blob is available
             // this is normally the image from the camera
-
-            auto bvp = property.getBLOB();
-            auto bp = bvp->at(0);
-            newBLOB(bvp);
+            newBLOB(property.getBLOB());
         } break;
         default:
             break;
@@ -188,143 +457,9 @@ void HydrogenCamera::updateProperty(HYDROGEN::Property property) {
 }
 
 void HydrogenCamera::newSwitch(HYDROGEN::PropertyViewSwitch *svp) {
-    std::string name = svp->name;
-
-    DLOG_F(INFO, "{} Received Switch: {}", GetName(), name);
-
-    if (name == "CONNECTION") {
-        m_connection_prop.reset(svp);
-        if (auto connectswitch = IUFindSwitch(svp, "CONNECT");
-            connectswitch->s == ISS_ON) {
-            SetVariable("connect", true);
-            is_connected.store(true);
-            DLOG_F(INFO, "{} is connected", GetName());
-        } else {
-            if (is_ready.load()) {
-                ClearStatus();
-                SetVariable("connect", false);
-                is_connected.store(true);
-                DLOG_F(INFO, "{} is disconnected", GetName());
-            }
-        }
-    } else if (name == "DEBUG") {
-        debug_prop.reset(svp);
-        if (auto debugswitch = IUFindSwitch(svp, "ENABLE");
-            debugswitch->s == ISS_ON) {
-            SetVariable("debug", true);
-            is_debug.store(true);
-            DLOG_F(INFO, "DEBUG mode of {} is enabled", GetName());
-        } else {
-            SetVariable("debug", false);
-            is_debug.store(false);
-            DLOG_F(INFO, "DEBUG mode of {} is disabled", GetName());
-        }
-    } else if (name == "CCD_FRAME_TYPE") {
-        frame_type_prop.reset(svp);
-        std::string type;
-        if (auto lightswitch = IUFindSwitch(svp, "FRAME_LIGHT");
-            lightswitch->s == ISS_ON)
-            type = "Light";
-        else if (auto darkswitch = IUFindSwitch(svp, "FRAME_DARK");
-                 darkswitch->s == ISS_ON)
-            type = "Dark";
-        else if (auto flatswitch = IUFindSwitch(svp, "FRAME_FLAT");
-                 flatswitch->s == ISS_ON)
-            type = "Flat";
-        else if (auto biasswitch = IUFindSwitch(svp, "FRAME_BIAS");
-                 biasswitch->s == ISS_ON)
-            type = "Bias";
-        SetVariable("frame_type", type);
-        frame.frame_type = type;
-        DLOG_F(INFO, "Current frame type of {} is {}", GetName(),
-               frame.frame_type);
-    } else if (name == "CCD_TRANSFER_FORMAT") {
-        frame_format_prop.reset(svp);
-        std::string format;
-        if (auto fitsswitch = IUFindSwitch(svp, "FORMAT_FITS");
-            fitsswitch->s == ISS_ON)
-            format = "Fits";
-        else if (auto natswitch = IUFindSwitch(svp, "FORMAT_NATIVE");
-                 natswitch->s == ISS_ON)
-            format = "Raw";
-        else if (auto xisfswitch = IUFindSwitch(svp, "FORMAT_XISF");
-                 xisfswitch->s == ISS_ON)
-            format = "Xisf";
-        SetVariable("frame_format", format);
-        frame.frame_format = format;
-        DLOG_F(INFO, "Current frame format of {} is {}", GetName(),
-               frame.frame_format);
-    } else if (name == "CCD_ABORT_EXPOSURE") {
-        abort_exposure_prop.reset(svp);
-        if (auto abortswitch = IUFindSwitch(svp, "ABORT_EXPOSURE");
-            abortswitch->s == ISS_ON) {
-            SetVariable("is_exposure", false);
-            is_exposure.store(false);
-            DLOG_F(INFO, "{} is stopped", GetName());
-        }
-    } else if (name == "UPLOAD_MODE") {
-        image_upload_mode_prop.reset(svp);
-        std::string mode;
-        if (auto clientswitch = IUFindSwitch(svp, "UPLOAD_CLIENT");
-            clientswitch->s == ISS_ON)
-            mode = "Client";
-        else if (auto localswitch = IUFindSwitch(svp, "UPLOAD_LOCAL");
-                 localswitch->s == ISS_ON)
-            mode = "Local";
-        else if (auto bothswitch = IUFindSwitch(svp, "UPLOAD_BOTH");
-                 bothswitch->s == ISS_ON)
-            mode = "Both";
-        frame.upload_mode = mode;
-        DLOG_F(INFO, "Current upload mode of {} is {}", GetName(),
-               frame.upload_mode);
-    } else if (name == "CCD_FAST_TOGGLE") {
-        fast_read_out_prop.reset(svp);
-        if (auto enabledswitch = IUFindSwitch(svp, "HYDROGEN_ENABLED");
-            enabledswitch->s == ISS_ON) {
-            SetVariable("is_fastread", true);
-            frame.is_fastread.store(true);
-            DLOG_F(INFO, "Current fast readout mode of {} is enabled",
-                   GetName());
-        } else if (auto disabledswitch = IUFindSwitch(svp, "HYDROGEN_DISABLED");
-                   disabledswitch->s == ISS_ON) {
-            SetVariable("is_fastread", false);
-            frame.is_fastread.store(false);
-            DLOG_F(INFO, "Current fast readout mode of {} is disabled",
-                   GetName());
-        }
-    } else if (name == "CCD_VIDEO_STREAM") {
-        video_prop.reset(svp);
-        if (auto onswitch = IUFindSwitch(svp, "STREAM_ON");
-            onswitch->s == ISS_ON) {
-            SetVariable("is_video", true);
-            is_video.store(true);
-            DLOG_F(INFO, "{} start video capture", GetName());
-        } else if (auto offswitch = IUFindSwitch(svp, "STREAM_OFF");
-                   offswitch->s == ISS_ON) {
-            SetVariable("is_video", false);
-            is_video.store(false);
-            DLOG_F(INFO, "{} stop video capture", GetName());
-        }
-    } else if (name == "FLIP") {
-    } else if (name == "CCD_COMPRESSION") {
-    }
-
-    else if (name == "CCD_CONTROLS") {
-    } else if (name == "CCD_CONTROLS_MODE") {
-    }
-    // The following properties are for Toup Camera
-    else if (name == "TC_FAN_CONTROL") {
-    } else if (name == "TC_FAN_Speed") {
-    } else if (name == "TC_AUTO_WB") {
-    } else if (name == "TC_HEAT_CONTROL") {
-    } else if (name == "TC_HCG_CONTROL") {
-    } else if (name == "TC_LOW_NOISE_CONTROL") {
-    }
-    /*
-    else if (PropName == "CCD_BINNING_MODE" && Proptype == HYDROGEN_SWITCH)
-    {
-    }
-    */
+    pushHydrogenProperty(GetName(), svp);
+    DLOG_F(INFO, "{} Received Switch: {}", GetName(), svp->name);
+    m_switch_switch->match(svp->name, svp);
 }
 
 void HydrogenCamera::newMessage(HYDROGEN::BaseDevice dp, int messageID) {
@@ -357,177 +492,62 @@ inline static const char *StateStr(IPState st) {
 }
 
 void HydrogenCamera::newNumber(HYDROGEN::PropertyViewNumber *nvp) {
-    using namespace std::string_literals;
-    const std::string name = nvp->name;
-    if (name == "CCD_EXPOSURE") {
-        const double exposure = nvp->np->value;
-        current_exposure.store(exposure);
-        DLOG_F(INFO, "Current CCD_EXPOSURE for {} is {}", GetName(), exposure);
-    } else if (name == "CCD_INFO") {
-        ccdinfo_prop.reset(nvp);
-        frame.pixel.store(IUFindNumber(nvp, "CCD_PIXEL_SIZE")->value);
-        frame.pixel_x.store(IUFindNumber(nvp, "CCD_PIXEL_SIZE_X")->value);
-        frame.pixel_y.store(IUFindNumber(nvp, "CCD_PIXEL_SIZE_Y")->value);
-        frame.max_frame_x.store(IUFindNumber(nvp, "CCD_MAX_X")->value);
-        frame.max_frame_y.store(IUFindNumber(nvp, "CCD_MAX_Y")->value);
-        frame.pixel_depth.store(IUFindNumber(nvp, "CCD_BITSPERPIXEL")->value);
-
-        DLOG_F(INFO,
-               "{} pixel {} pixel_x {} pixel_y {} max_frame_x {} max_frame_y "
-               "{} pixel_depth {}",
-               GetName(), frame.pixel.load(), frame.pixel_x.load(),
-               frame.pixel_y.load(), frame.max_frame_x.load(),
-               frame.max_frame_y.load(), frame.pixel_depth.load());
-    } else if (name == "CCD_BINNING") {
-        hydrogen_binning_x.reset(IUFindNumber(nvp, "HOR_BIN"));
-        hydrogen_binning_y.reset(IUFindNumber(nvp, "VER_BIN"));
-        frame.binning_x.store(hydrogen_binning_x->value);
-        frame.binning_y.store(hydrogen_binning_y->value);
-        DLOG_F(INFO, "Current binning_x and y of {} are {} {}", GetName(),
-               hydrogen_binning_x->value, hydrogen_binning_y->value);
-    } else if (name == "CCD_FRAME") {
-        hydrogen_frame_x.reset(IUFindNumber(nvp, "X"));
-        hydrogen_frame_y.reset(IUFindNumber(nvp, "Y"));
-        hydrogen_frame_width.reset(IUFindNumber(nvp, "WIDTH"));
-        hydrogen_frame_height.reset(IUFindNumber(nvp, "HEIGHT"));
-
-        frame.frame_x.store(hydrogen_frame_x->value);
-        frame.frame_y.store(hydrogen_frame_y->value);
-        frame.frame_height.store(hydrogen_frame_height->value);
-        frame.frame_width.store(hydrogen_frame_width->value);
-
-        DLOG_F(INFO, "Current frame of {} are {} {} {} {}", GetName(),
-               hydrogen_frame_width->value, hydrogen_frame_y->value,
-               hydrogen_frame_width->value, hydrogen_frame_height->value);
-    } else if (name == "CCD_TEMPERATURE") {
-        camera_temperature_prop.reset(nvp);
-        current_temperature.store(
-            IUFindNumber(nvp, "CCD_TEMPERATURE_VALUE")->value);
-        DLOG_F(INFO, "Current temperature of {} is {}", GetName(),
-               current_temperature.load());
-    } else if (name == "CCD_GAIN") {
-        gain_prop.reset(nvp);
-        current_gain.store(IUFindNumber(nvp, "GAIN")->value);
-        SetVariable("gain", current_gain.load());
-        DLOG_F(INFO, "Current camera gain of {} is {}", GetName(),
-               current_gain.load());
-    } else if (name == "CCD_OFFSET") {
-        offset_prop.reset(nvp);
-        current_offset.store(IUFindNumber(nvp, "OFFSET")->value);
-        SetVariable("offset", current_offset.load());
-        DLOG_F(INFO, "Current camera offset of {} is {}", GetName(),
-               current_offset.load());
-    }
-    /*
-     else if (name == "POLLING_PERIOD")
-    {
-        device_info["network"]["period"] = IUFindNumber(nvp,
-    "PERIOD_MS")->value; DLOG_F(INFO, "Current period of {} is {}", GetName(),
-    device_info["network"]["period"].dump());
-    }
-    else if (name == "LIMITS")
-    {
-        device_info["limits"]["maxbuffer"] = IUFindNumber(nvp,
-    "LIMITS_BUFFER_MAX")->value; DLOG_F(INFO, "Current max buffer of {} is {}",
-    GetName(), device_info["limits"]["maxbuffer"].dump());
-        device_info["limits"]["maxfps"] = IUFindNumber(nvp,
-    "LIMITS_PREVIEW_FPS")->value; DLOG_F(INFO, "Current max fps of {} is {}",
-    GetName(), device_info["limits"]["maxfps"].dump());
-    }
-    else if (name == "STREAM_DELAY")
-    {
-        device_info["video"]["delay"] = IUFindNumber(nvp,
-    "STREAM_DELAY_TIME")->value; DLOG_F(INFO, "Current stream delay of {} is
-    {}", GetName(), device_info["video"]["delay"].dump());
-    }
-    else if (name == "STREAMING_EXPOSURE")
-    {
-        device_info["video"]["exposure"] = IUFindNumber(nvp,
-    "STREAMING_EXPOSURE_VALUE")->value; DLOG_F(INFO, "Current streaming exposure
-    of {} is {}", GetName(), device_info["video"]["exposure"].dump());
-        device_info["video"]["division"] = IUFindNumber(nvp,
-    "STREAMING_DIVISOR_VALUE")->value; DLOG_F(INFO, "Current streaming division
-    of {} is {}", GetName(), device_info["video"]["division"].dump());
-    }
-    else if (name == "FPS")
-    {
-        device_info["video"]["fps"] = IUFindNumber(nvp, "EST_FPS")->value;
-        DLOG_F(INFO, "Current fps of {} is {}", GetName(),
-    device_info["video"]["fps"].dump()); device_info["video"]["avgfps"] =
-    IUFindNumber(nvp, "AVG_FPS")->value; DLOG_F(INFO, "Current average fps of {}
-    is {}", GetName(), device_info["video"]["avgfps"].dump());
-    }
-    else if (PropName == "TC_HGC_SET" && Proptype == HYDROGEN_NUMBER)
-    {
-    }
-    else if (PropName == "CCD_LEVEL_RANGE" && Proptype == HYDROGEN_NUMBER)
-    {
-    }
-
-    else if (PropName == "CCD_BLACK_BALANCE" && Proptype == HYDROGEN_NUMBER)
-    {
-    }
-    else if (PropName == "Firmware" && Proptype == HYDROGEN_NUMBER)
-    {
-    }
-    */
+    pushHydrogenProperty(GetName(), nvp);
+    m_number_switch->match(nvp->name, nvp);
 }
 
 void HydrogenCamera::newText(HYDROGEN::PropertyViewText *tvp) {
-    const std::string name = tvp->name;
-    DLOG_F(INFO, "{} Received Text: {} = {}", GetName(), name, tvp->tp->text);
-
-    if (name == hydrogen_camera_cmd + "CFA") {
-        cfa_prop.reset(tvp);
-        cfa_type_prop.reset(IUFindText(tvp, "CFA_TYPE"));
-        if (cfa_type_prop && cfa_type_prop->text && *cfa_type_prop->text) {
-            DLOG_F(INFO, "{} CFA_TYPE is {}", GetName(), cfa_type_prop->text);
-            is_color = true;
-            SetVariable("is_color", true);
-        } else {
-            SetVariable("is_color", false);
-        }
-    } else if (name == "DEVICE_PORT") {
-        camera_prop.reset(tvp);
-        hydrogen_camera_port = tvp->tp->text;
-        SetVariable("port", hydrogen_camera_port);
-        DLOG_F(INFO, "Current device port of {} is {}", GetName(),
-               camera_prop->tp->text);
-    } else if (name == "DRIVER_INFO") {
-        hydrogen_camera_exec = IUFindText(tvp, "DRIVER_EXEC")->text;
-        hydrogen_camera_version = IUFindText(tvp, "DRIVER_VERSION")->text;
-        hydrogen_camera_interface = IUFindText(tvp, "DRIVER_INTERFACE")->text;
-        DLOG_F(INFO, "Camera Name : {} connected exec {}", GetName(), GetName(),
-               hydrogen_camera_exec);
-    } else if (name == "ACTIVE_DEVICES") {
-        active_device_prop.reset(tvp);
-    }
+    DLOG_F(INFO, "{} Received Text: {} = {}", GetName(), tvp->name,
+           tvp->tp->text);
+    m_text_switch->match(tvp->name, tvp);
 }
 
 void HydrogenCamera::newBLOB(HYDROGEN::PropertyViewBlob *bp) {
     // we go here every time a new blob is available
     // this is normally the image from the camera
 
-    DLOG_F(INFO, "{} Received BLOB {} len = {} size = {}", GetName(), bp->name);
-
-    if (exposure_prop) {
-        if (bp->name == hydrogen_blob_name.c_str()) {
-            has_blob = 1;
-            // set option to receive blob and messages for the selected CCD
-            setBLOBMode(B_ALSO, GetName().c_str(), hydrogen_blob_name.c_str());
+    DLOG_F(INFO, "{} Received BLOB {}", GetName(), bp->name);
+    if (hydrogen_blob_name != bp->name) {
+        return;
+    }
+    if (!has_blob.exchange(true)) {
+        // set option to receive blob and messages for the selected CCD
+        setBLOBMode(B_ALSO, GetName().c_str(), hydrogen_blob_name.c_str());
 
 #ifdef HYDROGEN_SHARED_BLOB_SUPPORT
-            // Allow faster mode provided we don't modify the blob content or
-            // free/realloc it
-            enableDirectBlobAccess(GetName().c_str(),
-                                   hydrogen_blob_name.c_str());
+        // Allow faster mode provided we don't modify the blob content or
+        // free/realloc it
+        enableDirectBlobAccess(GetName().c_str(), hydrogen_blob_name.c_str());
 #endif
-        }
-    } else if (video_prop) {
+        return;
+    }
+
+    // The client library has already decoded the payload (or mapped the
+    // shared blob), so the pixels are copied once, straight into the ring.
+    IBLOB *blob = bp->at(0);
+    if (blob == nullptr || blob->size <= 0) {
+        return;
+    }
+    CapturedFrame captured;
+    if (!captured.store(blob, frame_buffers)) {
+        LOG_F(WARNING, "{}: no free frame buffer for a {} byte blob, dropped",
+              GetName(), blob->size);
+        return;
+    }
+    {
+        std::scoped_lock lock(m_frame_mutex);
+        m_last_frame = std::move(captured);
     }
+    is_exposure.store(false);
+}
+
+CapturedFrame HydrogenCamera::getLastFrame() const {
+    std::scoped_lock lock(m_frame_mutex);
+    return m_last_frame;
 }
 
 void HydrogenCamera::ClearStatus() {
+    has_blob = false;
     m_connection_prop = nullptr;
     exposure_prop = nullptr;
     frame_prop = nullptr;
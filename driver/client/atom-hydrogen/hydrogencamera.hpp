@@ -15,39 +15,33 @@ Description: Hydrogen Camera
 #ifndef ATOM_HYDROGEN_CAMERA_HPP
 #define ATOM_HYDROGEN_CAMERA_HPP
 
+#include <mutex>
+
 #include "atom/driver/camera.hpp"
+#include "atom/memory/framebuffer.hpp"
 #include "atom/utils/switch.hpp"
 #include "hydrogenbasic.hpp"
 
 class CapturedFrame {
 public:
-    void *m_data;
-    size_t m_size;
+    atom::memory::FrameHandle m_frame;
     char m_format[MAXHYDROGENBLOBFMT];
 
-    CapturedFrame() {
-        m_data = nullptr;
-        m_size = 0;
-        m_format[0] = 0;
-    }
-
-    ~CapturedFrame() {
-#ifdef HYDROGEN_SHARED_BLOB_SUPPORT
-        IDSharedBlobFree(m_data);
-#else
-        free(m_data);
-#endif
-    }
-
-    // Take ownership of this blob's data, so HYDROGEN won't overwrite/free the
-    // memory
-    void steal(IBLOB *bp) {
-        m_data = bp->blob;
-        m_size = bp->size;
+    CapturedFrame() { m_format[0] = 0; }
+
+    // Copy this blob into a pooled frame buffer. HYDROGEN keeps its blob
+    // allocation and reuses it for the next frame, so nothing is allocated
+    // or freed per frame and the pooled buffer is already paged in.
+    bool store(IBLOB *bp, atom::memory::FrameBufferRing &ring) {
+        auto frame = ring.tryAcquire();
+        if (!frame || static_cast<size_t>(bp->size) > frame.capacity()) {
+            return false;
+        }
+        std::memcpy(frame.data(), bp->blob, bp->size);
+        frame.setSize(bp->size);
         strncpy(m_format, bp->format, MAXHYDROGENBLOBFMT);
-
-        bp->blob = nullptr;
-        bp->size = 0;
+        m_frame = std::move(frame);
+        return true;
     }
 };
 
@@ -269,6 +263,13 @@ public:
 
     bool isFrameSettingAvailable();
 
+    /**
+     * @brief 获取最近一次收到的图像
+     *
+     * @return 图像所在的帧缓冲和格式，尚未收到图像时为空
+     */
+    CapturedFrame getLastFrame() const;
+
 protected:
     // 清空状态
     void ClearStatus();
@@ -371,13 +372,18 @@ private:
 
     // Hydrogen 指令
     std::string hydrogen_camera_cmd = "CCD_";  // Hydrogen 控制命令前缀
-    std::string hydrogen_blob_name;            // BLOB 文件名
+    std::string hydrogen_blob_name = "CCD1";   // BLOB 属性名
     std::string hydrogen_camera_exec = "";     // Hydrogen 执行命令
     std::string hydrogen_camera_version;
     std::string hydrogen_camera_interface;
     std::string hydrogen_camera_port;
 
     CameraFrame frame;
+    // Sized from CCD_INFO, plus room for the FITS header of each blob
+    atom::memory::FrameBufferRing frame_buffers;
+    // 最近一次收到的图像，由 Hydrogen 的接收线程写入
+    CapturedFrame m_last_frame;
+    mutable std::mutex m_frame_mutex;
 
     std::atomic<double> polling_period;
 
@@ -137,6 +137,7 @@ void HydrogenFilterwheel::removeDevice(HYDROGEN::BaseDevice dp) {
 }
 
 void HydrogenFilterwheel::newSwitch(HYDROGEN::PropertyViewSwitch *svp) {
+    pushHydrogenProperty(GetName(), svp);
     m_switch_switch->match(svp->name, svp);
 }
 
@@ -170,6 +171,7 @@ inline static const char *StateStr(IPState st) {
 }
 
 void HydrogenFilterwheel::newNumber(HYDROGEN::PropertyViewNumber *nvp) {
+    pushHydrogenProperty(GetName(), nvp);
     m_number_switch->match(nvp->name, nvp);
 }
 
@@ -230,6 +230,7 @@ void HydrogenFocuser::newDevice(HYDROGEN::BaseDevice dp) {
 }
 
 void HydrogenFocuser::newSwitch(HYDROGEN::PropertyViewSwitch *svp) {
+    pushHydrogenProperty(GetName(), svp);
     m_switch_switch->match(svp->name, svp);
 }
 
@@ -263,6 +264,7 @@ inline static const char *StateStr(IPState st) {
 }
 
 void HydrogenFocuser::newNumber(HYDROGEN::PropertyViewNumber *nvp) {
+    pushHydrogenProperty(GetName(), nvp);
     m_number_switch->match(nvp->name, nvp);
 }
 
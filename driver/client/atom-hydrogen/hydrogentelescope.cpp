@@ -172,6 +172,7 @@ void HydrogenTelescope::newDevice(HYDROGEN::BaseDevice dp) {
 }
 
 void HydrogenTelescope::newSwitch(HYDROGEN::PropertyViewSwitch *svp) {
+    pushHydrogenProperty(GetName(), svp);
     m_switch_switch->match(svp->name, svp);
 }
 
@@ -205,6 +206,7 @@ inline static const char *StateStr(IPState st) {
 }
 
 void HydrogenTelescope::newNumber(HYDROGEN::PropertyViewNumber *nvp) {
+    pushHydrogenProperty(GetName(), nvp);
     m_number_switch->match(nvp->name, nvp);
 }
 
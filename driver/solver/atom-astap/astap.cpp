@@ -1,13 +1,9 @@
 #include "astap.hpp"
 
-#include "atom/async/async.hpp"
 #include "atom/io/io.hpp"
 #include "atom/log/loguru.hpp"
-#include "atom/system/command.hpp"
-#include "atom/utils/cmdline.hpp"
 
-
-#include <fitsio.h>
+#include <cstdlib>
 
 AstapSolver::AstapSolver(const std::string &name) : Solver(name) {
     DLOG_F(INFO, "Initializing Astap Solver...");
@@ -28,12 +24,14 @@ bool AstapSolver::connect(const json &params) {
         return false;
     }
     SetVariable("solverPath", params["path"].get<std::string>());
+    resetService();
     DLOG_F(INFO, "Connected to Astap Solver");
     return true;
 }
 
 bool AstapSolver::disconnect(const json &params) {
     DLOG_F(INFO, "Disconnecting from Astap Solver...");
+    resetService();
     SetVariable("solverPath", "");
     DLOG_F(INFO, "Disconnected from Astap Solver");
     return true;
@@ -66,65 +64,22 @@ bool AstapSolver::solveImage(const std::string &image, const int &timeout,
         LOG_F(ERROR, "Failed to execute {}: Invalid Parameters", __func__);
         return false;
     }
-    SolveResult resu;
-    t;
-    try {
-        std::string command = makeCommand();
-
-        auto ret = Atom::Async::asyncRetry(
-            [](const std::string &cmd) -> std::string {
-                return atom::utils::executeCommand(cmd, false);
-            },
-            3, std::chrono::seconds(5), cmd);
-
-        // 等待命令执行完成，或者超时
-        auto start_time = std::chrono::system_clock::now();
-        while (ret.wait_for(std::chrono::seconds(1)) !=
-               std::future_status::ready) {
-            auto elapsed_time =
-                std::chrono::duration_cast<std::chrono::seconds>(
-                    std::chrono::system_clock::now() - start_time)
-                    .count();
-            if (elapsed_time > timeout) {
-                LOG_F(ERROR, "Error: command timed out after {} seconds.",
-                      std::to_string(timeout));
-                return "";
-            }
-        }
-
-        // 返回命令执行结果，并输出调试信息
-        auto output = ret.get();
-        DLOG_F(INFO, "Command '{}' returned: {}", cmd, output);
-
-        if (output.find("Solution found:") != std::string::npos) {
-            DLOG_F(INFO, "Solved successfully");
-            ret_struct = readSolveResult(image);
-        } else {
-            LOG_F(ERROR, "Failed to solve the image");
-            ret_struct.error = "Failed to solve the image";
-        }
-    } catch (const std::exception &e) {
-        LOG_F(ERROR, "Failed to execute {}: {}", __func__, e.what());
+    auto solution = service()->solve(makeRequest(image, timeout));
+    if (!solution.solved) {
+        LOG_F(ERROR, "Failed to solve the image: {}", solution.error);
         return false;
     }
+    DLOG_F(INFO, "Solved successfully{}", solution.cached ? " (cached)" : "");
     // 将解析结果写入JSON对象
-    if (!result.ra.empty()) {
-        SetVariable("result.ra", result.ra);
-    }
-    if (!result.dec.empty()) {
-        SetVariable("result.dec", result.dec);
+    SetVariable("result.ra", std::to_string(solution.ra));
+    SetVariable("result.dec", std::to_string(solution.dec));
+    SetVariable("result.scale", solution.scale);
+    SetVariable("result.rotation", solution.rotation);
+    if (solution.fov_x > 0) {
+        SetVariable("result.fov_x", solution.fov_x);
     }
-    if (result.fov_x > 0) {
-        SetVariable("result.fov_x", result.fov_x);
-    }
-    if (result.fov_y > 0) {
-        SetVariable("result.fov_y", result.fov_y);
-    }
-    if (result.fov_avg > 0) {
-        SetVariable("result.fov_avg", result.fov_avg);
-    }
-    if (result.rotation != 0) {
-        SetVariable("result.rotation", result.rotation);
+    if (solution.fov_y > 0) {
+        SetVariable("result.fov_y", solution.fov_y);
     }
     return true;
 }
@@ -157,108 +112,58 @@ bool AstapSolver::setSolveParams(const json &params) {
     if (params.contains("update") && params["update"].is_boolean()) {
         DLOG_F(INFO, "Setting Update {}", params["update"].get<bool>());
         status = SetVariable("update", params["update"].get<bool>());
+        resetService();
     }
     return status;
 }
 
 json AstapSolver::getSolveParams() { return json{}; }
 
-std::string AstapSolver::makeCommand() {
-    auto solverPath = GetVariable<std::string>("solverPath").value();
-    auto image = GetVariable<std::string>("imagePath").value();
-    auto ra = GetVariable<std::string>("target_ra").value();
-    auto dec = GetVariable<std::string>("target_dec").value();
-    auto fov = GetVariable<double>("fov").value();
-    auto update = GetVariable<bool>("update").value();
-
-    // Max: Here we should use cmdline.hpp to make the command
-
-    std::stringstream ss;
-    ss << solverPath << " -f " << image << "";
-    if (!ra.empty()) {
-        ss << " -ra " << ra << "";
-    }
-    if (!dec.empty()) {
-        ss << " -dec " << dec << "";
-    }
-    if (fov > 0) {
-        ss << " -fov " << fov;
-    }
-    if (update) {
-        ss << " -update";
+std::shared_ptr<SolveService> AstapSolver::service() {
+    std::lock_guard<std::mutex> lock(m_serviceMutex);
+    if (!m_service) {
+        SolveService::Options options;
+        options.kind = SolverKind::Astap;
+        options.solver_path = GetVariable<std::string>("solverPath").value();
+        if (GetVariable<bool>("update").value_or(false)) {
+            options.extra_args.push_back("-update");
+        }
+        m_service = std::make_shared<SolveService>(std::move(options));
+        m_service->start();
     }
-
-    std::string cmd = ss.str();
-    DLOG_F(INFO, "Command: {}", cmd);
-    return cmd;
+    return m_service;
 }
 
-SolveResult AstapSolver::readSolveResult(const std::string &image) {
-    SovleResult ret_struct;
-
-    // 打开 FITS 文件并读取头信息
-    fitsfile *fptr;
-    int status = 0;
-    fits_open_file(&fptr, image.c_str(), READONLY, &status);
-    if (status != 0) {
-        LOG_F(ERROR, "Failed to read FITS header: {}", image);
-        ret_struct.error = "Failed to read FITS header: " + image;
-        return ret_struct;
+void AstapSolver::resetService() {
+    std::shared_ptr<SolveService> old;
+    {
+        std::lock_guard<std::mutex> lock(m_serviceMutex);
+        old.swap(m_service);
     }
+    // 最后一个引用在锁外释放，服务的停止不会阻塞其他调用
+}
 
-    double solved_ra, solved_dec, x_pixel_arcsec, y_pixel_arcsec, rotation,
-        x_pixel_size, y_pixel_size;
-    bool data_get_flag = false;
-    char comment[FLEN_COMMENT];
-
-    // 读取头信息中的关键字
-    status = 0;
-    fits_read_key(fptr, TDOUBLE, "CRVAL1", &solved_ra, comment, &status);
-
-    status = 0;
-    fits_read_key(fptr, TDOUBLE, "CRVAL2", &solved_dec, comment, &status);
-
-    status = 0;
-    fits_read_key(fptr, TDOUBLE, "CDELT1", &x_pixel_arcsec, comment, &status);
-
-    status = 0;
-    fits_read_key(fptr, TDOUBLE, "CDELT2", &y_pixel_arcsec, comment, &status);
-
-    status = 0;
-    fits_read_key(fptr, TDOUBLE, "CROTA1", &rotation, comment, &status);
-
-    status = 0;
-    fits_read_key(fptr, TDOUBLE, "XPIXSZ", &x_pixel_size, comment, &status);
-
-    status = 0;
-    fits_read_key(fptr, TDOUBLE, "YPIXSZ", &y_pixel_size, comment, &status);
-
-    // 关闭 FITS 文件
-    fits_close_file(fptr, &status);
-    if (status != 0) {
-        LOG_F(ERROR, "Failed to close FITS file: {}", image);
-        ret_struct.error = "Failed to close FITS file: " + image;
-        return ret_struct;
+SolveRequest AstapSolver::makeRequest(const std::string &image, int timeout) {
+    SolveRequest request;
+    request.image = image;
+    request.timeout = std::chrono::seconds(timeout);
+    // ASTAP 的赤经以小时为单位
+    if (auto ra = GetVariable<std::string>("target_ra")) {
+        request.hint.ra = parseAngle(*ra, 15.0);
     }
-
-    // 构造返回结果
-    if (data_get_flag) {
-        ret_struct.ra = std::to_string(solved_ra);
-        ret_struct.dec = std::to_string(solved_dec);
-        ret_struct.rotation = std::to_string(rotation);
-        if (x_pixel_size > 0.0 && y_pixel_size > 0.0) {
-            double x_focal_length = x_pixel_size / x_pixel_arcsec * 206.625;
-            double y_focal_length = y_pixel_size / y_pixel_arcsec * 206.625;
-            double avg_focal_length = (x_focal_length + y_focal_length) / 2.0;
-            ret_struct.fov_x = x_focal_length;
-            ret_struct.fov_y = y_focal_length;
-            ret_struct.fov_avg = avg_focal_length;
-            // 调试输出
-            DLOG_F(INFO, "avg_focal_length: {}", avg_focal_length);
+    if (auto dec = GetVariable<std::string>("target_dec")) {
+        request.hint.dec = parseAngle(*dec);
+    }
+    // fov 是视场高度，换算成像素比例后同样用于缓存的匹配
+    auto fov = GetVariable<double>("fov").value_or(0);
+    if (fov > 0) {
+        auto header = readFitsHeader(image);
+        if (auto it = header.find("NAXIS2"); it != header.end()) {
+            double height = std::atof(it->second.c_str());
+            if (height > 0) {
+                request.hint.scale = fov * 3600.0 / height;
+            }
         }
-    } else {
-        LOG_F(ERROR, "Solve failed");
-        ret_struct.error = "Solve failed";
     }
-    return ret_struct;
+    return request;
 }
@@ -1,5 +1,10 @@
 #include "atom/driver/solver.hpp"
 
+#include <memory>
+#include <mutex>
+
+#include "solve_service.hpp"
+
 class AstapSolver : public Solver {
 public:
     explicit AstapSolver(const std::string &name);
@@ -25,7 +30,14 @@ public:
     virtual json getSolveParams();
 
 private:
-    std::string makeCommand();
+    std::shared_ptr<SolveService> service();
+
+    void resetService();
+
+    SolveRequest makeRequest(const std::string &image, int timeout);
 
-    SolveResult readSolveResult(const std::string &image);
+    // 在第一次解析时创建，影响命令行的参数修改后重新创建。
+    // 解析中的调用持有自己的引用，重置只换掉指针，不会销毁正在使用的服务
+    std::shared_ptr<SolveService> m_service;
+    std::mutex m_serviceMutex;
 };
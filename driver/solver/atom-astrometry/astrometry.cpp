@@ -2,9 +2,10 @@
 
 #include "atom/io/io.hpp"
 #include "atom/log/loguru.hpp"
-#include "atom/system/command.hpp"
-#include "atom/utils/cmdline.hpp"
 
+#ifdef ATOM_SOLVE_SERVICE_STARS
+#include "star_extractor.hpp"
+#endif
 
 AstrometrySolver::AstrometrySolver(const std::string &name) : Solver(name) {
     RegisterFunc("solveImage", &AstrometrySolver::_solveImage, this);
@@ -41,12 +42,14 @@ bool AstrometrySolver::connect(const json &params) {
     // Check whether the file is a executable file
 
     SetVariable("solverPath", params["path"].get<std::string>());
+    resetService();
     DLOG_F(INFO, "Connected to Astrometry Solver");
     return true;
 }
 
 bool AstrometrySolver::disconnect(const json &params) {
     DLOG_F(INFO, "Disconnecting from Astrometry Solver...");
+    resetService();
     SetVariable("solverPath", "");
     DLOG_F(INFO, "Disconnected from Astrometry Solver");
     return true;
@@ -79,32 +82,24 @@ bool AstrometrySolver::solveImage(const std::string &image, const int &timeout,
         LOG_F(ERROR, "Failed to execute {}: Invalid Parameters", __func__);
         return false;
     }
-    SolveResult result;
-    try {
-        std::string command = makeCommand();
-
-        std::string output = Atom::System::executeCommand(command, false);
-
-        result = parseOutput(output);
-    } catch (const std::exception &e) {
-        LOG_F(ERROR, "Failed to execute {}: {}", __func__, e.what());
+    auto solution = service()->solve(makeRequest(image, timeout));
+    if (!solution.solved) {
+        LOG_F(ERROR, "Failed to solve the image: {}", solution.error);
         return false;
     }
+    DLOG_F(INFO, "Solved successfully{}{}",
+           solution.used_xylist ? " from extracted stars" : "",
+           solution.cached ? " (cached)" : "");
     // 将解析结果写入JSON对象
-    if (!result.ra.empty()) {
-        SetVariable("result.ra", result.ra);
-    }
-    if (!result.dec.empty()) {
-        SetVariable("result.dec", result.dec);
-    }
-    if (result.fov_x > 0) {
-        SetVariable("result.fov_x", result.fov_x);
+    SetVariable("result.ra", std::to_string(solution.ra));
+    SetVariable("result.dec", std::to_string(solution.dec));
+    SetVariable("result.scale", solution.scale);
+    SetVariable("result.rotation", solution.rotation);
+    if (solution.fov_x > 0) {
+        SetVariable("result.fov_x", solution.fov_x);
     }
-    if (result.fov_y > 0) {
-        SetVariable("result.fov_y", result.fov_y);
-    }
-    if (result.rotation != 0) {
-        SetVariable("result.rotation", result.rotation);
+    if (solution.fov_y > 0) {
+        SetVariable("result.fov_y", solution.fov_y);
     }
     return true;
 }
@@ -122,6 +117,8 @@ bool AstrometrySolver::getSolveStatus(const int &timeout, const bool &debug) {
 bool AstrometrySolver::setSolveParams(const json &params) {
     DLOG_F(INFO, "Setting Solve Parameters...");
     bool status = true;
+    // 坐标和半径只是每次请求的提示，其余参数改变命令行，需要重新创建服务
+    bool rebuild = false;
     if (params.contains("ra") && params["ra"].is_string()) {
         DLOG_F(INFO, "Setting Target RA {}", params["ra"].get<std::string>());
         status = SetVariable("target_ra", params["ra"].get<std::string>());
@@ -138,6 +135,7 @@ bool AstrometrySolver::setSolveParams(const json &params) {
     if (params.contains("downsample") && params["downsample"].is_number()) {
         DLOG_F(INFO, "Setting Downsample {}", params["downsample"].get<int>());
         status = SetVariable("downsample", params["downsample"].get<int>());
+        rebuild = true;
     }
     if (params.contains("depth") && params["depth"].is_array()) {
         for (auto &i : params["depth"].get<std::vector<int>>()) {
@@ -150,11 +148,13 @@ bool AstrometrySolver::setSolveParams(const json &params) {
     if (params.contains("scale_low") && params["scale_low"].is_number()) {
         DLOG_F(INFO, "Setting Scale Low {}", params["scale_low"].get<double>());
         status = SetVariable("scale_low", params["scale_low"].get<double>());
+        rebuild = true;
     }
     if (params.contains("scale_high") && params["scale_high"].is_number()) {
         DLOG_F(INFO, "Setting Scale High {}",
                params["scale_high"].get<double>());
         status = SetVariable("scale_high", params["scale_high"].get<double>());
+        rebuild = true;
     }
     if (params.contains("width") && params["width"].is_number()) {
         DLOG_F(INFO, "Setting Width {}", params["width"].get<int>());
@@ -169,6 +169,7 @@ bool AstrometrySolver::setSolveParams(const json &params) {
                params["scale_units"].get<std::string>());
         status = SetVariable("scale_units",
                              params["scale_units"].get<std::string>());
+        rebuild = true;
     }
     if (params.contains("overwrite") && params["overwrite"].is_boolean()) {
         DLOG_F(INFO, "Setting Overwrite {}", params["overwrite"].get<bool>());
@@ -181,122 +182,96 @@ bool AstrometrySolver::setSolveParams(const json &params) {
     if (params.contains("verify") && params["verify"].is_boolean()) {
         DLOG_F(INFO, "Setting Verify {}", params["verify"].get<bool>());
         status = SetVariable("verify", params["verify"].get<bool>());
+        rebuild = true;
+    }
+    if (rebuild) {
+        resetService();
     }
     return status;
 }
 
 json AstrometrySolver::getSolveParams() { return json{}; }
 
-std::string AstrometrySolver::makeCommand() {
-    auto solverPath = GetVariable<std::string>("solverPath").value();
-    auto image = GetVariable<std::string>("imagePath").value();
-    auto ra = GetVariable<std::string>("target_ra").value();
-    auto dec = GetVariable<std::string>("target_dec").value();
-    auto radius = GetVariable<double>("radius").value();
-    auto downsample = GetVariable<int>("downsample").value();
-    auto depth = GetVariable<std::vector<int>>("depth").value();
-    auto scale_low = GetVariable<double>("scale_low").value();
-    auto scale_high = GetVariable<double>("scale_high").value();
-    auto width = GetVariable<int>("width").value();
-    auto height = GetVariable<int>("height").value();
-    auto scale_units = GetVariable<std::string>("scale_units").value();
-    auto overwrite = GetVariable<bool>("overwrite").value();
-    auto no_plot = GetVariable<bool>("no_plot").value();
-    auto verify = GetVariable<bool>("verify").value();
-
-    // Max: Here we should use cmdline.hpp to make the command
-
-    std::stringstream ss;
-    ss << solverPath << " \"" << image << "\"";
-    if (!ra.empty()) {
-        ss << " --ra \"" << ra << "\"";
-    }
-    if (!dec.empty()) {
-        ss << " --dec \"" << dec << "\"";
-    }
-    if (radius > 0) {
-        ss << " --radius " << radius;
-    }
-    if (downsample != 1) {
-        ss << " --downsample " << downsample;
-    }
-    if (!depth.empty()) {
-        ss << " --depth " << depth[0] << "," << depth[1];
-    }
-    if (scale_low > 0) {
-        ss << " --scale-low " << scale_low;
-    }
-    if (scale_high > 0) {
-        ss << " --scale-high " << scale_high;
-    }
-    if (width > 0) {
-        ss << " --width " << width;
-    }
-    if (height > 0) {
-        ss << " --height " << height;
-    }
-    if (!scale_units.empty()) {
-        ss << " --scale-units \"" << scale_units << "\"";
-    }
-    if (overwrite) {
-        ss << " --overwrite";
-    }
-    if (no_plot) {
-        ss << " --no-plot";
-    }
-    if (verify) {
-        ss << " --verify";
-    }
-
-    std::string cmd = ss.str();
-    DLOG_F(INFO, "Command: {}", cmd);
-    return cmd;
-}
-
-SolveResult AstrometrySolver::parseOutput(const std::string &output) {
-    SolveResult result;
-    std::unordered_map<std::string, std::string> tokens;
-    std::istringstream ss(output);
-    std::string line;
-    while (std::getline(ss, line)) {
-        // 解析命令行输出结果中的每一行
-        std::string key, value;
-        auto pos = line.find(": ");
-        if (pos != std::string::npos) {
-            key = line.substr(0, pos);
-            value = line.substr(pos + 2);
-        } else {
-            key = line;
-            value = "";
+std::shared_ptr<SolveService> AstrometrySolver::service() {
+    std::lock_guard<std::mutex> lock(m_serviceMutex);
+    if (!m_service) {
+        SolveService::Options options;
+        options.kind = SolverKind::Astrometry;
+        options.solver_path = GetVariable<std::string>("solverPath").value();
+#ifdef ATOM_SOLVE_SERVICE_STARS
+        options.extractor = makeImageStarExtractor();
+#endif
+        auto downsample = GetVariable<int>("downsample").value_or(1);
+        if (downsample > 1) {
+            options.extra_args.insert(options.extra_args.end(),
+                                      {"--downsample",
+                                       std::to_string(downsample)});
         }
-        key.erase(
-            std::remove_if(key.begin(), key.end(),
-                           [](unsigned char c) { return !std::isalnum(c); }),
-            key.end());
-        tokens[key] = value;
-    }
-
-    // 提取解析出的参数
-    auto iter = tokens.find("FieldcenterRAHMSDecDMS");
-    if (iter != tokens.end()) {
-        auto pos = iter->second.find(",");
-        if (pos != std::string::npos) {
-            result.ra = iter->second.substr(0, pos);
-            result.dec = iter->second.substr(pos + 1);
+        auto depth = GetVariable<std::vector<int>>("depth").value_or(
+            std::vector<int>{});
+        if (depth.size() >= 2) {
+            options.extra_args.insert(
+                options.extra_args.end(),
+                {"--depth",
+                 std::to_string(depth[0]) + "," + std::to_string(depth[1])});
         }
-    }
-    iter = tokens.find("Fieldsize");
-    if (iter != tokens.end()) {
-        auto pos = iter->second.find("x");
-        if (pos != std::string::npos) {
-            result.fov_x = std::stod(iter->second.substr(0, pos));
-            result.fov_y = std::stod(iter->second.substr(pos + 1));
+        // arcsecperpix 的范围作为提示交给服务，其他单位原样传给 solve-field
+        auto scale_low = GetVariable<double>("scale_low").value_or(0);
+        auto scale_high = GetVariable<double>("scale_high").value_or(0);
+        auto scale_units =
+            GetVariable<std::string>("scale_units").value_or("");
+        if (scale_low > 0 && scale_high > scale_low) {
+            if (scale_units == "arcsecperpix") {
+                options.scale_tolerance =
+                    (scale_high - scale_low) / (scale_high + scale_low);
+            } else if (!scale_units.empty()) {
+                options.extra_args.insert(
+                    options.extra_args.end(),
+                    {"--scale-units", scale_units, "--scale-low",
+                     std::to_string(scale_low), "--scale-high",
+                     std::to_string(scale_high)});
+            }
+        }
+        if (GetVariable<bool>("verify").value_or(false)) {
+            options.extra_args.push_back("--verify");
         }
+        m_service = std::make_shared<SolveService>(std::move(options));
+        m_service->start();
     }
-    iter = tokens.find("Fieldrotationangleupisdegrees");
-    if (iter != tokens.end()) {
-        result.rotation = std::stod(iter->second);
+    return m_service;
+}
+
+void AstrometrySolver::resetService() {
+    std::shared_ptr<SolveService> old;
+    {
+        std::lock_guard<std::mutex> lock(m_serviceMutex);
+        old.swap(m_service);
     }
+    // 最后一个引用在锁外释放，服务的停止不会阻塞其他调用
+}
 
-    return result;
+SolveRequest AstrometrySolver::makeRequest(const std::string &image,
+                                           int timeout) {
+    SolveRequest request;
+    request.image = image;
+    request.timeout = std::chrono::seconds(timeout);
+    // 与 solve-field 相同，六十进制的赤经以小时为单位，十进制的以度为单位
+    if (auto ra = GetVariable<std::string>("target_ra")) {
+        bool sexagesimal = ra->find_first_of(": ") != std::string::npos;
+        request.hint.ra = parseAngle(*ra, sexagesimal ? 15.0 : 1.0);
+    }
+    if (auto dec = GetVariable<std::string>("target_dec")) {
+        request.hint.dec = parseAngle(*dec);
+    }
+    if (auto radius = GetVariable<double>("radius"); radius && *radius > 0) {
+        request.hint.radius = radius;
+    }
+    auto scale_low = GetVariable<double>("scale_low").value_or(0);
+    auto scale_high = GetVariable<double>("scale_high").value_or(0);
+    if (scale_low > 0 && scale_high > scale_low &&
+        GetVariable<std::string>("scale_units").value_or("") ==
+            "arcsecperpix") {
+        request.hint.scale = (scale_low + scale_high) / 2.0;
+    }
+    return request;
 }
@@ -0,0 +1,782 @@
+/*
+ * solve_service.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-6
+
+Description: Queued plate solving with hints, a process limit and a cache
+
+**************************************************/
+
+#include "solve_service.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "atom/log/loguru.hpp"
+
+extern char **environ;
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr size_t FITS_BLOCK = 2880;
+constexpr size_t FITS_CARD = 80;
+constexpr double BLIND_RADIUS = 180.0;
+
+std::string trim(std::string_view text) {
+    auto begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    auto end = text.find_last_not_of(" \t\r\n");
+    return std::string(text.substr(begin, end - begin + 1));
+}
+
+std::optional<double> toDouble(const std::map<std::string, std::string> &keys,
+                               const std::string &name) {
+    auto it = keys.find(name);
+    if (it == keys.end() || it->second.empty()) {
+        return std::nullopt;
+    }
+    char *end = nullptr;
+    double value = std::strtod(it->second.c_str(), &end);
+    if (end == it->second.c_str()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+double angularDistance(double ra1, double dec1, double ra2, double dec2) {
+    constexpr double RADIAN = M_PI / 180.0;
+    double cosine = std::sin(dec1 * RADIAN) * std::sin(dec2 * RADIAN) +
+                    std::cos(dec1 * RADIAN) * std::cos(dec2 * RADIAN) *
+                        std::cos((ra1 - ra2) * RADIAN);
+    return std::acos(std::clamp(cosine, -1.0, 1.0)) / RADIAN;
+}
+
+std::string format(double value) {
+    std::ostringstream ss;
+    ss.precision(10);
+    ss << value;
+    return ss.str();
+}
+
+// FNV-1a，按 8 字节一组读入，大图像也只需要一次顺序读取
+std::optional<uint64_t> hashFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    uint64_t hash = 14695981039346656037ULL;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        auto got = static_cast<size_t>(file.gcount());
+        size_t i = 0;
+        for (; i + 8 <= got; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, 8);
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        for (; i < got; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(buffer[i])) *
+                   1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+std::string fitsCard(std::string_view key, std::string_view value) {
+    std::string card(key);
+    card.resize(8, ' ');
+    if (!value.empty()) {
+        card += "= ";
+        if (value.front() == '\'') {
+            card += value;
+        } else {
+            // 定长格式：数值右对齐到第 30 列
+            card.append(20 - std::min<size_t>(20, value.size()), ' ');
+            card += value;
+        }
+    }
+    card.resize(FITS_CARD, ' ');
+    return card;
+}
+
+std::string fitsString(std::string_view value) {
+    std::string text(value);
+    text.resize(std::max<size_t>(8, text.size()), ' ');
+    return "'" + text + "'";
+}
+
+void padBlock(std::string &data, char fill) {
+    if (auto rest = data.size() % FITS_BLOCK; rest != 0) {
+        data.append(FITS_BLOCK - rest, fill);
+    }
+}
+
+void appendFloat(std::string &data, double value) {
+    auto bits = std::bit_cast<uint32_t>(static_cast<float>(value));
+    if constexpr (std::endian::native == std::endian::little) {
+        bits = __builtin_bswap32(bits);
+    }
+    data.append(reinterpret_cast<const char *>(&bits), sizeof(bits));
+}
+
+std::map<std::string, std::string> readIni(const fs::path &path) {
+    std::map<std::string, std::string> keys;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (auto pos = line.find('='); pos != std::string::npos) {
+            keys[trim(std::string_view(line).substr(0, pos))] =
+                trim(std::string_view(line).substr(pos + 1));
+        }
+    }
+    return keys;
+}
+
+std::shared_future<PlateSolution> failed(std::string error) {
+    std::promise<PlateSolution> promise;
+    PlateSolution solution;
+    solution.error = std::move(error);
+    promise.set_value(std::move(solution));
+    return promise.get_future().share();
+}
+}  // namespace
+
+json PlateSolution::toJson() const {
+    return {{"solved", solved},
+            {"ra", ra},
+            {"dec", dec},
+            {"scale", scale},
+            {"rotation", rotation},
+            {"fov_x", fov_x},
+            {"fov_y", fov_y},
+            {"cached", cached},
+            {"used_xylist", used_xylist},
+            {"error", error}};
+}
+
+std::map<std::string, std::string> readFitsHeader(const fs::path &path) {
+    std::map<std::string, std::string> keys;
+    std::ifstream file(path, std::ios::binary);
+    char card[FITS_CARD];
+    // 头最多读 100 个块，防止读入损坏文件的全部数据
+    for (size_t i = 0; i < 100 * FITS_BLOCK / FITS_CARD; ++i) {
+        if (!file.read(card, FITS_CARD)) {
+            return {};
+        }
+        std::string_view line(card, FITS_CARD);
+        auto key = trim(line.substr(0, 8));
+        if (i == 0 && key != "SIMPLE") {
+            return {};
+        }
+        if (key == "END") {
+            return keys;
+        }
+        if (line.substr(8, 2) != "= ") {
+            continue;
+        }
+        auto value = line.substr(10);
+        auto begin = value.find_first_not_of(' ');
+        if (begin == std::string_view::npos) {
+            continue;
+        }
+        value.remove_prefix(begin);
+        if (value.front() == '\'') {
+            std::string text;
+            for (size_t j = 1; j < value.size(); ++j) {
+                if (value[j] == '\'') {
+                    if (j + 1 < value.size() && value[j + 1] == '\'') {
+                        text += '\'';
+                        ++j;
+                        continue;
+                    }
+                    break;
+                }
+                text += value[j];
+            }
+            keys[key] = trim(text);
+        } else {
+            keys[key] = trim(value.substr(0, value.find('/')));
+        }
+    }
+    return {};
+}
+
+bool writeXYList(const fs::path &path, const StarList &list) {
+    std::string data;
+    data += fitsCard("SIMPLE", "T");
+    data += fitsCard("BITPIX", "8");
+    data += fitsCard("NAXIS", "0");
+    data += fitsCard("EXTEND", "T");
+    data += fitsCard("END", "");
+    padBlock(data, ' ');
+
+    data += fitsCard("XTENSION", fitsString("BINTABLE"));
+    data += fitsCard("BITPIX", "8");
+    data += fitsCard("NAXIS", "2");
+    data += fitsCard("NAXIS1", "12");
+    data += fitsCard("NAXIS2", std::to_string(list.stars.size()));
+    data += fitsCard("PCOUNT", "0");
+    data += fitsCard("GCOUNT", "1");
+    data += fitsCard("TFIELDS", "3");
+    data += fitsCard("TTYPE1", fitsString("X"));
+    data += fitsCard("TFORM1", fitsString("E"));
+    data += fitsCard("TTYPE2", fitsString("Y"));
+    data += fitsCard("TFORM2", fitsString("E"));
+    data += fitsCard("TTYPE3", fitsString("FLUX"));
+    data += fitsCard("TFORM3", fitsString("E"));
+    data += fitsCard("IMAGEW", std::to_string(list.width));
+    data += fitsCard("IMAGEH", std::to_string(list.height));
+    data += fitsCard("END", "");
+    padBlock(data, ' ');
+
+    for (const auto &star : list.stars) {
+        appendFloat(data, star.x + 1.0);
+        appendFloat(data, star.y + 1.0);
+        appendFloat(data, star.flux);
+    }
+    padBlock(data, '\0');
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    return static_cast<bool>(file);
+}
+
+std::optional<double> parseAngle(std::string_view text, double unit) {
+    auto value = trim(text);
+    if (value.empty()) {
+        return std::nullopt;
+    }
+    double sign = 1.0;
+    if (value.front() == '-' || value.front() == '+') {
+        sign = value.front() == '-' ? -1.0 : 1.0;
+        value.erase(0, 1);
+    }
+    std::replace(value.begin(), value.end(), ':', ' ');
+    std::istringstream ss(value);
+    double parts[3] = {0, 0, 0};
+    size_t count = 0;
+    std::string part;
+    while (ss >> part) {
+        if (count == 3) {
+            return std::nullopt;
+        }
+        char *end = nullptr;
+        parts[count] = std::strtod(part.c_str(), &end);
+        if (*end != '\0' || parts[count] < 0) {
+            return std::nullopt;
+        }
+        ++count;
+    }
+    if (count == 0) {
+        return std::nullopt;
+    }
+    return sign * (parts[0] + parts[1] / 60.0 + parts[2] / 3600.0) * unit;
+}
+
+SolveService::SolveService(Options options) : m_options(std::move(options)) {
+    if (m_options.work_dir.empty()) {
+        m_options.work_dir = fs::temp_directory_path() / "lithium-solve";
+    }
+    m_options.max_processes = std::max<size_t>(1, m_options.max_processes);
+}
+
+SolveService::~SolveService() { stop(); }
+
+bool SolveService::start() {
+    if (m_running.exchange(true)) {
+        return true;
+    }
+    std::error_code ec;
+    fs::create_directories(m_options.work_dir, ec);
+    if (ec) {
+        LOG_F(ERROR, "Failed to create solver work directory {}: {}",
+              m_options.work_dir.string(), ec.message());
+        m_running = false;
+        return false;
+    }
+    for (size_t i = 0; i < m_options.max_processes; ++i) {
+        m_workers.emplace_back([this] { worker(); });
+    }
+    DLOG_F(INFO, "Solve service started with {} solver processes",
+           m_options.max_processes);
+    return true;
+}
+
+void SolveService::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running.exchange(false)) {
+            return;
+        }
+    }
+    m_queue_cv.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &job : m_queue) {
+        PlateSolution solution;
+        solution.error = "Solve service stopped";
+        job.promise.set_value(std::move(solution));
+    }
+    m_queue.clear();
+}
+
+std::shared_future<PlateSolution> SolveService::submit(SolveRequest request) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_running) {
+        return failed("Solve service is not running");
+    }
+    if (m_queue.size() >= m_options.max_queue) {
+        LOG_F(WARNING, "Solve queue is full, rejecting {}", request.image);
+        return failed("Solve queue is full");
+    }
+    auto &job = m_queue.emplace_back();
+    job.request = std::move(request);
+    auto future = job.promise.get_future().share();
+    lock.unlock();
+    m_queue_cv.notify_one();
+    return future;
+}
+
+PlateSolution SolveService::solve(SolveRequest request) {
+    return submit(std::move(request)).get();
+}
+
+std::optional<PlateSolution> SolveService::lastSolution() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_last;
+}
+
+void SolveService::clearCache() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cache.clear();
+    m_cache_index.clear();
+}
+
+SolveService::Statistics SolveService::statistics() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto statistics = m_statistics;
+    statistics.queued = m_queue.size();
+    return statistics;
+}
+
+void SolveService::worker() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queue_cv.wait(lock,
+                            [this] { return !m_running || !m_queue.empty(); });
+            if (!m_running) {
+                return;
+            }
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        PlateSolution solution;
+        try {
+            solution = process(job.request);
+        } catch (const std::exception &e) {
+            LOG_F(ERROR, "Failed to solve {}: {}", job.request.image, e.what());
+            solution.error = e.what();
+        }
+        job.promise.set_value(std::move(solution));
+    }
+}
+
+PlateSolution SolveService::process(const SolveRequest &request) {
+    auto hash = hashFile(request.image);
+    if (!hash) {
+        LOG_F(ERROR, "Failed to read image {}", request.image);
+        PlateSolution solution;
+        solution.error = "Failed to read image " + request.image;
+        return solution;
+    }
+    auto region = resolve(request.hint, request.use_last);
+    auto key = requestKey(*hash, region);
+
+    std::promise<PlateSolution> promise;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (auto solution = cached(*hash, region)) {
+            ++m_statistics.cache_hits;
+            return *solution;
+        }
+        if (auto it = m_inflight.find(key); it != m_inflight.end()) {
+            auto future = it->second;
+            lock.unlock();
+            auto solution = future.get();
+            solution.cached = solution.solved;
+            return solution;
+        }
+        m_inflight.emplace(key, promise.get_future().share());
+    }
+
+    PlateSolution solution;
+    try {
+        auto list = extractStars(request.image);
+        bool completed = false;
+        solution =
+            runSolver(request, region, list ? &*list : nullptr, completed);
+        if (!solution.solved && region.from_last && completed) {
+            // 上一次的解可能已经不在视场附近，例如刚刚切换了目标
+            DLOG_F(INFO, "Hinted solve of {} failed, retrying blind",
+                   request.image);
+            Region blind;
+            blind.scale = region.scale;
+            solution =
+                runSolver(request, blind, list ? &*list : nullptr, completed);
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inflight.erase(key);
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    if (!solution.solved && solution.error.empty()) {
+        solution.error = "No solution found";
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (solution.solved) {
+        remember(*hash, solution);
+        m_last = solution;
+    }
+    m_inflight.erase(key);
+    promise.set_value(solution);
+    return solution;
+}
+
+SolveService::Region SolveService::resolve(const SolveHint &hint,
+                                           bool use_last) const {
+    Region region;
+    region.scale = hint.scale;
+    if (hint.ra && hint.dec) {
+        region.ra = hint.ra;
+        region.dec = hint.dec;
+        region.radius = hint.radius.value_or(m_options.hint_radius);
+        return region;
+    }
+    if (!use_last) {
+        return region;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_last) {
+        region.ra = m_last->ra;
+        region.dec = m_last->dec;
+        region.radius = hint.radius.value_or(m_options.hint_radius);
+        region.from_last = true;
+        if (!region.scale && m_last->scale > 0) {
+            region.scale = m_last->scale;
+        }
+    }
+    return region;
+}
+
+std::string SolveService::requestKey(uint64_t hash,
+                                     const Region &region) const {
+    std::ostringstream key;
+    key << std::hex << hash << std::dec;
+    if (region.blind()) {
+        key << "/blind";
+    } else {
+        // 半径的四分之一为一格，同一格内的提示搜索的是同一片天区
+        double step = std::max(region.radius / 4.0, 0.01);
+        key << '/' << std::lround(*region.ra / step) << ','
+            << std::lround(*region.dec / step) << ','
+            << std::lround(region.radius * 100);
+    }
+    if (region.scale) {
+        key << '/' << std::lround(*region.scale * 100);
+    }
+    return key.str();
+}
+
+std::optional<PlateSolution> SolveService::cached(uint64_t hash,
+                                                  const Region &region) {
+    auto it = m_cache_index.find(hash);
+    if (it == m_cache_index.end()) {
+        return std::nullopt;
+    }
+    auto solution = it->second->second;
+    if (!region.blind() &&
+        angularDistance(*region.ra, *region.dec, solution.ra, solution.dec) >
+            region.radius) {
+        return std::nullopt;
+    }
+    if (region.scale && std::abs(solution.scale - *region.scale) >
+                            *region.scale * m_options.scale_tolerance) {
+        return std::nullopt;
+    }
+    m_cache.splice(m_cache.begin(), m_cache, it->second);
+    solution.cached = true;
+    return solution;
+}
+
+void SolveService::remember(uint64_t hash, const PlateSolution &solution) {
+    if (m_options.cache_size == 0) {
+        return;
+    }
+    if (auto it = m_cache_index.find(hash); it != m_cache_index.end()) {
+        m_cache.erase(it->second);
+        m_cache_index.erase(it);
+    }
+    m_cache.emplace_front(hash, solution);
+    m_cache_index[hash] = m_cache.begin();
+    while (m_cache.size() > m_options.cache_size) {
+        m_cache_index.erase(m_cache.back().first);
+        m_cache.pop_back();
+    }
+}
+
+std::optional<StarList> SolveService::extractStars(
+    const std::string &image) const {
+    if (m_options.kind != SolverKind::Astrometry || !m_options.extractor) {
+        return std::nullopt;
+    }
+    auto list = m_options.extractor(image);
+    if (!list || list->stars.size() < m_options.min_stars) {
+        return std::nullopt;
+    }
+    std::sort(list->stars.begin(), list->stars.end(),
+              [](const XYStar &a, const XYStar &b) { return a.flux > b.flux; });
+    if (list->stars.size() > m_options.max_stars) {
+        list->stars.resize(m_options.max_stars);
+    }
+    return list;
+}
+
+PlateSolution SolveService::runSolver(const SolveRequest &request,
+                                      const Region &region,
+                                      const StarList *list, bool &completed) {
+    // 每次运行使用单独的目录，求解器的所有输出文件随目录一起删除
+    auto directory = m_options.work_dir /
+                     ("solve-" + std::to_string(::getpid()) + "-" +
+                      std::to_string(++m_sequence));
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    auto base = directory / "solve";
+    std::string input = request.image;
+    if (list != nullptr) {
+        input = base.string() + ".xyls";
+        if (!writeXYList(input, *list)) {
+            LOG_F(WARNING, "Failed to write star list {}", input);
+            input = request.image;
+            list = nullptr;
+        }
+    }
+
+    auto argv = makeCommand(request, input, base, region, list);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_statistics.runs;
+    }
+
+    PlateSolution solution;
+    completed = runProcess(argv, request.timeout, solution.error);
+    if (completed) {
+        solution = readResult(base, request.image, list);
+    }
+    fs::remove_all(directory, ec);
+    return solution;
+}
+
+std::vector<std::string> SolveService::makeCommand(
+    const SolveRequest &request, const std::string &input,
+    const fs::path &base, const Region &region, const StarList *list) const {
+    std::vector<std::string> argv{m_options.solver_path};
+    if (m_options.kind == SolverKind::Astap) {
+        argv.insert(argv.end(), {"-f", input, "-o", base.string(), "-r",
+                                 format(region.blind() ? BLIND_RADIUS
+                                                       : region.radius)});
+        if (!region.blind()) {
+            argv.insert(argv.end(), {"-ra", format(*region.ra / 15.0), "-spd",
+                                     format(*region.dec + 90.0)});
+        }
+        // ASTAP 需要的是视场高度，0 表示自动
+        double fov = 0;
+        if (region.scale) {
+            auto header = readFitsHeader(request.image);
+            if (auto height = toDouble(header, "NAXIS2")) {
+                fov = *region.scale * *height / 3600.0;
+            }
+        }
+        argv.insert(argv.end(), {"-fov", format(fov)});
+    } else {
+        argv.insert(argv.end(),
+                    {input, "--overwrite", "--no-plots", "--new-fits", "none",
+                     "--dir", base.parent_path().string(), "--out",
+                     base.filename().string(), "--cpulimit",
+                     std::to_string(request.timeout.count())});
+        if (list != nullptr) {
+            argv.insert(argv.end(),
+                        {"--width", std::to_string(list->width), "--height",
+                         std::to_string(list->height), "--sort-column",
+                         "FLUX"});
+        }
+        if (!region.blind()) {
+            argv.insert(argv.end(),
+                        {"--ra", format(*region.ra), "--dec",
+                         format(*region.dec), "--radius",
+                         format(region.radius)});
+        }
+        if (region.scale) {
+            argv.insert(argv.end(),
+                        {"--scale-units", "arcsecperpix", "--scale-low",
+                         format(*region.scale *
+                                (1.0 - m_options.scale_tolerance)),
+                         "--scale-high",
+                         format(*region.scale *
+                                (1.0 + m_options.scale_tolerance))});
+        }
+    }
+    argv.insert(argv.end(), m_options.extra_args.begin(),
+                m_options.extra_args.end());
+    return argv;
+}
+
+PlateSolution SolveService::readResult(const fs::path &base,
+                                       const std::string &image,
+                                       const StarList *list) const {
+    PlateSolution solution;
+    std::map<std::string, std::string> keys;
+    if (m_options.kind == SolverKind::Astap) {
+        keys = readIni(base.string() + ".ini");
+        if (keys["PLTSOLVD"] != "T") {
+            solution.error = keys["ERROR"];
+            return solution;
+        }
+    } else {
+        keys = readFitsHeader(base.string() + ".wcs");
+        if (keys.empty()) {
+            return solution;
+        }
+    }
+
+    auto ra = toDouble(keys, "CRVAL1");
+    auto dec = toDouble(keys, "CRVAL2");
+    if (!ra || !dec) {
+        solution.error = "Solver result has no CRVAL1/CRVAL2";
+        return solution;
+    }
+    solution.solved = true;
+    solution.ra = *ra;
+    solution.dec = *dec;
+
+    auto cd11 = toDouble(keys, "CD1_1");
+    auto cd12 = toDouble(keys, "CD1_2");
+    auto cd21 = toDouble(keys, "CD2_1");
+    auto cd22 = toDouble(keys, "CD2_2");
+    if (cd11 && cd12 && cd21 && cd22) {
+        solution.scale =
+            std::sqrt(std::abs(*cd11 * *cd22 - *cd12 * *cd21)) * 3600.0;
+        solution.rotation = std::atan2(-*cd12, *cd22) * 180.0 / M_PI;
+    } else if (auto cdelt2 = toDouble(keys, "CDELT2")) {
+        solution.scale = std::abs(*cdelt2) * 3600.0;
+        solution.rotation = toDouble(keys, "CROTA2").value_or(0.0);
+    }
+
+    std::optional<double> width = toDouble(keys, "IMAGEW");
+    std::optional<double> height = toDouble(keys, "IMAGEH");
+    if (list != nullptr) {
+        width = list->width;
+        height = list->height;
+    } else if (!width || !height) {
+        auto header = readFitsHeader(image);
+        width = toDouble(header, "NAXIS1");
+        height = toDouble(header, "NAXIS2");
+    }
+    if (width && height) {
+        solution.fov_x = solution.scale * *width / 3600.0;
+        solution.fov_y = solution.scale * *height / 3600.0;
+    }
+    solution.used_xylist = list != nullptr;
+    return solution;
+}
+
+bool SolveService::runProcess(const std::vector<std::string> &argv,
+                              std::chrono::seconds timeout,
+                              std::string &error) {
+    std::vector<char *> args;
+    for (const auto &arg : argv) {
+        args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                     O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    // 求解器自己的子进程放在同一个进程组里，超时时一起结束
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    pid_t pid = -1;
+    int status = posix_spawnp(&pid, args[0], &actions, &attributes,
+                              args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    if (status != 0) {
+        error = "Failed to start " + argv[0] + ": " + std::strerror(status);
+        LOG_F(ERROR, "{}", error);
+        return false;
+    }
+    DLOG_F(INFO, "Started solver {} ({})", argv[0], pid);
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        pid_t done = ::waitpid(pid, &status, WNOHANG);
+        if (done == pid) {
+            break;
+        }
+        if (done < 0 && errno != EINTR) {
+            error = std::string("Failed to wait for solver: ") +
+                    std::strerror(errno);
+            return false;
+        }
+        if (!m_running || std::chrono::steady_clock::now() >= deadline) {
+            ::kill(-pid, SIGKILL);
+            ::waitpid(pid, &status, 0);
+            error = m_running ? "Solver timed out" : "Solve service stopped";
+            LOG_F(WARNING, "Solver {}: {}", pid, error);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (WIFSIGNALED(status)) {
+        error = "Solver killed by signal " + std::to_string(WTERMSIG(status));
+        return false;
+    }
+    // 没有找到解时求解器也会返回非零值，是否成功以结果文件为准
+    return true;
+}
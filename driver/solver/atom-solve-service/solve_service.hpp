@@ -0,0 +1,260 @@
+/*
+ * solve_service.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-6
+
+Description: Queued plate solving with hints, a process limit and a cache
+
+**************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "atom/type/json.hpp"
+
+using json = nlohmann::json;
+
+enum class SolverKind {
+    /** ASTAP，只接受图像 */
+    Astap,
+    /** astrometry.net 的 solve-field，可以接受 xy 星表 */
+    Astrometry
+};
+
+/**
+ * @brief 解析的提示信息，坐标和半径的单位都是度。
+ */
+struct SolveHint {
+    std::optional<double> ra;
+    std::optional<double> dec;
+    /** 搜索半径，未给出时使用 Options::hint_radius */
+    std::optional<double> radius;
+    /** 像素比例，角秒/像素 */
+    std::optional<double> scale;
+};
+
+struct SolveRequest {
+    std::string image;
+    SolveHint hint;
+    /** 没有给出坐标时以上一次成功的解作为提示 */
+    bool use_last = true;
+    std::chrono::seconds timeout{60};
+};
+
+struct PlateSolution {
+    bool solved = false;
+    /** 视场中心，度 */
+    double ra = 0;
+    double dec = 0;
+    /** 角秒/像素 */
+    double scale = 0;
+    /** 北方向相对图像 y 轴的角度，度 */
+    double rotation = 0;
+    /** 视场大小，度，无法得知图像尺寸时为 0 */
+    double fov_x = 0;
+    double fov_y = 0;
+    /** 结果来自缓存 */
+    bool cached = false;
+    /** 交给求解器的是 xy 星表而不是图像 */
+    bool used_xylist = false;
+    std::string error;
+
+    json toJson() const;
+};
+
+struct XYStar {
+    double x = 0;
+    double y = 0;
+    double flux = 0;
+};
+
+struct StarList {
+    int width = 0;
+    int height = 0;
+    std::vector<XYStar> stars;
+};
+
+/**
+ * @brief 读取 FITS 主头中的关键字，只解析头，不读取图像数据。
+ * 字符串值去掉引号，读取失败时返回空表。
+ */
+std::map<std::string, std::string> readFitsHeader(
+    const std::filesystem::path &path);
+
+/**
+ * @brief 把星点写成 astrometry.net 使用的 xyls 文件（FITS 二进制表，
+ * X、Y、FLUX 三列，坐标从 1 开始）。
+ */
+bool writeXYList(const std::filesystem::path &path, const StarList &list);
+
+/**
+ * @brief 解析十进制或六十进制（"12:30:00"、"-5 30 0"）的角度。
+ * @param unit 每个单位对应的度数，时角为 15。
+ */
+std::optional<double> parseAngle(std::string_view text, double unit = 1.0);
+
+/**
+ * @class SolveService
+ * @brief 排队执行的解析服务。
+ *
+ * 请求进入队列后由最多 max_processes 个工作线程处理，每个线程同一时间
+ * 只运行一个求解器进程。结果按图像内容的哈希和提示所在的天区缓存，居中
+ * 循环重复提交同一张图像时不会再次启动求解器，相同的请求同时到达时也只
+ * 求解一次。没有给出坐标的请求以上一次的解为中心缩小搜索半径，失败后
+ * 再做一次全天搜索。求解器支持时，星点在进程内提取，只把 xy 星表交给
+ * 求解器。
+ */
+class SolveService {
+public:
+    /**
+     * @brief 从图像中提取星点，无法提取时返回 std::nullopt。
+     */
+    using StarExtractor =
+        std::function<std::optional<StarList>(const std::string &image)>;
+
+    struct Options {
+        SolverKind kind = SolverKind::Astap;
+        std::string solver_path;
+        /** 追加到每条命令行末尾的参数 */
+        std::vector<std::string> extra_args;
+        /** 同时运行的求解器进程数 */
+        size_t max_processes = 2;
+        /** 排队请求数的上限，超过时直接返回失败 */
+        size_t max_queue = 16;
+        /** 缓存的图像数量 */
+        size_t cache_size = 64;
+        /** 有坐标提示时的默认搜索半径，度 */
+        double hint_radius = 5.0;
+        /** 像素比例提示的相对误差 */
+        double scale_tolerance = 0.1;
+        /** 临时文件目录，为空时使用系统临时目录 */
+        std::filesystem::path work_dir;
+        /** 为空时总是把图像交给求解器 */
+        StarExtractor extractor;
+        /** 星点少于此数时仍然使用图像 */
+        size_t min_stars = 10;
+        /** xy 星表中最多保留的星点数，按亮度排序 */
+        size_t max_stars = 300;
+    };
+
+    struct Statistics {
+        /** 启动的求解器进程数 */
+        size_t runs = 0;
+        size_t cache_hits = 0;
+        size_t queued = 0;
+    };
+
+    explicit SolveService(Options options);
+    ~SolveService();
+
+    SolveService(const SolveService &) = delete;
+    SolveService &operator=(const SolveService &) = delete;
+
+    bool start();
+    void stop();
+    bool isRunning() const { return m_running.load(); }
+
+    /**
+     * @brief 提交一个请求，队列已满或服务未启动时返回的结果带有 error。
+     */
+    std::shared_future<PlateSolution> submit(SolveRequest request);
+
+    /**
+     * @brief 提交并等待结果。
+     */
+    PlateSolution solve(SolveRequest request);
+
+    std::optional<PlateSolution> lastSolution() const;
+    void clearCache();
+    Statistics statistics() const;
+
+private:
+    struct Job {
+        SolveRequest request;
+        std::promise<PlateSolution> promise;
+    };
+
+    /** 解析进程实际使用的搜索区域 */
+    struct Region {
+        std::optional<double> ra;
+        std::optional<double> dec;
+        double radius = 180.0;
+        std::optional<double> scale;
+        /** 提示来自上一次的解 */
+        bool from_last = false;
+
+        bool blind() const { return !ra || !dec; }
+    };
+
+    void worker();
+    PlateSolution process(const SolveRequest &request);
+    /**
+     * @brief 提取并按亮度排序星点，求解器不支持 xy 星表或星点太少时返回
+     * std::nullopt。
+     */
+    std::optional<StarList> extractStars(const std::string &image) const;
+    /**
+     * @param list 不为空时把星表而不是图像交给求解器
+     * @param completed 求解器正常结束时为 true，无论是否找到解
+     */
+    PlateSolution runSolver(const SolveRequest &request, const Region &region,
+                            const StarList *list, bool &completed);
+    Region resolve(const SolveHint &hint, bool use_last) const;
+    std::string requestKey(uint64_t hash, const Region &region) const;
+    std::optional<PlateSolution> cached(uint64_t hash, const Region &region);
+    void remember(uint64_t hash, const PlateSolution &solution);
+    std::vector<std::string> makeCommand(const SolveRequest &request,
+                                         const std::string &input,
+                                         const std::filesystem::path &base,
+                                         const Region &region,
+                                         const StarList *list) const;
+    PlateSolution readResult(const std::filesystem::path &base,
+                             const std::string &image,
+                             const StarList *list) const;
+    bool runProcess(const std::vector<std::string> &argv,
+                    std::chrono::seconds timeout, std::string &error);
+
+    Options m_options;
+    std::vector<std::thread> m_workers;
+    std::atomic<bool> m_running{false};
+    std::atomic<uint64_t> m_sequence{0};
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queue_cv;
+    std::deque<Job> m_queue;
+    /** 正在求解的请求（图像哈希和天区），相同的请求等待同一个结果 */
+    std::unordered_map<std::string, std::shared_future<PlateSolution>>
+        m_inflight;
+    /**
+     * 按图像哈希缓存的解，表头是最近使用的。缓存的解落在请求的搜索
+     * 区域内且像素比例相符时才会返回。
+     */
+    std::list<std::pair<uint64_t, PlateSolution>> m_cache;
+    std::unordered_map<uint64_t,
+                       std::list<std::pair<uint64_t, PlateSolution>>::iterator>
+        m_cache_index;
+    std::optional<PlateSolution> m_last;
+    Statistics m_statistics;
+};
@@ -0,0 +1,89 @@
+/*
+ * star_extractor.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-6
+
+Description: Star extraction for the solve service using lithium.image
+
+**************************************************/
+
+#include "star_extractor.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "fitsio.hpp"
+#include "hfr.hpp"
+
+#include "atom/log/loguru.hpp"
+
+namespace {
+bool isFits(const std::filesystem::path &path) {
+    auto extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return extension == ".fits" || extension == ".fit" || extension == ".fts";
+}
+
+// 检测器按 8 位图像计算阈值，高位深的图像按背景和噪声拉伸到 8 位，
+// 避免个别热点把星点压到很低的灰度
+cv::Mat toEightBit(const cv::Mat &image) {
+    if (image.depth() == CV_8U) {
+        return image;
+    }
+    cv::Mat gray;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = image;
+    }
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(gray, mean, stddev);
+    double low = std::max(0.0, mean[0] - 3 * stddev[0]);
+    double high = mean[0] + 20 * stddev[0];
+    if (high <= low) {
+        high = low + 1;
+    }
+    cv::Mat result;
+    gray.convertTo(result, CV_8U, 255.0 / (high - low),
+                   -low * 255.0 / (high - low));
+    return result;
+}
+}  // namespace
+
+SolveService::StarExtractor makeImageStarExtractor() {
+    return [](const std::string &image) -> std::optional<StarList> {
+        try {
+            cv::Mat mat =
+                isFits(image)
+                    ? readFitsToMat(image)
+                    : cv::imread(image,
+                                 cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
+            if (mat.empty()) {
+                LOG_F(WARNING, "Failed to load {} for star extraction", image);
+                return std::nullopt;
+            }
+            StarList list;
+            list.width = mat.cols;
+            list.height = mat.rows;
+            for (const auto &star : DetectStars(toEightBit(mat))) {
+                list.stars.push_back({star.center.x, star.center.y, star.flux});
+            }
+            DLOG_F(INFO, "Extracted {} stars from {}", list.stars.size(),
+                   image);
+            return list;
+        } catch (const std::exception &e) {
+            LOG_F(WARNING, "Failed to extract stars from {}: {}", image,
+                  e.what());
+            return std::nullopt;
+        }
+    };
+}
@@ -0,0 +1,23 @@
+/*
+ * star_extractor.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-6
+
+Description: Star extraction for the solve service using lithium.image
+
+**************************************************/
+
+#pragma once
+
+#include "solve_service.hpp"
+
+/**
+ * @brief 使用 lithium.image 的星点检测在进程内提取星点，FITS 文件用
+ * cfitsio 读取，其他格式由 OpenCV 读取。
+ */
+SolveService::StarExtractor makeImageStarExtractor();
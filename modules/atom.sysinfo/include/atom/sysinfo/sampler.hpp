@@ -0,0 +1,175 @@
+/*
+ * sampler.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-23
+
+Description: System Information Module - Background Metrics Sampler
+
+**************************************************/
+
+#ifndef ATOM_SYSTEM_MODULE_SAMPLER_HPP
+#define ATOM_SYSTEM_MODULE_SAMPLER_HPP
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace atom::system {
+/**
+ * @brief One set of dynamic system metrics.
+ */
+struct SystemSnapshot {
+    std::chrono::system_clock::time_point timestamp;
+    /** Incremented for every sample. */
+    std::uint64_t sequence = 0;
+    /** CPU usage over the last interval, in percent. */
+    float cpuUsage = 0.0f;
+    /** Per core usage over the last interval, in percent. */
+    std::vector<float> coreUsage;
+    /** CPU temperature in degrees Celsius, 0 if unknown. */
+    float cpuTemperature = 0.0f;
+    /** Physical memory in bytes. */
+    unsigned long long memoryTotal = 0;
+    unsigned long long memoryAvailable = 0;
+    /** Physical memory in use, in percent. */
+    float memoryUsage = 0.0f;
+    /** Swap in bytes. */
+    unsigned long long swapTotal = 0;
+    unsigned long long swapUsed = 0;
+};
+
+/**
+ * @brief Metrics kept in the history ring.
+ */
+enum class Metric { CpuUsage, CpuTemperature, MemoryUsage, SwapUsage, Count };
+
+/**
+ * @brief Parse a metric name (`cpu_usage`, `cpu_temperature`,
+ * `memory_usage`, `swap_usage`).
+ */
+std::optional<Metric> metricFromName(std::string_view name);
+
+/**
+ * @brief Samples system metrics on a background thread.
+ *
+ * Every interval the sampler reads /proc/stat, /proc/meminfo and the CPU
+ * thermal zone once (keeping the files open and reusing one read buffer),
+ * derives CPU usage from the difference to the previous counters, and
+ * publishes an immutable snapshot. The counters are first read on
+ * construction and not published (they hold the average since boot), so
+ * every published CPU usage covers one interval. Any number of readers share that
+ * snapshot, so concurrent clients never trigger additional parsing. The last
+ * `historySize` values of every metric are kept for sparklines.
+ *
+ * On other platforms the sampler falls back to the getters in cpu.hpp and
+ * memory.hpp.
+ */
+class SystemSampler {
+public:
+    /**
+     * @param interval Sampling interval.
+     * @param historySize Samples kept per metric.
+     * @param procRoot Where `stat` and `meminfo` are read from.
+     */
+    explicit SystemSampler(
+        std::chrono::milliseconds interval = std::chrono::seconds(1),
+        std::size_t historySize = 300,
+        const std::filesystem::path &procRoot = "/proc");
+    ~SystemSampler();
+
+    SystemSampler(const SystemSampler &) = delete;
+    SystemSampler &operator=(const SystemSampler &) = delete;
+
+    /**
+     * @brief Start the sampling thread (no-op if already running).
+     */
+    void start();
+
+    /**
+     * @brief Stop the sampling thread.
+     */
+    void stop();
+
+    /**
+     * @brief Change the sampling interval, effective after the next sample.
+     */
+    void setInterval(std::chrono::milliseconds interval);
+
+    std::chrono::milliseconds getInterval() const;
+
+    /**
+     * @brief Latest snapshot, never null. Its sequence is 0 until the first
+     * sample was taken.
+     */
+    std::shared_ptr<const SystemSnapshot> snapshot() const;
+
+    /**
+     * @brief Recent values of a metric, oldest first.
+     * @param metric The metric.
+     * @param count Maximum number of values, 0 for the whole history.
+     */
+    std::vector<float> history(Metric metric, std::size_t count = 0) const;
+
+    /**
+     * @brief Take one sample now, on the calling thread.
+     */
+    void sampleOnce();
+
+private:
+    struct Counters {
+        unsigned long long idle = 0;
+        unsigned long long total = 0;
+    };
+
+    struct Ring {
+        std::vector<float> values;
+        std::size_t head = 0;
+        std::size_t count = 0;
+
+        void push(float value);
+    };
+
+    bool readProc(int fd);
+    bool readCpu(SystemSnapshot &snapshot);
+    bool readMemory(SystemSnapshot &snapshot);
+    bool readTemperature(SystemSnapshot &snapshot);
+    void run(std::stop_token token);
+
+    std::chrono::milliseconds m_interval;
+    std::size_t m_historySize;
+
+    /* sampling state, only touched by the sampling thread (or sampleOnce) */
+    std::mutex m_sampleMutex;
+    int m_statFd = -1;
+    int m_meminfoFd = -1;
+    int m_thermalFd = -1;
+    std::vector<char> m_buffer;
+    std::size_t m_bufferSize = 0;
+    std::vector<Counters> m_previous;
+    std::uint64_t m_sequence = 0;
+
+    /* published state */
+    mutable std::mutex m_mutex;
+    std::shared_ptr<const SystemSnapshot> m_snapshot;
+    std::array<Ring, static_cast<std::size_t>(Metric::Count)> m_history;
+
+    std::condition_variable_any m_wakeup;
+    std::jthread m_thread;
+};
+}  // namespace atom::system
+
+#endif
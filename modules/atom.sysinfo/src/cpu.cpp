@@ -17,6 +17,7 @@ Description: System Information Module - CPU
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
 #include <sstream>
 #include <vector>
 namespace fs = std::filesystem;
@@ -82,16 +83,41 @@ float getCurrentCpuUsage() {
     std::istringstream iss(line);
     std::vector<std::string> tokens(std::istream_iterator<std::string>{iss},
                                     std::istream_iterator<std::string>());
-
-    unsigned long total_time = 0;
-    for (size_t i = 1; i < tokens.size(); i++) {
-        total_time += std::stoul(tokens[i]);
+    if (tokens.size() < 5) {
+        LOG_F(ERROR, "Unexpected /proc/stat format");
+        return cpu_usage;
     }
 
-    unsigned long idle_time = std::stoul(tokens[4]);
+    // user nice system idle iowait irq softirq steal, guest is part of user
+    unsigned long long total_time = 0;
+    for (size_t i = 1; i < tokens.size() && i <= 8; i++) {
+        total_time += std::stoull(tokens[i]);
+    }
+    unsigned long long idle_time = std::stoull(tokens[4]);
+    if (tokens.size() > 5) {
+        idle_time += std::stoull(tokens[5]);
+    }
 
-    float usage = static_cast<float>(total_time - idle_time) / total_time;
-    cpu_usage = usage * 100.0;
+    // The counters are cumulative since boot, so the usage is the delta to
+    // the previous call (the first call reports the average since boot).
+    // SystemSampler in sampler.hpp does this on a fixed interval.
+    static std::mutex mutex;
+    static unsigned long long last_total = 0;
+    static unsigned long long last_idle = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    unsigned long long delta_total = total_time - last_total;
+    unsigned long long delta_idle = idle_time - last_idle;
+    if (total_time <= last_total || delta_idle > delta_total) {
+        delta_total = total_time;
+        delta_idle = idle_time;
+    }
+    last_total = total_time;
+    last_idle = idle_time;
+    if (delta_total == 0) {
+        return cpu_usage;
+    }
+    cpu_usage = 100.0f * static_cast<float>(delta_total - delta_idle) /
+                static_cast<float>(delta_total);
 #elif __APPLE__
     host_cpu_load_info_data_t cpu_load;
     mach_msg_type_number_t count = HOST_CPU_LOAD_INFO_COUNT;
@@ -0,0 +1,393 @@
+/*
+ * sampler.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-23
+
+Description: System Information Module - Background Metrics Sampler
+
+**************************************************/
+
+#include "atom/sysinfo/sampler.hpp"
+
+#include "atom/sysinfo/cpu.hpp"
+#include "atom/sysinfo/memory.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "atom/log/loguru.hpp"
+
+namespace atom::system {
+namespace {
+#ifdef __linux__
+/* Parse the next unsigned number at or after `p`, advancing it. */
+unsigned long long nextNumber(const char *&p, const char *end) {
+    while (p < end && (*p < '0' || *p > '9') && *p != '\n') {
+        ++p;
+    }
+    unsigned long long value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + static_cast<unsigned long long>(*p - '0');
+        ++p;
+    }
+    return value;
+}
+
+const char *nextLine(const char *p, const char *end) {
+    auto newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    return newline != nullptr ? newline + 1 : end;
+}
+
+/* The thermal zone most likely to be the CPU package, zone0 otherwise. */
+std::string findCpuThermalZone() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::string fallback;
+    for (const auto &entry :
+         fs::directory_iterator("/sys/class/thermal", ec)) {
+        auto name = entry.path().filename().string();
+        if (!name.starts_with("thermal_zone")) {
+            continue;
+        }
+        auto temp = (entry.path() / "temp").string();
+        char type[64] = {};
+        int fd = ::open((entry.path() / "type").c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            auto n = ::read(fd, type, sizeof(type) - 1);
+            ::close(fd);
+            type[std::max<ssize_t>(n, 0)] = '\0';
+        }
+        if (std::strstr(type, "x86_pkg_temp") != nullptr ||
+            std::strstr(type, "cpu") != nullptr ||
+            std::strstr(type, "soc") != nullptr) {
+            return temp;
+        }
+        if (fallback.empty() || name == "thermal_zone0") {
+            fallback = temp;
+        }
+    }
+    return fallback;
+}
+#endif
+}  // namespace
+
+std::optional<Metric> metricFromName(std::string_view name) {
+    if (name == "cpu_usage") {
+        return Metric::CpuUsage;
+    }
+    if (name == "cpu_temperature" || name == "cpu_temp") {
+        return Metric::CpuTemperature;
+    }
+    if (name == "memory_usage") {
+        return Metric::MemoryUsage;
+    }
+    if (name == "swap_usage") {
+        return Metric::SwapUsage;
+    }
+    return std::nullopt;
+}
+
+void SystemSampler::Ring::push(float value) {
+    if (values.empty()) {
+        return;
+    }
+    values[head] = value;
+    head = (head + 1) % values.size();
+    count = std::min(count + 1, values.size());
+}
+
+SystemSampler::SystemSampler(std::chrono::milliseconds interval,
+                             std::size_t historySize,
+                             const std::filesystem::path &procRoot)
+    : m_interval(std::max(interval, std::chrono::milliseconds(10))),
+      m_historySize(historySize),
+      m_snapshot(std::make_shared<SystemSnapshot>()) {
+    for (auto &ring : m_history) {
+        ring.values.resize(m_historySize);
+    }
+#ifdef __linux__
+    m_buffer.resize(16 * 1024);
+    m_statFd = ::open((procRoot / "stat").c_str(), O_RDONLY | O_CLOEXEC);
+    m_meminfoFd =
+        ::open((procRoot / "meminfo").c_str(), O_RDONLY | O_CLOEXEC);
+    if (auto zone = findCpuThermalZone(); !zone.empty()) {
+        m_thermalFd = ::open(zone.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (m_statFd < 0 || m_meminfoFd < 0) {
+        LOG_F(ERROR, "SystemSampler: failed to open procfs");
+    }
+    /* only remember the counters: measured against zero they are the
+     * average since boot, which must not be published as current usage */
+    SystemSnapshot discarded;
+    readCpu(discarded);
+#else
+    (void)procRoot;
+#endif
+}
+
+SystemSampler::~SystemSampler() {
+    stop();
+#ifdef __linux__
+    for (int fd : {m_statFd, m_meminfoFd, m_thermalFd}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+#endif
+}
+
+void SystemSampler::start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_thread.joinable()) {
+        m_thread =
+            std::jthread([this](std::stop_token token) { run(token); });
+    }
+}
+
+void SystemSampler::stop() {
+    std::jthread thread;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        thread = std::move(m_thread);
+    }
+    if (thread.joinable()) {
+        thread.request_stop();
+        m_wakeup.notify_all();
+        thread.join();
+    }
+}
+
+void SystemSampler::setInterval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_interval = std::max(interval, std::chrono::milliseconds(10));
+}
+
+std::chrono::milliseconds SystemSampler::getInterval() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_interval;
+}
+
+std::shared_ptr<const SystemSnapshot> SystemSampler::snapshot() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_snapshot;
+}
+
+std::vector<float> SystemSampler::history(Metric metric,
+                                          std::size_t count) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto &ring = m_history[static_cast<std::size_t>(metric)];
+    auto n = count == 0 ? ring.count : std::min(count, ring.count);
+    std::vector<float> values;
+    values.reserve(n);
+    auto size = ring.values.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        values.push_back(ring.values[(ring.head + size - n + i) % size]);
+    }
+    return values;
+}
+
+void SystemSampler::run(std::stop_token token) {
+    std::mutex waitMutex;
+    while (!token.stop_requested()) {
+        std::unique_lock<std::mutex> lock(waitMutex);
+        m_wakeup.wait_for(lock, token, getInterval(), [] { return false; });
+        if (token.stop_requested()) {
+            break;
+        }
+        sampleOnce();
+    }
+}
+
+bool SystemSampler::readProc(int fd) {
+#ifdef __linux__
+    if (fd < 0) {
+        return false;
+    }
+    std::size_t size = 0;
+    for (;;) {
+        auto n = ::pread(fd, m_buffer.data() + size, m_buffer.size() - size,
+                         static_cast<off_t>(size));
+        if (n < 0) {
+            return false;
+        }
+        size += static_cast<std::size_t>(n);
+        if (n == 0 || size < m_buffer.size()) {
+            break;
+        }
+        /* large /proc/stat on many-core machines: grow once and keep it */
+        m_buffer.resize(m_buffer.size() * 2);
+    }
+    m_bufferSize = size;
+    return true;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+bool SystemSampler::readCpu(SystemSnapshot &snapshot) {
+#ifdef __linux__
+    if (!readProc(m_statFd)) {
+        return false;
+    }
+    const char *p = m_buffer.data();
+    const char *end = p + m_bufferSize;
+    std::vector<Counters> current;
+    current.reserve(m_previous.size());
+    while (p < end && std::strncmp(p, "cpu", 3) == 0) {
+        const char *line = nextLine(p, end);
+        p += 3;
+        /* skip the cpu index of "cpuN" */
+        while (p < line && *p != ' ') {
+            ++p;
+        }
+        /* user nice system idle iowait irq softirq steal; guest time is
+         * already part of user */
+        unsigned long long fields[8] = {};
+        for (auto &field : fields) {
+            field = nextNumber(p, line);
+        }
+        Counters counters;
+        counters.idle = fields[3] + fields[4];
+        for (auto field : fields) {
+            counters.total += field;
+        }
+        current.push_back(counters);
+        p = line;
+    }
+    if (current.empty()) {
+        return false;
+    }
+
+    auto usage = [](const Counters &now, const Counters &before) {
+        auto total = now.total - before.total;
+        auto idle = now.idle - before.idle;
+        if (total == 0 || now.total < before.total) {
+            return 0.0f;
+        }
+        return 100.0f * static_cast<float>(total - std::min(idle, total)) /
+               static_cast<float>(total);
+    };
+    /* without matching previous counters (first read, CPU hotplug) there
+     * is no interval to measure, report 0 rather than the boot average */
+    bool hasPrevious = m_previous.size() == current.size();
+    snapshot.cpuUsage = hasPrevious ? usage(current[0], m_previous[0]) : 0.0f;
+    snapshot.coreUsage.clear();
+    for (std::size_t i = 1; i < current.size(); ++i) {
+        snapshot.coreUsage.push_back(
+            hasPrevious ? usage(current[i], m_previous[i]) : 0.0f);
+    }
+    m_previous = std::move(current);
+    return true;
+#else
+    (void)snapshot;
+    return false;
+#endif
+}
+
+bool SystemSampler::readMemory(SystemSnapshot &snapshot) {
+#ifdef __linux__
+    if (!readProc(m_meminfoFd)) {
+        return false;
+    }
+    const char *p = m_buffer.data();
+    const char *end = p + m_bufferSize;
+    unsigned long long swapFree = 0;
+    int found = 0;
+    while (p < end && found < 4) {
+        const char *line = nextLine(p, end);
+        auto match = [&](const char *key, unsigned long long &value) {
+            auto length = std::strlen(key);
+            if (static_cast<std::size_t>(line - p) > length &&
+                std::memcmp(p, key, length) == 0) {
+                const char *q = p + length;
+                value = nextNumber(q, line) * 1024;
+                ++found;
+                return true;
+            }
+            return false;
+        };
+        match("MemTotal:", snapshot.memoryTotal) ||
+            match("MemAvailable:", snapshot.memoryAvailable) ||
+            match("SwapTotal:", snapshot.swapTotal) ||
+            match("SwapFree:", swapFree);
+        p = line;
+    }
+    snapshot.swapUsed =
+        snapshot.swapTotal > swapFree ? snapshot.swapTotal - swapFree : 0;
+#else
+    snapshot.memoryTotal = getTotalMemorySize();
+    snapshot.memoryAvailable = getAvailableMemorySize();
+    snapshot.swapTotal = getSwapMemoryTotal();
+    snapshot.swapUsed = getSwapMemoryUsed();
+#endif
+    if (snapshot.memoryTotal == 0) {
+        return false;
+    }
+    snapshot.memoryUsage =
+        100.0f *
+        static_cast<float>(snapshot.memoryTotal -
+                           std::min(snapshot.memoryAvailable,
+                                    snapshot.memoryTotal)) /
+        static_cast<float>(snapshot.memoryTotal);
+    return true;
+}
+
+bool SystemSampler::readTemperature(SystemSnapshot &snapshot) {
+#ifdef __linux__
+    if (!readProc(m_thermalFd)) {
+        return false;
+    }
+    const char *p = m_buffer.data();
+    snapshot.cpuTemperature =
+        static_cast<float>(nextNumber(p, p + m_bufferSize)) / 1000.0f;
+    return true;
+#else
+    snapshot.cpuTemperature = getCurrentCpuTemperature();
+    return true;
+#endif
+}
+
+void SystemSampler::sampleOnce() {
+    auto snapshot = std::make_shared<SystemSnapshot>();
+    {
+        std::lock_guard<std::mutex> lock(m_sampleMutex);
+        snapshot->timestamp = std::chrono::system_clock::now();
+        snapshot->sequence = ++m_sequence;
+#ifdef __linux__
+        readCpu(*snapshot);
+#else
+        snapshot->cpuUsage = getCurrentCpuUsage();
+#endif
+        readMemory(*snapshot);
+        readTemperature(*snapshot);
+    }
+
+    float swapUsage =
+        snapshot->swapTotal == 0
+            ? 0.0f
+            : 100.0f * static_cast<float>(snapshot->swapUsed) /
+                  static_cast<float>(snapshot->swapTotal);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_history[static_cast<std::size_t>(Metric::CpuUsage)].push(
+        snapshot->cpuUsage);
+    m_history[static_cast<std::size_t>(Metric::CpuTemperature)].push(
+        snapshot->cpuTemperature);
+    m_history[static_cast<std::size_t>(Metric::MemoryUsage)].push(
+        snapshot->memoryUsage);
+    m_history[static_cast<std::size_t>(Metric::SwapUsage)].push(swapUsage);
+    m_snapshot = std::move(snapshot);
+}
+}  // namespace atom::system
@@ -21,6 +21,7 @@ Description: Lithium Image Component for Atom Addon
 #include "hfr.hpp"
 #include "hist.hpp"
 #include "imgutils.hpp"
+#include "sequence.hpp"
 #include "stack.hpp"
 #include "stretch.hpp"
 
@@ -61,6 +62,8 @@ ImageComponent::ImageComponent(const std::string& name) : Component(name) {
     def("load_images", &loadImages, "utils", "Load images from a folder");
 
     def("stack_image", &stackImages, "utils", "Stack images from a folder");
+    def("stack_sequence", &stackSequence, "utils",
+        "Stack frames from a SER or raw video sequence");
 
     def("stretch_wb", &Stretch_WhiteBalance, "utils",
         "Stretch white balance of a cv::Mat");
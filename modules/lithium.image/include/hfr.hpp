@@ -3,11 +3,28 @@
 
 #include <opencv2/core.hpp>
 
+#include <vector>
+
 #include "atom/type/json.hpp"
 using json = nlohmann::json;
 
 double calcHfr(const cv::Mat& inImage, float radius);
 
+struct DetectedStar {
+    cv::Point2f center;
+    cv::Rect box;
+    float radius;
+    double area;
+    double hfr;
+    // 星像区域内扣除背景后的亮度总和
+    double flux;
+};
+
+std::vector<DetectedStar> DetectStars(const cv::Mat& img,
+                                      bool if_removehotpixel = true,
+                                      bool if_noiseremoval = true,
+                                      bool down_sample_mean_std = true);
+
 std::tuple<cv::Mat, int, double, json> StarDetectAndHfr(
     const cv::Mat& img, bool if_removehotpixel, bool if_noiseremoval,
     bool do_star_mark = false, bool down_sample_mean_std = true,
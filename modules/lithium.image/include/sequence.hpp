@@ -0,0 +1,196 @@
+/*
+ * sequence.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-30
+
+Description: SER and raw video sequence writer and reader
+
+**************************************************/
+
+#ifndef LITHIUM_IMAGE_SEQUENCE_HPP
+#define LITHIUM_IMAGE_SEQUENCE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "atom/video/pipeline.hpp"
+#include "stack.hpp"
+
+// SER 规范中的颜色编码
+enum class SerColorId : int32_t {
+    MONO = 0,
+    BAYER_RGGB = 8,
+    BAYER_GRBG = 9,
+    BAYER_GBRG = 10,
+    BAYER_BGGR = 11,
+    RGB = 100,
+    BGR = 101
+};
+
+enum class SequenceFormat {
+    SER,  // SER v3, readable by AutoStakkert!, PIPP, Siril...
+    RAW   // Bare frames followed by a timestamp index
+};
+
+struct SequenceInfo {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bit_depth = 8;  // 9 to 16 bit samples take two bytes
+    SerColorId color = SerColorId::MONO;
+    std::string observer;
+    std::string instrument;
+    std::string telescope;
+
+    uint32_t channels() const { return color >= SerColorId::RGB ? 3 : 1; }
+    size_t frameBytes() const {
+        return static_cast<size_t>(width) * height * channels() *
+               (bit_depth > 8 ? 2 : 1);
+    }
+};
+
+/**
+ * @brief Records a video into one sequential file.
+ *
+ * Frames are copied into a page-aligned staging buffer and written in large
+ * blocks, with O_DIRECT where the filesystem allows it, so the page cache
+ * does not thrash during a long capture. The file is preallocated when the
+ * expected length is known. Per-frame timestamps go into the SER trailer
+ * (or the raw index) and the frame count is patched into the header on
+ * close(). A file that was never closed can still be read back.
+ */
+class SequenceWriter {
+public:
+    struct Options {
+        SequenceFormat format = SequenceFormat::SER;
+        size_t expected_frames = 0;          // 0: no preallocation
+        size_t buffer_size = 8 * 1024 * 1024;
+        bool direct_io = true;
+    };
+
+    SequenceWriter() = default;
+    ~SequenceWriter();
+
+    SequenceWriter(const SequenceWriter&) = delete;
+    SequenceWriter& operator=(const SequenceWriter&) = delete;
+
+    bool open(const std::filesystem::path& path, const SequenceInfo& info);
+    bool open(const std::filesystem::path& path, const SequenceInfo& info,
+              const Options& options);
+
+    /**
+     * @brief Append one frame of exactly info.frameBytes() bytes.
+     */
+    bool write(const void* data, size_t bytes,
+               std::chrono::system_clock::time_point timestamp);
+
+    bool close();
+
+    bool isOpen() const { return m_fd >= 0; }
+    uint64_t frameCount() const { return m_timestamps.size(); }
+    const SequenceInfo& info() const { return m_info; }
+
+private:
+    bool append(const void* data, size_t bytes);
+    bool flush(bool final);
+    std::vector<uint8_t> header() const;
+
+    SequenceInfo m_info;
+    Options m_options;
+    int m_fd = -1;
+    bool m_direct = false;
+    uint8_t* m_buffer = nullptr;
+    size_t m_buffered = 0;
+    uint64_t m_written = 0;
+    std::vector<int64_t> m_timestamps;
+};
+
+/**
+ * @brief Memory-maps a SER or raw sequence for random access.
+ *
+ * frame() returns a cv::Mat that points into the mapping, so feeding a
+ * sequence to the stacker costs no extra copies. The reader must outlive
+ * the Mats it hands out.
+ */
+class SequenceReader {
+public:
+    SequenceReader() = default;
+    ~SequenceReader();
+
+    SequenceReader(const SequenceReader&) = delete;
+    SequenceReader& operator=(const SequenceReader&) = delete;
+
+    bool open(const std::filesystem::path& path);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    SequenceFormat format() const { return m_format; }
+    const SequenceInfo& info() const { return m_info; }
+    uint64_t frameCount() const { return m_frame_count; }
+
+    std::span<const uint8_t> frameData(uint64_t index) const;
+    cv::Mat frame(uint64_t index) const;
+
+    /**
+     * @brief Capture time of a frame, or the epoch if the file has none.
+     */
+    std::chrono::system_clock::time_point timestamp(uint64_t index) const;
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    SequenceFormat m_format = SequenceFormat::SER;
+    SequenceInfo m_info;
+    size_t m_header_size = 0;
+    uint64_t m_frame_count = 0;
+    const uint8_t* m_timestamps = nullptr;
+#ifdef _WIN32
+    void* m_mapping = nullptr;
+#endif
+};
+
+/**
+ * @brief Stack the first `max_frames` frames (0: all) of a sequence.
+ *
+ * Mean, maximum, minimum and lighten stacks read one frame at a time and
+ * keep the sample depth of the sequence. The other modes need every
+ * sample of a pixel, so they go through stackImages() in bands of rows
+ * sized to keep memory bounded regardless of the frame count.
+ */
+cv::Mat stackSequence(const std::filesystem::path& path, StackMode mode,
+                      float sigma = 2.0, size_t max_frames = 0);
+
+/**
+ * @brief Video pipeline stage that records every frame to a sequence file.
+ * The file is created when the first frame arrives, using its geometry.
+ */
+class SequenceRecorder : public atom::video::FrameConsumer {
+public:
+    SequenceRecorder(std::filesystem::path path, SequenceInfo info,
+                     SequenceWriter::Options options);
+
+    std::string name() const override { return "recorder"; }
+    void consume(const atom::video::FrameHandle& frame) override;
+    void end() override;
+
+    uint64_t frameCount() const { return m_writer.frameCount(); }
+
+private:
+    std::filesystem::path m_path;
+    SequenceInfo m_info;
+    SequenceWriter::Options m_options;
+    SequenceWriter m_writer;
+    bool m_failed = false;
+};
+
+#endif
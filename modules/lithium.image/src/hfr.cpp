@@ -32,20 +32,12 @@ double calcHfr(const cv::Mat& inImage, float radius) {
 using namespace std;
 using namespace cv;
 
-tuple<Mat, int, double, json> StarDetectAndHfr(const Mat& img, bool if_removehotpixel, bool if_noiseremoval, bool do_star_mark, bool down_sample_mean_std, Mat mark_img) {
-    Mat grayimg, rgb_img;
+vector<DetectedStar> DetectStars(const Mat& img, bool if_removehotpixel, bool if_noiseremoval, bool down_sample_mean_std) {
+    Mat grayimg;
     if (img.channels() == 3) {
         cvtColor(img, grayimg, COLOR_BGR2GRAY);
-        rgb_img = img.clone();
     } else {
         grayimg = img;
-        cvtColor(grayimg, rgb_img, COLOR_GRAY2BGR);
-    }
-
-    if (!mark_img.data) {
-        mark_img = rgb_img.clone();
-    } else if (mark_img.channels() == 1) {
-        cvtColor(mark_img, mark_img, COLOR_GRAY2BGR);
     }
 
     Size img_shps = grayimg.size();
@@ -108,9 +100,7 @@ tuple<Mat, int, double, json> StarDetectAndHfr(const Mat& img, bool if_removehot
     double maximun_area = 1500 * (sclsize / stand_size);
     double minimun_area = max(1.0, ceil(sclsize / stand_size));
     double bsh_scale = sclsize / 2048;
-    vector<double> HfrList;
-    vector<double> arelist;
-    int starnum = 0;
+    vector<DetectedStar> stars;
 
     for (size_t i = 0; i < contours.size(); i++) {
         double area = contourArea(contours[i]);
@@ -120,7 +110,6 @@ tuple<Mat, int, double, json> StarDetectAndHfr(const Mat& img, bool if_removehot
             minEnclosingCircle(contours[i], center, radius);
 
             Rect boundingBox = boundingRect(contours[i]);
-            Point rect_center(boundingBox.x + boundingBox.width / 2, boundingBox.y + boundingBox.height / 2);
 
             if (checkElongated(boundingBox.width, boundingBox.height)) {
                 continue;
@@ -157,24 +146,48 @@ tuple<Mat, int, double, json> StarDetectAndHfr(const Mat& img, bool if_removehot
                 continue;
             }
 
-            Mat rect_expand = rgb_img(starRegion);
-
-            //if (caldim(rect_expand)) {
-            //    continue;
-            //}
-
             double hfr = calcHfr(grayimg(starRegion), radius);
             if (hfr < 0.05) {
                 continue;
             }
-            HfrList.push_back(hfr);
-            starnum++;
-            arelist.push_back(area);
 
-            if (do_star_mark) {
-                circle(mark_img, rect_center, static_cast<int>(radius) + 5, Scalar(0, 255, 0), 1);
-                putText(mark_img, to_string(hfr), rect_center, FONT_HERSHEY_SIMPLEX, 1.0, Scalar(0, 255, 0), 1, LINE_AA);
-            }
+            DetectedStar star;
+            star.center = center;
+            star.box = boundingBox;
+            star.radius = radius;
+            star.area = area;
+            star.hfr = hfr;
+            star.flux = sum(grayimg(starRegion))[0] - median * starRegion.area();
+            stars.push_back(star);
+        }
+    }
+    return stars;
+}
+
+tuple<Mat, int, double, json> StarDetectAndHfr(const Mat& img, bool if_removehotpixel, bool if_noiseremoval, bool do_star_mark, bool down_sample_mean_std, Mat mark_img) {
+    if (!mark_img.data) {
+        if (img.channels() == 3) {
+            mark_img = img.clone();
+        } else {
+            cvtColor(img, mark_img, COLOR_GRAY2BGR);
+        }
+    } else if (mark_img.channels() == 1) {
+        cvtColor(mark_img, mark_img, COLOR_GRAY2BGR);
+    }
+
+    vector<DetectedStar> stars = DetectStars(img, if_removehotpixel, if_noiseremoval, down_sample_mean_std);
+    vector<double> HfrList;
+    vector<double> arelist;
+    int starnum = static_cast<int>(stars.size());
+
+    for (const auto& star : stars) {
+        HfrList.push_back(star.hfr);
+        arelist.push_back(star.area);
+
+        if (do_star_mark) {
+            Point rect_center(star.box.x + star.box.width / 2, star.box.y + star.box.height / 2);
+            circle(mark_img, rect_center, static_cast<int>(star.radius) + 5, Scalar(0, 255, 0), 1);
+            putText(mark_img, to_string(star.hfr), rect_center, FONT_HERSHEY_SIMPLEX, 1.0, Scalar(0, 255, 0), 1, LINE_AA);
         }
     }
 
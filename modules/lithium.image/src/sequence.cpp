@@ -0,0 +1,664 @@
+/*
+ * sequence.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-30
+
+Description: SER and raw video sequence writer and reader
+
+**************************************************/
+
+#include "sequence.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "atom/log/loguru.hpp"
+
+namespace {
+constexpr size_t SER_HEADER_SIZE = 178;
+constexpr size_t RAW_HEADER_SIZE = 64;
+constexpr size_t RAW_FOOTER_SIZE = 16;
+constexpr size_t IO_ALIGNMENT = 4096;
+constexpr char SER_MAGIC[] = "LUCAM-RECORDER";
+constexpr char RAW_MAGIC[] = "LITHRAW1";
+constexpr char RAW_INDEX_MAGIC[] = "LITHIDX1";
+// 逐像素需要所有帧的叠加方式按行分块，每块的浮点数据不超过此大小
+constexpr size_t STACK_BATCH_BYTES = 256 * 1024 * 1024;
+
+// SER 时间戳：自公元 1 年 1 月 1 日起的 100 纳秒数
+constexpr int64_t SER_UNIX_EPOCH_TICKS = 621355968000000000LL;
+
+int64_t toSerTicks(std::chrono::system_clock::time_point time) {
+    auto ticks = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     time.time_since_epoch())
+                     .count() /
+                 100;
+    return ticks + SER_UNIX_EPOCH_TICKS;
+}
+
+std::chrono::system_clock::time_point fromSerTicks(int64_t ticks) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds((ticks - SER_UNIX_EPOCH_TICKS) * 100)));
+}
+
+int64_t utcOffsetTicks(std::time_t time) {
+    std::tm local{};
+    std::tm utc{};
+#ifdef _WIN32
+    localtime_s(&local, &time);
+    gmtime_s(&utc, &time);
+#else
+    localtime_r(&time, &local);
+    gmtime_r(&time, &utc);
+#endif
+    utc.tm_isdst = local.tm_isdst;
+    return static_cast<int64_t>(std::difftime(std::mktime(&local),
+                                              std::mktime(&utc))) *
+           10000000LL;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& out, size_t offset, T value) {
+    std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+T get(const uint8_t* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+void putString(std::vector<uint8_t>& out, size_t offset,
+               const std::string& value, size_t size) {
+    std::memcpy(out.data() + offset, value.data(),
+                std::min(value.size(), size));
+}
+
+uint8_t* allocateAligned(size_t size) {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, IO_ALIGNMENT));
+#else
+    return static_cast<uint8_t*>(std::aligned_alloc(IO_ALIGNMENT, size));
+#endif
+}
+
+void freeAligned(uint8_t* buffer) {
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    std::free(buffer);
+#endif
+}
+
+bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        auto chunk = static_cast<unsigned>(std::min<size_t>(size, 1 << 30));
+        auto written = _write(fd, data, chunk);
+#else
+        auto written = ::write(fd, data, size);
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool writeAt(int fd, uint64_t offset, const uint8_t* data, size_t size) {
+#ifdef _WIN32
+    if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) {
+        return false;
+    }
+    return writeAll(fd, data, size);
+#else
+    while (size > 0) {
+        auto written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+#endif
+}
+}  // namespace
+
+SequenceWriter::~SequenceWriter() { close(); }
+
+bool SequenceWriter::open(const std::filesystem::path& path,
+                          const SequenceInfo& info) {
+    return open(path, info, Options{});
+}
+
+bool SequenceWriter::open(const std::filesystem::path& path,
+                          const SequenceInfo& info, const Options& options) {
+    close();
+    if (info.width == 0 || info.height == 0 || info.bit_depth == 0 ||
+        info.bit_depth > 16) {
+        LOG_F(ERROR, "Invalid sequence geometry {}x{}x{}", info.width,
+              info.height, info.bit_depth);
+        return false;
+    }
+    m_info = info;
+    m_options = options;
+    m_options.buffer_size =
+        std::max(options.buffer_size, info.frameBytes() + IO_ALIGNMENT);
+    m_options.buffer_size =
+        (m_options.buffer_size + IO_ALIGNMENT - 1) / IO_ALIGNMENT *
+        IO_ALIGNMENT;
+
+#ifdef _WIN32
+    m_fd = _open(path.string().c_str(),
+                 _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+    m_direct = false;
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (m_options.direct_io) {
+        m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        m_direct = m_fd >= 0;
+    }
+#endif
+    if (m_fd < 0) {
+        // tmpfs 等文件系统不支持 O_DIRECT
+        m_fd = ::open(path.c_str(), flags, 0644);
+        m_direct = false;
+    }
+#endif
+    if (m_fd < 0) {
+        LOG_F(ERROR, "Failed to create {}: {}", path.string(),
+              std::strerror(errno));
+        return false;
+    }
+
+    m_buffer = allocateAligned(m_options.buffer_size);
+    if (m_buffer == nullptr) {
+        LOG_F(ERROR, "Failed to allocate {} byte write buffer",
+              m_options.buffer_size);
+        close();
+        return false;
+    }
+
+#ifdef __linux__
+    if (m_options.expected_frames > 0) {
+        auto bytes =
+            (m_options.format == SequenceFormat::SER
+                 ? SER_HEADER_SIZE
+                 : RAW_HEADER_SIZE + RAW_FOOTER_SIZE) +
+            m_options.expected_frames * (info.frameBytes() + 8);
+        // 预分配只是优化，失败时继续
+        if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0,
+                      static_cast<off_t>(bytes)) != 0) {
+            LOG_F(WARNING, "Failed to preallocate {} bytes for {}: {}", bytes,
+                  path.string(), std::strerror(errno));
+        }
+    }
+#endif
+
+    m_timestamps.clear();
+    m_timestamps.reserve(m_options.expected_frames);
+    auto head = header();
+    std::memcpy(m_buffer, head.data(), head.size());
+    m_buffered = head.size();
+    m_written = 0;
+    LOG_F(INFO, "Recording {} sequence to {}{}",
+          m_options.format == SequenceFormat::SER ? "SER" : "raw",
+          path.string(), m_direct ? " with direct I/O" : "");
+    return true;
+}
+
+bool SequenceWriter::write(const void* data, size_t bytes,
+                           std::chrono::system_clock::time_point timestamp) {
+    if (!isOpen()) {
+        return false;
+    }
+    if (bytes != m_info.frameBytes()) {
+        LOG_F(ERROR, "Frame of {} bytes does not match sequence frame of {}",
+              bytes, m_info.frameBytes());
+        return false;
+    }
+    if (!append(data, bytes)) {
+        return false;
+    }
+    m_timestamps.push_back(m_options.format == SequenceFormat::SER
+                               ? toSerTicks(timestamp)
+                               : std::chrono::duration_cast<
+                                     std::chrono::nanoseconds>(
+                                     timestamp.time_since_epoch())
+                                     .count());
+    return true;
+}
+
+bool SequenceWriter::close() {
+    if (!isOpen()) {
+        return true;
+    }
+    bool ok = true;
+    if (m_buffer != nullptr) {
+        ok = append(m_timestamps.data(), m_timestamps.size() * 8);
+        if (ok && m_options.format == SequenceFormat::RAW) {
+            uint8_t footer[RAW_FOOTER_SIZE];
+            uint64_t count = m_timestamps.size();
+            std::memcpy(footer, RAW_INDEX_MAGIC, 8);
+            std::memcpy(footer + 8, &count, 8);
+            ok = append(footer, sizeof(footer));
+        }
+        ok = ok && flush(true);
+#if !defined(_WIN32) && defined(O_DIRECT)
+        if (m_direct) {
+            // 头部只有几百字节，不满足 O_DIRECT 的对齐要求
+            fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+            m_direct = false;
+        }
+#endif
+        if (ok) {
+            auto head = header();
+            ok = writeAt(m_fd, 0, head.data(), head.size());
+        }
+        if (!ok) {
+            LOG_F(ERROR, "Failed to finish sequence: {}", std::strerror(errno));
+        }
+        freeAligned(m_buffer);
+        m_buffer = nullptr;
+    }
+#ifdef _WIN32
+    _close(m_fd);
+#else
+    ::close(m_fd);
+#endif
+    m_fd = -1;
+    m_buffered = 0;
+    LOG_F(INFO, "Sequence closed after {} frames", m_timestamps.size());
+    return ok;
+}
+
+bool SequenceWriter::append(const void* data, size_t bytes) {
+    auto* src = static_cast<const uint8_t*>(data);
+    while (bytes > 0) {
+        auto chunk = std::min(bytes, m_options.buffer_size - m_buffered);
+        std::memcpy(m_buffer + m_buffered, src, chunk);
+        m_buffered += chunk;
+        src += chunk;
+        bytes -= chunk;
+        if (m_buffered == m_options.buffer_size && !flush(false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SequenceWriter::flush(bool final) {
+    if (m_buffered == 0) {
+        return true;
+    }
+    // 只有最后一块可能不满；O_DIRECT 下补齐后再截断
+    auto logical = m_buffered;
+    auto size = m_buffered;
+    if (m_direct) {
+        size = (size + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+        std::memset(m_buffer + m_buffered, 0, size - m_buffered);
+    }
+    bool ok = writeAll(m_fd, m_buffer, size);
+#if !defined(_WIN32) && defined(O_DIRECT)
+    if (!ok && m_direct && errno == EINVAL) {
+        LOG_F(WARNING, "Direct I/O rejected, falling back to buffered writes");
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+        m_direct = false;
+        size = m_buffered;
+        ok = writeAll(m_fd, m_buffer, size);
+    }
+#endif
+    if (!ok) {
+        LOG_F(ERROR, "Failed to write sequence: {}", std::strerror(errno));
+        return false;
+    }
+    m_written += logical;
+    m_buffered = 0;
+#ifndef _WIN32
+    if (final && size != logical &&
+        ftruncate(m_fd, static_cast<off_t>(m_written)) != 0) {
+        LOG_F(ERROR, "Failed to truncate sequence: {}", std::strerror(errno));
+        return false;
+    }
+#endif
+    return true;
+}
+
+std::vector<uint8_t> SequenceWriter::header() const {
+    auto count = m_timestamps.size();
+    if (m_options.format == SequenceFormat::RAW) {
+        std::vector<uint8_t> out(RAW_HEADER_SIZE, 0);
+        std::memcpy(out.data(), RAW_MAGIC, 8);
+        put<uint32_t>(out, 8, RAW_HEADER_SIZE);
+        put<uint32_t>(out, 12, m_info.width);
+        put<uint32_t>(out, 16, m_info.height);
+        put<uint32_t>(out, 20, m_info.bit_depth);
+        put<int32_t>(out, 24, static_cast<int32_t>(m_info.color));
+        put<uint64_t>(out, 32, count);
+        return out;
+    }
+    std::vector<uint8_t> out(SER_HEADER_SIZE, 0);
+    std::memcpy(out.data(), SER_MAGIC, 14);
+    put<int32_t>(out, 14, 0);
+    put<int32_t>(out, 18, static_cast<int32_t>(m_info.color));
+    // 规范写的是 0 表示大端，但几乎所有采集软件都写 0 并使用小端数据
+    put<int32_t>(out, 22, 0);
+    put<int32_t>(out, 26, static_cast<int32_t>(m_info.width));
+    put<int32_t>(out, 30, static_cast<int32_t>(m_info.height));
+    put<int32_t>(out, 34, static_cast<int32_t>(m_info.bit_depth));
+    put<int32_t>(out, 38, static_cast<int32_t>(count));
+    putString(out, 42, m_info.observer, 40);
+    putString(out, 82, m_info.instrument, 40);
+    putString(out, 122, m_info.telescope, 40);
+    if (count > 0) {
+        auto utc = m_timestamps.front();
+        auto start = std::chrono::system_clock::to_time_t(
+            fromSerTicks(utc));
+        put<int64_t>(out, 162, utc + utcOffsetTicks(start));
+        put<int64_t>(out, 170, utc);
+    }
+    return out;
+}
+
+SequenceReader::~SequenceReader() { close(); }
+
+bool SequenceReader::open(const std::filesystem::path& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ,
+                              FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        LOG_F(ERROR, "Failed to open {}", path.string());
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_mapping = m_size > 0 ? CreateFileMappingW(file, nullptr, PAGE_READONLY,
+                                                0, 0, nullptr)
+                           : nullptr;
+    CloseHandle(file);
+    if (m_mapping == nullptr) {
+        LOG_F(ERROR, "Failed to map {}", path.string());
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(
+        MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_F(ERROR, "Failed to open {}: {}", path.string(),
+              std::strerror(errno));
+        return false;
+    }
+    struct stat st {};
+    fstat(fd, &st);
+    m_size = static_cast<size_t>(st.st_size);
+    void* data = m_size > 0 ? mmap(nullptr, m_size, PROT_READ, MAP_SHARED,
+                                   fd, 0)
+                            : MAP_FAILED;
+    ::close(fd);
+    if (data != MAP_FAILED) {
+        // 叠加时按顺序读取，让内核提前预读
+        madvise(data, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const uint8_t*>(data);
+    }
+#endif
+    if (m_data == nullptr) {
+        LOG_F(ERROR, "Failed to map {}", path.string());
+        close();
+        return false;
+    }
+
+    if (m_size >= SER_HEADER_SIZE && std::memcmp(m_data, SER_MAGIC, 14) == 0) {
+        m_format = SequenceFormat::SER;
+        m_header_size = SER_HEADER_SIZE;
+        m_info.color = static_cast<SerColorId>(get<int32_t>(m_data + 18));
+        m_info.width = get<uint32_t>(m_data + 26);
+        m_info.height = get<uint32_t>(m_data + 30);
+        m_info.bit_depth = get<uint32_t>(m_data + 34);
+        m_frame_count = get<uint32_t>(m_data + 38);
+        auto text = [this](size_t offset) {
+            auto begin = reinterpret_cast<const char*>(m_data + offset);
+            return std::string(begin, strnlen(begin, 40));
+        };
+        m_info.observer = text(42);
+        m_info.instrument = text(82);
+        m_info.telescope = text(122);
+    } else if (m_size >= RAW_HEADER_SIZE &&
+               std::memcmp(m_data, RAW_MAGIC, 8) == 0) {
+        m_format = SequenceFormat::RAW;
+        m_header_size = get<uint32_t>(m_data + 8);
+        m_info.width = get<uint32_t>(m_data + 12);
+        m_info.height = get<uint32_t>(m_data + 16);
+        m_info.bit_depth = get<uint32_t>(m_data + 20);
+        m_info.color = static_cast<SerColorId>(get<int32_t>(m_data + 24));
+        m_frame_count = get<uint64_t>(m_data + 32);
+    } else {
+        LOG_F(ERROR, "{} is not a SER or raw sequence", path.string());
+        close();
+        return false;
+    }
+
+    auto frame_bytes = m_info.frameBytes();
+    if (frame_bytes == 0 || m_header_size > m_size) {
+        LOG_F(ERROR, "{} has an invalid header", path.string());
+        close();
+        return false;
+    }
+    auto available = (m_size - m_header_size) / frame_bytes;
+    if (m_frame_count == 0 || m_frame_count > available) {
+        // 录制中断时头部没有帧数，按文件长度恢复
+        m_frame_count = available;
+        m_timestamps = nullptr;
+        return true;
+    }
+    auto frames_end = m_header_size + m_frame_count * frame_bytes;
+    if (m_format == SequenceFormat::SER) {
+        if (m_size >= frames_end + m_frame_count * 8) {
+            m_timestamps = m_data + frames_end;
+        }
+    } else if (m_size >= frames_end + m_frame_count * 8 + RAW_FOOTER_SIZE &&
+               std::memcmp(m_data + m_size - RAW_FOOTER_SIZE, RAW_INDEX_MAGIC,
+                           8) == 0) {
+        m_timestamps = m_data + frames_end;
+    }
+    return true;
+}
+
+void SequenceReader::close() {
+#ifdef _WIN32
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+#else
+    if (m_data != nullptr) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_frame_count = 0;
+    m_timestamps = nullptr;
+    m_info = {};
+}
+
+std::span<const uint8_t> SequenceReader::frameData(uint64_t index) const {
+    if (index >= m_frame_count) {
+        return {};
+    }
+    auto frame_bytes = m_info.frameBytes();
+    return {m_data + m_header_size + index * frame_bytes, frame_bytes};
+}
+
+cv::Mat SequenceReader::frame(uint64_t index) const {
+    auto data = frameData(index);
+    if (data.empty()) {
+        return cv::Mat();
+    }
+    int depth = m_info.bit_depth > 8 ? CV_16U : CV_8U;
+    return cv::Mat(static_cast<int>(m_info.height),
+                   static_cast<int>(m_info.width),
+                   CV_MAKETYPE(depth, static_cast<int>(m_info.channels())),
+                   const_cast<uint8_t*>(data.data()));
+}
+
+std::chrono::system_clock::time_point SequenceReader::timestamp(
+    uint64_t index) const {
+    if (m_timestamps == nullptr || index >= m_frame_count) {
+        return {};
+    }
+    auto value = get<int64_t>(m_timestamps + index * 8);
+    if (m_format == SequenceFormat::SER) {
+        return fromSerTicks(value);
+    }
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(value)));
+}
+
+cv::Mat stackSequence(const std::filesystem::path& path, StackMode mode,
+                      float sigma, size_t max_frames) {
+    SequenceReader reader;
+    if (!reader.open(path)) {
+        return cv::Mat();
+    }
+    auto count = reader.frameCount();
+    if (max_frames > 0) {
+        count = std::min<uint64_t>(count, max_frames);
+    }
+    if (count == 0) {
+        return cv::Mat();
+    }
+
+    // 可以逐帧累计的叠加方式每次只读取一帧
+    switch (mode) {
+        case MEAN: {
+            cv::Mat sum;
+            cv::Mat frame;
+            reader.frame(0).convertTo(sum, CV_32F);
+            for (uint64_t i = 1; i < count; ++i) {
+                reader.frame(i).convertTo(frame, CV_32F);
+                sum += frame;
+            }
+            sum /= static_cast<double>(count);
+            cv::Mat result;
+            sum.convertTo(result, reader.frame(0).depth());
+            return result;
+        }
+        case MAXIMUM:
+        case LIGHTEN:
+        case MINIMUM: {
+            auto result = reader.frame(0).clone();
+            for (uint64_t i = 1; i < count; ++i) {
+                if (mode == MINIMUM) {
+                    cv::min(result, reader.frame(i), result);
+                } else {
+                    cv::max(result, reader.frame(i), result);
+                }
+            }
+            return result;
+        }
+        default:
+            break;
+    }
+
+    // 其余方式需要每个像素的全部样本，按行分块交给 stackImages
+    const auto& info = reader.info();
+    auto row_bytes = static_cast<size_t>(info.width) * info.channels() *
+                     sizeof(float) * count;
+    auto rows = static_cast<int>(std::clamp<size_t>(
+        STACK_BATCH_BYTES / std::max<size_t>(row_bytes, 1), 1, info.height));
+    auto height = static_cast<int>(info.height);
+    cv::Mat result;
+    std::vector<cv::Mat> band;
+    band.reserve(count);
+    for (int row = 0; row < height; row += rows) {
+        auto end = std::min(row + rows, height);
+        band.clear();
+        for (uint64_t i = 0; i < count; ++i) {
+            band.push_back(reader.frame(i).rowRange(row, end));
+        }
+        auto stacked = stackImages(band, mode, sigma);
+        if (stacked.empty()) {
+            return cv::Mat();
+        }
+        if (result.empty()) {
+            result.create(height, stacked.cols, stacked.type());
+        }
+        stacked.copyTo(result.rowRange(row, end));
+    }
+    return result;
+}
+
+SequenceRecorder::SequenceRecorder(std::filesystem::path path,
+                                   SequenceInfo info,
+                                   SequenceWriter::Options options)
+    : m_path(std::move(path)),
+      m_info(std::move(info)),
+      m_options(options) {}
+
+void SequenceRecorder::consume(const atom::video::FrameHandle& frame) {
+    if (m_failed) {
+        return;
+    }
+    if (!m_writer.isOpen()) {
+        const auto& geometry = frame.info().geometry;
+        m_info.width = geometry.width;
+        m_info.height = geometry.height;
+        m_info.bit_depth = geometry.bits_per_sample;
+        if (geometry.channels == 3 && m_info.channels() != 3) {
+            m_info.color = SerColorId::RGB;
+        }
+        if (!m_writer.open(m_path, m_info, m_options)) {
+            m_failed = true;
+            return;
+        }
+    }
+    if (!m_writer.write(frame.data(), frame.size(), frame.info().timestamp)) {
+        m_failed = true;
+        m_writer.close();
+    }
+}
+
+void SequenceRecorder::end() { m_writer.close(); }
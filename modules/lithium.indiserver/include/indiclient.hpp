@@ -0,0 +1,173 @@
+#ifndef LITHIUM_INDISERVER_CLIENT_HPP
+#define LITHIUM_INDISERVER_CLIENT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief 一个 XML 元素，INDI 协议的每条消息都是一个顶层元素。
+ */
+struct INDIXmlElement {
+    std::string tag;
+    std::vector<std::pair<std::string, std::string>> attributes;
+    std::string text;
+    std::vector<INDIXmlElement> children;
+
+    /**
+     * @brief 属性值，不存在时返回空字符串。
+     */
+    const std::string &attribute(std::string_view name) const;
+    bool hasAttribute(std::string_view name) const;
+};
+
+/**
+ * @brief 增量 XML 解析器。
+ *
+ * indiserver 发送的是一个没有根元素的 XML 流，数据按网络读取的边界到达。
+ * 解析器保存不完整的标签，直到后续数据到达，每解析完一个顶层元素就调用
+ * 一次回调。
+ */
+class INDIXmlParser {
+public:
+    using Handler = std::function<void(const INDIXmlElement &)>;
+
+    explicit INDIXmlParser(Handler handler);
+
+    /**
+     * @brief 解析下一段数据。
+     * @return 数据格式错误时返回 false，此后需要 reset()。
+     */
+    bool feed(std::string_view data);
+
+    void reset();
+
+private:
+    bool parseTag(std::string_view tag);
+    void appendText(std::string_view text);
+
+    Handler m_handler;
+    std::string m_buffer;
+    std::vector<INDIXmlElement> m_stack;
+};
+
+/**
+ * @brief 属性树中的一个属性。
+ */
+struct INDIProperty {
+    /** Number、Switch、Text、Light 或 BLOB */
+    std::string type;
+    std::string state;
+    std::string perm;
+    std::string label;
+    std::string group;
+    std::map<std::string, std::string> elements;
+};
+
+/**
+ * @class INDIClient
+ * @brief 与 indiserver 保持长连接的客户端。
+ *
+ * 连接建立后发送 getProperties，之后 indiserver 推送的 def*Vector、
+ * set*Vector 和 delProperty 增量更新本地属性树。读取属性直接查询属性树，
+ * 写入属性只发送一条 new*Vector 消息，不再为每次操作启动 indi_getprop 或
+ * indi_setprop 进程。
+ */
+class INDIClient {
+public:
+    using Devices =
+        std::map<std::string, std::map<std::string, INDIProperty>>;
+
+    INDIClient(std::string host, int port);
+    ~INDIClient();
+
+    INDIClient(const INDIClient &) = delete;
+    INDIClient &operator=(const INDIClient &) = delete;
+
+    /**
+     * @brief 连接 indiserver，已连接时直接返回 true。
+     */
+    bool connect(std::chrono::milliseconds timeout =
+                     std::chrono::milliseconds(2000));
+    void disconnect();
+    bool isConnected() const { return m_connected.load(); }
+
+    /**
+     * @brief 从属性树读取元素的值。
+     * @param timeout 属性尚未定义时最多等待的时间。
+     */
+    std::optional<std::string> getValue(
+        const std::string &device, const std::string &property,
+        const std::string &element,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    /**
+     * @brief 从属性树读取属性的状态（Idle、Ok、Busy、Alert）。
+     */
+    std::optional<std::string> getState(
+        const std::string &device, const std::string &property,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    /**
+     * @brief 属性的一份拷贝。
+     */
+    std::optional<INDIProperty> getProperty(
+        const std::string &device, const std::string &property,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    /**
+     * @brief 发送一条 new*Vector 消息修改元素的值。
+     * 属性的类型从属性树中获取，属性尚未定义时返回 false。
+     */
+    bool setValue(const std::string &device, const std::string &property,
+                  const std::string &element, const std::string &value);
+
+    /**
+     * @brief 当前属性树的一份拷贝。
+     */
+    Devices devices() const;
+
+    /**
+     * @brief 处理一条 INDI 消息，接收线程解析出顶层元素时调用。
+     */
+    void apply(const INDIXmlElement &message);
+
+private:
+    void readLoop();
+    /** 关闭套接字和唤醒管道，与 send() 互斥 */
+    void closeDescriptors();
+    bool send(const std::string &message);
+    const INDIProperty *find(const std::string &device,
+                             const std::string &property) const;
+    template <typename Result, typename Reader>
+    std::optional<Result> waitFor(const std::string &device,
+                                  const std::string &property,
+                                  std::chrono::milliseconds timeout,
+                                  Reader reader);
+
+    std::string m_host;
+    int m_port;
+
+    std::mutex m_connect_mutex;
+    std::mutex m_send_mutex;
+    int m_socket = -1;
+    int m_wake[2] = {-1, -1};
+    std::thread m_reader;
+    std::atomic<bool> m_connected{false};
+
+    mutable std::shared_mutex m_mutex;
+    std::condition_variable_any m_changed;
+    Devices m_devices;
+};
+
+#endif  // LITHIUM_INDISERVER_CLIENT_HPP
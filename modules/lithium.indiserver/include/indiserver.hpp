@@ -2,6 +2,7 @@
 #define LITHIUM_INDISERVER_HPP
 
 #include "collection.hpp"
+#include "indiclient.hpp"
 
 class INDIManager {
 public:
@@ -46,14 +47,18 @@ public:
     getRunningDrivers();
 #endif
 
+    /**
+     * @brief 所有带 CONNECTION 属性的设备及其连接状态，从属性树中读取
+     */
 #if ENABLE_FASTHASH
-    static std::vector<emhash8::HashMap<std::string, std::string>> getDevices();
+    std::vector<emhash8::HashMap<std::string, std::string>> getDevices();
 #else
-    static std::vector<std::unordered_map<std::string, std::string>>
-    getDevices();
+    std::vector<std::unordered_map<std::string, std::string>> getDevices();
 #endif
 
 private:
+    bool writeFifo(const std::string &cmd);
+
     std::string host;         ///< INDI服务器的主机名
     int port;                 ///< INDI服务器的端口号
     std::string config_path;  ///< INDI配置文件路径
@@ -66,6 +71,7 @@ private:
     std::unordered_map<std::string, std::shared_ptr<INDIDeviceContainer>>
         running_drivers;  ///< 正在运行的驱动程序列表
 #endif
+    std::unique_ptr<INDIClient> client;  ///< 与INDI服务器的长连接
 };
 
 #endif  // LITHIUM_INDISERVER_HPP
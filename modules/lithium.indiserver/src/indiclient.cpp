@@ -0,0 +1,616 @@
+/*
+ * indiclient.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-4
+
+Description: Persistent INDI client with a local property tree
+
+**************************************************/
+
+#include "indiclient.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "atom/log/loguru.hpp"
+
+namespace {
+constexpr std::string_view WHITESPACE = " \t\r\n";
+
+std::string_view trim(std::string_view text) {
+    auto begin = text.find_first_not_of(WHITESPACE);
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    auto end = text.find_last_not_of(WHITESPACE);
+    return text.substr(begin, end - begin + 1);
+}
+
+void unescape(std::string_view text, std::string &out) {
+    while (!text.empty()) {
+        auto amp = text.find('&');
+        out.append(text.substr(0, amp));
+        if (amp == std::string_view::npos) {
+            return;
+        }
+        text.remove_prefix(amp);
+        auto semi = text.find(';');
+        if (semi == std::string_view::npos) {
+            out.append(text);
+            return;
+        }
+        auto entity = text.substr(1, semi - 1);
+        if (entity == "lt") {
+            out.push_back('<');
+        } else if (entity == "gt") {
+            out.push_back('>');
+        } else if (entity == "amp") {
+            out.push_back('&');
+        } else if (entity == "quot") {
+            out.push_back('"');
+        } else if (entity == "apos") {
+            out.push_back('\'');
+        } else if (entity.size() > 1 && entity[0] == '#') {
+            bool hex = entity[1] == 'x' || entity[1] == 'X';
+            auto code = std::strtoul(
+                std::string(entity.substr(hex ? 2 : 1)).c_str(), nullptr,
+                hex ? 16 : 10);
+            if (code < 0x80) {
+                out.push_back(static_cast<char>(code));
+            } else if (code < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            } else if (code < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            } else if (code < 0x110000) {
+                out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+                out.push_back(
+                    static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            } else {
+                // 超出 Unicode 范围的引用按原样保留
+                out.append(text.substr(0, semi + 1));
+            }
+        } else {
+            out.append(text.substr(0, semi + 1));
+        }
+        text.remove_prefix(semi + 1);
+    }
+}
+
+std::string escape(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '<':
+                out += "&lt;";
+                break;
+            case '>':
+                out += "&gt;";
+                break;
+            case '&':
+                out += "&amp;";
+                break;
+            case '"':
+                out += "&quot;";
+                break;
+            case '\'':
+                out += "&apos;";
+                break;
+            default:
+                out.push_back(c);
+        }
+    }
+    return out;
+}
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+bool endsWith(std::string_view text, std::string_view suffix) {
+    return text.size() >= suffix.size() &&
+           text.substr(text.size() - suffix.size()) == suffix;
+}
+}  // namespace
+
+const std::string &INDIXmlElement::attribute(std::string_view name) const {
+    static const std::string EMPTY;
+    for (const auto &[key, value] : attributes) {
+        if (key == name) {
+            return value;
+        }
+    }
+    return EMPTY;
+}
+
+bool INDIXmlElement::hasAttribute(std::string_view name) const {
+    return std::any_of(attributes.begin(), attributes.end(),
+                       [&](const auto &item) { return item.first == name; });
+}
+
+INDIXmlParser::INDIXmlParser(Handler handler)
+    : m_handler(std::move(handler)) {}
+
+void INDIXmlParser::reset() {
+    m_buffer.clear();
+    m_stack.clear();
+}
+
+bool INDIXmlParser::feed(std::string_view data) {
+    m_buffer.append(data);
+    std::string_view rest(m_buffer);
+    size_t consumed = 0;
+    while (consumed < rest.size()) {
+        auto view = rest.substr(consumed);
+        auto lt = view.find('<');
+        if (lt == std::string_view::npos) {
+            // 不完整的实体留到下一次读取
+            auto amp = view.rfind('&');
+            if (amp != std::string_view::npos &&
+                view.find(';', amp) == std::string_view::npos) {
+                view = view.substr(0, amp);
+            }
+            appendText(view);
+            consumed += view.size();
+            break;
+        }
+        appendText(view.substr(0, lt));
+        view.remove_prefix(lt);
+
+        size_t length;
+        if (startsWith(view, "<!--")) {
+            auto end = view.find("-->");
+            if (end == std::string_view::npos) {
+                break;
+            }
+            length = end + 3;
+        } else if (startsWith(view, "<![CDATA[")) {
+            auto end = view.find("]]>");
+            if (end == std::string_view::npos) {
+                break;
+            }
+            if (!m_stack.empty()) {
+                m_stack.back().text.append(view.substr(9, end - 9));
+            }
+            length = end + 3;
+        } else if (view.size() < 4 && (startsWith("<!--", view) ||
+                                       startsWith("<![CDATA[", view))) {
+            break;
+        } else {
+            // 引号内的 '>' 不结束标签
+            char quote = 0;
+            size_t end = 1;
+            for (; end < view.size(); ++end) {
+                char c = view[end];
+                if (quote != 0) {
+                    if (c == quote) {
+                        quote = 0;
+                    }
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '>') {
+                    break;
+                }
+            }
+            if (end == view.size()) {
+                break;
+            }
+            auto tag = view.substr(1, end - 1);
+            if (!startsWith(tag, "?") && !startsWith(tag, "!") &&
+                !parseTag(tag)) {
+                reset();
+                return false;
+            }
+            length = end + 1;
+        }
+        consumed += lt + length;
+    }
+    m_buffer.erase(0, consumed);
+    return true;
+}
+
+void INDIXmlParser::appendText(std::string_view text) {
+    if (!m_stack.empty() && !text.empty()) {
+        unescape(text, m_stack.back().text);
+    }
+}
+
+bool INDIXmlParser::parseTag(std::string_view tag) {
+    auto close = [this]() {
+        auto element = std::move(m_stack.back());
+        m_stack.pop_back();
+        if (m_stack.empty()) {
+            m_handler(element);
+        } else {
+            m_stack.back().children.push_back(std::move(element));
+        }
+    };
+
+    if (startsWith(tag, "/")) {
+        auto name = trim(tag.substr(1));
+        if (m_stack.empty() || m_stack.back().tag != name) {
+            LOG_F(ERROR, "Unexpected closing tag </{}>", name);
+            return false;
+        }
+        close();
+        return true;
+    }
+
+    bool selfClosing = endsWith(tag, "/");
+    if (selfClosing) {
+        tag.remove_suffix(1);
+    }
+    INDIXmlElement element;
+    auto nameEnd = tag.find_first_of(WHITESPACE);
+    element.tag = std::string(tag.substr(0, nameEnd));
+    if (element.tag.empty()) {
+        LOG_F(ERROR, "Empty XML tag");
+        return false;
+    }
+    auto attrs = nameEnd == std::string_view::npos ? std::string_view{}
+                                                   : tag.substr(nameEnd);
+    while (true) {
+        attrs = trim(attrs);
+        if (attrs.empty()) {
+            break;
+        }
+        auto eq = attrs.find('=');
+        if (eq == std::string_view::npos) {
+            LOG_F(ERROR, "Malformed attribute in <{}>", element.tag);
+            return false;
+        }
+        auto name = trim(attrs.substr(0, eq));
+        attrs = trim(attrs.substr(eq + 1));
+        if (attrs.empty() || (attrs[0] != '"' && attrs[0] != '\'')) {
+            LOG_F(ERROR, "Unquoted attribute {} in <{}>", name, element.tag);
+            return false;
+        }
+        auto end = attrs.find(attrs[0], 1);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        std::string value;
+        unescape(attrs.substr(1, end - 1), value);
+        element.attributes.emplace_back(std::string(name), std::move(value));
+        attrs.remove_prefix(end + 1);
+    }
+    m_stack.push_back(std::move(element));
+    if (selfClosing) {
+        close();
+    }
+    return true;
+}
+
+INDIClient::INDIClient(std::string host, int port)
+    : m_host(std::move(host)), m_port(port) {}
+
+INDIClient::~INDIClient() { disconnect(); }
+
+bool INDIClient::connect(std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(m_connect_mutex);
+    if (m_connected) {
+        return true;
+    }
+    // 上一次连接已经断开，回收接收线程
+    if (m_reader.joinable()) {
+        m_reader.join();
+    }
+    closeDescriptors();
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    auto service = std::to_string(m_port);
+    if (int rc = ::getaddrinfo(m_host.c_str(), service.c_str(), &hints,
+                               &result);
+        rc != 0) {
+        LOG_F(ERROR, "Cannot resolve INDI server {}: {}", m_host,
+              gai_strerror(rc));
+        return false;
+    }
+    int fd = -1;
+    for (auto *ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS) {
+            pollfd pfd{fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (::poll(&pfd, 1, static_cast<int>(timeout.count())) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 &&
+                error == 0) {
+                rc = 0;
+            }
+        }
+        if (rc != 0) {
+            ::close(fd);
+            fd = -1;
+            continue;
+        }
+        fcntl(fd, F_SETFL, flags);
+    }
+    ::freeaddrinfo(result);
+    if (fd < 0) {
+        LOG_F(ERROR, "Failed to connect to INDI server {}:{}", m_host, m_port);
+        return false;
+    }
+    if (::pipe(m_wake) != 0) {
+        LOG_F(ERROR, "Failed to create INDI client wake pipe: {}",
+              std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> sendLock(m_send_mutex);
+        m_socket = fd;
+    }
+    m_connected = true;
+    m_reader = std::thread([this] { readLoop(); });
+    if (!send("<getProperties version=\"1.7\"/>\n")) {
+        return false;
+    }
+    DLOG_F(INFO, "Connected to INDI server {}:{}", m_host, m_port);
+    return true;
+}
+
+void INDIClient::disconnect() {
+    std::lock_guard<std::mutex> lock(m_connect_mutex);
+    if (m_reader.joinable()) {
+        if (m_wake[1] >= 0) {
+            char byte = 1;
+            [[maybe_unused]] auto n = ::write(m_wake[1], &byte, 1);
+        }
+        m_reader.join();
+    }
+    closeDescriptors();
+    m_connected = false;
+}
+
+void INDIClient::closeDescriptors() {
+    // send() 可能在其他线程中使用套接字
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    for (int *fd : {&m_socket, &m_wake[0], &m_wake[1]}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void INDIClient::readLoop() {
+    INDIXmlParser parser([this](const INDIXmlElement &message) {
+        apply(message);
+    });
+    char buffer[64 * 1024];
+    while (true) {
+        pollfd fds[2] = {{m_socket, POLLIN, 0}, {m_wake[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+        auto got = ::recv(m_socket, buffer, sizeof(buffer), 0);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            LOG_F(WARNING, "INDI server {}:{} closed the connection", m_host,
+                  m_port);
+            break;
+        }
+        if (!parser.feed(std::string_view(buffer, got))) {
+            LOG_F(ERROR, "Malformed XML from INDI server {}:{}", m_host,
+                  m_port);
+            break;
+        }
+    }
+    // 属性树只在连接期间有效
+    {
+        std::unique_lock lock(m_mutex);
+        m_connected = false;
+        m_devices.clear();
+    }
+    m_changed.notify_all();
+}
+
+bool INDIClient::send(const std::string &message) {
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    if (m_socket < 0) {
+        return false;
+    }
+    size_t sent = 0;
+    while (sent < message.size()) {
+        auto n = ::send(m_socket, message.data() + sent, message.size() - sent,
+                        MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_F(ERROR, "Failed to send to INDI server: {}",
+                  std::strerror(errno));
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void INDIClient::apply(const INDIXmlElement &message) {
+    const auto &tag = message.tag;
+    const auto &device = message.attribute("device");
+    const auto &name = message.attribute("name");
+
+    if (tag == "message") {
+        DLOG_F(INFO, "INDI {}: {}", device, message.attribute("message"));
+        return;
+    }
+    {
+        std::unique_lock lock(m_mutex);
+        if (startsWith(tag, "def") && endsWith(tag, "Vector")) {
+            auto type = tag.substr(3, tag.size() - 9);
+            INDIProperty property;
+            property.type = type;
+            property.state = message.attribute("state");
+            property.perm = message.attribute("perm");
+            property.label = message.attribute("label");
+            property.group = message.attribute("group");
+            for (const auto &child : message.children) {
+                if (child.tag == "def" + type) {
+                    property.elements[child.attribute("name")] =
+                        std::string(trim(child.text));
+                }
+            }
+            m_devices[device][name] = std::move(property);
+        } else if (startsWith(tag, "set") && endsWith(tag, "Vector")) {
+            auto type = tag.substr(3, tag.size() - 9);
+            auto &property = m_devices[device][name];
+            if (property.type.empty()) {
+                property.type = type;
+            }
+            if (message.hasAttribute("state")) {
+                property.state = message.attribute("state");
+            }
+            for (const auto &child : message.children) {
+                if (child.tag == "one" + type) {
+                    property.elements[child.attribute("name")] =
+                        std::string(trim(child.text));
+                }
+            }
+        } else if (tag == "delProperty") {
+            if (name.empty()) {
+                m_devices.erase(device);
+            } else if (auto it = m_devices.find(device);
+                       it != m_devices.end()) {
+                it->second.erase(name);
+            }
+        } else {
+            return;
+        }
+    }
+    m_changed.notify_all();
+}
+
+const INDIProperty *INDIClient::find(const std::string &device,
+                                     const std::string &property) const {
+    auto it = m_devices.find(device);
+    if (it == m_devices.end()) {
+        return nullptr;
+    }
+    auto prop = it->second.find(property);
+    return prop == it->second.end() ? nullptr : &prop->second;
+}
+
+template <typename Result, typename Reader>
+std::optional<Result> INDIClient::waitFor(const std::string &device,
+                                          const std::string &property,
+                                          std::chrono::milliseconds timeout,
+                                          Reader reader) {
+    if (!connect()) {
+        return std::nullopt;
+    }
+    // 刚连接时属性树还在填充，等待属性被定义
+    std::shared_lock lock(m_mutex);
+    const INDIProperty *found = nullptr;
+    m_changed.wait_for(lock, timeout, [&] {
+        found = find(device, property);
+        return found != nullptr || !m_connected;
+    });
+    if (found == nullptr) {
+        return std::nullopt;
+    }
+    return reader(*found);
+}
+
+std::optional<std::string> INDIClient::getValue(
+    const std::string &device, const std::string &property,
+    const std::string &element, std::chrono::milliseconds timeout) {
+    return waitFor<std::string>(
+        device, property, timeout,
+        [&](const INDIProperty &prop) -> std::optional<std::string> {
+            auto it = prop.elements.find(element);
+            if (it == prop.elements.end()) {
+                return std::nullopt;
+            }
+            return it->second;
+        });
+}
+
+std::optional<std::string> INDIClient::getState(
+    const std::string &device, const std::string &property,
+    std::chrono::milliseconds timeout) {
+    return waitFor<std::string>(
+        device, property, timeout,
+        [](const INDIProperty &prop) -> std::optional<std::string> {
+            return prop.state;
+        });
+}
+
+std::optional<INDIProperty> INDIClient::getProperty(
+    const std::string &device, const std::string &property,
+    std::chrono::milliseconds timeout) {
+    return waitFor<INDIProperty>(
+        device, property, timeout,
+        [](const INDIProperty &prop) -> std::optional<INDIProperty> {
+            return prop;
+        });
+}
+
+bool INDIClient::setValue(const std::string &device,
+                          const std::string &property,
+                          const std::string &element,
+                          const std::string &value) {
+    auto prop = getProperty(device, property);
+    if (!prop) {
+        LOG_F(ERROR, "Unknown INDI property {}.{}", device, property);
+        return false;
+    }
+    if (prop->perm == "ro" || prop->type == "Light" || prop->type == "BLOB") {
+        LOG_F(ERROR, "INDI property {}.{} is not writable", device, property);
+        return false;
+    }
+    if (!prop->elements.contains(element)) {
+        LOG_F(ERROR, "INDI property {}.{} has no element {}", device, property,
+              element);
+        return false;
+    }
+    const auto &type = prop->type;
+    std::string message = "<new" + type + "Vector device=\"" +
+                          escape(device) + "\" name=\"" + escape(property) +
+                          "\">\n  <one" + type + " name=\"" +
+                          escape(element) + "\">" + escape(value) + "</one" +
+                          type + ">\n</new" + type + "Vector>\n";
+    return send(message);
+}
+
+INDIClient::Devices INDIClient::devices() const {
+    std::shared_lock lock(m_mutex);
+    return m_devices;
+}
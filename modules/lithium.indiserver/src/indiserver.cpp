@@ -14,7 +14,11 @@ Description: INDI Device Manager
 
 #include "indiserver.hpp"
 
-#include <regex>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "atom/error/exception.hpp"
 #include "atom/io/io.hpp"
@@ -31,6 +35,7 @@ INDIManager::INDIManager(const std::string &hst, int prt,
     config_path = cfg;
     data_path = dta;
     fifo_path = fif;
+    client = std::make_unique<INDIClient>(host, port);
 }
 
 INDIManager::~INDIManager() {}
@@ -77,6 +82,7 @@ bool INDIManager::stopServer() {
         DLOG_F(WARNING, "INDI server is not running");
         return true;
     }
+    client->disconnect();
     std::string cmd = "killall indiserver >/dev/null 2>&1";
     DLOG_F(INFO, "Terminating INDI server");
     try {
@@ -103,22 +109,32 @@ bool INDIManager::isInstalled() {
     return atom::system::checkSoftwareInstalled("hydrogenserver");
 }
 
+bool INDIManager::writeFifo(const std::string &cmd) {
+    DLOG_F(INFO, "Cmd: {}", cmd);
+    // 非阻塞打开，indiserver 没有在读 FIFO 时立即失败而不是挂起
+    int fd = ::open(fifo_path.c_str(), O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        LOG_F(ERROR, "Failed to open fifo {}: {}", fifo_path,
+              std::strerror(errno));
+        return false;
+    }
+    std::string line = cmd + "\n";
+    auto written = ::write(fd, line.data(), line.size());
+    ::close(fd);
+    if (written != static_cast<ssize_t>(line.size())) {
+        LOG_F(ERROR, "Failed to write to fifo {}: {}", fifo_path,
+              std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
 bool INDIManager::startDriver(std::shared_ptr<INDIDeviceContainer> driver) {
     std::string cmd = "start " + driver->binary;
     if (driver->skeleton != "") {
         cmd += " -s \"" + driver->skeleton + "\"";
     }
-    cmd = std::regex_replace(cmd, std::regex("\""), "\\\"");
-    std::string full_cmd = "echo \"" + cmd + "\" > " + fifo_path;
-    DLOG_F(INFO, "Cmd: {}", full_cmd);
-    try {
-        if (atom::system::executeCommand(full_cmd, false) != "") {
-            LOG_F(ERROR, "Failed to execute command: {}", full_cmd);
-            return false;
-        }
-    } catch (const atom::error::RuntimeError &e) {
-        LOG_F(ERROR, "Failed to execute command: {} with {}", full_cmd,
-              e.what());
+    if (!writeFifo(cmd)) {
         return false;
     }
     running_drivers.emplace(driver->label, driver);
@@ -130,17 +146,7 @@ bool INDIManager::stopDriver(std::shared_ptr<INDIDeviceContainer> driver) {
     if (driver->binary.find("@") == std::string::npos) {
         cmd += " -n \"" + driver->label + "\"";
     }
-    cmd = std::regex_replace(cmd, std::regex("\""), "\\\"");
-    std::string full_cmd = "echo \"" + cmd + "\" > " + fifo_path;
-    DLOG_F(INFO, "Cmd: {}", full_cmd);
-    try {
-        if (atom::system::executeCommand(full_cmd, false) != "") {
-            LOG_F(ERROR, "Failed to execute command: {}", full_cmd);
-            return false;
-        }
-    } catch (const atom::error::RuntimeError &e) {
-        LOG_F(ERROR, "Failed to execute command: {} with {}", full_cmd,
-              e.what());
+    if (!writeFifo(cmd)) {
         return false;
     }
     DLOG_F(INFO, "Stop running driver: {}", driver->label);
@@ -151,19 +157,8 @@ bool INDIManager::stopDriver(std::shared_ptr<INDIDeviceContainer> driver) {
 bool INDIManager::setProp(const std::string &dev, const std::string &prop,
                           const std::string &element,
                           const std::string &value) {
-    std::stringstream ss;
-
-    ss << "indi_setprop " << dev << "." << prop << "." << element << "="
-       << value;
-    std::string cmd = ss.str();
-    DLOG_F(INFO, "Cmd: {}", cmd);
-    try {
-        if (atom::system::executeCommand(cmd, false) != "") {
-            LOG_F(ERROR, "Failed to execute command: {}", cmd);
-            return false;
-        }
-    } catch (const atom::error::RuntimeError &e) {
-        LOG_F(ERROR, "Failed to execute command: {} with {}", cmd, e.what());
+    if (!client->setValue(dev, prop, element, value)) {
+        LOG_F(ERROR, "Failed to set property: {}.{}.{}", dev, prop, element);
         return false;
     }
     DLOG_F(INFO, "Set property: {}.{} to {}", dev, prop, value);
@@ -173,29 +168,16 @@ bool INDIManager::setProp(const std::string &dev, const std::string &prop,
 std::string INDIManager::getProp(const std::string &dev,
                                  const std::string &prop,
                                  const std::string &element) {
-    std::stringstream ss;
-#if ENABLE_INDI
-    ss << "indi_getprop " << dev << "." << prop << "." << element;
-#else
-    ss << "indi_getprop " << dev << "." << prop << "." << element;
-#endif
-    std::string cmd = ss.str();
-    try {
-        std::string output = atom::system::executeCommand(cmd, false);
-        size_t equalsPos = output.find('=');
-        if (equalsPos != std::string::npos && equalsPos + 1 < output.length()) {
-            return output.substr(equalsPos + 1,
-                                 output.length() - equalsPos - 2);
-        }
-    } catch (const atom::error::RuntimeError &e) {
-        LOG_F(ERROR, "Failed to execute command: {} with {}", cmd, e.what());
+    // indi_getprop 用 _STATE 表示属性状态
+    if (element == "_STATE") {
+        return getState(dev, prop);
     }
-    return "";
+    return client->getValue(dev, prop, element).value_or("");
 }
 
 std::string INDIManager::getState(const std::string &dev,
                                   const std::string &prop) {
-    return getProp(dev, prop, "_STATE");
+    return client->getState(dev, prop).value_or("");
 }
 
 #if ENABLE_FASTHASH
@@ -222,37 +204,19 @@ INDIManager::getDevices()
 #else
     std::vector<std::unordered_map<std::string, std::string>> devices;
 #endif
-    std::string cmd = "indi_getprop *.CONNECTION.CONNECT";
-    std::array<char, 128> buffer;
-    std::string result = "";
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"),
-                                                  pclose);
-    if (!pipe) {
-        LOG_F(ERROR, "Failed to execute command: {}", cmd);
-        THROW_RUNTIME_ERROR("popen() failed!");
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
+    if (!client->connect()) {
+        return devices;
     }
-    std::vector<std::string> lines = {"", ""};
-    for (char token : result) {
-        if (token == '\n') {
-            std::unordered_map<std::string, std::string> device;
-            std::stringstream ss(lines[0]);
-            std::string item;
-            while (getline(ss, item, '.')) {
-                device["device"] = item;
-            }
-            device["connected"] = (lines[1] == "On") ? "true" : "false";
-            devices.push_back(device);
-            lines = {"", ""};
-        } else if (token == '=') {
-            lines[1] = lines[1].substr(0, lines[1].length() - 1);
-        } else if (token == ' ') {
+    for (const auto &[name, properties] : client->devices()) {
+        auto it = properties.find("CONNECTION");
+        if (it == properties.end()) {
             continue;
-        } else {
-            lines[(lines[0] == "") ? 0 : 1] += token;
         }
+        auto connect = it->second.elements.find("CONNECT");
+        bool connected = connect != it->second.elements.end() &&
+                         connect->second == "On";
+        devices.push_back(
+            {{"device", name}, {"connected", connected ? "true" : "false"}});
     }
     return devices;
 }
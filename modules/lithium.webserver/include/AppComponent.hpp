@@ -19,6 +19,11 @@ Description: App Components
 #include "config/HubsConfig.hpp"
 
 #include "websocket/Registry.hpp"
+#include "websocket/Telemetry.hpp"
+
+#include "components/UploadManager.hpp"
+
+#include "atom/sysinfo/sampler.hpp"
 
 // Websocket
 #include "oatpp-websocket/AsyncConnectionHandler.hpp"
@@ -118,6 +123,55 @@ public:
     OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor)
     ([] { return std::make_shared<oatpp::async::Executor>(); }());
 
+    /**
+     * Background system metrics sampler shared by the system controller and
+     * telemetry, so procfs is parsed once per interval however many clients
+     * ask.
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<atom::system::SystemSampler>,
+                           systemSampler)
+    ([] {
+        auto sampler = std::make_shared<atom::system::SystemSampler>(
+            std::chrono::seconds(1), 300);
+        sampler->start();
+        return sampler;
+    }());
+
+    /**
+     * Telemetry store shared by all hub connections. System metrics are
+     * registered as sources reading the sampler snapshot; other modules
+     * publish into it.
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<Telemetry>, telemetry)
+    ([] {
+        OATPP_COMPONENT(std::shared_ptr<atom::system::SystemSampler>, sampler);
+        auto telemetry = std::make_shared<Telemetry>();
+        telemetry->addSource(
+            "system",
+            [sampler] {
+                auto snapshot = sampler->snapshot();
+                return Telemetry::json{
+                    {"cpu_usage", snapshot->cpuUsage},
+                    {"cpu_temperature", snapshot->cpuTemperature},
+                    {"memory_usage", snapshot->memoryUsage}};
+            },
+            sampler->getInterval());
+        return telemetry;
+    }());
+
+    /**
+     * Streaming upload storage, used by the upload controller. Uploads need
+     * the bearer token from LITHIUM_UPLOAD_TOKEN and are refused without.
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<UploadManager>, uploadManager)
+    ([] {
+        UploadManager::Options options;
+        if (const char* token = std::getenv("LITHIUM_UPLOAD_TOKEN")) {
+            options.token = token;
+        }
+        return std::make_shared<UploadManager>(std::move(options));
+    }());
+
     /**
      *  Create Router component
      */
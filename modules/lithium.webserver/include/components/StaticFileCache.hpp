@@ -0,0 +1,141 @@
+/*
+ * StaticFileCache.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-21
+
+Description: Cached, precompressed static asset serving
+
+**************************************************/
+
+#ifndef LITHIUM_COMPONENTS_STATIC_FILE_CACHE_HPP
+#define LITHIUM_COMPONENTS_STATIC_FILE_CACHE_HPP
+
+#include "oatpp/web/protocol/http/incoming/Request.hpp"
+#include "oatpp/web/protocol/http/outgoing/Response.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * In-memory cache of static web assets.
+ *
+ * Files up to `maxCachedFileSize` are read once and kept together with their
+ * gzip and brotli variants, taken from a fresh `file.gz` / `file.br` next to
+ * the source or computed by preload(). On a cache miss the file is served
+ * uncompressed and its variants are computed on a background thread, once
+ * per file however many requests missed. Entries are keyed by path and
+ * revalidated against size and mtime with a single stat() per request.
+ * Responses carry a weak ETag and Cache-Control, and a matching
+ * `If-None-Match` is answered with 304. Larger files are not cached and
+ * are streamed straight out of an mmap'd view instead of being copied into
+ * a string.
+ */
+class StaticFileCache {
+public:
+    struct Options {
+        /** Directory relative paths are resolved against. */
+        std::filesystem::path root = std::filesystem::current_path();
+        /** Files above this size are streamed, not cached. */
+        std::uintmax_t maxCachedFileSize = 2 * 1024 * 1024;
+        /** Total bytes (including variants) the cache may hold. */
+        std::uintmax_t maxCacheBytes = 64 * 1024 * 1024;
+        /** Cache-Control for versioned assets (js, css, fonts, images). */
+        std::string assetCacheControl = "public, max-age=86400";
+        /** Cache-Control for html documents, always revalidated. */
+        std::string documentCacheControl = "no-cache";
+    };
+
+    struct Asset;
+
+private:
+    Options m_options;
+    std::unordered_map<std::string, std::shared_ptr<const Asset>> m_assets;
+    std::uintmax_t m_cachedBytes = 0;
+    mutable std::shared_mutex m_mutex;
+
+    /* keys waiting for or being compressed, guarded by m_jobMutex */
+    std::deque<std::string> m_jobs;
+    std::unordered_set<std::string> m_compressing;
+    std::mutex m_jobMutex;
+    std::condition_variable_any m_jobCv;
+    /* started on the first miss; stopped and joined first on destruction */
+    std::jthread m_compressor;
+
+private:
+    std::shared_ptr<const Asset> load(const std::filesystem::path& path,
+                                      std::uintmax_t size, std::int64_t mtime,
+                                      bool compress);
+    /**
+     * Cache `asset` under `key` unless an entry for the same file version is
+     * already there. Caller holds m_mutex exclusively.
+     * @return - the cached asset, `asset` if it was not cached.
+     */
+    std::shared_ptr<const Asset> storeLocked(
+        const std::string& key, const std::shared_ptr<const Asset>& asset);
+    void scheduleCompression(const std::string& key);
+    void compressPending(std::stop_token token);
+
+public:
+    StaticFileCache() = default;
+    explicit StaticFileCache(Options options);
+
+    StaticFileCache(const StaticFileCache&) = delete;
+    StaticFileCache& operator=(const StaticFileCache&) = delete;
+
+    /**
+     * Build the response for a GET of `relativePath`.
+     * @param request - used for If-None-Match and Accept-Encoding.
+     * @param relativePath - path below the root, `..` is rejected.
+     * @param allowedExtensions - empty to allow everything.
+     * @return - response, 404/403 for missing or forbidden files.
+     */
+    std::shared_ptr<oatpp::web::protocol::http::outgoing::Response> serve(
+        const std::shared_ptr<oatpp::web::protocol::http::incoming::Request>&
+            request,
+        const std::string& relativePath,
+        const std::unordered_set<std::string>& allowedExtensions = {});
+
+    /**
+     * Load and compress every cacheable file below `directory` up front.
+     * @return - number of files loaded.
+     */
+    std::size_t preload(const std::filesystem::path& directory);
+
+    /**
+     * Drop all cached entries.
+     */
+    void clear();
+
+    /**
+     * Bytes currently held by the cache.
+     */
+    std::uintmax_t cachedBytes() const;
+
+    /**
+     * MIME type for a file extension (without the dot).
+     */
+    static std::string contentType(const std::string& extension);
+
+    /**
+     * Does an `If-None-Match` value match `etag`? The value is `*` or a
+     * comma separated list of entity tags, compared weakly (RFC 9110 13.1.2).
+     */
+    static bool matchesEntityTag(const std::string& ifNoneMatch,
+                                 const std::string& etag);
+};
+
+#endif  // LITHIUM_COMPONENTS_STATIC_FILE_CACHE_HPP
@@ -0,0 +1,212 @@
+/*
+ * UploadManager.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-22
+
+Description: Streaming, resumable file uploads
+
+**************************************************/
+
+#ifndef LITHIUM_COMPONENTS_UPLOAD_MANAGER_HPP
+#define LITHIUM_COMPONENTS_UPLOAD_MANAGER_HPP
+
+#include "oatpp/core/data/stream/Stream.hpp"
+
+#include "atom/algorithm/md5.hpp"
+#include "atom/memory/object.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Fixed-size write buffer lent to an upload while it receives data.
+ */
+struct UploadBuffer {
+    explicit UploadBuffer(std::size_t capacity) : data(capacity) {}
+    void reset() { used = 0; }
+
+    std::vector<char> data;
+    std::size_t used = 0;
+};
+
+/**
+ * Streams uploaded files to disk.
+ *
+ * Each upload is written to `<tempDirectory>/<id>.part` through a buffer
+ * borrowed from a fixed pool and hashed (MD5) as the bytes arrive, so memory
+ * use does not depend on the file size. Uploads can be resumed: a chunk must
+ * start at the current offset (as reported by status()), which is also the
+ * number of bytes hashed so far. The expected size is given on create() or
+ * by the first chunk that declares a total; once it is reached the file is
+ * synced and moved into `directory`, so readers never see a partial file.
+ * Uploads of unknown size complete on an explicit commit(). An existing file
+ * is never replaced: the upload gets a free name (`name (1).ext`, ...)
+ * instead.
+ */
+class UploadManager {
+public:
+    struct Options {
+        /** Where finished uploads are renamed to. */
+        std::filesystem::path directory = "./upload";
+        /** Where partial uploads live; same filesystem as `directory`. */
+        std::filesystem::path tempDirectory = "./tmp";
+        /** Size of one pooled write buffer. */
+        std::size_t bufferSize = 256 * 1024;
+        /** Number of pooled buffers (concurrently buffered uploads). */
+        std::size_t bufferCount = 16;
+        /** Largest accepted upload. */
+        std::uintmax_t maxFileSize = std::uintmax_t{8} << 30;
+        /** Idle uploads are dropped after this long. */
+        std::chrono::seconds idleTimeout{3600};
+        /** Bearer token the upload endpoints require, none are accepted
+         * while it is empty. */
+        std::string token;
+    };
+
+    struct Status {
+        std::string id;
+        std::string name;
+        std::uintmax_t offset = 0;
+        /** Expected size, 0 if unknown. */
+        std::uintmax_t size = 0;
+        bool complete = false;
+        /** Hex MD5 of the file, set once complete. */
+        std::string md5;
+        /** Final path, set once complete. */
+        std::string path;
+    };
+
+    class Upload;
+
+private:
+    Options m_options;
+    ObjectPool<UploadBuffer> m_buffers;
+    std::unordered_map<std::string, std::shared_ptr<Upload>> m_uploads;
+    std::mutex m_mutex;
+
+private:
+    static std::string makeId();
+
+public:
+    UploadManager();
+    explicit UploadManager(Options options);
+    ~UploadManager();
+
+    /**
+     * Start a new upload.
+     * @param name - client file name, reduced to its last path component.
+     * @param size - expected size in bytes, 0 if unknown (a chunk may still
+     * declare it, otherwise the upload completes on Upload::commit()).
+     * @return - nullptr if the size is too large or the file can't be
+     * created.
+     */
+    std::shared_ptr<Upload> create(const std::string& name,
+                                   std::uintmax_t size);
+
+    /**
+     * Find an upload by id, nullptr if unknown or expired.
+     */
+    std::shared_ptr<Upload> find(const std::string& id);
+
+    /**
+     * Abort an upload and delete its partial file.
+     */
+    bool cancel(const std::string& id);
+
+    /**
+     * Drop uploads idle for longer than the configured timeout.
+     * @return - number of uploads dropped.
+     */
+    std::size_t expire();
+
+    const Options& getOptions() const { return m_options; }
+
+    /**
+     * Check a bearer token against Options::token in constant time.
+     */
+    bool authorize(const std::string& token) const;
+
+    /**
+     * Parse `bytes <first>-<last>/<total|*>`.
+     * @return - {first, last + 1, total (0 if `*`)}, or nothing if malformed.
+     */
+    static std::optional<std::tuple<std::uintmax_t, std::uintmax_t,
+                                    std::uintmax_t>>
+    parseContentRange(const std::string& header);
+};
+
+/**
+ * One upload in progress. Also the WriteCallback request bodies and
+ * multipart parts are streamed into.
+ */
+class UploadManager::Upload : public oatpp::data::stream::WriteCallback {
+    friend class UploadManager;
+
+private:
+    UploadManager* m_manager;
+    Status m_status;
+    std::filesystem::path m_tempPath;
+    int m_fd = -1;
+    atom::algorithm::MD5 m_md5;
+    ObjectPool<UploadBuffer>::Handle m_buffer;
+    /* bytes accepted in the current chunk, and its declared end */
+    std::uintmax_t m_chunkEnd = 0;
+    /* Options::maxFileSize, no chunk reaches past it */
+    std::uintmax_t m_maxSize;
+    bool m_busy = false;
+    bool m_failed = false;
+    std::chrono::steady_clock::time_point m_lastActive;
+    std::mutex m_mutex;
+
+private:
+    bool writeOut(const char* data, std::size_t size);
+    bool flushBuffer();
+    void close();
+
+public:
+    Upload(UploadManager* manager, Status status,
+           std::filesystem::path tempPath, int fd);
+    ~Upload() override;
+
+    /**
+     * Begin receiving bytes [first, last), `last` is capped at the largest
+     * accepted upload. Fails if another chunk is in flight or `first` is not
+     * the current offset.
+     * @param total - total size the chunk declares, 0 if none. Sets the
+     * expected size if it was unknown, and must match it otherwise.
+     */
+    bool begin(std::uintmax_t first, std::uintmax_t last,
+               std::uintmax_t total = 0);
+
+    /**
+     * Finish the current chunk: flush buffered bytes and return the buffer
+     * to the pool. Commits when the expected size has been reached.
+     * @return - false if writing failed.
+     */
+    bool end();
+
+    /**
+     * Flush, sync and atomically rename to the final path.
+     */
+    bool commit();
+
+    Status status();
+
+    oatpp::v_io_size write(const void* data, v_buff_size count,
+                           oatpp::async::Action& action) override;
+};
+
+#endif  // LITHIUM_COMPONENTS_UPLOAD_MANAGER_HPP
@@ -81,6 +81,10 @@ inline DeviceType StringToDeviceType(const std::string& type) {
 
 #include "lithiumapp.hpp"
 
+#include "atom/function/global_ptr.hpp"
+#include "device/discovery.hpp"
+#include "utils/constant.hpp"
+
 #include OATPP_CODEGEN_BEGIN(ApiController)  //<- Begin Codegen
 
 class DeviceController : public oatpp::web::server::api::ApiController {
@@ -522,12 +526,20 @@ public:
             auto res = StatusDto::createShared();
             if (body->device_type.getValue("") == "") {
                 res->error = "Invalid Parameters";
-                res->message = "Device name is required";
+                res->message = "Device type is required";
             } else {
-                auto device_name = body->device_type.getValue("");
-                if (!lithium::MyApp->removeDeviceByName(device_name)) {
+                // 发现服务在后台持续运行，这里只读取缓存并触发新一轮探测
+                auto discovery = GetPtr<lithium::AlpacaDiscovery>(
+                    constants::LITHIUM_DEVICE_DISCOVERY);
+                if (!discovery || !*discovery) {
                     res->error = "DeviceError";
-                    res->message = "Failed to remove device";
+                    res->message = "Device discovery is not running";
+                } else {
+                    (*discovery)->probe();
+                    res->message =
+                        (*discovery)
+                            ->devices(body->device_type.getValue(""))
+                            .dump();
                 }
             }
             return _return(
@@ -20,11 +20,9 @@ Description: Static Route
 #include "oatpp/parser/json/mapping/ObjectMapper.hpp"
 #include "oatpp/web/server/api/ApiController.hpp"
 
-#include <filesystem>
-#include <fstream>
-#include <sstream>
+#include "components/StaticFileCache.hpp"
+
 #include <string>
-#include <unordered_set>
 
 class StaticController : public oatpp::web::server::api::ApiController {
 public:
@@ -43,44 +41,12 @@ public:
         return std::make_shared<StaticController>(objectMapper);
     }
 
-    // ----------------------------------------------------------------
-    // Static Loader
-    // ----------------------------------------------------------------
-
-    static std::string loadResource(
-        const std::string &path,
-        const std::unordered_set<std::string> &allowedExtensions,
-        bool checkAllowed = true) {
-        std::string fullPath;
-        if (std::filesystem::path(path).is_absolute()) {
-            fullPath = path;
-        } else {
-            std::filesystem::path currentPath = std::filesystem::current_path();
-            fullPath = (currentPath / path).string();
-        }
-
-        std::string fileExtension =
-            fullPath.substr(fullPath.find_last_of(".") + 1);
-
-        if (checkAllowed &&
-            allowedExtensions.find(fileExtension) == allowedExtensions.end()) {
-            throw std::runtime_error("File type not allowed: " + fileExtension);
-        }
-
-        std::ifstream file(fullPath);
-
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to open file: " + fullPath);
-        }
-
-        try {
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            return buffer.str();
-        } catch (const std::exception &e) {
-            throw std::runtime_error("Failed to read file: " + fullPath +
-                                     ". Error: " + e.what());
-        }
+    /**
+     * Cache shared by every static endpoint, rooted at the working directory.
+     */
+    static StaticFileCache &staticFiles() {
+        static StaticFileCache cache;
+        return cache;
     }
 
 #include OATPP_CODEGEN_BEGIN(ApiController)  //<- Begin Codegen
@@ -93,10 +59,8 @@ public:
     ENDPOINT_ASYNC("GET", "/", IndexRequestHandler) {
         ENDPOINT_ASYNC_INIT(IndexRequestHandler);
         Action act() override {
-            auto response = controller->createResponse(
-                Status::CODE_200, loadResource("index.html", {"html"}));
-            response->putHeader(Header::CONTENT_TYPE, "text/html");
-            return _return(response);
+            return _return(
+                staticFiles().serve(request, "index.html", {"html"}));
         }
     };
 
@@ -104,10 +68,8 @@ public:
     ENDPOINT_ASYNC("GET", "/client", ClientRequestHandler) {
         ENDPOINT_ASYNC_INIT(ClientRequestHandler);
         Action act() override {
-            auto response = controller->createResponse(
-                Status::CODE_200, loadResource("client/index.html", {"html"}));
-            response->putHeader(Header::CONTENT_TYPE, "text/html");
-            return _return(response);
+            return _return(
+                staticFiles().serve(request, "client/index.html", {"html"}));
         }
     };
 
@@ -115,11 +77,8 @@ public:
     ENDPOINT_ASYNC("GET", "/novnc", NoVNCRequestHandler) {
         ENDPOINT_ASYNC_INIT(NoVNCRequestHandler);
         Action act() override {
-            auto response = controller->createResponse(
-                Status::CODE_200,
-                loadResource("module/novnc/index.html", {"html"}));
-            response->putHeader(Header::CONTENT_TYPE, "text/html");
-            return _return(response);
+            return _return(staticFiles().serve(
+                request, "module/novnc/index.html", {"html"}));
         }
     };
 
@@ -127,11 +86,8 @@ public:
     ENDPOINT_ASYNC("GET", "/webssh", WebSSHRequestHandler) {
         ENDPOINT_ASYNC_INIT(WebSSHRequestHandler);
         Action act() override {
-            auto response = controller->createResponse(
-                Status::CODE_200,
-                loadResource("module/webssh/index.html", {"html"}));
-            response->putHeader(Header::CONTENT_TYPE, "text/html");
-            return _return(response);
+            return _return(staticFiles().serve(
+                request, "module/webssh/index.html", {"html"}));
         }
     };
 
@@ -145,13 +101,9 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = pathLabel.toString();
-            auto buffer = loadResource(
-                path.getValue(""),
-                {"json", "js", "css", "html", "jpg", "png", "robot"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
-            return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+            return _return(staticFiles().serve(
+                request, path.getValue(""),
+                {"json", "js", "css", "html", "jpg", "png", "robot"}));
         }
     };
 
@@ -169,14 +121,10 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "css/" + pathLabel.toString();
-            auto buffer = loadResource(
-                path.getValue(""),
+            return _return(staticFiles().serve(
+                request, path.getValue(""),
                 {"json", "js", "css", "html", "jpg", "png", "robot", "woff2",
-                 "tff", "ico", "svg", "mp3", "oga", "woff", "ttf"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
-            return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+                 "tff", "ico", "svg", "mp3", "oga", "woff", "ttf"}));
         }
     };
 
@@ -192,11 +140,8 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "js/" + pathLabel.toString();
-            auto buffer = loadResource(path.getValue(""), {"js"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
             return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+                staticFiles().serve(request, path.getValue(""), {"js"}));
         }
     };
 
@@ -210,11 +155,8 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "json/" + pathLabel.toString();
-            auto buffer = loadResource(path.getValue(""), {"json"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
             return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+                staticFiles().serve(request, path.getValue(""), {"json"}));
         }
     };
 
@@ -228,12 +170,9 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "font/" + pathLabel.toString();
-            auto buffer = loadResource(path.getValue(""),
-                                       {"tff", "tff", "woff", "woff2", "eot"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
-            return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+            return _return(staticFiles().serve(
+                request, path.getValue(""),
+                {"tff", "tff", "woff", "woff2", "eot"}));
         }
     };
 
@@ -252,11 +191,8 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "node_modules/" + pathLabel.toString();
-            auto buffer = loadResource(path.getValue(""), {"css", "js"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
             return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+                staticFiles().serve(request, path.getValue(""), {"css", "js"}));
         }
     };
 
@@ -272,11 +208,9 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "sounds/" + pathLabel.toString();
-            auto buffer = loadResource(path.getValue(""), {"oga", "mp3"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
-            return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+            return _return(staticFiles().serve(
+                request, path.getValue(""),
+                {"oga", "mp3"}));
         }
     };
 
@@ -292,12 +226,9 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "textures/" + pathLabel.toString();
-            auto buffer =
-                loadResource(path.getValue(""), {"gif", "png", "svg", "jpg"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
-            return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+            return _return(staticFiles().serve(
+                request, path.getValue(""),
+                {"gif", "png", "svg", "jpg"}));
         }
     };
 
@@ -313,12 +244,9 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "webfonts/" + pathLabel.toString();
-            auto buffer = loadResource(path.getValue(""),
-                                       {"eot", "svg", "ttf", "woff", "woff2"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
-            return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+            return _return(staticFiles().serve(
+                request, path.getValue(""),
+                {"eot", "svg", "ttf", "woff", "woff2"}));
         }
     };
 
@@ -334,11 +262,8 @@ public:
             auto pathLabel = caret.putLabel();
             caret.findChar('?');
             auto path = "assets/" + pathLabel.toString();
-            auto buffer = loadResource(path.getValue(""), {"css", "js"});
-            OATPP_ASSERT_HTTP(buffer != "", Status::CODE_500,
-                              "Can't read file");
             return _return(
-                controller->createResponse(Status::CODE_200, buffer));
+                staticFiles().serve(request, path.getValue(""), {"css", "js"}));
         }
     };
 
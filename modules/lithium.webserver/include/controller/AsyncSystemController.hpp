@@ -15,16 +15,18 @@ Description: System Route
 #ifndef LITHIUM_ASYNC_SYSTEM_CONTROLLER_HPP
 #define LITHIUM_ASYNC_SYSTEM_CONTROLLER_HPP
 
-#include "atom/system/module/battery.hpp"
-#include "atom/system/module/cpu.hpp"
-#include "atom/system/module/disk.hpp"
-#include "atom/system/module/memory.hpp"
-#include "atom/system/module/os.hpp"
-#include "atom/system/module/wifi.hpp"
+#include "atom/sysinfo/battery.hpp"
+#include "atom/sysinfo/cpu.hpp"
+#include "atom/sysinfo/disk.hpp"
+#include "atom/sysinfo/memory.hpp"
+#include "atom/sysinfo/os.hpp"
+#include "atom/sysinfo/sampler.hpp"
+#include "atom/sysinfo/wifi.hpp"
 #include "atom/system/system.hpp"
 
 #include "oatpp/core/macro/codegen.hpp"
 #include "oatpp/core/macro/component.hpp"
+#include "oatpp/core/utils/ConversionUtils.hpp"
 #include "oatpp/parser/json/mapping/ObjectMapper.hpp"
 #include "oatpp/web/server/api/ApiController.hpp"
 
@@ -33,6 +35,34 @@ Description: System Route
 #include OATPP_CODEGEN_BEGIN(ApiController)  //<- Begin Codegen
 
 class SystemController : public oatpp::web::server::api::ApiController {
+private:
+    /* dynamic metrics come from the shared sampler snapshot, so any number
+     * of dashboards cost one procfs read per interval */
+    OATPP_COMPONENT(std::shared_ptr<atom::system::SystemSampler>, m_sampler);
+
+    /* hardware facts that do not change while running, read once */
+    struct CpuInfo {
+        std::string model;
+        double frequency;
+        std::string identifier;
+        int packages;
+        int cores;
+    };
+
+    static const CpuInfo &cpuInfo() {
+        static const CpuInfo info{atom::system::getCPUModel(),
+                                  atom::system::getProcessorFrequency(),
+                                  atom::system::getProcessorIdentifier(),
+                                  atom::system::getNumberOfPhysicalPackages(),
+                                  atom::system::getNumberOfPhysicalCPUs()};
+        return info;
+    }
+
+    static const atom::system::MemoryInfo::MemorySlot &memorySlot() {
+        static const auto slot = atom::system::getPhysicalMemoryInfo();
+        return slot;
+    }
+
 public:
     SystemController(const std::shared_ptr<ObjectMapper> &objectMapper)
         : oatpp::web::server::api::ApiController(objectMapper) {}
@@ -64,8 +94,9 @@ public:
         Action act() override {
             auto res = BaseReturnSystemDto::createShared();
             res->command = "getUICpuUsage";
-            if (float cpu_usage = atom::system::getCurrentCpuUsage();
-                cpu_usage <= 0.0f) {
+            /* an idle CPU legitimately reports 0% over an interval */
+            if (float cpu_usage = controller->m_sampler->snapshot()->cpuUsage;
+                cpu_usage < 0.0f) {
                 res->status = "error";
                 res->message = "Failed to get current CPU usage";
                 res->error = "System Error";
@@ -91,7 +122,8 @@ public:
         Action act() override {
             auto res = BaseReturnSystemDto::createShared();
             res->command = "getUICpuTemperature";
-            if (float cpu_temp = atom::system::getCurrentCpuTemperature();
+            if (float cpu_temp =
+                    controller->m_sampler->snapshot()->cpuTemperature;
                 cpu_temp <= 0.0f) {
                 res->code = 500;
                 res->status = "error";
@@ -119,11 +151,12 @@ public:
             auto res = ReturnCpuInfoDto::createShared();
             res->command = "getUICpuInfo";
 
-            auto cpu_model = atom::system::getCPUModel();
-            auto cpu_freq = atom::system::getProcessorFrequency();
-            auto cpu_id = atom::system::getProcessorIdentifier();
-            auto cpu_package = atom::system::getNumberOfPhysicalPackages();
-            auto cpu_core = atom::system::getNumberOfPhysicalCPUs();
+            const auto &info = cpuInfo();
+            const auto &cpu_model = info.model;
+            auto cpu_freq = info.frequency;
+            const auto &cpu_id = info.identifier;
+            auto cpu_package = info.packages;
+            auto cpu_core = info.cores;
 
             if (cpu_model.empty() || cpu_freq <= 0.0f || cpu_id.empty() ||
                 cpu_package <= 0 || cpu_core <= 0) [[unlikely]] {
@@ -176,7 +209,7 @@ public:
             auto res = BaseReturnSystemDto::createShared();
             res->command = "getUIMemoryUsage";
 
-            auto memory_usage = atom::system::getMemoryUsage();
+            auto memory_usage = controller->m_sampler->snapshot()->memoryUsage;
             if (memory_usage <= 0.0f) {
                 res->code = 500;
                 res->status = "error";
@@ -205,14 +238,15 @@ public:
             auto res = ReturnMemoryInfoDto::createShared();
             res->command = "getUIMemoryInfo";
 
-            auto total_memory = atom::system::getTotalMemorySize();
-            auto available_memory = atom::system::getAvailableMemorySize();
+            auto snapshot = controller->m_sampler->snapshot();
+            auto total_memory = snapshot->memoryTotal;
+            auto available_memory = snapshot->memoryAvailable;
             auto virtual_memory_max = atom::system::getVirtualMemoryMax();
             auto virtual_memory_used = atom::system::getVirtualMemoryUsed();
-            auto swap_memory_total = atom::system::getSwapMemoryTotal();
-            auto swap_memory_used = atom::system::getSwapMemoryUsed();
+            auto swap_memory_total = snapshot->swapTotal;
+            auto swap_memory_used = snapshot->swapUsed;
 
-            auto physical_memory = atom::system::getPhysicalMemoryInfo();
+            const auto &physical_memory = memorySlot();
 
             if (total_memory <= 0 || available_memory <= 0 ||
                 virtual_memory_max <= 0 || virtual_memory_used <= 0 ||
@@ -245,6 +279,51 @@ public:
         }
     };
 
+    ENDPOINT_INFO(getUIMetricHistory) {
+        info->summary = "Get recent values of a system metric";
+        info->queryParams.add<String>("metric").description =
+            "cpu_usage, cpu_temperature, memory_usage or swap_usage";
+        info->queryParams.add<String>("count").required = false;
+        info->addResponse<Object<ReturnMetricHistoryDto>>(
+            Status::CODE_200, "application/json", "History of the metric");
+    }
+    ENDPOINT_ASYNC("GET", "/api/system/history", getUIMetricHistory) {
+        ENDPOINT_ASYNC_INIT(getUIMetricHistory);
+        Action act() override {
+            auto res = ReturnMetricHistoryDto::createShared();
+            res->command = "getUIMetricHistory";
+
+            auto name = request->getQueryParameter("metric", "cpu_usage");
+            auto metric = atom::system::metricFromName(*name);
+            if (!metric) {
+                res->code = 400;
+                res->status = "error";
+                res->message = "Unknown metric";
+                res->error = "Invalid Parameters";
+                return _return(
+                    controller->createDtoResponse(Status::CODE_400, res));
+            }
+            v_uint64 count = 0;
+            if (auto countParam = request->getQueryParameter("count")) {
+                bool success = false;
+                count = oatpp::utils::conversion::strToUInt64(countParam,
+                                                              success);
+            }
+
+            res->status = "success";
+            res->code = 200;
+            res->metric = name;
+            res->interval = controller->m_sampler->getInterval().count();
+            res->values = {};
+            for (float value : controller->m_sampler->history(*metric, count)) {
+                res->values->push_back(value);
+            }
+            res->message = "Success get metric history";
+            return _return(
+                controller->createDtoResponse(Status::CODE_200, res));
+        }
+    };
+
     // ----------------------------------------------------------------
     // Disk Methods
     // ----------------------------------------------------------------
@@ -12,13 +12,13 @@ Description: Upload Route
 
 **************************************************/
 
-// TODO #12
-
 #ifndef LITHIUM_ASYNC_UPLOAD_CONTROLLER_HPP
 #define LITHIUM_ASYNC_UPLOAD_CONTROLLER_HPP
 
 #include "config.h"
 
+#include "components/UploadManager.hpp"
+
 #include "oatpp/web/mime/multipart/FileProvider.hpp"
 #include "oatpp/web/mime/multipart/InMemoryDataProvider.hpp"
 #include "oatpp/web/mime/multipart/Multipart.hpp"
@@ -29,17 +29,132 @@ Description: Upload Route
 
 #include "oatpp/core/macro/codegen.hpp"
 #include "oatpp/core/macro/component.hpp"
+#include "oatpp/core/utils/ConversionUtils.hpp"
 #include "oatpp/parser/json/mapping/ObjectMapper.hpp"
 #include "oatpp/web/server/api/ApiController.hpp"
+#include "oatpp/web/server/handler/AuthorizationHandler.hpp"
+
+#include <limits>
+#include <tuple>
 
 namespace multipart = oatpp::web::mime::multipart;
 
+/**
+ * Accepts the bearer token configured for the UploadManager.
+ */
+class UploadAuthorizationHandler
+    : public oatpp::web::server::handler::BearerAuthorizationHandler {
+private:
+    std::shared_ptr<UploadManager> m_uploads;
+
+public:
+    explicit UploadAuthorizationHandler(
+        const std::shared_ptr<UploadManager> &uploads)
+        : BearerAuthorizationHandler("lithium-upload"), m_uploads(uploads) {}
+
+    std::shared_ptr<oatpp::web::server::handler::AuthorizationObject>
+    authorize(const oatpp::String &token) override {
+        if (!token || !m_uploads->authorize(*token)) {
+            return nullptr;
+        }
+        return std::make_shared<
+            oatpp::web::server::handler::DefaultBearerAuthorizationObject>();
+    }
+};
+
+/**
+ * Multipart part reader that streams a part into an UploadManager upload
+ * instead of buffering it. Only one part per request may carry the file.
+ */
+class UploadPartReader : public multipart::AsyncPartReader {
+private:
+    std::shared_ptr<UploadManager> m_uploads;
+    std::shared_ptr<UploadManager::Upload> m_upload;
+
+public:
+    explicit UploadPartReader(const std::shared_ptr<UploadManager> &uploads)
+        : m_uploads(uploads) {}
+
+    /* a request that failed before the commit leaves nothing behind */
+    ~UploadPartReader() override {
+        if (m_upload) {
+            m_upload->end();
+            if (!m_upload->status().complete) {
+                m_uploads->cancel(m_upload->status().id);
+            }
+        }
+    }
+
+    oatpp::async::CoroutineStarter onNewPartAsync(
+        const std::shared_ptr<multipart::Part> &part) override {
+        if (m_upload) {
+            throw std::runtime_error("Only one file per request");
+        }
+        auto filename = part->getFilename();
+        m_upload = m_uploads->create(filename ? *filename : "upload", 0);
+        /* the open-ended chunk is capped at the largest accepted upload */
+        if (!m_upload ||
+            !m_upload->begin(0, std::numeric_limits<std::uintmax_t>::max())) {
+            throw std::runtime_error("Can't create upload");
+        }
+        return nullptr;
+    }
+
+    oatpp::async::CoroutineStarter onPartDataAsync(
+        const std::shared_ptr<multipart::Part> &part, const char *data,
+        oatpp::v_io_size size) override {
+        (void)part;
+        if (size > 0) {
+            oatpp::async::Action action;
+            if (m_upload->write(data, size, action) != size) {
+                throw std::runtime_error("Can't write upload");
+            }
+        } else if (!m_upload->end()) {
+            throw std::runtime_error("Can't write upload");
+        }
+        return nullptr;
+    }
+
+    /**
+     * The upload the part went to, nullptr if there was no such part.
+     */
+    std::shared_ptr<UploadManager::Upload> getUpload() const {
+        return m_upload;
+    }
+};
+
 #include OATPP_CODEGEN_BEGIN(ApiController)  //<- Begin Codegen
 
 class UploadController : public oatpp::web::server::api::ApiController {
+private:
+    OATPP_COMPONENT(std::shared_ptr<UploadManager>, m_uploads);
+
+    static oatpp::Fields<oatpp::Any> toFields(
+        const UploadManager::Status &status) {
+        return oatpp::Fields<oatpp::Any>(
+            {{"code", oatpp::Int32(200)},
+             {"message", oatpp::String("OK")},
+             {"id", oatpp::String(status.id)},
+             {"name", oatpp::String(status.name)},
+             {"offset", oatpp::UInt64(status.offset)},
+             {"size", oatpp::UInt64(status.size)},
+             {"complete", oatpp::Boolean(status.complete)},
+             {"md5", status.complete ? oatpp::String(status.md5) : nullptr},
+             {"path", status.complete ? oatpp::String(status.path) : nullptr}});
+    }
+
+    /* throws 401 unless the request carries the upload token */
+    void checkToken(const std::shared_ptr<IncomingRequest> &request) const {
+        handleDefaultAuthorization(request->getHeader(
+            oatpp::web::protocol::http::Header::AUTHORIZATION));
+    }
+
 public:
     UploadController(const std::shared_ptr<ObjectMapper> &objectMapper)
-        : oatpp::web::server::api::ApiController(objectMapper) {}
+        : oatpp::web::server::api::ApiController(objectMapper) {
+        setDefaultAuthorizationHandler(
+            std::make_shared<UploadAuthorizationHandler>(m_uploads));
+    }
 
     // ----------------------------------------------------------------
     // Pointer creator
@@ -62,18 +177,19 @@ public:
 
         /* Coroutine State */
         std::shared_ptr<multipart::PartList> m_multipart;
-        std::shared_ptr<oatpp::data::stream::BufferOutputStream>
-            m_bufferStream =
-                std::make_shared<oatpp::data::stream::BufferOutputStream>();
+        std::shared_ptr<UploadPartReader> m_fileReader;
 
         Action act() override {
+            controller->checkToken(request);
             m_multipart =
                 std::make_shared<multipart::PartList>(request->getHeaders());
             auto multipartReader =
                 std::make_shared<multipart::AsyncReader>(m_multipart);
 
-            multipartReader->setPartReader(
-                "file", multipart::createAsyncFilePartReader("./tmp"));
+            /* "file" is streamed to disk and hashed, never kept in memory */
+            m_fileReader =
+                std::make_shared<UploadPartReader>(controller->m_uploads);
+            multipartReader->setPartReader("file", m_fileReader);
 
             multipartReader->setDefaultPartReader(
                 multipart::createAsyncInMemoryPartReader(
@@ -84,35 +200,160 @@ public:
         }
 
         Action onUploaded() {
-            oatpp::String fileData;
-
-            auto file = m_multipart->getNamedPart("file");
-            if (file) {
-                return oatpp::data::stream::transferAsync(
-                           file->getPayload()->openInputStream(),
-                           m_bufferStream, 0,
-                           oatpp::data::buffer::IOBuffer::createShared())
-                    .next(yieldTo(
-                        &MultipartUploadToFile::sendResponseWithFileData));
+            auto upload = m_fileReader->getUpload();
+            OATPP_ASSERT_HTTP(upload, Status::CODE_400, "file is null");
+            OATPP_ASSERT_HTTP(upload->commit(), Status::CODE_500,
+                              "Failed to store file");
+            auto fields = toFields(upload->status());
+            fields["parts-uploaded"] = oatpp::Int32(m_multipart->count());
+            return _return(
+                controller->createDtoResponse(Status::CODE_200, fields));
+        }
+    };
+
+    // ----------------------------------------------------------------
+    // Resumable Upload Http Handler
+    //
+    // POST   /api/upload/session?name=<file>&size=<bytes>  start an upload
+    // GET    /api/upload/session/{id}                      current offset
+    // PUT    /api/upload/session/{id}                      send a chunk
+    // POST   /api/upload/session/{id}/commit               finish the upload
+    // DELETE /api/upload/session/{id}                      abort
+    //
+    // A chunk carries `Content-Range: bytes <first>-<last>/<size>` and must
+    // start at the current offset; without the header it is appended. After
+    // an interrupted chunk, GET the offset and continue from there. The
+    // upload completes with the chunk that reaches its size, taken from
+    // `size` or the first Content-Range total; without either, the client
+    // commits it once all chunks are sent.
+    //
+    // Every upload endpoint requires `Authorization: Bearer <token>` with
+    // the token configured for the UploadManager.
+    // ----------------------------------------------------------------
+
+    ENDPOINT_INFO(CreateUpload) { info->summary = "Start Resumable Upload"; }
+    ENDPOINT_ASYNC("POST", "/api/upload/session", CreateUpload) {
+        ENDPOINT_ASYNC_INIT(CreateUpload)
+
+        Action act() override {
+            controller->checkToken(request);
+            auto name = request->getQueryParameter("name");
+            OATPP_ASSERT_HTTP(name, Status::CODE_400, "name is required");
+            std::uintmax_t size = 0;
+            if (auto sizeParam = request->getQueryParameter("size")) {
+                bool success = false;
+                size = static_cast<std::uintmax_t>(
+                    oatpp::utils::conversion::strToUInt64(sizeParam,
+                                                          success));
+                OATPP_ASSERT_HTTP(success, Status::CODE_400, "invalid size");
+            }
+            auto upload = controller->m_uploads->create(*name, size);
+            OATPP_ASSERT_HTTP(upload, Status::CODE_413,
+                              "Upload can't be created");
+            return _return(controller->createDtoResponse(
+                Status::CODE_201, toFields(upload->status())));
+        }
+    };
+
+    ENDPOINT_INFO(GetUpload) { info->summary = "Get Upload Offset"; }
+    ENDPOINT_ASYNC("GET", "/api/upload/session/{id}", GetUpload) {
+        ENDPOINT_ASYNC_INIT(GetUpload)
+
+        Action act() override {
+            controller->checkToken(request);
+            auto upload =
+                controller->m_uploads->find(request->getPathVariable("id"));
+            OATPP_ASSERT_HTTP(upload, Status::CODE_404, "Unknown upload");
+            return _return(controller->createDtoResponse(
+                Status::CODE_200, toFields(upload->status())));
+        }
+    };
+
+    ENDPOINT_INFO(UploadChunk) { info->summary = "Upload File Chunk"; }
+    ENDPOINT_ASYNC("PUT", "/api/upload/session/{id}", UploadChunk) {
+        ENDPOINT_ASYNC_INIT(UploadChunk)
+
+        /* Coroutine State */
+        std::shared_ptr<UploadManager::Upload> m_upload;
+        bool m_started = false;
+
+        /* an aborted transfer still releases the chunk and its buffer */
+        ~UploadChunk() override {
+            if (m_started) {
+                m_upload->end();
+            }
+        }
+
+        Action act() override {
+            controller->checkToken(request);
+            m_upload =
+                controller->m_uploads->find(request->getPathVariable("id"));
+            OATPP_ASSERT_HTTP(m_upload, Status::CODE_404, "Unknown upload");
+
+            auto status = m_upload->status();
+            std::uintmax_t first = status.offset;
+            std::uintmax_t last = std::numeric_limits<std::uintmax_t>::max();
+            std::uintmax_t total = 0;
+            if (status.size != 0) {
+                last = status.size;
+            }
+            if (auto range = request->getHeader("Content-Range")) {
+                auto parsed = UploadManager::parseContentRange(*range);
+                OATPP_ASSERT_HTTP(parsed, Status::CODE_400,
+                                  "Malformed Content-Range");
+                std::tie(first, last, total) = *parsed;
+            }
+            auto maxSize = controller->m_uploads->getOptions().maxFileSize;
+            OATPP_ASSERT_HTTP(total <= maxSize && first <= maxSize,
+                              Status::CODE_413, "Upload is too large");
+            if (!m_upload->begin(first, last, total)) {
+                /* tell the client where to resume from */
+                return _return(controller->createDtoResponse(
+                    Status::CODE_409, toFields(m_upload->status())));
             }
+            m_started = true;
+            return request->transferBodyAsync(m_upload).next(
+                yieldTo(&UploadChunk::onChunk));
+        }
 
+        Action onChunk() {
+            m_started = false;
+            OATPP_ASSERT_HTTP(m_upload->end(), Status::CODE_500,
+                              "Failed to store chunk");
             return _return(controller->createDtoResponse(
-                Status::CODE_200,
-                oatpp::Fields<oatpp::Any>(
-                    {{"code", oatpp::Int32(200)},
-                     {"message", oatpp::String("OK")},
-                     {"parts-uploaded", oatpp::Int32(m_multipart->count())},
-                     {"file-data", nullptr /* no file data */}})));
+                Status::CODE_200, toFields(m_upload->status())));
         }
+    };
 
-        Action sendResponseWithFileData() {
+    ENDPOINT_INFO(CommitUpload) { info->summary = "Finish Upload"; }
+    ENDPOINT_ASYNC("POST", "/api/upload/session/{id}/commit", CommitUpload) {
+        ENDPOINT_ASYNC_INIT(CommitUpload)
+
+        Action act() override {
+            controller->checkToken(request);
+            auto upload =
+                controller->m_uploads->find(request->getPathVariable("id"));
+            OATPP_ASSERT_HTTP(upload, Status::CODE_404, "Unknown upload");
+            if (!upload->commit()) {
+                /* missing bytes or a chunk still in flight */
+                return _return(controller->createDtoResponse(
+                    Status::CODE_409, toFields(upload->status())));
+            }
             return _return(controller->createDtoResponse(
-                Status::CODE_200,
-                oatpp::Fields<oatpp::Any>(
-                    {{"code", oatpp::Int32(200)},
-                     {"message", oatpp::String("OK")},
-                     {"parts-uploaded", oatpp::Int32(m_multipart->count())},
-                     {"file-data", m_bufferStream->toString()}})));
+                Status::CODE_200, toFields(upload->status())));
+        }
+    };
+
+    ENDPOINT_INFO(CancelUpload) { info->summary = "Abort Upload"; }
+    ENDPOINT_ASYNC("DELETE", "/api/upload/session/{id}", CancelUpload) {
+        ENDPOINT_ASYNC_INIT(CancelUpload)
+
+        Action act() override {
+            controller->checkToken(request);
+            OATPP_ASSERT_HTTP(
+                controller->m_uploads->cancel(request->getPathVariable("id")),
+                Status::CODE_404, "Unknown upload");
+            return _return(controller->createResponse(Status::CODE_200, "OK"));
         }
     };
 
@@ -129,6 +370,7 @@ public:
                 std::make_shared<oatpp::data::stream::BufferOutputStream>();
 
         Action act() override {
+            controller->checkToken(request);
             m_multipart =
                 std::make_shared<multipart::PartList>(request->getHeaders());
             auto multipartReader =
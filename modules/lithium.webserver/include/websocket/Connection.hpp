@@ -21,6 +21,7 @@ Description: Websocket Connection
 #include "config/HubsConfig.hpp"
 
 #include "data/DTOs.hpp"
+#include "Telemetry.hpp"
 
 #include "oatpp-websocket/AsyncWebSocket.hpp"
 
@@ -31,14 +32,34 @@ Description: Websocket Connection
 #include "oatpp/core/data/mapping/ObjectMapper.hpp"
 #include "oatpp/core/macro/component.hpp"
 
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 class Session;  // FWD
 
-class Connection : public oatpp::websocket::AsyncWebSocket::Listener {
+class Connection : public oatpp::websocket::AsyncWebSocket::Listener,
+                   public std::enable_shared_from_this<Connection> {
 private:
+    /**
+     * A serialized frame waiting to be written. `data` is shared by every
+     * connection the frame was fanned out to.
+     */
+    struct QueuedFrame {
+        oatpp::String data;
+        oatpp::String coalesceKey;
+        bool binary = false;
+    };
+
     struct MessageQueue {
-        std::list<oatpp::Object<MessageDto>> queue;
+        std::list<QueuedFrame> queue;
+        /* coalesceKey -> queued frame with that key */
+        std::unordered_map<std::string, std::list<QueuedFrame>::iterator>
+            keyed;
         std::mutex mutex;
         bool active = false;
+        v_uint64 dropped = 0;
+        v_uint64 merged = 0;
     };
 
 private:
@@ -57,6 +78,8 @@ private:
     std::mutex m_socketMutex;
     std::shared_ptr<Session> m_hubSession;
     v_int64 m_connectionId;
+    /* telemetry subscriber id, unique across hub sessions */
+    v_int64 m_telemetryId;
     std::shared_ptr<MessageQueue> m_messageQueue;
 
 private:
@@ -70,6 +93,7 @@ private:
     OATPP_COMPONENT(std::shared_ptr<oatpp::async::Executor>, m_asyncExecutor);
     OATPP_COMPONENT(std::shared_ptr<oatpp::data::mapping::ObjectMapper>,
                     m_objectMapper, Constants::COMPONENT_REST_API);
+    OATPP_COMPONENT(std::shared_ptr<Telemetry>, m_telemetry);
 
 private:
     CoroutineStarter handlePong(const oatpp::Object<MessageDto>& message);
@@ -82,6 +106,10 @@ private:
         const oatpp::Object<MessageDto>& message);
     CoroutineStarter handleClientMessage(
         const oatpp::Object<MessageDto>& message);
+    CoroutineStarter handleTelemetrySubscribe(
+        const oatpp::Object<MessageDto>& message);
+    CoroutineStarter handleTelemetryUnsubscribe(
+        const oatpp::Object<MessageDto>& message);
     CoroutineStarter handleMessage(const oatpp::Object<MessageDto>& message);
 
 public:
@@ -110,6 +138,26 @@ public:
      */
     bool queueMessage(const oatpp::Object<MessageDto>& message);
 
+    /**
+     * Queue an already serialized frame. Used for fan-out, where one
+     * serialized buffer is shared by all recipients.
+     * @param frame - serialized message.
+     * @param coalesceKey - frames with the same non-null key are status
+     * frames: a newer one replaces a queued older one in place, and they are
+     * the first to be dropped when the queue is full.
+     * @param binary - send as a binary instead of a text frame.
+     * @return - `false` if the frame was dropped.
+     */
+    bool queueFrame(const oatpp::String& frame,
+                    const oatpp::String& coalesceKey = nullptr,
+                    bool binary = false);
+
+    /**
+     * Number of frames dropped and merged because of backpressure.
+     */
+    v_uint64 getDroppedFrames();
+    v_uint64 getMergedFrames();
+
     /**
      * Ping connection.
      */
@@ -138,6 +186,12 @@ public:
      */
     v_int64 getConnectionId();
 
+    /**
+     * Get the id this connection subscribes to telemetry under.
+     * @return
+     */
+    v_int64 getTelemetryId();
+
     /**
      * Remove circle `std::shared_ptr` dependencies
      */
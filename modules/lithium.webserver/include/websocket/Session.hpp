@@ -28,6 +28,10 @@ private:
     std::shared_ptr<Connection> m_host;
     std::mutex m_connectionsMutex;
 
+private:
+    OATPP_COMPONENT(std::shared_ptr<oatpp::data::mapping::ObjectMapper>,
+                    m_objectMapper, Constants::COMPONENT_REST_API);
+
 private:
     v_int64 m_pingCurrentTimestamp;
     v_int64 m_pingBestTime;
@@ -57,6 +61,21 @@ public:
     void broadcastSynchronizedEvent(v_int64 senderId,
                                     const oatpp::String& eventData);
 
+    /**
+     * Send a message to every connection of the session. The message is
+     * serialized once and the same frame is queued for all recipients.
+     * @param message
+     * @param coalesceKey - non-null for status/telemetry messages: a queued
+     * frame with the same key is replaced instead of queueing another one,
+     * and such frames are dropped first under backpressure.
+     * @param excludeConnectionId - connection to skip (usually the sender),
+     * `-1` for none.
+     * @return - number of connections the frame was queued for.
+     */
+    v_int64 broadcast(const oatpp::Object<MessageDto>& message,
+                      const oatpp::String& coalesceKey = nullptr,
+                      v_int64 excludeConnectionId = -1);
+
     v_int64 generateNewConnectionId();
 
     void checkAllConnectionsPings();
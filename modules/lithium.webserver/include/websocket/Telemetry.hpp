@@ -0,0 +1,229 @@
+/*
+ * Telemetry.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-20
+
+Description: Subscription based, delta compressed telemetry stream
+
+**************************************************/
+
+#ifndef LITHIUM_WEBSOCKET_TELEMETRY_HPP
+#define LITHIUM_WEBSOCKET_TELEMETRY_HPP
+
+#include "oatpp/core/Types.hpp"
+#include "oatpp/core/async/Executor.hpp"
+#include "oatpp/core/macro/component.hpp"
+
+#include "atom/type/json.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Connection;  // FWD
+
+/**
+ * Telemetry store and fan-out.
+ *
+ * Producers publish values under dotted paths (`system.cpu_usage`,
+ * `device.camera.temperature`, ...) or register sampled sources. Clients
+ * subscribe to paths or path prefixes over the hub WebSocket. For each
+ * subscriber the last sent version of every path is remembered and, at most
+ * once per subscriber interval, only the paths that changed since are
+ * pushed. A frame that cannot be queued (backpressure) leaves the
+ * subscriber's snapshot untouched, so the next frame carries the delta.
+ *
+ * Sources are sampled on a dedicated thread, so samplers may block (procfs,
+ * drivers); the async executor only diffs, encodes and queues frames, and
+ * frames are queued after the store lock has been released.
+ */
+class Telemetry {
+public:
+    using json = nlohmann::json;
+    using Sampler = std::function<json()>;
+
+    /**
+     * Destination of a subscriber's frames.
+     * Returns `false` if the frame was dropped (backpressure).
+     */
+    using FrameSink =
+        std::function<bool(const oatpp::String& frame, bool binary)>;
+
+    /**
+     * Wire encoding of telemetry frames.
+     */
+    enum class Encoding { JSON, CBOR, MSGPACK };
+
+    /**
+     * Frame producer tick. Subscriber intervals are rounded up to it.
+     */
+    static constexpr std::chrono::milliseconds TICK{50};
+
+private:
+    struct Entry {
+        json value;
+        v_uint64 version;
+    };
+
+    struct Source {
+        Sampler sampler;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next;
+    };
+
+    struct Subscriber {
+        /* the subscription ends when the owner goes away */
+        std::weak_ptr<void> owner;
+        FrameSink sink;
+        std::vector<std::string> patterns;
+        Encoding encoding = Encoding::JSON;
+        std::chrono::milliseconds interval{500};
+        std::chrono::steady_clock::time_point next;
+        /* path -> version last delivered to this subscriber */
+        std::unordered_map<std::string, v_uint64> sent;
+        v_uint64 seq = 0;
+        /* bumped by subscribe() so frames built before it are not committed */
+        v_uint64 generation = 0;
+    };
+
+    /**
+     * A frame built under the store lock and queued after releasing it.
+     */
+    struct PendingFrame {
+        v_int64 subscriberId;
+        v_uint64 generation;
+        v_uint64 seq;
+        std::shared_ptr<void> owner;
+        FrameSink sink;
+        Encoding encoding;
+        json message;
+        std::vector<std::pair<std::string, v_uint64>> delivered;
+        std::vector<std::string> removed;
+    };
+
+    struct State {
+        std::map<std::string, Entry> entries;
+        std::map<std::string, Source> sources;
+        std::unordered_map<v_int64, Subscriber> subscribers;
+        v_uint64 version = 0;
+        bool isActive = false;
+        /* set when sources or subscribers change, wakes the sampling thread */
+        bool sourcesChanged = false;
+        std::mutex mutex;
+        std::condition_variable_any sourcesCv;
+    };
+
+private:
+    std::shared_ptr<State> m_state;
+    std::once_flag m_samplingStarted;
+    /* samples sources; stopped and joined on destruction */
+    std::jthread m_samplingThread;
+    std::atomic<v_int64> m_nextSubscriberId{0};
+
+private:
+    OATPP_COMPONENT(std::shared_ptr<oatpp::async::Executor>, m_asyncExecutor);
+
+private:
+    static bool matches(const std::string& pattern, const std::string& path);
+    static bool flush(State& state);
+    static bool buildFrame(State& state, v_int64 id, Subscriber& subscriber,
+                           std::chrono::steady_clock::time_point now,
+                           std::vector<PendingFrame>& frames);
+    static void publishLocked(State& state, const std::string& path,
+                              json value);
+    static void runSources(State& state, std::stop_token token);
+    void startFlusher();
+
+public:
+    Telemetry();
+
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+
+    /**
+     * Set the value of a path. Publishing an unchanged value is free: no
+     * subscriber will see it again.
+     */
+    void publish(const std::string& path, json value);
+
+    /**
+     * Publish every member of a JSON object as `prefix.member`.
+     */
+    void publishObject(const std::string& prefix, const json& object);
+
+    /**
+     * Remove a path. Subscribers receive it in the `removed` list.
+     */
+    void remove(const std::string& path);
+
+    /**
+     * Register a source sampled while anybody is subscribed. The sampler is
+     * called on the telemetry sampling thread and may block.
+     * @param path - published path, an object result is flattened into it.
+     * @param interval - sampling interval.
+     */
+    void addSource(const std::string& path, Sampler sampler,
+                   std::chrono::milliseconds interval);
+
+    void removeSource(const std::string& path);
+
+    /**
+     * A subscriber id unique within this store. Connection ids restart at
+     * 0 in every hub session, so connections subscribe under one of these.
+     */
+    v_int64 newSubscriberId();
+
+    /**
+     * Subscribe a connection (replaces its previous subscription).
+     * @param connection
+     * @param patterns - exact paths or prefixes (`system` matches
+     * `system.cpu_usage`); `*` subscribes to everything.
+     * @param encoding
+     * @param interval - minimum time between two frames to this client.
+     */
+    void subscribe(const std::shared_ptr<Connection>& connection,
+                   const std::vector<std::string>& patterns,
+                   Encoding encoding, std::chrono::milliseconds interval);
+
+    /**
+     * Subscribe an arbitrary frame sink (replaces its previous subscription).
+     * @param id - subscriber id from `newSubscriberId`, as used by
+     * `unsubscribe`.
+     * @param owner - the subscription ends once the owner is destroyed.
+     * @param sink - called without any telemetry lock held.
+     */
+    void subscribe(v_int64 id, const std::weak_ptr<void>& owner,
+                   FrameSink sink, const std::vector<std::string>& patterns,
+                   Encoding encoding, std::chrono::milliseconds interval);
+
+    /**
+     * Drop patterns from a subscription; an empty list drops it entirely.
+     */
+    void unsubscribe(v_int64 subscriberId,
+                     const std::vector<std::string>& patterns = {});
+
+    /**
+     * Current value of a path, `null` if unknown.
+     */
+    json get(const std::string& path);
+
+    /**
+     * Parse an encoding name (`json`, `cbor`, `msgpack`).
+     */
+    static Encoding parseEncoding(const std::string& name);
+};
+
+#endif  // LITHIUM_WEBSOCKET_TELEMETRY_HPP
@@ -127,13 +127,30 @@ ENUM(MessageCodes, v_int32,
      */
      VALUE(OUTGOING_CLIENT_KICKED, 300),
 
+    /**
+     * Telemetry delta for the client's subscription. Payload:
+     * {"seq": n, "full": bool, "changes": {path: value}, "removed": [path]}.
+     * Sent as a binary frame when the subscription asked for cbor/msgpack.
+     */
+     VALUE(OUTGOING_TELEMETRY, 301),
+
 ///////////////////////////////////////////////////////////////////
 //// 400 - 499 incoming client messages
 
      /**
       * Client sends direct message to host.
       */
-     VALUE(INCOMING_CLIENT_MESSAGE, 400)
+     VALUE(INCOMING_CLIENT_MESSAGE, 400),
+
+     /**
+      * Client subscribes to telemetry paths.
+      */
+     VALUE(INCOMING_TELEMETRY_SUBSCRIBE, 401),
+
+     /**
+      * Client unsubscribes from telemetry paths (all of them if none given).
+      */
+     VALUE(INCOMING_TELEMETRY_UNSUBSCRIBE, 402)
 
 );
 
@@ -283,6 +300,30 @@ class OutgoingSynchronizedMessageDto : public oatpp::DTO {
 
 };
 
+/**
+ * Telemetry subscription.
+ */
+class TelemetrySubscribeDto : public oatpp::DTO {
+
+  DTO_INIT(TelemetrySubscribeDto, DTO)
+
+  /**
+   * Paths or path prefixes, `*` for everything.
+   */
+  DTO_FIELD(Vector<String>, paths) = {};
+
+  /**
+   * Frame encoding: `json` (default), `cbor` or `msgpack`.
+   */
+  DTO_FIELD(String, encoding) = "json";
+
+  /**
+   * Minimum interval between two telemetry frames.
+   */
+  DTO_FIELD(UInt32, intervalMillis) = 500;
+
+};
+
 /**
  * Message
  */
@@ -351,6 +392,12 @@ class MessageDto : public oatpp::DTO {
       case MessageCodes::INCOMING_CLIENT_MESSAGE:
         return oatpp::String::Class::getType();
 
+      case MessageCodes::INCOMING_TELEMETRY_SUBSCRIBE:
+        return oatpp::Object<TelemetrySubscribeDto>::Class::getType();
+
+      case MessageCodes::INCOMING_TELEMETRY_UNSUBSCRIBE:
+        return oatpp::Vector<oatpp::String>::Class::getType();
+
       default:
         throw std::runtime_error("not implemented");
 
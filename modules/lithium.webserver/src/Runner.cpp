@@ -22,6 +22,7 @@ Description: Lithium Server Runner
 #include "controller/AsyncIOController.hpp"
 #include "controller/AsyncStaticController.hpp"
 #include "controller/AsyncSystemController.hpp"
+#include "controller/AsyncUploadController.hpp"
 
 #include "oatpp-swagger/AsyncController.hpp"
 
@@ -129,6 +130,7 @@ Runner::Runner(const oatpp::Object<ConfigDto>& config,
     ADD_CONTROLLER(IOController, hostServer);
     ADD_CONTROLLER(StaticController, hostServer);
     ADD_CONTROLLER(SystemController, hostServer);
+    ADD_CONTROLLER(UploadController, hostServer);
 
     hostServer->getRouter()->addController(
         oatpp::swagger::AsyncController::createShared(docEndpoints));
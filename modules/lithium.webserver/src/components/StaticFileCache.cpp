@@ -0,0 +1,623 @@
+/*
+ * StaticFileCache.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-21
+
+Description: Cached, precompressed static asset serving
+
+**************************************************/
+
+#include "components/StaticFileCache.hpp"
+
+#include "oatpp/web/protocol/http/outgoing/BufferBody.hpp"
+
+#include <zlib.h>
+
+#ifdef LITHIUM_ENABLE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+
+namespace fs = std::filesystem;
+using oatpp::web::protocol::http::Status;
+using OutgoingResponse = oatpp::web::protocol::http::outgoing::Response;
+using oatpp::web::protocol::http::outgoing::BufferBody;
+
+struct StaticFileCache::Asset {
+    std::uintmax_t size = 0;
+    std::int64_t mtime = 0;
+    std::string etag;
+    std::string contentType;
+    oatpp::String identity;
+    oatpp::String gzip;
+    oatpp::String brotli;
+    /* gzip/brotli not computed yet, done by the compressor thread */
+    bool variantsPending = false;
+
+    std::uintmax_t footprint() const {
+        return (identity ? identity->size() : 0) + (gzip ? gzip->size() : 0) +
+               (brotli ? brotli->size() : 0);
+    }
+};
+
+namespace {
+
+/**
+ * Body backed by a read-only mapping of the file. getKnownData() exposes the
+ * mapping so the response is written straight from the page cache.
+ */
+class MappedFileBody : public oatpp::web::protocol::http::outgoing::Body {
+private:
+    const char* m_data = nullptr;
+    v_int64 m_size = 0;
+    v_int64 m_position = 0;
+    std::string m_contentType;
+#ifdef _WIN32
+    std::string m_buffer;
+#endif
+
+public:
+    MappedFileBody(const fs::path& path, std::uintmax_t size,
+                   std::string contentType)
+        : m_contentType(std::move(contentType)) {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        m_buffer.resize(size);
+        file.read(m_buffer.data(), static_cast<std::streamsize>(size));
+        m_buffer.resize(static_cast<std::size_t>(file.gcount()));
+        m_data = m_buffer.data();
+        m_size = static_cast<v_int64>(m_buffer.size());
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || size == 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return;
+        }
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return;
+        }
+        ::madvise(data, size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(data);
+        m_size = static_cast<v_int64>(size);
+#endif
+    }
+
+    ~MappedFileBody() override {
+#ifndef _WIN32
+        if (m_data != nullptr) {
+            ::munmap(const_cast<char*>(m_data), static_cast<size_t>(m_size));
+        }
+#endif
+    }
+
+    bool isValid() const { return m_data != nullptr; }
+
+    oatpp::v_io_size read(void* buffer, v_buff_size count,
+                          oatpp::async::Action& action) override {
+        (void)action;
+        auto n = std::min<v_int64>(count, m_size - m_position);
+        if (n <= 0) {
+            return 0;
+        }
+        std::memcpy(buffer, m_data + m_position, static_cast<size_t>(n));
+        m_position += n;
+        return n;
+    }
+
+    void declareHeaders(oatpp::web::protocol::http::Headers& headers) override {
+        if (!m_contentType.empty()) {
+            headers.putIfNotExists_LockFree(
+                oatpp::web::protocol::http::Header::CONTENT_TYPE,
+                m_contentType);
+        }
+    }
+
+    p_char8 getKnownData() override {
+        return reinterpret_cast<p_char8>(const_cast<char*>(m_data));
+    }
+
+    v_int64 getKnownSize() override { return m_size; }
+};
+
+bool isCompressible(const std::string& contentType) {
+    return contentType.starts_with("text/") ||
+           contentType.find("javascript") != std::string::npos ||
+           contentType.find("json") != std::string::npos ||
+           contentType.find("svg") != std::string::npos ||
+           contentType.find("xml") != std::string::npos ||
+           contentType == "application/wasm" || contentType == "font/ttf" ||
+           contentType == "application/vnd.ms-fontobject";
+}
+
+oatpp::String gzipCompress(const std::string& input) {
+    z_stream zs{};
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nullptr;
+    }
+    std::string output;
+    output.resize(deflateBound(&zs, input.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zs.avail_in = static_cast<uInt>(input.size());
+    zs.next_out = reinterpret_cast<Bytef*>(output.data());
+    zs.avail_out = static_cast<uInt>(output.size());
+    int ret = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        return nullptr;
+    }
+    output.resize(zs.total_out);
+    return oatpp::String(std::move(output));
+}
+
+oatpp::String brotliCompress(const std::string& input) {
+#ifdef LITHIUM_ENABLE_BROTLI
+    std::string output;
+    size_t size = BrotliEncoderMaxCompressedSize(input.size());
+    if (size == 0) {
+        return nullptr;
+    }
+    output.resize(size);
+    if (!BrotliEncoderCompress(
+            BROTLI_DEFAULT_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+            input.size(), reinterpret_cast<const uint8_t*>(input.data()),
+            &size, reinterpret_cast<uint8_t*>(output.data()))) {
+        return nullptr;
+    }
+    output.resize(size);
+    return oatpp::String(std::move(output));
+#else
+    (void)input;
+    return nullptr;
+#endif
+}
+
+/* Fill in the variants no sibling file provided. */
+void compressVariants(StaticFileCache::Asset& asset) {
+    const std::string& data = *asset.identity;
+    /* keep a variant only if it saves at least ~10% */
+    auto worthIt = [&data](const oatpp::String& variant) {
+        return variant && variant->size() < data.size() * 9 / 10
+                   ? variant
+                   : oatpp::String(nullptr);
+    };
+    if (!asset.gzip) {
+        asset.gzip = worthIt(gzipCompress(data));
+    }
+    if (!asset.brotli) {
+        asset.brotli = worthIt(brotliCompress(data));
+    }
+    asset.variantsPending = false;
+}
+
+std::int64_t modificationTime(const fs::path& path, std::error_code& ec) {
+    auto time = fs::last_write_time(path, ec);
+    return ec ? 0
+              : std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    time.time_since_epoch())
+                    .count();
+}
+
+/* A `file.gz` / `file.br` produced by the build, if not older than `file`. */
+oatpp::String readSibling(const fs::path& path, const char* suffix,
+                          std::int64_t mtime) {
+    fs::path sibling = path;
+    sibling += suffix;
+    std::error_code ec;
+    if (!fs::is_regular_file(sibling, ec) ||
+        modificationTime(sibling, ec) < mtime || ec) {
+        return nullptr;
+    }
+    std::ifstream file(sibling, std::ios::binary);
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    return oatpp::String(buffer.str());
+}
+
+/* Does the Accept-Encoding header list `coding` with a non-zero q? */
+bool accepts(const oatpp::String& header, const std::string& coding) {
+    if (!header) {
+        return false;
+    }
+    std::string_view value(*header);
+    std::size_t pos = 0;
+    while (pos < value.size()) {
+        auto end = value.find(',', pos);
+        auto item = value.substr(pos, end == std::string_view::npos
+                                          ? std::string_view::npos
+                                          : end - pos);
+        pos = end == std::string_view::npos ? value.size() : end + 1;
+        while (!item.empty() && item.front() == ' ') {
+            item.remove_prefix(1);
+        }
+        auto semicolon = item.find(';');
+        auto name = item.substr(0, semicolon);
+        while (!name.empty() && name.back() == ' ') {
+            name.remove_suffix(1);
+        }
+        if (name != coding && name != "*") {
+            continue;
+        }
+        if (semicolon != std::string_view::npos &&
+            item.find("q=0", semicolon) != std::string_view::npos &&
+            item.find("q=0.", semicolon) == std::string_view::npos) {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+StaticFileCache::StaticFileCache(Options options)
+    : m_options(std::move(options)) {}
+
+std::string StaticFileCache::contentType(const std::string& extension) {
+    static const std::unordered_map<std::string, std::string> types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"},
+        {"js", "application/javascript; charset=utf-8"},
+        {"mjs", "application/javascript; charset=utf-8"},
+        {"json", "application/json"},
+        {"map", "application/json"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"robot", "text/plain; charset=utf-8"},
+        {"xml", "application/xml"},
+        {"svg", "image/svg+xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"ico", "image/x-icon"},
+        {"webp", "image/webp"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"ttf", "font/ttf"},
+        {"tff", "font/ttf"},
+        {"eot", "application/vnd.ms-fontobject"},
+        {"mp3", "audio/mpeg"},
+        {"oga", "audio/ogg"},
+        {"wasm", "application/wasm"}};
+    auto it = types.find(extension);
+    return it != types.end() ? it->second : "application/octet-stream";
+}
+
+bool StaticFileCache::matchesEntityTag(const std::string& ifNoneMatch,
+                                       const std::string& etag) {
+    /* weak comparison: the W/ prefix is ignored on both sides */
+    auto opaque = [](std::string_view tag) {
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        return tag;
+    };
+    auto wanted = opaque(etag);
+
+    std::string_view value(ifNoneMatch);
+    auto isSpace = [](char c) { return c == ' ' || c == '\t'; };
+    std::size_t pos = 0;
+    auto skipSeparators = [&] {
+        while (pos < value.size() &&
+               (isSpace(value[pos]) || value[pos] == ',')) {
+            ++pos;
+        }
+    };
+    skipSeparators();
+    if (value.substr(pos, 1) == "*") {
+        return true;
+    }
+    while (pos < value.size()) {
+        auto start = pos;
+        if (value.substr(pos, 2) == "W/") {
+            pos += 2;
+        }
+        if (pos >= value.size() || value[pos] != '"') {
+            return false;  // malformed, never matches
+        }
+        auto close = value.find('"', pos + 1);
+        if (close == std::string_view::npos) {
+            return false;
+        }
+        pos = close + 1;
+        if (opaque(value.substr(start, pos - start)) == wanted) {
+            return true;
+        }
+        skipSeparators();
+    }
+    return false;
+}
+
+std::shared_ptr<const StaticFileCache::Asset> StaticFileCache::load(
+    const fs::path& path, std::uintmax_t size, std::int64_t mtime,
+    bool compress) {
+    auto asset = std::make_shared<Asset>();
+    asset->size = size;
+    asset->mtime = mtime;
+
+    std::ostringstream etag;
+    etag << "W/\"" << std::hex << size << '-' << mtime << '"';
+    asset->etag = etag.str();
+
+    auto extension = path.extension().string();
+    asset->contentType =
+        contentType(extension.empty() ? "" : extension.substr(1));
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return nullptr;
+    }
+    std::string data(size, '\0');
+    file.read(data.data(), static_cast<std::streamsize>(size));
+    data.resize(static_cast<std::size_t>(file.gcount()));
+
+    bool compressible =
+        isCompressible(asset->contentType) && data.size() > 256;
+    asset->identity = oatpp::String(std::move(data));
+    if (compressible) {
+        asset->gzip = readSibling(path, ".gz", mtime);
+        asset->brotli = readSibling(path, ".br", mtime);
+        asset->variantsPending = !asset->gzip || !asset->brotli;
+        if (asset->variantsPending && compress) {
+            compressVariants(*asset);
+        }
+    }
+    return asset;
+}
+
+std::shared_ptr<const StaticFileCache::Asset> StaticFileCache::storeLocked(
+    const std::string& key, const std::shared_ptr<const Asset>& asset) {
+    auto& slot = m_assets[key];
+    if (slot && slot->size == asset->size && slot->mtime == asset->mtime &&
+        (!slot->variantsPending || asset->variantsPending)) {
+        return slot;  // a concurrent miss got here first
+    }
+    if (slot) {
+        m_cachedBytes -= slot->footprint();
+    }
+    if (m_cachedBytes + asset->footprint() <= m_options.maxCacheBytes) {
+        slot = asset;
+        m_cachedBytes += asset->footprint();
+    } else {
+        m_assets.erase(key);
+    }
+    return asset;
+}
+
+void StaticFileCache::scheduleCompression(const std::string& key) {
+    {
+        std::lock_guard lock(m_jobMutex);
+        if (!m_compressing.insert(key).second) {
+            return;
+        }
+        m_jobs.push_back(key);
+        if (!m_compressor.joinable()) {
+            m_compressor = std::jthread(
+                [this](std::stop_token token) { compressPending(token); });
+        }
+    }
+    m_jobCv.notify_one();
+}
+
+void StaticFileCache::compressPending(std::stop_token token) {
+    std::unique_lock jobLock(m_jobMutex);
+    while (m_jobCv.wait(jobLock, token, [this] { return !m_jobs.empty(); })) {
+        auto key = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        jobLock.unlock();
+
+        /* retry while the file keeps being replaced under us */
+        while (!token.stop_requested()) {
+            std::shared_ptr<const Asset> current;
+            {
+                std::shared_lock lock(m_mutex);
+                auto it = m_assets.find(key);
+                if (it != m_assets.end()) {
+                    current = it->second;
+                }
+            }
+            if (!current || !current->variantsPending) {
+                break;
+            }
+            auto compressed = std::make_shared<Asset>(*current);
+            compressVariants(*compressed);
+
+            std::unique_lock lock(m_mutex);
+            auto it = m_assets.find(key);
+            if (it == m_assets.end() || it->second != current) {
+                continue;
+            }
+            m_cachedBytes -= current->footprint();
+            if (m_cachedBytes + compressed->footprint() <=
+                m_options.maxCacheBytes) {
+                it->second = std::move(compressed);
+            }
+            m_cachedBytes += it->second->footprint();
+            break;
+        }
+
+        jobLock.lock();
+        m_compressing.erase(key);
+    }
+}
+
+std::shared_ptr<OutgoingResponse> StaticFileCache::serve(
+    const std::shared_ptr<oatpp::web::protocol::http::incoming::Request>&
+        request,
+    const std::string& relativePath,
+    const std::unordered_set<std::string>& allowedExtensions) {
+    auto error = [](const Status& status, const char* message) {
+        return OutgoingResponse::createShared(
+            status, BufferBody::createShared(oatpp::String(message),
+                                             "text/plain; charset=utf-8"));
+    };
+
+    fs::path relative(relativePath);
+    if (relative.empty() || relative.is_absolute() ||
+        std::any_of(relative.begin(), relative.end(),
+                    [](const fs::path& part) { return part == ".."; })) {
+        return error(Status::CODE_403, "Forbidden");
+    }
+
+    auto extension = relative.extension().string();
+    extension = extension.empty() ? "" : extension.substr(1);
+    if (!allowedExtensions.empty() && !allowedExtensions.contains(extension)) {
+        return error(Status::CODE_403, "File type not allowed");
+    }
+
+    auto path = m_options.root / relative;
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    auto mtime = ec ? 0 : modificationTime(path, ec);
+    if (ec || !fs::is_regular_file(path, ec)) {
+        return error(Status::CODE_404, "Not Found");
+    }
+
+    auto key = path.lexically_normal().string();
+    std::shared_ptr<const Asset> asset;
+    {
+        std::shared_lock lock(m_mutex);
+        auto it = m_assets.find(key);
+        if (it != m_assets.end() && it->second->size == size &&
+            it->second->mtime == mtime) {
+            asset = it->second;
+        }
+    }
+
+    auto cacheControl = extension == "html" || extension == "htm"
+                            ? m_options.documentCacheControl
+                            : m_options.assetCacheControl;
+
+    if (!asset && size <= m_options.maxCachedFileSize) {
+        /* compressing inline would stall the executor, serve identity now */
+        asset = load(path, size, mtime, false);
+        if (asset) {
+            {
+                std::unique_lock lock(m_mutex);
+                asset = storeLocked(key, asset);
+            }
+            if (asset->variantsPending) {
+                scheduleCompression(key);
+            }
+        }
+    }
+
+    std::string etag;
+    if (asset) {
+        etag = asset->etag;
+    } else {
+        std::ostringstream stream;
+        stream << "W/\"" << std::hex << size << '-' << mtime << '"';
+        etag = stream.str();
+    }
+
+    auto ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch && matchesEntityTag(*ifNoneMatch, etag)) {
+        auto response = OutgoingResponse::createShared(
+            Status::CODE_304, BufferBody::createShared(oatpp::String("")));
+        response->putHeader("ETag", etag);
+        response->putHeader("Cache-Control", cacheControl);
+        return response;
+    }
+
+    std::shared_ptr<OutgoingResponse> response;
+    if (asset) {
+        auto acceptEncoding = request->getHeader("Accept-Encoding");
+        oatpp::String body = asset->identity;
+        const char* encoding = nullptr;
+        if (asset->brotli && accepts(acceptEncoding, "br")) {
+            body = asset->brotli;
+            encoding = "br";
+        } else if (asset->gzip && accepts(acceptEncoding, "gzip")) {
+            body = asset->gzip;
+            encoding = "gzip";
+        }
+        response = OutgoingResponse::createShared(
+            Status::CODE_200,
+            BufferBody::createShared(body, asset->contentType));
+        if (encoding != nullptr) {
+            response->putHeader("Content-Encoding", encoding);
+        }
+        if (asset->gzip || asset->brotli) {
+            response->putHeader("Vary", "Accept-Encoding");
+        }
+    } else {
+        auto body = std::make_shared<MappedFileBody>(path, size,
+                                                     contentType(extension));
+        if (!body->isValid() && size != 0) {
+            return error(Status::CODE_500, "Can't read file");
+        }
+        response = OutgoingResponse::createShared(Status::CODE_200, body);
+    }
+
+    response->putHeader("ETag", etag);
+    response->putHeader("Cache-Control", cacheControl);
+    return response;
+}
+
+std::size_t StaticFileCache::preload(const fs::path& directory) {
+    std::size_t loaded = 0;
+    std::error_code ec;
+    auto base = directory.is_absolute() ? directory
+                                        : m_options.root / directory;
+    for (fs::recursive_directory_iterator it(base, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        auto extension = it->path().extension();
+        if (extension == ".gz" || extension == ".br") {
+            continue;
+        }
+        auto size = it->file_size(ec);
+        if (ec || size > m_options.maxCachedFileSize) {
+            continue;
+        }
+        auto mtime = modificationTime(it->path(), ec);
+        auto asset = load(it->path(), size, mtime, true);
+        if (!asset) {
+            continue;
+        }
+        std::unique_lock lock(m_mutex);
+        if (m_cachedBytes + asset->footprint() > m_options.maxCacheBytes) {
+            break;
+        }
+        storeLocked(it->path().lexically_normal().string(), asset);
+        ++loaded;
+    }
+    return loaded;
+}
+
+void StaticFileCache::clear() {
+    std::unique_lock lock(m_mutex);
+    m_assets.clear();
+    m_cachedBytes = 0;
+}
+
+std::uintmax_t StaticFileCache::cachedBytes() const {
+    std::shared_lock lock(m_mutex);
+    return m_cachedBytes;
+}
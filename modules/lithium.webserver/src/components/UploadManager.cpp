@@ -0,0 +1,445 @@
+/*
+ * UploadManager.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-22
+
+Description: Streaming, resumable file uploads
+
+**************************************************/
+
+#include "components/UploadManager.hpp"
+
+#include "oatpp/core/base/Environment.hpp"
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+int openFile(const fs::path& path) {
+#ifdef _WIN32
+    return ::_wopen(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                    _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+#endif
+}
+
+long long writeFile(int fd, const char* data, std::size_t size) {
+#ifdef _WIN32
+    auto count = static_cast<unsigned>(std::min<std::size_t>(size, 1 << 30));
+    return ::_write(fd, data, count);
+#else
+    return ::write(fd, data, size);
+#endif
+}
+
+int syncFile(int fd) {
+#ifdef _WIN32
+    return ::_commit(fd);
+#else
+    return ::fdatasync(fd);
+#endif
+}
+
+void closeFile(int fd) {
+#ifdef _WIN32
+    ::_close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+/* Move `from` to `to` unless `to` exists. `exists` tells the cases apart. */
+bool moveNoReplace(const fs::path& from, const fs::path& to, bool& exists) {
+    exists = false;
+#ifdef _WIN32
+    /* unlike POSIX rename(), _wrename() fails if the target exists */
+    if (::_wrename(from.c_str(), to.c_str()) == 0) {
+        return true;
+    }
+#else
+    /* link() never replaces, the temporary name is dropped afterwards */
+    if (::link(from.c_str(), to.c_str()) == 0) {
+        ::unlink(from.c_str());
+        return true;
+    }
+    /* no hard links on this filesystem (vfat, some FUSE mounts) */
+    if ((errno == EPERM || errno == EOPNOTSUPP || errno == ENOSYS) &&
+        ::access(to.c_str(), F_OK) != 0 &&
+        ::rename(from.c_str(), to.c_str()) == 0) {
+        return true;
+    }
+#endif
+    int error = errno;
+    std::error_code ec;
+    exists = error == EEXIST || fs::exists(to, ec);
+    errno = error;
+    return false;
+}
+
+/* `name (n).ext`, the n-th alternative to an existing `name.ext` */
+fs::path alternativeName(const fs::path& target, int n) {
+    auto name = target.stem().string() + " (" + std::to_string(n) + ")" +
+                target.extension().string();
+    return target.parent_path() / name;
+}
+
+constexpr int MAX_ALTERNATIVE_NAMES = 1000;
+}  // namespace
+
+UploadManager::UploadManager() : UploadManager(Options()) {}
+
+UploadManager::UploadManager(Options options)
+    : m_options(std::move(options)),
+      m_buffers(
+          std::max<std::size_t>(m_options.bufferCount, 1),
+          [size = m_options.bufferSize] {
+              return std::make_unique<UploadBuffer>(size);
+          }) {
+    std::error_code ec;
+    fs::create_directories(m_options.directory, ec);
+    fs::create_directories(m_options.tempDirectory, ec);
+    if (m_options.token.empty()) {
+        OATPP_LOGW("UploadManager",
+                   "no upload token configured, uploads are refused")
+    }
+}
+
+bool UploadManager::authorize(const std::string& token) const {
+    const auto& expected = m_options.token;
+    if (expected.empty()) {
+        return false;
+    }
+    /* don't leak the matching prefix length through timing */
+    unsigned char diff = token.size() == expected.size() ? 0 : 1;
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        diff |= static_cast<unsigned char>(
+            expected[i] ^ (i < token.size() ? token[i] : 0));
+    }
+    return diff == 0;
+}
+
+UploadManager::~UploadManager() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& [id, upload] : m_uploads) {
+        std::lock_guard<std::mutex> uploadLock(upload->m_mutex);
+        upload->m_buffer.reset();
+        upload->m_manager = nullptr;
+    }
+}
+
+std::string UploadManager::makeId() {
+    static thread_local std::mt19937_64 engine{std::random_device{}()};
+    std::ostringstream id;
+    id << std::hex << engine() << engine();
+    return id.str();
+}
+
+std::shared_ptr<UploadManager::Upload> UploadManager::create(
+    const std::string& name, std::uintmax_t size) {
+    if (size > m_options.maxFileSize) {
+        OATPP_LOGE("UploadManager", "'%s' is too large (%ju bytes)",
+                   name.c_str(), size)
+        return nullptr;
+    }
+
+    Status status;
+    status.id = makeId();
+    status.name = fs::path(name).filename().string();
+    if (status.name.empty() || status.name == "." || status.name == "..") {
+        status.name = status.id;
+    }
+    status.size = size;
+
+    auto tempPath = m_options.tempDirectory / (status.id + ".part");
+    int fd = openFile(tempPath);
+    if (fd < 0) {
+        OATPP_LOGE("UploadManager", "can't create '%s': %s",
+                   tempPath.string().c_str(), std::strerror(errno))
+        return nullptr;
+    }
+
+    auto upload = std::make_shared<Upload>(this, std::move(status),
+                                           std::move(tempPath), fd);
+    expire();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_uploads.emplace(upload->m_status.id, upload);
+    return upload;
+}
+
+std::shared_ptr<UploadManager::Upload> UploadManager::find(
+    const std::string& id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_uploads.find(id);
+    return it != m_uploads.end() ? it->second : nullptr;
+}
+
+bool UploadManager::cancel(const std::string& id) {
+    std::shared_ptr<Upload> upload;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_uploads.find(id);
+        if (it == m_uploads.end()) {
+            return false;
+        }
+        upload = std::move(it->second);
+        m_uploads.erase(it);
+    }
+    std::lock_guard<std::mutex> lock(upload->m_mutex);
+    upload->m_failed = true;
+    upload->close();
+    return true;
+}
+
+std::size_t UploadManager::expire() {
+    auto deadline = std::chrono::steady_clock::now() - m_options.idleTimeout;
+    std::vector<std::string> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_uploads.begin(); it != m_uploads.end();) {
+            auto& upload = it->second;
+            std::unique_lock<std::mutex> uploadLock(upload->m_mutex,
+                                                    std::try_to_lock);
+            if (!uploadLock.owns_lock()) {
+                ++it;
+                continue;
+            }
+            /* completed uploads are kept until they go idle as well, so a
+             * client can still fetch the final status */
+            if (!upload->m_busy && upload->m_lastActive < deadline) {
+                expired.push_back(it->first);
+                uploadLock.unlock();
+                it = m_uploads.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const auto& id : expired) {
+        OATPP_LOGD("UploadManager", "upload '%s' expired", id.c_str())
+    }
+    return expired.size();
+}
+
+std::optional<std::tuple<std::uintmax_t, std::uintmax_t, std::uintmax_t>>
+UploadManager::parseContentRange(const std::string& header) {
+    std::uintmax_t first = 0;
+    std::uintmax_t last = 0;
+    std::uintmax_t total = 0;
+    char tail[2] = {};
+    if (std::sscanf(header.c_str(), "bytes %ju-%ju/%ju", &first, &last,
+                    &total) == 3) {
+        if (last < first || last >= total) {
+            return std::nullopt;
+        }
+        return std::make_tuple(first, last + 1, total);
+    }
+    if (std::sscanf(header.c_str(), "bytes %ju-%ju/%1s", &first, &last,
+                    tail) == 3 &&
+        tail[0] == '*' && last >= first) {
+        return std::make_tuple(first, last + 1, std::uintmax_t{0});
+    }
+    return std::nullopt;
+}
+
+// ----------------------------------------------------------------
+// Upload
+// ----------------------------------------------------------------
+
+UploadManager::Upload::Upload(UploadManager* manager, Status status,
+                              fs::path tempPath, int fd)
+    : m_manager(manager),
+      m_status(std::move(status)),
+      m_tempPath(std::move(tempPath)),
+      m_fd(fd),
+      m_maxSize(manager != nullptr
+                    ? manager->m_options.maxFileSize
+                    : std::numeric_limits<std::uintmax_t>::max()),
+      m_lastActive(std::chrono::steady_clock::now()) {}
+
+UploadManager::Upload::~Upload() {
+    close();
+    if (!m_status.complete) {
+        std::error_code ec;
+        fs::remove(m_tempPath, ec);
+    }
+}
+
+void UploadManager::Upload::close() {
+    m_buffer.reset();
+    if (m_fd >= 0) {
+        closeFile(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool UploadManager::Upload::writeOut(const char* data, std::size_t size) {
+    while (size > 0) {
+        auto n = writeFile(m_fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            OATPP_LOGE("UploadManager", "write to '%s' failed: %s",
+                       m_tempPath.string().c_str(), std::strerror(errno))
+            m_failed = true;
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool UploadManager::Upload::flushBuffer() {
+    if (!m_buffer || m_buffer->used == 0) {
+        return !m_failed;
+    }
+    bool ok = writeOut(m_buffer->data.data(), m_buffer->used);
+    m_buffer->used = 0;
+    return ok;
+}
+
+bool UploadManager::Upload::begin(std::uintmax_t first, std::uintmax_t last,
+                                  std::uintmax_t total) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto size = m_status.size != 0 ? m_status.size : total;
+    if (m_busy || m_failed || m_status.complete || m_fd < 0 ||
+        first != m_status.offset || last < first || first > m_maxSize ||
+        total > m_maxSize || (total != 0 && total != size) ||
+        (size != 0 && last > size)) {
+        return false;
+    }
+    m_status.size = size;
+    m_busy = true;
+    m_chunkEnd = std::min(last, m_maxSize);
+    m_lastActive = std::chrono::steady_clock::now();
+    /* without a pooled buffer every piece goes straight to the file */
+    if (m_manager != nullptr) {
+        m_buffer = m_manager->m_buffers.tryAcquire();
+    }
+    return true;
+}
+
+oatpp::v_io_size UploadManager::Upload::write(const void* data,
+                                              v_buff_size count,
+                                              oatpp::async::Action& action) {
+    (void)action;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_busy || m_failed) {
+        return oatpp::IOError::BROKEN_PIPE;
+    }
+    auto size = static_cast<std::size_t>(count);
+    if (size > m_chunkEnd - m_status.offset) {
+        OATPP_LOGE("UploadManager", "upload '%s' got more data than declared",
+                   m_status.id.c_str())
+        m_failed = true;
+        return oatpp::IOError::BROKEN_PIPE;
+    }
+
+    auto bytes = static_cast<const char*>(data);
+    m_md5.update(bytes, size);
+    m_status.offset += size;
+
+    if (!m_buffer) {
+        return writeOut(bytes, size) ? count : oatpp::IOError::BROKEN_PIPE;
+    }
+    auto& buffer = *m_buffer;
+    if (buffer.used + size > buffer.data.size()) {
+        if (!flushBuffer()) {
+            return oatpp::IOError::BROKEN_PIPE;
+        }
+        if (size >= buffer.data.size()) {
+            return writeOut(bytes, size) ? count : oatpp::IOError::BROKEN_PIPE;
+        }
+    }
+    std::memcpy(buffer.data.data() + buffer.used, bytes, size);
+    buffer.used += size;
+    return count;
+}
+
+bool UploadManager::Upload::end() {
+    bool done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_busy) {
+            return false;
+        }
+        bool ok = flushBuffer();
+        m_buffer.reset();
+        m_busy = false;
+        m_lastActive = std::chrono::steady_clock::now();
+        if (!ok) {
+            return false;
+        }
+        done = m_status.size != 0 && m_status.offset == m_status.size;
+    }
+    return !done || commit();
+}
+
+bool UploadManager::Upload::commit() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_status.complete) {
+        return true;
+    }
+    if (m_busy || m_failed || m_fd < 0 || m_manager == nullptr ||
+        (m_status.size != 0 && m_status.offset != m_status.size)) {
+        return false;
+    }
+    if (syncFile(m_fd) != 0) {
+        OATPP_LOGE("UploadManager", "fsync of '%s' failed: %s",
+                   m_tempPath.string().c_str(), std::strerror(errno))
+        m_failed = true;
+        return false;
+    }
+    close();
+
+    auto target = m_manager->m_options.directory / m_status.name;
+    auto candidate = target;
+    bool exists = false;
+    for (int n = 1; !moveNoReplace(m_tempPath, candidate, exists); ++n) {
+        if (!exists || n > MAX_ALTERNATIVE_NAMES) {
+            OATPP_LOGE("UploadManager", "can't move upload to '%s': %s",
+                       candidate.string().c_str(),
+                       exists ? "no free name" : std::strerror(errno))
+            m_failed = true;
+            return false;
+        }
+        candidate = alternativeName(target, n);
+    }
+    target = std::move(candidate);
+    m_status.name = target.filename().string();
+    m_status.md5 = m_md5.finalize();
+    m_status.path = target.string();
+    m_status.size = m_status.offset;
+    m_status.complete = true;
+    OATPP_LOGD("UploadManager", "'%s' uploaded, %ju bytes, md5 %s",
+               m_status.path.c_str(), m_status.size, m_status.md5.c_str())
+    return true;
+}
+
+UploadManager::Status UploadManager::Upload::status() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_status;
+}
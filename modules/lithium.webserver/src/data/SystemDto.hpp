@@ -198,6 +198,23 @@ class ReturnOSInfoDto : public StatusDto {
     DTO_FIELD(String, compiler);
 };
 
+class ReturnMetricHistoryDto : public StatusDto {
+    DTO_INIT(ReturnMetricHistoryDto, StatusDto)
+
+    DTO_FIELD_INFO(metric) { info->description = "The name of the metric"; }
+    DTO_FIELD(String, metric);
+
+    DTO_FIELD_INFO(interval) {
+        info->description = "Milliseconds between two samples";
+    }
+    DTO_FIELD(Int64, interval);
+
+    DTO_FIELD_INFO(values) {
+        info->description = "The recent values, oldest first";
+    }
+    DTO_FIELD(Vector<Float32>, values);
+};
+
 #include OATPP_CODEGEN_END(DTO)
 
 #endif  // SYSTEMDTO_HPP
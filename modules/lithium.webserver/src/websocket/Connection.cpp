@@ -17,6 +17,9 @@ Description: Websocket Connection
 
 #include "oatpp/core/utils/ConversionUtils.hpp"
 
+#include <algorithm>
+#include <iterator>
+
 Connection::Connection(const std::shared_ptr<AsyncWebSocket>& socket,
            const std::shared_ptr<Session>& hubSession, v_int64 connectionId)
     : m_socket(socket),
@@ -25,7 +28,9 @@ Connection::Connection(const std::shared_ptr<AsyncWebSocket>& socket,
       m_messageQueue(std::make_shared<MessageQueue>()),
       m_pingTime(-1),
       m_failedPings(0),
-      m_lastPingTimestamp(-1) {}
+      m_lastPingTimestamp(-1) {
+    m_telemetryId = m_telemetry->newSubscriberId();
+}
 
 oatpp::async::CoroutineStarter Connection::sendMessageAsync(
     const oatpp::Object<MessageDto>& message) {
@@ -106,63 +111,121 @@ oatpp::async::CoroutineStarter Connection::sendErrorAsync(
 }
 
 bool Connection::queueMessage(const oatpp::Object<MessageDto>& message) {
-    class SendMessageCoroutine
-        : public oatpp::async::Coroutine<SendMessageCoroutine> {
+    if (!message) {
+        return false;
+    }
+    return queueFrame(m_objectMapper->writeToString(message));
+}
+
+bool Connection::queueFrame(const oatpp::String& frame,
+                            const oatpp::String& coalesceKey, bool binary) {
+    class SendFramesCoroutine
+        : public oatpp::async::Coroutine<SendFramesCoroutine> {
     private:
-        std::shared_ptr<oatpp::data::mapping::ObjectMapper> m_mapper;
         oatpp::async::Lock* m_lock;
         std::shared_ptr<AsyncWebSocket> m_websocket;
         std::shared_ptr<MessageQueue> m_queue;
 
     public:
-        SendMessageCoroutine(
-            const std::shared_ptr<oatpp::data::mapping::ObjectMapper>& mapper,
-            oatpp::async::Lock* lock,
-            const std::shared_ptr<AsyncWebSocket>& websocket,
-            const std::shared_ptr<MessageQueue>& queue)
-            : m_mapper(mapper),
-              m_lock(lock),
-              m_websocket(websocket),
-              m_queue(queue) {}
+        SendFramesCoroutine(oatpp::async::Lock* lock,
+                            const std::shared_ptr<AsyncWebSocket>& websocket,
+                            const std::shared_ptr<MessageQueue>& queue)
+            : m_lock(lock), m_websocket(websocket), m_queue(queue) {}
 
         Action act() override {
-            std::unique_lock<std::mutex> lock(m_queue->mutex);
-            if (m_queue->queue.empty()) {
-                m_queue->active = false;
-                return finish();
+            /*
+             * Take one frame at a time: frames still in the queue can be
+             * replaced by newer ones with the same key while this one is
+             * being written, so a slow client only gets the latest status.
+             */
+            QueuedFrame frame;
+            {
+                std::lock_guard<std::mutex> lock(m_queue->mutex);
+                if (m_queue->queue.empty()) {
+                    m_queue->active = false;
+                    return finish();
+                }
+                frame = std::move(m_queue->queue.front());
+                m_queue->queue.pop_front();
+                if (frame.coalesceKey) {
+                    m_queue->keyed.erase(*frame.coalesceKey);
+                }
+            }
+            if (frame.binary) {
+                return oatpp::async::synchronize(
+                           m_lock,
+                           m_websocket->sendOneFrameBinaryAsync(frame.data))
+                    .next(repeat());
             }
-            auto msg = m_queue->queue.back();
-            m_queue->queue.pop_back();
-            lock.unlock();
-
-            auto json = m_mapper->writeToString(msg);
             return oatpp::async::synchronize(
-                       m_lock, m_websocket->sendOneFrameTextAsync(json))
+                       m_lock, m_websocket->sendOneFrameTextAsync(frame.data))
                 .next(repeat());
         }
 
         Action handleError(oatpp::async::Error* error) override {
-            return yieldTo(&SendMessageCoroutine::act);
+            return yieldTo(&SendFramesCoroutine::act);
         }
     };
 
-    if (message) {
-        std::lock_guard<std::mutex> lock(m_messageQueue->mutex);
-        if (m_messageQueue->queue.size() <
-            m_hubSession->getConfig()->maxQueuedMessages) {
-            m_messageQueue->queue.push_front(message);
-            if (!m_messageQueue->active) {
-                m_messageQueue->active = true;
-                std::lock_guard<std::mutex> socketLock(m_socketMutex);
-                if (m_socket) {
-                    m_asyncExecutor->execute<SendMessageCoroutine>(
-                        m_objectMapper, &m_writeLock, m_socket, m_messageQueue);
-                }
-            }
+    if (!frame) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_messageQueue->mutex);
+    auto& queue = m_messageQueue->queue;
+    auto& keyed = m_messageQueue->keyed;
+
+    if (coalesceKey) {
+        /* a newer status frame supersedes the queued one */
+        auto it = keyed.find(*coalesceKey);
+        if (it != keyed.end()) {
+            it->second->data = frame;
+            it->second->binary = binary;
+            m_messageQueue->merged++;
             return true;
         }
     }
-    return false;
+
+    if (queue.size() >= m_hubSession->getConfig()->maxQueuedMessages) {
+        /* backpressure: drop the oldest status frame, never a plain one */
+        auto victim = std::find_if(
+            queue.begin(), queue.end(),
+            [](const QueuedFrame& queued) {
+                return queued.coalesceKey != nullptr;
+            });
+        if (victim == queue.end()) {
+            m_messageQueue->dropped++;
+            return false;
+        }
+        keyed.erase(*victim->coalesceKey);
+        queue.erase(victim);
+        m_messageQueue->dropped++;
+    }
+
+    queue.push_back({frame, coalesceKey, binary});
+    if (coalesceKey) {
+        keyed.emplace(*coalesceKey, std::prev(queue.end()));
+    }
+
+    if (!m_messageQueue->active) {
+        std::lock_guard<std::mutex> socketLock(m_socketMutex);
+        if (m_socket) {
+            m_messageQueue->active = true;
+            m_asyncExecutor->execute<SendFramesCoroutine>(
+                &m_writeLock, m_socket, m_messageQueue);
+        }
+    }
+    return true;
+}
+
+v_uint64 Connection::getDroppedFrames() {
+    std::lock_guard<std::mutex> lock(m_messageQueue->mutex);
+    return m_messageQueue->dropped;
+}
+
+v_uint64 Connection::getMergedFrames() {
+    std::lock_guard<std::mutex> lock(m_messageQueue->mutex);
+    return m_messageQueue->merged;
 }
 
 void Connection::ping(v_int64 timestampMicroseconds) {
@@ -235,7 +298,11 @@ std::shared_ptr<Session> Connection::getHubSession() { return m_hubSession; }
 
 v_int64 Connection::getConnectionId() { return m_connectionId; }
 
+v_int64 Connection::getTelemetryId() { return m_telemetryId; }
+
 void Connection::invalidateSocket() {
+    m_telemetry->unsubscribe(m_telemetryId);
+
     {
         std::lock_guard<std::mutex> socketLock(m_socketMutex);
         if (m_socket) {
@@ -247,6 +314,7 @@ void Connection::invalidateSocket() {
     {
         std::lock_guard<std::mutex> lock(m_messageQueue->mutex);
         m_messageQueue->queue.clear();
+        m_messageQueue->keyed.clear();
     }
 }
 
@@ -292,18 +360,13 @@ oatpp::async::CoroutineStarter Connection::handlePong(
 
 oatpp::async::CoroutineStarter Connection::handleBroadcast(
     const oatpp::Object<MessageDto>& message) {
-    auto connections = m_hubSession->getAllConnections();
-
-    for (auto connection : connections) {
-        if (connection->getConnectionId() != m_connectionId) {
-            auto payload = OutgoingMessageDto::createShared();
-            payload->connectionId = m_connectionId;
-            payload->data = message->payload.retrieve<oatpp::String>();
+    auto payload = OutgoingMessageDto::createShared();
+    payload->connectionId = m_connectionId;
+    payload->data = message->payload.retrieve<oatpp::String>();
 
-            connection->queueMessage(MessageDto::createShared(
-                MessageCodes::OUTGOING_MESSAGE, payload));
-        }
-    }
+    m_hubSession->broadcast(
+        MessageDto::createShared(MessageCodes::OUTGOING_MESSAGE, payload),
+        nullptr, m_connectionId);
 
     return nullptr;
 }
@@ -325,14 +388,17 @@ oatpp::async::CoroutineStarter Connection::handleDirectMessage(
 
     auto connections = m_hubSession->getConnections(dm->connectionIds);
 
+    auto payload = OutgoingMessageDto::createShared();
+    payload->connectionId = m_connectionId;
+    payload->data = dm->data;
+
+    /* serialize once, share the frame with every recipient */
+    auto frame = m_objectMapper->writeToString(
+        MessageDto::createShared(MessageCodes::OUTGOING_MESSAGE, payload));
+
     for (auto connection : connections) {
         if (connection->getConnectionId() != m_connectionId) {
-            auto payload = OutgoingMessageDto::createShared();
-            payload->connectionId = m_connectionId;
-            payload->data = dm->data;
-
-            connection->queueMessage(MessageDto::createShared(
-                MessageCodes::OUTGOING_MESSAGE, payload));
+            connection->queueFrame(frame);
         }
     }
 
@@ -404,6 +470,49 @@ oatpp::async::CoroutineStarter Connection::handleClientMessage(
     return nullptr;
 }
 
+oatpp::async::CoroutineStarter Connection::handleTelemetrySubscribe(
+    const oatpp::Object<MessageDto>& message) {
+    auto request =
+        message->payload.retrieve<oatpp::Object<TelemetrySubscribeDto>>();
+
+    if (!request || !request->paths || request->paths->empty()) {
+        return sendErrorAsync(ErrorDto::createShared(
+            ErrorCodes::BAD_MESSAGE,
+            "Payload MUST contain array of telemetry paths."));
+    }
+
+    std::vector<std::string> paths;
+    for (auto& path : *request->paths) {
+        if (path) {
+            paths.emplace_back(*path);
+        }
+    }
+
+    m_telemetry->subscribe(
+        shared_from_this(), paths,
+        Telemetry::parseEncoding(request->encoding.getValue("json")),
+        std::chrono::milliseconds(request->intervalMillis.getValue(500)));
+
+    return nullptr;
+}
+
+oatpp::async::CoroutineStarter Connection::handleTelemetryUnsubscribe(
+    const oatpp::Object<MessageDto>& message) {
+    auto request = message->payload.retrieve<oatpp::Vector<oatpp::String>>();
+
+    std::vector<std::string> paths;
+    if (request) {
+        for (auto& path : *request) {
+            if (path) {
+                paths.emplace_back(*path);
+            }
+        }
+    }
+
+    m_telemetry->unsubscribe(m_telemetryId, paths);
+    return nullptr;
+}
+
 oatpp::async::CoroutineStarter Connection::handleMessage(
     const oatpp::Object<MessageDto>& message) {
     if (!message->code) {
@@ -424,6 +533,10 @@ oatpp::async::CoroutineStarter Connection::handleMessage(
             return handleKickMessage(message);
         case MessageCodes::INCOMING_CLIENT_MESSAGE:
             return handleClientMessage(message);
+        case MessageCodes::INCOMING_TELEMETRY_SUBSCRIBE:
+            return handleTelemetrySubscribe(message);
+        case MessageCodes::INCOMING_TELEMETRY_UNSUBSCRIBE:
+            return handleTelemetryUnsubscribe(message);
 
         default:
             return sendErrorAsync(
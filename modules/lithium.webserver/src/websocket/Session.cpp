@@ -122,13 +122,34 @@ void Session::broadcastSynchronizedEvent(v_int64 senderId,
     event->connectionId = senderId;
     event->data = eventData;
 
-    auto message = MessageDto::createShared(
-        MessageCodes::OUTGOING_SYNCHRONIZED_EVENT, event);
+    /* the event id must be ordered across connections, so queue under lock */
+    auto frame = m_objectMapper->writeToString(MessageDto::createShared(
+        MessageCodes::OUTGOING_SYNCHRONIZED_EVENT, event));
     for (auto& connection : m_connections) {
-        connection.second->queueMessage(message);
+        connection.second->queueFrame(frame);
     }
 }
 
+v_int64 Session::broadcast(const oatpp::Object<MessageDto>& message,
+                           const oatpp::String& coalesceKey,
+                           v_int64 excludeConnectionId) {
+    if (!message) {
+        return 0;
+    }
+
+    auto frame = m_objectMapper->writeToString(message);
+    auto connections = getAllConnections();
+
+    v_int64 queued = 0;
+    for (auto& connection : connections) {
+        if (connection->getConnectionId() != excludeConnectionId &&
+            connection->queueFrame(frame, coalesceKey)) {
+            queued++;
+        }
+    }
+    return queued;
+}
+
 v_int64 Session::generateNewConnectionId() { return m_connectionIdCounter++; }
 
 void Session::checkAllConnectionsPings() {
@@ -0,0 +1,379 @@
+/*
+ * Telemetry.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-20
+
+Description: Subscription based, delta compressed telemetry stream
+
+**************************************************/
+
+#include "Telemetry.hpp"
+#include "Connection.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr std::chrono::milliseconds MIN_INTERVAL{50};
+constexpr std::chrono::milliseconds MAX_INTERVAL{60000};
+}  // namespace
+
+Telemetry::Telemetry() : m_state(std::make_shared<State>()) {}
+
+bool Telemetry::matches(const std::string& pattern, const std::string& path) {
+    if (pattern == "*" || pattern == path) {
+        return true;
+    }
+    return path.size() > pattern.size() &&
+           path.compare(0, pattern.size(), pattern) == 0 &&
+           path[pattern.size()] == '.';
+}
+
+void Telemetry::publishLocked(State& state, const std::string& path,
+                              json value) {
+    auto it = state.entries.find(path);
+    if (it == state.entries.end()) {
+        state.entries.emplace(path, Entry{std::move(value), ++state.version});
+    } else if (it->second.value != value) {
+        it->second.value = std::move(value);
+        it->second.version = ++state.version;
+    }
+}
+
+void Telemetry::publish(const std::string& path, json value) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    publishLocked(*m_state, path, std::move(value));
+}
+
+void Telemetry::publishObject(const std::string& prefix, const json& object) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    for (auto& [key, value] : object.items()) {
+        publishLocked(*m_state, prefix + "." + key, value);
+    }
+}
+
+void Telemetry::remove(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->entries.erase(path);
+}
+
+void Telemetry::addSource(const std::string& path, Sampler sampler,
+                          std::chrono::milliseconds interval) {
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->sources[path] = Source{std::move(sampler),
+                                        std::max(interval, MIN_INTERVAL),
+                                        std::chrono::steady_clock::now()};
+        m_state->sourcesChanged = true;
+    }
+    m_state->sourcesCv.notify_one();
+    std::call_once(m_samplingStarted, [this] {
+        m_samplingThread = std::jthread(
+            [state = m_state](std::stop_token token) {
+                runSources(*state, token);
+            });
+    });
+}
+
+void Telemetry::removeSource(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->sources.erase(path);
+}
+
+Telemetry::json Telemetry::get(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    auto it = m_state->entries.find(path);
+    return it != m_state->entries.end() ? it->second.value : json();
+}
+
+Telemetry::Encoding Telemetry::parseEncoding(const std::string& name) {
+    if (name == "cbor") {
+        return Encoding::CBOR;
+    }
+    if (name == "msgpack") {
+        return Encoding::MSGPACK;
+    }
+    return Encoding::JSON;
+}
+
+v_int64 Telemetry::newSubscriberId() { return m_nextSubscriberId++; }
+
+void Telemetry::subscribe(const std::shared_ptr<Connection>& connection,
+                          const std::vector<std::string>& patterns,
+                          Encoding encoding,
+                          std::chrono::milliseconds interval) {
+    std::weak_ptr<Connection> weak = connection;
+    subscribe(
+        connection->getTelemetryId(), connection,
+        [weak](const oatpp::String& frame, bool binary) {
+            auto target = weak.lock();
+            return target && target->queueFrame(frame, nullptr, binary);
+        },
+        patterns, encoding, interval);
+}
+
+void Telemetry::subscribe(v_int64 id, const std::weak_ptr<void>& owner,
+                          FrameSink sink,
+                          const std::vector<std::string>& patterns,
+                          Encoding encoding,
+                          std::chrono::milliseconds interval) {
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        auto& subscriber = m_state->subscribers[id];
+        subscriber.owner = owner;
+        subscriber.sink = std::move(sink);
+        subscriber.patterns = patterns;
+        subscriber.encoding = encoding;
+        subscriber.interval = std::clamp(interval, MIN_INTERVAL, MAX_INTERVAL);
+        subscriber.next = std::chrono::steady_clock::now();
+        /* resend a full snapshot of the new subscription */
+        subscriber.sent.clear();
+        subscriber.seq = 0;
+        subscriber.generation++;
+        m_state->sourcesChanged = true;
+    }
+    m_state->sourcesCv.notify_one();
+    startFlusher();
+}
+
+void Telemetry::unsubscribe(v_int64 subscriberId,
+                            const std::vector<std::string>& patterns) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    auto it = m_state->subscribers.find(subscriberId);
+    if (it == m_state->subscribers.end()) {
+        return;
+    }
+    auto& subscriber = it->second;
+    if (patterns.empty()) {
+        m_state->subscribers.erase(it);
+        return;
+    }
+    std::erase_if(subscriber.patterns, [&patterns](const std::string& p) {
+        return std::find(patterns.begin(), patterns.end(), p) !=
+               patterns.end();
+    });
+    if (subscriber.patterns.empty()) {
+        m_state->subscribers.erase(it);
+        return;
+    }
+    /* forget paths no longer covered so they are not reported as removed */
+    std::erase_if(subscriber.sent, [&subscriber](const auto& sent) {
+        return std::none_of(subscriber.patterns.begin(),
+                            subscriber.patterns.end(),
+                            [&sent](const std::string& pattern) {
+                                return matches(pattern, sent.first);
+                            });
+    });
+}
+
+bool Telemetry::buildFrame(State& state, v_int64 id, Subscriber& subscriber,
+                           std::chrono::steady_clock::time_point now,
+                           std::vector<PendingFrame>& frames) {
+    auto owner = subscriber.owner.lock();
+    if (!owner) {
+        return false;
+    }
+    if (now < subscriber.next) {
+        return true;
+    }
+
+    json changes = json::object();
+    std::vector<std::pair<std::string, v_uint64>> delivered;
+
+    auto collect = [&](const std::string& path, const Entry& entry) {
+        auto sent = subscriber.sent.find(path);
+        if ((sent == subscriber.sent.end() || sent->second != entry.version) &&
+            !changes.contains(path)) {
+            changes[path] = entry.value;
+            delivered.emplace_back(path, entry.version);
+        }
+    };
+
+    for (const auto& pattern : subscriber.patterns) {
+        if (pattern == "*") {
+            for (const auto& [path, entry] : state.entries) {
+                collect(path, entry);
+            }
+            continue;
+        }
+        if (auto it = state.entries.find(pattern); it != state.entries.end()) {
+            collect(it->first, it->second);
+        }
+        /* prefix range: every `pattern.xxx` path is contiguous in the map */
+        auto prefix = pattern + ".";
+        for (auto it = state.entries.lower_bound(prefix);
+             it != state.entries.end() &&
+             it->first.compare(0, prefix.size(), prefix) == 0;
+             ++it) {
+            collect(it->first, it->second);
+        }
+    }
+
+    std::vector<std::string> removed;
+    for (const auto& [path, version] : subscriber.sent) {
+        if (!state.entries.contains(path)) {
+            removed.push_back(path);
+        }
+    }
+
+    if (changes.empty() && removed.empty()) {
+        return true;
+    }
+
+    json message = {{"code", static_cast<v_int32>(
+                                 MessageCodes::OUTGOING_TELEMETRY)},
+                    {"payload",
+                     {{"seq", subscriber.seq},
+                      {"full", subscriber.seq == 0},
+                      {"changes", std::move(changes)},
+                      {"removed", removed}}}};
+
+    frames.push_back(PendingFrame{id, subscriber.generation, subscriber.seq,
+                                  std::move(owner), subscriber.sink,
+                                  subscriber.encoding, std::move(message),
+                                  std::move(delivered), std::move(removed)});
+    return true;
+}
+
+bool Telemetry::flush(State& state) {
+    auto now = std::chrono::steady_clock::now();
+
+    /* build frames under the lock, encode and queue them without it */
+    std::vector<PendingFrame> frames;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.subscribers.empty()) {
+            state.isActive = false;
+            return false;
+        }
+        for (auto it = state.subscribers.begin();
+             it != state.subscribers.end();) {
+            if (!buildFrame(state, it->first, it->second, now, frames)) {
+                it = state.subscribers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (frames.empty()) {
+        return true;
+    }
+
+    std::vector<bool> queued(frames.size(), false);
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        auto& frame = frames[i];
+        if (frame.encoding == Encoding::JSON) {
+            queued[i] = frame.sink(oatpp::String(frame.message.dump()), false);
+        } else {
+            auto bytes = frame.encoding == Encoding::CBOR
+                             ? json::to_cbor(frame.message)
+                             : json::to_msgpack(frame.message);
+            queued[i] = frame.sink(
+                oatpp::String(reinterpret_cast<const char*>(bytes.data()),
+                              static_cast<v_buff_size>(bytes.size())),
+                true);
+        }
+    }
+
+    /* on backpressure keep the old snapshot: the next frame has the delta */
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        auto& frame = frames[i];
+        auto it = state.subscribers.find(frame.subscriberId);
+        if (!queued[i] || it == state.subscribers.end()) {
+            continue;
+        }
+        auto& subscriber = it->second;
+        /* resubscribed meanwhile: the new subscription starts from scratch */
+        if (subscriber.generation != frame.generation ||
+            subscriber.seq != frame.seq) {
+            continue;
+        }
+        for (auto& [path, version] : frame.delivered) {
+            subscriber.sent[std::move(path)] = version;
+        }
+        for (const auto& path : frame.removed) {
+            subscriber.sent.erase(path);
+        }
+        subscriber.seq++;
+        subscriber.next = now + subscriber.interval;
+    }
+    return true;
+}
+
+void Telemetry::runSources(State& state, std::stop_token token) {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while (!token.stop_requested()) {
+        auto now = std::chrono::steady_clock::now();
+        auto wake = now + MAX_INTERVAL;
+        std::vector<std::pair<std::string, Sampler>> due;
+        /* sources are only sampled while somebody is subscribed */
+        if (!state.subscribers.empty()) {
+            for (auto& [path, source] : state.sources) {
+                if (source.next <= now) {
+                    due.emplace_back(path, source.sampler);
+                    source.next = now + source.interval;
+                }
+                wake = std::min(wake, source.next);
+            }
+        }
+        if (due.empty()) {
+            state.sourcesCv.wait_until(lock, token, wake, [&state] {
+                return std::exchange(state.sourcesChanged, false);
+            });
+            continue;
+        }
+
+        lock.unlock();
+        std::vector<std::pair<std::string, json>> samples;
+        for (auto& [path, sampler] : due) {
+            try {
+                samples.emplace_back(path, sampler());
+            } catch (const std::exception& e) {
+                OATPP_LOGE("Telemetry", "source '%s' failed: %s",
+                           path.c_str(), e.what())
+            }
+        }
+        lock.lock();
+
+        for (auto& [path, value] : samples) {
+            if (value.is_object()) {
+                for (auto& [key, member] : value.items()) {
+                    publishLocked(state, path + "." + key, member);
+                }
+            } else {
+                publishLocked(state, path, std::move(value));
+            }
+        }
+    }
+}
+
+void Telemetry::startFlusher() {
+    class Flusher : public oatpp::async::Coroutine<Flusher> {
+    private:
+        std::shared_ptr<State> m_state;
+
+    public:
+        Flusher(const std::shared_ptr<State>& state) : m_state(state) {}
+
+        Action act() override {
+            if (!Telemetry::flush(*m_state)) {
+                OATPP_LOGD("Telemetry", "Stopped")
+                return finish();
+            }
+            return waitRepeat(TICK);
+        }
+    };
+
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (!m_state->isActive) {
+        OATPP_LOGD("Telemetry", "Started")
+        m_state->isActive = true;
+        m_asyncExecutor->execute<Flusher>(m_state);
+    }
+}
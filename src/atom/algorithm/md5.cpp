@@ -14,6 +14,7 @@ Description: Self implemented MD5 algorithm.
 
 #include "md5.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <sstream>
@@ -38,39 +39,61 @@ constexpr uint32_t s[64] = {7,  12, 17, 22, 7,  12, 17, 22, 7,  12, 17, 22, 7,
                             23, 4,  11, 16, 23, 4,  11, 16, 23, 6,  10, 15, 21,
                             6,  10, 15, 21, 6,  10, 15, 21, 6,  10, 15, 21};
 
+MD5::MD5() { init(); }
+
 void MD5::init() {
     _a = 0x67452301;
     _b = 0xefcdab89;
     _c = 0x98badcfe;
     _d = 0x10325476;
     _count = 0;
-    _buffer.clear();
+    _bufferSize = 0;
 }
 
-void MD5::update(const std::string &input) {
-    for (char ch : input) {
-        _buffer.push_back(static_cast<uint8_t>(ch));
-        if (_buffer.size() == 64) {
-            processBlock(_buffer.data());
-            _count += 512;
-            _buffer.clear();
+void MD5::update(const void *data, std::size_t size) {
+    auto input = static_cast<const uint8_t *>(data);
+    _count += static_cast<uint64_t>(size) * 8;
+
+    if (_bufferSize > 0) {
+        std::size_t n = std::min(size, sizeof(_buffer) - _bufferSize);
+        std::memcpy(_buffer + _bufferSize, input, n);
+        _bufferSize += n;
+        input += n;
+        size -= n;
+        if (_bufferSize < sizeof(_buffer)) {
+            return;
         }
+        processBlock(_buffer);
+        _bufferSize = 0;
     }
 
-    // Padding
-    size_t bitLen = _count + _buffer.size() * 8;
-    _buffer.push_back(0x80);
-    while (_buffer.size() < 56)
-        _buffer.push_back(0x00);
-
-    for (int i = 0; i < 8; ++i) {
-        _buffer.push_back(static_cast<uint8_t>((bitLen >> (i * 8)) & 0xff));
+    // Whole blocks straight from the input, no copy
+    for (; size >= 64; input += 64, size -= 64) {
+        processBlock(input);
     }
 
-    processBlock(_buffer.data());
+    std::memcpy(_buffer, input, size);
+    _bufferSize = size;
 }
 
+void MD5::update(std::string_view input) { update(input.data(), input.size()); }
+
 std::string MD5::finalize() {
+    // Padding
+    uint64_t bitLen = _count;
+    _buffer[_bufferSize++] = 0x80;
+    if (_bufferSize > 56) {
+        std::memset(_buffer + _bufferSize, 0, sizeof(_buffer) - _bufferSize);
+        processBlock(_buffer);
+        _bufferSize = 0;
+    }
+    std::memset(_buffer + _bufferSize, 0, 56 - _bufferSize);
+    for (int i = 0; i < 8; ++i) {
+        _buffer[56 + i] = static_cast<uint8_t>((bitLen >> (i * 8)) & 0xff);
+    }
+    processBlock(_buffer);
+    _bufferSize = 0;
+
     std::stringstream ss;
     ss << std::hex << std::setfill('0');
     ss << std::setw(8) << reverseBytes(_a);
@@ -147,7 +170,6 @@ uint32_t MD5::reverseBytes(uint32_t x) {
 
 std::string MD5::encrypt(const std::string &input) {
     MD5 md5;
-    md5.init();
     md5.update(input);
     return md5.finalize();
 }
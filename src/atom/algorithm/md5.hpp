@@ -15,9 +15,10 @@ Description: Self implemented MD5 algorithm.
 #ifndef ATOM_UTILS_MD5_HPP
 #define ATOM_UTILS_MD5_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
-#include <vector>
+#include <string_view>
 
 
 namespace atom::algorithm {
@@ -26,6 +27,8 @@ namespace atom::algorithm {
  */
 class MD5 {
 public:
+    MD5();
+
     /**
      * @brief Encrypts the input string using MD5 algorithm.
      *
@@ -34,26 +37,42 @@ public:
      */
     static std::string encrypt(const std::string &input);
 
-private:
     /**
-     * @brief Initializes internal variables and buffer for MD5 computation.
+     * @brief Resets the state to hash a new message.
      */
     void init();
 
+    /**
+     * @brief Updates the MD5 computation with additional input data. May be
+     * called any number of times with arbitrarily sized pieces.
+     *
+     * @param data Pointer to the input bytes.
+     * @param size Number of bytes.
+     */
+    void update(const void *data, std::size_t size);
+
     /**
      * @brief Updates the MD5 computation with additional input data.
      *
-     * @param input The input string to be added to the MD5 computation.
+     * @param input The input to be added to the MD5 computation.
      */
-    void update(const std::string &input);
+    void update(std::string_view input);
 
     /**
      * @brief Finalizes the MD5 computation and returns the resulting hash.
+     * The object must be init()ed again before hashing another message.
      *
      * @return The MD5 hash of all the input data provided so far.
      */
     std::string finalize();
 
+    /**
+     * @brief Total number of bytes hashed so far.
+     */
+    std::uint64_t size() const { return _count / 8; }
+
+private:
+
     /**
      * @brief Processes a 64-byte block of input data.
      *
@@ -94,7 +113,8 @@ private:
     uint32_t _a, _b, _c,
         _d;          /**< Internal state variables for MD5 computation. */
     uint64_t _count; /**< Total count of input bits. */
-    std::vector<uint8_t> _buffer; /**< Buffer for input data. */
+    uint8_t _buffer[64]; /**< Partial block of input data. */
+    std::size_t _bufferSize; /**< Bytes held in _buffer. */
 };
 
 }  // namespace atom::algorithm
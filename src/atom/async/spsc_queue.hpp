@@ -0,0 +1,129 @@
+/*
+ * spsc_queue.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-29
+
+Description: Bounded lock-free single-producer single-consumer queue
+
+**************************************************/
+
+#ifndef ATOM_ASYNC_SPSC_QUEUE_HPP
+#define ATOM_ASYNC_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace atom::async {
+/**
+ * @brief A bounded ring buffer for exactly one producer and one consumer
+ * thread.
+ *
+ * push and pop never lock or allocate. Each side caches the other side's
+ * index and only reloads it when the queue looks full or empty, and the two
+ * indices sit on separate cache lines, so a steady stream costs about one
+ * cache miss per batch rather than per element.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    /**
+     * @param capacity Maximum number of queued elements, rounded up to a
+     * power of two.
+     */
+    explicit SpscQueue(std::size_t capacity)
+        : mask_(roundUp(capacity) - 1),
+          slots_(std::make_unique<Slot[]>(mask_ + 1)) {}
+
+    ~SpscQueue() {
+        while (tryPop()) {
+        }
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    /**
+     * @brief Producer side: append unless the queue is full.
+     */
+    template <typename... Args>
+    bool tryEmplace(Args &&...args) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - headCache_ > mask_) {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail - headCache_ > mask_) {
+                return false;
+            }
+        }
+        new (slots_[tail & mask_].storage) T(std::forward<Args>(args)...);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPush(const T &value) { return tryEmplace(value); }
+    bool tryPush(T &&value) { return tryEmplace(std::move(value)); }
+
+    /**
+     * @brief Consumer side: take the oldest element if there is one.
+     */
+    std::optional<T> tryPop() {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_) {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_) {
+                return std::nullopt;
+            }
+        }
+        T *item = slots_[head & mask_].get();
+        std::optional<T> value(std::move(*item));
+        item->~T();
+        head_.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    /** Approximate number of queued elements. */
+    std::size_t size() const {
+        return tail_.load(std::memory_order_acquire) -
+               head_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        T *get() { return std::launder(reinterpret_cast<T *>(storage)); }
+    };
+
+    static std::size_t roundUp(std::size_t value) {
+        std::size_t size = 2;
+        while (size < value) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    const std::size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> head_{0};
+    std::size_t tailCache_ = 0;
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail_{0};
+    std::size_t headCache_ = 0;
+};
+}  // namespace atom::async
+
+#endif
@@ -59,7 +59,8 @@ PYBIND11_MODULE(atom_connection, m) {
         .def(py::init<>())
         .def("start", &UdpSocketHub::start, py::arg("port"))
         .def("stop", &UdpSocketHub::stop)
-        .def("addHandler", &UdpSocketHub::addHandler)
+        .def("addMessageHandler", &UdpSocketHub::addMessageHandler)
+        .def("removeMessageHandler", &UdpSocketHub::removeMessageHandler)
         .def("sendTo", &UdpSocketHub::sendTo, py::arg("message"), py::arg("ip"),
              py::arg("port"));
 
@@ -88,5 +89,10 @@ PYBIND11_MODULE(atom_connection, m) {
         .def(py::init<>())
         .def("start", &SocketHub::start)
         .def("stop", &SocketHub::stop)
-        .def("addHandler", &SocketHub::addHandler);
+        .def("addHandler",
+             py::overload_cast<std::function<void(std::string)>>(
+                 &SocketHub::addHandler))
+        .def("send", &SocketHub::send)
+        .def("broadcast", &SocketHub::broadcast)
+        .def("clientCount", &SocketHub::clientCount);
 }
@@ -0,0 +1,159 @@
+/*
+ * framing.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-25
+
+Description: Message framing and receive buffers for stream sockets.
+
+*************************************************/
+
+#ifndef ATOM_CONNECTION_FRAMING_HPP
+#define ATOM_CONNECTION_FRAMING_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace atom::connection {
+/**
+ * @brief Where the next message is in buffered stream input.
+ *
+ * `consumed == 0` means more data is needed. Otherwise the message is
+ * `length` bytes at `offset` and `consumed` bytes are dropped from the
+ * buffer.
+ */
+struct Frame {
+    std::size_t consumed = 0;
+    std::size_t offset = 0;
+    std::size_t length = 0;
+};
+
+/**
+ * @brief Finds the next message in buffered stream input.
+ */
+using Framer = std::function<Frame(std::string_view data)>;
+
+/**
+ * @brief Every chunk of input is one message.
+ */
+inline Frame rawFrame(std::string_view data) {
+    return {data.size(), 0, data.size()};
+}
+
+/**
+ * @brief Messages terminated by `delimiter`, which is not included.
+ */
+inline Framer lineFramer(char delimiter = '\n') {
+    return [delimiter](std::string_view data) -> Frame {
+        auto pos = data.find(delimiter);
+        if (pos == std::string_view::npos) {
+            return {};
+        }
+        return {pos + 1, 0, pos};
+    };
+}
+
+/**
+ * @brief Messages preceded by a 32 bit big-endian length.
+ */
+inline Framer lengthPrefixFramer() {
+    return [](std::string_view data) -> Frame {
+        if (data.size() < 4) {
+            return {};
+        }
+        std::size_t length = 0;
+        for (int i = 0; i < 4; ++i) {
+            length = (length << 8) | static_cast<unsigned char>(data[i]);
+        }
+        if (data.size() - 4 < length) {
+            return {};
+        }
+        return {4 + length, 4, length};
+    };
+}
+
+/**
+ * @brief Largest message lengthPrefixFramer() can describe.
+ */
+inline constexpr std::size_t MAX_PREFIXED_LENGTH = 0xFFFFFFFFU;
+
+/**
+ * @brief Encode the 32 bit big-endian length header of lengthPrefixFramer().
+ * @param length At most MAX_PREFIXED_LENGTH, larger lengths can't be
+ * encoded and must be rejected by the caller.
+ */
+inline std::array<char, 4> lengthPrefix(std::size_t length) {
+    auto value = static_cast<std::uint32_t>(length);
+    return {static_cast<char>(value >> 24), static_cast<char>(value >> 16),
+            static_cast<char>(value >> 8), static_cast<char>(value)};
+}
+
+/**
+ * @class ReceiveBuffer
+ * @brief A fixed capacity byte buffer for socket input.
+ *
+ * Data is appended at the back with writable()/commit() and removed from
+ * the front with consume(). Instead of wrapping around like a ring, unread
+ * bytes are moved to the front only when the free space at the back runs
+ * out, so buffered input (and every frame in it) is always contiguous and
+ * can be handed to a Framer without copying. The storage is allocated once.
+ */
+class ReceiveBuffer {
+public:
+    explicit ReceiveBuffer(std::size_t capacity = 64 * 1024)
+        : storage_(capacity) {}
+
+    /** Unread bytes. */
+    std::string_view data() const {
+        return {storage_.data() + begin_, end_ - begin_};
+    }
+
+    std::size_t size() const { return end_ - begin_; }
+    std::size_t capacity() const { return storage_.size(); }
+    bool empty() const { return begin_ == end_; }
+    bool full() const { return size() == capacity(); }
+
+    /**
+     * @brief Free space to receive into, compacting first if needed.
+     */
+    std::span<char> writable() {
+        if (end_ == storage_.size() && begin_ > 0) {
+            std::memmove(storage_.data(), storage_.data() + begin_,
+                         end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        return {storage_.data() + end_, storage_.size() - end_};
+    }
+
+    /** Mark `count` bytes of writable() as received. */
+    void commit(std::size_t count) { end_ += count; }
+
+    /** Drop `count` bytes from the front. */
+    void consume(std::size_t count) {
+        begin_ += std::min(count, size());
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+    }
+
+    void clear() { begin_ = end_ = 0; }
+
+private:
+    std::vector<char> storage_;
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+};
+}  // namespace atom::connection
+
+#endif
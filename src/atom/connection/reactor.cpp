@@ -0,0 +1,519 @@
+/*
+ * reactor.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-24
+
+Description: Readiness based event loop and bounded worker pool shared by
+the socket hubs.
+
+*************************************************/
+
+#include "reactor.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "atom/log/loguru.hpp"
+
+namespace atom::connection {
+bool setNonBlocking(NativeSocket socket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+void closeNativeSocket(NativeSocket socket) {
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+bool lastErrorWouldBlock() {
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINTR;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// ----------------------------------------------------------------
+// Reactor
+// ----------------------------------------------------------------
+
+class Reactor::Impl {
+public:
+    struct Entry {
+        std::uint32_t events;
+        std::shared_ptr<Callback> callback;
+    };
+
+    Impl() {
+#ifdef __linux__
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd_;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+#elif !defined(_WIN32)
+        if (pipe(wakePipe_) == 0) {
+            setNonBlocking(wakePipe_[0]);
+            setNonBlocking(wakePipe_[1]);
+        }
+#endif
+    }
+
+    ~Impl() {
+#ifdef __linux__
+        close(wakeFd_);
+        close(epollFd_);
+#elif !defined(_WIN32)
+        close(wakePipe_[0]);
+        close(wakePipe_[1]);
+#endif
+    }
+
+#ifdef __linux__
+    static std::uint32_t toEpoll(std::uint32_t events) {
+        /* RDHUP is level triggered, only watch it while reading */
+        std::uint32_t result = 0;
+        if (events & READABLE) {
+            result |= EPOLLIN | EPOLLRDHUP;
+        }
+        if (events & WRITABLE) {
+            result |= EPOLLOUT;
+        }
+        return result;
+    }
+#endif
+
+    bool add(NativeSocket socket, std::uint32_t events, Callback callback) {
+        std::scoped_lock lock(mutex_);
+        auto [it, inserted] = entries_.try_emplace(
+            socket,
+            Entry{events, std::make_shared<Callback>(std::move(callback))});
+        if (!inserted) {
+            return false;
+        }
+#ifdef __linux__
+        epoll_event event{};
+        event.events = toEpoll(events);
+        event.data.fd = socket;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, socket, &event) != 0) {
+            entries_.erase(it);
+            return false;
+        }
+#else
+        wakeup();
+#endif
+        return true;
+    }
+
+    bool modify(NativeSocket socket, std::uint32_t events) {
+        std::scoped_lock lock(mutex_);
+        auto it = entries_.find(socket);
+        if (it == entries_.end()) {
+            return false;
+        }
+        if (it->second.events == events) {
+            return true;
+        }
+        it->second.events = events;
+#ifdef __linux__
+        epoll_event event{};
+        event.events = toEpoll(events);
+        event.data.fd = socket;
+        return epoll_ctl(epollFd_, EPOLL_CTL_MOD, socket, &event) == 0;
+#else
+        wakeup();
+        return true;
+#endif
+    }
+
+    void remove(NativeSocket socket) {
+        std::scoped_lock lock(mutex_);
+        if (entries_.erase(socket) == 0) {
+            return;
+        }
+#ifdef __linux__
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, socket, nullptr);
+#endif
+    }
+
+    void post(Task task) {
+        {
+            std::scoped_lock lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        wakeup();
+    }
+
+    void wakeup() {
+#ifdef __linux__
+        std::uint64_t one = 1;
+        [[maybe_unused]] auto n = write(wakeFd_, &one, sizeof(one));
+#elif !defined(_WIN32)
+        char byte = 0;
+        [[maybe_unused]] auto n = write(wakePipe_[1], &byte, 1);
+#endif
+        /* WSAPoll has no portable wakeup handle, the loop polls with a short
+         * timeout instead */
+    }
+
+    void drainWakeup() {
+#ifdef __linux__
+        std::uint64_t value;
+        [[maybe_unused]] auto n = read(wakeFd_, &value, sizeof(value));
+#elif !defined(_WIN32)
+        char buffer[64];
+        while (read(wakePipe_[0], buffer, sizeof(buffer)) > 0) {
+        }
+#endif
+    }
+
+    void runTasks() {
+        std::vector<Task> tasks;
+        {
+            std::scoped_lock lock(mutex_);
+            tasks.swap(tasks_);
+        }
+        for (auto &task : tasks) {
+            task();
+        }
+    }
+
+    void dispatch(NativeSocket socket, std::uint32_t events) {
+        std::shared_ptr<Callback> callback;
+        {
+            std::scoped_lock lock(mutex_);
+            auto it = entries_.find(socket);
+            if (it == entries_.end()) {
+                return;
+            }
+            callback = it->second.callback;
+        }
+        (*callback)(events);
+    }
+
+    /* Run the loop, the caller has set running_. */
+    void loop() {
+        loopThread_.store(std::this_thread::get_id());
+#ifdef __linux__
+        std::vector<epoll_event> events(256);
+        while (running_.load(std::memory_order_relaxed)) {
+            int count = epoll_wait(epollFd_, events.data(),
+                                   static_cast<int>(events.size()), -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG_F(ERROR, "epoll_wait failed: {}", errno);
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == wakeFd_) {
+                    drainWakeup();
+                    continue;
+                }
+                std::uint32_t ready = 0;
+                if (events[i].events & EPOLLIN) {
+                    ready |= READABLE;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    ready |= WRITABLE;
+                }
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    ready |= CLOSED;
+                }
+                if (events[i].events & EPOLLRDHUP) {
+                    ready |= READ_CLOSED;
+                }
+                dispatch(fd, ready);
+            }
+            if (static_cast<std::size_t>(count) == events.size()) {
+                events.resize(events.size() * 2);
+            }
+            runTasks();
+        }
+#else
+        std::vector<
+#ifdef _WIN32
+            WSAPOLLFD
+#else
+            pollfd
+#endif
+            >
+            fds;
+        while (running_.load(std::memory_order_relaxed)) {
+            fds.clear();
+#ifndef _WIN32
+            fds.push_back({wakePipe_[0], POLLIN, 0});
+#endif
+            {
+                std::scoped_lock lock(mutex_);
+                for (const auto &[socket, entry] : entries_) {
+                    short wanted = 0;
+                    if (entry.events & READABLE) {
+                        wanted |= POLLIN;
+                    }
+                    if (entry.events & WRITABLE) {
+                        wanted |= POLLOUT;
+                    }
+                    fds.push_back({socket, wanted, 0});
+                }
+            }
+#ifdef _WIN32
+            int count = fds.empty()
+                            ? (Sleep(50), 0)
+                            : WSAPoll(fds.data(),
+                                      static_cast<ULONG>(fds.size()), 50);
+#else
+            int count = poll(fds.data(), fds.size(), -1);
+#endif
+            if (count < 0 && !lastErrorWouldBlock()) {
+                LOG_F(ERROR, "poll failed");
+                break;
+            }
+            for (const auto &fd : fds) {
+                if (fd.revents == 0) {
+                    continue;
+                }
+#ifndef _WIN32
+                if (fd.fd == wakePipe_[0]) {
+                    drainWakeup();
+                    continue;
+                }
+#endif
+                std::uint32_t ready = 0;
+                if (fd.revents & POLLIN) {
+                    ready |= READABLE;
+                }
+                if (fd.revents & POLLOUT) {
+                    ready |= WRITABLE;
+                }
+                if (fd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                    ready |= CLOSED;
+                }
+                dispatch(fd.fd, ready);
+            }
+            runTasks();
+        }
+#endif
+        runTasks();
+        loopThread_.store(std::thread::id());
+    }
+
+    void stop() {
+        running_.store(false);
+        wakeup();
+    }
+
+    std::atomic<bool> running_{false};
+    std::atomic<std::thread::id> loopThread_;
+    std::jthread thread_;
+
+private:
+#ifdef __linux__
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+#elif !defined(_WIN32)
+    int wakePipe_[2] = {-1, -1};
+#endif
+    std::mutex mutex_;
+    std::unordered_map<NativeSocket, Entry> entries_;
+    std::vector<Task> tasks_;
+};
+
+Reactor::Reactor() : impl_(std::make_unique<Impl>()) {}
+
+Reactor::~Reactor() { stop(); }
+
+bool Reactor::add(NativeSocket socket, std::uint32_t events,
+                  Callback callback) {
+    return impl_->add(socket, events, std::move(callback));
+}
+
+bool Reactor::modify(NativeSocket socket, std::uint32_t events) {
+    return impl_->modify(socket, events);
+}
+
+void Reactor::remove(NativeSocket socket) { impl_->remove(socket); }
+
+void Reactor::post(Task task) { impl_->post(std::move(task)); }
+
+void Reactor::run() {
+    bool expected = false;
+    if (!impl_->running_.compare_exchange_strong(expected, true)) {
+        LOG_F(WARNING, "Reactor is already running.");
+        return;
+    }
+    impl_->loop();
+}
+
+void Reactor::start() {
+    /* mark as running before the thread starts so an early stop() wins */
+    bool expected = false;
+    if (impl_->thread_.joinable() ||
+        !impl_->running_.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    impl_->thread_ = std::jthread([this] { impl_->loop(); });
+}
+
+void Reactor::stop() {
+    impl_->stop();
+    if (impl_->thread_.joinable() &&
+        impl_->thread_.get_id() != std::this_thread::get_id()) {
+        impl_->thread_.join();
+    }
+}
+
+bool Reactor::isRunning() const { return impl_->running_.load(); }
+
+bool Reactor::isInLoopThread() const {
+    return impl_->loopThread_.load() == std::this_thread::get_id();
+}
+
+const char *Reactor::backend() {
+#ifdef __linux__
+    return "epoll";
+#elif defined(_WIN32)
+    return "wsapoll";
+#else
+    return "poll";
+#endif
+}
+
+// ----------------------------------------------------------------
+// WorkerPool
+// ----------------------------------------------------------------
+
+WorkerPool::WorkerPool(std::size_t threads, std::size_t capacity)
+    : capacity_(std::max<std::size_t>(capacity, 1)) {
+    threads = std::max<std::size_t>(threads, 1);
+    workers_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_[i]->thread = std::thread([this, i] { runWorker(i); });
+    }
+}
+
+WorkerPool::~WorkerPool() { stop(); }
+
+std::size_t WorkerPool::workerFor(std::size_t key) const {
+    return key % workers_.size();
+}
+
+bool WorkerPool::tryPost(std::size_t key, Task task) {
+    auto &worker = *workers_[workerFor(key)];
+    {
+        std::scoped_lock lock(worker.mutex);
+        if (stopping_.load() || worker.tasks.size() >= capacity_) {
+            worker.rejected = true;
+            return false;
+        }
+        worker.tasks.push_back(std::move(task));
+    }
+    worker.cv.notify_one();
+    return true;
+}
+
+void WorkerPool::post(std::size_t key, Task task) {
+    auto &worker = *workers_[workerFor(key)];
+    {
+        std::scoped_lock lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    worker.cv.notify_one();
+}
+
+void WorkerPool::setDrainCallback(
+    std::function<void(std::size_t worker)> callback) {
+    std::scoped_lock lock(callbackMutex_);
+    drainCallback_ = std::move(callback);
+}
+
+void WorkerPool::runWorker(std::size_t index) {
+    auto &worker = *workers_[index];
+    while (true) {
+        Task task;
+        bool drained = false;
+        {
+            std::unique_lock lock(worker.mutex);
+            worker.cv.wait(lock, [&] {
+                return !worker.tasks.empty() || stopping_.load();
+            });
+            if (worker.tasks.empty()) {
+                return;
+            }
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            if (worker.rejected && worker.tasks.size() <= capacity_ / 2) {
+                worker.rejected = false;
+                drained = true;
+            }
+        }
+        try {
+            task();
+        } catch (const std::exception &e) {
+            LOG_F(ERROR, "Worker task threw: {}", e.what());
+        }
+        if (drained) {
+            std::function<void(std::size_t)> callback;
+            {
+                std::scoped_lock lock(callbackMutex_);
+                callback = drainCallback_;
+            }
+            if (callback) {
+                callback(index);
+            }
+        }
+    }
+}
+
+void WorkerPool::stop() {
+    if (stopping_.exchange(true)) {
+        return;
+    }
+    for (auto &worker : workers_) {
+        {
+            std::scoped_lock lock(worker->mutex);
+        }
+        worker->cv.notify_all();
+    }
+    for (auto &worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+}  // namespace atom::connection
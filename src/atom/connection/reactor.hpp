@@ -0,0 +1,213 @@
+/*
+ * reactor.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-24
+
+Description: Readiness based event loop and bounded worker pool shared by
+the socket hubs.
+
+*************************************************/
+
+#ifndef ATOM_CONNECTION_REACTOR_HPP
+#define ATOM_CONNECTION_REACTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+namespace atom::connection {
+#ifdef _WIN32
+using NativeSocket = SOCKET;
+constexpr NativeSocket INVALID_NATIVE_SOCKET = INVALID_SOCKET;
+#else
+using NativeSocket = int;
+constexpr NativeSocket INVALID_NATIVE_SOCKET = -1;
+#endif
+
+/**
+ * @brief Put a socket into non-blocking mode.
+ */
+bool setNonBlocking(NativeSocket socket);
+
+/**
+ * @brief Close a socket.
+ */
+void closeNativeSocket(NativeSocket socket);
+
+/**
+ * @brief True if the last socket error was EAGAIN / EWOULDBLOCK / EINTR.
+ */
+bool lastErrorWouldBlock();
+
+/**
+ * @class Reactor
+ * @brief A single threaded readiness event loop.
+ *
+ * Sockets are registered with the events they are interested in and a
+ * callback that runs on the loop thread when any of them is ready. The
+ * backend is epoll on Linux, poll() on other POSIX systems and WSAPoll() on
+ * Windows. Work from other threads is handed to the loop with post().
+ *
+ * add(), modify() and remove() may be called from any thread; callbacks are
+ * always invoked on the loop thread.
+ */
+class Reactor {
+public:
+    enum Events : std::uint32_t {
+        READABLE = 1U << 0,
+        WRITABLE = 1U << 1,
+        /** Hang up or error, always reported. */
+        CLOSED = 1U << 2,
+        /** The peer shut down its sending side; data may still be buffered.
+         * Only reported with READABLE interest and only by epoll, elsewhere
+         * recv() returning 0 is the signal. */
+        READ_CLOSED = 1U << 3,
+    };
+
+    using Callback = std::function<void(std::uint32_t events)>;
+    using Task = std::function<void()>;
+
+    Reactor();
+    ~Reactor();
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    /**
+     * @brief Register a socket.
+     * @param socket The socket, should be non-blocking.
+     * @param events READABLE and/or WRITABLE.
+     * @param callback Invoked with the ready events.
+     * @return false if the socket could not be registered.
+     */
+    bool add(NativeSocket socket, std::uint32_t events, Callback callback);
+
+    /**
+     * @brief Change the events a registered socket is interested in.
+     */
+    bool modify(NativeSocket socket, std::uint32_t events);
+
+    /**
+     * @brief Unregister a socket. Its callback will not be invoked again.
+     */
+    void remove(NativeSocket socket);
+
+    /**
+     * @brief Run a task on the loop thread.
+     */
+    void post(Task task);
+
+    /**
+     * @brief Run the loop on the calling thread until stop() is called.
+     * Returns at once if the loop is already running on another thread.
+     */
+    void run();
+
+    /**
+     * @brief Run the loop on a thread owned by the reactor.
+     */
+    void start();
+
+    /**
+     * @brief Stop the loop and join its thread if start() created one.
+     */
+    void stop();
+
+    bool isRunning() const;
+
+    /**
+     * @brief True when called from the thread running the loop.
+     */
+    bool isInLoopThread() const;
+
+    /**
+     * @brief Name of the backend in use ("epoll", "poll" or "wsapoll").
+     */
+    static const char *backend();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * @class WorkerPool
+ * @brief A fixed number of worker threads with bounded queues.
+ *
+ * Tasks are routed by key to one worker, so tasks with the same key (for
+ * example from the same client) run in order. Each worker queue holds at
+ * most `capacity` tasks; tryPost() fails instead of growing it, which lets
+ * the producer apply backpressure. Once a queue that rejected a task has
+ * drained to half its capacity the drain callback is invoked with the
+ * worker index.
+ */
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    WorkerPool(std::size_t threads, std::size_t capacity);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /**
+     * @brief Queue a task unless the worker for `key` is full.
+     */
+    bool tryPost(std::size_t key, Task task);
+
+    /**
+     * @brief Queue a task even if the worker is full (for rare control
+     * events that must not be lost).
+     */
+    void post(std::size_t key, Task task);
+
+    /**
+     * @brief Worker index a key is routed to.
+     */
+    std::size_t workerFor(std::size_t key) const;
+
+    std::size_t size() const { return workers_.size(); }
+
+    void setDrainCallback(std::function<void(std::size_t worker)> callback);
+
+    /**
+     * @brief Finish queued tasks and join the workers.
+     */
+    void stop();
+
+private:
+    struct Worker {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool rejected = false;
+        std::thread thread;
+    };
+
+    void runWorker(std::size_t index);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::size_t capacity_;
+    std::atomic<bool> stopping_{false};
+    std::function<void(std::size_t)> drainCallback_;
+    std::mutex callbackMutex_;
+};
+}  // namespace atom::connection
+
+#endif
@@ -14,203 +14,636 @@ Description: SocketHub类用于管理socket连接的类。
 
 #include "sockethub.hpp"
 
+#include "reactor.hpp"
+
 #include <algorithm>
+#include <atomic>
 #include <cstring>
-#include <iostream>
-#include <string>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
 
 #include "atom/log/loguru.hpp"
 
-#ifndef _WIN32
-typedef int SOCKET;
+namespace atom::connection {
+namespace {
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
 #endif
+}  // namespace
+
+class SocketHub::Impl : public std::enable_shared_from_this<Impl> {
+public:
+    Impl(Options options, std::shared_ptr<Reactor> reactor)
+        : options_(options),
+          reactor_(std::move(reactor)),
+          ownsReactor_(!reactor_),
+          framer_(rawFrame),
+          handlers_(std::make_shared<Handlers>()) {
+        if (ownsReactor_) {
+            reactor_ = std::make_shared<Reactor>();
+        }
+        options_.readBufferSize =
+            std::clamp<std::size_t>(options_.readBufferSize, 256,
+                                    std::max<std::size_t>(
+                                        options_.maxMessageSize, 256));
+    }
 
-namespace atom::connection {
-SocketHub::SocketHub() : running(false) {}
+    ~Impl() { stop(); }
 
-SocketHub::~SocketHub() { stop(); }
+    void start(int port) {
+        if (running_.load()) {
+            LOG_F(WARNING, "SocketHub is already running.");
+            return;
+        }
 
-void SocketHub::start(int port) {
-    if (running.load()) {
-        LOG_F(WARNING, "SocketHub is already running.");
-        return;
-    }
+        if (!initWinsock()) {
+            return;
+        }
+
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener_ == INVALID_NATIVE_SOCKET) {
+            LOG_F(ERROR, "Failed to create server socket.");
+            cleanupWinsock();
+            return;
+        }
+
+        int reuse = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR,
+                   reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+
+        sockaddr_in serverAddress{};
+        serverAddress.sin_family = AF_INET;
+        serverAddress.sin_addr.s_addr = INADDR_ANY;
+        serverAddress.sin_port = htons(static_cast<std::uint16_t>(port));
+
+        if (bind(listener_, reinterpret_cast<sockaddr *>(&serverAddress),
+                 sizeof(serverAddress)) != 0) {
+            LOG_F(ERROR, "Failed to bind server socket.");
+            closeListener();
+            return;
+        }
+
+        if (listen(listener_, SOMAXCONN) != 0 || !setNonBlocking(listener_)) {
+            LOG_F(ERROR, "Failed to listen on server socket.");
+            closeListener();
+            return;
+        }
 
-    if (!initWinsock()) {
-        return;
+        socklen_t length = sizeof(serverAddress);
+        getsockname(listener_, reinterpret_cast<sockaddr *>(&serverAddress),
+                    &length);
+        port_ = ntohs(serverAddress.sin_port);
+
+        pool_ = std::make_unique<WorkerPool>(options_.workerThreads,
+                                             options_.queueCapacity);
+        pool_->setDrainCallback(
+            [weak = weak_from_this()](std::size_t worker) {
+                if (auto self = weak.lock()) {
+                    self->reactor_->post([weak, worker] {
+                        if (auto self = weak.lock()) {
+                            self->resumeWorker(worker);
+                        }
+                    });
+                }
+            });
+
+        running_.store(true);
+        reactor_->add(listener_, Reactor::READABLE,
+                      [weak = weak_from_this()](std::uint32_t) {
+                          if (auto self = weak.lock()) {
+                              self->acceptClients();
+                          }
+                      });
+        if (ownsReactor_) {
+            reactor_->start();
+        }
+        DLOG_F(INFO, "SocketHub started on port {} ({})", port_,
+               Reactor::backend());
     }
 
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-#ifdef _WIN32
-    if (serverSocket == INVALID_SOCKET)
-#else
-    if (serverSocket < 0)
-#endif
-    {
-        LOG_F(ERROR, "Failed to create server socket.");
+    void stop() {
+        if (!running_.exchange(false)) {
+            return;
+        }
+
+        runOnLoop([this] {
+            reactor_->remove(listener_);
+            closeNativeSocket(listener_);
+            listener_ = INVALID_NATIVE_SOCKET;
+            while (!clients_.empty()) {
+                closeClient(clients_.begin()->second);
+            }
+        });
+        if (ownsReactor_) {
+            reactor_->stop();
+        }
+        /* handlers still queued run to completion, sends from them are
+         * dropped because no client is left */
+        pool_->stop();
         cleanupWinsock();
-        return;
+        DLOG_F(INFO, "SocketHub stopped.");
     }
 
-    sockaddr_in serverAddress{};
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_addr.s_addr = INADDR_ANY;
-    serverAddress.sin_port = htons(port);
+    void addHandler(ClientMessageHandler handler) {
+        std::scoped_lock lock(handlersMutex_);
+        auto handlers = std::make_shared<Handlers>(*handlers_);
+        handlers->messages.push_back(std::move(handler));
+        handlers_ = std::move(handlers);
+    }
 
-#ifdef _WIN32
-    if (bind(serverSocket, reinterpret_cast<sockaddr *>(&serverAddress),
-             sizeof(serverAddress)) == SOCKET_ERROR)
-#else
-    if (bind(serverSocket, reinterpret_cast<sockaddr *>(&serverAddress),
-             sizeof(serverAddress)) < 0)
-#endif
-    {
-        LOG_F(ERROR, "Failed to bind server socket.");
-        cleanupSocket();
-        return;
+    void setConnectHandler(ConnectHandler handler) {
+        std::scoped_lock lock(handlersMutex_);
+        auto handlers = std::make_shared<Handlers>(*handlers_);
+        handlers->connect = std::move(handler);
+        handlers_ = std::move(handlers);
     }
 
-#ifdef _WIN32
-    if (listen(serverSocket, maxConnections) == SOCKET_ERROR)
-#else
-    if (listen(serverSocket, maxConnections) < 0)
-#endif
-    {
-        LOG_F(ERROR, "Failed to listen on server socket.");
-        cleanupSocket();
-        return;
+    void setFramer(Framer framer) {
+        if (running_.load()) {
+            LOG_F(WARNING, "SocketHub framer can't change while running.");
+            return;
+        }
+        framer_ = framer ? std::move(framer) : Framer(rawFrame);
     }
 
-    running.store(true);
-    DLOG_F(INFO, "SocketHub started on port {}", port);
+    bool send(ClientId id, std::string data) {
+        if (!running_.load()) {
+            return false;
+        }
+        if (reactor_->isInLoopThread()) {
+            return queueOutput(id, std::move(data));
+        }
+        {
+            std::scoped_lock lock(liveMutex_);
+            if (!live_.contains(id)) {
+                return false;
+            }
+        }
+        reactor_->post([weak = weak_from_this(), id,
+                        data = std::move(data)]() mutable {
+            if (auto self = weak.lock()) {
+                self->queueOutput(id, std::move(data));
+            }
+        });
+        return true;
+    }
 
-#if __cplusplus >= 202002L
-    acceptThread =
-        std::make_unique<std::jthread>(&SocketHub::acceptConnections, this);
-#else
-    acceptThread =
-        std::make_unique<std::thread>(&SocketHub::acceptConnections, this);
-#endif
-}
+    void broadcast(std::string data) {
+        if (!running_.load()) {
+            return;
+        }
+        auto task = [weak = weak_from_this(), data = std::move(data)] {
+            if (auto self = weak.lock()) {
+                std::vector<ClientId> ids;
+                ids.reserve(self->clients_.size());
+                for (const auto &[id, client] : self->clients_) {
+                    ids.push_back(id);
+                }
+                for (auto id : ids) {
+                    self->queueOutput(id, data);
+                }
+            }
+        };
+        if (reactor_->isInLoopThread()) {
+            task();
+        } else {
+            reactor_->post(std::move(task));
+        }
+    }
 
-void SocketHub::stop() {
-    if (!running.load()) {
-        LOG_F(WARNING, "SocketHub is not running.");
-        return;
+    void disconnect(ClientId id) {
+        reactor_->post([weak = weak_from_this(), id] {
+            if (auto self = weak.lock()) {
+                if (auto it = self->clients_.find(id);
+                    it != self->clients_.end()) {
+                    self->closeClient(it->second);
+                }
+            }
+        });
     }
 
-    running.store(false);
+    bool isRunning() const { return running_.load(); }
 
-    if (acceptThread && acceptThread->joinable()) {
-        acceptThread->join();
-    }
+    std::size_t clientCount() const { return clientCount_.load(); }
 
-    cleanupSocket();
-    cleanupWinsock();
-    DLOG_F(INFO, "SocketHub stopped.");
-}
+    int getPort() const { return port_; }
 
-void SocketHub::addHandler(std::function<void(std::string)> handler) {
-    this->handler = std::move(handler);
-}
+private:
+    struct Handlers {
+        std::vector<ClientMessageHandler> messages;
+        ConnectHandler connect;
+    };
 
-bool SocketHub::initWinsock() {
-#ifdef _WIN32
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        LOG_F(ERROR, "Failed to initialize Winsock.");
-        return false;
-    }
-#endif
-    return true;
-}
+    /* Loop thread only. Input is buffered in [begin, end) of `input`. */
+    struct Client {
+        ClientId id = 0;
+        NativeSocket socket = INVALID_NATIVE_SOCKET;
+        std::vector<char> input;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+        std::string output;
+        std::size_t outputOffset = 0;
+        bool paused = false;
+        std::uint32_t events = 0;
+    };
 
-void SocketHub::cleanupWinsock() {
+    bool initWinsock() {
 #ifdef _WIN32
-    WSACleanup();
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            LOG_F(ERROR, "Failed to initialize Winsock.");
+            return false;
+        }
 #endif
-}
+        return true;
+    }
 
+    void cleanupWinsock() {
 #ifdef _WIN32
-void SocketHub::closeSocket(SOCKET socket)
-#else
-void SocketHub::closeSocket(int socket)
-#endif
-{
-#ifdef _WIN32
-    closesocket(socket);
-#else
-    close(socket);
+        WSACleanup();
 #endif
-}
+    }
 
-void SocketHub::acceptConnections() {
-    while (running.load()) {
-        sockaddr_in clientAddress{};
-        socklen_t clientAddressLength = sizeof(clientAddress);
+    void closeListener() {
+        closeNativeSocket(listener_);
+        listener_ = INVALID_NATIVE_SOCKET;
+        cleanupWinsock();
+    }
 
-        SOCKET clientSocket =
-            accept(serverSocket, reinterpret_cast<sockaddr *>(&clientAddress),
-                   &clientAddressLength);
-#ifdef _WIN32
-        if (clientSocket == INVALID_SOCKET)
-#else
-        if (clientSocket < 0)
-#endif
-        {
-            if (running.load()) {
-                LOG_F(ERROR, "Failed to accept client connection.");
+    /* Run a task on the loop thread and wait for it. */
+    void runOnLoop(const std::function<void()> &task) {
+        if (reactor_->isInLoopThread() || !reactor_->isRunning()) {
+            task();
+            return;
+        }
+        std::promise<void> done;
+        reactor_->post([&] {
+            task();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+
+    std::shared_ptr<const Handlers> handlers() {
+        std::scoped_lock lock(handlersMutex_);
+        return handlers_;
+    }
+
+    void acceptClients() {
+        while (true) {
+            sockaddr_in address{};
+            socklen_t length = sizeof(address);
+            NativeSocket socket = accept(
+                listener_, reinterpret_cast<sockaddr *>(&address), &length);
+            if (socket == INVALID_NATIVE_SOCKET) {
+                if (!lastErrorWouldBlock()) {
+                    LOG_F(ERROR, "Failed to accept client connection.");
+                }
+                return;
+            }
+            if (clients_.size() >= options_.maxConnections) {
+                LOG_F(WARNING, "SocketHub is full, refusing a client.");
+                closeNativeSocket(socket);
+                continue;
+            }
+            if (!setNonBlocking(socket)) {
+                closeNativeSocket(socket);
+                continue;
+            }
+
+            auto id = nextId_.fetch_add(1);
+            auto &client = clients_[id];
+            client.id = id;
+            client.socket = socket;
+            client.input.resize(options_.readBufferSize);
+            client.events = Reactor::READABLE;
+            reactor_->add(socket, client.events,
+                          [this, id](std::uint32_t events) {
+                              onEvents(id, events);
+                          });
+            clientCount_.fetch_add(1);
+            {
+                std::scoped_lock lock(liveMutex_);
+                live_.insert(id);
+            }
+
+            if (auto current = handlers(); current->connect) {
+                pool_->post(id, [current, id] { current->connect(id, true); });
+            }
+        }
+    }
+
+    void onEvents(ClientId id, std::uint32_t events) {
+        auto it = clients_.find(id);
+        if (it == clients_.end()) {
+            return;
+        }
+        auto &client = it->second;
+        if (events & Reactor::WRITABLE) {
+            if (!flushOutput(client)) {
+                closeClient(client);
+                return;
             }
-            continue;
         }
+        if (events & Reactor::CLOSED) {
+            /* error or reset: nothing more can be read or sent */
+            closeClient(client);
+            return;
+        }
+        /* a paused client doesn't watch READ_CLOSED: after a FIN its
+         * buffered messages are dispatched on resume, and the FIN is seen
+         * by recv() once reading is back on */
+        if ((events & (Reactor::READABLE | Reactor::READ_CLOSED)) &&
+            !client.paused) {
+            readInput(client);
+        }
+    }
 
-        clients.push_back(clientSocket);
+    void readInput(Client &client) {
+        /* bounded so one busy client can't starve the others */
+        for (int i = 0; i < 16 && !client.paused; ++i) {
+            if (client.end == client.input.size()) {
+                if (client.begin > 0) {
+                    std::memmove(client.input.data(),
+                                 client.input.data() + client.begin,
+                                 client.end - client.begin);
+                    client.end -= client.begin;
+                    client.begin = 0;
+                } else if (client.input.size() < options_.maxMessageSize) {
+                    client.input.resize(std::min(client.input.size() * 2,
+                                                 options_.maxMessageSize));
+                } else {
+                    LOG_F(WARNING,
+                          "SocketHub client {} exceeded the message size "
+                          "limit.",
+                          client.id);
+                    closeClient(client);
+                    return;
+                }
+            }
 
-#if __cplusplus >= 202002L
-        clientThreads.push_back(std::make_unique<std::jthread>(
-            [this, clientSocket]() { handleClientMessages(clientSocket); }));
-#else
-        clientThreads.push_back(std::make_unique<std::thread>(
-            [this, clientSocket]() { handleClientMessages(clientSocket); }));
-#endif
+            auto count = recv(client.socket, client.input.data() + client.end,
+                              static_cast<int>(client.input.size() -
+                                               client.end),
+                              0);
+            if (count == 0) {
+                /* every complete message is dispatched by now, anything
+                 * still buffered is an incomplete one */
+                closeClient(client);
+                return;
+            }
+            if (count < 0) {
+                if (!lastErrorWouldBlock()) {
+                    closeClient(client);
+                }
+                return;
+            }
+            client.end += static_cast<std::size_t>(count);
+            if (!dispatchFrames(client)) {
+                closeClient(client);
+                return;
+            }
+        }
     }
-}
 
-void SocketHub::handleClientMessages(SOCKET clientSocket) {
-    char buffer[1024];
-    while (running.load()) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytesRead = recv(clientSocket, buffer, sizeof(buffer), 0);
-        if (bytesRead <= 0) {
-            closeSocket(clientSocket);
-            clients.erase(
-                std::remove(clients.begin(), clients.end(), clientSocket),
-                clients.end());
-            break;
+    /* Hand complete messages to the workers. Returns false on a framing
+     * error. Stops early and pauses the client if its worker is full. */
+    bool dispatchFrames(Client &client) {
+        std::shared_ptr<const Handlers> current;
+        while (client.begin < client.end) {
+            std::string_view data(client.input.data() + client.begin,
+                                  client.end - client.begin);
+            auto frame = framer_(data);
+            if (frame.consumed == 0) {
+                break;
+            }
+            if (frame.consumed > data.size() ||
+                frame.offset + frame.length > frame.consumed) {
+                LOG_F(ERROR, "SocketHub framer returned an invalid frame.");
+                return false;
+            }
+            if (!current) {
+                current = handlers();
+            }
+            if (!current->messages.empty()) {
+                auto task = [current, id = client.id,
+                             message = std::string(
+                                 data.substr(frame.offset, frame.length))] {
+                    for (const auto &handler : current->messages) {
+                        handler(id, message);
+                    }
+                };
+                if (!pool_->tryPost(client.id, std::move(task))) {
+                    pause(client);
+                    break;
+                }
+            }
+            client.begin += frame.consumed;
         }
+        if (client.begin == client.end) {
+            client.begin = client.end = 0;
+            /* give memory back after an unusually large message */
+            if (client.input.size() > options_.readBufferSize * 4) {
+                client.input.resize(options_.readBufferSize);
+                client.input.shrink_to_fit();
+            }
+        }
+        return true;
+    }
 
-        std::string message(buffer, bytesRead);
+    void pause(Client &client) {
+        client.paused = true;
+        updateEvents(client);
+    }
 
-        if (handler) {
-            handler(message);
+    void resumeWorker(std::size_t worker) {
+        std::vector<ClientId> paused;
+        for (const auto &[id, client] : clients_) {
+            if (client.paused && pool_->workerFor(id) == worker) {
+                paused.push_back(id);
+            }
+        }
+        for (auto id : paused) {
+            auto it = clients_.find(id);
+            if (it == clients_.end()) {
+                continue;
+            }
+            auto &client = it->second;
+            client.paused = false;
+            if (!dispatchFrames(client)) {
+                closeClient(client);
+                continue;
+            }
+            updateEvents(client);
         }
     }
-}
 
-void SocketHub::cleanupSocket() {
-    for (const auto &client : clients) {
-        closeSocket(client);
+    void updateEvents(Client &client) {
+        std::uint32_t events = client.paused ? 0U : Reactor::READABLE;
+        if (client.outputOffset < client.output.size()) {
+            events |= Reactor::WRITABLE;
+        }
+        if (events != client.events) {
+            client.events = events;
+            reactor_->modify(client.socket, events);
+        }
     }
-    clients.clear();
 
-    closeSocket(serverSocket);
+    bool queueOutput(ClientId id, std::string data) {
+        auto it = clients_.find(id);
+        if (it == clients_.end()) {
+            return false;
+        }
+        auto &client = it->second;
+        if (client.output.size() - client.outputOffset + data.size() >
+            options_.maxPendingOutput) {
+            LOG_F(WARNING, "SocketHub client {} is too slow, dropping it.",
+                  id);
+            closeClient(client);
+            return false;
+        }
+        if (client.outputOffset == client.output.size()) {
+            client.output = std::move(data);
+            client.outputOffset = 0;
+        } else {
+            client.output.append(data);
+        }
+        if (!flushOutput(client)) {
+            closeClient(client);
+            return false;
+        }
+        return true;
+    }
+
+    bool flushOutput(Client &client) {
+        while (client.outputOffset < client.output.size()) {
+            auto count = ::send(
+                client.socket, client.output.data() + client.outputOffset,
+                static_cast<int>(client.output.size() - client.outputOffset),
+                SEND_FLAGS);
+            if (count < 0) {
+                if (lastErrorWouldBlock()) {
+                    break;
+                }
+                return false;
+            }
+            client.outputOffset += static_cast<std::size_t>(count);
+        }
+        if (client.outputOffset == client.output.size()) {
+            client.output.clear();
+            client.outputOffset = 0;
+        } else if (client.outputOffset > client.output.size() / 2) {
+            client.output.erase(0, client.outputOffset);
+            client.outputOffset = 0;
+        }
+        updateEvents(client);
+        return true;
+    }
 
-    for (auto &thread : clientThreads) {
-        if (thread->joinable()) {
-            thread->join();
+    void closeClient(Client &client) {
+        auto id = client.id;
+        reactor_->remove(client.socket);
+        closeNativeSocket(client.socket);
+        clients_.erase(id);
+        clientCount_.fetch_sub(1);
+        {
+            std::scoped_lock lock(liveMutex_);
+            live_.erase(id);
+        }
+        if (auto current = handlers(); current->connect) {
+            pool_->post(id, [current, id] { current->connect(id, false); });
         }
     }
-    clientThreads.clear();
+
+    Options options_;
+    std::shared_ptr<Reactor> reactor_;
+    bool ownsReactor_;
+    std::unique_ptr<WorkerPool> pool_;
+    Framer framer_;
+
+    std::mutex handlersMutex_;
+    std::shared_ptr<const Handlers> handlers_;
+
+    std::atomic<bool> running_{false};
+    std::atomic<ClientId> nextId_{1};
+    std::atomic<std::size_t> clientCount_{0};
+    int port_ = 0;
+
+    /* ids of connected clients, for send() from other threads */
+    std::mutex liveMutex_;
+    std::unordered_set<ClientId> live_;
+
+    /* loop thread only */
+    NativeSocket listener_ = INVALID_NATIVE_SOCKET;
+    std::unordered_map<ClientId, Client> clients_;
+};
+
+SocketHub::SocketHub() : SocketHub(Options()) {}
+
+SocketHub::SocketHub(Options options, std::shared_ptr<Reactor> reactor)
+    : impl_(std::make_shared<Impl>(options, std::move(reactor))) {}
+
+SocketHub::~SocketHub() { impl_->stop(); }
+
+void SocketHub::start(int port) { impl_->start(port); }
+
+void SocketHub::stop() { impl_->stop(); }
+
+void SocketHub::addHandler(std::function<void(std::string)> handler) {
+    impl_->addHandler(
+        [handler = std::move(handler)](ClientId, std::string message) {
+            handler(std::move(message));
+        });
+}
+
+void SocketHub::addHandler(ClientMessageHandler handler) {
+    impl_->addHandler(std::move(handler));
+}
+
+void SocketHub::setConnectHandler(ConnectHandler handler) {
+    impl_->setConnectHandler(std::move(handler));
+}
+
+void SocketHub::setFramer(Framer framer) {
+    impl_->setFramer(std::move(framer));
+}
+
+SocketHub::Framer SocketHub::lineFramer(char delimiter) {
+    return connection::lineFramer(delimiter);
 }
 
+SocketHub::Framer SocketHub::lengthPrefixFramer() {
+    return connection::lengthPrefixFramer();
+}
+
+bool SocketHub::send(ClientId client, std::string data) {
+    return impl_->send(client, std::move(data));
+}
+
+void SocketHub::broadcast(std::string data) {
+    impl_->broadcast(std::move(data));
+}
+
+void SocketHub::disconnect(ClientId client) { impl_->disconnect(client); }
+
+bool SocketHub::isRunning() const { return impl_->isRunning(); }
+
+std::size_t SocketHub::clientCount() const { return impl_->clientCount(); }
+
+int SocketHub::getPort() const { return impl_->getPort(); }
 }  // namespace atom::connection
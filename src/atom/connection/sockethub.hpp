@@ -15,59 +15,97 @@ Description: SocketHub类用于管理socket连接的类。
 #ifndef ATOM_CONNECTION_SOCKETHUB_HPP
 #define ATOM_CONNECTION_SOCKETHUB_HPP
 
-#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <memory>
-#include <thread>
-#include <vector>
-
-#ifdef _WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32.lib")
-#else
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#endif
+#include <string>
+#include <string_view>
+
+#include "framing.hpp"
 
 namespace atom::connection {
+class Reactor;
+
 /**
  * @class SocketHub
  * @brief 用于管理socket连接的类。
  *
  * SocketHub类提供了启动和停止socket服务的功能，同时管理多个客户端连接。
- * 它支持接收来自客户端的连接，并为每个客户端启动一个线程处理消息。
+ * 所有连接由一个事件循环（Linux上为epoll）以非阻塞方式处理，
+ * 消息处理函数在有界的工作线程池中执行。
  *
  * @class SocketHub
  * @brief A class for managing socket connections.
  *
  * The SocketHub class offers functionalities to start and stop a socket
- * service, while managing multiple client connections. It supports accepting
- * connections from clients and starts a thread for each client to handle
- * messages.
+ * service, while managing multiple client connections. All connections are
+ * served by one non-blocking event loop (epoll on Linux). Incoming bytes are
+ * collected in a per-connection buffer that grows up to
+ * Options::maxMessageSize, cut into messages by the framer and handed to a
+ * bounded worker pool. Messages of one client are always handled in order;
+ * when a worker falls behind, reading from its clients is paused until it
+ * catches up. A client that shuts down its sending side still has every
+ * complete message it sent delivered before it is closed.
  */
 class SocketHub {
 public:
+    using ClientId = std::uint64_t;
+
+    using Frame = connection::Frame;
+    using Framer = connection::Framer;
+
+    using ClientMessageHandler =
+        std::function<void(ClientId client, std::string message)>;
+
+    /**
+     * @brief Called with `true` after a client connected and `false` after
+     * it disconnected, in order with its messages.
+     */
+    using ConnectHandler = std::function<void(ClientId client, bool connected)>;
+
+    struct Options {
+        std::size_t maxConnections = 1024;
+        std::size_t workerThreads = 4;
+        /** Pending messages per worker before reading is paused. */
+        std::size_t queueCapacity = 1024;
+        /** Largest message (and read buffer) per connection. */
+        std::size_t maxMessageSize = 1 << 20;
+        /** Initial read buffer size per connection. */
+        std::size_t readBufferSize = 4096;
+        /** Unsent bytes per connection before a slow client is dropped. */
+        std::size_t maxPendingOutput = 8 << 20;
+    };
+
     /**
      * @brief 构造函数。
      * @brief Constructor.
      */
     SocketHub();
 
+    /**
+     * @param options Limits and pool sizes.
+     * @param reactor Event loop to share with other hubs. The caller runs
+     * it; when null the hub creates and runs its own.
+     */
+    explicit SocketHub(Options options,
+                       std::shared_ptr<Reactor> reactor = nullptr);
+
     /**
      * @brief 析构函数，负责资源的清理。
      * @brief Destructor, responsible for cleaning up resources.
      */
     ~SocketHub();
 
+    SocketHub(const SocketHub &) = delete;
+    SocketHub &operator=(const SocketHub &) = delete;
+
     /**
      * @brief 启动socket服务并监听指定端口。
      *
      * @param port 要监听的端口号。
      * @brief Starts the socket service and listens on the specified port.
      *
-     * @param port The port number to listen on.
+     * @param port The port number to listen on, 0 for any free port.
      */
     void start(int port);
 
@@ -87,93 +125,59 @@ public:
      */
     void addHandler(std::function<void(std::string)> handler);
 
-private:
-    static const int maxConnections = 10;  ///< 最大连接数。
-                                           ///< Maximum number of connections.
-    std::atomic<bool>
-        running;  ///< 指示服务是否正在运行的标志。
-                  ///< Flag indicating whether the service is running.
-#ifdef _WIN32
-    SOCKET serverSocket;          ///< 服务器socket。
-                                  ///< Server socket.
-    std::vector<SOCKET> clients;  ///< 客户端sockets列表。
-                                  ///< List of client sockets.
-#else
-    int serverSocket;
-    std::vector<int> clients;
-#endif
-#if __cplusplus >= 202002L
-    std::unique_ptr<std::jthread>
-        acceptThread;  ///< 用于接受连接的线程。
-                       ///< Thread for accepting connections.
-    std::vector<std::unique_ptr<std::jthread>>
-        clientThreads;  ///< 客户端处理线程列表。
-                        ///< List of threads for handling clients.
-#else
-    std::unique_ptr<std::thread>
-        acceptThread;  ///< 用于接受连接的线程。
-                       ///< Thread for accepting connections.
-    std::vector<std::unique_ptr<std::thread>>
-        clientThreads;  ///< 客户端处理线程列表。
-                        ///< List of threads for handling clients.
-#endif
+    /**
+     * @brief Adds a message handler that also receives the client id.
+     */
+    void addHandler(ClientMessageHandler handler);
 
-    std::function<void(std::string)> handler;  ///< 消息处理函数。
+    void setConnectHandler(ConnectHandler handler);
 
     /**
-     * @brief 初始化Winsock。
-     *
-     * @return 成功返回true，失败返回false。
-     * @brief Initializes Winsock.
-     *
-     * @return true on success, false on failure.
+     * @brief Set how the input of a client is cut into messages. Must be
+     * called before start(). By default every read is one message.
      */
-    bool initWinsock();
+    void setFramer(Framer framer);
 
     /**
-     * @brief 清理Winsock资源。
-     * @brief Cleans up Winsock resources.
+     * @brief Messages terminated by `delimiter`, which is not included.
      */
-    void cleanupWinsock();
+    static Framer lineFramer(char delimiter = '\n');
 
     /**
-     * @brief 关闭指定的socket。
-     *
-     * @param socket 要关闭的socket。
-     * @brief Closes the specified socket.
-     *
-     * @param socket The socket to close.
+     * @brief Messages preceded by a 32 bit big-endian length.
      */
-#ifdef _WIN32
-    void closeSocket(SOCKET socket);
-#else
-    void closeSocket(int socket);
-#endif
+    static Framer lengthPrefixFramer();
 
     /**
-     * @brief 接受客户端连接并将它们添加到clients列表。
-     * @brief Accepts client connections and adds them to the clients list.
+     * @brief Queue data for a client. Safe to call from any thread,
+     * including handlers.
+     * @return false if the client is not connected. From other threads
+     * the client may still disconnect before the data is written.
      */
-    void acceptConnections();
+    bool send(ClientId client, std::string data);
 
     /**
-     * @brief 处理客户端消息。
-     *
-     * @param clientSocket 客户端socket。
-     * @brief Handles messages from a client.
-     *
-     * @param clientSocket The client socket.
+     * @brief Queue data for every connected client.
      */
-#ifdef _WIN32
-    void handleClientMessages(SOCKET clientSocket);
-#else
-    void handleClientMessages(int clientSocket);
-#endif
+    void broadcast(std::string data);
+
+    /**
+     * @brief Close the connection to a client.
+     */
+    void disconnect(ClientId client);
+
+    bool isRunning() const;
+
+    std::size_t clientCount() const;
+
     /**
-     * @brief 清理sockets资源，关闭所有客户端连接。
-     * @brief Cleans up socket resources, closing all client connections.
+     * @brief The port actually listened on, useful after start(0).
      */
-    void cleanupSocket();
+    int getPort() const;
+
+private:
+    class Impl;
+    std::shared_ptr<Impl> impl_;
 };
 }  // namespace atom::connection
 
@@ -14,7 +14,11 @@ Description: TCP Client Class
 
 #include "tcpclient.hpp"
 
+#include <array>
+#include <atomic>
+#include <cerrno>
 #include <cstring>
+#include <mutex>
 #include <stdexcept>
 #include <thread>
 
@@ -25,13 +29,66 @@ Description: TCP Client Class
 #else
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
 #include "atom/error/exception.hpp"
 
 namespace atom::connection {
+namespace {
+#ifdef _WIN32
+using SocketType = SOCKET;
+constexpr SocketType INVALID_SOCKET_VALUE = INVALID_SOCKET;
+using IoVec = WSABUF;
+#else
+using SocketType = int;
+constexpr SocketType INVALID_SOCKET_VALUE = -1;
+using IoVec = iovec;
+#endif
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+/* Scatter/gather entries kept on the stack, larger requests are split. */
+constexpr std::size_t MAX_PARTS = 16;
+
+void setIoVec(IoVec& vec, const char* data, std::size_t size) {
+#ifdef _WIN32
+    vec.buf = const_cast<char*>(data);
+    vec.len = static_cast<ULONG>(size);
+#else
+    vec.iov_base = const_cast<char*>(data);
+    vec.iov_len = size;
+#endif
+}
+
+std::size_t ioVecSize(const IoVec& vec) {
+#ifdef _WIN32
+    return vec.len;
+#else
+    return vec.iov_len;
+#endif
+}
+
+void advanceIoVec(IoVec& vec, std::size_t count) {
+#ifdef _WIN32
+    vec.buf += count;
+    vec.len -= static_cast<ULONG>(count);
+#else
+    vec.iov_base = static_cast<char*>(vec.iov_base) + count;
+    vec.iov_len -= count;
+#endif
+}
+}  // namespace
+
 class TcpClient::Impl {
 public:
     Impl() {
@@ -43,13 +100,15 @@ public:
         }
 #endif
         socket_ = socket(AF_INET, SOCK_STREAM, 0);
-        if (socket_ < 0) {
+        if (socket_ == INVALID_SOCKET_VALUE) {
             THROW_RUNTIME_ERROR("Socket creation failed");
         }
     }
 
     ~Impl() {
+        stopReceiving();
         disconnect();
+        closeSocket();
 #ifdef _WIN32
         WSACleanup();
 #endif
@@ -57,6 +116,16 @@ public:
 
     bool connect(const std::string& host, int port,
                  std::chrono::milliseconds timeout) {
+        /* a socket can't connect again once it was shut down */
+        if (socket_ == INVALID_SOCKET_VALUE) {
+            socket_ = socket(AF_INET, SOCK_STREAM, 0);
+            if (socket_ == INVALID_SOCKET_VALUE) {
+                errorMessage_ = "Socket creation failed";
+                return false;
+            }
+            recvTimeout_ = std::chrono::milliseconds::zero();
+        }
+
         struct hostent* server = gethostbyname(host.c_str());
         if (server == nullptr) {
             errorMessage_ = "Host not found";
@@ -70,13 +139,9 @@ public:
         serverAddress.sin_port = htons(port);
 
         if (timeout > std::chrono::milliseconds::zero()) {
-            struct timeval tv;
-            tv.tv_sec = timeout.count() / 1000;
-            tv.tv_usec = (timeout.count() % 1000) * 1000;
-            setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO,
-                       reinterpret_cast<const char*>(&tv), sizeof(tv));
-            setsockopt(socket_, SOL_SOCKET, SO_SNDTIMEO,
-                       reinterpret_cast<const char*>(&tv), sizeof(tv));
+            setTimeout(SO_RCVTIMEO, timeout);
+            setTimeout(SO_SNDTIMEO, timeout);
+            recvTimeout_ = timeout;
         }
 
         if (::connect(socket_,
@@ -87,55 +152,149 @@ public:
         }
 
         connected_ = true;
+        if (onConnectedCallback_) {
+            onConnectedCallback_();
+        }
         return true;
     }
 
     void disconnect() {
-        if (connected_) {
-#ifdef _WIN32
-            closesocket(socket_);
-#else
-            close(socket_);
-#endif
-            connected_ = false;
+        /* the receive loop polls the socket, so it has to stop before the
+         * descriptor is closed and possibly reused; from the loop itself
+         * (recv() returned 0 or a callback disconnects) it exits on its
+         * own once connected_ is false */
+        if (receivingThreadId_.load() != std::this_thread::get_id()) {
+            stopReceiving();
+        }
+        if (connected_.exchange(false)) {
+            closeSocket();
+            if (onDisconnectedCallback_) {
+                onDisconnectedCallback_();
+            }
         }
     }
 
-    bool send(const std::vector<char>& data) {
+    bool send(std::span<const char> data) {
+        std::array<std::span<const char>, 1> parts{data};
+        return sendParts(parts);
+    }
+
+    bool sendParts(std::span<const std::span<const char>> parts) {
         if (!connected_) {
             errorMessage_ = "Not connected";
             return false;
         }
 
-        if (::send(socket_, data.data(), data.size(), 0) < 0) {
-            errorMessage_ = "Send failed";
-            return false;
+        std::lock_guard<std::mutex> lock(sendMutex_);
+        while (!parts.empty()) {
+            std::array<IoVec, MAX_PARTS> vecs;
+            std::size_t count = 0;
+            for (; count < parts.size() && count < MAX_PARTS; ++count) {
+                setIoVec(vecs[count], parts[count].data(), parts[count].size());
+            }
+            if (!sendAll(vecs.data(), count)) {
+                errorMessage_ = "Send failed";
+                return false;
+            }
+            parts = parts.subspan(count);
         }
-
         return true;
     }
 
-    std::vector<char> receive(
-        size_t size,
-        std::chrono::milliseconds timeout = std::chrono::milliseconds::zero()) {
-        if (timeout > std::chrono::milliseconds::zero()) {
-            struct timeval tv;
-            tv.tv_sec = timeout.count() / 1000;
-            tv.tv_usec = (timeout.count() % 1000) * 1000;
-            setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO,
-                       reinterpret_cast<const char*>(&tv), sizeof(tv));
+    bool sendLengthPrefixed(std::span<const char> payload) {
+        if (payload.size() > MAX_PREFIXED_LENGTH) {
+            errorMessage_ = "Message too large for a 32 bit length prefix";
+            return false;
         }
+        auto header = lengthPrefix(payload.size());
+        std::array<std::span<const char>, 2> parts{header, payload};
+        return sendParts(parts);
+    }
+
+    bool sendDelimited(std::span<const char> payload, char delimiter) {
+        std::array<std::span<const char>, 2> parts{
+            payload, std::span<const char>(&delimiter, 1)};
+        return sendParts(parts);
+    }
 
+    std::vector<char> receive(size_t size,
+                              std::chrono::milliseconds timeout) {
         std::vector<char> data(size);
-        ssize_t bytesRead = ::recv(socket_, data.data(), size, 0);
+        auto bytesRead = receiveRaw(data.data(), size, timeout);
         if (bytesRead < 0) {
             errorMessage_ = "Receive failed";
             return {};
         }
-        data.resize(bytesRead);
+        data.resize(static_cast<std::size_t>(bytesRead));
         return data;
     }
 
+    long long receiveInto(ReceiveBuffer& buffer,
+                          std::chrono::milliseconds timeout) {
+        auto space = buffer.writable();
+        if (space.empty()) {
+            errorMessage_ = "Receive buffer full";
+            return -1;
+        }
+        auto bytesRead = receiveRaw(space.data(), space.size(), timeout);
+        if (bytesRead < 0) {
+            errorMessage_ = "Receive failed";
+            return -1;
+        }
+        buffer.commit(static_cast<std::size_t>(bytesRead));
+        return bytesRead;
+    }
+
+    std::optional<std::string_view> receiveFrame(
+        ReceiveBuffer& buffer, const Framer& framer,
+        std::chrono::milliseconds timeout) {
+        while (true) {
+            if (!buffer.empty()) {
+                auto data = buffer.data();
+                auto frame = framer(data);
+                if (frame.consumed > data.size() ||
+                    frame.offset + frame.length > frame.consumed) {
+                    errorMessage_ = "Invalid frame";
+                    return std::nullopt;
+                }
+                if (frame.consumed > 0) {
+                    /* the bytes stay in place until the next receive */
+                    buffer.consume(frame.consumed);
+                    return data.substr(frame.offset, frame.length);
+                }
+                if (buffer.full()) {
+                    errorMessage_ = "Message larger than receive buffer";
+                    return std::nullopt;
+                }
+            }
+            if (receiveInto(buffer, timeout) <= 0) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    bool setNoDelay(bool enable) {
+        int value = enable ? 1 : 0;
+        return setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY,
+                          reinterpret_cast<const char*>(&value),
+                          sizeof(value)) == 0;
+    }
+
+    bool setCork(bool enable) {
+        int value = enable ? 1 : 0;
+#if defined(TCP_CORK)
+        return setsockopt(socket_, IPPROTO_TCP, TCP_CORK, &value,
+                          sizeof(value)) == 0;
+#elif defined(TCP_NOPUSH)
+        return setsockopt(socket_, IPPROTO_TCP, TCP_NOPUSH, &value,
+                          sizeof(value)) == 0;
+#else
+        (void)value;
+        errorMessage_ = "Corking is not supported";
+        return false;
+#endif
+    }
+
     [[nodiscard]] bool isConnected() const { return connected_; }
 
     [[nodiscard]] std::string getErrorMessage() const { return errorMessage_; }
@@ -156,6 +315,12 @@ public:
         onErrorCallback_ = callback;
     }
 
+    void setOnFrameReceivedCallback(const OnFrameReceivedCallback& callback) {
+        onFrameReceivedCallback_ = callback;
+    }
+
+    void setFramer(Framer framer) { framer_ = std::move(framer); }
+
     void startReceiving(size_t bufferSize) {
         stopReceiving();
         receivingThread_ = std::thread(&Impl::receivingLoop, this, bufferSize);
@@ -170,30 +335,165 @@ public:
     }
 
 private:
-    void receivingLoop(size_t bufferSize) {
-        while (!receivingStopped_) {
-            std::vector<char> data = receive(bufferSize);
-            if (!data.empty() && onDataReceivedCallback_) {
-                onDataReceivedCallback_(data);
+    void closeSocket() {
+        /* a concurrent send() must not write to a closed descriptor */
+        std::lock_guard<std::mutex> lock(sendMutex_);
+        if (socket_ != INVALID_SOCKET_VALUE) {
+#ifdef _WIN32
+            closesocket(socket_);
+#else
+            close(socket_);
+#endif
+            socket_ = INVALID_SOCKET_VALUE;
+        }
+    }
+
+    void setTimeout(int option, std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+        DWORD tv = static_cast<DWORD>(timeout.count());
+#else
+        struct timeval tv;
+        tv.tv_sec = timeout.count() / 1000;
+        tv.tv_usec = (timeout.count() % 1000) * 1000;
+#endif
+        setsockopt(socket_, SOL_SOCKET, option,
+                   reinterpret_cast<const char*>(&tv), sizeof(tv));
+    }
+
+    /* Returns bytes read, 0 on orderly shutdown, -1 on error or timeout. */
+    long long receiveRaw(char* data, std::size_t size,
+                         std::chrono::milliseconds timeout) {
+        /* only touch the socket option when the timeout actually changes */
+        if (timeout > std::chrono::milliseconds::zero() &&
+            timeout != recvTimeout_) {
+            setTimeout(SO_RCVTIMEO, timeout);
+            recvTimeout_ = timeout;
+        }
+        auto bytesRead = ::recv(socket_, data, static_cast<int>(size), 0);
+        return bytesRead < 0 ? -1 : static_cast<long long>(bytesRead);
+    }
+
+    /* Send the whole iovec array, resuming after partial writes. */
+    bool sendAll(IoVec* vecs, std::size_t count) {
+        while (count > 0) {
+#ifdef _WIN32
+            DWORD sent = 0;
+            if (WSASend(socket_, vecs, static_cast<DWORD>(count), &sent, 0,
+                        nullptr, nullptr) != 0) {
+                return false;
+            }
+            std::size_t remaining = sent;
+#else
+            msghdr message{};
+            message.msg_iov = vecs;
+            message.msg_iovlen = count;
+            auto sent = ::sendmsg(socket_, &message, SEND_FLAGS);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            auto remaining = static_cast<std::size_t>(sent);
+#endif
+            while (count > 0 && remaining >= ioVecSize(*vecs)) {
+                remaining -= ioVecSize(*vecs);
+                ++vecs;
+                --count;
+            }
+            if (count > 0) {
+                advanceIoVec(*vecs, remaining);
             }
         }
+        return true;
     }
 
+    /* Wait up to `timeout` for input so the loop notices stopReceiving(). */
+    bool waitReadable(std::chrono::milliseconds timeout) {
 #ifdef _WIN32
-    SOCKET socket_;
+        WSAPOLLFD fd{socket_, POLLRDNORM, 0};
+        return WSAPoll(&fd, 1, static_cast<INT>(timeout.count())) > 0;
 #else
-    int socket_;
+        pollfd fd{socket_, POLLIN, 0};
+        return ::poll(&fd, 1, static_cast<int>(timeout.count())) > 0;
 #endif
-    bool connected_ = false;
+    }
+
+    void receivingLoop(size_t bufferSize) {
+        receivingThreadId_ = std::this_thread::get_id();
+        ReceiveBuffer buffer(bufferSize);
+        std::vector<char> chunk;
+        while (!receivingStopped_ && connected_) {
+            if (!waitReadable(std::chrono::milliseconds(100))) {
+                continue;
+            }
+            auto bytesRead = receiveInto(buffer, recvTimeout_);
+            if (bytesRead <= 0) {
+                if (bytesRead < 0 && onErrorCallback_) {
+                    onErrorCallback_(errorMessage_);
+                }
+                if (bytesRead == 0) {
+                    disconnect();
+                }
+                if (bytesRead < 0 && buffer.full()) {
+                    /* a message that can never fit, drop it and resync */
+                    buffer.clear();
+                }
+                continue;
+            }
+
+            if (!framer_) {
+                if (onDataReceivedCallback_) {
+                    /* reuse one vector so steady traffic doesn't allocate */
+                    auto data = buffer.data();
+                    chunk.assign(data.begin(), data.end());
+                    onDataReceivedCallback_(chunk);
+                }
+                buffer.clear();
+                continue;
+            }
+
+            while (!buffer.empty()) {
+                auto data = buffer.data();
+                auto frame = framer_(data);
+                if (frame.consumed == 0) {
+                    break;
+                }
+                if (frame.consumed > data.size() ||
+                    frame.offset + frame.length > frame.consumed) {
+                    errorMessage_ = "Invalid frame";
+                    if (onErrorCallback_) {
+                        onErrorCallback_(errorMessage_);
+                    }
+                    buffer.clear();
+                    break;
+                }
+                if (onFrameReceivedCallback_) {
+                    onFrameReceivedCallback_(
+                        data.substr(frame.offset, frame.length));
+                }
+                buffer.consume(frame.consumed);
+            }
+        }
+    }
+
+    SocketType socket_ = INVALID_SOCKET_VALUE;
+    std::atomic<bool> connected_ = false;
     std::string errorMessage_;
+    std::chrono::milliseconds recvTimeout_{0};
+    std::mutex sendMutex_;
 
     OnConnectedCallback onConnectedCallback_;
     OnDisconnectedCallback onDisconnectedCallback_;
     OnDataReceivedCallback onDataReceivedCallback_;
     OnErrorCallback onErrorCallback_;
+    OnFrameReceivedCallback onFrameReceivedCallback_;
+    Framer framer_;
 
     std::thread receivingThread_;
-    bool receivingStopped_ = false;
+    std::atomic<bool> receivingStopped_ = false;
+    /* set by the loop itself, receivingThread_ may not be assigned yet */
+    std::atomic<std::thread::id> receivingThreadId_;
 };
 
 TcpClient::TcpClient() : impl_(std::make_unique<Impl>()) {}
@@ -211,11 +511,40 @@ bool TcpClient::send(const std::vector<char>& data) {
     return impl_->send(data);
 }
 
+bool TcpClient::send(std::span<const char> data) { return impl_->send(data); }
+
+bool TcpClient::sendParts(std::span<const std::span<const char>> parts) {
+    return impl_->sendParts(parts);
+}
+
+bool TcpClient::sendLengthPrefixed(std::span<const char> payload) {
+    return impl_->sendLengthPrefixed(payload);
+}
+
+bool TcpClient::sendDelimited(std::span<const char> payload, char delimiter) {
+    return impl_->sendDelimited(payload, delimiter);
+}
+
 std::vector<char> TcpClient::receive(size_t size,
                                      std::chrono::milliseconds timeout) {
     return impl_->receive(size, timeout);
 }
 
+long long TcpClient::receiveInto(ReceiveBuffer& buffer,
+                                 std::chrono::milliseconds timeout) {
+    return impl_->receiveInto(buffer, timeout);
+}
+
+std::optional<std::string_view> TcpClient::receiveFrame(
+    ReceiveBuffer& buffer, const Framer& framer,
+    std::chrono::milliseconds timeout) {
+    return impl_->receiveFrame(buffer, framer, timeout);
+}
+
+bool TcpClient::setNoDelay(bool enable) { return impl_->setNoDelay(enable); }
+
+bool TcpClient::setCork(bool enable) { return impl_->setCork(enable); }
+
 bool TcpClient::isConnected() const { return impl_->isConnected(); }
 
 std::string TcpClient::getErrorMessage() const {
@@ -240,6 +569,15 @@ void TcpClient::setOnErrorCallback(const OnErrorCallback& callback) {
     impl_->setOnErrorCallback(callback);
 }
 
+void TcpClient::setOnFrameReceivedCallback(
+    const OnFrameReceivedCallback& callback) {
+    impl_->setOnFrameReceivedCallback(callback);
+}
+
+void TcpClient::setFramer(Framer framer) {
+    impl_->setFramer(std::move(framer));
+}
+
 void TcpClient::startReceiving(size_t bufferSize) {
     impl_->startReceiving(bufferSize);
 }
@@ -18,16 +18,26 @@ Description: TCP Client Class
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "atom/type/noncopyable.hpp"
+#include "framing.hpp"
 
 namespace atom::connection {
 /**
  * @class TcpClient
  * @brief Represents a TCP client for connecting to a server and
  * sending/receiving data.
+ *
+ * Besides the simple vector based calls, the client offers an allocation
+ * free path for small, latency sensitive protocols: sendParts() hands
+ * several buffers (e.g. header and payload) to the kernel in one
+ * writev/sendmsg call without concatenating them, and receiveFrame() cuts
+ * messages out of a caller-owned ReceiveBuffer with a Framer.
  */
 class TcpClient : public NonCopyable {
 public:
@@ -43,6 +53,10 @@ public:
     using OnErrorCallback =
         std::function<void(const std::string&)>; /**< Type definition for error
                                                     callback function. */
+    using OnFrameReceivedCallback = std::function<void(
+        std::string_view)>; /**< Type definition for frame received callback
+                               function, the view is only valid during the
+                               call. */
 
     /**
      * @brief Constructor.
@@ -77,6 +91,32 @@ public:
      */
     bool send(const std::vector<char>& data);
 
+    /**
+     * @brief Sends data to the server without copying it.
+     * @param data The data to be sent.
+     * @return True if all data is sent, false otherwise.
+     */
+    bool send(std::span<const char> data);
+
+    /**
+     * @brief Sends several buffers as one contiguous stream with a single
+     * scatter/gather system call (writev/sendmsg, WSASend on Windows).
+     * @param parts The buffers, sent in order.
+     * @return True if all data is sent, false otherwise.
+     */
+    bool sendParts(std::span<const std::span<const char>> parts);
+
+    /**
+     * @brief Sends a message with the 32 bit big-endian length header
+     * expected by lengthPrefixFramer().
+     */
+    bool sendLengthPrefixed(std::span<const char> payload);
+
+    /**
+     * @brief Sends a message followed by a delimiter, see lineFramer().
+     */
+    bool sendDelimited(std::span<const char> payload, char delimiter = '\n');
+
     /**
      * @brief Receives data from the server.
      * @param size The number of bytes to receive.
@@ -87,6 +127,46 @@ public:
         size_t size,
         std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
 
+    /**
+     * @brief Receives whatever is available into the free space of a
+     * caller-owned buffer.
+     * @param buffer The receive buffer.
+     * @param timeout The receive timeout duration.
+     * @return The number of bytes received, 0 if the server closed the
+     * connection, -1 on error or timeout.
+     */
+    long long receiveInto(
+        ReceiveBuffer& buffer,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
+
+    /**
+     * @brief Receives the next complete message.
+     *
+     * Messages already in the buffer are returned without touching the
+     * socket. The returned view points into the buffer and stays valid
+     * until the buffer is used again.
+     * @param buffer The receive buffer, keeps partial messages between calls.
+     * @param framer Finds message boundaries.
+     * @param timeout The timeout for each receive.
+     * @return The message, or nullopt on error, timeout or disconnect.
+     */
+    std::optional<std::string_view> receiveFrame(
+        ReceiveBuffer& buffer, const Framer& framer,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
+
+    /**
+     * @brief Enables or disables Nagle's algorithm (TCP_NODELAY).
+     * @return True if the option was applied.
+     */
+    bool setNoDelay(bool enable);
+
+    /**
+     * @brief Holds back partial segments until uncorked (TCP_CORK on Linux,
+     * TCP_NOPUSH on BSD and macOS), to coalesce a burst of small sends.
+     * @return True if the option was applied, false if unsupported.
+     */
+    bool setCork(bool enable);
+
     /**
      * @brief Checks if the client is connected to the server.
      * @return True if connected, false otherwise.
@@ -126,8 +206,26 @@ public:
      */
     void setOnErrorCallback(const OnErrorCallback& callback);
 
+    /**
+     * @brief Sets the callback function to be called for every message when
+     * a framer is set.
+     * @param callback The callback function.
+     */
+    void setOnFrameReceivedCallback(const OnFrameReceivedCallback& callback);
+
+    /**
+     * @brief Sets the framer used by startReceiving(). Without a framer every
+     * read is passed to the data received callback as is.
+     * @param framer The framer, empty to disable framing.
+     */
+    void setFramer(Framer framer);
+
     /**
      * @brief Starts receiving data from the server.
+     *
+     * One receive buffer of `bufferSize` bytes is allocated here and reused
+     * for every read; with a framer it must be large enough for the largest
+     * message.
      * @param bufferSize The size of the receive buffer.
      */
     void startReceiving(size_t bufferSize);
@@ -13,11 +13,14 @@ Description: A simple UDP server.
 *************************************************/
 
 #include "udp_server.hpp"
-#include "atom/log/loguru.hpp"
+
+#include "reactor.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <future>
 #include <mutex>
-#include <thread>
+#include <vector>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -27,13 +30,28 @@ Description: A simple UDP server.
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
-#include <unistd.h>
 #endif
 
+#include "atom/log/loguru.hpp"
+
 namespace atom::connection {
-class UdpSocketHub::Impl {
+namespace {
+/* Largest possible UDP payload. */
+constexpr std::size_t MAX_DATAGRAM = 65536;
+}  // namespace
+
+class UdpSocketHub::Impl : public std::enable_shared_from_this<Impl> {
 public:
-    Impl() : running_(false), socket_(INVALID_SOCKET) {}
+    Impl(Options options, std::shared_ptr<Reactor> reactor)
+        : options_(options),
+          reactor_(std::move(reactor)),
+          ownsReactor_(!reactor_),
+          handlers_(std::make_shared<Handlers>()),
+          buffer_(MAX_DATAGRAM) {
+        if (ownsReactor_) {
+            reactor_ = std::make_shared<Reactor>();
+        }
+    }
 
     ~Impl() { stop(); }
 
@@ -48,7 +66,7 @@ public:
         }
 
         socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-        if (socket_ == INVALID_SOCKET) {
+        if (socket_ == INVALID_NATIVE_SOCKET) {
             LOG_F(ERROR, "Failed to create socket.");
             cleanupNetworking();
             return;
@@ -56,48 +74,73 @@ public:
 
         sockaddr_in serverAddr{};
         serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(port);
+        serverAddr.sin_port = htons(static_cast<std::uint16_t>(port));
         serverAddr.sin_addr.s_addr = INADDR_ANY;
 
         if (bind(socket_, reinterpret_cast<sockaddr*>(&serverAddr),
-                 sizeof(serverAddr)) == SOCKET_ERROR) {
+                 sizeof(serverAddr)) != 0 ||
+            !setNonBlocking(socket_)) {
             LOG_F(ERROR, "Bind failed with error.");
             closeSocket();
             cleanupNetworking();
             return;
         }
 
+        socklen_t length = sizeof(serverAddr);
+        getsockname(socket_, reinterpret_cast<sockaddr*>(&serverAddr),
+                    &length);
+        port_ = ntohs(serverAddr.sin_port);
+
+        pool_ = std::make_unique<WorkerPool>(options_.workerThreads,
+                                             options_.queueCapacity);
         running_.store(true);
-        receiverThread_ = std::jthread([this] { receiveMessages(); });
+        reactor_->add(socket_, Reactor::READABLE,
+                      [weak = weak_from_this()](std::uint32_t) {
+                          if (auto self = weak.lock()) {
+                              self->receiveMessages();
+                          }
+                      });
+        if (ownsReactor_) {
+            reactor_->start();
+        }
     }
 
     void stop() {
-        if (!running_.load()) {
+        if (!running_.exchange(false)) {
             return;
         }
 
-        running_.store(false);
+        reactor_->remove(socket_);
+        if (ownsReactor_) {
+            reactor_->stop();
+        } else if (reactor_->isRunning() && !reactor_->isInLoopThread()) {
+            /* wait for a receive that may still be using the socket */
+            std::promise<void> done;
+            reactor_->post([&done] { done.set_value(); });
+            done.get_future().wait();
+        }
         closeSocket();
+        pool_->stop();
         cleanupNetworking();
-
-        if (receiverThread_.joinable()) {
-            receiverThread_.join();
-        }
     }
 
     bool isRunning() const { return running_.load(); }
 
-    void addMessageHandler(MessageHandler handler) {
+    HandlerId addMessageHandler(MessageHandler handler) {
         std::scoped_lock lock(handlersMutex_);
-        handlers_.push_back(std::move(handler));
+        auto handlers = std::make_shared<Handlers>(*handlers_);
+        auto id = nextHandlerId_++;
+        handlers->emplace_back(id, std::move(handler));
+        handlers_ = std::move(handlers);
+        return id;
     }
 
-    void removeMessageHandler(MessageHandler handler) {
+    void removeMessageHandler(HandlerId id) {
         std::scoped_lock lock(handlersMutex_);
-        auto it = std::find(handlers_.begin(), handlers_.end(), handler);
-        if (it != handlers_.end()) {
-            handlers_.erase(it);
-        }
+        auto handlers = std::make_shared<Handlers>(*handlers_);
+        std::erase_if(*handlers,
+                      [id](const auto& entry) { return entry.first == id; });
+        handlers_ = std::move(handlers);
     }
 
     void sendTo(const std::string& message, const std::string& ip, int port) {
@@ -108,17 +151,26 @@ public:
 
         sockaddr_in targetAddr{};
         targetAddr.sin_family = AF_INET;
-        targetAddr.sin_port = htons(port);
-        inet_pton(AF_INET, ip.c_str(), &targetAddr.sin_addr);
+        targetAddr.sin_port = htons(static_cast<std::uint16_t>(port));
+        if (inet_pton(AF_INET, ip.c_str(), &targetAddr.sin_addr) != 1) {
+            LOG_F(ERROR, "Invalid address: {}", ip);
+            return;
+        }
 
-        if (sendto(socket_, message.data(), message.size(), 0,
-                   reinterpret_cast<sockaddr*>(&targetAddr),
-                   sizeof(targetAddr)) == SOCKET_ERROR) {
+        if (sendto(socket_, message.data(), static_cast<int>(message.size()),
+                   0, reinterpret_cast<sockaddr*>(&targetAddr),
+                   sizeof(targetAddr)) < 0) {
             LOG_F(ERROR, "Failed to send message.");
         }
     }
 
+    int getPort() const { return port_; }
+
+    std::uint64_t droppedMessages() const { return dropped_.load(); }
+
 private:
+    using Handlers = std::vector<std::pair<HandlerId, MessageHandler>>;
+
     bool initNetworking() {
 #ifdef _WIN32
         WSADATA wsaData;
@@ -135,49 +187,85 @@ private:
     }
 
     void closeSocket() {
-#ifdef _WIN32
-        closesocket(socket_);
-#else
-        close(socket_);
-#endif
-        socket_ = INVALID_SOCKET;
+        if (socket_ != INVALID_NATIVE_SOCKET) {
+            closeNativeSocket(socket_);
+            socket_ = INVALID_NATIVE_SOCKET;
+        }
     }
 
+    /* Runs on the loop thread: drain every queued datagram. */
     void receiveMessages() {
-        char buffer[1024];
-        sockaddr_in clientAddr{};
-        socklen_t clientAddrSize = sizeof(clientAddr);
+        std::shared_ptr<const Handlers> current;
+        {
+            std::scoped_lock lock(handlersMutex_);
+            current = handlers_;
+        }
 
-        while (running_.load()) {
+        /* bounded so a flood can't starve other sockets on the loop */
+        for (int i = 0; i < 256; ++i) {
+            sockaddr_in clientAddr{};
+            socklen_t clientAddrSize = sizeof(clientAddr);
             const auto bytesReceived = recvfrom(
-                socket_, buffer, sizeof(buffer), 0,
+                socket_, buffer_.data(), static_cast<int>(buffer_.size()), 0,
                 reinterpret_cast<sockaddr*>(&clientAddr), &clientAddrSize);
-            if (bytesReceived == SOCKET_ERROR) {
-                LOG_F(ERROR, "recvfrom failed with error.");
+            if (bytesReceived < 0) {
+                if (!lastErrorWouldBlock()) {
+                    LOG_F(ERROR, "recvfrom failed with error.");
+                }
+                return;
+            }
+            if (current->empty()) {
                 continue;
             }
 
-            std::string message(buffer, bytesReceived);
-            std::string clientIp = inet_ntoa(clientAddr.sin_addr);
-            int clientPort = ntohs(clientAddr.sin_port);
-
-            std::scoped_lock lock(handlersMutex_);
-            for (const auto& handler : handlers_) {
-                handler(message, clientIp, clientPort);
+            /* same sender, same worker: datagrams keep their order */
+            auto key = (static_cast<std::size_t>(clientAddr.sin_addr.s_addr)
+                        << 16) ^
+                       clientAddr.sin_port;
+            auto task = [current, addr = clientAddr,
+                         message = std::string(
+                             buffer_.data(),
+                             static_cast<std::size_t>(bytesReceived))] {
+                char ip[INET_ADDRSTRLEN] = {};
+                inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+                int port = ntohs(addr.sin_port);
+                for (const auto& [id, handler] : *current) {
+                    handler(message, ip, port);
+                }
+            };
+            if (!pool_->tryPost(key, std::move(task))) {
+                if (dropped_.fetch_add(1) % 1000 == 0) {
+                    LOG_F(WARNING, "UdpSocketHub is overloaded, dropping "
+                                   "datagrams.");
+                }
             }
         }
     }
 
-    std::atomic<bool> running_;
-    SOCKET socket_;
-    std::jthread receiverThread_;
-    std::vector<MessageHandler> handlers_;
+    Options options_;
+    std::shared_ptr<Reactor> reactor_;
+    bool ownsReactor_;
+    std::unique_ptr<WorkerPool> pool_;
+
+    std::atomic<bool> running_{false};
+    NativeSocket socket_ = INVALID_NATIVE_SOCKET;
+    int port_ = 0;
+    std::atomic<std::uint64_t> dropped_{0};
+
     std::mutex handlersMutex_;
+    std::shared_ptr<const Handlers> handlers_;
+    HandlerId nextHandlerId_ = 1;
+
+    /* loop thread only */
+    std::vector<char> buffer_;
 };
 
-UdpSocketHub::UdpSocketHub() : impl_(std::make_unique<Impl>()) {}
+UdpSocketHub::UdpSocketHub() : UdpSocketHub(Options()) {}
 
-UdpSocketHub::~UdpSocketHub() = default;
+UdpSocketHub::UdpSocketHub(Options options, std::shared_ptr<Reactor> reactor)
+    : impl_(std::make_shared<Impl>(options, std::move(reactor))) {}
+
+UdpSocketHub::~UdpSocketHub() { impl_->stop(); }
 
 void UdpSocketHub::start(int port) { impl_->start(port); }
 
@@ -185,16 +273,23 @@ void UdpSocketHub::stop() { impl_->stop(); }
 
 bool UdpSocketHub::isRunning() const { return impl_->isRunning(); }
 
-void UdpSocketHub::addMessageHandler(MessageHandler handler) {
-    impl_->addMessageHandler(std::move(handler));
+UdpSocketHub::HandlerId UdpSocketHub::addMessageHandler(
+    MessageHandler handler) {
+    return impl_->addMessageHandler(std::move(handler));
 }
 
-void UdpSocketHub::removeMessageHandler(MessageHandler handler) {
-    impl_->removeMessageHandler(std::move(handler));
+void UdpSocketHub::removeMessageHandler(HandlerId id) {
+    impl_->removeMessageHandler(id);
 }
 
 void UdpSocketHub::sendTo(const std::string& message, const std::string& ip,
                           int port) {
     impl_->sendTo(message, ip, port);
 }
+
+int UdpSocketHub::getPort() const { return impl_->getPort(); }
+
+std::uint64_t UdpSocketHub::droppedMessages() const {
+    return impl_->droppedMessages();
+}
 }  // namespace atom::connection
@@ -15,16 +15,23 @@ Description: A simple UDP server.
 #ifndef ATOM_CONNECTION_UDP_HPP
 #define ATOM_CONNECTION_UDP_HPP
 
-#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
-#include <vector>
 
 namespace atom::connection {
+class Reactor;
+
 /**
  * @class UdpSocketHub
  * @brief Represents a hub for managing UDP sockets and message handling.
+ *
+ * The socket is non-blocking and served by an event loop (epoll on Linux);
+ * each readiness drains all queued datagrams into one reusable buffer.
+ * Handlers run on a bounded worker pool, datagrams from the same sender are
+ * handled in order, and datagrams arriving while the pool is full are
+ * dropped and counted rather than queued without limit.
  */
 class UdpSocketHub {
 public:
@@ -37,11 +44,27 @@ public:
     using MessageHandler =
         std::function<void(const std::string&, const std::string&, int)>;
 
+    using HandlerId = std::uint64_t;
+
+    struct Options {
+        std::size_t workerThreads = 2;
+        /** Pending datagrams per worker before new ones are dropped. */
+        std::size_t queueCapacity = 4096;
+    };
+
     /**
      * @brief Constructor.
      */
     UdpSocketHub();
 
+    /**
+     * @param options Pool sizes.
+     * @param reactor Event loop to share with other hubs. The caller runs
+     * it; when null the hub creates and runs its own.
+     */
+    explicit UdpSocketHub(Options options,
+                          std::shared_ptr<Reactor> reactor = nullptr);
+
     /**
      * @brief Destructor.
      */
@@ -55,7 +78,7 @@ public:
     /**
      * @brief Starts the UDP socket hub and binds it to the specified port.
      * @param port The port on which the UDP socket hub will listen for incoming
-     * messages.
+     * messages, 0 for any free port.
      */
     void start(int port);
 
@@ -73,14 +96,15 @@ public:
     /**
      * @brief Adds a message handler function to the UDP socket hub.
      * @param handler The message handler function to add.
+     * @return An id for removeMessageHandler().
      */
-    void addMessageHandler(MessageHandler handler);
+    HandlerId addMessageHandler(MessageHandler handler);
 
     /**
      * @brief Removes a message handler function from the UDP socket hub.
-     * @param handler The message handler function to remove.
+     * @param id The id returned by addMessageHandler().
      */
-    void removeMessageHandler(MessageHandler handler);
+    void removeMessageHandler(HandlerId id);
 
     /**
      * @brief Sends a message to the specified IP address and port.
@@ -90,9 +114,19 @@ public:
      */
     void sendTo(const std::string& message, const std::string& ip, int port);
 
+    /**
+     * @brief The port actually bound, useful after start(0).
+     */
+    int getPort() const;
+
+    /**
+     * @brief Datagrams dropped because the workers were full.
+     */
+    std::uint64_t droppedMessages() const;
+
 private:
     class Impl; /**< Forward declaration of the implementation class. */
-    std::unique_ptr<Impl> impl_; /**< Pointer to the implementation object. */
+    std::shared_ptr<Impl> impl_; /**< Pointer to the implementation object. */
 };
 }  // namespace atom::connection
 
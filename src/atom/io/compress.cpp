@@ -14,6 +14,7 @@ Description: Compressor using ZLib
 
 #include "compress.hpp"
 #include "io.hpp"
+#include "ziparchive.hpp"
 
 #include <minizip-ng/mz_compat.h>
 #include <minizip-ng/mz_strm.h>
@@ -390,89 +391,42 @@ bool file_exists_in_zip(const std::string &zip_file,
 
 bool remove_file_from_zip(const std::string &zip_file,
                           const std::string &file_name) {
-    void *zip_reader = unzOpen(zip_file.c_str());
-    if (zip_reader == nullptr) {
+    ZipArchive archive;
+    if (!archive.open(zip_file)) {
         LOG_F(ERROR, "Failed to open ZIP file: {}", zip_file);
         return false;
     }
 
-    if (unzLocateFile(zip_reader, file_name.c_str(), 0) != UNZ_OK) {
+    if (!archive.contains(file_name)) {
         LOG_F(ERROR, "File not found in ZIP: {}", file_name);
-        unzClose(zip_reader);
         return false;
     }
 
-    // This is a simplified method that recreates the ZIP file without the
-    // specified file.
-    std::string temp_zip_file = zip_file + ".tmp";
-    void *zip_writer = zipOpen(temp_zip_file.c_str(), APPEND_STATUS_CREATE);
+    // Only the central directory is rewritten, the entry data stays in place
+    // until compact_zip() is called.
+    return archive.remove(file_name);
+}
 
-    if (zip_writer == nullptr) {
-        LOG_F(ERROR, "Failed to create temporary ZIP file: {}", temp_zip_file);
-        unzClose(zip_reader);
+bool add_file_to_zip(const std::string &zip_file, const std::string &file_path,
+                     const std::string &entry_name, int compression_level) {
+    ZipArchive archive;
+    if (!archive.open(zip_file, true)) {
+        LOG_F(ERROR, "Failed to open ZIP file: {}", zip_file);
         return false;
     }
+    const std::string name = entry_name.empty()
+                                 ? fs::path(file_path).filename().string()
+                                 : entry_name;
+    return archive.appendFile(name, file_path, compression_level);
+}
 
-    if (unzGoToFirstFile(zip_reader) != UNZ_OK) {
-        LOG_F(ERROR, "Failed to read first file in ZIP: {}", zip_file);
-        unzClose(zip_reader);
-        zipClose(zip_writer, nullptr);
+bool compact_zip(const std::string &zip_file) {
+    ZipArchive archive;
+    if (!archive.open(zip_file)) {
+        LOG_F(ERROR, "Failed to open ZIP file: {}", zip_file);
         return false;
     }
-
-    do {
-        char filename[256];
-        unz_file_info file_info;
-        if (unzGetCurrentFileInfo(zip_reader, &file_info, filename,
-                                  sizeof(filename), nullptr, 0, nullptr,
-                                  0) != UNZ_OK) {
-            LOG_F(ERROR, "Failed to get file info in ZIP: {}", zip_file);
-            unzClose(zip_reader);
-            zipClose(zip_writer, nullptr);
-            return false;
-        }
-
-        if (file_name == filename) {
-            continue;
-        }
-
-        if (unzOpenCurrentFile(zip_reader) != UNZ_OK) {
-            LOG_F(ERROR, "Failed to open file in ZIP: {}", filename);
-            unzClose(zip_reader);
-            zipClose(zip_writer, nullptr);
-            return false;
-        }
-
-        zip_fileinfo file_info_out = {};
-        if (zipOpenNewFileInZip(zip_writer, filename, &file_info_out, nullptr,
-                                0, nullptr, 0, nullptr, Z_DEFLATED,
-                                Z_DEFAULT_COMPRESSION) != ZIP_OK) {
-            LOG_F(ERROR, "Failed to add file to temporary ZIP: {}", filename);
-            unzCloseCurrentFile(zip_reader);
-            unzClose(zip_reader);
-            zipClose(zip_writer, nullptr);
-            return false;
-        }
-
-        char buffer[8192];
-        int read_size = 0;
-        while ((read_size = unzReadCurrentFile(zip_reader, buffer,
-                                               sizeof(buffer))) > 0) {
-            zipWriteInFileInZip(zip_writer, buffer, read_size);
-        }
-
-        unzCloseCurrentFile(zip_reader);
-        zipCloseFileInZip(zip_writer);
-    } while (unzGoToNextFile(zip_reader) != UNZ_END_OF_LIST_OF_FILE);
-
-    unzClose(zip_reader);
-    zipClose(zip_writer, nullptr);
-
-    // Replace original ZIP file with the new one
-    fs::remove(zip_file);
-    fs::rename(temp_zip_file, zip_file);
-
-    return true;
+    return archive.compact();
 }
 
 size_t get_zip_file_size(const std::string &zip_file) {
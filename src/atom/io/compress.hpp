@@ -139,13 +139,39 @@ bool file_exists_in_zip(const std::string &zip_file,
  * @param file_name 文件名
  * @return 是否删除成功
  *
- * 该函数用于从ZIP文件中删除指定的文件。
+ * 该函数用于从ZIP文件中删除指定的文件。只会重写中央目录，被删除文件的数据
+ * 仍然留在归档中，直到调用compact_zip。
  *
  * @note 如果指定的ZIP文件不存在，则函数将返回false。
  */
 bool remove_file_from_zip(const std::string &zip_file,
                           const std::string &file_name);
 
+/**
+ * @brief 向ZIP文件追加一个文件
+ * @param zip_file ZIP文件名（包含路径）
+ * @param file_path 待追加的文件
+ * @param entry_name ZIP中的条目名称，为空时使用文件名
+ * @param compression_level 压缩级别（可选，默认为-1，表示使用默认级别）
+ * @return 是否追加成功
+ *
+ * 该函数只写入新的本地条目并重写中央目录，不会复制已有数据。
+ *
+ * @note 如果指定的ZIP文件不存在，则会创建一个新的ZIP文件。
+ */
+bool add_file_to_zip(const std::string &zip_file, const std::string &file_path,
+                     const std::string &entry_name = "",
+                     int compression_level = -1);
+
+/**
+ * @brief 压缩ZIP文件，回收被删除文件占用的空间
+ * @param zip_file ZIP文件名（包含路径）
+ * @return 是否成功
+ *
+ * 该函数会重写整个ZIP文件，但不会重新压缩其中的数据。
+ */
+bool compact_zip(const std::string &zip_file);
+
 /**
  * @brief 获取ZIP文件中的文件大小
  * @param zip_file ZIP文件名（包含路径）
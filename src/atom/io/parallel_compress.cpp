@@ -0,0 +1,533 @@
+/*
+ * parallel_compress.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-12
+
+Description: Parallel block compressor (gzip compatible, optional zstd)
+
+**************************************************/
+
+#include "parallel_compress.hpp"
+
+#include <minizip-ng/mz_compat.h>
+#include <minizip-ng/zip.h>
+#include <zlib.h>
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <thread>
+
+// ATOM_ENABLE_ZSTD 只由构建系统在链接 zstd 时定义
+#ifdef ATOM_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "atom/async/pool.hpp"
+#include "atom/error/exception.hpp"
+#include "atom/log/loguru.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::size_t STREAM_CHUNK = 1 << 16;
+constexpr std::array<unsigned char, 10> GZIP_HEADER = {
+    0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 0xff};
+
+void writeLE32(std::ostream &out, std::uint32_t value) {
+    std::array<char, 4> bytes = {
+        static_cast<char>(value & 0xff), static_cast<char>((value >> 8) & 0xff),
+        static_cast<char>((value >> 16) & 0xff),
+        static_cast<char>((value >> 24) & 0xff)};
+    out.write(bytes.data(), bytes.size());
+}
+
+std::vector<unsigned char> deflateRaw(std::span<const unsigned char> input,
+                                      int level, bool last) {
+    z_stream zs{};
+    if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        THROW_RUNTIME_ERROR("deflateInit2 failed");
+    }
+    std::vector<unsigned char> out(deflateBound(&zs, input.size()) + 64);
+    zs.next_in = const_cast<Bytef *>(input.data());
+    zs.avail_in = static_cast<uInt>(input.size());
+
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    std::size_t produced = 0;
+    while (true) {
+        if (produced == out.size()) {
+            out.resize(out.size() * 2);
+        }
+        zs.next_out = out.data() + produced;
+        zs.avail_out = static_cast<uInt>(out.size() - produced);
+        int ret = deflate(&zs, flush);
+        produced = out.size() - zs.avail_out;
+        if (ret == Z_STREAM_ERROR) {
+            deflateEnd(&zs);
+            THROW_RUNTIME_ERROR("deflate failed");
+        }
+        if (last ? ret == Z_STREAM_END : zs.avail_out != 0) {
+            break;
+        }
+    }
+    deflateEnd(&zs);
+    out.resize(produced);
+    return out;
+}
+
+#ifdef ATOM_ENABLE_ZSTD
+std::vector<unsigned char> compressZstdFrame(
+    std::span<const unsigned char> input, int level) {
+    std::vector<unsigned char> out(ZSTD_compressBound(input.size()));
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                           level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    std::size_t size = ZSTD_compress2(cctx, out.data(), out.size(),
+                                      input.data(), input.size());
+    ZSTD_freeCCtx(cctx);
+    if (ZSTD_isError(size)) {
+        THROW_RUNTIME_ERROR("ZSTD_compress2 failed: ", ZSTD_getErrorName(size));
+    }
+    out.resize(size);
+    return out;
+}
+#endif
+
+struct ZipFileTask {
+    fs::path path;
+    std::string name;
+    std::uintmax_t size;
+};
+}  // namespace
+
+namespace atom::io {
+
+bool is_zstd_available() {
+#ifdef ATOM_ENABLE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+ParallelCompressor::ParallelCompressor(ParallelCompressOptions options)
+    : m_options(options) {
+    if (m_options.threads == 0) {
+        m_options.threads =
+            std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    if (m_options.maxInFlight == 0) {
+        m_options.maxInFlight = m_options.threads * 2;
+    }
+    m_options.blockSize = std::clamp<std::size_t>(m_options.blockSize, 32768,
+                                                  std::size_t{UINT_MAX} / 2);
+    if (m_options.backend == CompressionBackend::ZSTD &&
+        !is_zstd_available()) {
+        LOG_F(WARNING, "zstd is not available, falling back to gzip");
+        m_options.backend = CompressionBackend::GZIP;
+    }
+    m_pool = std::make_unique<atom::async::ThreadPool>(m_options.threads);
+}
+
+ParallelCompressor::~ParallelCompressor() = default;
+
+CompressedBlock ParallelCompressor::compressBlock(
+    std::span<const unsigned char> input, bool last) const {
+    CompressedBlock block;
+    block.rawSize = input.size();
+#ifdef ATOM_ENABLE_ZSTD
+    if (m_options.backend == CompressionBackend::ZSTD) {
+        block.data = compressZstdFrame(input, m_options.level);
+        return block;
+    }
+#endif
+    block.crc = static_cast<std::uint32_t>(
+        crc32(0L, input.data(), static_cast<uInt>(input.size())));
+    block.data = deflateRaw(input, m_options.level, last);
+    return block;
+}
+
+bool ParallelCompressor::compressBlocks(
+    std::istream &in, const std::function<bool(const CompressedBlock &)> &sink,
+    std::uint32_t &crc, std::uint64_t &total) {
+    std::deque<std::future<CompressedBlock>> pending;
+    auto drainOne = [&]() {
+        try {
+            auto block = pending.front().get();
+            pending.pop_front();
+            crc = static_cast<std::uint32_t>(crc32_combine(
+                crc, block.crc, static_cast<z_off_t>(block.rawSize)));
+            total += block.rawSize;
+            return sink(block);
+        } catch (const std::exception &e) {
+            LOG_F(ERROR, "Failed to compress block: {}", e.what());
+            return false;
+        }
+    };
+
+    while (true) {
+        auto buffer = std::make_shared<std::vector<unsigned char>>(
+            m_options.blockSize);
+        in.read(reinterpret_cast<char *>(buffer->data()),
+                static_cast<std::streamsize>(buffer->size()));
+        if (in.bad()) {
+            LOG_F(ERROR, "Failed to read input stream");
+            return false;
+        }
+        buffer->resize(static_cast<std::size_t>(in.gcount()));
+        const bool last =
+            in.eof() || in.peek() == std::char_traits<char>::eof();
+        pending.push_back(m_pool->enqueue([this, buffer, last] {
+            return compressBlock(*buffer, last);
+        }));
+        if (pending.size() >= m_options.maxInFlight && !drainOne()) {
+            return false;
+        }
+        if (last) {
+            break;
+        }
+    }
+    while (!pending.empty()) {
+        if (!drainOne()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParallelCompressor::compressStream(std::istream &in, std::ostream &out) {
+    const bool gzip = m_options.backend == CompressionBackend::GZIP;
+    if (gzip) {
+        out.write(reinterpret_cast<const char *>(GZIP_HEADER.data()),
+                  GZIP_HEADER.size());
+    }
+    std::uint32_t crc = 0;
+    std::uint64_t total = 0;
+    bool ok = compressBlocks(
+        in,
+        [&out](const CompressedBlock &block) {
+            out.write(reinterpret_cast<const char *>(block.data.data()),
+                      static_cast<std::streamsize>(block.data.size()));
+            return static_cast<bool>(out);
+        },
+        crc, total);
+    if (!ok) {
+        return false;
+    }
+    if (gzip) {
+        writeLE32(out, crc);
+        writeLE32(out, static_cast<std::uint32_t>(total & 0xffffffffU));
+    }
+    out.flush();
+    if (!out) {
+        LOG_F(ERROR, "Failed to write compressed stream");
+        return false;
+    }
+    return true;
+}
+
+bool ParallelCompressor::inflateStream(std::istream &in, std::ostream &out) {
+    z_stream zs{};
+    if (inflateInit2(&zs, MAX_WBITS + 16) != Z_OK) {
+        LOG_F(ERROR, "inflateInit2 failed");
+        return false;
+    }
+    std::vector<unsigned char> inBuf(STREAM_CHUNK);
+    std::vector<unsigned char> outBuf(STREAM_CHUNK);
+    while (true) {
+        in.read(reinterpret_cast<char *>(inBuf.data()),
+                static_cast<std::streamsize>(inBuf.size()));
+        zs.avail_in = static_cast<uInt>(in.gcount());
+        zs.next_in = inBuf.data();
+        if (zs.avail_in == 0) {
+            break;
+        }
+        do {
+            zs.next_out = outBuf.data();
+            zs.avail_out = static_cast<uInt>(outBuf.size());
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_BUF_ERROR) {
+                break;
+            }
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                LOG_F(ERROR, "Failed to inflate stream: {}",
+                      zs.msg != nullptr ? zs.msg : "unknown error");
+                inflateEnd(&zs);
+                return false;
+            }
+            out.write(
+                reinterpret_cast<const char *>(outBuf.data()),
+                static_cast<std::streamsize>(outBuf.size() - zs.avail_out));
+            if (ret == Z_STREAM_END) {
+                // 处理多个gzip成员首尾相接的情况
+                inflateReset(&zs);
+            }
+        } while (zs.avail_in > 0 || zs.avail_out == 0);
+    }
+    inflateEnd(&zs);
+    return static_cast<bool>(out);
+}
+
+bool ParallelCompressor::zstdDecompressStream(std::istream &in,
+                                              std::ostream &out) {
+#ifdef ATOM_ENABLE_ZSTD
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    std::vector<char> inBuf(ZSTD_DStreamInSize());
+    std::vector<char> outBuf(ZSTD_DStreamOutSize());
+    while (true) {
+        in.read(inBuf.data(), static_cast<std::streamsize>(inBuf.size()));
+        auto got = static_cast<std::size_t>(in.gcount());
+        if (got == 0) {
+            break;
+        }
+        ZSTD_inBuffer input = {inBuf.data(), got, 0};
+        while (input.pos < input.size) {
+            ZSTD_outBuffer output = {outBuf.data(), outBuf.size(), 0};
+            std::size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+            if (ZSTD_isError(ret)) {
+                LOG_F(ERROR, "Failed to decompress zstd stream: {}",
+                      ZSTD_getErrorName(ret));
+                ZSTD_freeDCtx(dctx);
+                return false;
+            }
+            out.write(outBuf.data(), static_cast<std::streamsize>(output.pos));
+        }
+    }
+    ZSTD_freeDCtx(dctx);
+    return static_cast<bool>(out);
+#else
+    (void)in;
+    (void)out;
+    LOG_F(ERROR, "zstd is not available in this build");
+    return false;
+#endif
+}
+
+bool ParallelCompressor::decompressStream(std::istream &in,
+                                          std::ostream &out) {
+    std::array<unsigned char, 4> magic{};
+    in.read(reinterpret_cast<char *>(magic.data()), magic.size());
+    const auto got = in.gcount();
+    in.clear();
+    in.seekg(-got, std::ios::cur);
+    if (!in) {
+        LOG_F(ERROR, "Input stream is not seekable");
+        return false;
+    }
+    if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return inflateStream(in, out);
+    }
+    if (got == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+        magic[3] == 0xfd) {
+        return zstdDecompressStream(in, out);
+    }
+    LOG_F(ERROR, "Unknown compressed stream format");
+    return false;
+}
+
+bool ParallelCompressor::compressFile(const fs::path &input,
+                                      const fs::path &output) {
+    if (!fs::exists(input)) {
+        LOG_F(ERROR, "Input file {} does not exist.", input.string());
+        return false;
+    }
+    fs::path outputPath = output;
+    if (outputPath.empty()) {
+        outputPath = input;
+        outputPath += m_options.backend == CompressionBackend::ZSTD ? ".zst"
+                                                                    : ".gz";
+    }
+    std::ifstream in(input, std::ios::binary);
+    if (!in) {
+        LOG_F(ERROR, "Failed to open input file {}", input.string());
+        return false;
+    }
+    std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        LOG_F(ERROR, "Failed to create compressed file {}",
+              outputPath.string());
+        return false;
+    }
+    if (!compressStream(in, out)) {
+        LOG_F(ERROR, "Failed to compress file {}", input.string());
+        return false;
+    }
+    DLOG_F(INFO, "Compressed file {} -> {} with {} threads", input.string(),
+           outputPath.string(), m_options.threads);
+    return true;
+}
+
+bool ParallelCompressor::decompressFile(const fs::path &input,
+                                        const fs::path &output) {
+    std::ifstream in(input, std::ios::binary);
+    if (!in) {
+        LOG_F(ERROR, "Failed to open compressed file {}", input.string());
+        return false;
+    }
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        LOG_F(ERROR, "Failed to create decompressed file {}", output.string());
+        return false;
+    }
+    if (!decompressStream(in, out)) {
+        LOG_F(ERROR, "Failed to decompress file {}", input.string());
+        return false;
+    }
+    DLOG_F(INFO, "Decompressed file {} -> {}", input.string(),
+           output.string());
+    return true;
+}
+
+bool ParallelCompressor::compressFolderToZip(const fs::path &folder,
+                                             const fs::path &zipFile) {
+    std::vector<ZipFileTask> files;
+    try {
+        for (const auto &entry : fs::recursive_directory_iterator(folder)) {
+            if (entry.is_regular_file()) {
+                files.push_back(
+                    {entry.path(),
+                     fs::relative(entry.path(), folder).generic_string(),
+                     entry.file_size()});
+            }
+        }
+    } catch (const fs::filesystem_error &e) {
+        LOG_F(ERROR, "Failed to scan folder {}: {}", folder.string(),
+              e.what());
+        return false;
+    }
+    std::sort(files.begin(), files.end(),
+              [](const auto &a, const auto &b) { return a.name < b.name; });
+
+    void *zipWriter = zipOpen64(zipFile.string().c_str(), APPEND_STATUS_CREATE);
+    if (zipWriter == nullptr) {
+        LOG_F(ERROR, "Failed to create ZIP file: {}", zipFile.string());
+        return false;
+    }
+
+    // ZIP条目只能是deflate数据，因此这里固定使用deflate而不是zstd
+    const int level = m_options.level;
+    struct Pending {
+        std::future<CompressedBlock> block;
+        std::size_t fileIndex;
+        bool first;
+        bool last;
+    };
+    std::deque<Pending> pending;
+    std::uint32_t crc = 0;
+    std::uint64_t total = 0;
+
+    auto drainOne = [&]() {
+        auto item = std::move(pending.front());
+        pending.pop_front();
+        const auto &file = files[item.fileIndex];
+        CompressedBlock block;
+        try {
+            block = item.block.get();
+        } catch (const std::exception &e) {
+            LOG_F(ERROR, "Failed to compress {}: {}", file.name, e.what());
+            return false;
+        }
+        if (item.first) {
+            zip_fileinfo info = {};
+            const int zip64 = file.size >= 0xffffffffULL ? 1 : 0;
+            if (zipOpenNewFileInZip2_64(zipWriter, file.name.c_str(), &info,
+                                        nullptr, 0, nullptr, 0, nullptr,
+                                        Z_DEFLATED, level, 1,
+                                        zip64) != ZIP_OK) {
+                LOG_F(ERROR, "Failed to add file to ZIP: {}", file.name);
+                return false;
+            }
+            crc = 0;
+            total = 0;
+        }
+        crc = static_cast<std::uint32_t>(crc32_combine(
+            crc, block.crc, static_cast<z_off_t>(block.rawSize)));
+        total += block.rawSize;
+        if (!block.data.empty() &&
+            zipWriteInFileInZip(zipWriter, block.data.data(),
+                                static_cast<uint32_t>(block.data.size())) !=
+                ZIP_OK) {
+            LOG_F(ERROR, "Failed to write file to ZIP: {}", file.name);
+            return false;
+        }
+        if (item.last &&
+            zipCloseFileInZipRaw64(zipWriter, total, crc) != ZIP_OK) {
+            LOG_F(ERROR, "Failed to close file in ZIP: {}", file.name);
+            return false;
+        }
+        return true;
+    };
+
+    bool ok = true;
+    for (std::size_t index = 0; ok && index < files.size(); ++index) {
+        std::ifstream in(files[index].path, std::ios::binary);
+        if (!in) {
+            LOG_F(ERROR, "Failed to open file for reading: {}",
+                  files[index].path.string());
+            ok = false;
+            break;
+        }
+        bool first = true;
+        while (ok) {
+            auto buffer = std::make_shared<std::vector<unsigned char>>(
+                m_options.blockSize);
+            in.read(reinterpret_cast<char *>(buffer->data()),
+                    static_cast<std::streamsize>(buffer->size()));
+            if (in.bad()) {
+                LOG_F(ERROR, "Failed to read file {}",
+                      files[index].path.string());
+                ok = false;
+                break;
+            }
+            buffer->resize(static_cast<std::size_t>(in.gcount()));
+            const bool last =
+                in.eof() || in.peek() == std::char_traits<char>::eof();
+            pending.push_back(
+                {m_pool->enqueue([buffer, last, level] {
+                     CompressedBlock block;
+                     block.rawSize = buffer->size();
+                     block.crc = static_cast<std::uint32_t>(
+                         crc32(0L, buffer->data(),
+                               static_cast<uInt>(buffer->size())));
+                     block.data = deflateRaw(*buffer, level, last);
+                     return block;
+                 }),
+                 index, first, last});
+            first = false;
+            if (pending.size() >= m_options.maxInFlight) {
+                ok = drainOne();
+            }
+            if (last) {
+                break;
+            }
+        }
+    }
+    while (ok && !pending.empty()) {
+        ok = drainOne();
+    }
+    for (auto &item : pending) {
+        item.block.wait();
+    }
+
+    if (zipClose(zipWriter, nullptr) != ZIP_OK) {
+        ok = false;
+    }
+    if (!ok) {
+        LOG_F(ERROR, "Failed to create ZIP file: {}", zipFile.string());
+        return false;
+    }
+    DLOG_F(INFO, "ZIP file created with {} entries: {}", files.size(),
+           zipFile.string());
+    return true;
+}
+
+}  // namespace atom::io
@@ -0,0 +1,165 @@
+/*
+ * parallel_compress.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-12
+
+Description: Parallel block compressor (gzip compatible, optional zstd)
+
+**************************************************/
+
+#ifndef ATOM_IO_PARALLEL_COMPRESS_HPP
+#define ATOM_IO_PARALLEL_COMPRESS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace atom::async {
+class ThreadPool;
+}
+
+namespace atom::io {
+
+/**
+ * @brief 压缩后端
+ *
+ * GZIP: 输出标准gzip格式，可以被gunzip/zlib直接解压。
+ * ZSTD: 输出由多个独立zstd帧拼接而成的流，仅在编译时找到zstd时可用。
+ */
+enum class CompressionBackend { GZIP, ZSTD };
+
+/**
+ * @brief 并行压缩参数
+ */
+struct ParallelCompressOptions {
+    /// 每个独立压缩块的大小
+    std::size_t blockSize = 1 << 20;
+    /// 压缩级别，-1表示后端的默认级别
+    int level = -1;
+    /// 工作线程数量，0表示使用硬件并发数
+    std::size_t threads = 0;
+    /// 同时在内存中的块数量上限，0表示线程数的两倍
+    std::size_t maxInFlight = 0;
+    /// 压缩后端
+    CompressionBackend backend = CompressionBackend::GZIP;
+};
+
+/**
+ * @brief 单个压缩块的结果
+ */
+struct CompressedBlock {
+    std::vector<unsigned char> data;
+    std::uint32_t crc = 0;
+    std::size_t rawSize = 0;
+};
+
+/**
+ * @brief 判断当前构建是否支持zstd后端
+ */
+[[nodiscard]] bool is_zstd_available();
+
+/**
+ * @class ParallelCompressor
+ * @brief 将输入切分为独立的块并在线程池上并行压缩，按顺序写出
+ *
+ * gzip后端采用与pigz相同的方式：每个块是一段以同步刷新结束的原始deflate数据，
+ * 最后一块以Z_FINISH结束，CRC通过crc32_combine合并，因此输出是单个标准的
+ * gzip成员。输入与输出均为流式处理，内存占用被限制在maxInFlight个块以内。
+ */
+class ParallelCompressor {
+public:
+    explicit ParallelCompressor(ParallelCompressOptions options = {});
+    ~ParallelCompressor();
+
+    ParallelCompressor(const ParallelCompressor &) = delete;
+    ParallelCompressor &operator=(const ParallelCompressor &) = delete;
+
+    /**
+     * @brief 压缩一个输入流
+     * @param in 输入流
+     * @param out 输出流
+     * @return 是否压缩成功
+     */
+    bool compressStream(std::istream &in, std::ostream &out);
+
+    /**
+     * @brief 解压由compressStream生成的流(或任意gzip/zstd流)
+     * @param in 输入流
+     * @param out 输出流
+     * @return 是否解压成功
+     *
+     * @note 解压本身无法并行，这里只提供固定缓冲区的流式实现。
+     */
+    bool decompressStream(std::istream &in, std::ostream &out);
+
+    /**
+     * @brief 压缩单个文件
+     * @param input 待压缩的文件
+     * @param output 输出文件，为空时使用input加上.gz或.zst后缀
+     * @return 是否压缩成功
+     */
+    bool compressFile(const std::filesystem::path &input,
+                      const std::filesystem::path &output = {});
+
+    /**
+     * @brief 解压单个文件
+     * @param input 压缩文件
+     * @param output 输出文件
+     * @return 是否解压成功
+     */
+    bool decompressFile(const std::filesystem::path &input,
+                        const std::filesystem::path &output);
+
+    /**
+     * @brief 将目录并行压缩为ZIP文件
+     * @param folder 待压缩的目录
+     * @param zipFile 输出的ZIP文件
+     * @return 是否压缩成功
+     *
+     * 各个文件在线程池上并行压缩为原始deflate数据，然后按相对路径的字典序以
+     * raw模式写入ZIP。目录遍历顺序因文件系统而异，排序后输出的条目顺序是确定的。
+     */
+    bool compressFolderToZip(const std::filesystem::path &folder,
+                             const std::filesystem::path &zipFile);
+
+    /**
+     * @brief 压缩一个数据块
+     * @param input 原始数据
+     * @param last 是否为最后一块(gzip后端以Z_FINISH结束)
+     * @return 压缩结果
+     */
+    [[nodiscard]] CompressedBlock compressBlock(
+        std::span<const unsigned char> input, bool last) const;
+
+    /**
+     * @brief 获取当前参数
+     */
+    [[nodiscard]] const ParallelCompressOptions &options() const {
+        return m_options;
+    }
+
+private:
+    bool compressBlocks(std::istream &in,
+                        const std::function<bool(const CompressedBlock &)> &sink,
+                        std::uint32_t &crc, std::uint64_t &total);
+    bool inflateStream(std::istream &in, std::ostream &out);
+    bool zstdDecompressStream(std::istream &in, std::ostream &out);
+
+    ParallelCompressOptions m_options;
+    std::unique_ptr<atom::async::ThreadPool> m_pool;
+};
+
+}  // namespace atom::io
+
+#endif
@@ -0,0 +1,1032 @@
+/*
+ * ziparchive.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-14
+
+Description: Append-only ZIP archive editing with an mmap'd index
+
+**************************************************/
+
+#include "ziparchive.hpp"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "atom/log/loguru.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::uint32_t LOCAL_HEADER_SIG = 0x04034b50;
+constexpr std::uint32_t CENTRAL_HEADER_SIG = 0x02014b50;
+constexpr std::uint32_t EOCD_SIG = 0x06054b50;
+constexpr std::uint32_t ZIP64_EOCD_SIG = 0x06064b50;
+constexpr std::uint32_t ZIP64_LOCATOR_SIG = 0x07064b50;
+constexpr std::uint32_t DATA_DESCRIPTOR_SIG = 0x08074b50;
+constexpr std::uint16_t ZIP64_EXTRA_ID = 0x0001;
+
+constexpr std::size_t LOCAL_HEADER_SIZE = 30;
+constexpr std::size_t CENTRAL_HEADER_SIZE = 46;
+constexpr std::size_t EOCD_SIZE = 22;
+constexpr std::size_t ZIP64_EOCD_SIZE = 56;
+constexpr std::size_t ZIP64_LOCATOR_SIZE = 20;
+
+constexpr std::uint32_t MAX32 = 0xffffffffU;
+constexpr std::uint16_t MAX16 = 0xffffU;
+constexpr std::uint16_t FLAG_DATA_DESCRIPTOR = 0x0008;
+constexpr std::uint16_t FLAG_UTF8 = 0x0800;
+constexpr std::uint16_t VERSION_DEFAULT = 20;
+constexpr std::uint16_t VERSION_ZIP64 = 45;
+constexpr std::size_t IO_CHUNK = 1 << 16;
+// 墓碑至少达到该大小并超过有效数据的一半时自动compact()
+constexpr std::uint64_t COMPACT_MIN_DEAD = 1 << 20;
+
+std::uint16_t get16(const unsigned char *p) {
+    return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+std::uint32_t get32(const unsigned char *p) {
+    return static_cast<std::uint32_t>(p[0]) |
+           (static_cast<std::uint32_t>(p[1]) << 8) |
+           (static_cast<std::uint32_t>(p[2]) << 16) |
+           (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+std::uint64_t get64(const unsigned char *p) {
+    return static_cast<std::uint64_t>(get32(p)) |
+           (static_cast<std::uint64_t>(get32(p + 4)) << 32);
+}
+
+class ByteWriter {
+public:
+    explicit ByteWriter(std::vector<unsigned char> &out) : m_out(out) {}
+    void put16(std::uint16_t v) {
+        m_out.push_back(static_cast<unsigned char>(v & 0xff));
+        m_out.push_back(static_cast<unsigned char>(v >> 8));
+    }
+    void put32(std::uint32_t v) {
+        put16(static_cast<std::uint16_t>(v & 0xffff));
+        put16(static_cast<std::uint16_t>(v >> 16));
+    }
+    void put64(std::uint64_t v) {
+        put32(static_cast<std::uint32_t>(v & MAX32));
+        put32(static_cast<std::uint32_t>(v >> 32));
+    }
+    void putBytes(std::string_view bytes) {
+        m_out.insert(m_out.end(), bytes.begin(), bytes.end());
+    }
+
+private:
+    std::vector<unsigned char> &m_out;
+};
+
+void set32(std::vector<unsigned char> &buffer, std::size_t pos,
+           std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        buffer[pos + i] = static_cast<unsigned char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+void set64(std::vector<unsigned char> &buffer, std::size_t pos,
+           std::uint64_t v) {
+    set32(buffer, pos, static_cast<std::uint32_t>(v & MAX32));
+    set32(buffer, pos + 4, static_cast<std::uint32_t>(v >> 32));
+}
+
+void currentDosTime(std::uint16_t &dosTime, std::uint16_t &dosDate) {
+    std::time_t now = std::time(nullptr);
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &now);
+#else
+    localtime_r(&now, &tm);
+#endif
+    dosTime = static_cast<std::uint16_t>((tm.tm_hour << 11) |
+                                         (tm.tm_min << 5) | (tm.tm_sec / 2));
+    dosDate = static_cast<std::uint16_t>(((tm.tm_year - 80) << 9) |
+                                         ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+bool writeAll(std::fstream &out, const std::vector<unsigned char> &data) {
+    out.write(reinterpret_cast<const char *>(data.data()),
+              static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+// 将文件内容落盘，保证中央目录只会指向已经写入磁盘的数据
+bool syncFile(const fs::path &path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    const bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+}  // namespace
+
+namespace atom::io {
+
+ZipArchive::~ZipArchive() { close(); }
+
+bool ZipArchive::open(const fs::path &path, bool create) {
+    close();
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        if (!create) {
+            LOG_F(ERROR, "ZIP file {} does not exist", path.string());
+            return false;
+        }
+        std::fstream out(path, std::ios::binary | std::ios::out);
+        std::vector<unsigned char> eocd;
+        ByteWriter writer(eocd);
+        writer.put32(EOCD_SIG);
+        eocd.resize(EOCD_SIZE, 0);
+        if (!out || !writeAll(out, eocd)) {
+            LOG_F(ERROR, "Failed to create ZIP file {}", path.string());
+            return false;
+        }
+    }
+    m_path = path;
+    if (!map() || !loadIndex()) {
+        close();
+        return false;
+    }
+    DLOG_F(INFO, "Opened ZIP file {} with {} entries", path.string(),
+           m_entries.size());
+    return true;
+}
+
+void ZipArchive::close() {
+    unmap();
+    m_entries.clear();
+    m_index.clear();
+    m_cdOffset = 0;
+    m_path.clear();
+}
+
+bool ZipArchive::map() {
+    unmap();
+#ifdef _WIN32
+    HANDLE file = CreateFileW(m_path.wstring().c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        LOG_F(ERROR, "Failed to open ZIP file {}", m_path.string());
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    m_size = static_cast<std::uint64_t>(size.QuadPart);
+    m_file = file;
+    if (m_size == 0) {
+        return true;
+    }
+    HANDLE mapping =
+        CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        LOG_F(ERROR, "Failed to map ZIP file {}", m_path.string());
+        return false;
+    }
+    m_mapping = mapping;
+    m_data = static_cast<const unsigned char *>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    int fd = ::open(m_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_F(ERROR, "Failed to open ZIP file {}", m_path.string());
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_size = static_cast<std::uint64_t>(st.st_size);
+    if (m_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void *addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        LOG_F(ERROR, "Failed to map ZIP file {}", m_path.string());
+        return false;
+    }
+    m_data = static_cast<const unsigned char *>(addr);
+#endif
+    return m_data != nullptr;
+}
+
+void ZipArchive::unmap() {
+#ifdef _WIN32
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != nullptr) {
+        CloseHandle(m_file);
+        m_file = nullptr;
+    }
+#else
+    if (m_data != nullptr) {
+        munmap(const_cast<unsigned char *>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool ZipArchive::loadIndex() {
+    m_entries.clear();
+    if (m_size < EOCD_SIZE) {
+        LOG_F(ERROR, "{} is not a ZIP file", m_path.string());
+        return false;
+    }
+
+    std::uint64_t count = 0;
+    std::uint64_t cdSize = 0;
+    std::uint64_t cdOffset = 0;
+    // 解析pos处的中央目录结束记录；strict要求中央目录紧挨着结束记录
+    auto parseEocd = [&](std::uint64_t eocd, bool strict) {
+        count = get16(m_data + eocd + 10);
+        cdSize = get32(m_data + eocd + 12);
+        cdOffset = get32(m_data + eocd + 16);
+        std::uint64_t cdEnd = eocd;
+        if ((count == MAX16 || cdSize == MAX32 || cdOffset == MAX32) &&
+            eocd >= ZIP64_LOCATOR_SIZE &&
+            get32(m_data + eocd - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIG) {
+            const std::uint64_t zip64Eocd =
+                get64(m_data + eocd - ZIP64_LOCATOR_SIZE + 8);
+            if (m_size < ZIP64_EOCD_SIZE ||
+                zip64Eocd > m_size - ZIP64_EOCD_SIZE ||
+                get32(m_data + zip64Eocd) != ZIP64_EOCD_SIG) {
+                return false;
+            }
+            count = get64(m_data + zip64Eocd + 32);
+            cdSize = get64(m_data + zip64Eocd + 40);
+            cdOffset = get64(m_data + zip64Eocd + 48);
+            cdEnd = zip64Eocd;
+        }
+        if (cdOffset > m_size || cdSize > m_size - cdOffset) {
+            return false;
+        }
+        if (!strict) {
+            return true;
+        }
+        return cdOffset + cdSize == cdEnd &&
+               (count == 0 || (cdOffset + 4 <= m_size &&
+                               get32(m_data + cdOffset) == CENTRAL_HEADER_SIG));
+    };
+
+    // 从文件末尾向前查找中央目录结束记录(其后最多有65535字节的注释)
+    std::uint64_t eocd = m_size - EOCD_SIZE;
+    const std::uint64_t limit =
+        m_size > EOCD_SIZE + MAX16 ? m_size - EOCD_SIZE - MAX16 : 0;
+    bool found = false;
+    while (true) {
+        if (get32(m_data + eocd) == EOCD_SIG) {
+            found = parseEocd(eocd, false);
+            break;
+        }
+        if (eocd == limit) {
+            break;
+        }
+        --eocd;
+    }
+    if (!found) {
+        // 追加过程中断时，文件末尾是未完成的条目，有效的中央目录在它前面。
+        // 向前扫描整个文件，只接受与中央目录首尾相接的结束记录。
+        for (std::uint64_t pos = eocd; pos-- > 0;) {
+            if (get32(m_data + pos) == EOCD_SIG && parseEocd(pos, true)) {
+                found = true;
+                LOG_F(WARNING,
+                      "Recovered central directory at offset {} in {}, "
+                      "ignoring {} trailing bytes",
+                      cdOffset, m_path.string(), m_size - pos - EOCD_SIZE);
+                break;
+            }
+        }
+    }
+    if (!found) {
+        LOG_F(ERROR, "Valid central directory not found in {}",
+              m_path.string());
+        return false;
+    }
+
+    m_cdOffset = cdOffset;
+    m_entries.reserve(count);
+    std::uint64_t pos = cdOffset;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        if (pos + CENTRAL_HEADER_SIZE > m_size ||
+            get32(m_data + pos) != CENTRAL_HEADER_SIG) {
+            LOG_F(ERROR, "Corrupted central directory entry in {}",
+                  m_path.string());
+            return false;
+        }
+        const unsigned char *p = m_data + pos;
+        ZipEntry entry;
+        entry.versionMadeBy = get16(p + 4);
+        entry.flags = get16(p + 8);
+        entry.method = get16(p + 10);
+        entry.dosTime = get16(p + 12);
+        entry.dosDate = get16(p + 14);
+        entry.crc = get32(p + 16);
+        entry.compressedSize = get32(p + 20);
+        entry.uncompressedSize = get32(p + 24);
+        const std::uint16_t nameLength = get16(p + 28);
+        const std::uint16_t extraLength = get16(p + 30);
+        const std::uint16_t commentLength = get16(p + 32);
+        entry.externalAttributes = get32(p + 38);
+        entry.localHeaderOffset = get32(p + 42);
+        if (pos + CENTRAL_HEADER_SIZE + nameLength + extraLength > m_size) {
+            LOG_F(ERROR, "Corrupted central directory entry in {}",
+                  m_path.string());
+            return false;
+        }
+        entry.name.assign(
+            reinterpret_cast<const char *>(p + CENTRAL_HEADER_SIZE),
+            nameLength);
+
+        // ZIP64扩展字段只包含主记录中被置为0xffffffff的值
+        const unsigned char *extra = p + CENTRAL_HEADER_SIZE + nameLength;
+        for (std::size_t off = 0; off + 4 <= extraLength;) {
+            const std::uint16_t id = get16(extra + off);
+            const std::uint16_t size = get16(extra + off + 2);
+            if (id == ZIP64_EXTRA_ID) {
+                const unsigned char *field = extra + off + 4;
+                const unsigned char *end = field + size;
+                if (entry.uncompressedSize == MAX32 && field + 8 <= end) {
+                    entry.uncompressedSize = get64(field);
+                    field += 8;
+                }
+                if (entry.compressedSize == MAX32 && field + 8 <= end) {
+                    entry.compressedSize = get64(field);
+                    field += 8;
+                }
+                if (entry.localHeaderOffset == MAX32 && field + 8 <= end) {
+                    entry.localHeaderOffset = get64(field);
+                }
+            }
+            off += 4 + size;
+        }
+
+        const std::uint64_t local = entry.localHeaderOffset;
+        if (local + LOCAL_HEADER_SIZE > m_size ||
+            get32(m_data + local) != LOCAL_HEADER_SIG) {
+            LOG_F(ERROR, "Corrupted local header for {} in {}", entry.name,
+                  m_path.string());
+            return false;
+        }
+        entry.dataOffset = local + LOCAL_HEADER_SIZE +
+                           get16(m_data + local + 26) +
+                           get16(m_data + local + 28);
+        std::uint64_t end = entry.dataOffset + entry.compressedSize;
+        if ((entry.flags & FLAG_DATA_DESCRIPTOR) != 0) {
+            if (end + 4 <= m_size && get32(m_data + end) == DATA_DESCRIPTOR_SIG) {
+                end += 4;
+            }
+            // 本地头带有ZIP64扩展字段时，数据描述符中的大小是8字节
+            bool zip64 = entry.compressedSize >= MAX32 ||
+                         entry.uncompressedSize >= MAX32;
+            const std::uint16_t localName = get16(m_data + local + 26);
+            const std::uint16_t localExtra = get16(m_data + local + 28);
+            const unsigned char *extra =
+                m_data + local + LOCAL_HEADER_SIZE + localName;
+            for (std::size_t off = 0;
+                 !zip64 && off + 4 <= localExtra &&
+                 entry.dataOffset <= m_size;
+                 off += 4 + get16(extra + off + 2)) {
+                zip64 = get16(extra + off) == ZIP64_EXTRA_ID;
+            }
+            end += zip64 ? 20 : 12;
+        }
+        entry.recordSize = end - local;
+
+        m_entries.push_back(std::move(entry));
+        pos += CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+    }
+    rebuildIndex();
+    return true;
+}
+
+void ZipArchive::rebuildIndex() {
+    m_index.clear();
+    m_index.reserve(m_entries.size());
+    for (std::size_t i = 0; i < m_entries.size(); ++i) {
+        m_index[m_entries[i].name] = i;
+    }
+}
+
+const ZipEntry *ZipArchive::find(std::string_view name) const {
+    auto it = m_index.find(std::string(name));
+    return it == m_index.end() ? nullptr : &m_entries[it->second];
+}
+
+std::span<const unsigned char> ZipArchive::rawData(
+    const ZipEntry &entry) const {
+    if (m_data == nullptr || entry.dataOffset + entry.compressedSize > m_size) {
+        return {};
+    }
+    return {m_data + entry.dataOffset,
+            static_cast<std::size_t>(entry.compressedSize)};
+}
+
+std::optional<std::vector<unsigned char>> ZipArchive::read(
+    std::string_view name) const {
+    const ZipEntry *entry = find(name);
+    if (entry == nullptr) {
+        LOG_F(ERROR, "File not found in ZIP: {}", name);
+        return std::nullopt;
+    }
+    auto raw = rawData(*entry);
+    std::vector<unsigned char> out(entry->uncompressedSize);
+    if (entry->method == 0) {
+        std::copy(raw.begin(), raw.end(), out.begin());
+    } else if (entry->method == Z_DEFLATED && !out.empty()) {
+        z_stream zs{};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            return std::nullopt;
+        }
+        std::size_t inPos = 0;
+        std::size_t outPos = 0;
+        int ret = Z_OK;
+        while (ret == Z_OK) {
+            const std::size_t inChunk =
+                std::min<std::size_t>(raw.size() - inPos, MAX32);
+            const std::size_t outChunk =
+                std::min<std::size_t>(out.size() - outPos, MAX32);
+            zs.next_in = const_cast<Bytef *>(raw.data() + inPos);
+            zs.avail_in = static_cast<uInt>(inChunk);
+            zs.next_out = out.data() + outPos;
+            zs.avail_out = static_cast<uInt>(outChunk);
+            ret = inflate(&zs, Z_NO_FLUSH);
+            inPos += inChunk - zs.avail_in;
+            outPos += outChunk - zs.avail_out;
+            if (ret == Z_BUF_ERROR && inChunk == 0 && outChunk == 0) {
+                ret = Z_STREAM_END;
+            }
+        }
+        inflateEnd(&zs);
+        if (ret != Z_STREAM_END || outPos != out.size()) {
+            LOG_F(ERROR, "Failed to inflate {} from ZIP", name);
+            return std::nullopt;
+        }
+    } else if (entry->method != Z_DEFLATED) {
+        LOG_F(ERROR, "Unsupported compression method {} for {}",
+              entry->method, name);
+        return std::nullopt;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (std::size_t off = 0; off < out.size(); off += IO_CHUNK) {
+        const auto len = std::min(IO_CHUNK, out.size() - off);
+        crc = crc32(crc, out.data() + off, static_cast<uInt>(len));
+    }
+    if (crc != entry->crc) {
+        LOG_F(ERROR, "CRC mismatch for {} in ZIP", name);
+        return std::nullopt;
+    }
+    return out;
+}
+
+bool ZipArchive::extract(std::string_view name,
+                         const fs::path &destination) const {
+    const ZipEntry *entry = find(name);
+    if (entry == nullptr) {
+        LOG_F(ERROR, "File not found in ZIP: {}", name);
+        return false;
+    }
+    if (entry->method != 0 && entry->method != Z_DEFLATED) {
+        LOG_F(ERROR, "Unsupported compression method {} for {}",
+              entry->method, name);
+        return false;
+    }
+    if (destination.has_parent_path()) {
+        fs::create_directories(destination.parent_path());
+    }
+    std::ofstream out(destination, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        LOG_F(ERROR, "Failed to create file: {}", destination.string());
+        return false;
+    }
+
+    auto raw = rawData(*entry);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    if (entry->method == 0) {
+        for (std::size_t off = 0; off < raw.size(); off += IO_CHUNK) {
+            const auto len = std::min(IO_CHUNK, raw.size() - off);
+            crc = crc32(crc, raw.data() + off, static_cast<uInt>(len));
+            out.write(reinterpret_cast<const char *>(raw.data() + off),
+                      static_cast<std::streamsize>(len));
+        }
+    } else {
+        z_stream zs{};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            return false;
+        }
+        std::vector<unsigned char> buffer(IO_CHUNK);
+        std::size_t inPos = 0;
+        int ret = Z_OK;
+        while (ret != Z_STREAM_END) {
+            if (zs.avail_in == 0) {
+                const std::size_t inChunk =
+                    std::min(IO_CHUNK, raw.size() - inPos);
+                zs.next_in = const_cast<Bytef *>(raw.data() + inPos);
+                zs.avail_in = static_cast<uInt>(inChunk);
+                inPos += inChunk;
+            }
+            zs.next_out = buffer.data();
+            zs.avail_out = static_cast<uInt>(buffer.size());
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                LOG_F(ERROR, "Failed to inflate {} from ZIP", name);
+                inflateEnd(&zs);
+                return false;
+            }
+            const std::size_t produced = buffer.size() - zs.avail_out;
+            crc = crc32(crc, buffer.data(), static_cast<uInt>(produced));
+            out.write(reinterpret_cast<const char *>(buffer.data()),
+                      static_cast<std::streamsize>(produced));
+        }
+        inflateEnd(&zs);
+    }
+    if (crc != entry->crc || !out) {
+        LOG_F(ERROR, "Failed to extract {} from ZIP", name);
+        return false;
+    }
+    return true;
+}
+
+bool ZipArchive::append(std::string_view name,
+                        std::span<const unsigned char> data, int level) {
+    std::size_t pos = 0;
+    return appendEntry(
+        name,
+        [&data, &pos](unsigned char *buffer, std::size_t size) {
+            const std::size_t n = std::min(size, data.size() - pos);
+            if (n > 0) {
+                std::memcpy(buffer, data.data() + pos, n);
+            }
+            pos += n;
+            return n;
+        },
+        data.size(), level);
+}
+
+bool ZipArchive::appendFile(std::string_view name, const fs::path &file,
+                            int level) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        LOG_F(ERROR, "Failed to open file for reading: {}", file.string());
+        return false;
+    }
+    std::error_code ec;
+    const auto size = fs::file_size(file, ec);
+    return appendEntry(
+        name,
+        [&in](unsigned char *buffer, std::size_t size) {
+            in.read(reinterpret_cast<char *>(buffer),
+                    static_cast<std::streamsize>(size));
+            return static_cast<std::size_t>(in.gcount());
+        },
+        ec ? 0 : size, level);
+}
+
+bool ZipArchive::appendEntry(std::string_view name, const ChunkReader &reader,
+                             std::uint64_t sizeHint, int level) {
+    if (!isOpen()) {
+        LOG_F(ERROR, "ZIP archive is not open");
+        return false;
+    }
+    if (name.empty() || name.size() > MAX16) {
+        LOG_F(ERROR, "Invalid ZIP entry name: {}", name);
+        return false;
+    }
+
+    // 新条目和新的中央目录都写在文件末尾，旧的中央目录在新目录落盘之前
+    // 一直完好，中途失败或崩溃时归档仍然指向旧目录
+    const std::uint64_t oldSize = m_size;
+    ZipEntry entry;
+    entry.name = std::string(name);
+    entry.method = level == 0 ? 0 : Z_DEFLATED;
+    entry.flags = FLAG_UTF8;
+    entry.localHeaderOffset = oldSize;
+    entry.externalAttributes = 0644U << 16;
+    currentDosTime(entry.dosTime, entry.dosDate);
+    // 大小未知时CRC和大小写在数据之后的ZIP64数据描述符中，
+    // 否则写完数据后回填本地头
+    const bool streaming = sizeHint == 0;
+    if (streaming) {
+        entry.flags |= FLAG_DATA_DESCRIPTOR;
+    }
+    // 压缩后可能略大于原始大小，留出余量后再决定是否需要ZIP64
+    const bool zip64 = streaming || sizeHint >= MAX32 - (MAX32 >> 6);
+    entry.versionMadeBy = (3 << 8) | VERSION_ZIP64;
+
+    std::vector<unsigned char> header;
+    ByteWriter writer(header);
+    writer.put32(LOCAL_HEADER_SIG);
+    writer.put16(zip64 ? VERSION_ZIP64 : VERSION_DEFAULT);
+    writer.put16(entry.flags);
+    writer.put16(entry.method);
+    writer.put16(entry.dosTime);
+    writer.put16(entry.dosDate);
+    writer.put32(0);  // crc, 写完数据后回填
+    writer.put32(zip64 ? MAX32 : 0);
+    writer.put32(zip64 ? MAX32 : 0);
+    writer.put16(static_cast<std::uint16_t>(name.size()));
+    writer.put16(zip64 ? 20 : 0);
+    writer.putBytes(name);
+    if (zip64) {
+        writer.put16(ZIP64_EXTRA_ID);
+        writer.put16(16);
+        writer.put64(0);
+        writer.put64(0);
+    }
+
+    unmap();
+    // 丢弃写了一半的条目，文件末尾重新成为旧的中央目录
+    auto rollback = [this, oldSize]() {
+        std::error_code ec;
+        fs::resize_file(m_path, oldSize, ec);
+        map();
+        return false;
+    };
+    std::fstream out(m_path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!out) {
+        LOG_F(ERROR, "Failed to open ZIP file for writing: {}",
+              m_path.string());
+        map();
+        return false;
+    }
+    out.seekp(static_cast<std::streamoff>(oldSize));
+    if (!writeAll(out, header)) {
+        LOG_F(ERROR, "Failed to write local header for {}", name);
+        out.close();
+        return rollback();
+    }
+    entry.dataOffset = oldSize + header.size();
+
+    std::vector<unsigned char> inBuf(IO_CHUNK);
+    std::vector<unsigned char> outBuf(IO_CHUNK);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    std::uint64_t rawSize = 0;
+    std::uint64_t compressedSize = 0;
+    bool ok = true;
+    if (entry.method == 0) {
+        std::size_t n = 0;
+        while ((n = reader(inBuf.data(), inBuf.size())) > 0) {
+            crc = crc32(crc, inBuf.data(), static_cast<uInt>(n));
+            out.write(reinterpret_cast<const char *>(inBuf.data()),
+                      static_cast<std::streamsize>(n));
+            rawSize += n;
+        }
+        compressedSize = rawSize;
+    } else {
+        z_stream zs{};
+        if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            out.close();
+            return rollback();
+        }
+        int flush = Z_NO_FLUSH;
+        do {
+            const std::size_t n = reader(inBuf.data(), inBuf.size());
+            crc = crc32(crc, inBuf.data(), static_cast<uInt>(n));
+            rawSize += n;
+            flush = n == 0 ? Z_FINISH : Z_NO_FLUSH;
+            zs.next_in = inBuf.data();
+            zs.avail_in = static_cast<uInt>(n);
+            do {
+                zs.next_out = outBuf.data();
+                zs.avail_out = static_cast<uInt>(outBuf.size());
+                if (deflate(&zs, flush) == Z_STREAM_ERROR) {
+                    ok = false;
+                    break;
+                }
+                const std::size_t produced = outBuf.size() - zs.avail_out;
+                out.write(reinterpret_cast<const char *>(outBuf.data()),
+                          static_cast<std::streamsize>(produced));
+                compressedSize += produced;
+            } while (zs.avail_out == 0);
+        } while (ok && flush != Z_FINISH);
+        deflateEnd(&zs);
+    }
+    if (!ok || !out || (!zip64 && (rawSize >= MAX32 ||
+                                   compressedSize >= MAX32))) {
+        LOG_F(ERROR, "Failed to write {} to ZIP", name);
+        out.close();
+        return rollback();
+    }
+
+    entry.crc = static_cast<std::uint32_t>(crc);
+    entry.uncompressedSize = rawSize;
+    entry.compressedSize = compressedSize;
+    entry.recordSize = header.size() + compressedSize;
+
+    if (streaming) {
+        std::vector<unsigned char> descriptor;
+        ByteWriter descriptorWriter(descriptor);
+        descriptorWriter.put32(DATA_DESCRIPTOR_SIG);
+        descriptorWriter.put32(entry.crc);
+        descriptorWriter.put64(compressedSize);
+        descriptorWriter.put64(rawSize);
+        if (!writeAll(out, descriptor)) {
+            LOG_F(ERROR, "Failed to write data descriptor for {}", name);
+            out.close();
+            return rollback();
+        }
+        entry.recordSize += descriptor.size();
+    } else {
+        // 回填CRC与大小
+        std::vector<unsigned char> patch(header.begin(), header.end());
+        set32(patch, 14, entry.crc);
+        if (zip64) {
+            const std::size_t extra = LOCAL_HEADER_SIZE + name.size();
+            set64(patch, extra + 4, rawSize);
+            set64(patch, extra + 12, compressedSize);
+        } else {
+            set32(patch, 18, static_cast<std::uint32_t>(compressedSize));
+            set32(patch, 22, static_cast<std::uint32_t>(rawSize));
+        }
+        out.seekp(static_cast<std::streamoff>(entry.localHeaderOffset));
+        if (!writeAll(out, patch)) {
+            LOG_F(ERROR, "Failed to update local header for {}", name);
+            out.close();
+            return rollback();
+        }
+    }
+    out.close();
+    // 条目数据先落盘，中央目录才能引用它
+    if (!out || !syncFile(m_path)) {
+        LOG_F(ERROR, "Failed to flush {} to ZIP", name);
+        return rollback();
+    }
+
+    const std::uint64_t newCdOffset = entry.localHeaderOffset + entry.recordSize;
+    auto entries = m_entries;
+    if (auto it = m_index.find(entry.name); it != m_index.end()) {
+        entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(it->second));
+    }
+    entries.push_back(std::move(entry));
+    if (!commitCentralDirectory(std::move(entries), newCdOffset)) {
+        return rollback();
+    }
+    DLOG_F(INFO, "Appended {} ({} bytes) to ZIP {}", name, rawSize,
+           m_path.string());
+    return true;
+}
+
+std::vector<unsigned char> ZipArchive::buildCentralDirectory(
+    const std::vector<ZipEntry> &entries, std::uint64_t offset) const {
+    std::vector<unsigned char> cd;
+    ByteWriter writer(cd);
+    for (const auto &entry : entries) {
+        const bool bigRaw = entry.uncompressedSize >= MAX32;
+        const bool bigCompressed = entry.compressedSize >= MAX32;
+        const bool bigOffset = entry.localHeaderOffset >= MAX32;
+        const std::uint16_t extraSize = static_cast<std::uint16_t>(
+            (bigRaw ? 8 : 0) + (bigCompressed ? 8 : 0) + (bigOffset ? 8 : 0));
+        const bool zip64 = extraSize > 0;
+
+        writer.put32(CENTRAL_HEADER_SIG);
+        writer.put16(entry.versionMadeBy);
+        writer.put16(zip64 ? VERSION_ZIP64 : VERSION_DEFAULT);
+        writer.put16(entry.flags);
+        writer.put16(entry.method);
+        writer.put16(entry.dosTime);
+        writer.put16(entry.dosDate);
+        writer.put32(entry.crc);
+        writer.put32(bigCompressed
+                         ? MAX32
+                         : static_cast<std::uint32_t>(entry.compressedSize));
+        writer.put32(bigRaw ? MAX32
+                            : static_cast<std::uint32_t>(entry.uncompressedSize));
+        writer.put16(static_cast<std::uint16_t>(entry.name.size()));
+        writer.put16(zip64 ? extraSize + 4 : 0);
+        writer.put16(0);  // comment
+        writer.put16(0);  // disk number
+        writer.put16(0);  // internal attributes
+        writer.put32(entry.externalAttributes);
+        writer.put32(bigOffset
+                         ? MAX32
+                         : static_cast<std::uint32_t>(entry.localHeaderOffset));
+        writer.putBytes(entry.name);
+        if (zip64) {
+            writer.put16(ZIP64_EXTRA_ID);
+            writer.put16(extraSize);
+            if (bigRaw) {
+                writer.put64(entry.uncompressedSize);
+            }
+            if (bigCompressed) {
+                writer.put64(entry.compressedSize);
+            }
+            if (bigOffset) {
+                writer.put64(entry.localHeaderOffset);
+            }
+        }
+    }
+
+    const std::uint64_t cdSize = cd.size();
+    const std::uint64_t count = entries.size();
+    const bool zip64 = count >= MAX16 || cdSize >= MAX32 || offset >= MAX32;
+    if (zip64) {
+        const std::uint64_t zip64Eocd = offset + cdSize;
+        writer.put32(ZIP64_EOCD_SIG);
+        writer.put64(ZIP64_EOCD_SIZE - 12);
+        writer.put16((3 << 8) | VERSION_ZIP64);
+        writer.put16(VERSION_ZIP64);
+        writer.put32(0);
+        writer.put32(0);
+        writer.put64(count);
+        writer.put64(count);
+        writer.put64(cdSize);
+        writer.put64(offset);
+
+        writer.put32(ZIP64_LOCATOR_SIG);
+        writer.put32(0);
+        writer.put64(zip64Eocd);
+        writer.put32(1);
+    }
+    writer.put32(EOCD_SIG);
+    writer.put16(0);
+    writer.put16(0);
+    writer.put16(zip64 ? MAX16 : static_cast<std::uint16_t>(count));
+    writer.put16(zip64 ? MAX16 : static_cast<std::uint16_t>(count));
+    writer.put32(zip64 ? MAX32 : static_cast<std::uint32_t>(cdSize));
+    writer.put32(zip64 ? MAX32 : static_cast<std::uint32_t>(offset));
+    writer.put16(0);
+    return cd;
+}
+
+bool ZipArchive::commitCentralDirectory(std::vector<ZipEntry> entries,
+                                        std::uint64_t offset) {
+    unmap();
+    const auto cd = buildCentralDirectory(entries, offset);
+    {
+        std::fstream out(m_path,
+                         std::ios::binary | std::ios::in | std::ios::out);
+        if (!out) {
+            LOG_F(ERROR, "Failed to open ZIP file for writing: {}",
+                  m_path.string());
+            map();
+            return false;
+        }
+        out.seekp(static_cast<std::streamoff>(offset));
+        if (!writeAll(out, cd)) {
+            LOG_F(ERROR, "Failed to write central directory to {}",
+                  m_path.string());
+            return false;
+        }
+    }
+    // 新目录写在所有已有数据之后，落盘之后它才成为文件末尾的有效目录
+    if (!syncFile(m_path)) {
+        LOG_F(ERROR, "Failed to sync ZIP file {}", m_path.string());
+        return false;
+    }
+    m_entries = std::move(entries);
+    rebuildIndex();
+    m_cdOffset = offset;
+    if (!map()) {
+        return false;
+    }
+    // 每次提交都把旧目录留在文件中，逐个追加时墓碑按平方增长。超过阈值
+    // 后整理一次，文件大小与有效数据保持线性关系。整理失败时新目录已经
+    // 生效，提交仍然成功
+    const std::uint64_t dead = deadBytes();
+    if (dead >= COMPACT_MIN_DEAD && dead >= (offset - dead) / 2 &&
+        !compact()) {
+        LOG_F(WARNING, "Failed to compact ZIP file {}, {} dead bytes",
+              m_path.string(), dead);
+    }
+    return true;
+}
+
+bool ZipArchive::remove(std::string_view name) {
+    auto it = m_index.find(std::string(name));
+    if (it == m_index.end()) {
+        LOG_F(ERROR, "File not found in ZIP: {}", name);
+        return false;
+    }
+    auto entries = m_entries;
+    entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(it->second));
+    // 与追加相同，新目录写在文件末尾，旧目录成为墓碑
+    const std::uint64_t oldSize = m_size;
+    if (!commitCentralDirectory(std::move(entries), oldSize)) {
+        std::error_code ec;
+        fs::resize_file(m_path, oldSize, ec);
+        map();
+        return false;
+    }
+    DLOG_F(INFO, "Removed {} from ZIP {}, {} dead bytes", name,
+           m_path.string(), deadBytes());
+    return true;
+}
+
+std::uint64_t ZipArchive::deadBytes() const {
+    std::uint64_t live = 0;
+    for (const auto &entry : m_entries) {
+        live += entry.recordSize;
+    }
+    return live >= m_cdOffset ? 0 : m_cdOffset - live;
+}
+
+bool ZipArchive::compact() {
+    if (!isOpen()) {
+        return false;
+    }
+    if (deadBytes() == 0) {
+        return true;
+    }
+
+    std::vector<ZipEntry> entries = m_entries;
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+        return a.localHeaderOffset < b.localHeaderOffset;
+    });
+
+    fs::path tempPath = m_path;
+    tempPath += ".compact";
+    {
+        std::fstream out(tempPath,
+                         std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!out) {
+            LOG_F(ERROR, "Failed to create temporary ZIP file: {}",
+                  tempPath.string());
+            return false;
+        }
+        std::uint64_t offset = 0;
+        for (auto &entry : entries) {
+            // 本地条目按原样复制，只有偏移发生变化
+            const unsigned char *src = m_data + entry.localHeaderOffset;
+            out.write(reinterpret_cast<const char *>(src),
+                      static_cast<std::streamsize>(entry.recordSize));
+            entry.dataOffset =
+                offset + (entry.dataOffset - entry.localHeaderOffset);
+            entry.localHeaderOffset = offset;
+            offset += entry.recordSize;
+        }
+        const auto cd = buildCentralDirectory(entries, offset);
+        if (!writeAll(out, cd)) {
+            LOG_F(ERROR, "Failed to write temporary ZIP file: {}",
+                  tempPath.string());
+            out.close();
+            fs::remove(tempPath);
+            return false;
+        }
+    }
+    // 替换之前落盘，崩溃后留下的要么是旧文件要么是完整的新文件
+    if (!syncFile(tempPath)) {
+        LOG_F(ERROR, "Failed to sync temporary ZIP file: {}",
+              tempPath.string());
+        fs::remove(tempPath);
+        return false;
+    }
+
+    const auto path = m_path;
+    close();
+    std::error_code ec;
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+        LOG_F(ERROR, "Failed to replace ZIP file {}: {}", path.string(),
+              ec.message());
+        open(path);
+        return false;
+    }
+    DLOG_F(INFO, "Compacted ZIP file {}", path.string());
+    return open(path);
+}
+
+}  // namespace atom::io
@@ -0,0 +1,199 @@
+/*
+ * ziparchive.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-14
+
+Description: Append-only ZIP archive editing with an mmap'd index
+
+**************************************************/
+
+#ifndef ATOM_IO_ZIPARCHIVE_HPP
+#define ATOM_IO_ZIPARCHIVE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace atom::io {
+
+/**
+ * @brief 中央目录中的一个条目
+ */
+struct ZipEntry {
+    std::string name;
+    std::uint16_t versionMadeBy = 0;
+    std::uint16_t flags = 0;
+    std::uint16_t method = 0;
+    std::uint16_t dosTime = 0;
+    std::uint16_t dosDate = 0;
+    std::uint32_t crc = 0;
+    std::uint64_t compressedSize = 0;
+    std::uint64_t uncompressedSize = 0;
+    std::uint32_t externalAttributes = 0;
+    /// 本地文件头的偏移
+    std::uint64_t localHeaderOffset = 0;
+    /// 压缩数据的偏移(跳过本地文件头)
+    std::uint64_t dataOffset = 0;
+    /// 本地文件头、数据以及数据描述符占用的总长度
+    std::uint64_t recordSize = 0;
+};
+
+/**
+ * @class ZipArchive
+ * @brief 只修改中央目录的ZIP编辑器
+ *
+ * 打开时通过mmap解析中央目录并建立名称索引，读取时直接定位到条目数据。
+ * 追加新文件时，新的本地条目和新的中央目录都写在文件末尾并落盘，旧的中央目录
+ * 在此之前保持不变，因此中途失败或崩溃不会丢失已有条目，已有的数据也不会被
+ * 复制。删除文件只是写出不含该条目的新中央目录，数据和旧目录成为墓碑。
+ * 墓碑超过1MiB且达到有效数据的一半时自动compact()，也可以显式调用。
+ * 大小未知的数据使用ZIP64数据描述符。
+ * 支持ZIP64。
+ *
+ * @note 该类不是线程安全的，同一个归档同时只能有一个写入者。
+ */
+class ZipArchive {
+public:
+    ZipArchive() = default;
+    ~ZipArchive();
+
+    ZipArchive(const ZipArchive &) = delete;
+    ZipArchive &operator=(const ZipArchive &) = delete;
+
+    /**
+     * @brief 打开ZIP文件
+     * @param path ZIP文件路径
+     * @param create 文件不存在时是否创建空归档
+     * @return 是否打开成功
+     */
+    bool open(const std::filesystem::path &path, bool create = false);
+
+    /**
+     * @brief 关闭归档并解除映射
+     */
+    void close();
+
+    /**
+     * @brief 归档是否已打开
+     */
+    [[nodiscard]] bool isOpen() const { return !m_path.empty(); }
+
+    /**
+     * @brief 获取所有有效条目
+     */
+    [[nodiscard]] const std::vector<ZipEntry> &entries() const {
+        return m_entries;
+    }
+
+    /**
+     * @brief 按名称查找条目
+     * @return 条目指针，不存在时为nullptr
+     */
+    [[nodiscard]] const ZipEntry *find(std::string_view name) const;
+
+    /**
+     * @brief 判断条目是否存在
+     */
+    [[nodiscard]] bool contains(std::string_view name) const {
+        return find(name) != nullptr;
+    }
+
+    /**
+     * @brief 获取条目的原始(压缩后)数据，直接指向映射的内存
+     * @note 在下一次修改归档之前有效
+     */
+    [[nodiscard]] std::span<const unsigned char> rawData(
+        const ZipEntry &entry) const;
+
+    /**
+     * @brief 读取并解压条目
+     * @return 解压后的数据，失败时为std::nullopt
+     */
+    [[nodiscard]] std::optional<std::vector<unsigned char>> read(
+        std::string_view name) const;
+
+    /**
+     * @brief 将条目流式解压到文件
+     * @return 是否成功
+     */
+    bool extract(std::string_view name,
+                 const std::filesystem::path &destination) const;
+
+    /**
+     * @brief 追加内存中的数据为新条目，同名条目会被替换
+     * @param name 条目名称
+     * @param data 数据
+     * @param level 压缩级别，0表示仅存储，-1表示默认级别
+     * @return 是否成功
+     */
+    bool append(std::string_view name, std::span<const unsigned char> data,
+                int level = -1);
+
+    /**
+     * @brief 流式追加文件为新条目，同名条目会被替换
+     * @param name 条目名称
+     * @param file 源文件
+     * @param level 压缩级别，0表示仅存储，-1表示默认级别
+     * @return 是否成功
+     */
+    bool appendFile(std::string_view name, const std::filesystem::path &file,
+                    int level = -1);
+
+    /**
+     * @brief 从中央目录中删除条目，数据保留为墓碑
+     * @return 是否成功
+     */
+    bool remove(std::string_view name);
+
+    /**
+     * @brief 获取墓碑及其他未被引用的数据占用的字节数
+     */
+    [[nodiscard]] std::uint64_t deadBytes() const;
+
+    /**
+     * @brief 重写归档，只保留有效条目(不会重新压缩)
+     * @return 是否成功
+     */
+    bool compact();
+
+private:
+    using ChunkReader = std::function<std::size_t(unsigned char *, std::size_t)>;
+
+    bool map();
+    void unmap();
+    bool loadIndex();
+    bool appendEntry(std::string_view name, const ChunkReader &reader,
+                     std::uint64_t sizeHint, int level);
+    bool commitCentralDirectory(std::vector<ZipEntry> entries,
+                                std::uint64_t offset);
+    std::vector<unsigned char> buildCentralDirectory(
+        const std::vector<ZipEntry> &entries, std::uint64_t offset) const;
+    void rebuildIndex();
+
+    std::filesystem::path m_path;
+    const unsigned char *m_data = nullptr;
+    std::uint64_t m_size = 0;
+#ifdef _WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+    std::vector<ZipEntry> m_entries;
+    std::unordered_map<std::string, std::size_t> m_index;
+    std::uint64_t m_cdOffset = 0;
+};
+
+}  // namespace atom::io
+
+#endif
@@ -0,0 +1,465 @@
+/*
+ * framebuffer.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-28
+
+Description: Pre-allocated, page-aligned frame buffers for camera drivers
+
+**************************************************/
+
+#ifndef ATOM_MEMORY_FRAMEBUFFER_HPP
+#define ATOM_MEMORY_FRAMEBUFFER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace atom::memory {
+/**
+ * @brief Size of one image as delivered by a sensor.
+ */
+struct FrameGeometry {
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::uint32_t channels = 1;
+    /** Significant bits per sample; 9 to 16 bit data takes two bytes. */
+    std::uint32_t bits_per_sample = 8;
+
+    std::size_t bytesPerSample() const { return (bits_per_sample + 7) / 8; }
+
+    std::size_t bytes() const {
+        return static_cast<std::size_t>(width) * height * channels *
+               bytesPerSample();
+    }
+};
+
+/**
+ * @brief Per frame metadata filled in by the producer.
+ */
+struct FrameInfo {
+    FrameGeometry geometry;
+    std::uint64_t sequence = 0;
+    std::chrono::system_clock::time_point timestamp;
+    double exposure = 0.0;
+};
+
+class FrameBufferRing;
+
+/**
+ * @brief Shared, reference counted view of one pooled frame buffer.
+ *
+ * Copies refer to the same pixels; the buffer goes back to its ring when
+ * the last copy is destroyed. Copying does not allocate, so a frame can be
+ * handed to the FITS writer, the preview and analysis at the same time.
+ * Consumers must treat the pixels as read-only once the frame is shared.
+ */
+class FrameHandle {
+public:
+    FrameHandle() = default;
+    ~FrameHandle() { reset(); }
+
+    FrameHandle(const FrameHandle &other) noexcept
+        : state_(other.state_), index_(other.index_) {
+        retain();
+    }
+
+    FrameHandle &operator=(const FrameHandle &other) noexcept {
+        if (this != &other) {
+            reset();
+            state_ = other.state_;
+            index_ = other.index_;
+            retain();
+        }
+        return *this;
+    }
+
+    FrameHandle(FrameHandle &&other) noexcept
+        : state_(std::move(other.state_)), index_(other.index_) {}
+
+    FrameHandle &operator=(FrameHandle &&other) noexcept {
+        if (this != &other) {
+            reset();
+            state_ = std::move(other.state_);
+            index_ = other.index_;
+        }
+        return *this;
+    }
+
+    explicit operator bool() const noexcept { return state_ != nullptr; }
+
+    /** Start of the buffer, page aligned. */
+    std::uint8_t *data() const noexcept;
+
+    /** Bytes of valid image data, see setSize(). */
+    std::size_t size() const noexcept;
+
+    /** Bytes the buffer can hold. */
+    std::size_t capacity() const noexcept;
+
+    /** Mark the first `bytes` bytes as the image, at most capacity(). */
+    void setSize(std::size_t bytes);
+
+    std::span<std::uint8_t> bytes() const noexcept { return {data(), size()}; }
+
+    FrameInfo &info() const noexcept;
+
+    /** Number of handles sharing this frame. */
+    std::uint32_t useCount() const noexcept;
+
+    /** Drop this reference now. */
+    void reset() noexcept;
+
+private:
+    friend class FrameBufferRing;
+    struct State;
+
+    FrameHandle(std::shared_ptr<State> state, std::uint32_t index)
+        : state_(std::move(state)), index_(index) {}
+
+    void retain() const noexcept;
+
+    std::shared_ptr<State> state_;
+    std::uint32_t index_ = 0;
+};
+
+/* One ring configuration: the mapping, the slots and the free ring. */
+struct FrameHandle::State {
+    struct Slot {
+        std::atomic<std::uint32_t> refs{0};
+        std::size_t size = 0;
+        FrameInfo info;
+    };
+
+    static constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    ~State() { release(); }
+
+    static std::size_t pageSize() {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    static std::size_t roundUp(std::size_t value, std::size_t unit) {
+        return (value + unit - 1) / unit * unit;
+    }
+
+    void allocate(std::size_t count, bool huge_pages) {
+        stride = roundUp(frame_bytes, pageSize());
+#if defined(__linux__) && defined(MAP_HUGETLB)
+        if (huge_pages) {
+            mapped = roundUp(stride, HUGE_PAGE_SIZE) * count;
+            void *ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED) {
+                stride = roundUp(stride, HUGE_PAGE_SIZE);
+                base = static_cast<std::uint8_t *>(ptr);
+                huge = true;
+            }
+        }
+#endif
+#ifdef _WIN32
+        if (base == nullptr) {
+            mapped = stride * count;
+            base = static_cast<std::uint8_t *>(VirtualAlloc(
+                nullptr, mapped, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        }
+#else
+        if (base == nullptr) {
+            mapped = stride * count;
+            void *ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr != MAP_FAILED) {
+                base = static_cast<std::uint8_t *>(ptr);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+                /* Transparent huge pages are the fallback when no
+                 * hugetlbfs pages are reserved. */
+                if (huge_pages) {
+                    huge = madvise(base, mapped, MADV_HUGEPAGE) == 0;
+                }
+#endif
+            }
+        }
+#endif
+        if (base == nullptr) {
+            throw std::bad_alloc();
+        }
+        /* Fault every page in now rather than during capture. */
+        std::memset(base, 0, mapped);
+    }
+
+    void release() {
+        if (base == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        VirtualFree(base, 0, MEM_RELEASE);
+#else
+        munmap(base, mapped);
+#endif
+        base = nullptr;
+    }
+
+    FrameHandle take(const std::shared_ptr<State> &self) {
+        std::scoped_lock lock(mutex);
+        return takeLocked(self);
+    }
+
+    FrameHandle takeLocked(const std::shared_ptr<State> &self) {
+        if (free_count == 0) {
+            return {};
+        }
+        auto index = free[head];
+        head = (head + 1) % free.size();
+        --free_count;
+        auto &slot = slots[index];
+        slot.refs.store(1, std::memory_order_relaxed);
+        slot.size = 0;
+        slot.info = {};
+        return FrameHandle(self, index);
+    }
+
+    void put(std::uint32_t index) {
+        {
+            std::scoped_lock lock(mutex);
+            free[(head + free_count) % free.size()] = index;
+            ++free_count;
+        }
+        released.notify_one();
+    }
+
+    std::size_t frame_bytes = 0;
+    std::size_t stride = 0;
+    std::size_t mapped = 0;
+    std::uint8_t *base = nullptr;
+    bool huge = false;
+
+    std::vector<Slot> slots;
+
+    std::mutex mutex;
+    std::condition_variable released;
+    /* Ring of free slot indices: free_count entries starting at head. */
+    std::vector<std::uint32_t> free;
+    std::size_t head = 0;
+    std::size_t free_count = 0;
+};
+
+/**
+ * @class FrameBufferRing
+ * @brief A fixed set of frame buffers allocated once per connection.
+ *
+ * All buffers live in one page-aligned mapping, optionally backed by huge
+ * pages, and are touched at configure() time so capturing never page
+ * faults or calls the allocator. Free buffers are handed out in ring order.
+ * When every buffer is still referenced, tryAcquire() fails so a video
+ * producer can drop the frame instead of stalling, and acquireFor() waits
+ * for a consumer to let go.
+ *
+ * Reconfiguring (e.g. after reconnecting a different camera) replaces the
+ * buffers; frames acquired earlier keep the old mapping alive until they
+ * are released.
+ */
+class FrameBufferRing {
+public:
+    FrameBufferRing() = default;
+
+    /**
+     * @param geometry Largest frame the buffers must hold.
+     * @param count Number of buffers.
+     * @param huge_pages Try to back the buffers with huge pages.
+     */
+    FrameBufferRing(const FrameGeometry &geometry, std::size_t count,
+                    bool huge_pages = false) {
+        configure(geometry, count, huge_pages);
+    }
+
+    FrameBufferRing(const FrameBufferRing &) = delete;
+    FrameBufferRing &operator=(const FrameBufferRing &) = delete;
+
+    /**
+     * @brief Allocate `count` buffers for frames up to `geometry`.
+     * @throws std::bad_alloc if the memory cannot be mapped.
+     */
+    void configure(const FrameGeometry &geometry, std::size_t count,
+                   bool huge_pages = false) {
+        configure(geometry.bytes(), count, huge_pages);
+    }
+
+    /**
+     * @brief Allocate `count` buffers of `frame_bytes` each, for frames that
+     * carry more than pixels (e.g. a FITS header).
+     */
+    void configure(std::size_t frame_bytes, std::size_t count,
+                   bool huge_pages = false) {
+        assert(count > 0 && count < UINT32_MAX);
+        auto state = std::make_shared<FrameHandle::State>();
+        state->frame_bytes = std::max<std::size_t>(frame_bytes, 1);
+        state->allocate(count, huge_pages);
+        state->slots = std::vector<FrameHandle::State::Slot>(count);
+        state->free.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            state->free[i] = static_cast<std::uint32_t>(i);
+        }
+        state->free_count = count;
+        std::scoped_lock lock(mutex_);
+        state_ = std::move(state);
+    }
+
+    /**
+     * @brief Whether configure() has been called.
+     */
+    bool configured() const {
+        std::scoped_lock lock(mutex_);
+        return state_ != nullptr;
+    }
+
+    /**
+     * @brief Take a free buffer, or an empty handle if all are in use.
+     */
+    FrameHandle tryAcquire() {
+        auto state = current();
+        return state ? state->take(state) : FrameHandle{};
+    }
+
+    /**
+     * @brief Take a free buffer, waiting up to `timeout` for one.
+     */
+    template <typename Rep, typename Period>
+    FrameHandle acquireFor(std::chrono::duration<Rep, Period> timeout) {
+        auto state = current();
+        if (!state) {
+            return {};
+        }
+        std::unique_lock lock(state->mutex);
+        state->released.wait_for(lock, timeout,
+                                 [&] { return state->free_count > 0; });
+        return state->takeLocked(state);
+    }
+
+    /**
+     * @brief Take a free buffer.
+     * @throws std::runtime_error if the ring is not configured or full.
+     */
+    FrameHandle acquire() {
+        auto frame = tryAcquire();
+        if (!frame) {
+            throw std::runtime_error("FrameBufferRing has no free buffer.");
+        }
+        return frame;
+    }
+
+    /** Number of buffers. */
+    std::size_t size() const {
+        auto state = current();
+        return state ? state->slots.size() : 0;
+    }
+
+    /** Buffers not referenced by any handle. */
+    std::size_t available() const {
+        auto state = current();
+        if (!state) {
+            return 0;
+        }
+        std::scoped_lock lock(state->mutex);
+        return state->free_count;
+    }
+
+    /** Usable bytes per buffer. */
+    std::size_t frameBytes() const {
+        auto state = current();
+        return state ? state->frame_bytes : 0;
+    }
+
+    /** Whether the buffers ended up on huge pages. */
+    bool hugePages() const {
+        auto state = current();
+        return state && state->huge;
+    }
+
+private:
+    std::shared_ptr<FrameHandle::State> current() const {
+        std::scoped_lock lock(mutex_);
+        return state_;
+    }
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<FrameHandle::State> state_;
+};
+
+inline std::uint8_t *FrameHandle::data() const noexcept {
+    return state_ ? state_->base + index_ * state_->stride : nullptr;
+}
+
+inline std::size_t FrameHandle::size() const noexcept {
+    return state_ ? state_->slots[index_].size : 0;
+}
+
+inline std::size_t FrameHandle::capacity() const noexcept {
+    return state_ ? state_->frame_bytes : 0;
+}
+
+inline void FrameHandle::setSize(std::size_t bytes) {
+    if (!state_ || bytes > state_->frame_bytes) {
+        throw std::length_error("Frame larger than its buffer.");
+    }
+    state_->slots[index_].size = bytes;
+}
+
+inline FrameInfo &FrameHandle::info() const noexcept {
+    return state_->slots[index_].info;
+}
+
+inline std::uint32_t FrameHandle::useCount() const noexcept {
+    return state_ ? state_->slots[index_].refs.load(std::memory_order_relaxed)
+                  : 0;
+}
+
+inline void FrameHandle::retain() const noexcept {
+    if (state_) {
+        state_->slots[index_].refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void FrameHandle::reset() noexcept {
+    if (!state_) {
+        return;
+    }
+    auto state = std::move(state_);
+    if (state->slots[index_].refs.fetch_sub(1, std::memory_order_acq_rel) ==
+        1) {
+        state->put(index_);
+    }
+}
+}  // namespace atom::memory
+
+#endif
@@ -8,94 +8,408 @@
 
 Date: 2024-4-5
 
-Description: A simple implementation of object pool
+Description: A lock-free object pool with thread-local magazines
 
 **************************************************/
 
 #ifndef ATOM_MEMORY_OBJECT_HPP
 #define ATOM_MEMORY_OBJECT_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <concepts>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 template <typename T>
 concept Resettable = requires(T& obj) { obj.reset(); };
 
+/**
+ * @brief A bounded pool of reusable objects.
+ *
+ * At most max_size objects are ever created. Released objects are reset and
+ * kept in a small per-thread magazine, so a thread that acquires and
+ * releases repeatedly never touches shared state. Magazines spill to and
+ * refill from a lock-free global depot. When both are empty, new objects
+ * are created until max_size is reached, after which objects parked in
+ * other threads' magazines are reclaimed before the pool reports
+ * exhaustion.
+ *
+ * Objects are handed out as move-only Handles that return the object to
+ * the pool when destroyed. Handles must not outlive the pool.
+ */
 template <Resettable T>
 class ObjectPool {
+    struct Slot {
+        std::unique_ptr<T> object;
+        std::atomic<std::uint32_t> next{0};
+    };
+
+    struct Magazine {
+        explicit Magazine(std::size_t capacity) : items(capacity) {}
+
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        std::size_t count = 0;
+        std::vector<std::uint32_t> items;
+    };
+
 public:
-    using CreateFunc = std::function<std::shared_ptr<T>()>;
+    using CreateFunc = std::function<std::unique_ptr<T>()>;
+
+    /**
+     * @brief RAII owner of a pooled object.
+     */
+    class Handle {
+    public:
+        Handle() = default;
+        ~Handle() { reset(); }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        Handle(Handle&& other) noexcept
+            : pool_(std::exchange(other.pool_, nullptr)),
+              index_(other.index_) {}
+
+        Handle& operator=(Handle&& other) noexcept {
+            if (this != &other) {
+                reset();
+                pool_ = std::exchange(other.pool_, nullptr);
+                index_ = other.index_;
+            }
+            return *this;
+        }
+
+        T* get() const noexcept {
+            return pool_ != nullptr ? pool_->slots_[index_].object.get()
+                                    : nullptr;
+        }
+        T& operator*() const noexcept { return *get(); }
+        T* operator->() const noexcept { return get(); }
+        explicit operator bool() const noexcept { return pool_ != nullptr; }
+
+        /**
+         * @brief Return the object to the pool now.
+         */
+        void reset() {
+            if (pool_ != nullptr) {
+                std::exchange(pool_, nullptr)->put(index_);
+            }
+        }
 
+    private:
+        friend class ObjectPool;
+
+        Handle(ObjectPool* pool, std::uint32_t index)
+            : pool_(pool), index_(index) {}
+
+        ObjectPool* pool_ = nullptr;
+        std::uint32_t index_ = 0;
+    };
+
+    /**
+     * @param max_size Maximum number of objects the pool will create.
+     * @param creator Factory for new objects.
+     * @param magazine_size Objects each thread may keep cached locally; 0
+     * picks a size based on max_size.
+     */
     explicit ObjectPool(
         size_t max_size,
-        CreateFunc creator = []() { return std::make_shared<T>(); })
+        CreateFunc creator = []() { return std::make_unique<T>(); },
+        size_t magazine_size = 0)
         : max_size_(max_size),
-          available_(max_size),
-          creator_(std::move(creator)) {
+          magazine_size_(magazine_size != 0
+                             ? magazine_size
+                             : std::clamp<size_t>(max_size / 8, 1, 32)),
+          slots_(std::make_unique<Slot[]>(max_size)),
+          creator_(std::move(creator)),
+          id_(nextId()),
+          token_(std::make_shared<char>()) {
         assert(max_size_ > 0 && "ObjectPool size must be greater than zero.");
-        pool_.reserve(max_size_);
+        assert(max_size_ < UINT32_MAX && "ObjectPool size is too large.");
     }
 
-    std::shared_ptr<T> acquire() {
-        std::unique_lock lock(mutex_);
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
 
-        if (available_ == 0) {
+    /**
+     * @brief Acquire an object.
+     * @throws std::runtime_error if all max_size objects are in use.
+     */
+    Handle acquire() {
+        Handle handle = tryAcquire();
+        if (!handle) {
             throw std::runtime_error("ObjectPool is full.");
         }
-        cv_.wait(lock, [this] { return !pool_.empty() || available_ > 0; });
+        return handle;
+    }
 
-        if (!pool_.empty()) {
-            auto obj = pool_.back();
-            pool_.pop_back();
-            return obj;
+    /**
+     * @brief Acquire an object, or return an empty Handle if all objects
+     * are in use.
+     */
+    Handle tryAcquire() {
+        auto index = take();
+        if (index == NONE) {
+            return {};
         }
-
-        assert(available_ > 0);
-        --available_;
-        return creator_();
+        in_use_.fetch_add(1, std::memory_order_relaxed);
+        return Handle(this, index);
     }
 
-    void release(std::shared_ptr<T> obj) {
-        std::unique_lock lock(mutex_);
-        if (pool_.size() < max_size_) {
-            obj->reset();
-            pool_.push_back(std::move(obj));
-        } else {
-            ++available_;
+    /**
+     * @brief Acquire an object, waiting up to @p timeout for one to be
+     * released. Returns an empty Handle on timeout.
+     */
+    template <typename Rep, typename Period>
+    Handle acquireFor(std::chrono::duration<Rep, Period> timeout) {
+        if (Handle handle = tryAcquire()) {
+            return handle;
         }
-        cv_.notify_one();
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        Handle handle;
+        {
+            std::unique_lock lock(wait_mutex_);
+            while (!(handle = tryAcquire())) {
+                if (wait_cv_.wait_until(lock, deadline) ==
+                    std::cv_status::timeout) {
+                    handle = tryAcquire();
+                    break;
+                }
+            }
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return handle;
     }
 
+    /**
+     * @brief Return an object to the pool before its Handle goes out of
+     * scope.
+     */
+    void release(Handle&& handle) { handle.reset(); }
+
+    /**
+     * @brief Number of objects that can be acquired without blocking.
+     */
     size_t available() const {
-        std::lock_guard lock(mutex_);
-        return available_ + pool_.size();
+        return max_size_ - in_use_.load(std::memory_order_relaxed);
     }
 
-    size_t size() const {
-        std::lock_guard lock(mutex_);
-        return max_size_ - available_ + pool_.size();
-    }
+    /**
+     * @brief Number of objects currently handed out.
+     */
+    size_t size() const { return in_use_.load(std::memory_order_relaxed); }
 
+    /**
+     * @brief Create objects up front until @p count exist.
+     */
     void prefill(size_t count) {
-        std::unique_lock lock(mutex_);
-        for (size_t i = pool_.size(); i < count && i < max_size_; ++i) {
-            pool_.push_back(creator_());
+        count = std::min(count, max_size_);
+        while (true) {
+            auto created = created_.load(std::memory_order_relaxed);
+            if (created >= count) {
+                return;
+            }
+            if (created_.compare_exchange_weak(created, created + 1,
+                                               std::memory_order_relaxed)) {
+                auto index = static_cast<std::uint32_t>(created);
+                slots_[index].object = creator_();
+                pushDepot(index);
+            }
         }
     }
 
 private:
+    static constexpr std::uint32_t NONE = UINT32_MAX;
+
+    // Magazines of the calling thread, keyed by pool id. The token lets
+    // entries of destroyed pools be pruned.
+    struct LocalEntry {
+        std::uint64_t id;
+        std::weak_ptr<void> token;
+        Magazine* magazine;
+    };
+
+    static std::uint64_t nextId() noexcept {
+        static std::atomic<std::uint64_t> counter{1};
+        return counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Magazine& localMagazine() {
+        thread_local std::vector<LocalEntry> entries;
+        thread_local LocalEntry* last = nullptr;
+        if (last != nullptr && last->id == id_) {
+            return *last->magazine;
+        }
+        for (auto& entry : entries) {
+            if (entry.id == id_) {
+                last = &entry;
+                return *entry.magazine;
+            }
+        }
+        std::erase_if(entries, [](const LocalEntry& entry) {
+            return entry.token.expired();
+        });
+        Magazine* magazine;
+        {
+            std::lock_guard lock(registry_mutex_);
+            magazines_.push_back(std::make_unique<Magazine>(magazine_size_));
+            magazine = magazines_.back().get();
+        }
+        entries.push_back({id_, token_, magazine});
+        last = &entries.back();
+        return *magazine;
+    }
+
+    std::uint32_t take() {
+        Magazine& magazine = localMagazine();
+        if (!magazine.busy.test_and_set(std::memory_order_acquire)) {
+            std::uint32_t index = NONE;
+            if (magazine.count == 0) {
+                // Refill half a magazine from the depot.
+                while (magazine.count < (magazine_size_ + 1) / 2) {
+                    auto popped = popDepot();
+                    if (popped == NONE) {
+                        break;
+                    }
+                    magazine.items[magazine.count++] = popped;
+                }
+            }
+            if (magazine.count > 0) {
+                index = magazine.items[--magazine.count];
+            }
+            magazine.busy.clear(std::memory_order_release);
+            if (index != NONE) {
+                return index;
+            }
+        } else if (auto popped = popDepot(); popped != NONE) {
+            return popped;
+        }
+
+        auto created = created_.load(std::memory_order_relaxed);
+        while (created < max_size_) {
+            if (created_.compare_exchange_weak(created, created + 1,
+                                               std::memory_order_relaxed)) {
+                auto index = static_cast<std::uint32_t>(created);
+                slots_[index].object = creator_();
+                return index;
+            }
+        }
+        return steal();
+    }
+
+    // Slow path: take an object parked in another thread's magazine.
+    std::uint32_t steal() {
+        if (auto popped = popDepot(); popped != NONE) {
+            return popped;
+        }
+        std::lock_guard lock(registry_mutex_);
+        for (auto& magazine : magazines_) {
+            if (magazine->busy.test_and_set(std::memory_order_acquire)) {
+                continue;
+            }
+            std::uint32_t index = NONE;
+            if (magazine->count > 0) {
+                index = magazine->items[--magazine->count];
+            }
+            magazine->busy.clear(std::memory_order_release);
+            if (index != NONE) {
+                return index;
+            }
+        }
+        return NONE;
+    }
+
+    void put(std::uint32_t index) {
+        slots_[index].object->reset();
+        in_use_.fetch_sub(1, std::memory_order_relaxed);
+
+        // With waiters, go straight to the depot so they can see it.
+        if (waiters_.load(std::memory_order_seq_cst) > 0) {
+            pushDepot(index);
+            notifyWaiter();
+            return;
+        }
+
+        Magazine& magazine = localMagazine();
+        if (magazine.busy.test_and_set(std::memory_order_acquire)) {
+            pushDepot(index);
+        } else {
+            if (magazine.count == magazine_size_) {
+                // Spill half the magazine to the depot.
+                while (magazine.count > magazine_size_ / 2) {
+                    pushDepot(magazine.items[--magazine.count]);
+                }
+            }
+            magazine.items[magazine.count++] = index;
+            magazine.busy.clear(std::memory_order_release);
+        }
+        if (waiters_.load(std::memory_order_seq_cst) > 0) {
+            notifyWaiter();
+        }
+    }
+
+    void notifyWaiter() {
+        { std::lock_guard lock(wait_mutex_); }
+        wait_cv_.notify_one();
+    }
+
+    // The depot is a Treiber stack of slot indices. The head packs a
+    // modification tag with index + 1 to rule out ABA.
+    void pushDepot(std::uint32_t index) {
+        auto head = depot_.load(std::memory_order_relaxed);
+        std::uint64_t next;
+        do {
+            slots_[index].next.store(static_cast<std::uint32_t>(head),
+                                     std::memory_order_relaxed);
+            next = ((head >> 32) + 1) << 32 | (index + 1);
+        } while (!depot_.compare_exchange_weak(head, next,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+    }
+
+    std::uint32_t popDepot() {
+        auto head = depot_.load(std::memory_order_acquire);
+        std::uint64_t next;
+        do {
+            auto top = static_cast<std::uint32_t>(head);
+            if (top == 0) {
+                return NONE;
+            }
+            next = ((head >> 32) + 1) << 32 |
+                   slots_[top - 1].next.load(std::memory_order_relaxed);
+        } while (!depot_.compare_exchange_weak(head, next,
+                                               std::memory_order_acquire,
+                                               std::memory_order_acquire));
+        return static_cast<std::uint32_t>(head) - 1;
+    }
+
     size_t max_size_;
-    size_t available_;
-    mutable std::mutex mutex_;
-    std::condition_variable cv_;
-    std::vector<std::shared_ptr<T>> pool_;
+    size_t magazine_size_;
+    std::unique_ptr<Slot[]> slots_;
     CreateFunc creator_;
+    std::uint64_t id_;
+    std::shared_ptr<void> token_;
+
+    std::atomic<size_t> created_{0};
+    std::atomic<size_t> in_use_{0};
+    std::atomic<std::uint64_t> depot_{0};
+
+    std::mutex registry_mutex_;
+    std::vector<std::unique_ptr<Magazine>> magazines_;
+
+    std::atomic<int> waiters_{0};
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
 };
 
 #endif  // ATOM_MEMORY_OBJECT_HPP
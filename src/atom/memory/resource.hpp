@@ -0,0 +1,543 @@
+/*
+ * resource.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-18
+
+Description: Size-class slab, arena and statistics memory resources
+
+**************************************************/
+
+#ifndef ATOM_MEMORY_RESOURCE_HPP
+#define ATOM_MEMORY_RESOURCE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "atom/type/noncopyable.hpp"
+
+namespace atom::memory {
+
+/**
+ * @brief A snapshot of the counters kept by the resources in this file.
+ */
+struct MemoryStats {
+    std::size_t allocations = 0;    ///< Number of do_allocate calls.
+    std::size_t deallocations = 0;  ///< Number of do_deallocate calls.
+    std::size_t bytesInUse = 0;     ///< Bytes currently handed out.
+    std::size_t peakBytesInUse = 0; ///< High-water mark of bytesInUse.
+    std::size_t upstreamBytes = 0;  ///< Bytes currently held from upstream.
+};
+
+/**
+ * @brief Thread-safe counters shared by the resources below.
+ */
+class MemoryCounters {
+public:
+    void onAllocate(std::size_t bytes) noexcept {
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+        auto inUse =
+            bytesInUse_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto peak = peak_.load(std::memory_order_relaxed);
+        while (inUse > peak &&
+               !peak_.compare_exchange_weak(peak, inUse,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    void onDeallocate(std::size_t bytes) noexcept {
+        deallocations_.fetch_add(1, std::memory_order_relaxed);
+        bytesInUse_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    void onUpstream(std::ptrdiff_t bytes) noexcept {
+        upstream_.fetch_add(static_cast<std::size_t>(bytes),
+                            std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] MemoryStats snapshot() const noexcept {
+        return {allocations_.load(std::memory_order_relaxed),
+                deallocations_.load(std::memory_order_relaxed),
+                bytesInUse_.load(std::memory_order_relaxed),
+                peak_.load(std::memory_order_relaxed),
+                upstream_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    std::atomic<std::size_t> allocations_{0};
+    std::atomic<std::size_t> deallocations_{0};
+    std::atomic<std::size_t> bytesInUse_{0};
+    std::atomic<std::size_t> peak_{0};
+    std::atomic<std::size_t> upstream_{0};
+};
+
+/**
+ * @brief A decorator that counts every allocation passing through it and
+ * optionally reports each event to a hook.
+ *
+ * Useful for attributing heap use to a subsystem (dispatch, JSON, ...)
+ * without changing the resource that actually serves the memory.
+ */
+class StatsResource : public std::pmr::memory_resource, NonCopyable {
+public:
+    /**
+     * @brief Hook called after every allocation (bytes > 0) and
+     * deallocation (bytes < 0).
+     */
+    using Hook = std::function<void(std::ptrdiff_t bytes, std::size_t alignment)>;
+
+    explicit StatsResource(
+        std::pmr::memory_resource* upstream = std::pmr::get_default_resource(),
+        Hook hook = {})
+        : upstream_(upstream), hook_(std::move(hook)) {}
+
+    [[nodiscard]] MemoryStats stats() const noexcept {
+        return counters_.snapshot();
+    }
+
+    [[nodiscard]] std::pmr::memory_resource* upstream() const noexcept {
+        return upstream_;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        void* p = upstream_->allocate(bytes, alignment);
+        counters_.onAllocate(bytes);
+        counters_.onUpstream(static_cast<std::ptrdiff_t>(bytes));
+        if (hook_) {
+            hook_(static_cast<std::ptrdiff_t>(bytes), alignment);
+        }
+        return p;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes,
+                       std::size_t alignment) override {
+        upstream_->deallocate(p, bytes, alignment);
+        counters_.onDeallocate(bytes);
+        counters_.onUpstream(-static_cast<std::ptrdiff_t>(bytes));
+        if (hook_) {
+            hook_(-static_cast<std::ptrdiff_t>(bytes), alignment);
+        }
+    }
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    std::pmr::memory_resource* upstream_;
+    Hook hook_;
+    MemoryCounters counters_;
+};
+
+/**
+ * @brief A monotonic bump allocator for per-request or per-frame scratch
+ * memory.
+ *
+ * Deallocation is a no-op. reset() rewinds the arena but keeps the blocks
+ * obtained from upstream, so a steady-state frame loop allocates from
+ * upstream only during the first few frames. release() returns everything
+ * to upstream. Not thread-safe: use one arena per thread or per request.
+ */
+class ArenaResource : public std::pmr::memory_resource, NonCopyable {
+public:
+    explicit ArenaResource(
+        std::size_t blockSize = 64 * 1024,
+        std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : blockSize_(std::max<std::size_t>(blockSize, 256)),
+          upstream_(upstream) {}
+
+    ~ArenaResource() override { release(); }
+
+    /**
+     * @brief Rewind the arena. All memory handed out so far becomes invalid,
+     * but the blocks are kept for reuse.
+     */
+    void reset() noexcept {
+        current_ = 0;
+        offset_ = 0;
+        bytesInUse_ = 0;
+    }
+
+    /**
+     * @brief Return all blocks to upstream.
+     */
+    void release() noexcept {
+        for (auto& block : blocks_) {
+            upstream_->deallocate(block.memory, block.size, BLOCK_ALIGNMENT);
+        }
+        blocks_.clear();
+        upstreamBytes_ = 0;
+        reset();
+    }
+
+    [[nodiscard]] MemoryStats stats() const noexcept {
+        return {allocations_, 0, bytesInUse_, peakBytesInUse_, upstreamBytes_};
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++allocations_;
+        while (current_ < blocks_.size()) {
+            auto& block = blocks_[current_];
+            auto addr = reinterpret_cast<std::uintptr_t>(block.memory) + offset_;
+            auto aligned = (addr + alignment - 1) & ~(alignment - 1);
+            auto end = aligned + bytes;
+            if (end <= reinterpret_cast<std::uintptr_t>(block.memory) +
+                           block.size) {
+                offset_ =
+                    end - reinterpret_cast<std::uintptr_t>(block.memory);
+                track(bytes);
+                return reinterpret_cast<void*>(aligned);
+            }
+            ++current_;
+            offset_ = 0;
+        }
+
+        const std::size_t size =
+            std::max(blockSize_, bytes + std::max(alignment, BLOCK_ALIGNMENT));
+        void* memory = upstream_->allocate(size, BLOCK_ALIGNMENT);
+        blocks_.push_back({memory, size});
+        upstreamBytes_ += size;
+        current_ = blocks_.size() - 1;
+        offset_ = 0;
+        return do_allocate_in_current(bytes, alignment);
+    }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    static constexpr std::size_t BLOCK_ALIGNMENT = alignof(std::max_align_t);
+
+    struct Block {
+        void* memory;
+        std::size_t size;
+    };
+
+    void* do_allocate_in_current(std::size_t bytes, std::size_t alignment) {
+        auto& block = blocks_[current_];
+        auto base = reinterpret_cast<std::uintptr_t>(block.memory);
+        auto aligned = (base + alignment - 1) & ~(alignment - 1);
+        offset_ = aligned + bytes - base;
+        track(bytes);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void track(std::size_t bytes) noexcept {
+        bytesInUse_ += bytes;
+        peakBytesInUse_ = std::max(peakBytesInUse_, bytesInUse_);
+    }
+
+    std::size_t blockSize_;
+    std::pmr::memory_resource* upstream_;
+    std::vector<Block> blocks_;
+    std::size_t current_ = 0;
+    std::size_t offset_ = 0;
+    std::size_t allocations_ = 0;
+    std::size_t bytesInUse_ = 0;
+    std::size_t peakBytesInUse_ = 0;
+    std::size_t upstreamBytes_ = 0;
+};
+
+/**
+ * @brief A thread-caching, size-class slab allocator.
+ *
+ * Small requests are rounded up to one of a fixed set of size classes. Each
+ * class carves fixed-size blocks out of slabs obtained from upstream and
+ * keeps freed blocks on a free list, so freed memory is reused immediately
+ * instead of waiting for a whole slab to empty. Every thread keeps a small
+ * magazine of free blocks per class; the shared free lists (and their
+ * mutex) are only touched when a magazine runs empty or overflows.
+ *
+ * Requests larger than the biggest class, or with an alignment stricter
+ * than alignof(std::max_align_t), go straight to upstream.
+ *
+ * Slabs are returned to upstream when the resource is destroyed. Thread
+ * caches only hold a weak reference, so a long-lived thread never keeps a
+ * dead resource's slabs alive; its stale magazines are discarded the next
+ * time it touches any SlabResource, or when it exits. Upstream must be
+ * thread-safe.
+ */
+class SlabResource : public std::pmr::memory_resource, NonCopyable {
+public:
+    static constexpr std::size_t MAX_CLASS_SIZE = 4096;
+
+    explicit SlabResource(
+        std::size_t slabSize = 64 * 1024, std::size_t magazineSize = 32,
+        std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : shared_(std::make_shared<Shared>(
+              std::max(slabSize, MAX_CLASS_SIZE * 4),
+              std::max<std::size_t>(magazineSize, 2), upstream)),
+          id_(nextId()) {}
+
+    ~SlabResource() override {
+        // Hand this thread's cached blocks back; other threads do so when
+        // they exit.
+        ThreadCaches::local().drop(id_);
+    }
+
+    [[nodiscard]] MemoryStats stats() const noexcept {
+        return shared_->counters.snapshot();
+    }
+
+    /**
+     * @brief Return the size class a request of @p bytes is served from, or
+     * 0 when it bypasses the slabs.
+     */
+    [[nodiscard]] static std::size_t classSize(std::size_t bytes) noexcept {
+        const auto index = classIndex(bytes);
+        return index < CLASS_COUNT ? CLASS_SIZES[index] : 0;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        const auto index = classIndex(bytes);
+        if (index >= CLASS_COUNT || alignment > alignof(std::max_align_t)) {
+            void* p = shared_->upstream->allocate(bytes, alignment);
+            shared_->counters.onAllocate(bytes);
+            shared_->counters.onUpstream(static_cast<std::ptrdiff_t>(bytes));
+            return p;
+        }
+        auto& magazine = cache().magazines[index];
+        if (magazine.count == 0) {
+            shared_->refill(index, magazine);
+        }
+        FreeNode* node = magazine.head;
+        magazine.head = node->next;
+        --magazine.count;
+        shared_->counters.onAllocate(CLASS_SIZES[index]);
+        return node;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes,
+                       std::size_t alignment) override {
+        const auto index = classIndex(bytes);
+        if (index >= CLASS_COUNT || alignment > alignof(std::max_align_t)) {
+            shared_->upstream->deallocate(p, bytes, alignment);
+            shared_->counters.onDeallocate(bytes);
+            shared_->counters.onUpstream(-static_cast<std::ptrdiff_t>(bytes));
+            return;
+        }
+        auto& magazine = cache().magazines[index];
+        auto* node = static_cast<FreeNode*>(p);
+        node->next = magazine.head;
+        magazine.head = node;
+        ++magazine.count;
+        shared_->counters.onDeallocate(CLASS_SIZES[index]);
+        if (magazine.count > shared_->magazineSize * 2) {
+            shared_->flush(index, magazine, shared_->magazineSize);
+        }
+    }
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    static constexpr std::array<std::size_t, 20> CLASS_SIZES = {
+        16,  32,  48,  64,   80,   96,   112,  128,  192,  256,
+        320, 384, 512, 768, 1024, 1536, 2048, 2560, 3072, 4096};
+    static constexpr std::size_t CLASS_COUNT = CLASS_SIZES.size();
+
+    static constexpr std::size_t classIndex(std::size_t bytes) noexcept {
+        if (bytes > MAX_CLASS_SIZE) {
+            return CLASS_COUNT;
+        }
+        if (bytes <= 128) {
+            return bytes == 0 ? 0 : (bytes - 1) / 16;
+        }
+        return static_cast<std::size_t>(
+            std::lower_bound(CLASS_SIZES.begin() + 8, CLASS_SIZES.end(),
+                             bytes) -
+            CLASS_SIZES.begin());
+    }
+
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct Magazine {
+        FreeNode* head = nullptr;
+        std::size_t count = 0;
+    };
+
+    struct Shared {
+        Shared(std::size_t slab, std::size_t magazine,
+               std::pmr::memory_resource* up)
+            : slabSize(slab), magazineSize(magazine), upstream(up) {}
+
+        ~Shared() {
+            for (auto& slab : slabs) {
+                upstream->deallocate(slab, slabSize, alignof(std::max_align_t));
+            }
+        }
+
+        // Move up to magazineSize blocks from the shared list (carving a new
+        // slab if needed) into the calling thread's magazine.
+        void refill(std::size_t index, Magazine& magazine) {
+            std::lock_guard lock(mutex);
+            auto& list = freeLists[index];
+            if (list.count == 0) {
+                carve(index, list);
+            }
+            std::size_t moved = 0;
+            while (list.head != nullptr && moved < magazineSize) {
+                FreeNode* node = list.head;
+                list.head = node->next;
+                node->next = magazine.head;
+                magazine.head = node;
+                ++moved;
+            }
+            list.count -= moved;
+            magazine.count += moved;
+        }
+
+        // Return blocks from a magazine until @p keep remain.
+        void flush(std::size_t index, Magazine& magazine, std::size_t keep) {
+            std::lock_guard lock(mutex);
+            auto& list = freeLists[index];
+            while (magazine.count > keep) {
+                FreeNode* node = magazine.head;
+                magazine.head = node->next;
+                node->next = list.head;
+                list.head = node;
+                --magazine.count;
+                ++list.count;
+            }
+        }
+
+        void carve(std::size_t index, Magazine& list) {
+            const std::size_t size = CLASS_SIZES[index];
+            auto* slab = static_cast<std::byte*>(
+                upstream->allocate(slabSize, alignof(std::max_align_t)));
+            slabs.push_back(slab);
+            counters.onUpstream(static_cast<std::ptrdiff_t>(slabSize));
+            const std::size_t blocks = slabSize / size;
+            for (std::size_t i = blocks; i-- > 0;) {
+                auto* node = reinterpret_cast<FreeNode*>(slab + i * size);
+                node->next = list.head;
+                list.head = node;
+            }
+            list.count += blocks;
+        }
+
+        std::size_t slabSize;
+        std::size_t magazineSize;
+        std::pmr::memory_resource* upstream;
+        std::mutex mutex;
+        std::array<Magazine, CLASS_COUNT> freeLists{};
+        std::vector<std::byte*> slabs;
+        MemoryCounters counters;
+    };
+
+    struct ThreadCache {
+        std::uint64_t id = 0;
+        std::weak_ptr<Shared> shared;
+        std::array<Magazine, CLASS_COUNT> magazines{};
+
+        // Give cached blocks back to a live resource. The blocks of a dead
+        // resource went back upstream with its slabs, so they are dropped.
+        void flushAll() {
+            auto owner = shared.lock();
+            if (!owner) {
+                return;
+            }
+            for (std::size_t i = 0; i < CLASS_COUNT; ++i) {
+                if (magazines[i].count > 0) {
+                    owner->flush(i, magazines[i], 0);
+                }
+            }
+        }
+    };
+
+    // The caches of one thread for every SlabResource it has touched.
+    class ThreadCaches {
+    public:
+        static ThreadCaches& local() {
+            thread_local ThreadCaches caches;
+            return caches;
+        }
+
+        ~ThreadCaches() {
+            for (auto& cache : caches_) {
+                cache->flushAll();
+            }
+        }
+
+        ThreadCache& get(std::uint64_t id,
+                         const std::shared_ptr<Shared>& shared) {
+            if (last_ != nullptr && last_->id == id) {
+                return *last_;
+            }
+            for (auto& cache : caches_) {
+                if (cache->id == id) {
+                    last_ = cache.get();
+                    return *last_;
+                }
+            }
+            // Forget caches of resources destroyed on other threads before
+            // registering a new one, so the list only holds live resources.
+            std::erase_if(caches_, [](const auto& cache) {
+                return cache->shared.expired();
+            });
+            auto cache = std::make_unique<ThreadCache>();
+            cache->id = id;
+            cache->shared = shared;
+            last_ = cache.get();
+            caches_.push_back(std::move(cache));
+            return *last_;
+        }
+
+        void drop(std::uint64_t id) {
+            auto it = std::find_if(
+                caches_.begin(), caches_.end(),
+                [id](const auto& cache) { return cache->id == id; });
+            if (it != caches_.end()) {
+                (*it)->flushAll();
+                if (last_ == it->get()) {
+                    last_ = nullptr;
+                }
+                caches_.erase(it);
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<ThreadCache>> caches_;
+        ThreadCache* last_ = nullptr;
+    };
+
+    static std::uint64_t nextId() noexcept {
+        static std::atomic<std::uint64_t> counter{1};
+        return counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ThreadCache& cache() { return ThreadCaches::local().get(id_, shared_); }
+
+    std::shared_ptr<Shared> shared_;
+    std::uint64_t id_;
+};
+
+}  // namespace atom::memory
+
+#endif  // ATOM_MEMORY_RESOURCE_HPP
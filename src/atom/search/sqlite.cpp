@@ -14,9 +14,273 @@ Description: Simple Sqilte3 wrapper
 
 #include "sqlite.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
 #include "atom/log/loguru.hpp"
 
-SqliteDB::SqliteDB(const char *dbPath) {
+SqliteStatementCache::SqliteStatementCache(sqlite3 *db, std::size_t capacity)
+    : m_db(db), m_capacity(capacity) {}
+
+SqliteStatementCache::~SqliteStatementCache() { clear(); }
+
+sqlite3_stmt *SqliteStatementCache::acquire(std::string_view sql) {
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_index.find(std::string(sql));
+        if (it != m_index.end()) {
+            // 取最近归还的一条，它在语句自己的缓存里最热
+            auto node = it->second.back();
+            sqlite3_stmt *stmt = node->stmt;
+            it->second.pop_back();
+            if (it->second.empty()) {
+                m_index.erase(it);
+            }
+            m_lru.erase(node);
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return stmt;
+        }
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    sqlite3_stmt *stmt = nullptr;
+    int rc = sqlite3_prepare_v3(m_db, sql.data(), static_cast<int>(sql.size()),
+                                SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return nullptr;
+    }
+    return stmt;
+}
+
+void SqliteStatementCache::release(std::string_view sql, sqlite3_stmt *stmt) {
+    if (stmt == nullptr) {
+        return;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (m_capacity == 0) {
+        sqlite3_finalize(stmt);
+        return;
+    }
+    sqlite3_stmt *victim = nullptr;
+    {
+        std::lock_guard lock(m_mutex);
+        m_lru.push_front({std::string(sql), stmt});
+        m_index[m_lru.front().sql].push_back(m_lru.begin());
+        if (m_lru.size() > m_capacity) {
+            // 表尾是全局最久未用的语句，也是它那条SQL中最早归还的一条
+            auto oldest = std::prev(m_lru.end());
+            auto it = m_index.find(oldest->sql);
+            it->second.erase(it->second.begin());
+            if (it->second.empty()) {
+                m_index.erase(it);
+            }
+            victim = oldest->stmt;
+            m_lru.erase(oldest);
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (victim != nullptr) {
+        sqlite3_finalize(victim);
+    }
+}
+
+void SqliteStatementCache::clear() {
+    std::lock_guard lock(m_mutex);
+    for (auto &idle : m_lru) {
+        sqlite3_finalize(idle.stmt);
+    }
+    m_lru.clear();
+    m_index.clear();
+}
+
+std::size_t SqliteStatementCache::size() const {
+    std::lock_guard lock(m_mutex);
+    return m_lru.size();
+}
+
+SqliteStatement::SqliteStatement(SqliteStatementCache *cache, std::string sql,
+                                 sqlite3_stmt *stmt,
+                                 std::function<void()> onRelease)
+    : m_cache(cache),
+      m_sql(std::move(sql)),
+      m_stmt(stmt),
+      m_onRelease(std::move(onRelease)) {}
+
+SqliteStatement::~SqliteStatement() { release(); }
+
+SqliteStatement::SqliteStatement(SqliteStatement &&other) noexcept
+    : m_cache(std::exchange(other.m_cache, nullptr)),
+      m_sql(std::move(other.m_sql)),
+      m_stmt(std::exchange(other.m_stmt, nullptr)),
+      m_onRelease(std::exchange(other.m_onRelease, {})) {}
+
+SqliteStatement &SqliteStatement::operator=(SqliteStatement &&other) noexcept {
+    if (this != &other) {
+        release();
+        m_cache = std::exchange(other.m_cache, nullptr);
+        m_sql = std::move(other.m_sql);
+        m_stmt = std::exchange(other.m_stmt, nullptr);
+        m_onRelease = std::exchange(other.m_onRelease, {});
+    }
+    return *this;
+}
+
+void SqliteStatement::release() {
+    if (m_stmt != nullptr) {
+        if (m_cache != nullptr) {
+            m_cache->release(m_sql, m_stmt);
+        } else {
+            sqlite3_finalize(m_stmt);
+        }
+        m_stmt = nullptr;
+    }
+    if (m_onRelease) {
+        std::exchange(m_onRelease, {})();
+    }
+}
+
+bool SqliteStatement::bind(int index, std::nullptr_t) {
+    return sqlite3_bind_null(m_stmt, index) == SQLITE_OK;
+}
+
+bool SqliteStatement::bind(int index, double value) {
+    return sqlite3_bind_double(m_stmt, index, value) == SQLITE_OK;
+}
+
+bool SqliteStatement::bind(int index, std::string_view value) {
+    return sqlite3_bind_text64(m_stmt, index, value.data(), value.size(),
+                               SQLITE_TRANSIENT, SQLITE_UTF8) == SQLITE_OK;
+}
+
+bool SqliteStatement::bind(int index, const char *value) {
+    if (value == nullptr) {
+        return bind(index, nullptr);
+    }
+    return bind(index, std::string_view(value));
+}
+
+bool SqliteStatement::bind(int index, const std::string &value) {
+    return bind(index, std::string_view(value));
+}
+
+bool SqliteStatement::bind(int index, std::span<const std::byte> value) {
+    return sqlite3_bind_blob64(m_stmt, index, value.data(), value.size(),
+                               SQLITE_TRANSIENT) == SQLITE_OK;
+}
+
+bool SqliteStatement::bind(int index, const std::vector<std::byte> &value) {
+    return bind(index, std::span<const std::byte>(value));
+}
+
+bool SqliteStatement::bind(int index, const SqliteValue &value) {
+    return std::visit(
+        [this, index](const auto &v) {
+            using T = std::decay_t<decltype(v)>;
+            if constexpr (std::is_same_v<T, std::vector<std::byte>>) {
+                return bind(index, std::span<const std::byte>(v));
+            } else {
+                return bind(index, v);
+            }
+        },
+        value);
+}
+
+bool SqliteStatement::bindRow(std::span<const SqliteValue> row) {
+    for (std::size_t i = 0; i < row.size(); ++i) {
+        if (!bind(static_cast<int>(i + 1), row[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int SqliteStatement::step() { return sqlite3_step(m_stmt); }
+
+void SqliteStatement::reset() {
+    sqlite3_reset(m_stmt);
+    sqlite3_clear_bindings(m_stmt);
+}
+
+SqliteCursor::SqliteCursor(SqliteStatement stmt,
+                           std::function<void(const char *)> errorCallback)
+    : m_stmt(std::move(stmt)), m_errorCallback(std::move(errorCallback)) {}
+
+bool SqliteCursor::next() {
+    if (!m_stmt || m_done) {
+        return false;
+    }
+    int rc = m_stmt.step();
+    if (rc == SQLITE_ROW) {
+        return true;
+    }
+    if (rc != SQLITE_DONE && m_errorCallback) {
+        m_errorCallback(sqlite3_errmsg(sqlite3_db_handle(m_stmt.get())));
+    }
+    m_done = true;
+    return false;
+}
+
+int SqliteCursor::columnCount() const {
+    return sqlite3_column_count(m_stmt.get());
+}
+
+std::string_view SqliteCursor::columnName(int column) const {
+    const char *name = sqlite3_column_name(m_stmt.get(), column);
+    return name != nullptr ? std::string_view(name) : std::string_view();
+}
+
+bool SqliteCursor::isNull(int column) const {
+    return sqlite3_column_type(m_stmt.get(), column) == SQLITE_NULL;
+}
+
+std::int64_t SqliteCursor::getInt(int column) const {
+    return sqlite3_column_int64(m_stmt.get(), column);
+}
+
+double SqliteCursor::getDouble(int column) const {
+    return sqlite3_column_double(m_stmt.get(), column);
+}
+
+std::string_view SqliteCursor::getText(int column) const {
+    const auto *text = reinterpret_cast<const char *>(
+        sqlite3_column_text(m_stmt.get(), column));
+    if (text == nullptr) {
+        return {};
+    }
+    return {text, static_cast<std::size_t>(
+                      sqlite3_column_bytes(m_stmt.get(), column))};
+}
+
+std::span<const std::byte> SqliteCursor::getBlob(int column) const {
+    const auto *blob = static_cast<const std::byte *>(
+        sqlite3_column_blob(m_stmt.get(), column));
+    if (blob == nullptr) {
+        return {};
+    }
+    return {blob, static_cast<std::size_t>(
+                      sqlite3_column_bytes(m_stmt.get(), column))};
+}
+
+SqliteValue SqliteCursor::getValue(int column) const {
+    switch (sqlite3_column_type(m_stmt.get(), column)) {
+        case SQLITE_INTEGER:
+            return getInt(column);
+        case SQLITE_FLOAT:
+            return getDouble(column);
+        case SQLITE_TEXT:
+            return std::string(getText(column));
+        case SQLITE_BLOB: {
+            auto blob = getBlob(column);
+            return std::vector<std::byte>(blob.begin(), blob.end());
+        }
+        default:
+            return nullptr;
+    }
+}
+
+SqliteDB::SqliteDB(const char *dbPath) : m_path(dbPath) {
     errorCallback = [](const char *errorMessage) {
         LOG_F(ERROR, "{}", errorMessage);
     };
@@ -26,9 +290,12 @@ SqliteDB::SqliteDB(const char *dbPath) {
     } else {
         DLOG_F(INFO, "Open database: {}", dbPath);
     }
+    m_cache = std::make_unique<SqliteStatementCache>(db);
 }
 
 SqliteDB::~SqliteDB() {
+    closeReaders();
+    m_cache.reset();
     sqlite3_close(db);
     DLOG_F(INFO, "Close database");
 }
@@ -45,56 +312,27 @@ bool SqliteDB::executeQuery(const char *query) {
 }
 
 void SqliteDB::selectData(const char *query) {
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, query, -1, &stmt, 0);
-
-    if (rc == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            // 处理查询结果
-        }
-    } else {
-        errorCallback(sqlite3_errmsg(db));
+    auto cursor = this->query(query);
+    while (cursor.next()) {
+        // 处理查询结果
     }
-
-    sqlite3_finalize(stmt);
 }
 
 int SqliteDB::getIntValue(const char *query) {
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, query, -1, &stmt, 0);
-    int result = 0;
-
-    if (rc == SQLITE_OK) {
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            result = sqlite3_column_int(stmt, 0);
-        }
-    } else {
-        errorCallback(sqlite3_errmsg(db));
+    auto cursor = this->query(query);
+    if (cursor.next()) {
+        return static_cast<int>(cursor.getInt(0));
     }
-
-    sqlite3_finalize(stmt);
-
-    return result;
+    return 0;
 }
 
 double SqliteDB::getDoubleValue(const char *query) {
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, query, -1, &stmt, 0);
-    double result = 0.0;
-
-    if (rc == SQLITE_OK) {
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            result = sqlite3_column_double(stmt, 0);
-        }
-    } else {
-        errorCallback(sqlite3_errmsg(db));
+    auto cursor = this->query(query);
+    if (cursor.next()) {
+        return cursor.getDouble(0);
     }
-
-    sqlite3_finalize(stmt);
-
-    return result;
+    return 0.0;
 }
-
 const unsigned char *SqliteDB::getTextValue(const char *query) {
     sqlite3_stmt *stmt;
     int rc = sqlite3_prepare_v2(db, query, -1, &stmt, 0);
@@ -114,17 +352,8 @@ const unsigned char *SqliteDB::getTextValue(const char *query) {
 }
 
 bool SqliteDB::searchData(const char *query, const char *searchTerm) {
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, searchTerm, -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            return true;
-        }
-    } else {
-        errorCallback(sqlite3_errmsg(db));
-    }
-    sqlite3_finalize(stmt);
-    return false;
+    auto cursor = this->query(query, searchTerm);
+    return cursor.next();
 }
 
 bool SqliteDB::updateData(const char *query) { return executeQuery(query); }
@@ -159,16 +388,159 @@ bool SqliteDB::validateData(const char *query, const char *validationQuery) {
 
 void SqliteDB::selectDataWithPagination(const char *query, int limit,
                                         int offset) {
-    // 构建带有分页的查询语句
+    // 构建带有分页的查询语句，分页参数通过绑定传入以复用预编译语句
     std::string queryWithPagination = query;
-    queryWithPagination +=
-        " LIMIT " + std::to_string(limit) + " OFFSET " + std::to_string(offset);
+    queryWithPagination += " LIMIT ? OFFSET ?";
 
     // 执行分页查询
-    selectData(queryWithPagination.c_str());
+    auto cursor = this->query(queryWithPagination, limit, offset);
+    while (cursor.next()) {
+        // 处理查询结果
+    }
 }
 
 void SqliteDB::setErrorMessageCallback(
     const std::function<void(const char *)> &errorCallback) {
     this->errorCallback = errorCallback;
 }
+
+SqliteStatement SqliteDB::prepare(std::string_view sql) {
+    sqlite3_stmt *stmt = m_cache->acquire(sql);
+    if (stmt == nullptr) {
+        errorCallback(sqlite3_errmsg(db));
+        return {};
+    }
+    return SqliteStatement(m_cache.get(), std::string(sql), stmt);
+}
+
+SqliteStatement SqliteDB::prepareReader(std::string_view sql) {
+    if (m_readers == nullptr) {
+        return prepare(sql);
+    }
+    auto pool = m_readers;
+    std::shared_ptr<ReaderConnection> reader;
+    {
+        std::unique_lock lock(pool->mutex);
+        pool->cv.wait(lock,
+                      [&pool] { return !pool->idle.empty() || pool->closed; });
+        if (pool->closed) {
+            return {};
+        }
+        reader = std::move(pool->idle.back());
+        pool->idle.pop_back();
+    }
+    // 回调持有连接池和连接本身，连接池关闭后归还的连接随回调一起释放
+    auto giveBack = [pool, reader]() mutable {
+        {
+            std::lock_guard lock(pool->mutex);
+            if (!pool->closed) {
+                pool->idle.push_back(std::move(reader));
+            }
+        }
+        pool->cv.notify_one();
+    };
+    sqlite3_stmt *stmt = reader->cache->acquire(sql);
+    if (stmt == nullptr) {
+        errorCallback(sqlite3_errmsg(reader->db));
+        giveBack();
+        return {};
+    }
+    auto *cache = reader->cache.get();
+    return SqliteStatement(cache, std::string(sql), stmt, std::move(giveBack));
+}
+
+std::size_t SqliteDB::insertBatch(std::string_view sql,
+                                  std::span<const SqliteRow> rows,
+                                  std::size_t rowsPerTransaction) {
+    if (rows.empty()) {
+        return 0;
+    }
+    auto stmt = prepare(sql);
+    if (!stmt) {
+        return 0;
+    }
+    const std::size_t chunk =
+        rowsPerTransaction == 0 ? rows.size() : rowsPerTransaction;
+    std::size_t committed = 0;
+    for (std::size_t begin = 0; begin < rows.size(); begin += chunk) {
+        const std::size_t end = std::min(begin + chunk, rows.size());
+        if (!execute("BEGIN IMMEDIATE TRANSACTION")) {
+            return committed;
+        }
+        bool ok = true;
+        for (std::size_t i = begin; i < end; ++i) {
+            if (!stmt.bindRow(rows[i]) || stmt.step() != SQLITE_DONE) {
+                handleSQLError();
+                ok = false;
+            }
+            stmt.reset();
+            if (!ok) {
+                break;
+            }
+        }
+        if (!ok || !execute("COMMIT TRANSACTION")) {
+            execute("ROLLBACK TRANSACTION");
+            return committed;
+        }
+        committed += end - begin;
+    }
+    return committed;
+}
+
+bool SqliteDB::enableWAL(std::size_t readerCount) {
+    if (m_path.empty() || m_path == ":memory:") {
+        errorCallback("WAL mode requires a file backed database");
+        return false;
+    }
+    auto cursor = query("PRAGMA journal_mode=WAL");
+    if (!cursor.next() || cursor.getText(0) != "wal") {
+        errorCallback("Failed to switch database to WAL mode");
+        return false;
+    }
+    cursor = SqliteCursor();
+    if (!execute("PRAGMA synchronous=NORMAL")) {
+        return false;
+    }
+
+    closeReaders();
+    auto pool = std::make_shared<ReaderPool>();
+    for (std::size_t i = 0; i < readerCount; ++i) {
+        auto reader = std::make_shared<ReaderConnection>();
+        int rc = sqlite3_open_v2(m_path.c_str(), &reader->db,
+                                 SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                                 nullptr);
+        if (rc != SQLITE_OK) {
+            errorCallback(sqlite3_errmsg(reader->db));
+            return false;
+        }
+        sqlite3_busy_timeout(reader->db, 5000);
+        reader->cache = std::make_unique<SqliteStatementCache>(reader->db);
+        pool->idle.push_back(std::move(reader));
+    }
+    pool->size = readerCount;
+    if (readerCount > 0) {
+        m_readers = std::move(pool);
+    }
+    DLOG_F(INFO, "Enable WAL mode with {} reader connections", readerCount);
+    return true;
+}
+
+SqliteDB::ReaderConnection::~ReaderConnection() {
+    cache.reset();
+    sqlite3_close(db);
+}
+
+void SqliteDB::closeReaders() {
+    if (m_readers == nullptr) {
+        return;
+    }
+    // 空闲连接立即关闭；借出的连接由持有它的游标在析构时关闭，不在这里等待
+    std::vector<std::shared_ptr<ReaderConnection>> idle;
+    {
+        std::lock_guard lock(m_readers->mutex);
+        m_readers->closed = true;
+        idle.swap(m_readers->idle);
+    }
+    m_readers->cv.notify_all();
+    m_readers.reset();
+}
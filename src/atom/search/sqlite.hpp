@@ -16,8 +16,290 @@ Description: Simple Sqilte3 wrapper
 #define ATOM_SEARCH_SQLITE_HPP
 
 #include <sqlite3.h>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+/**
+ * @brief SQLite绑定参数的值类型
+ */
+using SqliteValue = std::variant<std::nullptr_t, std::int64_t, double,
+                                 std::string, std::vector<std::byte>>;
+
+/**
+ * @brief 批量插入时的一行参数
+ */
+using SqliteRow = std::vector<SqliteValue>;
+
+/**
+ * @class SqliteStatementCache
+ * @brief 以SQL文本为键的预编译语句缓存，每个数据库连接一个
+ * @details 空闲语句按归还顺序排成LRU链表，超过容量时淘汰最久未用的语句。
+ */
+class SqliteStatementCache {
+public:
+    /**
+     * @brief 构造函数
+     * @param db 所属的数据库连接
+     * @param capacity 最多保留的空闲语句数量
+     */
+    explicit SqliteStatementCache(sqlite3 *db, std::size_t capacity = 64);
+
+    /**
+     * @brief 析构函数，释放所有缓存的语句
+     */
+    ~SqliteStatementCache();
+
+    SqliteStatementCache(const SqliteStatementCache &) = delete;
+    SqliteStatementCache &operator=(const SqliteStatementCache &) = delete;
+
+    /**
+     * @brief 取出一个预编译语句，缓存未命中时进行编译
+     * @param sql SQL语句
+     * @return 预编译语句，失败时返回nullptr
+     */
+    sqlite3_stmt *acquire(std::string_view sql);
+
+    /**
+     * @brief 重置语句并放回缓存
+     * @param sql 取出语句时使用的SQL文本，作为缓存的键
+     * @param stmt 由acquire取出的语句
+     */
+    void release(std::string_view sql, sqlite3_stmt *stmt);
+
+    /**
+     * @brief 释放所有空闲语句
+     */
+    void clear();
+
+    /**
+     * @brief 获取当前空闲语句数量
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief 获取缓存命中次数
+     */
+    std::size_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 获取缓存未命中(需要编译)次数
+     */
+    std::size_t misses() const {
+        return m_misses.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 获取因超过容量而被淘汰的语句数量
+     */
+    std::size_t evictions() const {
+        return m_evictions.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct IdleStatement {
+        std::string sql;
+        sqlite3_stmt *stmt;
+    };
+    using IdleList = std::list<IdleStatement>;
+
+    sqlite3 *m_db;
+    std::size_t m_capacity;
+    std::atomic<std::size_t> m_hits{0};
+    std::atomic<std::size_t> m_misses{0};
+    std::atomic<std::size_t> m_evictions{0};
+    IdleList m_lru; /**< 空闲语句，表头是最近归还的 */
+    /** 每条SQL对应的空闲语句，按归还顺序排列 */
+    std::unordered_map<std::string, std::vector<IdleList::iterator>> m_index;
+    mutable std::mutex m_mutex;
+};
+
+/**
+ * @class SqliteStatement
+ * @brief 从缓存中借出的预编译语句，析构时自动归还
+ */
+class SqliteStatement {
+public:
+    SqliteStatement() = default;
+
+    /**
+     * @brief 构造函数
+     * @param cache 语句所属的缓存
+     * @param sql 取出语句时使用的SQL文本
+     * @param stmt 预编译语句
+     * @param onRelease 语句归还后调用的回调(用于归还读连接)
+     */
+    SqliteStatement(SqliteStatementCache *cache, std::string sql,
+                    sqlite3_stmt *stmt, std::function<void()> onRelease = {});
+
+    ~SqliteStatement();
+
+    SqliteStatement(SqliteStatement &&other) noexcept;
+    SqliteStatement &operator=(SqliteStatement &&other) noexcept;
+    SqliteStatement(const SqliteStatement &) = delete;
+    SqliteStatement &operator=(const SqliteStatement &) = delete;
+
+    /**
+     * @brief 语句是否有效
+     */
+    explicit operator bool() const { return m_stmt != nullptr; }
+
+    /**
+     * @brief 获取底层的sqlite3_stmt
+     */
+    sqlite3_stmt *get() const { return m_stmt; }
+
+    /**
+     * @brief 绑定参数，索引从1开始
+     * @return 绑定是否成功
+     */
+    bool bind(int index, std::nullptr_t);
+    bool bind(int index, double value);
+    bool bind(int index, std::string_view value);
+    bool bind(int index, const char *value);
+    bool bind(int index, const std::string &value);
+    bool bind(int index, std::span<const std::byte> value);
+    bool bind(int index, const std::vector<std::byte> &value);
+    bool bind(int index, const SqliteValue &value);
+
+    template <std::integral T>
+    bool bind(int index, T value) {
+        return sqlite3_bind_int64(m_stmt, index,
+                                  static_cast<sqlite3_int64>(value)) ==
+               SQLITE_OK;
+    }
+
+    template <std::floating_point T>
+    bool bind(int index, T value) {
+        return bind(index, static_cast<double>(value));
+    }
+
+    /**
+     * @brief 按顺序绑定所有参数
+     * @return 全部绑定是否成功
+     */
+    template <typename... Args>
+    bool bindAll(const Args &...args) {
+        int index = 0;
+        return (bind(++index, args) && ...);
+    }
+
+    /**
+     * @brief 绑定一整行参数
+     * @param row 参数行
+     * @return 全部绑定是否成功
+     */
+    bool bindRow(std::span<const SqliteValue> row);
+
+    /**
+     * @brief 执行一步
+     * @return sqlite3_step的返回值
+     */
+    int step();
+
+    /**
+     * @brief 重置语句并清空绑定，以便再次执行
+     */
+    void reset();
+
+private:
+    void release();
+
+    SqliteStatementCache *m_cache = nullptr;
+    std::string m_sql;
+    sqlite3_stmt *m_stmt = nullptr;
+    std::function<void()> m_onRelease;
+};
+
+/**
+ * @class SqliteCursor
+ * @brief 流式读取查询结果的游标，不会一次性加载全部结果
+ */
+class SqliteCursor {
+public:
+    SqliteCursor() = default;
+
+    /**
+     * @brief 构造函数
+     * @param stmt 已绑定参数的语句
+     * @param errorCallback 出错时调用的回调
+     */
+    SqliteCursor(SqliteStatement stmt,
+                 std::function<void(const char *)> errorCallback);
+
+    /**
+     * @brief 游标是否有效
+     */
+    explicit operator bool() const { return static_cast<bool>(m_stmt); }
+
+    /**
+     * @brief 移动到下一行
+     * @return 是否还有数据
+     */
+    bool next();
+
+    /**
+     * @brief 结果集是否已读取完毕
+     */
+    bool done() const { return m_done; }
+
+    /**
+     * @brief 获取列数
+     */
+    int columnCount() const;
+
+    /**
+     * @brief 获取列名
+     */
+    std::string_view columnName(int column) const;
+
+    /**
+     * @brief 当前行指定列是否为NULL
+     */
+    bool isNull(int column) const;
+
+    /**
+     * @brief 获取整型列值
+     */
+    std::int64_t getInt(int column) const;
+
+    /**
+     * @brief 获取浮点型列值
+     */
+    double getDouble(int column) const;
+
+    /**
+     * @brief 获取文本列值，仅在移动到下一行之前有效
+     */
+    std::string_view getText(int column) const;
+
+    /**
+     * @brief 获取二进制列值，仅在移动到下一行之前有效
+     */
+    std::span<const std::byte> getBlob(int column) const;
+
+    /**
+     * @brief 获取列值
+     */
+    SqliteValue getValue(int column) const;
+
+private:
+    SqliteStatement m_stmt;
+    std::function<void(const char *)> m_errorCallback;
+    bool m_done = false;
+};
 
 /**
  * @class SqliteDB
@@ -26,6 +308,32 @@ Description: Simple Sqilte3 wrapper
 class SqliteDB {
 private:
     sqlite3 *db; /**< SQLite数据库连接对象 */
+    std::string m_path; /**< 数据库文件的路径 */
+    std::unique_ptr<SqliteStatementCache> m_cache; /**< 写连接的语句缓存 */
+
+    /**
+     * @brief WAL模式下的只读连接，最后一个引用释放时关闭
+     */
+    struct ReaderConnection {
+        sqlite3 *db = nullptr;
+        std::unique_ptr<SqliteStatementCache> cache;
+
+        ~ReaderConnection();
+    };
+
+    /**
+     * @brief 只读连接池。借出的语句持有连接和连接池的引用，
+     * 因此游标可以比SqliteDB活得更久，关闭连接池时不需要等待游标。
+     */
+    struct ReaderPool {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<std::shared_ptr<ReaderConnection>> idle;
+        std::size_t size = 0;
+        bool closed = false;
+    };
+
+    std::shared_ptr<ReaderPool> m_readers;
 
 public:
     /**
@@ -141,7 +449,111 @@ public:
     void setErrorMessageCallback(
         const std::function<void(const char *)> &errorCallback);
 
+    /**
+     * @brief 从语句缓存中取出预编译语句
+     * @param sql SQL语句，可包含?占位符
+     * @return 预编译语句，失败时为空
+     */
+    SqliteStatement prepare(std::string_view sql);
+
+    /**
+     * @brief 使用预编译语句和绑定参数执行一条不返回结果的语句
+     * @param sql SQL语句，可包含?占位符
+     * @param args 按顺序绑定的参数
+     * @return 执行是否成功
+     */
+    template <typename... Args>
+    bool execute(std::string_view sql, const Args &...args) {
+        auto stmt = prepare(sql);
+        if (!stmt) {
+            return false;
+        }
+        if (!stmt.bindAll(args...)) {
+            handleSQLError();
+            return false;
+        }
+        int rc = stmt.step();
+        if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
+            handleSQLError();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 在写连接上执行查询并返回流式游标
+     * @param sql SQL语句，可包含?占位符
+     * @param args 按顺序绑定的参数
+     * @return 游标，失败时为空
+     */
+    template <typename... Args>
+    SqliteCursor query(std::string_view sql, const Args &...args) {
+        auto stmt = prepare(sql);
+        if (!stmt) {
+            return {};
+        }
+        if (!stmt.bindAll(args...)) {
+            handleSQLError();
+            return {};
+        }
+        return SqliteCursor(std::move(stmt), errorCallback);
+    }
+
+    /**
+     * @brief 在读连接池上执行查询并返回流式游标
+     * @details 未启用读连接池时退化为query。游标析构前会一直占用该读连接，
+     * 数据库关闭后仍存活的游标在析构时关闭它占用的读连接。
+     * @param sql SQL语句，可包含?占位符
+     * @param args 按顺序绑定的参数
+     * @return 游标，失败时为空
+     */
+    template <typename... Args>
+    SqliteCursor read(std::string_view sql, const Args &...args) {
+        auto stmt = prepareReader(sql);
+        if (!stmt) {
+            return {};
+        }
+        if (!stmt.bindAll(args...)) {
+            errorCallback(sqlite3_errmsg(sqlite3_db_handle(stmt.get())));
+            return {};
+        }
+        return SqliteCursor(std::move(stmt), errorCallback);
+    }
+
+    /**
+     * @brief 在事务中批量执行同一条插入语句
+     * @param sql 插入语句，可包含?占位符
+     * @param rows 每行的绑定参数
+     * @param rowsPerTransaction 每个事务包含的行数，0表示全部放在一个事务中
+     * @return 成功提交的行数
+     */
+    std::size_t insertBatch(std::string_view sql,
+                            std::span<const SqliteRow> rows,
+                            std::size_t rowsPerTransaction = 0);
+
+    /**
+     * @brief 启用WAL模式并创建只读连接池
+     * @param readerCount 只读连接数量
+     * @return 是否成功启用
+     */
+    bool enableWAL(std::size_t readerCount = 2);
+
+    /**
+     * @brief 获取只读连接数量
+     */
+    std::size_t readerCount() const {
+        return m_readers != nullptr ? m_readers->size : 0;
+    }
+
+    /**
+     * @brief 获取写连接的语句缓存
+     */
+    const SqliteStatementCache &statementCache() const { return *m_cache; }
+
 private:
+    SqliteStatement prepareReader(std::string_view sql);
+    void closeReaders();
+
     std::function<void(const char *)> errorCallback =
         [](const char *errorMessage) {};
 };
@@ -17,21 +17,32 @@ Description: QuickFlatMap for C++20
 
 #include <algorithm>
 #include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
-template <typename Key, typename Value, typename Comparator = std::equal_to<>>
+template <typename Key, typename Value, typename Comparator = std::equal_to<>,
+          typename Allocator = std::allocator<std::pair<Key, Value>>>
 class QuickFlatMap {
 public:
     using value_type = std::pair<Key, Value>;
-    using iterator = typename std::vector<value_type>::iterator;
-    using const_iterator = typename std::vector<value_type>::const_iterator;
+    using allocator_type = Allocator;
+    using container_type = std::vector<value_type, Allocator>;
+    using iterator = typename container_type::iterator;
+    using const_iterator = typename container_type::const_iterator;
 
     QuickFlatMap() = default;
 
+    explicit QuickFlatMap(const Allocator &alloc) : data(alloc) {}
+
+    allocator_type get_allocator() const noexcept {
+        return data.get_allocator();
+    }
+
     template <typename Lookup>
     iterator find(const Lookup &s) noexcept {
         return std::find_if(
@@ -138,19 +149,28 @@ public:
     }
 
 private:
-    std::vector<value_type> data;
+    container_type data;
     Comparator comparator;
 };
 
-template <typename Key, typename Value, typename Comparator = std::equal_to<>>
+template <typename Key, typename Value, typename Comparator = std::equal_to<>,
+          typename Allocator = std::allocator<std::pair<Key, Value>>>
 class QuickFlatMultiMap {
 public:
     using value_type = std::pair<Key, Value>;
-    using iterator = typename std::vector<value_type>::iterator;
-    using const_iterator = typename std::vector<value_type>::const_iterator;
+    using allocator_type = Allocator;
+    using container_type = std::vector<value_type, Allocator>;
+    using iterator = typename container_type::iterator;
+    using const_iterator = typename container_type::const_iterator;
 
     QuickFlatMultiMap() = default;
 
+    explicit QuickFlatMultiMap(const Allocator &alloc) : data(alloc) {}
+
+    allocator_type get_allocator() const noexcept {
+        return data.get_allocator();
+    }
+
     template <typename Lookup>
     iterator find(const Lookup &s) noexcept {
         return std::find_if(
@@ -258,8 +278,18 @@ public:
     }
 
 private:
-    std::vector<value_type> data;
+    container_type data;
     Comparator comparator;
 };
 
+template <typename Key, typename Value, typename Comparator = std::equal_to<>>
+using PmrQuickFlatMap =
+    QuickFlatMap<Key, Value, Comparator,
+                 std::pmr::polymorphic_allocator<std::pair<Key, Value>>>;
+
+template <typename Key, typename Value, typename Comparator = std::equal_to<>>
+using PmrQuickFlatMultiMap =
+    QuickFlatMultiMap<Key, Value, Comparator,
+                      std::pmr::polymorphic_allocator<std::pair<Key, Value>>>;
+
 #endif  // ATOM_TYPE_FLATMAP_HPP
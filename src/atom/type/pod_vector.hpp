@@ -3,9 +3,12 @@
 
 #include <algorithm>
 #include <concepts>
+#include <cstdlib>
 #include <cstring>
 #include <initializer_list>
 #include <memory>
+#include <memory_resource>
+#include <new>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -14,12 +17,41 @@ namespace atom::type {
 template <typename T>
 concept PodType = std::is_trivial_v<T> && std::is_standard_layout_v<T>;
 
-void* pool64_alloc(std::size_t size) { return std::malloc(size); }
+inline void* pool64_alloc(std::size_t size) { return std::malloc(size); }
 
-void pool64_dealloc(void* ptr) { std::free(ptr); }
+inline void pool64_dealloc(void* ptr) { std::free(ptr); }
 
-template <PodType T, int Growth = 2>
+/**
+ * @brief The default pod_vector allocator, backed by pool64_alloc so that
+ * buffers returned by detach() can be released with pool64_dealloc.
+ */
+template <typename T>
+struct pool64_allocator {
+    using value_type = T;
+
+    pool64_allocator() noexcept = default;
+    template <typename U>
+    pool64_allocator(const pool64_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        void* p = pool64_alloc(n * sizeof(T));
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t) noexcept { pool64_dealloc(p); }
+
+    template <typename U>
+    bool operator==(const pool64_allocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+template <PodType T, int Growth = 2, typename Allocator = pool64_allocator<T>>
 struct pod_vector {
+    using alloc_traits = std::allocator_traits<Allocator>;
+
     static constexpr int SizeT = sizeof(T);
     static constexpr int N = 64 / SizeT;
 
@@ -28,46 +60,104 @@ struct pod_vector {
     int _size;
     int _capacity;
     T* _data;
+    [[no_unique_address]] Allocator _alloc;
 
     using size_type = int;
+    using allocator_type = Allocator;
 
-    pod_vector() : _size(0), _capacity(N) {
-        _data = static_cast<T*>(pool64_alloc(_capacity * SizeT));
+    pod_vector() : pod_vector(Allocator()) {}
+
+    explicit pod_vector(const Allocator& alloc)
+        : _size(0), _capacity(N), _alloc(alloc) {
+        _data = alloc_traits::allocate(_alloc, _capacity);
     }
 
-    pod_vector(std::initializer_list<T> il)
-        : _size(il.size()), _capacity(std::max(N, _size)) {
-        _data = static_cast<T*>(pool64_alloc(_capacity * SizeT));
+    pod_vector(std::initializer_list<T> il,
+               const Allocator& alloc = Allocator())
+        : _size(il.size()), _capacity(std::max(N, _size)), _alloc(alloc) {
+        _data = alloc_traits::allocate(_alloc, _capacity);
         std::copy(il.begin(), il.end(), _data);
     }
 
-    explicit pod_vector(int size) : _size(size), _capacity(std::max(N, size)) {
-        _data = static_cast<T*>(pool64_alloc(_capacity * SizeT));
+    explicit pod_vector(int size, const Allocator& alloc = Allocator())
+        : _size(size), _capacity(std::max(N, size)), _alloc(alloc) {
+        _data = alloc_traits::allocate(_alloc, _capacity);
     }
 
     pod_vector(const pod_vector& other)
-        : _size(other._size), _capacity(other._capacity) {
-        _data = static_cast<T*>(pool64_alloc(_capacity * SizeT));
+        : _size(other._size),
+          _capacity(other._capacity),
+          _alloc(alloc_traits::select_on_container_copy_construction(
+              other._alloc)) {
+        _data = alloc_traits::allocate(_alloc, _capacity);
         std::memcpy(_data, other._data, SizeT * _size);
     }
 
     pod_vector(pod_vector&& other) noexcept
-        : _size(other._size), _capacity(other._capacity), _data(other._data) {
+        : _size(other._size),
+          _capacity(other._capacity),
+          _data(other._data),
+          _alloc(other._alloc) {
         other._data = nullptr;
     }
 
-    pod_vector& operator=(pod_vector&& other) noexcept {
-        if (this != &other) {
+    // Buffers are handed over by pointer only between equal allocators (or
+    // when the allocator propagates); otherwise the elements are copied into
+    // storage from this vector's own allocator.
+    pod_vector& operator=(pod_vector&& other) noexcept(
+        alloc_traits::propagate_on_container_move_assignment::value ||
+        alloc_traits::is_always_equal::value) {
+        if (this == &other)
+            return *this;
+        bool steal = true;
+        if constexpr (alloc_traits::propagate_on_container_move_assignment::
+                          value) {
             if (_data != nullptr)
-                pool64_dealloc(_data);
+                alloc_traits::deallocate(_alloc, _data, _capacity);
+            _data = nullptr;
+            _alloc = std::move(other._alloc);
+        } else {
+            steal = _alloc == other._alloc;
+        }
+        if (steal) {
+            if (_data != nullptr)
+                alloc_traits::deallocate(_alloc, _data, _capacity);
             _size = other._size;
             _capacity = other._capacity;
             _data = other._data;
             other._data = nullptr;
+            return *this;
+        }
+        if (_data == nullptr || other._size > _capacity) {
+            if (_data != nullptr)
+                alloc_traits::deallocate(_alloc, _data, _capacity);
+            _capacity = std::max(N, other._size);
+            _data = alloc_traits::allocate(_alloc, _capacity);
         }
+        std::memcpy(_data, other._data, SizeT * other._size);
+        _size = other._size;
         return *this;
     }
 
+    friend void swap(pod_vector& lhs, pod_vector& rhs) noexcept(
+        alloc_traits::propagate_on_container_swap::value ||
+        alloc_traits::is_always_equal::value) {
+        if constexpr (alloc_traits::propagate_on_container_swap::value) {
+            std::swap(lhs._alloc, rhs._alloc);
+        } else if (!(lhs._alloc == rhs._alloc)) {
+            pod_vector tmp(lhs._alloc);
+            tmp.extend(lhs.begin(), lhs.end());
+            lhs.clear();
+            lhs.extend(rhs.begin(), rhs.end());
+            rhs.clear();
+            rhs.extend(tmp.begin(), tmp.end());
+            return;
+        }
+        std::swap(lhs._size, rhs._size);
+        std::swap(lhs._capacity, rhs._capacity);
+        std::swap(lhs._data, rhs._data);
+    }
+
     pod_vector& operator=(const pod_vector& other) = delete;
 
     template <typename __ValueT>
@@ -87,12 +177,13 @@ struct pod_vector {
     void reserve(int cap) {
         if (cap <= _capacity)
             return;
+        const int old_capacity = _capacity;
         _capacity = cap;
         T* old_data = _data;
-        _data = static_cast<T*>(pool64_alloc(_capacity * SizeT));
+        _data = alloc_traits::allocate(_alloc, _capacity);
         if (old_data != nullptr) {
             std::memcpy(_data, old_data, SizeT * _size);
-            pool64_dealloc(old_data);
+            alloc_traits::deallocate(_alloc, old_data, old_capacity);
         }
     }
 
@@ -153,6 +244,10 @@ struct pod_vector {
         _size = size;
     }
 
+    /**
+     * @brief Release ownership of the buffer. It must be freed with the
+     * vector's allocator (pool64_dealloc for the default allocator).
+     */
     std::pair<T*, int> detach() noexcept {
         T* p = _data;
         int size = _size;
@@ -161,12 +256,20 @@ struct pod_vector {
         return {p, size};
     }
 
+    allocator_type get_allocator() const noexcept { return _alloc; }
+
     ~pod_vector() {
         if (_data != nullptr)
-            pool64_dealloc(_data);
+            alloc_traits::deallocate(_alloc, _data, _capacity);
     }
 };
 
+namespace pmr {
+template <PodType T, int Growth = 2>
+using pod_vector =
+    atom::type::pod_vector<T, Growth, std::pmr::polymorphic_allocator<T>>;
+}  // namespace pmr
+
 template <typename T, typename Container = std::vector<T>>
 class stack {
     Container vec;
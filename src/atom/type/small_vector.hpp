@@ -19,14 +19,20 @@ Description: A Small Vector Implementation
 #include <array>
 #include <cstddef>
 #include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <numeric>
 #include <stdexcept>
 #include <type_traits>
 
-template <typename T, std::size_t N>
+template <typename T, std::size_t N, typename Allocator = std::allocator<T>>
 class SmallVector {
+    using alloc_traits = std::allocator_traits<Allocator>;
+
 public:
     using value_type = T;
+    using allocator_type = Allocator;
     using size_type = std::size_t;
     using difference_type = std::ptrdiff_t;
     using reference = value_type&;
@@ -40,6 +46,8 @@ public:
 
     SmallVector() = default;
 
+    explicit SmallVector(const Allocator& alloc) noexcept : alloc_(alloc) {}
+
     template <typename InputIt,
               typename = std::enable_if_t<!std::is_integral_v<InputIt>>>
     SmallVector(InputIt first, InputIt last) {
@@ -55,13 +63,21 @@ public:
         assign(first, last);
     }
 
-    SmallVector(std::initializer_list<T> init) { assign(init); }
+    SmallVector(std::initializer_list<T> init,
+                const Allocator& alloc = Allocator())
+        : alloc_(alloc) {
+        assign(init);
+    }
 
-    SmallVector(const SmallVector& other) {
+    SmallVector(const SmallVector& other)
+        : alloc_(alloc_traits::select_on_container_copy_construction(
+              other.alloc_)) {
         assign(other.begin(), other.end());
     }
 
-    SmallVector(SmallVector&& other) noexcept { move(std::move(other)); }
+    SmallVector(SmallVector&& other) noexcept : alloc_(other.alloc_) {
+        move(std::move(other));
+    }
 
     ~SmallVector() {
         clear();
@@ -79,6 +95,11 @@ public:
         if (this != &other) {
             clear();
             deallocate();
+            capacity_ = N;
+            if constexpr (alloc_traits::propagate_on_container_move_assignment::
+                              value) {
+                alloc_ = other.alloc_;
+            }
             move(std::move(other));
         }
         return *this;
@@ -93,7 +114,8 @@ public:
         clear();
         if (count > capacity()) {
             deallocate();
-            allocate(count);
+            data_ = allocate(count);
+            capacity_ = count;
         }
         std::fill_n(begin(), count, value);
         size_ = count;
@@ -105,7 +127,8 @@ public:
         size_type count = std::distance(first, last);
         if (count > capacity()) {
             deallocate();
-            allocate(count);
+            data_ = allocate(count);
+            capacity_ = count;
         }
         std::copy(first, last, begin());
         size_ = count;
@@ -307,22 +330,35 @@ public:
         }
     }
 
-    void swap(SmallVector& other) noexcept {
+    // Heap buffers are exchanged by pointer only when the allocators are
+    // equal (or propagate on swap); otherwise the elements are moved into
+    // storage owned by each vector's own allocator.
+    void swap(SmallVector& other) noexcept(
+        alloc_traits::propagate_on_container_swap::value ||
+        alloc_traits::is_always_equal::value) {
         using std::swap;
+        if constexpr (alloc_traits::propagate_on_container_swap::value) {
+            swap(alloc_, other.alloc_);
+        } else if (!(alloc_ == other.alloc_)) {
+            SmallVector mine(alloc_);
+            mine.assign(std::make_move_iterator(begin()),
+                        std::make_move_iterator(end()));
+            assign(std::make_move_iterator(other.begin()),
+                   std::make_move_iterator(other.end()));
+            other.assign(std::make_move_iterator(mine.begin()),
+                         std::make_move_iterator(mine.end()));
+            return;
+        }
         if (capacity() > N && other.capacity() > N) {
             swap(data_, other.data_);
         } else if (capacity() > N) {
-            T* temp_data = data_;
-            data_ = other.allocate(capacity());
-            std::move(other.begin(), other.end(), data_);
-            other.deallocate();
-            other.data_ = temp_data;
+            std::move(other.begin(), other.end(), static_buffer_.begin());
+            other.data_ = data_;
+            data_ = nullptr;
         } else if (other.capacity() > N) {
-            T* temp_data = other.data_;
-            other.data_ = allocate(other.capacity());
-            std::move(begin(), end(), other.data_);
-            deallocate();
-            data_ = temp_data;
+            std::move(begin(), end(), other.static_buffer_.begin());
+            data_ = other.data_;
+            other.data_ = nullptr;
         } else {
             swap(static_buffer_, other.static_buffer_);
         }
@@ -330,26 +366,31 @@ public:
         swap(capacity_, other.capacity_);
     }
 
+    allocator_type get_allocator() const noexcept { return alloc_; }
+
 private:
-    T* allocate(size_type n) {
-        return static_cast<T*>(::operator new(n * sizeof(T)));
-    }
+    T* allocate(size_type n) { return alloc_traits::allocate(alloc_, n); }
 
     void deallocate() {
         if (capacity() > N) {
-            ::operator delete(data_);
+            alloc_traits::deallocate(alloc_, data_, capacity_);
         }
     }
 
     void move(SmallVector&& other) {
-        if (other.capacity() > N) {
+        if (other.capacity() > N && alloc_ == other.alloc_) {
             data_ = other.data_;
             other.data_ = nullptr;
+            capacity_ = other.capacity_;
         } else {
+            if (other.size() > N) {
+                data_ = allocate(other.size());
+                capacity_ = other.size();
+            }
             std::move(other.begin(), other.end(), begin());
+            other.deallocate();
         }
         size_ = other.size_;
-        capacity_ = other.capacity_;
         other.size_ = 0;
         other.capacity_ = N;
     }
@@ -358,42 +399,53 @@ private:
     size_type capacity_ = N;
     std::array<T, N> static_buffer_;
     T* data_ = nullptr;
+    [[no_unique_address]] Allocator alloc_;
 };
 
 template <typename T, std::size_t N>
-bool operator==(const SmallVector<T, N>& lhs, const SmallVector<T, N>& rhs) {
+using PmrSmallVector = SmallVector<T, N, std::pmr::polymorphic_allocator<T>>;
+
+template <typename T, std::size_t N, typename A>
+bool operator==(const SmallVector<T, N, A>& lhs,
+                const SmallVector<T, N, A>& rhs) {
     return lhs.size() == rhs.size() &&
            std::equal(lhs.begin(), lhs.end(), rhs.begin());
 }
 
-template <typename T, std::size_t N>
-bool operator!=(const SmallVector<T, N>& lhs, const SmallVector<T, N>& rhs) {
+template <typename T, std::size_t N, typename A>
+bool operator!=(const SmallVector<T, N, A>& lhs,
+                const SmallVector<T, N, A>& rhs) {
     return !(lhs == rhs);
 }
 
-template <typename T, std::size_t N>
-bool operator<(const SmallVector<T, N>& lhs, const SmallVector<T, N>& rhs) {
+template <typename T, std::size_t N, typename A>
+bool operator<(const SmallVector<T, N, A>& lhs,
+               const SmallVector<T, N, A>& rhs) {
     return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(),
                                         rhs.end());
 }
 
-template <typename T, std::size_t N>
-bool operator<=(const SmallVector<T, N>& lhs, const SmallVector<T, N>& rhs) {
+template <typename T, std::size_t N, typename A>
+bool operator<=(const SmallVector<T, N, A>& lhs,
+                const SmallVector<T, N, A>& rhs) {
     return !(rhs < lhs);
 }
 
-template <typename T, std::size_t N>
-bool operator>(const SmallVector<T, N>& lhs, const SmallVector<T, N>& rhs) {
+template <typename T, std::size_t N, typename A>
+bool operator>(const SmallVector<T, N, A>& lhs,
+               const SmallVector<T, N, A>& rhs) {
     return rhs < lhs;
 }
 
-template <typename T, std::size_t N>
-bool operator>=(const SmallVector<T, N>& lhs, const SmallVector<T, N>& rhs) {
+template <typename T, std::size_t N, typename A>
+bool operator>=(const SmallVector<T, N, A>& lhs,
+                const SmallVector<T, N, A>& rhs) {
     return !(lhs < rhs);
 }
 
-template <typename T, std::size_t N>
-void swap(SmallVector<T, N>& lhs, SmallVector<T, N>& rhs) noexcept {
+template <typename T, std::size_t N, typename A>
+void swap(SmallVector<T, N, A>& lhs,
+          SmallVector<T, N, A>& rhs) noexcept(noexcept(lhs.swap(rhs))) {
     lhs.swap(rhs);
 }
 
@@ -18,6 +18,7 @@ Description: Smart Switch just like javascript
 #include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 #if ENABLE_FASTHASH
@@ -48,7 +49,7 @@ public:
     // Register a case with the given string and function
     void registerCase(const std::string &str, Func func) {
         if (cases_.find(str) != cases_.end()) {
-            throw Error::ObjectAlreadyExist("Case already registered");
+            THROW_OBJ_ALREADY_EXIST("Case already registered");
         }
         cases_[str] = std::move(func);  // Use move semantics for efficiency
     }
@@ -59,9 +60,15 @@ public:
     // Clear all registered cases
     void clearCases() { cases_.clear(); }
 
-    // Match the given string against the registered cases
-    bool match(const std::string &str, Args... args) {
+    // Match the given string against the registered cases. Lookups take a
+    // string_view, so dispatching on a C string (e.g. a property name)
+    // hashes it once and does not build a temporary std::string.
+    bool match(std::string_view str, Args... args) {
+#if ENABLE_FASTHASH
+        auto iter = cases_.find(std::string(str));
+#else
         auto iter = cases_.find(str);
+#endif
         if (iter != cases_.end()) {
             std::invoke(iter->second, args...);
             return true;
@@ -93,7 +100,7 @@ public:
     template <typename T,
               typename = std::enable_if_t<std::is_invocable_v<T, Args...>>>
     void registerCase(const std::string &str, T &&func) {
-        registerCase(str, std::forward<T>(func));
+        registerCase(str, Func(std::forward<T>(func)));
     }
 
     // C++20 designated initializers for easier case registration
@@ -107,7 +114,13 @@ private:
 #if ENABLE_FASTHASH
     emhash8::HashMap<std::string, Func> cases_;
 #else
-    std::unordered_map<std::string, Func> cases_;
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+    std::unordered_map<std::string, Func, StringHash, std::equal_to<>> cases_;
 #endif
     DefaultFunc defaultFunc_;
 };
@@ -0,0 +1,102 @@
+/*
+ * consumers.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-29
+
+Description: Common stages for the video capture pipeline
+
+**************************************************/
+
+#include "consumers.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace atom::video {
+CallbackConsumer::CallbackConsumer(std::string name, Callback callback)
+    : name_(std::move(name)), callback_(std::move(callback)) {}
+
+void CallbackConsumer::consume(const FrameHandle &frame) {
+    if (callback_) {
+        callback_(frame);
+    }
+}
+
+PreviewDecimator::PreviewDecimator(double max_fps, Callback callback)
+    : interval_(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::duration<double>(max_fps > 0 ? 1.0 / max_fps : 0.0))),
+      callback_(std::move(callback)) {}
+
+void PreviewDecimator::consume(const FrameHandle &frame) {
+    auto timestamp = frame.info().timestamp;
+    if (last_ != std::chrono::system_clock::time_point{} &&
+        timestamp - last_ < interval_) {
+        return;
+    }
+    last_ = timestamp;
+    if (callback_) {
+        callback_(frame);
+    }
+}
+
+namespace {
+template <typename Sample>
+double gradientScore(const std::uint8_t *data, std::size_t width,
+                     std::size_t height, std::size_t channels,
+                     std::size_t step) {
+    auto at = [&](std::size_t x, std::size_t y) {
+        Sample value;
+        auto offset = (y * width + x) * channels * sizeof(Sample);
+        std::memcpy(&value, data + offset, sizeof(Sample));
+        return static_cast<double>(value);
+    };
+    double sum = 0.0;
+    std::size_t count = 0;
+    for (std::size_t y = 0; y + step < height; y += step) {
+        for (std::size_t x = 0; x + step < width; x += step) {
+            double centre = at(x, y);
+            double dx = at(x + step, y) - centre;
+            double dy = at(x, y + step) - centre;
+            sum += dx * dx + dy * dy;
+            ++count;
+        }
+    }
+    return count ? sum / static_cast<double>(count) : 0.0;
+}
+}  // namespace
+
+QualityScorer::QualityScorer(Callback callback, std::size_t step)
+    : callback_(std::move(callback)), step_(std::max<std::size_t>(1, step)) {}
+
+void QualityScorer::consume(const FrameHandle &frame) {
+    auto value = score(frame, step_);
+    if (callback_) {
+        callback_(frame, value);
+    }
+}
+
+double QualityScorer::score(const FrameHandle &frame, std::size_t step) {
+    if (!frame) {
+        return 0.0;
+    }
+    const auto &geometry = frame.info().geometry;
+    if (geometry.bytes() == 0 || frame.size() < geometry.bytes() ||
+        geometry.bytesPerSample() > 2) {
+        return 0.0;
+    }
+    step = std::max<std::size_t>(1, step);
+    if (geometry.bytesPerSample() == 1) {
+        return gradientScore<std::uint8_t>(frame.data(), geometry.width,
+                                           geometry.height, geometry.channels,
+                                           step);
+    }
+    return gradientScore<std::uint16_t>(frame.data(), geometry.width,
+                                        geometry.height, geometry.channels,
+                                        step);
+}
+}  // namespace atom::video
@@ -0,0 +1,85 @@
+/*
+ * consumers.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-29
+
+Description: Common stages for the video capture pipeline
+
+**************************************************/
+
+#ifndef ATOM_VIDEO_CONSUMERS_HPP
+#define ATOM_VIDEO_CONSUMERS_HPP
+
+#include <functional>
+
+#include "pipeline.hpp"
+
+namespace atom::video {
+/**
+ * @brief Hands every frame to a callback.
+ */
+class CallbackConsumer : public FrameConsumer {
+public:
+    using Callback = std::function<void(const FrameHandle &)>;
+
+    CallbackConsumer(std::string name, Callback callback);
+
+    std::string name() const override { return name_; }
+    void consume(const FrameHandle &frame) override;
+
+private:
+    std::string name_;
+    Callback callback_;
+};
+
+/**
+ * @brief Forwards at most `max_fps` frames per second, e.g. to a preview
+ * that cannot redraw at the capture rate. Pacing follows the frame
+ * timestamps, not the time the frame reaches this stage.
+ */
+class PreviewDecimator : public FrameConsumer {
+public:
+    using Callback = std::function<void(const FrameHandle &)>;
+
+    PreviewDecimator(double max_fps, Callback callback);
+
+    std::string name() const override { return "preview"; }
+    void consume(const FrameHandle &frame) override;
+
+private:
+    std::chrono::system_clock::duration interval_;
+    std::chrono::system_clock::time_point last_;
+    Callback callback_;
+};
+
+/**
+ * @brief Scores the sharpness of every frame for lucky imaging.
+ *
+ * The score is the mean squared gradient of the first channel sampled on a
+ * grid of `step` pixels, which tracks seeing well and costs a fraction of a
+ * full-frame pass. Higher is sharper; scores are only comparable between
+ * frames of the same target and exposure.
+ */
+class QualityScorer : public FrameConsumer {
+public:
+    using Callback = std::function<void(const FrameHandle &, double)>;
+
+    explicit QualityScorer(Callback callback, std::size_t step = 2);
+
+    std::string name() const override { return "quality"; }
+    void consume(const FrameHandle &frame) override;
+
+    static double score(const FrameHandle &frame, std::size_t step = 2);
+
+private:
+    Callback callback_;
+    std::size_t step_;
+};
+}  // namespace atom::video
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * pipeline.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-29
+
+Description: Streaming video capture pipeline for camera drivers
+
+**************************************************/
+
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "atom/async/spsc_queue.hpp"
+#include "atom/log/loguru.hpp"
+
+namespace atom::video {
+bool pinThread(std::thread &thread, int cpu) {
+    if (cpu < 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return SetThreadAffinityMask(thread.native_handle(),
+                                 DWORD_PTR{1} << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) ==
+           0;
+#else
+    return false;
+#endif
+}
+
+class CapturePipeline::Impl {
+public:
+    struct Stage {
+        Stage(std::shared_ptr<FrameConsumer> consumer, int cpu,
+              std::size_t depth)
+            : consumer(std::move(consumer)), cpu(cpu), queue(depth) {}
+
+        std::shared_ptr<FrameConsumer> consumer;
+        int cpu;
+        atom::async::SpscQueue<FrameHandle> queue;
+        /* Bumped after every push so an idle consumer can sleep on it. */
+        std::atomic<std::uint32_t> signal{0};
+        std::atomic<std::uint64_t> processed{0};
+        std::atomic<std::uint64_t> dropped{0};
+        std::thread thread;
+    };
+
+    Impl(std::shared_ptr<FrameSource> source, Options options)
+        : source_(std::move(source)), options_(options) {}
+
+    ~Impl() { stop(); }
+
+    bool addConsumer(std::shared_ptr<FrameConsumer> consumer, int cpu) {
+        std::scoped_lock lock(mutex_);
+        if (running_ || !consumer) {
+            return false;
+        }
+        stages_.push_back(std::make_unique<Stage>(
+            std::move(consumer), cpu,
+            std::max<std::size_t>(1, options_.queue_depth)));
+        return true;
+    }
+
+    bool start() {
+        std::scoped_lock lock(mutex_);
+        if (running_) {
+            return true;
+        }
+        if (!source_->start()) {
+            LOG_F(ERROR, "CapturePipeline: frame source failed to start");
+            return false;
+        }
+        stopping_ = false;
+        captureDone_ = false;
+        captured_ = 0;
+        sourceDroppedBase_ = source_->droppedFrames();
+        started_ = std::chrono::steady_clock::now();
+        for (auto &stage : stages_) {
+            stage->processed = 0;
+            stage->dropped = 0;
+            stage->thread = std::thread([this, raw = stage.get()] {
+                consumeLoop(*raw);
+            });
+            pinThread(stage->thread, stage->cpu);
+        }
+        captureThread_ = std::thread([this] { captureLoop(); });
+        pinThread(captureThread_, options_.capture_cpu);
+        running_ = true;
+        LOG_F(INFO, "CapturePipeline started with {} consumer(s)",
+              stages_.size());
+        return true;
+    }
+
+    void stop() {
+        std::scoped_lock lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        stopping_ = true;
+        captureThread_.join();
+        source_->stop();
+        captureDone_.store(true, std::memory_order_release);
+        for (auto &stage : stages_) {
+            stage->signal.fetch_add(1, std::memory_order_release);
+            stage->signal.notify_one();
+            stage->thread.join();
+        }
+        stopped_ = std::chrono::steady_clock::now();
+        running_ = false;
+        LOG_F(INFO, "CapturePipeline stopped after {} frames",
+              captured_.load());
+    }
+
+    bool isRunning() const {
+        std::scoped_lock lock(mutex_);
+        return running_;
+    }
+
+    PipelineStats stats() const {
+        std::scoped_lock lock(mutex_);
+        PipelineStats stats;
+        stats.captured = captured_.load();
+        stats.source_dropped = source_->droppedFrames() - sourceDroppedBase_;
+        auto end = running_ ? std::chrono::steady_clock::now() : stopped_;
+        std::chrono::duration<double> elapsed = end - started_;
+        if (elapsed.count() > 0) {
+            stats.fps = static_cast<double>(stats.captured) / elapsed.count();
+        }
+        for (const auto &stage : stages_) {
+            stats.consumers.push_back({stage->consumer->name(),
+                                       stage->processed.load(),
+                                       stage->dropped.load(),
+                                       stage->queue.size()});
+        }
+        return stats;
+    }
+
+private:
+    void captureLoop() {
+        std::uint64_t sequence = 0;
+        while (!stopping_.load(std::memory_order_acquire)) {
+            auto frame = source_->read(options_.read_timeout);
+            if (!frame) {
+                continue;
+            }
+            auto &info = frame.info();
+            info.sequence = ++sequence;
+            if (info.timestamp == std::chrono::system_clock::time_point{}) {
+                info.timestamp = std::chrono::system_clock::now();
+            }
+            captured_.fetch_add(1, std::memory_order_relaxed);
+            for (auto &stage : stages_) {
+                if (stage->queue.tryPush(frame)) {
+                    stage->signal.fetch_add(1, std::memory_order_release);
+                    stage->signal.notify_one();
+                } else {
+                    stage->dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    void consumeLoop(Stage &stage) {
+        try {
+            stage.consumer->begin();
+        } catch (const std::exception &e) {
+            LOG_F(ERROR, "CapturePipeline: {} failed to begin: {}",
+                  stage.consumer->name(), e.what());
+        }
+        while (true) {
+            /* Load the signal before looking at the queue so a push that
+             * lands in between makes the wait below return at once. */
+            auto seen = stage.signal.load(std::memory_order_acquire);
+            if (auto frame = stage.queue.tryPop()) {
+                try {
+                    stage.consumer->consume(*frame);
+                } catch (const std::exception &e) {
+                    LOG_F(ERROR, "CapturePipeline: {} failed on frame {}: {}",
+                          stage.consumer->name(), frame->info().sequence,
+                          e.what());
+                }
+                stage.processed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (captureDone_.load(std::memory_order_acquire)) {
+                /* No more pushes can happen, so an empty queue is final. */
+                if (stage.queue.empty()) {
+                    break;
+                }
+                continue;
+            }
+            stage.signal.wait(seen, std::memory_order_acquire);
+        }
+        try {
+            stage.consumer->end();
+        } catch (const std::exception &e) {
+            LOG_F(ERROR, "CapturePipeline: {} failed to end: {}",
+                  stage.consumer->name(), e.what());
+        }
+    }
+
+    std::shared_ptr<FrameSource> source_;
+    Options options_;
+
+    mutable std::mutex mutex_;
+    bool running_ = false;
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> captureDone_{false};
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::thread captureThread_;
+
+    std::atomic<std::uint64_t> captured_{0};
+    std::uint64_t sourceDroppedBase_ = 0;
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point stopped_;
+};
+
+CapturePipeline::CapturePipeline(std::shared_ptr<FrameSource> source)
+    : CapturePipeline(std::move(source), Options{}) {}
+
+CapturePipeline::CapturePipeline(std::shared_ptr<FrameSource> source,
+                                 Options options)
+    : impl_(std::make_unique<Impl>(std::move(source), options)) {}
+
+CapturePipeline::~CapturePipeline() = default;
+
+bool CapturePipeline::addConsumer(std::shared_ptr<FrameConsumer> consumer,
+                                  int cpu) {
+    return impl_->addConsumer(std::move(consumer), cpu);
+}
+
+bool CapturePipeline::start() { return impl_->start(); }
+
+void CapturePipeline::stop() { impl_->stop(); }
+
+bool CapturePipeline::isRunning() const { return impl_->isRunning(); }
+
+PipelineStats CapturePipeline::stats() const { return impl_->stats(); }
+}  // namespace atom::video
@@ -0,0 +1,149 @@
+/*
+ * pipeline.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-29
+
+Description: Streaming video capture pipeline for camera drivers
+
+**************************************************/
+
+#ifndef ATOM_VIDEO_PIPELINE_HPP
+#define ATOM_VIDEO_PIPELINE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "atom/memory/framebuffer.hpp"
+
+namespace atom::video {
+using atom::memory::FrameHandle;
+
+/**
+ * @brief Where frames come from, typically a camera in video mode.
+ */
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    /** Start streaming. */
+    virtual bool start() = 0;
+
+    /** Stop streaming; read() may still return frames already captured. */
+    virtual void stop() = 0;
+
+    /**
+     * @brief Wait up to `timeout` for the next frame.
+     * @return An empty handle if no frame arrived in time.
+     */
+    virtual FrameHandle read(std::chrono::milliseconds timeout) = 0;
+
+    /** Frames lost before they reached read(), e.g. no free buffer. */
+    virtual std::uint64_t droppedFrames() const { return 0; }
+};
+
+/**
+ * @brief A pipeline stage fed with every captured frame.
+ *
+ * Each consumer runs on its own thread. Frames are shared handles, so
+ * consume() must not modify the pixels.
+ */
+class FrameConsumer {
+public:
+    virtual ~FrameConsumer() = default;
+
+    virtual std::string name() const = 0;
+
+    /** Called on the consumer thread before the first frame. */
+    virtual void begin() {}
+
+    virtual void consume(const FrameHandle &frame) = 0;
+
+    /** Called on the consumer thread after the last frame. */
+    virtual void end() {}
+};
+
+struct PipelineStats {
+    struct Consumer {
+        std::string name;
+        std::uint64_t processed = 0;
+        /** Frames skipped because this consumer's queue was full. */
+        std::uint64_t dropped = 0;
+        std::size_t queued = 0;
+    };
+
+    std::uint64_t captured = 0;
+    /** Frames the source lost, see FrameSource::droppedFrames(). */
+    std::uint64_t source_dropped = 0;
+    double fps = 0.0;
+    std::vector<Consumer> consumers;
+};
+
+/**
+ * @class CapturePipeline
+ * @brief Moves frames from a FrameSource to independent consumers.
+ *
+ * A dedicated capture thread reads the source as fast as it delivers and
+ * stamps each frame with a sequence number and timestamp. Every consumer
+ * has its own lock-free SPSC queue and thread, optionally pinned to a core,
+ * so a slow writer never holds up the preview or the camera. When a
+ * consumer's queue is full the frame is dropped for that consumer only and
+ * counted. Queue depth times the number of consumers should stay below the
+ * number of frame buffers behind the source, or the source runs dry.
+ */
+class CapturePipeline {
+public:
+    struct Options {
+        std::size_t queue_depth = 16;
+        /** Core to pin the capture thread to, -1 for no pinning. */
+        int capture_cpu = -1;
+        std::chrono::milliseconds read_timeout{100};
+    };
+
+    explicit CapturePipeline(std::shared_ptr<FrameSource> source);
+    CapturePipeline(std::shared_ptr<FrameSource> source, Options options);
+    ~CapturePipeline();
+
+    CapturePipeline(const CapturePipeline &) = delete;
+    CapturePipeline &operator=(const CapturePipeline &) = delete;
+
+    /**
+     * @brief Add a stage; only allowed while stopped.
+     * @param cpu Core to pin the consumer thread to, -1 for no pinning.
+     */
+    bool addConsumer(std::shared_ptr<FrameConsumer> consumer, int cpu = -1);
+
+    /**
+     * @brief Start the source, the capture thread and the consumers.
+     */
+    bool start();
+
+    /**
+     * @brief Stop capturing. Consumers finish the frames already queued.
+     */
+    void stop();
+
+    bool isRunning() const;
+
+    PipelineStats stats() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * @brief Pin `thread` to `cpu`. Returns false where unsupported.
+ */
+bool pinThread(std::thread &thread, int cpu);
+}  // namespace atom::video
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * synthetic.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-29
+
+Description: Simulated camera for exercising the video pipeline
+
+**************************************************/
+
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace atom::video {
+SyntheticCamera::SyntheticCamera(const atom::memory::FrameGeometry &geometry,
+                                 double fps, std::size_t buffers)
+    : geometry_(geometry),
+      period_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(1.0 / std::max(fps, 0.001)))),
+      ring_(geometry, std::max<std::size_t>(1, buffers)) {}
+
+bool SyntheticCamera::start() {
+    epoch_ = std::chrono::steady_clock::now();
+    next_ = 0;
+    running_ = true;
+    return true;
+}
+
+void SyntheticCamera::stop() { running_ = false; }
+
+FrameHandle SyntheticCamera::read(std::chrono::milliseconds timeout) {
+    if (!running_) {
+        return {};
+    }
+    auto now = std::chrono::steady_clock::now();
+    /* A free-running sensor overwrites frames nobody collected. */
+    auto due = static_cast<std::uint64_t>((now - epoch_) / period_);
+    if (due > next_ + 1) {
+        dropped_ += due - next_ - 1;
+        next_ = due - 1;
+    }
+    auto deadline = epoch_ + period_ * static_cast<std::int64_t>(next_ + 1);
+    if (deadline > now + timeout) {
+        std::this_thread::sleep_until(now + timeout);
+        return {};
+    }
+    std::this_thread::sleep_until(deadline);
+    auto index = next_++;
+
+    auto frame = ring_.tryAcquire();
+    if (!frame) {
+        ++dropped_;
+        return {};
+    }
+    render(frame, index);
+    frame.setSize(geometry_.bytes());
+    auto &info = frame.info();
+    info.geometry = geometry_;
+    info.timestamp = std::chrono::system_clock::now();
+    info.exposure = std::chrono::duration<double>(period_).count();
+    return frame;
+}
+
+void SyntheticCamera::render(const FrameHandle &frame,
+                             std::uint64_t index) const {
+    const auto bytes = geometry_.bytesPerSample();
+    const auto stride = static_cast<std::size_t>(geometry_.width) *
+                        geometry_.channels * bytes;
+    std::memset(frame.data(), 0x10, geometry_.bytes());
+    /* A 5x5 star wandering around the frame centre, clipped to the frame. */
+    const auto width = static_cast<std::int64_t>(geometry_.width);
+    const auto height = static_cast<std::int64_t>(geometry_.height);
+    const auto cx = width / 2 + static_cast<std::int64_t>(index % 7) - 3;
+    const auto cy = height / 2 + static_cast<std::int64_t>((index / 7) % 7) - 3;
+    for (auto y = std::max<std::int64_t>(cy - 2, 0);
+         y <= std::min(cy + 2, height - 1); ++y) {
+        auto *row = frame.data() + static_cast<std::size_t>(y) * stride;
+        for (auto x = std::max<std::int64_t>(cx - 2, 0);
+             x <= std::min(cx + 2, width - 1); ++x) {
+            std::memset(row + static_cast<std::size_t>(x) *
+                                  geometry_.channels * bytes,
+                        0xF0, geometry_.channels * bytes);
+        }
+    }
+}
+}  // namespace atom::video
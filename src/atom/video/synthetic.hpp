@@ -0,0 +1,54 @@
+/*
+ * synthetic.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-29
+
+Description: Simulated camera for exercising the video pipeline
+
+**************************************************/
+
+#ifndef ATOM_VIDEO_SYNTHETIC_HPP
+#define ATOM_VIDEO_SYNTHETIC_HPP
+
+#include <atomic>
+
+#include "pipeline.hpp"
+
+namespace atom::video {
+/**
+ * @brief A FrameSource that renders a drifting star at a fixed frame rate.
+ *
+ * It behaves like a free-running sensor: frames are due on a fixed
+ * schedule whether or not anybody reads them, so frames that are not read
+ * in time, or for which no buffer is free, are counted as dropped.
+ */
+class SyntheticCamera : public FrameSource {
+public:
+    SyntheticCamera(const atom::memory::FrameGeometry &geometry, double fps,
+                    std::size_t buffers = 8);
+
+    bool start() override;
+    void stop() override;
+    FrameHandle read(std::chrono::milliseconds timeout) override;
+    std::uint64_t droppedFrames() const override { return dropped_.load(); }
+
+private:
+    void render(const FrameHandle &frame, std::uint64_t index) const;
+
+    atom::memory::FrameGeometry geometry_;
+    std::chrono::steady_clock::duration period_;
+    atom::memory::FrameBufferRing ring_;
+
+    std::atomic<bool> running_{false};
+    std::chrono::steady_clock::time_point epoch_;
+    std::uint64_t next_ = 0;
+    std::atomic<std::uint64_t> dropped_{0};
+};
+}  // namespace atom::video
+
+#endif
@@ -0,0 +1,49 @@
+-- xmake.lua for Atom-Video
+-- This project is licensed under the terms of the GPL3 license.
+--
+-- Project Name: Atom-Video
+-- Description: Video capture pipeline
+-- Author: Max Qian
+-- License: GPL3
+
+add_rules("mode.debug", "mode.release")
+
+set_project("atom-video")
+set_version("1.0.0")
+set_license("GPL3")
+
+-- Sources
+local sources = {
+    "consumers.cpp",
+    "pipeline.cpp",
+    "synthetic.cpp"
+}
+
+-- Headers
+local headers = {
+    "consumers.hpp",
+    "pipeline.hpp",
+    "synthetic.hpp"
+}
+
+-- Build Object Library
+target("atom-video-object")
+    set_kind("object")
+    add_files(headers, {public = true})
+    add_files(sources, {public = false})
+    add_packages("loguru")
+
+-- Build Static Library
+target("atom-video")
+    set_kind("static")
+    add_deps("atom-video-object")
+    add_packages("loguru")
+    add_includedirs(".", {public = true})
+
+    set_targetdir("$(buildir)/lib")
+    set_objectdir("$(buildir)/obj")
+
+    after_build(function (target)
+        os.cp("$(buildir)/lib", "$(projectdir)/lib")
+        os.cp("$(projectdir)/*.hpp", "$(projectdir)/include")
+    end)
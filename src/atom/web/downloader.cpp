@@ -14,15 +14,510 @@ Description: Downloader
 
 #include "downloader.hpp"
 
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <chrono>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
+#include <future>
+#include <optional>
+#include <sstream>
 #include <thread>
 
+#include "atom/async/pool.hpp"
 #include "atom/error/exception.hpp"
 #include "atom/log/loguru.hpp"
 #include "cpp_httplib/httplib.h"
 
+namespace fs = std::filesystem;
+
 namespace atom::web {
+namespace {
+constexpr size_t kFileBufferSize = 1024 * 1024;
+/* 分段每写入这么多字节刷新一次并公开进度 */
+constexpr size_t kFlushInterval = 4 * 1024 * 1024;
+constexpr auto kStateInterval = std::chrono::seconds(1);
+
+/* 分段 [start, end)，done 为已落盘的字节数 */
+struct Segment {
+    size_t start{0};
+    size_t end{0};
+    std::atomic<size_t> done{0};
+};
+
+/* 下载的元数据，与 .part.state 文件一一对应 */
+struct DownloadState {
+    std::string url;
+    size_t total{0};
+    bool ranges{false};
+    std::string etag;
+    std::vector<std::unique_ptr<Segment>> segments;
+
+    size_t downloaded() const {
+        size_t sum = 0;
+        for (const auto &segment : segments) {
+            sum += segment->done.load();
+        }
+        return sum;
+    }
+};
+
+enum class SegmentResult { DONE, FAILED, CANCELLED };
+
+/* "http://host:port/path?q" -> {"http://host:port", "/path?q"} */
+std::pair<std::string, std::string> split_url(const std::string &url) {
+    auto scheme = url.find("://");
+    auto slash = url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    if (slash == std::string::npos) {
+        return {url, "/"};
+    }
+    return {url.substr(0, slash), url.substr(slash)};
+}
+
+std::unique_ptr<httplib::Client> make_client(const std::string &origin,
+                                             const DownloadOptions &options) {
+    auto client = std::make_unique<httplib::Client>(origin);
+    client->set_connection_timeout(options.timeout.count());
+    client->set_read_timeout(options.timeout.count());
+    client->set_follow_location(true);
+    return client;
+}
+
+bool save_state(const fs::path &path, const DownloadState &state) {
+    auto temp = path;
+    temp += ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << "atom-download 1\n"
+            << "url " << state.url << '\n'
+            << "total " << state.total << '\n'
+            << "etag " << (state.etag.empty() ? "-" : state.etag) << '\n';
+        for (const auto &segment : state.segments) {
+            out << "segment " << segment->start << ' ' << segment->end << ' '
+                << segment->done.load() << '\n';
+        }
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, path, ec);
+    return !ec;
+}
+
+bool load_state(const fs::path &path, DownloadState &state) {
+    std::ifstream in(path);
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version) || magic != "atom-download" ||
+        version != 1) {
+        return false;
+    }
+    std::string key;
+    while (in >> key) {
+        if (key == "url") {
+            in >> state.url;
+        } else if (key == "total") {
+            in >> state.total;
+        } else if (key == "etag") {
+            in >> state.etag;
+            if (state.etag == "-") {
+                state.etag.clear();
+            }
+        } else if (key == "segment") {
+            auto segment = std::make_unique<Segment>();
+            size_t done = 0;
+            in >> segment->start >> segment->end >> done;
+            if (segment->end < segment->start ||
+                done > segment->end - segment->start) {
+                return false;
+            }
+            segment->done = done;
+            state.segments.push_back(std::move(segment));
+        } else {
+            return false;
+        }
+    }
+    state.ranges = !state.segments.empty();
+    return state.total > 0 && state.ranges;
+}
+
+std::string file_sha256(const fs::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return "";
+    }
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+    std::vector<char> buffer(kFileBufferSize);
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (file.gcount() > 0) {
+            EVP_DigestUpdate(ctx, buffer.data(),
+                             static_cast<size_t>(file.gcount()));
+        }
+    }
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx, hash, &length);
+    EVP_MD_CTX_free(ctx);
+
+    std::string hex;
+    hex.reserve(length * 2);
+    for (unsigned int i = 0; i < length; ++i) {
+        char digits[3];
+        std::snprintf(digits, sizeof(digits), "%02x", hash[i]);
+        hex += digits;
+    }
+    return hex;
+}
+
+std::string to_lower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+/* 解析服务器给出的 Content-Length，格式错误或溢出时返回 std::nullopt */
+std::optional<size_t> parse_length(const std::string &value) {
+    size_t length = 0;
+    auto [end, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), length);
+    if (ec != std::errc{} || end != value.data() + value.size()) {
+        return std::nullopt;
+    }
+    return length;
+}
+
+/* 下载一个分段（或不支持 Range 时的整个文件），失败时按指数退避重试 */
+SegmentResult download_segment(const std::string &url, const fs::path &part,
+                               bool ranged, Segment &segment,
+                               const DownloadOptions &options,
+                               RateLimiter &limiter,
+                               const DownloadEngine::CancelCheck &cancelled) {
+    auto [origin, path] = split_url(url);
+    std::vector<char> streamBuffer(kFileBufferSize);
+
+    for (int attempt = 0; attempt <= options.retries; ++attempt) {
+        if (attempt > 0) {
+            auto delay = std::chrono::milliseconds(500) * (1 << (attempt - 1));
+            auto until = std::chrono::steady_clock::now() + delay;
+            while (std::chrono::steady_clock::now() < until) {
+                if (cancelled && cancelled()) {
+                    return SegmentResult::CANCELLED;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            LOG_F(WARNING, "Retrying {} (attempt {})", url, attempt + 1);
+        }
+
+        /* 不支持 Range 时只能从头开始 */
+        size_t offset = ranged ? segment.start + segment.done.load() : 0;
+        if (!ranged) {
+            segment.done = 0;
+        }
+        if (ranged && offset >= segment.end) {
+            return SegmentResult::DONE;
+        }
+
+        std::ofstream out;
+        out.rdbuf()->pubsetbuf(streamBuffer.data(),
+                               static_cast<std::streamsize>(
+                                   streamBuffer.size()));
+        out.open(part, ranged ? std::ios::binary | std::ios::in | std::ios::out
+                              : std::ios::binary | std::ios::trunc |
+                                    std::ios::out);
+        if (!out) {
+            LOG_F(ERROR, "Failed to open file {}", part.string());
+            return SegmentResult::FAILED;
+        }
+        out.seekp(static_cast<std::streamoff>(offset));
+
+        httplib::Headers headers;
+        if (ranged) {
+            headers.emplace("Range", "bytes=" + std::to_string(offset) + "-" +
+                                         std::to_string(segment.end - 1));
+        }
+
+        size_t written = ranged ? segment.done.load() : 0;
+        size_t unflushed = 0;
+        bool stopped = false;
+        bool ioError = false;
+        auto client = make_client(origin, options);
+        auto res = client->Get(
+            path, headers,
+            [&](const httplib::Response &response) {
+                if (!ranged) {
+                    return response.status == 200;
+                }
+                /* 服务器忽略 Range 时会返回 200 和完整内容 */
+                auto expected = "bytes " + std::to_string(offset) + "-";
+                return response.status == 206 &&
+                       response.get_header_value("Content-Range")
+                           .starts_with(expected);
+            },
+            [&](const char *data, size_t length) {
+                if (cancelled && cancelled()) {
+                    stopped = true;
+                    return false;
+                }
+                if (ranged) {
+                    length = std::min(length, segment.end - segment.start -
+                                                  written);
+                }
+                limiter.acquire(length);
+                if (!out.write(data, static_cast<std::streamsize>(length))) {
+                    ioError = true;
+                    return false;
+                }
+                written += length;
+                unflushed += length;
+                if (unflushed >= kFlushInterval) {
+                    if (!out.flush()) {
+                        ioError = true;
+                        return false;
+                    }
+                    segment.done = written;
+                    unflushed = 0;
+                }
+                return true;
+            });
+
+        out.flush();
+        if (out) {
+            segment.done = written;
+        }
+        if (stopped) {
+            return SegmentResult::CANCELLED;
+        }
+        if (ioError || !out) {
+            LOG_F(ERROR, "Failed to write file {}", part.string());
+            return SegmentResult::FAILED;
+        }
+        if (res && (ranged ? written == segment.end - segment.start
+                           : res->status == 200)) {
+            if (!ranged) {
+                segment.end = segment.start + written;
+            }
+            return SegmentResult::DONE;
+        }
+        if (res) {
+            LOG_F(ERROR, "Failed to download {}: HTTP {}", url, res->status);
+        } else {
+            LOG_F(ERROR, "Failed to download {}: {}", url,
+                  httplib::to_string(res.error()));
+        }
+    }
+    return SegmentResult::FAILED;
+}
+}  // namespace
+
+RateLimiter::RateLimiter(size_t bytes_per_second)
+    : rate_(bytes_per_second), last_(std::chrono::steady_clock::now()) {}
+
+void RateLimiter::set_rate(size_t bytes_per_second) {
+    std::lock_guard lock(mutex_);
+    rate_ = bytes_per_second;
+    tokens_ = 0;
+    last_ = std::chrono::steady_clock::now();
+}
+
+void RateLimiter::acquire(size_t bytes) {
+    std::chrono::duration<double> wait{0};
+    {
+        std::lock_guard lock(mutex_);
+        if (rate_ == 0) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+        auto rate = static_cast<double>(rate_);
+        tokens_ = std::min(tokens_ + elapsed * rate, rate);
+        tokens_ -= static_cast<double>(bytes);
+        if (tokens_ < 0) {
+            /* 欠下的令牌按速率折算为等待时间，由调用者在锁外睡眠 */
+            wait = std::chrono::duration<double>(-tokens_ / rate);
+        }
+    }
+    if (wait.count() > 0) {
+        std::this_thread::sleep_for(wait);
+    }
+}
+
+DownloadEngine::DownloadEngine(size_t max_connections, size_t download_speed)
+    : pool_(std::make_unique<atom::async::ThreadPool>(
+          std::max<size_t>(max_connections, 1))),
+      limiter_(download_speed) {}
+
+DownloadEngine::~DownloadEngine() = default;
+
+bool DownloadEngine::download(const std::string &url,
+                              const std::string &filepath,
+                              const DownloadOptions &options,
+                              const ProgressCallback &progress,
+                              const CancelCheck &cancelled) {
+    fs::path target(filepath);
+    fs::path part = target;
+    part += ".part";
+    fs::path statePath = part;
+    statePath += ".state";
+
+    if (target.has_parent_path()) {
+        std::error_code ec;
+        fs::create_directories(target.parent_path(), ec);
+    }
+
+    /* 探测大小、Range 支持与 ETag */
+    auto [origin, path] = split_url(url);
+    DownloadState remote;
+    remote.url = url;
+    {
+        auto client = make_client(origin, options);
+        auto res = client->Head(path);
+        if (res && res->status == 200) {
+            if (res->has_header("Content-Length")) {
+                auto value = res->get_header_value("Content-Length");
+                auto length = parse_length(value);
+                if (!length) {
+                    /* 按大小未知处理，不使用分段下载 */
+                    LOG_F(WARNING, "Invalid Content-Length from {}: {}", url,
+                          value);
+                }
+                remote.total = length.value_or(0);
+            }
+            remote.ranges =
+                to_lower(res->get_header_value("Accept-Ranges")) == "bytes" &&
+                remote.total > 0;
+            remote.etag = res->get_header_value("ETag");
+        } else {
+            LOG_F(WARNING, "HEAD {} failed, downloading without ranges", url);
+        }
+    }
+
+    /* 已有的进度只有在远端文件未变化时才可继续使用 */
+    DownloadState state;
+    std::error_code ec;
+    if (remote.ranges && fs::exists(part, ec) &&
+        load_state(statePath, state) && state.url == url &&
+        state.total == remote.total && state.etag == remote.etag &&
+        fs::file_size(part, ec) == state.total) {
+        DLOG_F(INFO, "Resuming {} at {} of {} bytes", url, state.downloaded(),
+               state.total);
+    } else {
+        state = DownloadState{};
+        state.url = url;
+        state.total = remote.total;
+        state.ranges = remote.ranges;
+        state.etag = remote.etag;
+        size_t count = 1;
+        if (state.ranges) {
+            count = std::clamp<size_t>(
+                state.total / std::max<size_t>(options.min_segment_size, 1),
+                1, std::max<size_t>(options.max_segments, 1));
+        }
+        size_t size = state.ranges ? (state.total + count - 1) / count : 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto segment = std::make_unique<Segment>();
+            segment->start = i * size;
+            segment->end = state.ranges
+                               ? std::min(state.total, (i + 1) * size)
+                               : 0;
+            state.segments.push_back(std::move(segment));
+        }
+        fs::remove(statePath, ec);
+        if (state.ranges) {
+            /* 预先分配文件，各分段写入自己的位置 */
+            std::ofstream(part, std::ios::binary | std::ios::trunc);
+            fs::resize_file(part, state.total, ec);
+            if (ec) {
+                LOG_F(ERROR, "Failed to allocate {}: {}", part.string(),
+                      ec.message());
+                return false;
+            }
+        }
+    }
+
+    std::vector<std::future<SegmentResult>> results;
+    for (auto &segment : state.segments) {
+        if (state.ranges && segment->done == segment->end - segment->start) {
+            continue;
+        }
+        results.push_back(pool_->enqueue([&, segment = segment.get()] {
+            return download_segment(url, part, state.ranges, *segment,
+                                    options, limiter_, cancelled);
+        }));
+    }
+
+    /* 等待期间报告进度并定期保存分段状态 */
+    auto lastSave = std::chrono::steady_clock::now();
+    for (auto &result : results) {
+        while (result.wait_for(std::chrono::milliseconds(200)) !=
+               std::future_status::ready) {
+            if (progress) {
+                progress(state.downloaded(), state.total);
+            }
+            if (state.ranges &&
+                std::chrono::steady_clock::now() - lastSave >=
+                    kStateInterval) {
+                save_state(statePath, state);
+                lastSave = std::chrono::steady_clock::now();
+            }
+        }
+    }
+
+    bool ok = true;
+    bool wasCancelled = false;
+    for (auto &result : results) {
+        auto status = result.get();
+        ok = ok && status == SegmentResult::DONE;
+        wasCancelled = wasCancelled || status == SegmentResult::CANCELLED;
+    }
+    if (!ok) {
+        if (state.ranges) {
+            save_state(statePath, state);
+        }
+        if (!wasCancelled) {
+            LOG_F(ERROR, "Failed to download {}", url);
+        }
+        return false;
+    }
+    if (!state.ranges) {
+        state.total = state.downloaded();
+    }
+    if (progress) {
+        progress(state.downloaded(), state.total);
+    }
+
+    if (!options.sha256.empty()) {
+        auto actual = file_sha256(part);
+        if (actual != to_lower(options.sha256)) {
+            LOG_F(ERROR, "SHA-256 mismatch for {}: expected {}, got {}", url,
+                  options.sha256, actual);
+            fs::remove(part, ec);
+            fs::remove(statePath, ec);
+            return false;
+        }
+    }
+
+    fs::rename(part, target, ec);
+    if (ec) {
+        LOG_F(ERROR, "Failed to move {} to {}: {}", part.string(),
+              target.string(), ec.message());
+        return false;
+    }
+    fs::remove(statePath, ec);
+    DLOG_F(INFO, "Downloaded file {}", target.string());
+    return true;
+}
+
 DownloadManager::DownloadManager(const std::string &task_file)
     : task_file_(task_file) {
     try {
@@ -31,11 +526,17 @@ DownloadManager::DownloadManager(const std::string &task_file)
             LOG_F(ERROR, "Failed to open task file {}", task_file_);
             THROW_EXCEPTION("Failed to open task file.");
         }
-        while (infile >> std::ws && !infile.eof()) {
-            std::string url, filepath;
-            infile >> url >> filepath;
+        std::string line;
+        while (std::getline(infile, line)) {
+            std::istringstream fields(line);
+            std::string url, filepath, sha256;
+            fields >> url >> filepath >> sha256;
             if (!url.empty() && !filepath.empty()) {
-                tasks_.push_back({url, filepath});
+                DownloadTask task;
+                task.url = url;
+                task.filepath = filepath;
+                task.sha256 = sha256;
+                tasks_.push_back(std::move(task));
             }
         }
         infile.close();
@@ -48,23 +549,30 @@ DownloadManager::DownloadManager(const std::string &task_file)
 DownloadManager::~DownloadManager() { save_task_list_to_file(); }
 
 void DownloadManager::add_task(const std::string &url,
-                               const std::string &filepath, int priority) {
+                               const std::string &filepath, int priority,
+                               const std::string &sha256) {
     try {
         std::ofstream outfile(task_file_, std::ios_base::app);
         if (!outfile) {
             LOG_F(ERROR, "Failed to open task file {}", task_file_);
             THROW_EXCEPTION("Failed to open task file.");
         }
-        outfile << url << " " << filepath << std::endl;
+        outfile << url << " " << filepath;
+        if (!sha256.empty()) {
+            outfile << " " << sha256;
+        }
+        outfile << std::endl;
         outfile.close();
     } catch (const std::exception &e) {
         LOG_F(ERROR, "Error: {}", e.what());
         THROW_EXCEPTION(fmt::format("Error: {}", e.what()).c_str());
     }
-    tasks_.push_back({url, filepath, false, false, 0, priority});
+    std::lock_guard lock(mutex_);
+    tasks_.push_back({url, filepath, false, false, 0, priority, sha256});
 }
 
 bool DownloadManager::remove_task(size_t index) {
+    std::lock_guard lock(mutex_);
     if (index >= tasks_.size()) {
         return false;
     }
@@ -73,21 +581,21 @@ bool DownloadManager::remove_task(size_t index) {
 }
 
 void DownloadManager::start(size_t thread_count, size_t download_speed) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    engine_ = std::make_unique<DownloadEngine>(thread_count, download_speed);
     running_ = true;
-#if _cplusplus >= 202002L
     std::vector<std::jthread> threads;
-#else
-    std::vector<std::thread> threads;
-#endif
     for (size_t i = 0; i < thread_count; ++i) {
-        threads.emplace_back(&DownloadManager::run, this, download_speed);
+        threads.emplace_back(&DownloadManager::run, this);
     }
     for (auto &thread : threads) {
         thread.join();
     }
+    running_ = false;
 }
 
 void DownloadManager::pause_task(size_t index) {
+    std::lock_guard lock(mutex_);
     if (index >= tasks_.size()) {
         LOG_F(ERROR, "Index out of bounds!");
         return;
@@ -99,6 +607,7 @@ void DownloadManager::pause_task(size_t index) {
 }
 
 void DownloadManager::resume_task(size_t index) {
+    std::lock_guard lock(mutex_);
     if (index >= tasks_.size()) {
         LOG_F(ERROR, "Index out of bounds!");
         return;
@@ -114,6 +623,7 @@ void DownloadManager::resume_task(size_t index) {
 }
 
 size_t DownloadManager::get_downloaded_bytes(size_t index) {
+    std::lock_guard lock(mutex_);
     if (index >= tasks_.size()) {
         LOG_F(ERROR, "Index out of bounds!");
         return 0;
@@ -123,114 +633,63 @@ size_t DownloadManager::get_downloaded_bytes(size_t index) {
 }
 
 std::optional<size_t> DownloadManager::get_next_task_index() {
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::lock_guard lock(mutex_);
+    std::optional<size_t> next;
     for (size_t i = 0; i < tasks_.size(); ++i) {
-        if (!tasks_[i].completed && !tasks_[i].paused) {
-            return i;
+        const auto &task = tasks_[i];
+        if (task.completed || task.paused || task.active) {
+            continue;
+        }
+        if (!next || task.priority > tasks_[*next].priority) {
+            next = i;
         }
     }
-    return std::nullopt;
-}
-
-std::optional<DownloadTask> DownloadManager::get_next_task() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (!task_queue_.empty()) {
-        auto task = task_queue_.top();
-        task_queue_.pop();
-        return task;
-    }
-
-    auto index = get_next_task_index();
-    if (index) {
-        return tasks_[*index];
+    if (next) {
+        tasks_[*next].active = true;
     }
-
-    return std::nullopt;
+    return next;
 }
 
-void DownloadManager::run(size_t download_speed) {
+void DownloadManager::run() {
     while (running_) {
-        auto task = get_next_task();
-        if (!task) {
+        auto index = get_next_task_index();
+        if (!index) {
             break;
         }
-
-        if (task->completed || task->paused) {
-            continue;
-        }
-        start_time_ = std::chrono::system_clock::now();
-        download_task(*task, download_speed);
+        download_task(*index);
     }
 }
 
-void DownloadManager::download_task(DownloadTask &task, size_t download_speed) {
-    httplib::Client cli(task.url);
-    auto res = cli.Get("/");
-    if (!res || res->status != 200) {
-        LOG_F(ERROR, "Failed to download {}", task.url);
-        return;
-    }
-
-    std::ofstream outfile(task.filepath,
-                          std::ofstream::binary | std::ofstream::app);
-    if (!outfile) {
-        LOG_F(ERROR, "Failed to open file {}", task.filepath);
-        return;
-    }
-
-    // 断点续传：从已经下载的字节数开始写入文件
-    outfile.seekp(task.downloaded_bytes);
-
-    constexpr size_t kBufferSize = 1024 * 1024;  // 1MB 缓存
-    size_t buffer_size = kBufferSize;
-    if (download_speed > 0) {
-        // 如果有下载速度限制，根据时间计算出当前应该下载的字节数
-        auto bytes_per_ms = static_cast<double>(download_speed) / 1000.0;
-        auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                              std::chrono::system_clock::now() - start_time_)
-                              .count();
-        auto bytes_to_download =
-            static_cast<size_t>(elapsed_ms * bytes_per_ms) -
-            task.downloaded_bytes;
-        if (bytes_to_download < buffer_size) {
-            buffer_size = bytes_to_download;
-        }
-    }
-
-    size_t total_bytes_read = 0;
-
-    while (!res->body.empty() && !task.completed && !task.paused) {
-        size_t bytes_to_write = res->body.size() - task.downloaded_bytes;
-        if (bytes_to_write > buffer_size) {
-            bytes_to_write = buffer_size;
-        }
-
-        outfile.write(res->body.c_str() + task.downloaded_bytes,
-                      bytes_to_write);
-        auto bytes_written =
-            static_cast<size_t>(outfile.tellp()) - task.downloaded_bytes;
-        task.downloaded_bytes += bytes_written;
-        total_bytes_read += bytes_written;
-
-        // 下载速度控制：根据需要下载的字节数和已经下载的字节数计算出需要等待的时间
-        if (download_speed > 0) {
-            auto bytes_per_ms = static_cast<double>(download_speed) / 1000.0;
-            auto elapsed_ms =
-                static_cast<double>(total_bytes_read) / bytes_per_ms;
-            std::this_thread::sleep_for(
-                std::chrono::milliseconds(static_cast<long long>(elapsed_ms)));
-        }
-
-        // 如果下载完成，则标记任务为已完成
-        if (task.downloaded_bytes >= res->body.size()) {
-            task.completed = true;
-        }
+void DownloadManager::download_task(size_t index) {
+    DownloadOptions options;
+    std::string url;
+    std::string filepath;
+    {
+        std::lock_guard lock(mutex_);
+        url = tasks_[index].url;
+        filepath = tasks_[index].filepath;
+        options.sha256 = tasks_[index].sha256;
     }
 
-    outfile.close();
-
-    if (task.completed) {
-        DLOG_F(INFO, "Downloaded file {}", task.filepath);
+    bool ok = engine_->download(
+        url, filepath, options,
+        [this, index](size_t downloaded, size_t) {
+            std::lock_guard lock(mutex_);
+            tasks_[index].downloaded_bytes = downloaded;
+        },
+        [this, index] {
+            std::lock_guard lock(mutex_);
+            return !running_ || tasks_[index].paused;
+        });
+
+    std::lock_guard lock(mutex_);
+    auto &task = tasks_[index];
+    task.active = false;
+    if (ok) {
+        task.completed = true;
+    } else if (!task.paused) {
+        /* 失败的任务不再自动重试，进度已保存，可再次 start() 续传 */
+        task.paused = true;
     }
 }
 
@@ -242,7 +701,11 @@ void DownloadManager::save_task_list_to_file() {
             throw std::runtime_error("Failed to open task file.");
         }
         for (const auto &task : tasks_) {
-            outfile << task.url << " " << task.filepath << std::endl;
+            outfile << task.url << " " << task.filepath;
+            if (!task.sha256.empty()) {
+                outfile << " " << task.sha256;
+            }
+            outfile << std::endl;
         }
         outfile.close();
     } catch (const std::exception &e) {
@@ -17,13 +17,19 @@ Description: Downloader
 #define DOWNLOAD_MANAGER_H
 
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <queue>
 #include <string>
 #include <thread>
 #include <vector>
 
+namespace atom::async {
+class ThreadPool;
+}
+
 namespace atom::web {
 
 struct DownloadTask {
@@ -33,12 +39,101 @@ struct DownloadTask {
     bool paused{false};
     size_t downloaded_bytes{0};
     int priority{0};
+    std::string sha256;   ///< 期望的 SHA-256，为空则不校验
+    bool active{false};   ///< 是否有线程正在下载
 };
 
 inline bool operator<(const DownloadTask &lhs, const DownloadTask &rhs) {
     return lhs.priority < rhs.priority;
 }
 
+/**
+ * @brief 单个文件的下载选项
+ */
+struct DownloadOptions {
+    size_t max_segments{4};  ///< 最多同时请求的分段数
+    size_t min_segment_size{8 * 1024 * 1024};  ///< 小于两段的文件不分段
+    std::string sha256;  ///< 期望的 SHA-256（十六进制），为空则不校验
+    int retries{3};      ///< 每个分段失败后的重试次数
+    std::chrono::seconds timeout{30};  ///< 连接与读取超时
+};
+
+/**
+ * @brief 令牌桶限速器，可被多个下载线程共享
+ *
+ * 每秒补充 rate 个令牌，最多积累一秒的量。acquire() 先扣除令牌，
+ * 不足时按欠额睡眠，因此所有线程合计的速度不会超过 rate。
+ */
+class RateLimiter {
+public:
+    /**
+     * @param bytes_per_second 限速，0 表示不限速
+     */
+    explicit RateLimiter(size_t bytes_per_second = 0);
+
+    void set_rate(size_t bytes_per_second);
+
+    /**
+     * @brief 获取 bytes 个令牌，必要时阻塞
+     */
+    void acquire(size_t bytes);
+
+private:
+    std::mutex mutex_;
+    size_t rate_;
+    double tokens_{0};
+    std::chrono::steady_clock::time_point last_;
+};
+
+/**
+ * @brief 流式分段下载引擎
+ *
+ * 响应体通过 content receiver 直接写入 `<filepath>.part`，不在内存中保存。
+ * 服务器支持 Range 且文件足够大时，文件被切分为多个分段并在有界线程池中
+ * 并发下载。分段进度定期保存在 `<filepath>.part.state`，中断后再次调用
+ * download() 会从上次的位置继续。全部完成后校验 SHA-256 并重命名为目标
+ * 文件。
+ */
+class DownloadEngine {
+public:
+    /**
+     * @brief 进度回调，total 未知时为 0
+     */
+    using ProgressCallback =
+        std::function<void(size_t downloaded, size_t total)>;
+
+    /**
+     * @brief 返回 true 时停止下载并保留进度
+     */
+    using CancelCheck = std::function<bool()>;
+
+    /**
+     * @param max_connections 同时进行的 HTTP 请求数上限（线程池大小）
+     * @param download_speed 所有下载合计的限速，单位为字节/秒，0 表示不限速
+     */
+    explicit DownloadEngine(size_t max_connections = 4,
+                            size_t download_speed = 0);
+    ~DownloadEngine();
+
+    DownloadEngine(const DownloadEngine &) = delete;
+    DownloadEngine &operator=(const DownloadEngine &) = delete;
+
+    /**
+     * @brief 下载文件，阻塞直到完成、失败或取消
+     * @return 文件完整下载且校验通过时返回 true
+     */
+    bool download(const std::string &url, const std::string &filepath,
+                  const DownloadOptions &options = {},
+                  const ProgressCallback &progress = {},
+                  const CancelCheck &cancelled = {});
+
+    RateLimiter &rate_limiter() { return limiter_; }
+
+private:
+    std::unique_ptr<atom::async::ThreadPool> pool_;
+    RateLimiter limiter_;
+};
+
 /**
  * @brief DownloadManager 类，用于管理下载任务
  */
@@ -60,9 +155,10 @@ public:
      * @param url 下载链接
      * @param filepath 本地保存文件路径
      * @param priority 下载任务优先级，数字越大优先级越高
+     * @param sha256 期望的 SHA-256，为空则不校验
      */
     void add_task(const std::string &url, const std::string &filepath,
-                  int priority = 0);
+                  int priority = 0, const std::string &sha256 = "");
 
     /**
      * @brief 删除下载任务
@@ -100,29 +196,21 @@ public:
 
 private:
     /**
-     * @brief 获取下一个要下载的任务的索引
-     * @return 下一个要下载的任务的索引，如果任务队列为空，则返回空
+     * @brief 获取优先级最高的待下载任务的索引，并将其标记为正在下载
+     * @return 任务的索引，如果没有待下载的任务，则返回空
      */
     std::optional<size_t> get_next_task_index();
 
-    /**
-     * @brief 获取下一个要下载的任务
-     * @return 下一个要下载的任务，如果任务队列为空，则返回空
-     */
-    std::optional<DownloadTask> get_next_task();
-
     /**
      * @brief 启动下载线程
-     * @param download_speed 下载速度限制，单位为字节/秒，0 表示不限制下载速度
      */
-    void run(size_t download_speed);
+    void run();
 
     /**
      * @brief 下载指定的任务
-     * @param task 要下载的任务
-     * @param download_speed 下载速度限制，单位为字节/秒，0 表示不限制下载速度
+     * @param index 任务在任务列表中的索引
      */
-    void download_task(DownloadTask &task, size_t download_speed);
+    void download_task(size_t index);
 
     /**
      * @brief 保存下载任务列表到文件中
@@ -132,11 +220,9 @@ private:
 private:
     std::string task_file_;            ///< 下载任务列表文件路径
     std::vector<DownloadTask> tasks_;  ///< 下载任务列表
-    std::priority_queue<DownloadTask>
-        task_queue_;    ///< 任务队列，按照优先级排序
-    std::mutex mutex_;  ///< 互斥量，用于保护任务列表和任务队列
+    std::mutex mutex_;                 ///< 互斥量，用于保护任务列表
     std::atomic<bool> running_{false};  ///< 是否正在下载中
-    std::chrono::system_clock::time_point start_time_;
+    std::unique_ptr<DownloadEngine> engine_;  ///< 下载引擎
 };
 }  // namespace atom::web
 
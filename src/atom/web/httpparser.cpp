@@ -14,6 +14,7 @@ Description: Http Header Parser
 
 #include "httpparser.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -25,6 +26,8 @@ public:
 
 HttpHeaderParser::HttpHeaderParser() : m_pImpl(std::make_unique<HttpHeaderParserImpl>()) {}
 
+HttpHeaderParser::~HttpHeaderParser() = default;
+
 void HttpHeaderParser::parseHeaders(const std::string &rawHeaders) {
     m_pImpl->headers_.clear();
     std::istringstream iss(rawHeaders);
@@ -89,4 +92,206 @@ bool HttpHeaderParser::hasHeader(const std::string &key) const {
 
 void HttpHeaderParser::clearHeaders() { m_pImpl->headers_.clear(); }
 
+namespace {
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        char x = a[i];
+        char y = b[i];
+        if (x >= 'A' && x <= 'Z') {
+            x = static_cast<char>(x - 'A' + 'a');
+        }
+        if (y >= 'A' && y <= 'Z') {
+            y = static_cast<char>(y - 'A' + 'a');
+        }
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* RFC 9110 token characters, the only ones allowed in a field name. */
+bool isTokenChar(char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9')) {
+        return true;
+    }
+    switch (c) {
+        case '!': case '#': case '$': case '%': case '&': case '\'':
+        case '*': case '+': case '-': case '.': case '^': case '_':
+        case '`': case '|': case '~':
+            return true;
+        default:
+            return false;
+    }
+}
+
+KnownHeader fromHash(std::uint32_t hash, std::string_view name) {
+    KnownHeader id = KnownHeader::UNKNOWN;
+    std::string_view expected;
+    switch (hash) {
+#define ATOM_KNOWN_HEADER(text, value)    \
+    case headerNameHash(text):            \
+        id = KnownHeader::value;          \
+        expected = text;                  \
+        break;
+        ATOM_KNOWN_HEADER("accept", ACCEPT)
+        ATOM_KNOWN_HEADER("accept-encoding", ACCEPT_ENCODING)
+        ATOM_KNOWN_HEADER("authorization", AUTHORIZATION)
+        ATOM_KNOWN_HEADER("cache-control", CACHE_CONTROL)
+        ATOM_KNOWN_HEADER("connection", CONNECTION)
+        ATOM_KNOWN_HEADER("content-encoding", CONTENT_ENCODING)
+        ATOM_KNOWN_HEADER("content-length", CONTENT_LENGTH)
+        ATOM_KNOWN_HEADER("content-range", CONTENT_RANGE)
+        ATOM_KNOWN_HEADER("content-type", CONTENT_TYPE)
+        ATOM_KNOWN_HEADER("cookie", COOKIE)
+        ATOM_KNOWN_HEADER("date", DATE)
+        ATOM_KNOWN_HEADER("etag", ETAG)
+        ATOM_KNOWN_HEADER("expect", EXPECT)
+        ATOM_KNOWN_HEADER("host", HOST)
+        ATOM_KNOWN_HEADER("if-none-match", IF_NONE_MATCH)
+        ATOM_KNOWN_HEADER("keep-alive", KEEP_ALIVE)
+        ATOM_KNOWN_HEADER("location", LOCATION)
+        ATOM_KNOWN_HEADER("range", RANGE)
+        ATOM_KNOWN_HEADER("transfer-encoding", TRANSFER_ENCODING)
+        ATOM_KNOWN_HEADER("upgrade", UPGRADE)
+        ATOM_KNOWN_HEADER("user-agent", USER_AGENT)
+#undef ATOM_KNOWN_HEADER
+        default:
+            return KnownHeader::UNKNOWN;
+    }
+    /* Guard against names that merely share a hash. */
+    return iequals(name, expected) ? id : KnownHeader::UNKNOWN;
+}
+
+std::string_view trimWhitespace(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+}  // namespace
+
+KnownHeader identifyHeader(std::string_view name) {
+    return fromHash(headerNameHash(name), name);
+}
+
+void StreamingHeaderParser::reset() {
+    data_ = {};
+    pos_ = 0;
+    status_ = Status::INCOMPLETE;
+    started_ = false;
+    start_ = {};
+    count_ = 0;
+    known_.fill(NONE);
+}
+
+StreamingHeaderParser::Status StreamingHeaderParser::parse(
+    std::string_view data) {
+    if (status_ != Status::INCOMPLETE) {
+        return status_;
+    }
+    data_ = data;
+    while (true) {
+        auto newline = data_.find('\n', pos_);
+        if (newline == std::string_view::npos) {
+            if (data_.size() > MAX_HEADER_SIZE) {
+                status_ = Status::INVALID;
+            }
+            return status_;
+        }
+        if (newline + 1 > MAX_HEADER_SIZE) {
+            return status_ = Status::INVALID;
+        }
+        auto begin = pos_;
+        auto end = newline;
+        if (end > begin && data_[end - 1] == '\r') {
+            --end;
+        }
+        pos_ = newline + 1;
+
+        if (!started_) {
+            /* Tolerate blank lines before the start line (RFC 9112 2.2). */
+            if (end == begin) {
+                continue;
+            }
+            start_ = {static_cast<std::uint32_t>(begin),
+                      static_cast<std::uint32_t>(end - begin)};
+            started_ = true;
+            continue;
+        }
+        if (end == begin) {
+            return status_ = Status::COMPLETE;
+        }
+        if (!parseField(begin, end)) {
+            return status_ = Status::INVALID;
+        }
+    }
+}
+
+bool StreamingHeaderParser::parseField(std::size_t begin, std::size_t end) {
+    auto line = data_.substr(begin, end - begin);
+    std::uint32_t hash = 2166136261u;
+    std::size_t colon = 0;
+    /* Hash the name while looking for the colon, so known names cost one
+     * pass. Obsolete line folding starts with whitespace and is rejected. */
+    for (; colon < line.size() && line[colon] != ':'; ++colon) {
+        char c = line[colon];
+        if (!isTokenChar(c)) {
+            return false;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    if (colon == 0 || colon == line.size() || count_ == MAX_FIELDS) {
+        return false;
+    }
+
+    auto name = line.substr(0, colon);
+    auto value = trimWhitespace(line.substr(colon + 1));
+    auto &entry = fields_[count_];
+    entry.name = {static_cast<std::uint32_t>(begin),
+                  static_cast<std::uint32_t>(colon)};
+    entry.value = {
+        static_cast<std::uint32_t>(value.data() - data_.data()),
+        static_cast<std::uint32_t>(value.size())};
+    entry.id = fromHash(hash, name);
+    auto &slot = known_[static_cast<std::size_t>(entry.id)];
+    if (entry.id != KnownHeader::UNKNOWN && slot == NONE) {
+        slot = static_cast<std::uint8_t>(count_);
+    }
+    ++count_;
+    return true;
+}
+
+std::optional<std::string_view> StreamingHeaderParser::get(
+    KnownHeader id) const {
+    auto slot = known_[static_cast<std::size_t>(id)];
+    if (id == KnownHeader::UNKNOWN || slot == NONE) {
+        return std::nullopt;
+    }
+    return view(fields_[slot].value);
+}
+
+std::optional<std::string_view> StreamingHeaderParser::get(
+    std::string_view name) const {
+    if (auto id = identifyHeader(name); id != KnownHeader::UNKNOWN) {
+        return get(id);
+    }
+    for (std::size_t i = 0; i < count_; ++i) {
+        if (iequals(view(fields_[i].name), name)) {
+            return view(fields_[i].value);
+        }
+    }
+    return std::nullopt;
+}
+
 }  // namespace atom::web
@@ -15,12 +15,15 @@ Description: Http Header Parser
 #ifndef ATOM_WEB_HTTP_PARSER_HPP
 #define ATOM_WEB_HTTP_PARSER_HPP
 
+#include <array>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
-
 namespace atom::web {
 class HttpHeaderParserImpl;
 
@@ -35,6 +38,11 @@ public:
      */
     HttpHeaderParser();
 
+    /**
+     * @brief Destroys the HttpHeaderParser object.
+     */
+    ~HttpHeaderParser();
+
     /**
      * @brief Parses the raw HTTP headers and stores them internally.
      * @param rawHeaders The raw HTTP headers as a string.
@@ -94,6 +102,150 @@ public:
 private:
     std::unique_ptr<HttpHeaderParserImpl> m_pImpl;  // Pointer to implementation
 };
+
+/**
+ * @brief Header fields recognised without string comparisons.
+ */
+enum class KnownHeader : std::uint8_t {
+    UNKNOWN,
+    ACCEPT,
+    ACCEPT_ENCODING,
+    AUTHORIZATION,
+    CACHE_CONTROL,
+    CONNECTION,
+    CONTENT_ENCODING,
+    CONTENT_LENGTH,
+    CONTENT_RANGE,
+    CONTENT_TYPE,
+    COOKIE,
+    DATE,
+    ETAG,
+    EXPECT,
+    HOST,
+    IF_NONE_MATCH,
+    KEEP_ALIVE,
+    LOCATION,
+    RANGE,
+    TRANSFER_ENCODING,
+    UPGRADE,
+    USER_AGENT,
+    COUNT
+};
+
+/**
+ * @brief Case-insensitive FNV-1a hash of a header name.
+ */
+constexpr std::uint32_t headerNameHash(std::string_view name) {
+    std::uint32_t hash = 2166136261u;
+    for (char c : name) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Identify a header name, KnownHeader::UNKNOWN if it is not listed.
+ */
+KnownHeader identifyHeader(std::string_view name);
+
+/**
+ * @brief Incremental HTTP/1.x header parser that does not allocate.
+ *
+ * parse() is called with everything received so far for the current
+ * message. Complete lines are parsed once and remembered as offsets, so a
+ * header block split across many reads is scanned only once and the buffer
+ * may move or grow between calls as long as the bytes already seen stay
+ * the same. Fields are kept in a fixed array and well-known names are
+ * matched through precomputed hashes; the returned views point into the
+ * buffer passed to the last parse() call.
+ */
+class StreamingHeaderParser {
+public:
+    static constexpr std::size_t MAX_FIELDS = 64;
+    static constexpr std::size_t MAX_HEADER_SIZE = 64 * 1024;
+
+    enum class Status { INCOMPLETE, COMPLETE, INVALID };
+
+    struct Field {
+        std::string_view name;
+        std::string_view value;
+        KnownHeader id;
+    };
+
+    StreamingHeaderParser() { reset(); }
+
+    /**
+     * @brief Parse as far as `data` allows.
+     * @param data The message received so far, starting at the start line.
+     * @return COMPLETE once the blank line ending the headers was seen.
+     */
+    Status parse(std::string_view data);
+
+    /**
+     * @brief Forget the current message.
+     */
+    void reset();
+
+    Status status() const { return status_; }
+
+    /** Bytes of the start line and headers, including the blank line. */
+    std::size_t consumed() const {
+        return status_ == Status::COMPLETE ? pos_ : 0;
+    }
+
+    /** Request or status line without its line ending. */
+    std::string_view startLine() const { return view(start_); }
+
+    std::size_t size() const { return count_; }
+
+    Field field(std::size_t index) const {
+        const auto &entry = fields_[index];
+        return {view(entry.name), view(entry.value), entry.id};
+    }
+
+    /**
+     * @brief First value of a well-known header.
+     */
+    std::optional<std::string_view> get(KnownHeader id) const;
+
+    /**
+     * @brief First value of any header, compared case-insensitively.
+     */
+    std::optional<std::string_view> get(std::string_view name) const;
+
+private:
+    struct Slice {
+        std::uint32_t offset = 0;
+        std::uint32_t length = 0;
+    };
+
+    struct Entry {
+        Slice name;
+        Slice value;
+        KnownHeader id = KnownHeader::UNKNOWN;
+    };
+
+    static constexpr std::uint8_t NONE = 0xFF;
+
+    std::string_view view(Slice slice) const {
+        return data_.substr(slice.offset, slice.length);
+    }
+
+    bool parseField(std::size_t begin, std::size_t end);
+
+    std::string_view data_;
+    std::size_t pos_ = 0;
+    Status status_ = Status::INCOMPLETE;
+    bool started_ = false;
+    Slice start_;
+    std::array<Entry, MAX_FIELDS> fields_;
+    std::size_t count_ = 0;
+    std::array<std::uint8_t, static_cast<std::size_t>(KnownHeader::COUNT)>
+        known_;
+};
 }  // namespace atom::web
 
 #endif  // ATOM_WEB_HTTP_PARSER_HPP
@@ -0,0 +1,961 @@
+/*
+ * httppool.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-27
+
+Description: Keep-alive HTTP/1.1 client with per-host connection pools
+
+**************************************************/
+
+#include "httppool.hpp"
+#include "httpparser.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "atom/async/pool.hpp"
+#include "atom/error/exception.hpp"
+#include "atom/log/loguru.hpp"
+
+namespace atom::web {
+namespace {
+#ifdef _WIN32
+using NativeSocket = SOCKET;
+constexpr NativeSocket kInvalidSocket = INVALID_SOCKET;
+#else
+using NativeSocket = int;
+constexpr NativeSocket kInvalidSocket = -1;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kReadChunk = 16 * 1024;
+constexpr std::size_t kMaxHeaderSize = 64 * 1024;
+constexpr int kMaxRetries = 1;
+
+void closeSocket(NativeSocket fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+int lastSocketError() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+/* Wait until `fd` is ready for `events` or `deadline` passes. */
+bool waitFor(NativeSocket fd, short events, Clock::time_point deadline) {
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - Clock::now());
+        if (remaining.count() <= 0) {
+            return false;
+        }
+#ifdef _WIN32
+        WSAPOLLFD pfd{fd, events, 0};
+        int ready = WSAPoll(&pfd, 1, static_cast<int>(remaining.count()));
+#else
+        pollfd pfd{fd, events, 0};
+        int ready = ::poll(&pfd, 1, static_cast<int>(remaining.count()));
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        return ready > 0;
+    }
+}
+
+bool setBlocking(NativeSocket fd, bool blocking) {
+#ifdef _WIN32
+    u_long mode = blocking ? 0 : 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags) == 0;
+#endif
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) ==
+                      std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+bool hasToken(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        if (iequals(trim(list.substr(0, comma)), token)) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool isPipelinable(const PooledRequest &request) {
+    return (request.method == "GET" || request.method == "HEAD") &&
+           request.body.empty();
+}
+
+bool isRetryable(const PooledRequest &request) {
+    if (request.method == "PUT" || request.method == "DELETE") {
+        return request.retry_writes;
+    }
+    return request.method == "GET" || request.method == "HEAD" ||
+           request.method == "OPTIONS";
+}
+
+/* The server dropped the connection, as opposed to a timeout or bad data. */
+bool isClosed(const std::string &err) {
+    return err == "connection closed" || err.starts_with("send failed") ||
+           err.starts_with("receive failed");
+}
+
+/* A persistent connection and the bytes read past the last response. */
+struct Connection {
+    NativeSocket fd = kInvalidSocket;
+    std::string buffer;
+    Clock::time_point lastUsed;
+    std::size_t served = 0;
+    /* Bytes read from the socket so far. */
+    std::uint64_t received = 0;
+    /* Answered with HTTP/1.1 keep-alive, so requests may be pipelined. */
+    bool pipelining = false;
+    /* Body sink of the response being read, see PooledRequest::on_body. */
+    const PooledRequest *sinkRequest = nullptr;
+    const PooledResponse *sinkResponse = nullptr;
+    std::size_t sinkOffset = 0;
+
+    Connection() = default;
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+    ~Connection() {
+        if (fd != kInvalidSocket) {
+            closeSocket(fd);
+        }
+    }
+
+    /* An idle connection with readable data was closed by the server. */
+    bool stale() const {
+#ifdef _WIN32
+        WSAPOLLFD pfd{fd, POLLIN, 0};
+        return WSAPoll(&pfd, 1, 0) != 0;
+#else
+        pollfd pfd{fd, POLLIN, 0};
+        return ::poll(&pfd, 1, 0) != 0;
+#endif
+    }
+
+    std::string sendAll(std::string_view data, Clock::time_point deadline) {
+        while (!data.empty()) {
+            if (!waitFor(fd, POLLOUT, deadline)) {
+                return "send timed out";
+            }
+#ifdef _WIN32
+            int sent = ::send(fd, data.data(), static_cast<int>(data.size()),
+                              0);
+#elif defined(MSG_NOSIGNAL)
+            auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+#else
+            auto sent = ::send(fd, data.data(), data.size(), 0);
+#endif
+            if (sent <= 0) {
+                return "send failed: " + std::to_string(lastSocketError());
+            }
+            data.remove_prefix(static_cast<std::size_t>(sent));
+        }
+        return {};
+    }
+
+    /* Append what the socket has to `out`; empty string on success. */
+    std::string receive(std::string &out, Clock::time_point deadline) {
+        if (!waitFor(fd, POLLIN, deadline)) {
+            return "receive timed out";
+        }
+        auto old = out.size();
+        out.resize(old + kReadChunk);
+#ifdef _WIN32
+        int got = ::recv(fd, out.data() + old, static_cast<int>(kReadChunk), 0);
+#else
+        auto got = ::recv(fd, out.data() + old, kReadChunk, 0);
+#endif
+        if (got <= 0) {
+            out.resize(old);
+            return got == 0 ? "connection closed"
+                            : "receive failed: " +
+                                  std::to_string(lastSocketError());
+        }
+        out.resize(old + static_cast<std::size_t>(got));
+        received += static_cast<std::size_t>(got);
+        return {};
+    }
+
+    /* Read one CRLF terminated line from the buffer. */
+    std::string readLine(std::string &line, Clock::time_point deadline) {
+        std::size_t end;
+        while ((end = buffer.find("\r\n")) == std::string::npos) {
+            if (buffer.size() > kMaxHeaderSize) {
+                return "line too long";
+            }
+            if (auto err = receive(buffer, deadline); !err.empty()) {
+                return err;
+            }
+        }
+        line.assign(buffer, 0, end);
+        buffer.erase(0, end + 2);
+        return {};
+    }
+
+    /* Hand what was read so far to the body sink, keeping `body` small. */
+    std::string feed(std::string &body) {
+        if (sinkRequest == nullptr || body.empty()) {
+            return {};
+        }
+        if (!sinkRequest->on_body(*sinkResponse, body, sinkOffset)) {
+            return "body rejected";
+        }
+        sinkOffset += body.size();
+        body.clear();
+        return {};
+    }
+
+    /* Move `count` body bytes from the buffer and then the socket. */
+    std::string readBody(std::string &body, std::size_t count,
+                         Clock::time_point deadline) {
+        auto buffered = std::min(count, buffer.size());
+        body.append(buffer, 0, buffered);
+        buffer.erase(0, buffered);
+        count -= buffered;
+        if (auto err = feed(body); !err.empty()) {
+            return err;
+        }
+        while (count > 0) {
+            auto before = body.size();
+            if (auto err = receive(body, deadline); !err.empty()) {
+                return err;
+            }
+            auto got = body.size() - before;
+            if (got > count) {
+                /* Bytes of the next pipelined response. */
+                buffer.append(body, before + count, got - count);
+                body.resize(before + count);
+                got = count;
+            }
+            count -= got;
+            if (auto err = feed(body); !err.empty()) {
+                return err;
+            }
+        }
+        return {};
+    }
+
+    std::string readChunked(std::string &body, Clock::time_point deadline) {
+        std::string line;
+        while (true) {
+            if (auto err = readLine(line, deadline); !err.empty()) {
+                return err;
+            }
+            std::size_t size = 0;
+            auto digits =
+                trim(std::string_view(line).substr(0, line.find(';')));
+            auto [ptr, ec] = std::from_chars(
+                digits.data(), digits.data() + digits.size(), size, 16);
+            if (ec != std::errc{} || digits.empty()) {
+                return "bad chunk size";
+            }
+            if (size == 0) {
+                break;
+            }
+            if (auto err = readBody(body, size, deadline); !err.empty()) {
+                return err;
+            }
+            if (auto err = readLine(line, deadline); !err.empty()) {
+                return err;
+            }
+        }
+        /* Trailers end with an empty line. */
+        do {
+            if (auto err = readLine(line, deadline); !err.empty()) {
+                return err;
+            }
+        } while (!line.empty());
+        return {};
+    }
+
+    /*
+     * Read the next response. `keepAlive` is cleared when the connection
+     * cannot carry another one.
+     */
+    std::string readResponse(const PooledRequest &request,
+                             PooledResponse &response, bool &keepAlive,
+                             Clock::time_point deadline) {
+        bool head = request.method == "HEAD";
+        StreamingHeaderParser parser;
+        bool http11 = false;
+        do {
+            parser.reset();
+            while (parser.parse(buffer) ==
+                   StreamingHeaderParser::Status::INCOMPLETE) {
+                if (auto err = receive(buffer, deadline); !err.empty()) {
+                    return err;
+                }
+            }
+            if (parser.status() == StreamingHeaderParser::Status::INVALID) {
+                return "bad response header";
+            }
+            auto line = parser.startLine();
+            if (line.size() < 12 || line.substr(0, 5) != "HTTP/") {
+                return "bad status line";
+            }
+            http11 = line.substr(5, 3) == "1.1";
+            auto [ptr, ec] =
+                std::from_chars(line.data() + 9, line.data() + 12,
+                                response.status);
+            if (ec != std::errc{}) {
+                return "bad status code";
+            }
+            response.reason = line.size() > 13 ? line.substr(13) : "";
+            response.headers.clear();
+            for (std::size_t i = 0; i < parser.size(); ++i) {
+                auto field = parser.field(i);
+                response.headers.emplace_back(field.name, field.value);
+            }
+            buffer.erase(0, parser.consumed());
+        } while (response.status >= 100 && response.status < 200 &&
+                 response.status != 101);
+
+        auto connection = response.header("Connection");
+        keepAlive = http11 ? !(connection && hasToken(*connection, "close"))
+                           : connection && hasToken(*connection, "keep-alive");
+        pipelining = http11 && keepAlive;
+
+        response.body.clear();
+        if (head || response.status == 204 || response.status == 304) {
+            return {};
+        }
+        sinkRequest = request.on_body ? &request : nullptr;
+        sinkResponse = &response;
+        sinkOffset = 0;
+        auto err = readPayload(response, keepAlive, deadline);
+        if (err.empty()) {
+            err = feed(response.body);
+        }
+        sinkRequest = nullptr;
+        sinkResponse = nullptr;
+        return err;
+    }
+
+    std::string readPayload(PooledResponse &response, bool &keepAlive,
+                            Clock::time_point deadline) {
+        if (auto encoding = response.header("Transfer-Encoding");
+            encoding && hasToken(*encoding, "chunked")) {
+            return readChunked(response.body, deadline);
+        }
+        if (auto length = response.header("Content-Length")) {
+            std::size_t size = 0;
+            auto [ptr, ec] = std::from_chars(
+                length->data(), length->data() + length->size(), size);
+            if (ec != std::errc{}) {
+                return "bad content length";
+            }
+            return readBody(response.body, size, deadline);
+        }
+        /* Delimited by the end of the connection. */
+        keepAlive = false;
+        response.body.swap(buffer);
+        buffer.clear();
+        while (true) {
+            auto err = receive(response.body, deadline);
+            if (err == "connection closed") {
+                return {};
+            }
+            if (!err.empty()) {
+                return err;
+            }
+            if (err = feed(response.body); !err.empty()) {
+                return err;
+            }
+        }
+    }
+};
+
+std::unique_ptr<Connection> connectTo(const std::string &host, int port,
+                                      Clock::time_point deadline,
+                                      std::string &err) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    auto service = std::to_string(port);
+    if (int rc = getaddrinfo(host.c_str(), service.c_str(), &hints, &result);
+        rc != 0) {
+        err = "cannot resolve " + host + ": " + gai_strerror(rc);
+        return nullptr;
+    }
+
+    std::unique_ptr<Connection> conn;
+    err = "cannot connect to " + host + ":" + service;
+    for (auto *ai = result; ai != nullptr && !conn; ai = ai->ai_next) {
+        auto fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == kInvalidSocket) {
+            continue;
+        }
+        setBlocking(fd, false);
+        int rc = ::connect(fd, ai->ai_addr,
+                           static_cast<socklen_t>(ai->ai_addrlen));
+        bool connected = rc == 0;
+        if (!connected) {
+#ifdef _WIN32
+            bool pending = lastSocketError() == WSAEWOULDBLOCK;
+#else
+            bool pending = errno == EINPROGRESS;
+#endif
+            if (pending && waitFor(fd, POLLOUT, deadline)) {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR,
+                           reinterpret_cast<char *>(&error), &len);
+                connected = error == 0;
+            }
+        }
+        if (!connected) {
+            closeSocket(fd);
+            continue;
+        }
+        setBlocking(fd, true);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<const char *>(&one), sizeof(one));
+        conn = std::make_unique<Connection>();
+        conn->fd = fd;
+    }
+    freeaddrinfo(result);
+    return conn;
+}
+
+std::string serialize(const std::string &host, int port,
+                      const PooledRequest &request) {
+    std::string out;
+    out.reserve(128 + request.target.size() + request.body.size());
+    out.append(request.method).append(" ").append(request.target);
+    out.append(" HTTP/1.1\r\nHost: ");
+    if (host.find(':') != std::string::npos) {
+        out.append("[").append(host).append("]");
+    } else {
+        out.append(host);
+    }
+    if (port != 80) {
+        out.append(":").append(std::to_string(port));
+    }
+    out.append("\r\n");
+    bool hasLength = false;
+    for (const auto &[key, value] : request.headers) {
+        hasLength = hasLength || iequals(key, "Content-Length");
+        out.append(key).append(": ").append(value).append("\r\n");
+    }
+    if (!hasLength && (!request.body.empty() || request.method == "POST" ||
+                       request.method == "PUT" || request.method == "PATCH")) {
+        out.append("Content-Length: ")
+            .append(std::to_string(request.body.size()))
+            .append("\r\n");
+    }
+    out.append("\r\n").append(request.body);
+    return out;
+}
+}  // namespace
+
+std::optional<std::string_view> PooledResponse::header(
+    std::string_view name) const {
+    for (const auto &[key, value] : headers) {
+        if (iequals(key, name)) {
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+
+class HttpConnectionPool::Impl {
+public:
+    struct Pending {
+        PooledRequest request;
+        std::promise<PooledResponse> promise;
+        std::shared_future<PooledResponse> future;
+        std::vector<Callback> callbacks;
+        std::string key;
+        int retries = 0;
+    };
+    using PendingPtr = std::shared_ptr<Pending>;
+
+    struct Host {
+        std::string name;
+        int port = 0;
+        std::mutex mutex;
+        std::deque<PendingPtr> queue;
+        std::vector<std::unique_ptr<Connection>> idle;
+        std::size_t workers = 0;
+    };
+
+    explicit Impl(Options options)
+        : options_(options),
+          pool_(std::make_unique<atom::async::ThreadPool>(
+              std::max<std::size_t>(1, options.worker_threads))) {
+        options_.max_connections_per_host =
+            std::max<std::size_t>(1, options_.max_connections_per_host);
+        options_.max_pipeline_depth =
+            std::max<std::size_t>(1, options_.max_pipeline_depth);
+#ifdef _WIN32
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+    }
+
+    ~Impl() {
+        closing_ = true;
+        std::vector<PendingPtr> abandoned;
+        {
+            std::scoped_lock lock(hostsMutex_);
+            for (auto &[key, host] : hosts_) {
+                std::scoped_lock hostLock(host->mutex);
+                abandoned.insert(abandoned.end(), host->queue.begin(),
+                                 host->queue.end());
+                host->queue.clear();
+            }
+        }
+        for (auto &pending : abandoned) {
+            fail(pending, "connection pool shut down");
+        }
+        pool_.reset();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    std::shared_future<PooledResponse> submit(const std::string &host,
+                                              int port, PooledRequest request,
+                                              Callback callback) {
+        ++stats_.requests;
+        std::string key;
+        if (request.coalesce && !request.on_body && isPipelinable(request)) {
+            key = request.method + " " + host + ":" + std::to_string(port) +
+                  request.target;
+        }
+
+        auto pending = std::make_shared<Pending>();
+        pending->request = std::move(request);
+        pending->future = pending->promise.get_future().share();
+        pending->key = key;
+        auto future = pending->future;
+        {
+            std::scoped_lock lock(inflightMutex_);
+            if (!key.empty()) {
+                if (auto it = inflight_.find(key); it != inflight_.end()) {
+                    ++stats_.coalesced;
+                    if (callback) {
+                        it->second->callbacks.push_back(std::move(callback));
+                    }
+                    return it->second->future;
+                }
+                inflight_.emplace(key, pending);
+            }
+            if (callback) {
+                pending->callbacks.push_back(std::move(callback));
+            }
+        }
+
+        if (closing_) {
+            fail(pending, "connection pool shut down");
+            return future;
+        }
+        auto target = hostFor(host, port);
+        bool spawn = false;
+        {
+            std::scoped_lock lock(target->mutex);
+            target->queue.push_back(std::move(pending));
+            if (target->workers < options_.max_connections_per_host &&
+                target->workers < target->queue.size()) {
+                ++target->workers;
+                spawn = true;
+            }
+        }
+        if (spawn) {
+            post(target);
+        }
+        return future;
+    }
+
+    void closeIdle() {
+        std::scoped_lock lock(hostsMutex_);
+        for (auto &[key, host] : hosts_) {
+            std::scoped_lock hostLock(host->mutex);
+            host->idle.clear();
+        }
+    }
+
+    Stats stats() const {
+        return {stats_.requests.load(),  stats_.connectionsOpened.load(),
+                stats_.reused.load(),    stats_.pipelined.load(),
+                stats_.coalesced.load(), stats_.retried.load()};
+    }
+
+private:
+    std::shared_ptr<Host> hostFor(const std::string &name, int port) {
+        std::scoped_lock lock(hostsMutex_);
+        auto &host = hosts_[name + ":" + std::to_string(port)];
+        if (!host) {
+            host = std::make_shared<Host>();
+            host->name = name;
+            host->port = port;
+        }
+        return host;
+    }
+
+    /* Take the most recently used live idle connection. */
+    std::unique_ptr<Connection> takeIdle(Host &host) {
+        auto now = Clock::now();
+        while (!host.idle.empty()) {
+            auto conn = std::move(host.idle.back());
+            host.idle.pop_back();
+            if (now - conn->lastUsed < options_.idle_timeout &&
+                !conn->stale()) {
+                return conn;
+            }
+        }
+        return nullptr;
+    }
+
+    std::chrono::milliseconds timeoutOf(const Pending &pending) const {
+        return pending.request.timeout.count() > 0 ? pending.request.timeout
+                                                   : options_.timeout;
+    }
+
+    /*
+     * Serve the host queue one batch per pool task. Between round trips the
+     * thread goes back to the pool and the host queues up behind other
+     * hosts; it keeps its connection slot (`workers`) until it runs dry.
+     */
+    void post(const std::shared_ptr<Host> &host) {
+        pool_->enqueue([this, host] {
+            while (serveBatch(*host)) {
+                try {
+                    post(host);
+                    return;
+                } catch (const atom::error::UnlawfulOperation &) {
+                    /* The pool is shutting down, finish here. */
+                }
+            }
+        });
+    }
+
+    /* One round trip; false once the queue is empty and the slot freed. */
+    bool serveBatch(Host &host) {
+        std::unique_ptr<Connection> conn;
+        std::vector<PendingPtr> batch;
+        {
+            std::scoped_lock lock(host.mutex);
+            if (host.queue.empty()) {
+                --host.workers;
+                return false;
+            }
+            conn = takeIdle(host);
+            std::size_t depth =
+                conn && conn->pipelining ? options_.max_pipeline_depth : 1;
+            // Leave a share of a burst to the other workers so it is
+            // spread over several connections instead of one pipeline.
+            std::size_t share =
+                (host.queue.size() + host.workers - 1) / host.workers;
+            depth = std::min(depth, std::max<std::size_t>(1, share));
+            batch.push_back(std::move(host.queue.front()));
+            host.queue.pop_front();
+            while (batch.size() < depth && !host.queue.empty() &&
+                   isPipelinable(batch.front()->request) &&
+                   isPipelinable(host.queue.front()->request)) {
+                batch.push_back(std::move(host.queue.front()));
+                host.queue.pop_front();
+            }
+        }
+
+        bool reused = conn != nullptr;
+        std::vector<PendingPtr> retry;
+        bool keep = false;
+        if (!conn) {
+            std::string err;
+            conn = connectTo(host.name, host.port,
+                             Clock::now() + timeoutOf(*batch.front()), err);
+            if (!conn) {
+                LOG_F(WARNING, "HttpConnectionPool: {}", err);
+                for (auto &pending : batch) {
+                    fail(pending, err);
+                }
+            } else {
+                ++stats_.connectionsOpened;
+            }
+        }
+        if (conn) {
+            keep = execute(host, *conn, batch, reused, retry);
+        }
+
+        std::scoped_lock lock(host.mutex);
+        if (keep && !closing_) {
+            conn->lastUsed = Clock::now();
+            host.idle.push_back(std::move(conn));
+        }
+        for (auto it = retry.rbegin(); it != retry.rend(); ++it) {
+            host.queue.push_front(std::move(*it));
+        }
+        if (host.queue.empty()) {
+            --host.workers;
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Write the batch and read the responses in order. Requests left
+     * unanswered are moved to `retry` or failed. Returns whether the
+     * connection can be kept.
+     */
+    bool execute(const Host &host, Connection &conn,
+                 std::vector<PendingPtr> &batch, bool reused,
+                 std::vector<PendingPtr> &retry) {
+        std::string wire;
+        for (const auto &pending : batch) {
+            wire += serialize(host.name, host.port, pending->request);
+        }
+        if (batch.size() > 1) {
+            stats_.pipelined += batch.size() - 1;
+        }
+
+        std::size_t done = 0;
+        bool keepAlive = true;
+        /* Part of the response to batch[done] arrived before an error. */
+        bool answered = false;
+        auto err = conn.sendAll(wire, Clock::now() + timeoutOf(*batch[0]));
+        while (err.empty() && keepAlive && done < batch.size()) {
+            auto &pending = batch[done];
+            PooledResponse response;
+            bool buffered = !conn.buffer.empty();
+            auto received = conn.received;
+            err = conn.readResponse(pending->request, response, keepAlive,
+                                    Clock::now() + timeoutOf(*pending));
+            if (!err.empty()) {
+                answered = buffered || conn.received != received;
+                break;
+            }
+            response.reused = reused || conn.served > 0;
+            if (response.reused) {
+                ++stats_.reused;
+            }
+            ++conn.served;
+            ++done;
+            complete(pending, std::move(response));
+        }
+
+        /* Only requests the server closed the connection on (or announced
+         * it would) before answering are sent again. After a timeout or a
+         * partial response the server may well have acted on them. */
+        bool closed = err.empty() || isClosed(err);
+        for (auto i = done; i < batch.size(); ++i) {
+            auto &pending = batch[i];
+            /* A fresh connection that failed on its first request is
+             * reported, it was not a stale keep-alive connection. */
+            bool lost = closed && (i > done || (!answered &&
+                                                (reused || done > 0)));
+            if (lost && !closing_ && isRetryable(pending->request) &&
+                pending->retries < kMaxRetries) {
+                ++pending->retries;
+                ++stats_.retried;
+                retry.push_back(std::move(pending));
+            } else {
+                fail(pending, err.empty() ? "connection closed" : err);
+            }
+        }
+        return err.empty() && keepAlive;
+    }
+
+    void fail(const PendingPtr &pending, const std::string &err) {
+        PooledResponse response;
+        response.error = err;
+        complete(pending, std::move(response));
+    }
+
+    void complete(const PendingPtr &pending, PooledResponse response) {
+        std::vector<Callback> callbacks;
+        {
+            std::scoped_lock lock(inflightMutex_);
+            if (!pending->key.empty()) {
+                auto it = inflight_.find(pending->key);
+                if (it != inflight_.end() && it->second == pending) {
+                    inflight_.erase(it);
+                }
+            }
+            callbacks.swap(pending->callbacks);
+        }
+        pending->promise.set_value(std::move(response));
+        const auto &result = pending->future.get();
+        for (auto &callback : callbacks) {
+            try {
+                callback(result);
+            } catch (const std::exception &e) {
+                LOG_F(ERROR, "HttpConnectionPool callback threw: {}",
+                      e.what());
+            }
+        }
+    }
+
+    Options options_;
+    std::atomic<bool> closing_{false};
+
+    std::mutex hostsMutex_;
+    std::map<std::string, std::shared_ptr<Host>> hosts_;
+
+    std::mutex inflightMutex_;
+    std::map<std::string, PendingPtr> inflight_;
+
+    struct {
+        std::atomic<std::uint64_t> requests{0};
+        std::atomic<std::uint64_t> connectionsOpened{0};
+        std::atomic<std::uint64_t> reused{0};
+        std::atomic<std::uint64_t> pipelined{0};
+        std::atomic<std::uint64_t> coalesced{0};
+        std::atomic<std::uint64_t> retried{0};
+    } stats_;
+
+    std::unique_ptr<atom::async::ThreadPool> pool_;
+};
+
+HttpConnectionPool::HttpConnectionPool() : HttpConnectionPool(Options{}) {}
+
+HttpConnectionPool::HttpConnectionPool(Options options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+HttpConnectionPool::~HttpConnectionPool() = default;
+
+HttpConnectionPool &HttpConnectionPool::shared() {
+    static HttpConnectionPool pool;
+    return pool;
+}
+
+std::shared_future<PooledResponse> HttpConnectionPool::request(
+    const std::string &host, int port, PooledRequest request) {
+    return impl_->submit(host, port, std::move(request), {});
+}
+
+void HttpConnectionPool::request(const std::string &host, int port,
+                                 PooledRequest request, Callback callback) {
+    impl_->submit(host, port, std::move(request), std::move(callback));
+}
+
+std::shared_future<PooledResponse> HttpConnectionPool::request(
+    std::string_view url, PooledRequest request) {
+    std::string host;
+    int port = 0;
+    if (!splitUrl(url, host, port, request.target)) {
+        std::promise<PooledResponse> promise;
+        PooledResponse response;
+        response.error = "unsupported URL: " + std::string(url);
+        promise.set_value(std::move(response));
+        return promise.get_future().share();
+    }
+    return impl_->submit(host, port, std::move(request), {});
+}
+
+std::shared_future<PooledResponse> HttpConnectionPool::get(
+    std::string_view url,
+    std::vector<std::pair<std::string, std::string>> headers) {
+    PooledRequest request;
+    request.headers = std::move(headers);
+    return this->request(url, std::move(request));
+}
+
+void HttpConnectionPool::closeIdle() { impl_->closeIdle(); }
+
+HttpConnectionPool::Stats HttpConnectionPool::stats() const {
+    return impl_->stats();
+}
+
+bool HttpConnectionPool::splitUrl(std::string_view url, std::string &host,
+                                  int &port, std::string &target) {
+    constexpr std::string_view scheme = "http://";
+    if (url.size() <= scheme.size() ||
+        !iequals(url.substr(0, scheme.size()), scheme)) {
+        return false;
+    }
+    url.remove_prefix(scheme.size());
+    auto slash = url.find_first_of("/?");
+    auto authority = url.substr(0, slash);
+    target = slash == std::string_view::npos ? "/"
+                                              : std::string(url.substr(slash));
+    if (target.front() == '?') {
+        target.insert(0, "/");
+    }
+
+    port = 80;
+    auto colon = authority.rfind(':');
+    if (colon != std::string_view::npos &&
+        authority.find(']', colon) == std::string_view::npos) {
+        auto digits = authority.substr(colon + 1);
+        auto [ptr, ec] =
+            std::from_chars(digits.data(), digits.data() + digits.size(), port);
+        if (ec != std::errc{} || ptr != digits.data() + digits.size()) {
+            return false;
+        }
+        authority = authority.substr(0, colon);
+    }
+    if (authority.size() > 2 && authority.front() == '[' &&
+        authority.back() == ']') {
+        authority = authority.substr(1, authority.size() - 2);
+    }
+    host = std::string(authority);
+    return !host.empty();
+}
+}  // namespace atom::web
@@ -0,0 +1,192 @@
+/*
+ * httppool.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-6-27
+
+Description: Keep-alive HTTP/1.1 client with per-host connection pools
+
+**************************************************/
+
+#ifndef ATOM_WEB_HTTPPOOL_HPP
+#define ATOM_WEB_HTTPPOOL_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace atom::web {
+struct PooledResponse;
+
+/**
+ * @brief A request sent through HttpConnectionPool.
+ */
+struct PooledRequest {
+    std::string method = "GET";
+    /** Origin-form target, e.g. "/api/v1/camera/0/ccdtemperature?x=1". */
+    std::string target = "/";
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    /** Per request timeout, zero means the pool default. */
+    std::chrono::milliseconds timeout{0};
+    /**
+     * Share the response with identical GET/HEAD requests already in flight.
+     * Only method, host, port and target are compared, so per request
+     * headers such as transaction ids do not prevent coalescing.
+     */
+    bool coalesce = true;
+    /**
+     * Send a PUT or DELETE again when the connection closed before any of
+     * the response arrived. GET, HEAD and OPTIONS are always retried; PUT
+     * and DELETE only on request, as a device may already have acted on
+     * them.
+     */
+    bool retry_writes = false;
+    /**
+     * Receives the body in pieces instead of PooledResponse::body, so a
+     * large download can be decoded straight into its destination.
+     * `offset` is the position of `chunk` in the body and 0 starts a new
+     * response, as a retried request starts over. Returning false aborts
+     * the transfer. Requests with a sink are never coalesced.
+     */
+    std::function<bool(const PooledResponse &response, std::string_view chunk,
+                       std::size_t offset)>
+        on_body;
+};
+
+/**
+ * @brief The result of a PooledRequest.
+ */
+struct PooledResponse {
+    int status = 0;
+    std::string reason;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    /** Transport error, empty when a response was received. */
+    std::string error;
+    /** Whether the response came over a kept-alive connection. */
+    bool reused = false;
+
+    bool ok() const { return error.empty(); }
+
+    /**
+     * @brief Value of the first header called `name`, case-insensitive.
+     */
+    std::optional<std::string_view> header(std::string_view name) const;
+};
+
+/**
+ * @class HttpConnectionPool
+ * @brief HTTP/1.1 client that keeps connections open between requests.
+ *
+ * Each host:port gets up to `max_connections_per_host` persistent
+ * connections which are reused until the server closes them or they sit
+ * idle for longer than `idle_timeout`. Consecutive GET/HEAD requests to the
+ * same host are pipelined on a connection that has already answered with
+ * keep-alive, and identical GET/HEAD requests that are still in flight are
+ * answered by a single round trip. A request the server closed the
+ * connection on before answering any of it is retried once on a fresh
+ * connection (PUT and DELETE only with `retry_writes`); a request that
+ * timed out is never retried.
+ *
+ * Requests complete on an internal worker thread, either through the
+ * returned future or a callback. A worker serves one round trip at a time
+ * and then queues up behind the other hosts, so a busy host does not
+ * starve the rest. Callbacks must not block on other pooled
+ * requests. Only plain http is supported.
+ */
+class HttpConnectionPool {
+public:
+    struct Options {
+        std::size_t max_connections_per_host = 4;
+        /** Requests written ahead on one connection, 1 disables it. */
+        std::size_t max_pipeline_depth = 8;
+        std::size_t worker_threads = 4;
+        std::chrono::milliseconds timeout{5000};
+        std::chrono::milliseconds idle_timeout{30000};
+    };
+
+    struct Stats {
+        std::uint64_t requests = 0;
+        std::uint64_t connections_opened = 0;
+        std::uint64_t reused = 0;
+        std::uint64_t pipelined = 0;
+        std::uint64_t coalesced = 0;
+        std::uint64_t retried = 0;
+    };
+
+    using Callback = std::function<void(const PooledResponse &)>;
+
+    HttpConnectionPool();
+    explicit HttpConnectionPool(Options options);
+    ~HttpConnectionPool();
+
+    HttpConnectionPool(const HttpConnectionPool &) = delete;
+    HttpConnectionPool &operator=(const HttpConnectionPool &) = delete;
+
+    /**
+     * @brief The process wide pool used by device clients.
+     */
+    static HttpConnectionPool &shared();
+
+    /**
+     * @brief Queue a request to host:port.
+     * @return Future completed with the response or a transport error.
+     */
+    std::shared_future<PooledResponse> request(const std::string &host,
+                                               int port,
+                                               PooledRequest request);
+
+    /**
+     * @brief Queue a request to host:port and call `callback` on completion.
+     */
+    void request(const std::string &host, int port, PooledRequest request,
+                 Callback callback);
+
+    /**
+     * @brief Queue a request to an absolute "http://host[:port]/path" URL.
+     *
+     * `request.target` is replaced by the path and query of `url`.
+     */
+    std::shared_future<PooledResponse> request(std::string_view url,
+                                               PooledRequest request);
+
+    /**
+     * @brief Queue a GET of an absolute URL.
+     */
+    std::shared_future<PooledResponse> get(
+        std::string_view url,
+        std::vector<std::pair<std::string, std::string>> headers = {});
+
+    /**
+     * @brief Close every idle connection.
+     */
+    void closeIdle();
+
+    Stats stats() const;
+
+    /**
+     * @brief Split "http://host[:port]/path?q" into its parts.
+     * @return false if the URL is not a plain http URL.
+     */
+    static bool splitUrl(std::string_view url, std::string &host, int &port,
+                         std::string &target);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+}  // namespace atom::web
+
+#endif
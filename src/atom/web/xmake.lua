@@ -17,6 +17,7 @@ local sources = {
     "address.cpp",
     "downloader.cpp",
     "httpclient.cpp",
+    "httppool.cpp",
     "httplite.cpp",
     "utils.cpp",
     "time.cpp"
@@ -27,6 +28,7 @@ local headers = {
     "address.hpp",
     "downloader.hpp",
     "httpclient.hpp",
+    "httppool.hpp",
     "httplite.hpp",
     "utils.hpp",
     "time.hpp"
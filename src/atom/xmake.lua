@@ -19,7 +19,7 @@ if has_config("atom_build_python") then
     add_requires("pybind11")
 end
 
-add_subdirs("algorithm", "async", "components", "connection", "driver", "event", "experiment", "io", "log", "server", "search", "system", "task", "type", "utils", "web")
+add_subdirs("algorithm", "async", "components", "connection", "driver", "event", "experiment", "io", "log", "server", "search", "system", "task", "type", "utils", "video", "web")
 
 if not has_config("HAS_STD_FORMAT") then
     add_requires("fmt")
@@ -61,6 +61,7 @@ local dependencies = {
     "atom-type",
     "atom-utils",
     "atom-search",
+    "atom-video",
     "atom-web",
     "atom-system",
     "atom-server"
@@ -0,0 +1,439 @@
+/*
+ * discovery.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-3
+
+Description: Background Alpaca device discovery with a result cache
+
+**************************************************/
+
+#include "discovery.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <set>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "atom/log/loguru.hpp"
+
+namespace lithium {
+namespace {
+constexpr std::string_view ALPACA_DISCOVERY = "alpacadiscovery1";
+constexpr const char *ALPACA_MULTICAST6 = "ff12::a1:9aca";
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) ==
+                      std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+void sendProbe(int fd, const sockaddr *addr, socklen_t len) {
+    if (::sendto(fd, ALPACA_DISCOVERY.data(), ALPACA_DISCOVERY.size(), 0,
+                 addr, len) < 0 &&
+        errno != ENETUNREACH && errno != EADDRNOTAVAIL) {
+        LOG_F(WARNING, "Failed to send Alpaca discovery probe: {}",
+              std::strerror(errno));
+    }
+}
+}  // namespace
+
+std::string AlpacaServer::address() const {
+    if (host.find(':') != std::string::npos) {
+        return "[" + host + "]:" + std::to_string(port);
+    }
+    return host + ":" + std::to_string(port);
+}
+
+AlpacaDiscovery::AlpacaDiscovery() : AlpacaDiscovery(Options{}) {}
+
+AlpacaDiscovery::AlpacaDiscovery(Options options)
+    : m_options(std::move(options)) {}
+
+AlpacaDiscovery::~AlpacaDiscovery() { stop(); }
+
+bool AlpacaDiscovery::start() {
+    if (m_running.exchange(true)) {
+        return true;
+    }
+    {
+        std::lock_guard lock(m_wake_mutex);
+        if (::pipe(m_wake) != 0) {
+            LOG_F(ERROR, "Failed to create discovery wake pipe: {}",
+                  std::strerror(errno));
+            m_wake[0] = m_wake[1] = -1;
+            m_running = false;
+            return false;
+        }
+        setNonBlocking(m_wake[0]);
+        setNonBlocking(m_wake[1]);
+    }
+
+    int on = 1;
+    if (m_options.ipv4) {
+        m_socket4 = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_socket4 >= 0) {
+            setsockopt(m_socket4, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+            setNonBlocking(m_socket4);
+        }
+    }
+    if (m_options.ipv6) {
+        m_socket6 = ::socket(AF_INET6, SOCK_DGRAM, 0);
+        if (m_socket6 >= 0) {
+            setsockopt(m_socket6, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+            setNonBlocking(m_socket6);
+        }
+    }
+    if (m_socket4 < 0 && m_socket6 < 0) {
+        LOG_F(ERROR, "Failed to create Alpaca discovery sockets");
+        stop();
+        return false;
+    }
+    m_thread = std::thread([this] { loop(); });
+    DLOG_F(INFO, "Alpaca discovery started");
+    return true;
+}
+
+void AlpacaDiscovery::stop() {
+    if (m_thread.joinable()) {
+        m_running = false;
+        probe();
+        m_thread.join();
+    }
+    m_running = false;
+    std::lock_guard wakeLock(m_wake_mutex);
+    for (int *fd : {&m_socket4, &m_socket6, &m_wake[0], &m_wake[1]}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    // 等待中的设备列表请求由连接池在超时后结束
+    std::unique_lock lock(m_mutex);
+    m_listing.clear();
+}
+
+void AlpacaDiscovery::probe() {
+    m_probe_now = true;
+    // 与 stop() 关闭管道互斥，否则可能写入已经关闭并被复用的描述符
+    std::lock_guard lock(m_wake_mutex);
+    if (m_wake[1] >= 0) {
+        char byte = 1;
+        [[maybe_unused]] auto n = ::write(m_wake[1], &byte, 1);
+    }
+}
+
+/*
+ * 这里直接使用 poll() 而不是 atom::connection::Reactor：循环需要按探测
+ * 间隔、服务器过期时间和设备列表请求定时醒来，Reactor 没有定时器，
+ * 而且只有两个套接字和一个唤醒管道，不值得为此再占用一个 Reactor 线程。
+ */
+void AlpacaDiscovery::loop() {
+    auto next = Clock::now();
+    while (m_running) {
+        auto now = Clock::now();
+        if (m_probe_now.exchange(false) || now >= next) {
+            sendProbes();
+            next = now + m_options.interval;
+        }
+
+        // 醒来的时间取下一轮探测和最早过期的服务器中较早的一个
+        bool listing;
+        auto deadline = next;
+        {
+            std::shared_lock lock(m_mutex);
+            listing = !m_listing.empty();
+            for (const auto &[address, server] : m_servers) {
+                deadline = std::min(deadline, server.last_seen +
+                                                  m_options.ttl +
+                                                  std::chrono::milliseconds(1));
+            }
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - Clock::now());
+        if (listing) {
+            wait = std::min(wait, std::chrono::milliseconds(20));
+        }
+
+        pollfd fds[3];
+        nfds_t count = 0;
+        fds[count++] = {m_wake[0], POLLIN, 0};
+        for (int fd : {m_socket4, m_socket6}) {
+            if (fd >= 0) {
+                fds[count++] = {fd, POLLIN, 0};
+            }
+        }
+        int ready = ::poll(fds, count,
+                           static_cast<int>(std::max<int64_t>(
+                               wait.count(), 0)));
+        if (ready > 0) {
+            if (fds[0].revents & POLLIN) {
+                char drain[64];
+                while (::read(m_wake[0], drain, sizeof(drain)) > 0) {
+                }
+            }
+            for (nfds_t i = 1; i < count; ++i) {
+                if (fds[i].revents & POLLIN) {
+                    receive(fds[i].fd);
+                }
+            }
+        }
+        collectListings();
+        expire();
+    }
+}
+
+void AlpacaDiscovery::sendProbes() {
+    ifaddrs *interfaces = nullptr;
+    if (::getifaddrs(&interfaces) != 0) {
+        LOG_F(WARNING, "Failed to list network interfaces: {}",
+              std::strerror(errno));
+        interfaces = nullptr;
+    }
+
+    // 所有报文一次性发出，响应由事件循环在到达时处理
+    std::set<std::string> sent;
+    std::set<unsigned> multicast;
+    for (auto *ifa = interfaces; ifa != nullptr; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == nullptr || !(ifa->ifa_flags & IFF_UP)) {
+            continue;
+        }
+        auto family = ifa->ifa_addr->sa_family;
+        if (family == AF_INET && m_socket4 >= 0) {
+            sockaddr_in target{};
+            target.sin_family = AF_INET;
+            target.sin_port = htons(m_options.port);
+            if (ifa->ifa_flags & IFF_LOOPBACK) {
+                target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            } else if ((ifa->ifa_flags & IFF_BROADCAST) &&
+                       ifa->ifa_broadaddr != nullptr) {
+                target.sin_addr =
+                    reinterpret_cast<sockaddr_in *>(ifa->ifa_broadaddr)
+                        ->sin_addr;
+            } else {
+                continue;
+            }
+            char text[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &target.sin_addr, text, sizeof(text));
+            if (sent.insert(text).second) {
+                sendProbe(m_socket4, reinterpret_cast<sockaddr *>(&target),
+                          sizeof(target));
+            }
+        } else if (family == AF_INET6 && m_socket6 >= 0) {
+            sockaddr_in6 target{};
+            target.sin6_family = AF_INET6;
+            target.sin6_port = htons(m_options.port);
+            if (ifa->ifa_flags & IFF_LOOPBACK) {
+                target.sin6_addr = in6addr_loopback;
+                if (!sent.insert("::1").second) {
+                    continue;
+                }
+            } else {
+                unsigned index = if_nametoindex(ifa->ifa_name);
+                if (!(ifa->ifa_flags & IFF_MULTICAST) || index == 0 ||
+                    !multicast.insert(index).second) {
+                    continue;
+                }
+                inet_pton(AF_INET6, ALPACA_MULTICAST6, &target.sin6_addr);
+                target.sin6_scope_id = index;
+                setsockopt(m_socket6, IPPROTO_IPV6, IPV6_MULTICAST_IF, &index,
+                           sizeof(index));
+            }
+            sendProbe(m_socket6, reinterpret_cast<sockaddr *>(&target),
+                      sizeof(target));
+        }
+    }
+    if (interfaces != nullptr) {
+        ::freeifaddrs(interfaces);
+    }
+
+    for (const auto &host : m_options.extra_hosts) {
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo *result = nullptr;
+        auto service = std::to_string(m_options.port);
+        if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &result) !=
+            0) {
+            LOG_F(WARNING, "Cannot resolve Alpaca host {}", host);
+            continue;
+        }
+        for (auto *ai = result; ai != nullptr; ai = ai->ai_next) {
+            int fd = ai->ai_family == AF_INET ? m_socket4 : m_socket6;
+            if (fd >= 0) {
+                sendProbe(fd, ai->ai_addr, ai->ai_addrlen);
+                break;
+            }
+        }
+        ::freeaddrinfo(result);
+    }
+}
+
+void AlpacaDiscovery::receive(int fd) {
+    char buffer[1024];
+    sockaddr_storage from{};
+    socklen_t length = sizeof(from);
+    ssize_t got;
+    while ((got = ::recvfrom(fd, buffer, sizeof(buffer), 0,
+                             reinterpret_cast<sockaddr *>(&from), &length)) >
+           0) {
+        char text[INET6_ADDRSTRLEN] = {};
+        std::string host;
+        if (from.ss_family == AF_INET) {
+            inet_ntop(AF_INET,
+                      &reinterpret_cast<sockaddr_in *>(&from)->sin_addr, text,
+                      sizeof(text));
+            host = text;
+        } else {
+            const auto *from6 = reinterpret_cast<sockaddr_in6 *>(&from);
+            inet_ntop(AF_INET6, &from6->sin6_addr, text, sizeof(text));
+            host = text;
+            // 链路本地地址只在收到响应的网卡上有效，连接时需要带上网卡
+            char name[IF_NAMESIZE];
+            if (IN6_IS_ADDR_LINKLOCAL(&from6->sin6_addr) &&
+                from6->sin6_scope_id != 0 &&
+                if_indextoname(from6->sin6_scope_id, name) != nullptr) {
+                host.append("%").append(name);
+            }
+        }
+        std::string payload(buffer, static_cast<size_t>(got));
+        if (payload != ALPACA_DISCOVERY) {
+            handleResponse(host, payload);
+        }
+        length = sizeof(from);
+    }
+}
+
+void AlpacaDiscovery::handleResponse(const std::string &host,
+                                     const std::string &payload) {
+    int port = 0;
+    try {
+        port = json::parse(payload).value("AlpacaPort", 0);
+    } catch (const std::exception &e) {
+        DLOG_F(WARNING, "Invalid Alpaca discovery response from {}: {}", host,
+               e.what());
+        return;
+    }
+    if (port <= 0 || port > 65535) {
+        return;
+    }
+
+    auto now = Clock::now();
+    std::unique_lock lock(m_mutex);
+    AlpacaServer probe{.host = host, .port = port};
+    auto address = probe.address();
+    auto [it, inserted] = m_servers.try_emplace(address, std::move(probe));
+    auto &server = it->second;
+    server.last_seen = now;
+    if (inserted) {
+        LOG_F(INFO, "Found Alpaca server {}", address);
+    }
+    bool stale =
+        server.devices.is_null() || now - server.listed > m_options.ttl;
+    if (!stale || m_listing.contains(address)) {
+        return;
+    }
+    atom::web::PooledRequest request;
+    request.timeout = m_options.listing_timeout;
+    m_listing.emplace(
+        address, atom::web::HttpConnectionPool::shared().request(
+                     "http://" + address + "/management/v1/configureddevices",
+                     std::move(request)));
+}
+
+void AlpacaDiscovery::collectListings() {
+    std::unique_lock lock(m_mutex);
+    for (auto it = m_listing.begin(); it != m_listing.end();) {
+        if (it->second.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        const auto &response = it->second.get();
+        auto server = m_servers.find(it->first);
+        if (server != m_servers.end() && response.ok() &&
+            response.status == 200) {
+            try {
+                auto value = json::parse(response.body).at("Value");
+                if (value.is_array()) {
+                    server->second.devices = std::move(value);
+                    server->second.listed = Clock::now();
+                }
+            } catch (const std::exception &e) {
+                LOG_F(WARNING, "Invalid device list from {}: {}", it->first,
+                      e.what());
+            }
+        } else if (!response.ok() || response.status != 200) {
+            LOG_F(WARNING, "Failed to list devices of {}: {}", it->first,
+                  response.ok() ? std::to_string(response.status)
+                                : response.error);
+        }
+        it = m_listing.erase(it);
+    }
+}
+
+void AlpacaDiscovery::expire() {
+    auto now = Clock::now();
+    std::unique_lock lock(m_mutex);
+    std::erase_if(m_servers, [&](const auto &item) {
+        if (now - item.second.last_seen <= m_options.ttl) {
+            return false;
+        }
+        LOG_F(INFO, "Alpaca server {} is gone", item.first);
+        return true;
+    });
+}
+
+std::vector<AlpacaServer> AlpacaDiscovery::servers() const {
+    std::shared_lock lock(m_mutex);
+    std::vector<AlpacaServer> result;
+    result.reserve(m_servers.size());
+    for (const auto &[address, server] : m_servers) {
+        result.push_back(server);
+    }
+    return result;
+}
+
+json AlpacaDiscovery::devices(const std::string &type) const {
+    json result = json::array();
+    std::shared_lock lock(m_mutex);
+    for (const auto &[address, server] : m_servers) {
+        if (!server.devices.is_array()) {
+            continue;
+        }
+        for (const auto &device : server.devices) {
+            if (!device.is_object()) {
+                continue;
+            }
+            if (!type.empty() &&
+                !iequals(device.value("DeviceType", ""), type)) {
+                continue;
+            }
+            json entry = device;
+            entry["address"] = address;
+            result.push_back(std::move(entry));
+        }
+    }
+    return result;
+}
+}  // namespace lithium
@@ -0,0 +1,131 @@
+/*
+ * discovery.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-3
+
+Description: Background Alpaca device discovery with a result cache
+
+**************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "atom/type/json.hpp"
+#include "atom/web/httppool.hpp"
+
+using json = nlohmann::json;
+
+namespace lithium {
+/**
+ * @brief 一个响应了发现请求的 Alpaca 服务器。
+ */
+struct AlpacaServer {
+    std::string host;
+    int port = 0;
+    /** management/v1/configureddevices 的 Value，尚未获取时为 null */
+    json devices;
+    std::chrono::steady_clock::time_point last_seen;
+    std::chrono::steady_clock::time_point listed;
+
+    std::string address() const;
+};
+
+/**
+ * @class AlpacaDiscovery
+ * @brief 在后台持续运行的 Alpaca 设备发现服务。
+ *
+ * 事件循环周期性地向所有 IPv4 广播地址和 IPv6 组播地址同时发送发现
+ * 报文，响应到达时再处理，不会按网卡逐个阻塞等待。响应者和它们的
+ * configureddevices 列表缓存 ttl 时长，扫描请求直接从缓存返回。IPv6
+ * 链路本地地址的响应者以 "fe80::1%eth0" 的形式记录，带上收到响应的网卡。
+ */
+class AlpacaDiscovery {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        /** 发现报文的目标端口 */
+        int port = 32227;
+        /** 两次探测之间的间隔 */
+        std::chrono::milliseconds interval{10000};
+        /** 服务器多久没有响应后从缓存中移除，设备列表同样按此刷新 */
+        std::chrono::milliseconds ttl{30000};
+        /** 获取设备列表的超时 */
+        std::chrono::milliseconds listing_timeout{2000};
+        bool ipv4 = true;
+        bool ipv6 = true;
+        /** 额外的单播目标，例如不在同一网段的服务器 */
+        std::vector<std::string> extra_hosts;
+    };
+
+    AlpacaDiscovery();
+    explicit AlpacaDiscovery(Options options);
+    ~AlpacaDiscovery();
+
+    AlpacaDiscovery(const AlpacaDiscovery &) = delete;
+    AlpacaDiscovery &operator=(const AlpacaDiscovery &) = delete;
+
+    bool start();
+    void stop();
+    bool isRunning() const { return m_running.load(); }
+
+    /**
+     * @brief 让事件循环立即发送一轮探测，不等待结果。
+     */
+    void probe();
+
+    /**
+     * @brief 缓存中的所有服务器。
+     */
+    std::vector<AlpacaServer> servers() const;
+
+    /**
+     * @brief 缓存中某一类型的设备，type 为空时返回全部。
+     * @return [{"address", "DeviceName", "DeviceType", "DeviceNumber",
+     *          "UniqueID"}]
+     */
+    json devices(const std::string &type = "") const;
+
+    /**
+     * @brief 处理一个发现响应，事件循环收到报文时调用。
+     */
+    void handleResponse(const std::string &host, const std::string &payload);
+
+private:
+    void loop();
+    void sendProbes();
+    void receive(int fd);
+    void expire();
+    void collectListings();
+
+    Options m_options;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    int m_socket4 = -1;
+    int m_socket6 = -1;
+    /** 保护唤醒管道，probe() 可能与 stop() 同时调用 */
+    std::mutex m_wake_mutex;
+    int m_wake[2] = {-1, -1};
+
+    mutable std::shared_mutex m_mutex;
+    std::map<std::string, AlpacaServer> m_servers;
+    /** 正在获取设备列表的服务器 */
+    std::map<std::string, std::shared_future<atom::web::PooledResponse>>
+        m_listing;
+    std::atomic<bool> m_probe_now{false};
+};
+}  // namespace lithium
@@ -27,9 +27,12 @@ Description: Device Manager
 #include "atom/driver/camera_utils.hpp"
 #include "atom/driver/exception.hpp"
 #include "atom/utils/random.hpp"
+#include "utils/constant.hpp"
 #include "utils/utils.hpp"
 
 #include <fmt/format.h>
+#include <cstdint>
+#include <limits>
 #include <typeinfo>
 
 #include "config.h"
@@ -39,6 +42,39 @@ Description: Device Manager
 
 namespace lithium {
 
+namespace {
+// 驱动一轮属性推送通常在几毫秒内到达
+constexpr std::chrono::milliseconds PROPERTY_NOTIFY_WINDOW{20};
+
+std::optional<json> anyToJson(const std::any &value) {
+    if (value.type() == typeid(bool)) {
+        return std::any_cast<bool>(value);
+    }
+    if (value.type() == typeid(int)) {
+        return std::any_cast<int>(value);
+    }
+    if (value.type() == typeid(long)) {
+        return std::any_cast<long>(value);
+    }
+    if (value.type() == typeid(double)) {
+        return std::any_cast<double>(value);
+    }
+    if (value.type() == typeid(float)) {
+        return std::any_cast<float>(value);
+    }
+    if (value.type() == typeid(std::string)) {
+        return std::any_cast<std::string>(value);
+    }
+    if (value.type() == typeid(const char *)) {
+        return std::string(std::any_cast<const char *>(value));
+    }
+    if (value.type() == typeid(json)) {
+        return std::any_cast<json>(value);
+    }
+    return std::nullopt;
+}
+}  // namespace
+
 // Constructor
 DeviceManager::DeviceManager(
     std::shared_ptr<atom::server::MessageBus> messageBus,
@@ -51,9 +87,86 @@ DeviceManager::DeviceManager(
     }
 
     m_hydrogenmanager = std::make_shared<HydrogenManager>();
+
+    // 属性缓存：驱动推送更新，写入合并后再提交给设备。驱动一次读取
+    // 送来的一串属性在通知窗口内合并，只向 MessageBus 发布一次。
+    DevicePropertyCache::Options cacheOptions;
+    cacheOptions.notify_window = PROPERTY_NOTIFY_WINDOW;
+    m_property_cache = std::make_shared<DevicePropertyCache>(cacheOptions);
+    m_property_cache->setWriter([this](const std::string &name,
+                                       const std::string &value_name,
+                                       const json &value) {
+        auto device = findDeviceByName(name);
+        if (!device) {
+            LOG_F(ERROR, "{} not found", name);
+            return false;
+        }
+        if (value.is_boolean()) {
+            device->setVariable(value_name, value.get<bool>());
+        } else if (value.is_number_unsigned()) {
+            // 能放进 int 的整数保持 int，超出范围时保留完整的 64 位值
+            auto number = value.get<uint64_t>();
+            if (number <= static_cast<uint64_t>(
+                              std::numeric_limits<int>::max())) {
+                device->setVariable(value_name, static_cast<int>(number));
+            } else {
+                device->setVariable(value_name, number);
+            }
+        } else if (value.is_number_integer()) {
+            auto number = value.get<int64_t>();
+            if (number >= std::numeric_limits<int>::min() &&
+                number <= std::numeric_limits<int>::max()) {
+                device->setVariable(value_name, static_cast<int>(number));
+            } else {
+                device->setVariable(value_name, number);
+            }
+        } else if (value.is_number_float()) {
+            device->setVariable(value_name, value.get<double>());
+        } else if (value.is_string()) {
+            device->setVariable(value_name, value.get<std::string>());
+        } else {
+            LOG_F(ERROR, "Unsupported value for {} of {}: {}", value_name,
+                  name, value.dump());
+            return false;
+        }
+        return true;
+    });
+    m_property_cache->setBatchNotifier(
+        [this](const std::vector<PropertyChange> &changes) {
+            if (!m_MessageBus) {
+                return;
+            }
+            json message = json::array();
+            for (const auto &change : changes) {
+                message.push_back({{"device", change.device},
+                                   {"property", change.property},
+                                   {"value", change.value}});
+            }
+            m_MessageBus->Publish<json>("device.property", message);
+        });
+    AddPtr(constants::LITHIUM_DEVICE_CACHE, m_property_cache);
+
+    // 发现服务在后台运行，扫描请求直接读取缓存
+    m_discovery = std::make_shared<AlpacaDiscovery>();
+    m_discovery->start();
+    AddPtr(constants::LITHIUM_DEVICE_DISCOVERY, m_discovery);
 }
 
 DeviceManager::~DeviceManager() {
+    // 缓存通过全局指针共享，可能比管理器活得更久：先提交等待中的写入并
+    // 停止后台线程，再断开捕获了 this 的回调
+    if (m_property_cache) {
+        m_property_cache->stop();
+        m_property_cache->setWriter({});
+        m_property_cache->setNotifier({});
+        m_property_cache->setBatchNotifier({});
+        RemovePtr(constants::LITHIUM_DEVICE_CACHE);
+    }
+    // 发现服务同样共享出去，停止事件循环后其他持有者只能读到旧的缓存
+    if (m_discovery) {
+        m_discovery->stop();
+        RemovePtr(constants::LITHIUM_DEVICE_DISCOVERY);
+    }
     for (auto &devices : m_devices) {
         for (auto &device : devices) {
             if (device) {
@@ -215,6 +328,12 @@ bool DeviceManager::addDevice(DeviceType type, const std::string &name,
             if (!logMsg.empty()) {
                 DLOG_F(INFO, "{}", logMsg);
             }
+            auto &devices = m_devices[static_cast<int>(type)];
+            if (!devices.empty() && devices.back() &&
+                devices.back()->getName() == newName) {
+                std::unique_lock indexLock(m_index_mutex);
+                m_device_index[newName] = {type, devices.back()};
+            }
             DLOG_F(INFO, "Added new {} instance successfully",
                    magic_enum::enum_name(type));
         }
@@ -310,6 +429,11 @@ bool DeviceManager::removeDevice(DeviceType type, const std::string &name) {
         if (*it && (*it)->getName() == name) {
             (*it)->runFunc("disconnect", {});
             devices.erase(it);
+            {
+                std::unique_lock indexLock(m_index_mutex);
+                m_device_index.erase(name);
+            }
+            m_property_cache->removeDevice(name);
             DLOG_F(INFO, "Remove device {} successfully", name);
             if (m_ConfigManager) {
 #ifdef __cpp_lib_format
@@ -339,6 +463,11 @@ bool DeviceManager::removeDeviceByName(const std::string &name) {
                            }),
             devices.end());
     }
+    {
+        std::unique_lock indexLock(m_index_mutex);
+        m_device_index.erase(name);
+    }
+    m_property_cache->removeDevice(name);
     if (m_ConfigManager) {
 #ifdef __cpp_lib_format
         m_ConfigManager->deleteValue(std::format("driver/{}", name));
@@ -366,16 +495,14 @@ bool DeviceManager::removeDeviceLibrary(const std::string &lib_name) {
 
 std::shared_ptr<AtomDriver> DeviceManager::getDevice(DeviceType type,
                                                      const std::string &name) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    size_t index = findDevice(type, name);
-    if (static_cast<int>(index) != -1) {
-        return m_devices[static_cast<int>(type)][index];
-    } else {
-        DLOG_F(WARNING, "Could not find device {} of type %d", name,
-               static_cast<int>(type));
-        return nullptr;
+    std::shared_lock lock(m_index_mutex);
+    if (auto it = m_device_index.find(name);
+        it != m_device_index.end() && it->second.first == type) {
+        return it->second.second;
     }
+    DLOG_F(WARNING, "Could not find device {} of type {}", name,
+           static_cast<int>(type));
+    return nullptr;
 }
 
 size_t DeviceManager::findDevice(DeviceType type, const std::string &name) {
@@ -390,12 +517,9 @@ size_t DeviceManager::findDevice(DeviceType type, const std::string &name) {
 
 std::shared_ptr<AtomDriver> DeviceManager::findDeviceByName(
     const std::string &name) const {
-    for (const auto &devices : m_devices) {
-        for (const auto &device : devices) {
-            if (device && device->getName() == name) {
-                return device;
-            }
-        }
+    std::shared_lock lock(m_index_mutex);
+    if (auto it = m_device_index.find(name); it != m_device_index.end()) {
+        return it->second.second;
     }
     return nullptr;
 }
@@ -403,54 +527,55 @@ std::shared_ptr<AtomDriver> DeviceManager::findDeviceByName(
 bool DeviceManager::setDeviceProperty(DeviceType type, const std::string &name,
                                       const std::string &value_name,
                                       const std::any &value) {
-    m_TaskPool->enqueue([this, &value, &type, &name, &value_name]() {
-        auto device = getDevice(type, name);
-        if (!device) {
-            LOG_F(ERROR, "{} not found", name);
-            return;
-        }
-        try {
-            // if (value.type() == typeid(std::string) || value.type() ==
-            // typeid(const char *))
-            //     device->SetVariable<std::string>(value_name,std::any_cast<std::string>(value));
-            // if (value.type() == typeid(int) || value.type() ==
-            // typeid(double))
-            //     device->SetVariable<double>(value_name,
-            //     std::any_cast<double>(value));
-        } catch (const std::bad_any_cast &e) {
-            LOG_F(ERROR, "Failed to convert {} of {} with {}", value_name, name,
-                  e.what());
-        }
-    });
-    return true;
+    if (!getDevice(type, name)) {
+        LOG_F(ERROR, "{} not found", name);
+        return false;
+    }
+    return setDevicePropertyByName(name, value_name, value);
 }
 
 bool DeviceManager::setDevicePropertyByName(const std::string &name,
                                             const std::string &value_name,
                                             const std::any &value) {
-    m_TaskPool->enqueue([this, &value, &name, &value_name]() {
-        auto device = findDeviceByName(name);
-        if (!device) {
-            LOG_F(ERROR, "{} not found", name);
-            return;
-        }
-        try {
-            // if (value.type() == typeid(std::string) || value.type() ==
-            // typeid(const char *))
-            //     device->SetVariable<std::string>(value_name,std::any_cast<std::string>(value));
-            // if (value.type() == typeid(int) || value.type() ==
-            // typeid(double))
-            //     device->SetVariable<double>(value_name,
-            //     std::any_cast<double>(value));
-
-        } catch (const std::bad_any_cast &e) {
-            LOG_F(ERROR, "Failed to convert {} of {} with {}", value_name, name,
-                  e.what());
-        }
-    });
+    if (!findDeviceByName(name)) {
+        LOG_F(ERROR, "{} not found", name);
+        return false;
+    }
+    auto converted = anyToJson(value);
+    if (!converted) {
+        LOG_F(ERROR, "Failed to convert {} of {} with type {}", value_name,
+              name, value.type().name());
+        return false;
+    }
+    // 合并写入窗口内对同一属性的多次设置
+    m_property_cache->write(name, value_name, *converted);
     return true;
 }
 
+json DeviceManager::getDeviceProperty(
+    const std::string &name, const std::string &value_name,
+    const DevicePropertyCache::Fetcher &fetch) {
+    if (!fetch) {
+        return m_property_cache->get(name, value_name).value_or(json());
+    }
+    try {
+        return m_property_cache->getOrFetch(name, value_name, fetch);
+    } catch (const std::exception &e) {
+        LOG_F(ERROR, "Failed to get {} of {}: {}", value_name, name, e.what());
+        return json();
+    }
+}
+
+void DeviceManager::updateDeviceProperty(const std::string &name,
+                                         const std::string &value_name,
+                                         const json &value) {
+    m_property_cache->update(name, value_name, value);
+}
+
+std::shared_ptr<DevicePropertyCache> DeviceManager::getPropertyCache() const {
+    return m_property_cache;
+}
+
 bool DeviceManager::setMainCamera(const std::string &name) {
     if (name.empty())
         return false;
@@ -16,8 +16,10 @@ Description: Device Manager
 
 #include <functional>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "atom/driver/device.hpp"
@@ -31,6 +33,9 @@ Description: Device Manager
 
 #include "server/hydrogen.hpp"
 
+#include "discovery.hpp"
+#include "property_cache.hpp"
+
 #include "error/error_code.hpp"
 
 class AtomCamera;
@@ -195,6 +200,29 @@ public:
                                  const std::string &value_name,
                                  const std::any &value);
 
+    /**
+     * @brief 读取设备属性，优先使用缓存。
+     * @param name 设备名称。
+     * @param value_name 属性名称。
+     * @param fetch 缓存过期时向设备读取的函数，为空时只查缓存。
+     * @return 属性值，不可用时返回 null。
+     */
+    json getDeviceProperty(const std::string &name,
+                           const std::string &value_name,
+                           const DevicePropertyCache::Fetcher &fetch = {});
+
+    /**
+     * @brief 驱动推送的属性更新。
+     */
+    void updateDeviceProperty(const std::string &name,
+                              const std::string &value_name,
+                              const json &value);
+
+    /**
+     * @brief 获取设备属性缓存。
+     */
+    std::shared_ptr<DevicePropertyCache> getPropertyCache() const;
+
     // Device Dispatch
 public:
     bool setMainCamera(const std::string &name);
@@ -220,6 +248,16 @@ private:
         DeviceType::
             NumDeviceTypes)];  ///< 存储设备对象的数组，每个设备类型对应一个向量。
 
+    std::unordered_map<std::string, std::pair<DeviceType,
+                                              std::shared_ptr<AtomDriver>>>
+        m_device_index;  ///< 设备名称到设备对象的索引。
+    mutable std::shared_mutex m_index_mutex;  ///< 保护设备索引。
+
+    std::shared_ptr<DevicePropertyCache>
+        m_property_cache;  ///< 设备属性缓存。
+
+    std::shared_ptr<AlpacaDiscovery> m_discovery;  ///< Alpaca 设备发现服务。
+
     std::mutex m_mutex;  ///< 互斥锁，用于保护设备管理器的并发访问。
 
     std::shared_ptr<ModuleLoader>
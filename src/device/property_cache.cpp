@@ -0,0 +1,338 @@
+/*
+ * property_cache.cpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-1
+
+Description: Device property cache with coalesced writes
+
+**************************************************/
+
+#include "property_cache.hpp"
+
+#include <vector>
+
+#include "atom/log/loguru.hpp"
+
+namespace lithium {
+DevicePropertyCache::DevicePropertyCache()
+    : DevicePropertyCache(Options{}) {}
+
+DevicePropertyCache::DevicePropertyCache(Options options)
+    : m_options(options) {
+    m_flush_thread = std::thread([this] { flushLoop(); });
+}
+
+DevicePropertyCache::~DevicePropertyCache() { stop(); }
+
+void DevicePropertyCache::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_stopping = true;
+    }
+    m_write_cv.notify_all();
+    if (m_flush_thread.joinable() &&
+        m_flush_thread.get_id() != std::this_thread::get_id()) {
+        m_flush_thread.join();
+    }
+    // 后台线程退出后再提交，剩下的写入只在这里处理一次
+    flush();
+}
+
+void DevicePropertyCache::setWriter(Writer writer) {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    m_writer = std::move(writer);
+}
+
+void DevicePropertyCache::setNotifier(Notifier notifier) {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    m_notifier = std::move(notifier);
+}
+
+void DevicePropertyCache::setBatchNotifier(BatchNotifier notifier) {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    m_batch_notifier = std::move(notifier);
+}
+
+void DevicePropertyCache::update(const std::string &device,
+                                 const std::string &property,
+                                 const json &value) {
+    auto now = Clock::now();
+    bool changed;
+    {
+        std::unique_lock lock(m_mutex);
+        auto &entry = m_entries[device][property];
+        changed = entry.updated == Clock::time_point{} || entry.value != value;
+        entry.value = value;
+        entry.updated = now;
+    }
+    if (!changed) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_write_mutex);
+        if (m_options.notify_window.count() == 0 || m_stopping) {
+            lock.unlock();
+            notify({{device, property, value, now}});
+            return;
+        }
+        if (m_changes.empty()) {
+            m_changes_deadline = now + m_options.notify_window;
+        }
+        m_changes.insert_or_assign(Key{device, property},
+                                   PropertyChange{device, property, value,
+                                                  now});
+    }
+    m_write_cv.notify_all();
+}
+
+void DevicePropertyCache::notify(std::vector<PropertyChange> changes) {
+    if (changes.empty()) {
+        return;
+    }
+    Notifier notifier;
+    BatchNotifier batchNotifier;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        notifier = m_notifier;
+        batchNotifier = m_batch_notifier;
+    }
+    if (notifier) {
+        for (const auto &change : changes) {
+            notifier(change);
+        }
+    }
+    if (batchNotifier) {
+        batchNotifier(changes);
+    }
+}
+
+std::vector<PropertyChange> DevicePropertyCache::takeChanges() {
+    std::vector<PropertyChange> changes;
+    changes.reserve(m_changes.size());
+    for (auto &[key, change] : m_changes) {
+        changes.push_back(std::move(change));
+    }
+    m_changes.clear();
+    return changes;
+}
+
+std::optional<json> DevicePropertyCache::get(
+    const std::string &device, const std::string &property) const {
+    return get(device, property, m_options.max_age);
+}
+
+std::optional<json> DevicePropertyCache::get(
+    const std::string &device, const std::string &property,
+    std::chrono::milliseconds max_age) const {
+    std::shared_lock lock(m_mutex);
+    auto deviceIt = m_entries.find(device);
+    if (deviceIt == m_entries.end()) {
+        return std::nullopt;
+    }
+    auto it = deviceIt->second.find(property);
+    if (it == deviceIt->second.end() ||
+        Clock::now() - it->second.updated > max_age) {
+        return std::nullopt;
+    }
+    return it->second.value;
+}
+
+json DevicePropertyCache::getOrFetch(const std::string &device,
+                                     const std::string &property,
+                                     const Fetcher &fetch) {
+    if (auto value = get(device, property)) {
+        return *value;
+    }
+    Key key{device, property};
+    std::promise<json> promise;
+    std::shared_future<json> inflight;
+    {
+        std::lock_guard<std::mutex> lock(m_fetch_mutex);
+        if (auto it = m_fetching.find(key); it != m_fetching.end()) {
+            inflight = it->second;
+        } else if (auto value = get(device, property)) {
+            // 另一个读取者可能刚刚完成 fetch
+            return *value;
+        } else {
+            m_fetching.emplace(key, promise.get_future().share());
+        }
+    }
+    if (inflight.valid()) {
+        return inflight.get();
+    }
+    try {
+        auto value = fetch();
+        update(device, property, value);
+        promise.set_value(value);
+        std::lock_guard<std::mutex> lock(m_fetch_mutex);
+        m_fetching.erase(key);
+        return value;
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(m_fetch_mutex);
+        m_fetching.erase(key);
+        throw;
+    }
+}
+
+std::optional<DevicePropertyCache::Entry> DevicePropertyCache::entry(
+    const std::string &device, const std::string &property) const {
+    std::shared_lock lock(m_mutex);
+    auto deviceIt = m_entries.find(device);
+    if (deviceIt == m_entries.end()) {
+        return std::nullopt;
+    }
+    auto it = deviceIt->second.find(property);
+    if (it == deviceIt->second.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+json DevicePropertyCache::snapshot(const std::string &device) const {
+    json result = json::object();
+    std::shared_lock lock(m_mutex);
+    if (auto it = m_entries.find(device); it != m_entries.end()) {
+        for (const auto &[property, entry] : it->second) {
+            result[property] = entry.value;
+        }
+    }
+    return result;
+}
+
+void DevicePropertyCache::write(const std::string &device,
+                                const std::string &property,
+                                const json &value) {
+    {
+        std::unique_lock<std::mutex> lock(m_write_mutex);
+        if (m_stopping) {
+            // 后台线程已经停止，不再合并
+            lock.unlock();
+            commit(Key{device, property}, value);
+            return;
+        }
+        auto [it, inserted] = m_pending.try_emplace(
+            Key{device, property},
+            PendingWrite{value, Clock::now() + m_options.write_window});
+        if (!inserted) {
+            // 保留原来的截止时间，连续拖动滑块时仍按窗口提交
+            it->second.value = value;
+            return;
+        }
+    }
+    m_write_cv.notify_all();
+}
+
+void DevicePropertyCache::flush() {
+    std::vector<std::pair<Key, json>> due;
+    std::vector<PropertyChange> changes;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        for (auto &[key, pending] : m_pending) {
+            due.emplace_back(key, std::move(pending.value));
+        }
+        m_pending.clear();
+        changes = takeChanges();
+    }
+    for (const auto &[key, value] : due) {
+        commit(key, value);
+    }
+    notify(std::move(changes));
+}
+
+void DevicePropertyCache::invalidate(const std::string &device) {
+    std::unique_lock lock(m_mutex);
+    if (auto it = m_entries.find(device); it != m_entries.end()) {
+        for (auto &[property, entry] : it->second) {
+            entry.updated = Clock::time_point{};
+        }
+    }
+}
+
+void DevicePropertyCache::removeDevice(const std::string &device) {
+    {
+        std::unique_lock lock(m_mutex);
+        m_entries.erase(device);
+    }
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    std::erase_if(m_pending,
+                  [&](const auto &item) { return item.first.first == device; });
+    std::erase_if(m_changes,
+                  [&](const auto &item) { return item.first.first == device; });
+}
+
+size_t DevicePropertyCache::pendingWrites() const {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    return m_pending.size();
+}
+
+void DevicePropertyCache::flushLoop() {
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    while (!m_stopping) {
+        if (m_pending.empty() && m_changes.empty()) {
+            m_write_cv.wait(lock);
+            continue;
+        }
+        auto next = Clock::time_point::max();
+        for (const auto &[key, pending] : m_pending) {
+            next = std::min(next, pending.deadline);
+        }
+        if (!m_changes.empty()) {
+            next = std::min(next, m_changes_deadline);
+        }
+        if (Clock::now() < next) {
+            m_write_cv.wait_until(lock, next);
+            continue;
+        }
+        std::vector<std::pair<Key, json>> due;
+        std::vector<PropertyChange> changes;
+        auto now = Clock::now();
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            if (it->second.deadline <= now) {
+                due.emplace_back(it->first, std::move(it->second.value));
+                it = m_pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!m_changes.empty() && m_changes_deadline <= now) {
+            changes = takeChanges();
+        }
+        lock.unlock();
+        for (const auto &[key, value] : due) {
+            commit(key, value);
+        }
+        notify(std::move(changes));
+        lock.lock();
+    }
+}
+
+void DevicePropertyCache::commit(const Key &key, const json &value) {
+    Writer writer;
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        writer = m_writer;
+    }
+    if (!writer) {
+        LOG_F(ERROR, "No property writer, dropping {}.{}", key.first,
+              key.second);
+        return;
+    }
+    try {
+        if (!writer(key.first, key.second, value)) {
+            LOG_F(ERROR, "Failed to set {} of {}", key.second, key.first);
+            return;
+        }
+    } catch (const std::exception &e) {
+        LOG_F(ERROR, "Failed to set {} of {}: {}", key.second, key.first,
+              e.what());
+        return;
+    }
+    update(key.first, key.second, value);
+}
+}  // namespace lithium
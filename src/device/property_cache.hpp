@@ -0,0 +1,184 @@
+/*
+ * property_cache.hpp
+ *
+ * Copyright (C) 2023-2024 Max Qian <lightapt.com>
+ */
+
+/*************************************************
+
+Date: 2024-7-1
+
+Description: Device property cache with coalesced writes
+
+**************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "atom/type/json.hpp"
+
+using json = nlohmann::json;
+
+namespace lithium {
+/**
+ * @brief 属性变化通知，由缓存在值变化或写入完成后发出。
+ */
+struct PropertyChange {
+    std::string device;
+    std::string property;
+    json value;
+    std::chrono::steady_clock::time_point updated;
+};
+
+/**
+ * @class DevicePropertyCache
+ * @brief 设备属性缓存。
+ *
+ * 驱动通过 update() 推送属性（例如 Hydrogen 的 newNumber/newSwitch），
+ * 读取方在值足够新时直接命中缓存，不会再访问慢速设备。同一属性的并发
+ * 读取只会触发一次 fetch。写入在一个时间窗口内合并，窗口内最后一次写入
+ * 生效，然后由 Writer 提交到设备。值发生变化时通过 Notifier 发出通知，
+ * DeviceManager 将其转发到 MessageBus。设置 notify_window 后，窗口内的
+ * 变化合并为一批交给 BatchNotifier，驱动一次推送的一串属性只产生一次通知。
+ */
+class DevicePropertyCache {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Fetcher = std::function<json()>;
+    using Writer = std::function<bool(const std::string &device,
+                                      const std::string &property,
+                                      const json &value)>;
+    using Notifier = std::function<void(const PropertyChange &)>;
+    using BatchNotifier =
+        std::function<void(const std::vector<PropertyChange> &)>;
+
+    struct Options {
+        /** 读取时可以接受的最大数据年龄 */
+        std::chrono::milliseconds max_age{1000};
+        /** 写入合并窗口 */
+        std::chrono::milliseconds write_window{50};
+        /** 通知合并窗口，为 0 时每次变化立即通知 */
+        std::chrono::milliseconds notify_window{0};
+    };
+
+    struct Entry {
+        json value;
+        Clock::time_point updated;
+    };
+
+    DevicePropertyCache();
+    explicit DevicePropertyCache(Options options);
+    ~DevicePropertyCache();
+
+    DevicePropertyCache(const DevicePropertyCache &) = delete;
+    DevicePropertyCache &operator=(const DevicePropertyCache &) = delete;
+
+    void setWriter(Writer writer);
+    void setNotifier(Notifier notifier);
+    void setBatchNotifier(BatchNotifier notifier);
+
+    /**
+     * @brief 驱动推送的新值，值变化时发出通知。
+     */
+    void update(const std::string &device, const std::string &property,
+                const json &value);
+
+    /**
+     * @brief 读取缓存中不超过 max_age 的值。
+     */
+    std::optional<json> get(const std::string &device,
+                            const std::string &property) const;
+    std::optional<json> get(const std::string &device,
+                            const std::string &property,
+                            std::chrono::milliseconds max_age) const;
+
+    /**
+     * @brief 读取属性，缓存过期时调用 fetch 并缓存结果。
+     * 同一属性同时只有一个 fetch 在执行，其他读取者等待它的结果。
+     */
+    json getOrFetch(const std::string &device, const std::string &property,
+                    const Fetcher &fetch);
+
+    /**
+     * @brief 带时间戳的原始缓存项，不检查是否过期。
+     */
+    std::optional<Entry> entry(const std::string &device,
+                               const std::string &property) const;
+
+    /**
+     * @brief 设备所有已缓存属性，{"property": value}。
+     */
+    json snapshot(const std::string &device) const;
+
+    /**
+     * @brief 提交写入，写入窗口内对同一属性的写入只保留最后一次。
+     */
+    void write(const std::string &device, const std::string &property,
+               const json &value);
+
+    /**
+     * @brief 立即提交所有等待中的写入，并发出等待中的通知。
+     */
+    void flush();
+
+    /**
+     * @brief 提交所有等待中的写入并停止后台线程，析构时自动调用。
+     * 之后的写入和通知不再合并，立即执行。
+     */
+    void stop();
+
+    /** 使设备的所有缓存值过期，下次读取会重新获取。 */
+    void invalidate(const std::string &device);
+
+    /** 移除设备的缓存值和等待中的写入。 */
+    void removeDevice(const std::string &device);
+
+    size_t pendingWrites() const;
+
+private:
+    using Key = std::pair<std::string, std::string>;
+
+    struct PendingWrite {
+        json value;
+        Clock::time_point deadline;
+    };
+
+    void flushLoop();
+    void commit(const Key &key, const json &value);
+    void notify(std::vector<PropertyChange> changes);
+    std::vector<PropertyChange> takeChanges();
+
+    Options m_options;
+
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<std::string, std::unordered_map<std::string, Entry>>
+        m_entries;
+
+    std::mutex m_fetch_mutex;
+    std::map<Key, std::shared_future<json>> m_fetching;
+
+    mutable std::mutex m_write_mutex;
+    std::condition_variable m_write_cv;
+    std::map<Key, PendingWrite> m_pending;
+    /** 等待合并通知的变化，同一属性只保留最新值 */
+    std::map<Key, PropertyChange> m_changes;
+    Clock::time_point m_changes_deadline;
+    bool m_stopping = false;
+    Writer m_writer;
+    Notifier m_notifier;
+    BatchNotifier m_batch_notifier;
+    std::thread m_flush_thread;
+};
+}  // namespace lithium
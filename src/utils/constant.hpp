@@ -90,6 +90,11 @@ public:
     static constexpr const char* LITHIUM_TASK_GENERATOR = "lithium.task.generator";
 
     static constexpr const char* LITHIUM_COMMAND = "lithium.command";
+
+    // Device
+    static constexpr const char* LITHIUM_DEVICE_CACHE = "lithium.device.cache";
+    static constexpr const char* LITHIUM_DEVICE_DISCOVERY =
+        "lithium.device.discovery";
 };
 
 #endif  // LITHIUM_UTILS_CONSTANTS_HPP
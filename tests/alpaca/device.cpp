@@ -0,0 +1,138 @@
+#include "device.hpp"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+#include "cpp_httplib/httplib.h"
+#include "exception.hpp"
+#include "reply.hpp"
+
+using alpaca::parseValue;
+using alpaca::ReplyFields;
+using alpaca::scanReply;
+
+TEST(AlpacaReplyTest, PicksTopLevelFields) {
+    ReplyFields fields;
+    ASSERT_TRUE(scanReply(
+        R"({"ClientTransactionID":3,"ServerTransactionID":7,)"
+        R"("ErrorNumber":0,"ErrorMessage":"","Value":12.5})",
+        fields));
+    EXPECT_EQ(fields.value, "12.5");
+    EXPECT_EQ(fields.error_number, "0");
+    EXPECT_EQ(fields.error_message, R"("")");
+
+    ReplyFields empty;
+    ASSERT_TRUE(scanReply(" { } ", empty));
+    EXPECT_TRUE(empty.value.empty());
+}
+
+TEST(AlpacaReplyTest, SkipsNestedValuesAndStrings) {
+    ReplyFields fields;
+    ASSERT_TRUE(scanReply(
+        R"({"Other":{"Value":1,"List":[{"Value":"}]"}]},)"
+        "\n\t"
+        R"("Value" : {"Value":[1,"a\"}",{"b":null}]}, "ErrorNumber":0})",
+        fields));
+    EXPECT_EQ(fields.value, R"({"Value":[1,"a\"}",{"b":null}]})");
+    auto value = parseValue(fields.value);
+    ASSERT_TRUE(value.is_object());
+    EXPECT_EQ(value["Value"][1], "a\"}");
+    EXPECT_TRUE(value["Value"][2]["b"].is_null());
+}
+
+TEST(AlpacaReplyTest, ReportsErrors) {
+    ReplyFields fields;
+    ASSERT_TRUE(scanReply(
+        R"({"Value":null,"ErrorNumber":1025,)"
+        R"("ErrorMessage":"Gain \"high\" is invalid"})",
+        fields));
+    EXPECT_EQ(fields.error_number, "1025");
+    EXPECT_EQ(parseValue(fields.error_message), "Gain \"high\" is invalid");
+    EXPECT_TRUE(parseValue(fields.value).is_null());
+}
+
+TEST(AlpacaReplyTest, RejectsTruncatedBodies) {
+    const std::string body =
+        R"({"ErrorNumber":0,"Value":[1,{"a":"b\"c"}],"ErrorMessage":""})";
+    for (size_t length = 0; length < body.size(); ++length) {
+        ReplyFields fields;
+        EXPECT_FALSE(scanReply(body.substr(0, length), fields))
+            << body.substr(0, length);
+    }
+    ReplyFields fields;
+    EXPECT_FALSE(scanReply("[1,2]", fields));
+    EXPECT_FALSE(scanReply(R"({"Value" 1})", fields));
+    EXPECT_FALSE(scanReply(R"({"Value":})", fields));
+    EXPECT_FALSE(scanReply(R"({"Value":1 "ErrorNumber":0})", fields));
+}
+
+TEST(AlpacaReplyTest, ParsesScalars) {
+    EXPECT_TRUE(parseValue("").is_null());
+    EXPECT_EQ(parseValue("true"), true);
+    EXPECT_EQ(parseValue("false"), false);
+    EXPECT_EQ(parseValue("-42"), -42);
+    EXPECT_TRUE(parseValue("-42").is_number_integer());
+    EXPECT_DOUBLE_EQ(parseValue("1.5e3").get<double>(), 1500.0);
+    EXPECT_DOUBLE_EQ(parseValue("-0.25").get<double>(), -0.25);
+    // out of int64 range, left to the JSON parser
+    EXPECT_EQ(parseValue("18446744073709551615").get<uint64_t>(),
+              18446744073709551615ULL);
+    EXPECT_EQ(parseValue(R"("plain")"), "plain");
+    EXPECT_EQ(parseValue(R"("tab\tquote\"")"), "tab\tquote\"");
+    EXPECT_EQ(parseValue(R"("é😀")"),
+              "\xC3\xA9\xF0\x9F\x98\x80");
+    EXPECT_EQ(parseValue("[1,2]"), json::array({1, 2}));
+    EXPECT_THROW(parseValue("[1,"), json::parse_error);
+    EXPECT_THROW(parseValue("12abc"), json::parse_error);
+}
+
+namespace {
+class AlpacaDeviceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const std::string base = "/api/v1/camera/0/";
+        reply(base + "name", R"({"Value":"Simulator","ErrorNumber":0,)"
+                             R"("ErrorMessage":"","ServerTransactionID":1})");
+        reply(base + "connected", R"({"ErrorNumber":0,"Value":true})");
+        reply(base + "gain",
+              R"({"Value":0,"ErrorNumber":1024,)"
+              R"("ErrorMessage":"Gain is not implemented"})");
+        reply(base + "sensortype", R"({"Value":{"Type":2,"Name":"RGGB"},)"
+                                   R"("ErrorNumber":0})");
+        server.Get(base + "broken",
+                   [](const httplib::Request &, httplib::Response &res) {
+                       res.status = 500;
+                       res.set_content("boom", "text/plain");
+                   });
+        port = server.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this] { server.listen_after_bind(); });
+        server.wait_until_ready();
+    }
+
+    void TearDown() override {
+        server.stop();
+        thread.join();
+    }
+
+    void reply(const std::string &path, std::string body) {
+        server.Get(path, [body](const httplib::Request &,
+                                httplib::Response &res) {
+            res.set_content(body, "application/json");
+        });
+    }
+
+    httplib::Server server;
+    std::thread thread;
+    int port = 0;
+};
+}  // namespace
+
+TEST_F(AlpacaDeviceTest, ReadsPropertiesThroughReplyParser) {
+    Device device("127.0.0.1:" + std::to_string(port), "camera", 0, "http");
+    EXPECT_EQ(device.get_Name(), "Simulator");
+    EXPECT_TRUE(device.get_Connected());
+    EXPECT_EQ(device._get("sensortype", {}, 2.0)["Name"], "RGGB");
+    EXPECT_THROW(device._get("gain", {}, 2.0), NotImplementedException);
+    EXPECT_THROW(device._get("broken", {}, 2.0), AlpacaRequestException);
+}
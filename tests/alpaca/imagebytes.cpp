@@ -0,0 +1,282 @@
+#include "imagebytes.hpp"
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+using atom::memory::FrameBufferRing;
+using atom::memory::FrameGeometry;
+
+struct Image {
+    int width;
+    int height;
+    int planes;  // 0 for rank 2
+
+    size_t count() const {
+        return static_cast<size_t>(width) * height * std::max(planes, 1);
+    }
+
+    // Sample at column x, row y, plane p
+    int64_t value(int x, int y, int p) const {
+        return (x * 7 + y * 131 + p * 1009) % 4000 + 100000;
+    }
+};
+
+template <typename T>
+void appendRaw(std::string &out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+std::string imageBytes(const Image &image, ImageArrayElementTypes image_type,
+                       ImageArrayElementTypes transmission,
+                       int32_t data_start = ImageMetadata::SIZE) {
+    std::string out;
+    int32_t header[] = {1,
+                        0,
+                        5,
+                        6,
+                        data_start,
+                        static_cast<int32_t>(image_type),
+                        static_cast<int32_t>(transmission),
+                        image.planes > 0 ? 3 : 2,
+                        image.width,
+                        image.height,
+                        image.planes};
+    for (auto field : header) {
+        appendRaw(out, field);
+    }
+    out.append(data_start - ImageMetadata::SIZE, '\xAB');
+    // Alpaca order: x outermost, then y, then plane
+    for (int x = 0; x < image.width; ++x) {
+        for (int y = 0; y < image.height; ++y) {
+            for (int p = 0; p < std::max(image.planes, 1); ++p) {
+                auto v = image.value(x, y, p);
+                switch (transmission) {
+                    case ImageArrayElementTypes::Int32:
+                        appendRaw(out, static_cast<int32_t>(v));
+                        break;
+                    case ImageArrayElementTypes::UInt16:
+                        appendRaw(out, static_cast<uint16_t>(v - 100000));
+                        break;
+                    case ImageArrayElementTypes::Double:
+                        appendRaw(out, static_cast<double>(v) + 0.25);
+                        break;
+                    default:
+                        ADD_FAILURE() << "unexpected transmission type";
+                }
+            }
+        }
+    }
+    return out;
+}
+
+std::string imageJson(const Image &image, ImageArrayElementTypes type) {
+    std::string out = R"({"Type":)" +
+                      std::to_string(static_cast<int>(type)) +
+                      R"(,"Rank":)" + (image.planes > 0 ? "3" : "2") +
+                      R"(, "Value" : [)";
+    for (int x = 0; x < image.width; ++x) {
+        out += x ? ",[" : "[";
+        for (int y = 0; y < image.height; ++y) {
+            out += y ? "," : "";
+            if (image.planes == 0) {
+                out += std::to_string(image.value(x, y, 0));
+                continue;
+            }
+            out += "[";
+            for (int p = 0; p < image.planes; ++p) {
+                out += (p ? ", " : "") + std::to_string(image.value(x, y, p));
+            }
+            out += "]";
+        }
+        out += "]";
+    }
+    out += R"(],"ClientTransactionID":5,"ErrorNumber":0,"ErrorMessage":""})";
+    return out;
+}
+
+class ImageArrayDecoderTest : public ::testing::Test {
+protected:
+    FrameBufferRing ring;
+    ImageArrayDecoder decoder{[this](const FrameGeometry &geometry) {
+        ring.configure(geometry, 2, false);
+        return ring.acquire();
+    }};
+
+    // Feeds the reply in pieces of random size up to max_chunk
+    bool decode(const std::string &reply, bool binary, size_t max_chunk,
+                unsigned seed = 1) {
+        decoder.reset(binary);
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<size_t> size(1, max_chunk);
+        for (size_t offset = 0; offset < reply.size();) {
+            size_t take = std::min(size(rng), reply.size() - offset);
+            if (!decoder.feed(std::string_view(reply).substr(offset, take))) {
+                return false;
+            }
+            offset += take;
+        }
+        return decoder.finish();
+    }
+
+    template <typename T>
+    void expectPixels(const Image &image, int64_t offset) {
+        const auto &frame = decoder.frame();
+        ASSERT_TRUE(frame);
+        const auto &geometry = frame.info().geometry;
+        int planes = std::max(image.planes, 1);
+        ASSERT_EQ(geometry.width, image.width);
+        ASSERT_EQ(geometry.height, image.height);
+        ASSERT_EQ(geometry.channels, planes);
+        ASSERT_EQ(geometry.bytesPerSample(), sizeof(T));
+        ASSERT_EQ(frame.size(), image.count() * sizeof(T));
+        auto *pixels = reinterpret_cast<const T *>(frame.data());
+        for (int y = 0; y < image.height; ++y) {
+            for (int x = 0; x < image.width; ++x) {
+                for (int p = 0; p < planes; ++p) {
+                    ASSERT_EQ(pixels[(y * image.width + x) * planes + p],
+                              image.value(x, y, p) + offset)
+                        << x << "," << y << "," << p;
+                }
+            }
+        }
+    }
+};
+
+struct BinaryCase {
+    ImageArrayElementTypes transmission;
+    int planes;
+};
+
+class ImageBytesTypesTest
+    : public ImageArrayDecoderTest,
+      public ::testing::WithParamInterface<BinaryCase> {};
+
+TEST_P(ImageBytesTypesTest, DecodesRankAndType) {
+    // Wide enough to take several column blocks
+    Image image{150, 37, GetParam().planes};
+    auto reply = imageBytes(image, ImageArrayElementTypes::Int32,
+                            GetParam().transmission);
+    for (size_t chunk : {size_t(1), size_t(7), size_t(4096), reply.size()}) {
+        SCOPED_TRACE(chunk);
+        ASSERT_TRUE(decode(reply, true, chunk, chunk))
+            << decoder.errorMessage();
+        EXPECT_EQ(decoder.errorNumber(), 0);
+        EXPECT_EQ(decoder.metadata().rank, image.planes > 0 ? 3 : 2);
+        switch (GetParam().transmission) {
+            case ImageArrayElementTypes::UInt16:
+                expectPixels<uint16_t>(image, -100000);
+                break;
+            default:
+                // Int32 values above 16 bit keep their full range
+                expectPixels<uint32_t>(image, 0);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Types, ImageBytesTypesTest,
+    ::testing::Values(BinaryCase{ImageArrayElementTypes::Int32, 0},
+                      BinaryCase{ImageArrayElementTypes::Int32, 3},
+                      BinaryCase{ImageArrayElementTypes::UInt16, 0},
+                      BinaryCase{ImageArrayElementTypes::UInt16, 3},
+                      BinaryCase{ImageArrayElementTypes::Double, 0},
+                      BinaryCase{ImageArrayElementTypes::Double, 3}));
+
+TEST_F(ImageArrayDecoderTest, NarrowImageTypeKeepsSixteenBits) {
+    Image image{9, 4, 0};
+    auto reply = imageBytes(image, ImageArrayElementTypes::UInt16,
+                            ImageArrayElementTypes::Int32);
+    ASSERT_TRUE(decode(reply, true, 5));
+    // Values beyond the declared image type are clamped
+    auto *pixels = reinterpret_cast<const uint16_t *>(decoder.frame().data());
+    EXPECT_EQ(decoder.frame().info().geometry.bits_per_sample, 16U);
+    EXPECT_EQ(pixels[0], 65535);
+}
+
+TEST_F(ImageArrayDecoderTest, SkipsBytesBeforeData) {
+    Image image{3, 2, 0};
+    auto reply = imageBytes(image, ImageArrayElementTypes::Int32,
+                            ImageArrayElementTypes::Int32, 300);
+    ASSERT_TRUE(decode(reply, true, 13)) << decoder.errorMessage();
+    expectPixels<uint32_t>(image, 0);
+}
+
+TEST_F(ImageArrayDecoderTest, RejectsHugeDataStart) {
+    Image image{3, 2, 0};
+    auto reply = imageBytes(image, ImageArrayElementTypes::Int32,
+                            ImageArrayElementTypes::Int32);
+    int32_t start = 0x7FFFFFFF;
+    reply.replace(16, 4, reinterpret_cast<const char *>(&start), 4);
+    EXPECT_FALSE(decode(reply, true, 64));
+    EXPECT_FALSE(decoder.frame());
+}
+
+TEST_F(ImageArrayDecoderTest, ReportsErrorAndCapsMessage) {
+    std::string reply;
+    int32_t header[] = {1, 0x0407, 0, 0, ImageMetadata::SIZE, 0, 0, 0, 0, 0, 0};
+    for (auto field : header) {
+        appendRaw(reply, field);
+    }
+    reply += "Not connected";
+    ASSERT_TRUE(decode(reply, true, 3));
+    EXPECT_EQ(decoder.errorNumber(), 0x0407);
+    EXPECT_EQ(decoder.errorMessage(), "Not connected");
+    EXPECT_FALSE(decoder.frame());
+
+    reply.append(1 << 20, 'x');
+    ASSERT_TRUE(decode(reply, true, 100000));
+    EXPECT_LE(decoder.errorMessage().size(), 4096U);
+}
+
+TEST_F(ImageArrayDecoderTest, RejectsTruncatedPayload) {
+    Image image{20, 10, 0};
+    auto reply = imageBytes(image, ImageArrayElementTypes::Int32,
+                            ImageArrayElementTypes::UInt16);
+    reply.pop_back();
+    EXPECT_FALSE(decode(reply, true, 17));
+    reply.append(3, '\0');
+    EXPECT_FALSE(decode(reply, true, 17));
+}
+
+TEST_F(ImageArrayDecoderTest, DecodesJsonRank2And3) {
+    for (int planes : {0, 3}) {
+        SCOPED_TRACE(planes);
+        Image image{41, 23, planes};
+        auto reply = imageJson(image, ImageArrayElementTypes::Int32);
+        for (size_t chunk : {size_t(1), size_t(10), reply.size()}) {
+            ASSERT_TRUE(decode(reply, false, chunk, chunk))
+                << decoder.errorMessage();
+            EXPECT_EQ(decoder.metadata().rank, planes > 0 ? 3 : 2);
+            expectPixels<uint32_t>(image, 0);
+        }
+    }
+}
+
+TEST_F(ImageArrayDecoderTest, JsonUsesImageTypeWidth) {
+    Image image{4, 3, 0};
+    auto reply = imageJson(image, ImageArrayElementTypes::UInt16);
+    ASSERT_TRUE(decode(reply, false, 6));
+    EXPECT_EQ(decoder.frame().info().geometry.bits_per_sample, 16U);
+    auto *pixels = reinterpret_cast<const uint16_t *>(decoder.frame().data());
+    EXPECT_EQ(pixels[0], 65535);
+}
+
+TEST_F(ImageArrayDecoderTest, JsonErrorAndMalformedReplies) {
+    ASSERT_TRUE(decode(
+        R"({"Value":[],"ErrorNumber":1025,"ErrorMessage":"bad \"value\""})",
+        false, 4));
+    EXPECT_EQ(decoder.errorNumber(), 1025);
+    EXPECT_EQ(decoder.errorMessage(), R"(bad "value")");
+
+    EXPECT_FALSE(decode(R"({"Value":[[1,2],[3]],"ErrorNumber":0})", false, 3));
+    EXPECT_FALSE(decode(R"({"Value":[[1,2],[3,4])", false, 3));
+    EXPECT_FALSE(decode(R"({"Value":[[[[1]]]]})", false, 3));
+    EXPECT_FALSE(decode(R"({"Value":[[1,x]]})", false, 3));
+}
+}  // namespace
@@ -4,9 +4,33 @@
 TEST(MD5Test, EncryptTest) {
     atom::algorithm::MD5 md5;
     std::string input = "Hello, World!";
-    std::string expectedOutput = "5eb63bbbe01eeed093cb22bb8f5acdc3";
+    std::string expectedOutput = "65a8e27d8879283831b664bd8b7f0ad4";
 
     std::string actualOutput = atom::algorithm::MD5::encrypt(input);
 
     EXPECT_EQ(actualOutput, expectedOutput);
 }
+
+TEST(MD5Test, KnownVectors) {
+    EXPECT_EQ(atom::algorithm::MD5::encrypt(""),
+              "d41d8cd98f00b204e9800998ecf8427e");
+    // 56..63 bytes need a second padding block
+    EXPECT_EQ(atom::algorithm::MD5::encrypt(std::string(56, 'a')),
+              "3b0c8ac703f828b04c6c197006d17218");
+    EXPECT_EQ(atom::algorithm::MD5::encrypt(std::string(1000, 'a')),
+              "cabe45dcc9ae5b66ba86600cca6b8ba8");
+}
+
+TEST(MD5Test, IncrementalMatchesOneShot) {
+    std::string input;
+    for (int i = 0; i < 10000; ++i) {
+        input.push_back(static_cast<char>(i * 31));
+    }
+    atom::algorithm::MD5 md5;
+    for (std::size_t pos = 0, step = 1; pos < input.size();
+         pos += step, step = step * 3 % 97 + 1) {
+        md5.update(std::string_view(input).substr(pos, step));
+    }
+    EXPECT_EQ(md5.size(), input.size());
+    EXPECT_EQ(md5.finalize(), atom::algorithm::MD5::encrypt(input));
+}
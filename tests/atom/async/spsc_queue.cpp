@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include "atom/async/spsc_queue.hpp"
+
+TEST(SpscQueueTest, RoundsCapacityAndFills) {
+    atom::async::SpscQueue<int> queue(5);
+    EXPECT_EQ(queue.capacity(), 8u);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(queue.tryPush(i));
+    }
+    EXPECT_FALSE(queue.tryPush(8));
+    EXPECT_EQ(queue.size(), 8u);
+    for (int i = 0; i < 8; ++i) {
+        auto value = queue.tryPop();
+        ASSERT_TRUE(value.has_value());
+        EXPECT_EQ(*value, i);
+    }
+    EXPECT_FALSE(queue.tryPop().has_value());
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscQueueTest, DestroysRemainingElements) {
+    auto shared = std::make_shared<int>(1);
+    {
+        atom::async::SpscQueue<std::shared_ptr<int>> queue(4);
+        queue.tryPush(shared);
+        queue.tryPush(shared);
+        EXPECT_EQ(shared.use_count(), 3);
+    }
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+TEST(SpscQueueTest, TransfersAcrossThreads) {
+    constexpr int COUNT = 200000;
+    atom::async::SpscQueue<int> queue(64);
+    std::thread producer([&] {
+        for (int i = 0; i < COUNT; ++i) {
+            while (!queue.tryPush(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for (int expected = 0; expected < COUNT;) {
+        if (auto value = queue.tryPop()) {
+            ASSERT_EQ(*value, expected);
+            ++expected;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+}
@@ -0,0 +1,261 @@
+#include "atom/connection/reactor.hpp"
+#include "atom/connection/sockethub.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace atom::connection;
+using namespace std::chrono_literals;
+
+TEST(ReactorTest, StopRightAfterStart) {
+    for (int i = 0; i < 50; ++i) {
+        Reactor reactor;
+        reactor.start();
+        reactor.stop();
+        EXPECT_FALSE(reactor.isRunning());
+    }
+}
+
+TEST(ReactorTest, PostRunsOnLoopThread) {
+    Reactor reactor;
+    reactor.start();
+    EXPECT_FALSE(reactor.isInLoopThread());
+
+    std::promise<bool> inLoop;
+    reactor.post(
+        [&reactor, &inLoop] { inLoop.set_value(reactor.isInLoopThread()); });
+    auto result = inLoop.get_future();
+    ASSERT_EQ(result.wait_for(5s), std::future_status::ready);
+    EXPECT_TRUE(result.get());
+    reactor.stop();
+}
+
+TEST(ReactorTest, RunReturnsWhileAlreadyRunning) {
+    Reactor reactor;
+    reactor.start();
+    auto second = std::async(std::launch::async, [&reactor] { reactor.run(); });
+    EXPECT_EQ(second.wait_for(5s), std::future_status::ready);
+    EXPECT_TRUE(reactor.isRunning());
+    reactor.stop();
+}
+
+TEST(WorkerPoolTest, SameKeyRunsInOrder) {
+    WorkerPool pool(4, 1024);
+    std::mutex mutex;
+    std::vector<int> seen;
+    std::promise<void> done;
+    for (int i = 0; i < 100; ++i) {
+        pool.post(7, [&, i] {
+            std::scoped_lock lock(mutex);
+            seen.push_back(i);
+            if (i == 99) {
+                done.set_value();
+            }
+        });
+    }
+    ASSERT_EQ(done.get_future().wait_for(5s), std::future_status::ready);
+    pool.stop();
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(seen[i], i);
+    }
+}
+
+TEST(WorkerPoolTest, RejectsWhenFullAndReportsDrain) {
+    WorkerPool pool(1, 2);
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+    std::promise<std::size_t> drained;
+    pool.setDrainCallback(
+        [&drained](std::size_t worker) { drained.set_value(worker); });
+
+    int accepted = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (pool.tryPost(0, [gate] { gate.wait(); })) {
+            ++accepted;
+        }
+    }
+    /* one task may already be running, the queue holds two */
+    EXPECT_LE(accepted, 3);
+    EXPECT_GE(accepted, 2);
+    release.set_value();
+
+    auto worker = drained.get_future();
+    ASSERT_EQ(worker.wait_for(5s), std::future_status::ready);
+    EXPECT_EQ(worker.get(), 0U);
+    pool.stop();
+}
+
+#ifndef _WIN32
+namespace {
+int connectTo(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void sendAll(int fd, const std::string &data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        auto count = ::send(fd, data.data() + sent, data.size() - sent, 0);
+        ASSERT_GT(count, 0);
+        sent += static_cast<std::size_t>(count);
+    }
+}
+
+/* Collects messages and connection events from the hub's workers. */
+struct Recorder {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::string> messages;
+    std::vector<std::string> messagesAtClose;
+    std::vector<SocketHub::ClientId> connected;
+    bool closed = false;
+
+    template <typename Predicate>
+    bool waitFor(Predicate predicate) {
+        std::unique_lock lock(mutex);
+        return cv.wait_for(lock, 5s, [&] { return predicate(); });
+    }
+};
+
+class SocketHubTest : public ::testing::Test {
+protected:
+    void startHub(SocketHub::Options options,
+                  std::chrono::milliseconds delay = 0ms) {
+        hub = std::make_unique<SocketHub>(options);
+        hub->setFramer(SocketHub::lineFramer());
+        hub->addHandler([this, delay](SocketHub::ClientId,
+                                      std::string message) {
+            if (delay.count() > 0) {
+                std::this_thread::sleep_for(delay);
+            }
+            std::scoped_lock lock(recorder.mutex);
+            recorder.messages.push_back(std::move(message));
+            recorder.cv.notify_all();
+        });
+        hub->setConnectHandler([this](SocketHub::ClientId id, bool up) {
+            std::scoped_lock lock(recorder.mutex);
+            if (up) {
+                recorder.connected.push_back(id);
+            } else {
+                recorder.closed = true;
+                recorder.messagesAtClose = recorder.messages;
+            }
+            recorder.cv.notify_all();
+        });
+        hub->start(0);
+        ASSERT_TRUE(hub->isRunning());
+        ASSERT_GT(hub->getPort(), 0);
+    }
+
+    void TearDown() override {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (hub) {
+            hub->stop();
+        }
+    }
+
+    Recorder recorder;
+    std::unique_ptr<SocketHub> hub;
+    int fd = -1;
+};
+}  // namespace
+
+TEST_F(SocketHubTest, DeliversLines) {
+    startHub({});
+    fd = connectTo(hub->getPort());
+    ASSERT_GE(fd, 0);
+    sendAll(fd, "one\ntwo\nthr");
+    sendAll(fd, "ee\n");
+    ASSERT_TRUE(recorder.waitFor([&] { return recorder.messages.size() == 3; }));
+    EXPECT_EQ(recorder.messages,
+              (std::vector<std::string>{"one", "two", "three"}));
+}
+
+TEST_F(SocketHubTest, PausedClientLosesNothing) {
+    SocketHub::Options options;
+    options.workerThreads = 1;
+    options.queueCapacity = 1;
+    options.readBufferSize = 16;
+    startHub(options, 2ms);
+    fd = connectTo(hub->getPort());
+    ASSERT_GE(fd, 0);
+
+    std::string data;
+    for (int i = 0; i < 200; ++i) {
+        data += "message " + std::to_string(i) + "\n";
+    }
+    sendAll(fd, data);
+    ASSERT_TRUE(
+        recorder.waitFor([&] { return recorder.messages.size() == 200; }));
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_EQ(recorder.messages[i], "message " + std::to_string(i));
+    }
+}
+
+TEST_F(SocketHubTest, HalfCloseDeliversBufferedMessages) {
+    SocketHub::Options options;
+    options.workerThreads = 1;
+    options.queueCapacity = 1;
+    startHub(options, 5ms);
+    fd = connectTo(hub->getPort());
+    ASSERT_GE(fd, 0);
+
+    std::string data;
+    for (int i = 0; i < 20; ++i) {
+        data += std::to_string(i) + "\n";
+    }
+    sendAll(fd, data + "incomplete");
+    ::shutdown(fd, SHUT_WR);
+
+    ASSERT_TRUE(recorder.waitFor([&] { return recorder.closed; }));
+    ASSERT_EQ(recorder.messagesAtClose.size(), 20U);
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(recorder.messagesAtClose[i], std::to_string(i));
+    }
+}
+
+TEST_F(SocketHubTest, SendToGoneClientFails) {
+    startHub({});
+    EXPECT_FALSE(hub->send(12345, "nobody\n"));
+
+    fd = connectTo(hub->getPort());
+    ASSERT_GE(fd, 0);
+    ASSERT_TRUE(recorder.waitFor([&] { return !recorder.connected.empty(); }));
+    auto id = recorder.connected.front();
+    EXPECT_TRUE(hub->send(id, "hello\n"));
+
+    char buffer[16] = {};
+    ASSERT_EQ(::recv(fd, buffer, 6, MSG_WAITALL), 6);
+    EXPECT_EQ(std::string(buffer, 6), "hello\n");
+
+    ::close(fd);
+    fd = -1;
+    ASSERT_TRUE(recorder.waitFor([&] { return recorder.closed; }));
+    EXPECT_FALSE(hub->send(id, "late\n"));
+}
+#endif
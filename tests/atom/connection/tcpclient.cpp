@@ -0,0 +1,194 @@
+#include "atom/connection/tcpclient.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace atom::connection;
+using namespace std::chrono_literals;
+
+TEST(FramingTest, LengthPrefixRoundTrip) {
+    auto header = lengthPrefix(0x01020304);
+    std::string data(header.begin(), header.end());
+    data.append(0x01020304, 'x');
+    auto frame = lengthPrefixFramer()(data);
+    EXPECT_EQ(frame.consumed, data.size());
+    EXPECT_EQ(frame.offset, 4U);
+    EXPECT_EQ(frame.length, 0x01020304U);
+
+    /* incomplete payload */
+    EXPECT_EQ(lengthPrefixFramer()(std::string_view(data).substr(0, 100))
+                  .consumed,
+              0U);
+}
+
+TEST(FramingTest, ReceiveBufferCompactsInsteadOfGrowing) {
+    ReceiveBuffer buffer(8);
+    auto space = buffer.writable();
+    ASSERT_EQ(space.size(), 8U);
+    std::copy_n("abcdefgh", 8, space.data());
+    buffer.commit(8);
+    EXPECT_TRUE(buffer.full());
+    buffer.consume(6);
+    EXPECT_EQ(buffer.data(), "gh");
+
+    space = buffer.writable();
+    EXPECT_EQ(space.size(), 6U);
+    std::copy_n("ij", 2, space.data());
+    buffer.commit(2);
+    EXPECT_EQ(buffer.data(), "ghij");
+    EXPECT_EQ(buffer.capacity(), 8U);
+}
+
+#ifndef _WIN32
+namespace {
+/* A loopback listener that accepts one connection. */
+class TcpClientTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_GE(listener, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(::bind(listener, reinterpret_cast<sockaddr *>(&address),
+                         sizeof(address)),
+                  0);
+        ASSERT_EQ(::listen(listener, 1), 0);
+        socklen_t length = sizeof(address);
+        ::getsockname(listener, reinterpret_cast<sockaddr *>(&address),
+                      &length);
+        port = ntohs(address.sin_port);
+    }
+
+    void TearDown() override {
+        if (peer >= 0) {
+            ::close(peer);
+        }
+        ::close(listener);
+    }
+
+    void connectClient() {
+        ASSERT_TRUE(client.connect("127.0.0.1", port, 2000ms));
+        peer = ::accept(listener, nullptr, nullptr);
+        ASSERT_GE(peer, 0);
+    }
+
+    std::string readPeer(std::size_t size) {
+        std::string data(size, '\0');
+        auto count = ::recv(peer, data.data(), size, MSG_WAITALL);
+        data.resize(count > 0 ? static_cast<std::size_t>(count) : 0);
+        return data;
+    }
+
+    void writePeer(const std::string &data) {
+        ASSERT_EQ(::send(peer, data.data(), data.size(), 0),
+                  static_cast<ssize_t>(data.size()));
+    }
+
+    int listener = -1;
+    int peer = -1;
+    int port = 0;
+    TcpClient client;
+};
+}  // namespace
+
+TEST_F(TcpClientTest, SendsFramedMessages) {
+    connectClient();
+    std::string payload = "hello";
+    ASSERT_TRUE(client.sendLengthPrefixed(payload));
+    ASSERT_TRUE(client.sendDelimited(payload, ';'));
+    std::string a = "ab", b = "cd";
+    std::vector<std::span<const char>> parts{a, b};
+    ASSERT_TRUE(client.sendParts(parts));
+
+    EXPECT_EQ(readPeer(19), std::string("\0\0\0\5hellohello;abcd", 19));
+}
+
+TEST_F(TcpClientTest, RejectsLengthBeyondPrefix) {
+    connectClient();
+    /* never read, the size check comes first */
+    static const char byte = 0;
+    std::span<const char> huge(&byte, MAX_PREFIXED_LENGTH + 1);
+    EXPECT_FALSE(client.sendLengthPrefixed(huge));
+    EXPECT_TRUE(client.isConnected());
+}
+
+TEST_F(TcpClientTest, ReceivesFramesIntoBuffer) {
+    connectClient();
+    writePeer("one\ntwo\nthr");
+    ReceiveBuffer buffer(64);
+    auto framer = lineFramer();
+    auto first = client.receiveFrame(buffer, framer, 2000ms);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(*first, "one");
+    auto second = client.receiveFrame(buffer, framer, 2000ms);
+    ASSERT_TRUE(second);
+    EXPECT_EQ(*second, "two");
+
+    writePeer("ee\n");
+    auto third = client.receiveFrame(buffer, framer, 2000ms);
+    ASSERT_TRUE(third);
+    EXPECT_EQ(*third, "three");
+}
+
+TEST_F(TcpClientTest, DisconnectStopsReceiveLoop) {
+    connectClient();
+    std::atomic<int> frames = 0;
+    std::atomic<int> disconnects = 0;
+    client.setFramer(lineFramer());
+    client.setOnFrameReceivedCallback(
+        [&frames](std::string_view) { frames.fetch_add(1); });
+    client.setOnDisconnectedCallback(
+        [&disconnects] { disconnects.fetch_add(1); });
+    client.startReceiving(256);
+
+    writePeer("a\nb\n");
+    for (int i = 0; i < 200 && frames.load() < 2; ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_EQ(frames.load(), 2);
+
+    client.disconnect();
+    EXPECT_FALSE(client.isConnected());
+    EXPECT_EQ(disconnects.load(), 1);
+
+    /* and the client can be used again */
+    ::close(peer);
+    peer = -1;
+    connectClient();
+    client.startReceiving(256);
+    writePeer("c\n");
+    for (int i = 0; i < 200 && frames.load() < 3; ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_EQ(frames.load(), 3);
+}
+
+TEST_F(TcpClientTest, PeerCloseDisconnectsFromLoop) {
+    connectClient();
+    std::atomic<int> disconnects = 0;
+    client.setOnDisconnectedCallback(
+        [&disconnects] { disconnects.fetch_add(1); });
+    client.startReceiving(256);
+    ::close(peer);
+    peer = -1;
+    for (int i = 0; i < 200 && disconnects.load() == 0; ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_EQ(disconnects.load(), 1);
+    EXPECT_FALSE(client.isConnected());
+    client.stopReceiving();
+}
+#endif
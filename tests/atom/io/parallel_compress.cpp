@@ -0,0 +1,129 @@
+#include "atom/io/parallel_compress.hpp"
+#include <gtest/gtest.h>
+
+#include <zlib.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+
+using atom::io::CompressionBackend;
+using atom::io::ParallelCompressOptions;
+using atom::io::ParallelCompressor;
+
+namespace {
+
+std::string makeData(std::size_t size) {
+    std::string data;
+    data.reserve(size);
+    std::mt19937 rng(42);
+    // 字母表较小，数据可压缩，同时又不是简单的重复
+    for (std::size_t i = 0; i < size; ++i) {
+        data.push_back("abcdefgh"[rng() % 8]);
+    }
+    return data;
+}
+
+std::string roundTrip(ParallelCompressor &compressor, const std::string &data,
+                      std::string *compressed = nullptr) {
+    std::istringstream in(data);
+    std::ostringstream out;
+    EXPECT_TRUE(compressor.compressStream(in, out));
+    std::istringstream packed(out.str());
+    std::ostringstream back;
+    EXPECT_TRUE(compressor.decompressStream(packed, back));
+    if (compressed != nullptr) {
+        *compressed = out.str();
+    }
+    return back.str();
+}
+
+ParallelCompressOptions smallBlocks(CompressionBackend backend) {
+    ParallelCompressOptions options;
+    options.backend = backend;
+    options.blockSize = 32768;
+    options.threads = 4;
+    return options;
+}
+
+}  // namespace
+
+TEST(ParallelCompressTest, GzipRoundTripAcrossBlocks) {
+    ParallelCompressor compressor(smallBlocks(CompressionBackend::GZIP));
+    const auto data = makeData(1'000'003);
+    std::string compressed;
+    EXPECT_EQ(roundTrip(compressor, data, &compressed), data);
+    EXPECT_LT(compressed.size(), data.size());
+    ASSERT_GE(compressed.size(), 2u);
+    EXPECT_EQ(static_cast<unsigned char>(compressed[0]), 0x1f);
+    EXPECT_EQ(static_cast<unsigned char>(compressed[1]), 0x8b);
+}
+
+TEST(ParallelCompressTest, GzipOutputIsReadableByZlib) {
+    ParallelCompressor compressor(smallBlocks(CompressionBackend::GZIP));
+    const auto data = makeData(200'000);
+    std::istringstream in(data);
+    std::ostringstream out;
+    ASSERT_TRUE(compressor.compressStream(in, out));
+
+    // 单个gzip成员，zlib的一次inflate就能完整解出
+    const auto packed = out.str();
+    std::string back(data.size(), '\0');
+    z_stream zs{};
+    ASSERT_EQ(inflateInit2(&zs, 16 + MAX_WBITS), Z_OK);
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(packed.data()));
+    zs.avail_in = static_cast<uInt>(packed.size());
+    zs.next_out = reinterpret_cast<Bytef *>(back.data());
+    zs.avail_out = static_cast<uInt>(back.size());
+    EXPECT_EQ(inflate(&zs, Z_FINISH), Z_STREAM_END);
+    EXPECT_EQ(zs.avail_in, 0u);
+    inflateEnd(&zs);
+    EXPECT_EQ(back, data);
+}
+
+TEST(ParallelCompressTest, GzipEmptyAndTinyInput) {
+    ParallelCompressor compressor(smallBlocks(CompressionBackend::GZIP));
+    EXPECT_EQ(roundTrip(compressor, ""), "");
+    EXPECT_EQ(roundTrip(compressor, "x"), "x");
+}
+
+TEST(ParallelCompressTest, GzipFileRoundTrip) {
+    const auto dir = std::filesystem::temp_directory_path() /
+                     "atom_parallel_compress_test";
+    std::filesystem::create_directories(dir);
+    const auto source = dir / "data.bin";
+    const auto data = makeData(300'000);
+    std::ofstream(source, std::ios::binary) << data;
+
+    ParallelCompressor compressor(smallBlocks(CompressionBackend::GZIP));
+    ASSERT_TRUE(compressor.compressFile(source));
+    ASSERT_TRUE(std::filesystem::exists(dir / "data.bin.gz"));
+    ASSERT_TRUE(compressor.decompressFile(dir / "data.bin.gz", dir / "out"));
+    std::ifstream in(dir / "out", std::ios::binary);
+    std::string back((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    EXPECT_EQ(back, data);
+    std::filesystem::remove_all(dir);
+}
+
+#ifdef ATOM_ENABLE_ZSTD
+TEST(ParallelCompressTest, ZstdRoundTripAcrossBlocks) {
+    ASSERT_TRUE(atom::io::is_zstd_available());
+    ParallelCompressor compressor(smallBlocks(CompressionBackend::ZSTD));
+    EXPECT_EQ(compressor.options().backend, CompressionBackend::ZSTD);
+    const auto data = makeData(1'000'003);
+    std::string compressed;
+    EXPECT_EQ(roundTrip(compressor, data, &compressed), data);
+    EXPECT_LT(compressed.size(), data.size());
+}
+#else
+TEST(ParallelCompressTest, ZstdFallsBackToGzip) {
+    EXPECT_FALSE(atom::io::is_zstd_available());
+    ParallelCompressor compressor(smallBlocks(CompressionBackend::ZSTD));
+    EXPECT_EQ(compressor.options().backend, CompressionBackend::GZIP);
+    const auto data = makeData(100'000);
+    EXPECT_EQ(roundTrip(compressor, data), data);
+}
+#endif
@@ -0,0 +1,183 @@
+#include "atom/io/ziparchive.hpp"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using atom::io::ZipArchive;
+
+namespace {
+
+std::span<const unsigned char> bytes(const std::string &text) {
+    return {reinterpret_cast<const unsigned char *>(text.data()), text.size()};
+}
+
+std::string readText(const ZipArchive &archive, std::string_view name) {
+    auto data = archive.read(name);
+    if (!data) {
+        return "<missing>";
+    }
+    return {data->begin(), data->end()};
+}
+
+class ZipArchiveTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir = std::filesystem::temp_directory_path() /
+              (std::string("atom_ziparchive_") +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        path = dir / "test.zip";
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir); }
+
+    std::filesystem::path dir;
+    std::filesystem::path path;
+};
+
+}  // namespace
+
+TEST_F(ZipArchiveTest, AppendAndReopen) {
+    const std::string big(100000, 'a');
+    {
+        ZipArchive archive;
+        ASSERT_TRUE(archive.open(path, true));
+        ASSERT_TRUE(archive.append("a.txt", bytes(big)));
+        ASSERT_TRUE(archive.append("dir/b.txt", bytes("hello world"), 0));
+        EXPECT_EQ(archive.entries().size(), 2u);
+    }
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path));
+    ASSERT_EQ(archive.entries().size(), 2u);
+    EXPECT_EQ(readText(archive, "a.txt"), big);
+    EXPECT_EQ(readText(archive, "dir/b.txt"), "hello world");
+
+    // 重新打开后继续追加
+    ASSERT_TRUE(archive.append("c.txt", bytes("third")));
+    archive.close();
+    ASSERT_TRUE(archive.open(path));
+    EXPECT_EQ(archive.entries().size(), 3u);
+    EXPECT_EQ(readText(archive, "c.txt"), "third");
+    EXPECT_EQ(readText(archive, "a.txt"), big);
+}
+
+TEST_F(ZipArchiveTest, ReplaceRemoveAndCompact) {
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path, true));
+    ASSERT_TRUE(archive.append("keep.txt", bytes("keep")));
+    ASSERT_TRUE(archive.append("drop.txt", bytes(std::string(5000, 'x'))));
+    ASSERT_TRUE(archive.append("keep.txt", bytes("replaced")));
+    EXPECT_EQ(archive.entries().size(), 2u);
+    EXPECT_EQ(readText(archive, "keep.txt"), "replaced");
+
+    ASSERT_TRUE(archive.remove("drop.txt"));
+    EXPECT_FALSE(archive.contains("drop.txt"));
+    EXPECT_FALSE(archive.remove("drop.txt"));
+    EXPECT_GT(archive.deadBytes(), 0u);
+
+    const auto before = std::filesystem::file_size(path);
+    ASSERT_TRUE(archive.compact());
+    EXPECT_EQ(archive.deadBytes(), 0u);
+    EXPECT_LT(std::filesystem::file_size(path), before);
+    EXPECT_EQ(archive.entries().size(), 1u);
+    EXPECT_EQ(readText(archive, "keep.txt"), "replaced");
+
+    archive.close();
+    ASSERT_TRUE(archive.open(path));
+    EXPECT_EQ(archive.entries().size(), 1u);
+    EXPECT_EQ(readText(archive, "keep.txt"), "replaced");
+}
+
+TEST_F(ZipArchiveTest, UnknownSizeUsesDataDescriptor) {
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path, true));
+    // 空数据没有大小提示，走数据描述符的路径
+    ASSERT_TRUE(archive.append("empty.txt", {}));
+    ASSERT_TRUE(archive.append("after.txt", bytes("after")));
+    const auto *entry = archive.find("empty.txt");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_NE(entry->flags & 0x0008, 0);
+    const auto recordSize = entry->recordSize;
+
+    archive.close();
+    ASSERT_TRUE(archive.open(path));
+    entry = archive.find("empty.txt");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->recordSize, recordSize);
+    EXPECT_EQ(readText(archive, "empty.txt"), "");
+
+    // compact按recordSize复制条目，描述符必须被完整带上
+    ASSERT_TRUE(archive.remove("after.txt"));
+    ASSERT_TRUE(archive.compact());
+    EXPECT_EQ(readText(archive, "empty.txt"), "");
+}
+
+TEST_F(ZipArchiveTest, AppendFileRoundTrip) {
+    const auto source = dir / "source.bin";
+    std::string data;
+    for (int i = 0; i < 200000; ++i) {
+        data.push_back(static_cast<char>(i * 31 % 251));
+    }
+    std::ofstream(source, std::ios::binary) << data;
+
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path, true));
+    ASSERT_TRUE(archive.appendFile("source.bin", source));
+    ASSERT_TRUE(archive.extract("source.bin", dir / "out.bin"));
+    std::ifstream in(dir / "out.bin", std::ios::binary);
+    std::string back((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    EXPECT_EQ(back, data);
+}
+
+TEST_F(ZipArchiveTest, RecoversFromInterruptedAppend) {
+    {
+        ZipArchive archive;
+        ASSERT_TRUE(archive.open(path, true));
+        ASSERT_TRUE(archive.append("a.txt", bytes("first")));
+        ASSERT_TRUE(archive.append("b.txt", bytes("second")));
+    }
+    // 模拟追加到一半时崩溃：旧目录之后是一段没有中央目录的条目数据
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        const std::string partial(200000, 'z');
+        out << "PK\x03\x04" << partial;
+    }
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path));
+    EXPECT_EQ(archive.entries().size(), 2u);
+    EXPECT_EQ(readText(archive, "a.txt"), "first");
+    EXPECT_EQ(readText(archive, "b.txt"), "second");
+
+    // 之后的追加写在残留数据之后，残留部分计入墓碑
+    ASSERT_TRUE(archive.append("c.txt", bytes("third")));
+    EXPECT_GE(archive.deadBytes(), 200000u);
+    archive.close();
+    ASSERT_TRUE(archive.open(path));
+    EXPECT_EQ(archive.entries().size(), 3u);
+    EXPECT_EQ(readText(archive, "c.txt"), "third");
+}
+
+TEST_F(ZipArchiveTest, ManyAppendsKeepFileSizeLinear) {
+    // 每次追加都会留下一份旧目录，不整理时600个条目约有10MB墓碑
+    constexpr int COUNT = 600;
+    const std::string payload(64, 'f');
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path, true));
+    for (int i = 0; i < COUNT; ++i) {
+        ASSERT_TRUE(archive.append("frame_" + std::to_string(i) + ".raw",
+                                   bytes(payload), 0));
+    }
+    EXPECT_LT(std::filesystem::file_size(path), 2u << 20);
+    EXPECT_LT(archive.deadBytes(), 1u << 20);
+
+    archive.close();
+    ASSERT_TRUE(archive.open(path));
+    ASSERT_EQ(archive.entries().size(), static_cast<std::size_t>(COUNT));
+    EXPECT_EQ(readText(archive, "frame_0.raw"), payload);
+    EXPECT_EQ(readText(archive, "frame_599.raw"), payload);
+}
@@ -0,0 +1,91 @@
+#include "atom/memory/framebuffer.hpp"
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using atom::memory::FrameBufferRing;
+using atom::memory::FrameGeometry;
+using atom::memory::FrameHandle;
+
+TEST(FrameBufferRingTest, SizesBuffersFromGeometry) {
+    FrameGeometry geometry{4144, 2822, 1, 16};
+    EXPECT_EQ(geometry.bytes(), 4144u * 2822u * 2u);
+
+    FrameBufferRing ring(geometry, 3);
+    EXPECT_EQ(ring.size(), 3u);
+    EXPECT_EQ(ring.available(), 3u);
+    EXPECT_EQ(ring.frameBytes(), geometry.bytes());
+
+    auto frame = ring.acquire();
+    EXPECT_EQ(frame.capacity(), geometry.bytes());
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(frame.data()) % 4096, 0u);
+    frame.setSize(100);
+    EXPECT_EQ(frame.size(), 100u);
+    EXPECT_THROW(frame.setSize(geometry.bytes() + 1), std::length_error);
+}
+
+TEST(FrameBufferRingTest, SharedHandlesReturnBufferOnce) {
+    FrameBufferRing ring({64, 64, 1, 8}, 2);
+    auto frame = ring.acquire();
+    frame.data()[0] = 42;
+    FrameHandle preview = frame;
+    FrameHandle writer = preview;
+    EXPECT_EQ(frame.useCount(), 3u);
+    EXPECT_EQ(writer.data()[0], 42);
+    EXPECT_EQ(ring.available(), 1u);
+
+    frame.reset();
+    preview.reset();
+    EXPECT_EQ(ring.available(), 1u);
+    writer.reset();
+    EXPECT_EQ(ring.available(), 2u);
+}
+
+TEST(FrameBufferRingTest, ExhaustedRingDropsOrWaits) {
+    FrameBufferRing ring({64, 64, 3, 8}, 2);
+    auto first = ring.tryAcquire();
+    auto second = ring.tryAcquire();
+    ASSERT_TRUE(first && second);
+    EXPECT_NE(first.data(), second.data());
+    EXPECT_FALSE(ring.tryAcquire());
+    EXPECT_THROW(ring.acquire(), std::runtime_error);
+    EXPECT_FALSE(ring.acquireFor(std::chrono::milliseconds(10)));
+
+    std::thread consumer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        first.reset();
+    });
+    EXPECT_TRUE(ring.acquireFor(std::chrono::seconds(5)));
+    consumer.join();
+}
+
+TEST(FrameBufferRingTest, ReconfigureKeepsOutstandingFrames) {
+    FrameBufferRing ring({16, 16, 1, 8}, 1);
+    auto old = ring.acquire();
+    old.data()[255] = 7;
+    ring.configure({32, 32, 1, 16}, 4);
+    EXPECT_EQ(ring.available(), 4u);
+    EXPECT_EQ(ring.frameBytes(), 32u * 32u * 2u);
+    EXPECT_EQ(old.data()[255], 7);
+    EXPECT_EQ(old.capacity(), 256u);
+}
+
+TEST(FrameBufferRingTest, ConcurrentProducersAndConsumers) {
+    FrameBufferRing ring({64, 64, 1, 8}, 4);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            for (int n = 0; n < 10000; ++n) {
+                if (auto frame = ring.tryAcquire()) {
+                    FrameHandle copy = frame;
+                    copy.data()[0] = static_cast<std::uint8_t>(n);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(ring.available(), 4u);
+}
@@ -100,3 +100,99 @@ TEST(ObjectPoolTest, MultiThreadedAcquireRelease) {
     EXPECT_EQ(counter, 100);
     EXPECT_EQ(pool.available(), 10);
 }
+
+TEST(ObjectPoolTest, HandleReturnsOnScopeExit) {
+    ObjectPool<TestObject> pool(1);
+
+    {
+        auto obj = pool.acquire();
+        obj->value = 7;
+        EXPECT_EQ(pool.available(), 0);
+    }
+    EXPECT_EQ(pool.available(), 1);
+
+    auto obj = pool.acquire();
+    EXPECT_EQ(obj->value, 0);
+}
+
+TEST(ObjectPoolTest, TryAcquire) {
+    ObjectPool<TestObject> pool(1);
+
+    auto obj1 = pool.tryAcquire();
+    ASSERT_TRUE(obj1);
+    auto obj2 = pool.tryAcquire();
+    EXPECT_FALSE(obj2);
+
+    obj1.reset();
+    EXPECT_TRUE(pool.tryAcquire());
+}
+
+TEST(ObjectPoolTest, AcquireForTimeout) {
+    ObjectPool<TestObject> pool(1);
+
+    auto obj = pool.acquire();
+    auto start = std::chrono::steady_clock::now();
+    auto none = pool.acquireFor(std::chrono::milliseconds(20));
+    EXPECT_FALSE(none);
+    EXPECT_GE(std::chrono::steady_clock::now() - start,
+              std::chrono::milliseconds(20));
+}
+
+TEST(ObjectPoolTest, AcquireForWakesOnRelease) {
+    ObjectPool<TestObject> pool(1);
+
+    auto obj = pool.acquire();
+    std::thread releaser([&obj] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        obj.reset();
+    });
+
+    auto other = pool.acquireFor(std::chrono::seconds(5));
+    EXPECT_TRUE(other);
+    releaser.join();
+}
+
+TEST(ObjectPoolTest, ReclaimsFromOtherThreads) {
+    ObjectPool<TestObject> pool(
+        4, [] { return std::make_unique<TestObject>(); }, 4);
+
+    std::thread worker([&pool] {
+        std::vector<ObjectPool<TestObject>::Handle> handles;
+        for (int i = 0; i < 4; ++i) {
+            handles.push_back(pool.acquire());
+        }
+    });
+    worker.join();
+
+    // All four objects are parked in the finished thread's magazine.
+    std::vector<ObjectPool<TestObject>::Handle> handles;
+    for (int i = 0; i < 4; ++i) {
+        handles.push_back(pool.acquire());
+    }
+    EXPECT_EQ(pool.available(), 0);
+}
+
+TEST(ObjectPoolTest, StressNeverExceedsMaxSize) {
+    std::atomic<int> created{0};
+    ObjectPool<TestObject> pool(8, [&created] {
+        ++created;
+        return std::make_unique<TestObject>();
+    });
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&pool] {
+            for (int j = 0; j < 10000; ++j) {
+                auto obj = pool.acquireFor(std::chrono::seconds(5));
+                ASSERT_TRUE(obj);
+                obj->value = j;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_LE(created, 8);
+    EXPECT_EQ(pool.available(), 8);
+}
@@ -0,0 +1,291 @@
+#include "atom/memory/resource.hpp"
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "atom/type/flatmap.hpp"
+#include "atom/type/pod_vector.hpp"
+#include "atom/type/small_vector.hpp"
+
+using namespace atom::memory;
+
+// Tests for ArenaResource
+TEST(ArenaResourceTest, BumpAllocation) {
+    ArenaResource arena(1024);
+
+    void* p1 = arena.allocate(100, 8);
+    void* p2 = arena.allocate(100, 64);
+    ASSERT_NE(p1, nullptr);
+    ASSERT_NE(p2, nullptr);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p2) % 64, 0u);
+
+    auto stats = arena.stats();
+    EXPECT_EQ(stats.allocations, 2u);
+    EXPECT_EQ(stats.bytesInUse, 200u);
+    EXPECT_EQ(stats.upstreamBytes, 1024u);
+}
+
+TEST(ArenaResourceTest, ResetKeepsBlocks) {
+    ArenaResource arena(1024);
+
+    for (int i = 0; i < 40; ++i) {
+        (void)arena.allocate(100);
+    }
+    auto upstream = arena.stats().upstreamBytes;
+    EXPECT_GT(upstream, 1024u);
+
+    arena.reset();
+    EXPECT_EQ(arena.stats().bytesInUse, 0u);
+    for (int i = 0; i < 40; ++i) {
+        (void)arena.allocate(100);
+    }
+    EXPECT_EQ(arena.stats().upstreamBytes, upstream);
+
+    arena.release();
+    EXPECT_EQ(arena.stats().upstreamBytes, 0u);
+}
+
+TEST(ArenaResourceTest, OversizedRequest) {
+    ArenaResource arena(1024);
+
+    void* p = arena.allocate(8192);
+    ASSERT_NE(p, nullptr);
+    EXPECT_GE(arena.stats().upstreamBytes, 8192u);
+}
+
+// Tests for SlabResource
+TEST(SlabResourceTest, SizeClasses) {
+    EXPECT_EQ(SlabResource::classSize(1), 16u);
+    EXPECT_EQ(SlabResource::classSize(16), 16u);
+    EXPECT_EQ(SlabResource::classSize(17), 32u);
+    EXPECT_EQ(SlabResource::classSize(129), 192u);
+    EXPECT_EQ(SlabResource::classSize(4096), 4096u);
+    EXPECT_EQ(SlabResource::classSize(4097), 0u);
+}
+
+TEST(SlabResourceTest, ReusesFreedBlocks) {
+    SlabResource slab;
+
+    void* p1 = slab.allocate(40);
+    slab.deallocate(p1, 40);
+    void* p2 = slab.allocate(48);
+    EXPECT_EQ(p1, p2);
+    slab.deallocate(p2, 48);
+
+    auto stats = slab.stats();
+    EXPECT_EQ(stats.allocations, 2u);
+    EXPECT_EQ(stats.deallocations, 2u);
+    EXPECT_EQ(stats.bytesInUse, 0u);
+    EXPECT_EQ(stats.peakBytesInUse, 48u);
+}
+
+TEST(SlabResourceTest, DistinctBlocks) {
+    SlabResource slab;
+    std::set<void*> seen;
+    std::vector<void*> blocks;
+
+    for (int i = 0; i < 5000; ++i) {
+        void* p = slab.allocate(64);
+        EXPECT_TRUE(seen.insert(p).second);
+        blocks.push_back(p);
+    }
+    for (void* p : blocks) {
+        slab.deallocate(p, 64);
+    }
+    EXPECT_EQ(slab.stats().bytesInUse, 0u);
+}
+
+TEST(SlabResourceTest, LargeAndOverAligned) {
+    SlabResource slab;
+
+    void* big = slab.allocate(1 << 20);
+    void* aligned = slab.allocate(64, 256);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(aligned) % 256, 0u);
+    EXPECT_EQ(slab.stats().upstreamBytes, (1u << 20) + 64u);
+
+    slab.deallocate(big, 1 << 20);
+    slab.deallocate(aligned, 64, 256);
+    EXPECT_EQ(slab.stats().upstreamBytes, 0u);
+}
+
+TEST(SlabResourceTest, CrossThreadFree) {
+    SlabResource slab;
+    std::vector<void*> blocks(10000);
+
+    std::thread producer([&] {
+        for (auto& p : blocks) {
+            p = slab.allocate(32);
+        }
+    });
+    producer.join();
+
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < 4; ++t) {
+        consumers.emplace_back([&, t] {
+            for (std::size_t i = t; i < blocks.size(); i += 4) {
+                slab.deallocate(blocks[i], 32);
+            }
+            for (int i = 0; i < 1000; ++i) {
+                slab.deallocate(slab.allocate(32), 32);
+            }
+        });
+    }
+    for (auto& thread : consumers) {
+        thread.join();
+    }
+    EXPECT_EQ(slab.stats().bytesInUse, 0u);
+}
+
+TEST(SlabResourceTest, LiveThreadDoesNotPinDeadResource) {
+    StatsResource upstream;
+    auto slab = std::make_unique<SlabResource>(64 * 1024, 32, &upstream);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool touched = false;
+    bool done = false;
+    std::thread worker([&] {
+        slab->deallocate(slab->allocate(32), 32);
+        {
+            std::lock_guard lock(mutex);
+            touched = true;
+        }
+        cv.notify_all();
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] { return done; });
+        // The dead resource's cache is discarded when this thread uses
+        // another resource.
+        SlabResource other(64 * 1024, 32, &upstream);
+        other.deallocate(other.allocate(32), 32);
+    });
+    {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] { return touched; });
+    }
+    EXPECT_GT(upstream.stats().bytesInUse, 0u);
+
+    // The worker is still alive and still has blocks cached for the slab.
+    slab.reset();
+    EXPECT_EQ(upstream.stats().bytesInUse, 0u);
+    {
+        std::lock_guard lock(mutex);
+        done = true;
+    }
+    cv.notify_all();
+    worker.join();
+    EXPECT_EQ(upstream.stats().bytesInUse, 0u);
+}
+
+// Tests for StatsResource
+TEST(StatsResourceTest, CountsAndHook) {
+    std::ptrdiff_t net = 0;
+    StatsResource stats(std::pmr::new_delete_resource(),
+                        [&net](std::ptrdiff_t bytes, std::size_t) {
+                            net += bytes;
+                        });
+
+    void* p = stats.allocate(128);
+    EXPECT_EQ(net, 128);
+    EXPECT_EQ(stats.stats().bytesInUse, 128u);
+    stats.deallocate(p, 128);
+    EXPECT_EQ(net, 0);
+    EXPECT_EQ(stats.stats().deallocations, 1u);
+}
+
+// Containers on pmr resources
+TEST(ResourceContainerTest, SmallVector) {
+    SlabResource slab;
+    PmrSmallVector<int, 4> vec(&slab);
+
+    for (int i = 0; i < 100; ++i) {
+        vec.push_back(i);
+    }
+    EXPECT_EQ(vec.size(), 100u);
+    EXPECT_EQ(vec[99], 99);
+    EXPECT_GT(slab.stats().bytesInUse, 0u);
+
+    PmrSmallVector<int, 4> moved(std::move(vec));
+    EXPECT_EQ(moved.size(), 100u);
+    EXPECT_EQ(moved.get_allocator().resource(), &slab);
+}
+
+TEST(ResourceContainerTest, SmallVectorSwapAcrossResources) {
+    StatsResource first;
+    StatsResource second;
+    PmrSmallVector<int, 4> a(&first);
+    PmrSmallVector<int, 4> b(&second);
+    for (int i = 0; i < 50; ++i) {
+        a.push_back(i);
+    }
+    b.push_back(7);
+
+    a.swap(b);
+    ASSERT_EQ(a.size(), 1u);
+    EXPECT_EQ(a[0], 7);
+    ASSERT_EQ(b.size(), 50u);
+    EXPECT_EQ(b[49], 49);
+    // Each vector keeps its own resource and the buffers stay with them.
+    EXPECT_EQ(a.get_allocator().resource(), &first);
+    EXPECT_EQ(b.get_allocator().resource(), &second);
+    EXPECT_GT(second.stats().bytesInUse, 0u);
+
+    a = PmrSmallVector<int, 4>(&first);
+    b = PmrSmallVector<int, 4>(&second);
+    EXPECT_EQ(first.stats().bytesInUse, 0u);
+    EXPECT_EQ(second.stats().bytesInUse, 0u);
+}
+
+TEST(ResourceContainerTest, PodVectorMoveAcrossResources) {
+    StatsResource first;
+    StatsResource second;
+    {
+        atom::type::pmr::pod_vector<int> a(&first);
+        atom::type::pmr::pod_vector<int> b(&second);
+        for (int i = 0; i < 100; ++i) {
+            b.push_back(i);
+        }
+        a = std::move(b);
+        ASSERT_EQ(a.size(), 100);
+        EXPECT_EQ(a[99], 99);
+        EXPECT_EQ(a.get_allocator().resource(), &first);
+
+        atom::type::pmr::pod_vector<int> c(&second);
+        c.push_back(1);
+        swap(a, c);
+        EXPECT_EQ(a.size(), 1);
+        EXPECT_EQ(c.size(), 100);
+        EXPECT_EQ(c[42], 42);
+        EXPECT_EQ(c.get_allocator().resource(), &second);
+    }
+    EXPECT_EQ(first.stats().bytesInUse, 0u);
+    EXPECT_EQ(second.stats().bytesInUse, 0u);
+}
+
+TEST(ResourceContainerTest, PodVector) {
+    ArenaResource arena;
+    {
+        atom::type::pmr::pod_vector<int> vec(&arena);
+        for (int i = 0; i < 1000; ++i) {
+            vec.push_back(i);
+        }
+        EXPECT_EQ(vec.size(), 1000);
+        EXPECT_EQ(vec[500], 500);
+    }
+    EXPECT_GT(arena.stats().allocations, 1u);
+}
+
+TEST(ResourceContainerTest, FlatMap) {
+    StatsResource stats;
+    PmrQuickFlatMap<std::string, int> map(&stats);
+
+    map["one"] = 1;
+    map["two"] = 2;
+    EXPECT_EQ(map.at("two"), 2);
+    EXPECT_GT(stats.stats().allocations, 0u);
+}
@@ -0,0 +1,156 @@
+#include "atom/search/sqlite.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class SqliteDBTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = std::filesystem::temp_directory_path() /
+               (std::string("atom_sqlite_") +
+                ::testing::UnitTest::GetInstance()->current_test_info()->name() +
+                ".db");
+        removeFiles();
+    }
+
+    void TearDown() override { removeFiles(); }
+
+    void removeFiles() {
+        for (const char *suffix : {"", "-wal", "-shm"}) {
+            std::filesystem::remove(path.string() + suffix);
+        }
+    }
+
+    std::filesystem::path path;
+};
+
+}  // namespace
+
+TEST_F(SqliteDBTest, StatementCacheHitsOnRepeatedSql) {
+    SqliteDB db(path.c_str());
+    ASSERT_TRUE(db.execute("CREATE TABLE t(id INTEGER, name TEXT)"));
+    const auto &cache = db.statementCache();
+    const auto misses = cache.misses();
+    // 结尾的分号和空白不会进入sqlite3_sql，缓存必须以取出时的文本为键
+    const std::string sql = "INSERT INTO t VALUES(?, ?);  ";
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(db.execute(sql, i, "star"));
+    }
+    EXPECT_EQ(cache.misses(), misses + 1);
+    EXPECT_GE(cache.hits(), 9u);
+    EXPECT_EQ(db.getIntValue("SELECT COUNT(*) FROM t"), 10);
+}
+
+TEST(SqliteStatementCacheTest, EvictsLeastRecentlyUsed) {
+    sqlite3 *db = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &db), SQLITE_OK);
+    {
+        SqliteStatementCache cache(db, 2);
+        const std::vector<std::string> sqls = {"SELECT 1", "SELECT 2",
+                                               "SELECT 3"};
+        for (const auto &sql : sqls) {
+            auto *stmt = cache.acquire(sql);
+            ASSERT_NE(stmt, nullptr);
+            cache.release(sql, stmt);
+        }
+        EXPECT_EQ(cache.size(), 2u);
+        EXPECT_EQ(cache.evictions(), 1u);
+
+        // "SELECT 1" 已被淘汰，后两条仍在缓存中
+        const auto misses = cache.misses();
+        auto *third = cache.acquire("SELECT 3");
+        auto *second = cache.acquire("SELECT 2");
+        EXPECT_EQ(cache.misses(), misses);
+        auto *first = cache.acquire("SELECT 1");
+        EXPECT_EQ(cache.misses(), misses + 1);
+        cache.release("SELECT 3", third);
+        cache.release("SELECT 2", second);
+        cache.release("SELECT 1", first);
+        EXPECT_EQ(cache.size(), 2u);
+        EXPECT_EQ(cache.evictions(), 2u);
+    }
+    EXPECT_EQ(sqlite3_close(db), SQLITE_OK);
+}
+
+TEST(SqliteStatementCacheTest, KeepsSeveralStatementsPerSql) {
+    sqlite3 *db = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &db), SQLITE_OK);
+    {
+        SqliteStatementCache cache(db);
+        auto *a = cache.acquire("SELECT 1");
+        auto *b = cache.acquire("SELECT 1");
+        ASSERT_NE(a, b);
+        cache.release("SELECT 1", a);
+        cache.release("SELECT 1", b);
+        EXPECT_EQ(cache.size(), 2u);
+        const auto hits = cache.hits();
+        auto *c = cache.acquire("SELECT 1");
+        auto *d = cache.acquire("SELECT 1");
+        EXPECT_EQ(cache.hits(), hits + 2);
+        cache.release("SELECT 1", c);
+        cache.release("SELECT 1", d);
+    }
+    EXPECT_EQ(sqlite3_close(db), SQLITE_OK);
+}
+
+TEST_F(SqliteDBTest, WalReadersRunAlongsideWriter) {
+    SqliteDB db(path.c_str());
+    ASSERT_TRUE(db.execute("CREATE TABLE t(id INTEGER PRIMARY KEY, v REAL)"));
+    ASSERT_TRUE(db.enableWAL(2));
+    EXPECT_EQ(db.readerCount(), 2u);
+
+    std::vector<SqliteRow> rows;
+    for (int i = 0; i < 1000; ++i) {
+        rows.push_back({std::int64_t{i}, i * 0.5});
+    }
+    ASSERT_EQ(db.insertBatch("INSERT INTO t VALUES(?, ?)", rows), 1000u);
+
+    std::atomic<bool> writing{true};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&] {
+            while (writing.load()) {
+                auto cursor = db.read("SELECT COUNT(*) FROM t WHERE id >= ?", 0);
+                if (!cursor.next() || cursor.getInt(0) < 1000) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (int i = 1000; i < 1200; ++i) {
+        ASSERT_TRUE(db.execute("INSERT INTO t VALUES(?, ?)", i, i * 0.5));
+    }
+    writing = false;
+    for (auto &thread : readers) {
+        thread.join();
+    }
+    EXPECT_EQ(failures.load(), 0);
+
+    auto cursor = db.read("SELECT COUNT(*) FROM t");
+    ASSERT_TRUE(cursor.next());
+    EXPECT_EQ(cursor.getInt(0), 1200);
+}
+
+TEST_F(SqliteDBTest, CloseDoesNotWaitForLiveCursor) {
+    SqliteCursor cursor;
+    {
+        SqliteDB db(path.c_str());
+        ASSERT_TRUE(db.execute("CREATE TABLE t(id INTEGER)"));
+        ASSERT_TRUE(db.execute("INSERT INTO t VALUES(1), (2), (3)"));
+        ASSERT_TRUE(db.enableWAL(1));
+        cursor = db.read("SELECT id FROM t ORDER BY id");
+        ASSERT_TRUE(cursor.next());
+        EXPECT_EQ(cursor.getInt(0), 1);
+        // 析构SqliteDB时游标仍占用唯一的读连接
+    }
+    ASSERT_TRUE(cursor.next());
+    EXPECT_EQ(cursor.getInt(0), 2);
+    cursor = SqliteCursor();
+}
@@ -0,0 +1,117 @@
+#include "atom/sysinfo/sampler.hpp"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace atom::system;
+namespace fs = std::filesystem;
+
+#ifdef __linux__
+namespace {
+class SystemSamplerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        root = fs::temp_directory_path() /
+               (std::string("atom_sampler_") +
+                ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        fs::remove_all(root);
+        fs::create_directories(root);
+        // user nice system idle iowait irq softirq steal
+        writeStat("cpu  300 0 100 600 0 0 0 0\n"
+                  "cpu0 200 0 50 250 0 0 0 0\n"
+                  "cpu1 100 0 50 350 0 0 0 0\n");
+        std::ofstream(root / "meminfo") << "MemTotal:        1000 kB\n"
+                                           "MemFree:          100 kB\n"
+                                           "MemAvailable:     250 kB\n"
+                                           "SwapTotal:        400 kB\n"
+                                           "SwapFree:         300 kB\n";
+    }
+
+    void TearDown() override { fs::remove_all(root); }
+
+    /* Rewrites in place, the sampler keeps the file open. */
+    void writeStat(const std::string& content) {
+        std::ofstream(root / "stat", std::ios::trunc) << content;
+    }
+
+    fs::path root;
+};
+}  // namespace
+
+TEST_F(SystemSamplerTest, BootAverageIsNotPublished) {
+    SystemSampler sampler(std::chrono::seconds(1), 8, root);
+    auto snapshot = sampler.snapshot();
+    ASSERT_TRUE(snapshot);
+    EXPECT_EQ(snapshot->sequence, 0u);
+    EXPECT_EQ(snapshot->cpuUsage, 0.0f);
+    EXPECT_TRUE(sampler.history(Metric::CpuUsage).empty());
+}
+
+TEST_F(SystemSamplerTest, UsageIsTheDeltaToThePreviousSample) {
+    SystemSampler sampler(std::chrono::seconds(1), 8, root);
+
+    // +200 jiffies in total, 150 of them busy; core 0 fully busy, core 1
+    // idle but for a quarter.
+    writeStat("cpu  400 0 150 650 0 0 0 0\n"
+              "cpu0 300 0 50 250 0 0 0 0\n"
+              "cpu1 100 0 100 400 0 0 0 0\n");
+    sampler.sampleOnce();
+    auto snapshot = sampler.snapshot();
+    EXPECT_EQ(snapshot->sequence, 1u);
+    EXPECT_FLOAT_EQ(snapshot->cpuUsage, 75.0f);
+    ASSERT_EQ(snapshot->coreUsage.size(), 2u);
+    EXPECT_FLOAT_EQ(snapshot->coreUsage[0], 100.0f);
+    EXPECT_FLOAT_EQ(snapshot->coreUsage[1], 50.0f);
+
+    // Nothing happened since: no division by zero, no stale value.
+    sampler.sampleOnce();
+    EXPECT_EQ(sampler.snapshot()->cpuUsage, 0.0f);
+
+    // iowait counts as idle.
+    writeStat("cpu  450 0 150 650 50 0 0 0\n"
+              "cpu0 350 0 50 250 0 0 0 0\n"
+              "cpu1 100 0 100 400 50 0 0 0\n");
+    sampler.sampleOnce();
+    EXPECT_FLOAT_EQ(sampler.snapshot()->cpuUsage, 50.0f);
+
+    auto history = sampler.history(Metric::CpuUsage);
+    ASSERT_EQ(history.size(), 3u);
+    EXPECT_FLOAT_EQ(history[0], 75.0f);
+    EXPECT_FLOAT_EQ(history[2], 50.0f);
+    EXPECT_EQ(sampler.history(Metric::CpuUsage, 1).size(), 1u);
+}
+
+TEST_F(SystemSamplerTest, CoreCountChangeReportsNoUsage) {
+    SystemSampler sampler(std::chrono::seconds(1), 8, root);
+    writeStat("cpu  400 0 150 650 0 0 0 0\n"
+              "cpu0 300 0 50 250 0 0 0 0\n");
+    sampler.sampleOnce();
+    EXPECT_EQ(sampler.snapshot()->cpuUsage, 0.0f);
+
+    writeStat("cpu  500 0 150 650 0 0 0 0\n"
+              "cpu0 400 0 50 250 0 0 0 0\n");
+    sampler.sampleOnce();
+    EXPECT_FLOAT_EQ(sampler.snapshot()->cpuUsage, 100.0f);
+}
+
+TEST_F(SystemSamplerTest, Memory) {
+    SystemSampler sampler(std::chrono::seconds(1), 8, root);
+    sampler.sampleOnce();
+    auto snapshot = sampler.snapshot();
+    EXPECT_EQ(snapshot->memoryTotal, 1000u * 1024);
+    EXPECT_EQ(snapshot->memoryAvailable, 250u * 1024);
+    EXPECT_FLOAT_EQ(snapshot->memoryUsage, 75.0f);
+    EXPECT_EQ(snapshot->swapTotal, 400u * 1024);
+    EXPECT_EQ(snapshot->swapUsed, 100u * 1024);
+    EXPECT_FLOAT_EQ(sampler.history(Metric::SwapUsage).back(), 25.0f);
+}
+#endif
+
+TEST(SystemSampler, MetricNames) {
+    EXPECT_EQ(metricFromName("cpu_usage"), Metric::CpuUsage);
+    EXPECT_EQ(metricFromName("cpu_temp"), Metric::CpuTemperature);
+    EXPECT_EQ(metricFromName("swap_usage"), Metric::SwapUsage);
+    EXPECT_FALSE(metricFromName("disk_usage"));
+}
@@ -0,0 +1,145 @@
+#include "atom/video/pipeline.hpp"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "atom/video/consumers.hpp"
+#include "atom/video/synthetic.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+atom::memory::FrameGeometry smallGeometry() {
+    atom::memory::FrameGeometry geometry;
+    geometry.width = 64;
+    geometry.height = 48;
+    return geometry;
+}
+}  // namespace
+
+TEST(CapturePipelineTest, DeliversFramesInOrder) {
+    auto camera =
+        std::make_shared<atom::video::SyntheticCamera>(smallGeometry(), 500);
+    atom::video::CapturePipeline pipeline(camera);
+
+    std::uint64_t last = 0;
+    bool ordered = true;
+    std::atomic<int> frames{0};
+    pipeline.addConsumer(std::make_shared<atom::video::CallbackConsumer>(
+        "order", [&](const atom::video::FrameHandle &frame) {
+            ordered = ordered && frame.info().sequence == last + 1;
+            last = frame.info().sequence;
+            EXPECT_EQ(frame.size(), smallGeometry().bytes());
+            ++frames;
+        }));
+    ASSERT_TRUE(pipeline.start());
+    std::this_thread::sleep_for(200ms);
+    pipeline.stop();
+
+    auto stats = pipeline.stats();
+    EXPECT_TRUE(ordered);
+    EXPECT_GT(frames.load(), 10);
+    ASSERT_EQ(stats.consumers.size(), 1u);
+    EXPECT_EQ(stats.consumers[0].processed, stats.captured);
+    EXPECT_EQ(stats.consumers[0].dropped, 0u);
+    EXPECT_GT(stats.fps, 0.0);
+}
+
+TEST(CapturePipelineTest, SlowConsumerOnlyDropsItsOwnFrames) {
+    auto camera = std::make_shared<atom::video::SyntheticCamera>(
+        smallGeometry(), 500, 16);
+    atom::video::CapturePipeline::Options options;
+    options.queue_depth = 4;
+    atom::video::CapturePipeline pipeline(camera, options);
+
+    std::atomic<int> fast{0};
+    pipeline.addConsumer(std::make_shared<atom::video::CallbackConsumer>(
+        "fast", [&](const atom::video::FrameHandle &) { ++fast; }));
+    pipeline.addConsumer(std::make_shared<atom::video::CallbackConsumer>(
+        "slow", [](const atom::video::FrameHandle &) {
+            std::this_thread::sleep_for(20ms);
+        }));
+    ASSERT_TRUE(pipeline.start());
+    std::this_thread::sleep_for(300ms);
+    pipeline.stop();
+
+    auto stats = pipeline.stats();
+    ASSERT_EQ(stats.consumers.size(), 2u);
+    EXPECT_EQ(stats.consumers[0].dropped, 0u);
+    EXPECT_EQ(static_cast<std::uint64_t>(fast.load()), stats.captured);
+    EXPECT_GT(stats.consumers[1].dropped, 0u);
+    EXPECT_EQ(stats.consumers[1].processed + stats.consumers[1].dropped,
+              stats.captured);
+}
+
+TEST(CapturePipelineTest, PreviewIsDecimated) {
+    auto camera =
+        std::make_shared<atom::video::SyntheticCamera>(smallGeometry(), 400);
+    atom::video::CapturePipeline pipeline(camera);
+    std::atomic<int> previews{0};
+    pipeline.addConsumer(std::make_shared<atom::video::PreviewDecimator>(
+        20, [&](const atom::video::FrameHandle &) { ++previews; }));
+    ASSERT_TRUE(pipeline.start());
+    std::this_thread::sleep_for(500ms);
+    pipeline.stop();
+
+    EXPECT_GE(previews.load(), 5);
+    EXPECT_LE(previews.load(), 12);
+    EXPECT_GT(pipeline.stats().captured, 100u);
+}
+
+TEST(CapturePipelineTest, ScoresSharpFramesHigher) {
+    atom::memory::FrameBufferRing ring(smallGeometry(), 2);
+    auto flat = ring.acquire();
+    flat.setSize(smallGeometry().bytes());
+    flat.info().geometry = smallGeometry();
+    std::fill(flat.data(), flat.data() + flat.size(), 100);
+
+    auto sharp = ring.acquire();
+    sharp.setSize(smallGeometry().bytes());
+    sharp.info().geometry = smallGeometry();
+    for (std::size_t i = 0; i < sharp.size(); ++i) {
+        sharp.data()[i] = (i / 2) % 2 ? 200 : 0;
+    }
+    EXPECT_EQ(atom::video::QualityScorer::score(flat), 0.0);
+    EXPECT_GT(atom::video::QualityScorer::score(sharp), 0.0);
+}
+
+TEST(CapturePipelineTest, RestartsCleanly) {
+    auto camera =
+        std::make_shared<atom::video::SyntheticCamera>(smallGeometry(), 200);
+    atom::video::CapturePipeline pipeline(camera);
+    std::atomic<int> frames{0};
+    pipeline.addConsumer(std::make_shared<atom::video::CallbackConsumer>(
+        "count", [&](const atom::video::FrameHandle &) { ++frames; }));
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(pipeline.start());
+        EXPECT_TRUE(pipeline.isRunning());
+        std::this_thread::sleep_for(50ms);
+        pipeline.stop();
+        EXPECT_FALSE(pipeline.isRunning());
+    }
+    EXPECT_GT(frames.load(), 0);
+    EXPECT_FALSE(pipeline.addConsumer(nullptr));
+}
+
+TEST(SyntheticCameraTest, RendersStarInSmallFrames) {
+    for (std::uint32_t size = 4; size <= 16; ++size) {
+        atom::memory::FrameGeometry geometry;
+        geometry.width = size;
+        geometry.height = size;
+        atom::video::SyntheticCamera camera(geometry, 1000, 2);
+        ASSERT_TRUE(camera.start());
+        atom::video::FrameHandle frame;
+        for (int i = 0; i < 100 && !frame; ++i) {
+            frame = camera.read(100ms);
+        }
+        ASSERT_TRUE(frame) << size;
+        auto *begin = frame.data();
+        auto *end = begin + geometry.bytes();
+        EXPECT_NE(std::find(begin, end, std::uint8_t{0xF0}), end) << size;
+        camera.stop();
+    }
+}
@@ -0,0 +1,105 @@
+#include "atom/web/downloader.hpp"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "cpp_httplib/httplib.h"
+
+namespace fs = std::filesystem;
+
+class DownloadEngineTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (std::size_t i = 0; i < 3 * 1024 * 1024; ++i) {
+            data.push_back(static_cast<char>((i * 7919) >> 3));
+        }
+        server.Get("/data.bin", [this](const httplib::Request &,
+                                       httplib::Response &res) {
+            res.set_header("Accept-Ranges", "bytes");
+            res.set_header("ETag", "\"v1\"");
+            res.set_content(data, "application/octet-stream");
+        });
+        port = server.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this] { server.listen_after_bind(); });
+        server.wait_until_ready();
+        dir = fs::temp_directory_path() / "atom_downloader_test";
+        fs::create_directories(dir);
+    }
+
+    void TearDown() override {
+        server.stop();
+        thread.join();
+        fs::remove_all(dir);
+    }
+
+    std::string url() const {
+        return "http://127.0.0.1:" + std::to_string(port) + "/data.bin";
+    }
+
+    std::string readFile(const fs::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(in), {}};
+    }
+
+    std::string data;
+    httplib::Server server;
+    std::thread thread;
+    int port = 0;
+    fs::path dir;
+};
+
+TEST_F(DownloadEngineTest, SegmentedDownloadMatchesSource) {
+    atom::web::DownloadEngine engine(4);
+    atom::web::DownloadOptions options;
+    options.min_segment_size = 512 * 1024;
+    std::size_t reported = 0;
+    ASSERT_TRUE(engine.download(url(), (dir / "a.bin").string(), options,
+                                [&](std::size_t done, std::size_t total) {
+                                    reported = done;
+                                    EXPECT_EQ(total, data.size());
+                                }));
+    EXPECT_EQ(reported, data.size());
+    EXPECT_EQ(readFile(dir / "a.bin"), data);
+    EXPECT_FALSE(fs::exists(dir / "a.bin.part"));
+    EXPECT_FALSE(fs::exists(dir / "a.bin.part.state"));
+}
+
+TEST_F(DownloadEngineTest, CancelKeepsStateAndResumes) {
+    atom::web::DownloadEngine engine(2, 1024 * 1024);
+    atom::web::DownloadOptions options;
+    options.min_segment_size = 512 * 1024;
+    auto target = (dir / "b.bin").string();
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    EXPECT_FALSE(engine.download(url(), target, options, {}, [&] {
+        return std::chrono::steady_clock::now() > deadline;
+    }));
+    EXPECT_TRUE(fs::exists(target + ".part"));
+    EXPECT_TRUE(fs::exists(target + ".part.state"));
+
+    engine.rate_limiter().set_rate(0);
+    ASSERT_TRUE(engine.download(url(), target, options));
+    EXPECT_EQ(readFile(target), data);
+}
+
+TEST_F(DownloadEngineTest, ChecksumMismatchFails) {
+    atom::web::DownloadEngine engine(2);
+    atom::web::DownloadOptions options;
+    options.sha256 = std::string(64, '0');
+    auto target = (dir / "c.bin").string();
+    EXPECT_FALSE(engine.download(url(), target, options));
+    EXPECT_FALSE(fs::exists(target));
+    EXPECT_FALSE(fs::exists(target + ".part"));
+}
+
+TEST(RateLimiterTest, LimitsThroughput) {
+    atom::web::RateLimiter limiter(1024 * 1024);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 16; ++i) {
+        limiter.acquire(32 * 1024);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(450));
+}
@@ -0,0 +1,92 @@
+#include "atom/web/httpparser.hpp"
+#include <gtest/gtest.h>
+
+#include <string>
+
+using atom::web::KnownHeader;
+using atom::web::StreamingHeaderParser;
+
+namespace {
+const std::string kRequest =
+    "GET /api/v1/camera/0/ccdtemperature HTTP/1.1\r\n"
+    "Host: 192.168.1.5:11111\r\n"
+    "user-agent: atom\r\n"
+    "X-Custom:  padded value \t\r\n"
+    "Accept: application/json\r\n"
+    "Accept: text/plain\r\n"
+    "\r\n"
+    "body";
+}  // namespace
+
+TEST(StreamingHeaderParserTest, ParsesCompleteBlock) {
+    StreamingHeaderParser parser;
+    ASSERT_EQ(parser.parse(kRequest), StreamingHeaderParser::Status::COMPLETE);
+    EXPECT_EQ(parser.startLine(),
+              "GET /api/v1/camera/0/ccdtemperature HTTP/1.1");
+    EXPECT_EQ(parser.consumed(), kRequest.size() - 4);
+    EXPECT_EQ(parser.size(), 5u);
+    EXPECT_EQ(parser.get(KnownHeader::HOST), "192.168.1.5:11111");
+    EXPECT_EQ(parser.get("USER-AGENT"), "atom");
+    EXPECT_EQ(parser.get("x-custom"), "padded value");
+    EXPECT_EQ(parser.get(KnownHeader::ACCEPT), "application/json");
+    EXPECT_EQ(parser.field(4).value, "text/plain");
+    EXPECT_EQ(parser.field(1).id, KnownHeader::USER_AGENT);
+    EXPECT_FALSE(parser.get(KnownHeader::CONTENT_LENGTH));
+    EXPECT_FALSE(parser.get("X-Missing"));
+}
+
+TEST(StreamingHeaderParserTest, ResumesAcrossPartialReads) {
+    StreamingHeaderParser parser;
+    std::string buffer;
+    for (std::size_t i = 0; i < kRequest.size(); ++i) {
+        buffer.push_back(kRequest[i]);
+        buffer.shrink_to_fit();
+        auto status = parser.parse(buffer);
+        ASSERT_NE(status, StreamingHeaderParser::Status::INVALID);
+        if (status == StreamingHeaderParser::Status::COMPLETE) {
+            break;
+        }
+    }
+    ASSERT_EQ(parser.status(), StreamingHeaderParser::Status::COMPLETE);
+    EXPECT_EQ(parser.get(KnownHeader::HOST), "192.168.1.5:11111");
+    EXPECT_EQ(parser.get("x-custom"), "padded value");
+}
+
+TEST(StreamingHeaderParserTest, AcceptsBareLineFeeds) {
+    StreamingHeaderParser parser;
+    ASSERT_EQ(parser.parse("HTTP/1.1 200 OK\nContent-Length: 5\n\n"),
+              StreamingHeaderParser::Status::COMPLETE);
+    EXPECT_EQ(parser.startLine(), "HTTP/1.1 200 OK");
+    EXPECT_EQ(parser.get(KnownHeader::CONTENT_LENGTH), "5");
+}
+
+TEST(StreamingHeaderParserTest, RejectsMalformedFields) {
+    StreamingHeaderParser parser;
+    EXPECT_EQ(parser.parse("GET / HTTP/1.1\r\nNo colon here\r\n\r\n"),
+              StreamingHeaderParser::Status::INVALID);
+    parser.reset();
+    EXPECT_EQ(parser.parse("GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n"),
+              StreamingHeaderParser::Status::INVALID);
+    parser.reset();
+    EXPECT_EQ(parser.parse("GET / HTTP/1.1\r\nBad Name: x\r\n\r\n"),
+              StreamingHeaderParser::Status::INVALID);
+}
+
+TEST(StreamingHeaderParserTest, LimitsFieldCount) {
+    std::string block = "GET / HTTP/1.1\r\n";
+    for (std::size_t i = 0; i <= StreamingHeaderParser::MAX_FIELDS; ++i) {
+        block += "X-" + std::to_string(i) + ": v\r\n";
+    }
+    block += "\r\n";
+    StreamingHeaderParser parser;
+    EXPECT_EQ(parser.parse(block), StreamingHeaderParser::Status::INVALID);
+}
+
+TEST(StreamingHeaderParserTest, IdentifiesKnownHeaders) {
+    EXPECT_EQ(atom::web::identifyHeader("Transfer-Encoding"),
+              KnownHeader::TRANSFER_ENCODING);
+    EXPECT_EQ(atom::web::identifyHeader("content-LENGTH"),
+              KnownHeader::CONTENT_LENGTH);
+    EXPECT_EQ(atom::web::identifyHeader("X-Content-Length"),
+              KnownHeader::UNKNOWN);
+}
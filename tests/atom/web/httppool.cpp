@@ -0,0 +1,324 @@
+#include "atom/web/httppool.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cpp_httplib/httplib.h"
+
+namespace {
+/*
+ * Raw HTTP server whose `reply` decides what the n-th request (counted over
+ * all connections) gets: a response, an empty string to close the
+ * connection, or nothing to never answer.
+ */
+class ScriptedServer {
+public:
+    using Reply = std::function<std::optional<std::string>(int)>;
+
+    explicit ScriptedServer(Reply reply) : reply_(std::move(reply)) {
+        fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        ::listen(fd_, 16);
+        socklen_t len = sizeof(addr);
+        ::getsockname(fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+        port = ntohs(addr.sin_port);
+        thread_ = std::thread([this] { accept(); });
+    }
+
+    ~ScriptedServer() {
+        stop_ = true;
+        thread_.join();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+        ::close(fd_);
+    }
+
+    int port = 0;
+    std::atomic<int> requests{0};
+
+private:
+    bool wait(int fd) const {
+        while (!stop_) {
+            pollfd pfd{fd, POLLIN, 0};
+            if (::poll(&pfd, 1, 20) > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void accept() {
+        while (wait(fd_)) {
+            int conn = ::accept(fd_, nullptr, nullptr);
+            workers_.emplace_back([this, conn] { serve(conn); });
+        }
+    }
+
+    void serve(int conn) {
+        std::string buffer;
+        char chunk[4096];
+        while (wait(conn)) {
+            auto got = ::recv(conn, chunk, sizeof(chunk), 0);
+            if (got <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<std::size_t>(got));
+            std::size_t end;
+            while ((end = buffer.find("\r\n\r\n")) != std::string::npos) {
+                // Bodies used here are short enough to arrive with the head.
+                auto length = buffer.find("Content-Length: ");
+                std::size_t body = 0;
+                if (length != std::string::npos && length < end) {
+                    body = std::stoul(buffer.substr(length + 16));
+                }
+                buffer.erase(0, end + 4 + body);
+                auto reply = reply_(requests++);
+                if (!reply) {
+                    while (wait(conn)) {
+                        if (::recv(conn, chunk, sizeof(chunk), 0) <= 0) {
+                            break;
+                        }
+                    }
+                    ::close(conn);
+                    return;
+                }
+                if (reply->empty()) {
+                    ::close(conn);
+                    return;
+                }
+                ::send(conn, reply->data(), reply->size(), MSG_NOSIGNAL);
+            }
+        }
+        ::close(conn);
+    }
+
+    Reply reply_;
+    int fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+    std::vector<std::thread> workers_;
+};
+
+const std::string kOk = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+/* Answers the first request, then treats the second with `second`. */
+ScriptedServer::Reply answerFirst(std::optional<std::string> second) {
+    return [second](int n) -> std::optional<std::string> {
+        return n == 1 ? second : kOk;
+    };
+}
+}  // namespace
+
+class HttpConnectionPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        server.Get(R"(/echo/(\d+))",
+                   [this](const httplib::Request &req, httplib::Response &res) {
+                       ++requests;
+                       res.set_content(req.matches[1], "text/plain");
+                   });
+        server.Get("/slow", [this](const httplib::Request &,
+                                   httplib::Response &res) {
+            ++requests;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            res.set_content("slow", "text/plain");
+        });
+        server.Put("/echo", [](const httplib::Request &req,
+                               httplib::Response &res) {
+            res.set_content(req.body, "application/json");
+        });
+        server.set_keep_alive_max_count(100);
+        port = server.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this] { server.listen_after_bind(); });
+        server.wait_until_ready();
+    }
+
+    void TearDown() override {
+        server.stop();
+        thread.join();
+    }
+
+    std::string url(const std::string &path) const {
+        return "http://127.0.0.1:" + std::to_string(port) + path;
+    }
+
+    httplib::Server server;
+    std::thread thread;
+    std::atomic<int> requests{0};
+    int port = 0;
+};
+
+TEST_F(HttpConnectionPoolTest, ReusesConnections) {
+    atom::web::HttpConnectionPool pool;
+    for (int i = 0; i < 10; ++i) {
+        auto response = pool.get(url("/echo/" + std::to_string(i))).get();
+        ASSERT_TRUE(response.ok()) << response.error;
+        EXPECT_EQ(response.status, 200);
+        EXPECT_EQ(response.body, std::to_string(i));
+        EXPECT_EQ(response.reused, i > 0);
+    }
+    EXPECT_EQ(pool.stats().connections_opened, 1u);
+}
+
+TEST_F(HttpConnectionPoolTest, ConcurrentRequestsKeepOrder) {
+    atom::web::HttpConnectionPool::Options options;
+    options.max_connections_per_host = 2;
+    atom::web::HttpConnectionPool pool(options);
+    pool.get(url("/echo/0")).wait();
+
+    std::vector<std::shared_future<atom::web::PooledResponse>> futures;
+    for (int i = 0; i < 50; ++i) {
+        futures.push_back(pool.get(url("/echo/" + std::to_string(i))));
+    }
+    for (int i = 0; i < 50; ++i) {
+        const auto &response = futures[i].get();
+        ASSERT_TRUE(response.ok()) << response.error;
+        EXPECT_EQ(response.body, std::to_string(i));
+    }
+    EXPECT_LE(pool.stats().connections_opened, 2u);
+}
+
+TEST_F(HttpConnectionPoolTest, CoalescesIdenticalGets) {
+    atom::web::HttpConnectionPool pool;
+    auto first = pool.get(url("/slow"));
+    auto second = pool.get(url("/slow"));
+    EXPECT_EQ(first.get().body, "slow");
+    EXPECT_EQ(second.get().body, "slow");
+    EXPECT_EQ(requests, 1);
+    EXPECT_EQ(pool.stats().coalesced, 1u);
+}
+
+TEST_F(HttpConnectionPoolTest, PutAndCallback) {
+    atom::web::HttpConnectionPool pool;
+    atom::web::PooledRequest request;
+    request.method = "PUT";
+    request.target = "/echo";
+    request.body = R"({"Connected":true})";
+    std::promise<std::string> body;
+    pool.request("127.0.0.1", port, request,
+                 [&](const atom::web::PooledResponse &response) {
+                     body.set_value(response.body);
+                 });
+    EXPECT_EQ(body.get_future().get(), request.body);
+}
+
+TEST_F(HttpConnectionPoolTest, ReportsConnectionErrors) {
+    atom::web::HttpConnectionPool pool;
+    auto response = pool.get("http://127.0.0.1:1/").get();
+    EXPECT_FALSE(response.ok());
+}
+
+TEST(HttpConnectionPoolRetryTest, RetriesGetClosedBeforeAnswer) {
+    ScriptedServer server(answerFirst(""));
+    atom::web::HttpConnectionPool pool;
+    ASSERT_TRUE(pool.request("127.0.0.1", server.port, {}).get().ok());
+    auto response = pool.request("127.0.0.1", server.port, {}).get();
+    ASSERT_TRUE(response.ok()) << response.error;
+    EXPECT_EQ(response.body, "ok");
+    EXPECT_EQ(server.requests, 3);
+    EXPECT_EQ(pool.stats().retried, 1u);
+}
+
+TEST(HttpConnectionPoolRetryTest, NeverRetriesAfterTimeout) {
+    ScriptedServer server(answerFirst(std::nullopt));
+    atom::web::HttpConnectionPool pool;
+    ASSERT_TRUE(pool.request("127.0.0.1", server.port, {}).get().ok());
+    atom::web::PooledRequest request;
+    request.timeout = std::chrono::milliseconds(100);
+    auto response = pool.request("127.0.0.1", server.port, request).get();
+    EXPECT_FALSE(response.ok());
+    EXPECT_EQ(server.requests, 2);
+    EXPECT_EQ(pool.stats().retried, 0u);
+}
+
+TEST(HttpConnectionPoolRetryTest, NeverRetriesPartialResponse) {
+    ScriptedServer server(answerFirst("HTTP/1.1 200 OK\r\nContent-Len"));
+    atom::web::HttpConnectionPool pool;
+    ASSERT_TRUE(pool.request("127.0.0.1", server.port, {}).get().ok());
+    atom::web::PooledRequest request;
+    request.timeout = std::chrono::milliseconds(200);
+    EXPECT_FALSE(pool.request("127.0.0.1", server.port, request).get().ok());
+    EXPECT_EQ(server.requests, 2);
+}
+
+TEST(HttpConnectionPoolRetryTest, RetriesWritesOnlyWhenAsked) {
+    ScriptedServer server([](int n) -> std::optional<std::string> {
+        return n == 1 || n == 3 ? "" : kOk;
+    });
+    atom::web::HttpConnectionPool pool;
+    ASSERT_TRUE(pool.request("127.0.0.1", server.port, {}).get().ok());
+    atom::web::PooledRequest request;
+    request.method = "PUT";
+    request.body = "Connected=True";
+    EXPECT_FALSE(pool.request("127.0.0.1", server.port, request).get().ok());
+    EXPECT_EQ(server.requests, 2);
+
+    ASSERT_TRUE(pool.request("127.0.0.1", server.port, {}).get().ok());
+    request.retry_writes = true;
+    auto response = pool.request("127.0.0.1", server.port, request).get();
+    EXPECT_TRUE(response.ok()) << response.error;
+    EXPECT_EQ(server.requests, 5);
+}
+
+TEST(HttpConnectionPoolRetryTest, BusyHostDoesNotStarveOthers) {
+    ScriptedServer slow([](int) -> std::optional<std::string> {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return kOk;
+    });
+    ScriptedServer fast([](int) -> std::optional<std::string> {
+        return kOk;
+    });
+    atom::web::HttpConnectionPool::Options options;
+    options.worker_threads = 1;
+    options.max_connections_per_host = 1;
+    options.max_pipeline_depth = 1;
+    atom::web::HttpConnectionPool pool(options);
+
+    std::vector<std::shared_future<atom::web::PooledResponse>> busy;
+    for (int i = 0; i < 10; ++i) {
+        atom::web::PooledRequest request;
+        request.target = "/" + std::to_string(i);
+        busy.push_back(pool.request("127.0.0.1", slow.port, request));
+    }
+    ASSERT_TRUE(pool.request("127.0.0.1", fast.port, {}).get().ok());
+    // The other host was served between two round trips of the busy one.
+    EXPECT_LT(slow.requests, 10);
+    for (auto &response : busy) {
+        EXPECT_TRUE(response.get().ok());
+    }
+}
+
+TEST(HttpConnectionPoolUrlTest, SplitsUrls) {
+    std::string host;
+    std::string target;
+    int port = 0;
+    ASSERT_TRUE(atom::web::HttpConnectionPool::splitUrl(
+        "http://192.168.1.5:11111/api/v1/camera/0/ccdtemperature", host, port,
+        target));
+    EXPECT_EQ(host, "192.168.1.5");
+    EXPECT_EQ(port, 11111);
+    EXPECT_EQ(target, "/api/v1/camera/0/ccdtemperature");
+
+    ASSERT_TRUE(atom::web::HttpConnectionPool::splitUrl("http://[::1]?a=1",
+                                                        host, port, target));
+    EXPECT_EQ(host, "::1");
+    EXPECT_EQ(port, 80);
+    EXPECT_EQ(target, "/?a=1");
+
+    EXPECT_FALSE(atom::web::HttpConnectionPool::splitUrl("https://host/",
+                                                         host, port, target));
+}
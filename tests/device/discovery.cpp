@@ -0,0 +1,187 @@
+#include "device/discovery.hpp"
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+#include "cpp_httplib/httplib.h"
+
+using namespace std::chrono_literals;
+
+class AlpacaDiscoveryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        server.Get("/management/v1/configureddevices",
+                   [this](const httplib::Request &, httplib::Response &res) {
+                       ++listings;
+                       res.set_content(
+                           R"({"Value":[)"
+                           R"({"DeviceName":"Sim Camera",)"
+                           R"("DeviceType":"Camera",)"
+                           R"("DeviceNumber":0,"UniqueID":"c0"},)"
+                           R"({"DeviceName":"Sim Focuser",)"
+                           R"("DeviceType":"Focuser",)"
+                           R"("DeviceNumber":0,"UniqueID":"f0"}],)"
+                           R"("ClientTransactionID":0,"ServerTransactionID":1,)"
+                           R"("ErrorNumber":0,"ErrorMessage":""})",
+                           "application/json");
+                   });
+        httpPort = server.bind_to_any_port("127.0.0.1");
+        httpThread = std::thread([this] { server.listen_after_bind(); });
+        server.wait_until_ready();
+
+        // 本地 UDP 响应者，代替局域网里的 Alpaca 服务器
+        udp = ::socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(::bind(udp, reinterpret_cast<sockaddr *>(&addr),
+                         sizeof(addr)),
+                  0);
+        socklen_t length = sizeof(addr);
+        ::getsockname(udp, reinterpret_cast<sockaddr *>(&addr), &length);
+        udpPort = ntohs(addr.sin_port);
+        responder = std::thread([this] {
+            while (running) {
+                pollfd pfd{udp, POLLIN, 0};
+                if (::poll(&pfd, 1, 20) <= 0) {
+                    continue;
+                }
+                char buffer[64];
+                sockaddr_in from{};
+                socklen_t fromLength = sizeof(from);
+                auto got = ::recvfrom(udp, buffer, sizeof(buffer), 0,
+                                      reinterpret_cast<sockaddr *>(&from),
+                                      &fromLength);
+                if (got > 0 && std::string(buffer, got) == "alpacadiscovery1") {
+                    ++probes;
+                    auto reply = R"({"AlpacaPort":)" +
+                                 std::to_string(httpPort) + "}";
+                    ::sendto(udp, reply.data(), reply.size(), 0,
+                             reinterpret_cast<sockaddr *>(&from), fromLength);
+                }
+            }
+        });
+    }
+
+    void TearDown() override {
+        running = false;
+        responder.join();
+        ::close(udp);
+        server.stop();
+        httpThread.join();
+    }
+
+    lithium::AlpacaDiscovery::Options options() const {
+        lithium::AlpacaDiscovery::Options options;
+        options.port = udpPort;
+        options.ipv6 = false;
+        options.interval = 100ms;
+        options.ttl = 1s;
+        return options;
+    }
+
+    template <typename Predicate>
+    static bool waitFor(Predicate predicate) {
+        for (int i = 0; i < 200 && !predicate(); ++i) {
+            std::this_thread::sleep_for(10ms);
+        }
+        return predicate();
+    }
+
+    httplib::Server server;
+    std::thread httpThread;
+    int httpPort = 0;
+    int udp = -1;
+    int udpPort = 0;
+    std::thread responder;
+    std::atomic<bool> running{true};
+    std::atomic<int> probes{0};
+    std::atomic<int> listings{0};
+};
+
+TEST_F(AlpacaDiscoveryTest, CachesRespondersAndTheirDevices) {
+    lithium::AlpacaDiscovery discovery(options());
+    EXPECT_TRUE(discovery.devices().empty());
+    ASSERT_TRUE(discovery.start());
+
+    ASSERT_TRUE(waitFor([&] { return discovery.devices().size() == 2; }));
+    auto cameras = discovery.devices("camera");
+    ASSERT_EQ(cameras.size(), 1u);
+    EXPECT_EQ(cameras[0]["DeviceName"], "Sim Camera");
+    EXPECT_EQ(cameras[0]["address"],
+              "127.0.0.1:" + std::to_string(httpPort));
+
+    auto servers = discovery.servers();
+    ASSERT_EQ(servers.size(), 1u);
+    EXPECT_EQ(servers[0].port, httpPort);
+
+    // 重复的响应直接命中缓存，不会每次都重新获取设备列表
+    int seen = probes;
+    ASSERT_TRUE(waitFor([&] { return probes >= seen + 2; }));
+    EXPECT_EQ(listings, 1);
+    discovery.stop();
+}
+
+TEST_F(AlpacaDiscoveryTest, ProbeOnDemandAndExpiry) {
+    auto opts = options();
+    opts.interval = 10s;
+    opts.ttl = 300ms;
+    lithium::AlpacaDiscovery discovery(opts);
+    ASSERT_TRUE(discovery.start());
+    ASSERT_TRUE(waitFor([&] { return probes >= 1; }));
+    ASSERT_TRUE(waitFor([&] { return discovery.devices().size() == 2; }));
+
+    discovery.probe();
+    ASSERT_TRUE(waitFor([&] { return probes >= 2; }));
+
+    // 没有新的探测时，服务器在 ttl 之后从缓存中移除
+    ASSERT_TRUE(waitFor([&] { return discovery.servers().empty(); }));
+    EXPECT_TRUE(discovery.devices().empty());
+}
+
+TEST(AlpacaDiscoveryResponseTest, IgnoresInvalidResponses) {
+    lithium::AlpacaDiscovery discovery;
+    discovery.handleResponse("10.0.0.1", "not json");
+    discovery.handleResponse("10.0.0.1", R"({"AlpacaPort":0})");
+    discovery.handleResponse("10.0.0.1", R"({"Other":1})");
+    EXPECT_TRUE(discovery.servers().empty());
+
+    discovery.handleResponse("fe80::1", R"({"AlpacaPort":11111})");
+    auto servers = discovery.servers();
+    ASSERT_EQ(servers.size(), 1u);
+    EXPECT_EQ(servers[0].address(), "[fe80::1]:11111");
+}
+
+TEST_F(AlpacaDiscoveryTest, ProbeWhileStopping) {
+    lithium::AlpacaDiscovery discovery(options());
+    std::atomic<bool> probing{true};
+    std::thread prober([&] {
+        while (probing) {
+            discovery.probe();
+        }
+    });
+    // 管道在 stop() 中关闭时 probe() 不能写入已关闭的描述符
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_TRUE(discovery.start());
+        std::this_thread::sleep_for(1ms);
+        discovery.stop();
+    }
+    probing = false;
+    prober.join();
+}
+
+TEST(AlpacaDiscoveryResponseTest, KeepsLinkLocalScope) {
+    lithium::AlpacaDiscovery discovery;
+    discovery.handleResponse("fe80::1%eth0", R"({"AlpacaPort":11111})");
+    auto servers = discovery.servers();
+    ASSERT_EQ(servers.size(), 1u);
+    EXPECT_EQ(servers[0].host, "fe80::1%eth0");
+    EXPECT_EQ(servers[0].address(), "[fe80::1%eth0]:11111");
+}
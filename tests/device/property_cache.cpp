@@ -0,0 +1,199 @@
+#include "device/property_cache.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(DevicePropertyCacheTest, ServesFreshValuesAndExpiresOldOnes) {
+    lithium::DevicePropertyCache::Options options;
+    options.max_age = 50ms;
+    lithium::DevicePropertyCache cache(options);
+
+    EXPECT_FALSE(cache.get("CCD", "CCD_TEMPERATURE").has_value());
+    cache.update("CCD", "CCD_TEMPERATURE", -10.5);
+    ASSERT_TRUE(cache.get("CCD", "CCD_TEMPERATURE").has_value());
+    EXPECT_EQ(*cache.get("CCD", "CCD_TEMPERATURE"), -10.5);
+
+    std::this_thread::sleep_for(80ms);
+    EXPECT_FALSE(cache.get("CCD", "CCD_TEMPERATURE").has_value());
+    EXPECT_TRUE(cache.get("CCD", "CCD_TEMPERATURE", 1s).has_value());
+    EXPECT_TRUE(cache.entry("CCD", "CCD_TEMPERATURE").has_value());
+
+    cache.update("CCD", "CCD_TEMPERATURE", -11.0);
+    cache.invalidate("CCD");
+    EXPECT_FALSE(cache.get("CCD", "CCD_TEMPERATURE").has_value());
+    EXPECT_EQ(cache.snapshot("CCD")["CCD_TEMPERATURE"], -11.0);
+}
+
+TEST(DevicePropertyCacheTest, NotifiesOnlyOnChange) {
+    lithium::DevicePropertyCache cache;
+    std::vector<lithium::PropertyChange> changes;
+    cache.setNotifier([&](const lithium::PropertyChange &change) {
+        changes.push_back(change);
+    });
+    cache.update("Focuser", "ABS_FOCUS_POSITION", 1000);
+    cache.update("Focuser", "ABS_FOCUS_POSITION", 1000);
+    cache.update("Focuser", "ABS_FOCUS_POSITION", 1200);
+    ASSERT_EQ(changes.size(), 2u);
+    EXPECT_EQ(changes[1].device, "Focuser");
+    EXPECT_EQ(changes[1].value, 1200);
+}
+
+TEST(DevicePropertyCacheTest, ConcurrentReadsShareOneFetch) {
+    lithium::DevicePropertyCache cache;
+    std::atomic<int> fetches{0};
+    auto slowFetch = [&] {
+        ++fetches;
+        std::this_thread::sleep_for(100ms);
+        return json(42);
+    };
+    std::vector<std::thread> readers;
+    std::atomic<int> correct{0};
+    for (int i = 0; i < 8; ++i) {
+        readers.emplace_back([&] {
+            if (cache.getOrFetch("Mount", "RA", slowFetch) == 42) {
+                ++correct;
+            }
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(correct, 8);
+    EXPECT_EQ(fetches, 1);
+    EXPECT_EQ(cache.getOrFetch("Mount", "RA", slowFetch), 42);
+    EXPECT_EQ(fetches, 1);
+}
+
+TEST(DevicePropertyCacheTest, FailedFetchPropagatesToWaiters) {
+    lithium::DevicePropertyCache cache;
+    EXPECT_THROW(cache.getOrFetch("Mount", "DEC",
+                                  []() -> json {
+                                      throw std::runtime_error("timeout");
+                                  }),
+                 std::runtime_error);
+    EXPECT_EQ(cache.getOrFetch("Mount", "DEC", [] { return json(1); }), 1);
+}
+
+TEST(DevicePropertyCacheTest, CoalescesWritesWithinWindow) {
+    lithium::DevicePropertyCache::Options options;
+    options.write_window = 50ms;
+    lithium::DevicePropertyCache cache(options);
+    std::atomic<int> writes{0};
+    json last;
+    std::mutex mutex;
+    cache.setWriter([&](const std::string &, const std::string &,
+                        const json &value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++writes;
+        last = value;
+        return true;
+    });
+    for (int i = 0; i < 20; ++i) {
+        cache.write("CCD", "CCD_GAIN", i);
+    }
+    EXPECT_EQ(cache.pendingWrites(), 1u);
+    std::this_thread::sleep_for(150ms);
+    EXPECT_EQ(writes, 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(last, 19);
+    }
+    EXPECT_EQ(*cache.get("CCD", "CCD_GAIN"), 19);
+
+    cache.write("CCD", "CCD_OFFSET", 10);
+    cache.flush();
+    EXPECT_EQ(writes, 2);
+    EXPECT_EQ(cache.pendingWrites(), 0u);
+}
+
+TEST(DevicePropertyCacheTest, FailedWriteLeavesCacheUntouched) {
+    lithium::DevicePropertyCache cache;
+    cache.update("CCD", "CCD_GAIN", 100);
+    cache.setWriter([](const std::string &, const std::string &,
+                       const json &) { return false; });
+    cache.write("CCD", "CCD_GAIN", 200);
+    cache.flush();
+    EXPECT_EQ(*cache.get("CCD", "CCD_GAIN"), 100);
+
+    cache.write("CCD", "CCD_GAIN", 300);
+    cache.removeDevice("CCD");
+    EXPECT_EQ(cache.pendingWrites(), 0u);
+    EXPECT_FALSE(cache.entry("CCD", "CCD_GAIN").has_value());
+}
+
+TEST(DevicePropertyCacheTest, BatchesNotificationsWithinWindow) {
+    lithium::DevicePropertyCache::Options options;
+    options.notify_window = 30ms;
+    lithium::DevicePropertyCache cache(options);
+
+    std::mutex mutex;
+    std::vector<std::vector<lithium::PropertyChange>> batches;
+    cache.setBatchNotifier(
+        [&](const std::vector<lithium::PropertyChange> &changes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            batches.push_back(changes);
+        });
+
+    // 一次推送中的一串属性只产生一次通知，同一属性只保留最新值
+    for (int i = 0; i < 10; ++i) {
+        cache.update("Mount", "EQUATORIAL_EOD_COORD", i);
+        cache.update("Mount", "TELESCOPE_TRACK_STATE", i % 2 == 0);
+    }
+    EXPECT_EQ(*cache.get("Mount", "EQUATORIAL_EOD_COORD"), 9);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_TRUE(batches.empty());
+    }
+    std::this_thread::sleep_for(80ms);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_EQ(batches.size(), 1u);
+        ASSERT_EQ(batches[0].size(), 2u);
+        EXPECT_EQ(batches[0][0].property, "EQUATORIAL_EOD_COORD");
+        EXPECT_EQ(batches[0][0].value, 9);
+    }
+
+    cache.update("Mount", "EQUATORIAL_EOD_COORD", 10);
+    cache.flush();
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(batches.size(), 2u);
+    EXPECT_EQ(batches[1][0].value, 10);
+}
+
+TEST(DevicePropertyCacheTest, StopCommitsPendingWritesAndStopsBatching) {
+    lithium::DevicePropertyCache::Options options;
+    options.write_window = 10s;
+    options.notify_window = 10s;
+    lithium::DevicePropertyCache cache(options);
+    std::vector<json> writes;
+    size_t notifications = 0;
+    cache.setWriter([&](const std::string &, const std::string &,
+                        const json &value) {
+        writes.push_back(value);
+        return true;
+    });
+    cache.setBatchNotifier(
+        [&](const std::vector<lithium::PropertyChange> &changes) {
+            notifications += changes.size();
+        });
+
+    cache.write("CCD", "CCD_GAIN", 1);
+    cache.stop();
+    ASSERT_EQ(writes.size(), 1u);
+    EXPECT_EQ(notifications, 1u);
+
+    // 停止后不再合并，也不再依赖后台线程
+    cache.write("CCD", "CCD_GAIN", 2);
+    EXPECT_EQ(writes.size(), 2u);
+    EXPECT_EQ(notifications, 2u);
+    EXPECT_EQ(cache.pendingWrites(), 0u);
+
+    cache.setWriter({});
+    cache.write("CCD", "CCD_GAIN", 3);
+    EXPECT_EQ(writes.size(), 2u);
+    EXPECT_EQ(*cache.get("CCD", "CCD_GAIN"), 2);
+}
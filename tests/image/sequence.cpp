@@ -0,0 +1,153 @@
+#include "sequence.hpp"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace {
+constexpr size_t FRAME_COUNT = 5;
+
+SequenceInfo testInfo(uint32_t bit_depth) {
+    SequenceInfo info;
+    // odd sizes so no frame ends on an I/O block boundary
+    info.width = 13;
+    info.height = 7;
+    info.bit_depth = bit_depth;
+    info.color = SerColorId::BAYER_RGGB;
+    info.observer = "observer";
+    info.instrument = "instrument";
+    info.telescope = "telescope";
+    return info;
+}
+
+std::vector<uint8_t> testFrame(const SequenceInfo& info, size_t index) {
+    std::vector<uint8_t> frame(info.frameBytes());
+    for (size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = static_cast<uint8_t>(i * 7 + index * 31);
+    }
+    return frame;
+}
+
+class SequenceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // parameterised test names contain '/'
+        std::string name =
+            ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        std::replace(name.begin(), name.end(), '/', '_');
+        path = fs::temp_directory_path() / ("lithium_sequence_" + name);
+    }
+
+    void TearDown() override { fs::remove(path); }
+
+    fs::path path;
+};
+
+class SequenceRoundTripTest
+    : public SequenceTest,
+      public ::testing::WithParamInterface<std::tuple<SequenceFormat, bool>> {
+};
+}  // namespace
+
+TEST_P(SequenceRoundTripTest, FramesTimestampsAndHeaderSurvive) {
+    auto [format, direct] = GetParam();
+    auto info = testInfo(12);
+    SequenceWriter::Options options;
+    options.format = format;
+    options.direct_io = direct;
+    options.expected_frames = 100;
+    // small enough that the frames span several flushes
+    options.buffer_size = 4096;
+
+    const auto start = std::chrono::system_clock::time_point(
+        std::chrono::seconds(1719700000));
+    SequenceWriter writer;
+    ASSERT_TRUE(writer.open(path, info, options));
+    for (size_t i = 0; i < FRAME_COUNT; ++i) {
+        auto frame = testFrame(info, i);
+        ASSERT_TRUE(writer.write(frame.data(), frame.size(),
+                                 start + i * 40ms + 100us));
+    }
+    EXPECT_EQ(writer.frameCount(), FRAME_COUNT);
+    ASSERT_TRUE(writer.close());
+
+    // preallocation must not leave space past the end of the data
+    auto expected_size = FRAME_COUNT * (info.frameBytes() + 8) +
+                         (format == SequenceFormat::SER ? 178 : 64 + 16);
+    EXPECT_EQ(fs::file_size(path), expected_size);
+
+    SequenceReader reader;
+    ASSERT_TRUE(reader.open(path));
+    EXPECT_EQ(reader.format(), format);
+    ASSERT_EQ(reader.frameCount(), FRAME_COUNT);
+    EXPECT_EQ(reader.info().width, info.width);
+    EXPECT_EQ(reader.info().height, info.height);
+    EXPECT_EQ(reader.info().bit_depth, info.bit_depth);
+    EXPECT_EQ(reader.info().color, info.color);
+    if (format == SequenceFormat::SER) {
+        EXPECT_EQ(reader.info().observer, info.observer);
+        EXPECT_EQ(reader.info().instrument, info.instrument);
+        EXPECT_EQ(reader.info().telescope, info.telescope);
+    }
+    for (size_t i = 0; i < FRAME_COUNT; ++i) {
+        auto expected = testFrame(info, i);
+        auto data = reader.frameData(i);
+        ASSERT_EQ(data.size(), expected.size());
+        EXPECT_EQ(std::memcmp(data.data(), expected.data(), data.size()), 0)
+            << "frame " << i;
+        EXPECT_EQ(reader.timestamp(i), start + i * 40ms + 100us)
+            << "frame " << i;
+    }
+    EXPECT_TRUE(reader.frameData(FRAME_COUNT).empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Formats, SequenceRoundTripTest,
+    ::testing::Combine(::testing::Values(SequenceFormat::SER,
+                                         SequenceFormat::RAW),
+                       ::testing::Bool()));
+
+TEST_F(SequenceTest, RejectsFramesOfTheWrongSize) {
+    auto info = testInfo(8);
+    SequenceWriter writer;
+    ASSERT_TRUE(writer.open(path, info));
+    std::vector<uint8_t> frame(info.frameBytes() - 1);
+    EXPECT_FALSE(writer.write(frame.data(), frame.size(),
+                              std::chrono::system_clock::now()));
+    EXPECT_EQ(writer.frameCount(), 0u);
+}
+
+TEST_F(SequenceTest, StacksFrameByFrame) {
+    SequenceInfo info;
+    info.width = 4;
+    info.height = 3;
+    SequenceWriter writer;
+    ASSERT_TRUE(writer.open(path, info));
+    for (uint8_t value : {10, 40, 20, 30}) {
+        std::vector<uint8_t> frame(info.frameBytes(), value);
+        ASSERT_TRUE(writer.write(frame.data(), frame.size(),
+                                 std::chrono::system_clock::now()));
+    }
+    ASSERT_TRUE(writer.close());
+
+    auto mean = stackSequence(path, MEAN);
+    ASSERT_FALSE(mean.empty());
+    EXPECT_EQ(mean.depth(), CV_8U);
+    EXPECT_EQ(mean.at<uint8_t>(2, 3), 25);
+
+    auto maximum = stackSequence(path, MAXIMUM);
+    ASSERT_FALSE(maximum.empty());
+    EXPECT_EQ(maximum.at<uint8_t>(1, 1), 40);
+
+    auto minimum = stackSequence(path, MINIMUM, 2.0, 1);
+    ASSERT_FALSE(minimum.empty());
+    EXPECT_EQ(minimum.at<uint8_t>(0, 0), 10);
+}
@@ -0,0 +1,281 @@
+#include "indiclient.hpp"
+#include <gtest/gtest.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+constexpr const char *DEFINITIONS =
+    "<defSwitchVector device=\"CCD Simulator\" name=\"CONNECTION\" "
+    "label=\"Connection\" group=\"Main Control\" state=\"Idle\" perm=\"rw\" "
+    "rule=\"OneOfMany\" timeout=\"60\">\n"
+    "  <defSwitch name=\"CONNECT\" label=\"Connect\">\nOff\n</defSwitch>\n"
+    "  <defSwitch name=\"DISCONNECT\" label=\"Disconnect\">\nOn\n"
+    "</defSwitch>\n</defSwitchVector>\n"
+    "<defNumberVector device=\"CCD Simulator\" name=\"CCD_TEMPERATURE\" "
+    "label=\"Temperature\" group=\"Main Control\" state=\"Ok\" perm=\"rw\">\n"
+    "  <defNumber name=\"CCD_TEMPERATURE_VALUE\" label=\"Temperature (C)\" "
+    "format=\"%5.2f\" min=\"-50\" max=\"50\" step=\"0\">\n-10\n</defNumber>\n"
+    "</defNumberVector>\n"
+    "<defTextVector device=\"CCD Simulator\" name=\"DRIVER_INFO\" "
+    "state=\"Idle\" perm=\"ro\">\n"
+    "  <defText name=\"DRIVER_NAME\">CCD &amp; Guider Simulator</defText>\n"
+    "</defTextVector>\n"
+    "<message device=\"CCD Simulator\" message=\"ready\"/>\n";
+
+// 模拟 indiserver：发送属性定义，把 new*Vector 作为 set*Vector 回送
+class MockINDIServer {
+public:
+    MockINDIServer() {
+        m_listen = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::bind(m_listen, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        ::listen(m_listen, 4);
+        socklen_t length = sizeof(addr);
+        ::getsockname(m_listen, reinterpret_cast<sockaddr *>(&addr), &length);
+        port = ntohs(addr.sin_port);
+        m_thread = std::thread([this] { run(); });
+    }
+
+    ~MockINDIServer() {
+        m_running = false;
+        m_thread.join();
+        ::close(m_listen);
+    }
+
+    void push(const std::string &xml) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_outgoing += xml;
+    }
+
+    std::string received() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_received;
+    }
+
+    void dropClient() { m_drop = true; }
+
+    int port = 0;
+    std::atomic<int> connections{0};
+
+private:
+    void run() {
+        while (m_running) {
+            pollfd pfd{m_listen, POLLIN, 0};
+            if (::poll(&pfd, 1, 20) <= 0) {
+                continue;
+            }
+            int client = ::accept(m_listen, nullptr, nullptr);
+            ++connections;
+            serve(client);
+            ::close(client);
+        }
+    }
+
+    void serve(int client) {
+        bool defined = false;
+        while (m_running && !m_drop.exchange(false)) {
+            std::string out;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                out.swap(m_outgoing);
+            }
+            if (!out.empty()) {
+                ::send(client, out.data(), out.size(), MSG_NOSIGNAL);
+            }
+            pollfd pfd{client, POLLIN, 0};
+            if (::poll(&pfd, 1, 10) <= 0) {
+                continue;
+            }
+            char buffer[4096];
+            auto got = ::recv(client, buffer, sizeof(buffer), 0);
+            if (got <= 0) {
+                return;
+            }
+            std::string in(buffer, got);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_received += in;
+            }
+            if (!defined && in.find("<getProperties") != std::string::npos) {
+                // 分成很小的片段发送，检验解析器跨读取边界的处理
+                std::string defs = DEFINITIONS;
+                for (size_t i = 0; i < defs.size(); i += 7) {
+                    auto part = defs.substr(i, 7);
+                    ::send(client, part.data(), part.size(), MSG_NOSIGNAL);
+                }
+                defined = true;
+            }
+            if (auto pos = in.find("<newNumberVector");
+                pos != std::string::npos) {
+                auto reply = in.substr(pos);
+                reply.replace(1, 3, "set");
+                reply.replace(reply.find("</newNumberVector>") + 2, 3, "set");
+                ::send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+            }
+        }
+    }
+
+    int m_listen = -1;
+    std::thread m_thread;
+    std::atomic<bool> m_running{true};
+    std::atomic<bool> m_drop{false};
+    std::mutex m_mutex;
+    std::string m_outgoing;
+    std::string m_received;
+};
+}  // namespace
+
+TEST(INDIXmlParserTest, ParsesElementsAcrossReads) {
+    std::vector<INDIXmlElement> elements;
+    INDIXmlParser parser(
+        [&](const INDIXmlElement &element) { elements.push_back(element); });
+
+    std::string xml =
+        "<?xml version=\"1.0\"?><!-- comment -->"
+        "<setTextVector device='A' name=\"T\" state=\"Ok\">"
+        "<oneText name=\"X\">a &lt;b&gt; &#65;&amp;c</oneText>"
+        "</setTextVector><delProperty device=\"A\"/>";
+    for (char c : xml) {
+        ASSERT_TRUE(parser.feed(std::string_view(&c, 1)));
+    }
+    ASSERT_EQ(elements.size(), 2u);
+    EXPECT_EQ(elements[0].tag, "setTextVector");
+    EXPECT_EQ(elements[0].attribute("device"), "A");
+    ASSERT_EQ(elements[0].children.size(), 1u);
+    EXPECT_EQ(elements[0].children[0].text, "a <b> A&c");
+    EXPECT_EQ(elements[1].tag, "delProperty");
+
+    EXPECT_FALSE(parser.feed("<a></b>"));
+}
+
+TEST(INDIXmlParserTest, DecodesCharacterReferencesToUtf8) {
+    std::vector<INDIXmlElement> elements;
+    INDIXmlParser parser(
+        [&](const INDIXmlElement &element) { elements.push_back(element); });
+
+    ASSERT_TRUE(parser.feed(
+        "<message message=\"&#xE9;&#8364;&#x1F52D;&#x110000;\"/>"));
+    ASSERT_EQ(elements.size(), 1u);
+    // 2、3、4 字节的编码，超出 Unicode 范围的引用原样保留
+    EXPECT_EQ(elements[0].attribute("message"),
+              "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x94\xAD&#x110000;");
+}
+
+TEST(INDIClientTest, AnswersFromThePropertyTree) {
+    MockINDIServer server;
+    INDIClient client("127.0.0.1", server.port);
+    ASSERT_TRUE(client.connect());
+
+    EXPECT_EQ(client.getValue("CCD Simulator", "CCD_TEMPERATURE",
+                              "CCD_TEMPERATURE_VALUE"),
+              "-10");
+    EXPECT_EQ(client.getState("CCD Simulator", "CCD_TEMPERATURE"), "Ok");
+    EXPECT_EQ(client.getValue("CCD Simulator", "DRIVER_INFO", "DRIVER_NAME"),
+              "CCD & Guider Simulator");
+    EXPECT_FALSE(client.getValue("CCD Simulator", "MISSING", "X", 50ms));
+
+    // 属性更新增量地合并到属性树中
+    server.push(
+        "<setSwitchVector device=\"CCD Simulator\" name=\"CONNECTION\" "
+        "state=\"Ok\"><oneSwitch name=\"CONNECT\">On</oneSwitch>"
+        "<oneSwitch name=\"DISCONNECT\">Off</oneSwitch></setSwitchVector>");
+    for (int i = 0; i < 100 &&
+                    client.getValue("CCD Simulator", "CONNECTION", "CONNECT") !=
+                        "On";
+         ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    auto devices = client.devices();
+    ASSERT_EQ(devices.size(), 1u);
+    EXPECT_EQ(devices["CCD Simulator"]["CONNECTION"].elements["CONNECT"],
+              "On");
+    EXPECT_EQ(devices["CCD Simulator"]["CONNECTION"].state, "Ok");
+
+    server.push("<delProperty device=\"CCD Simulator\" name=\"DRIVER_INFO\"/>");
+    for (int i = 0; i < 100 && client.devices()["CCD Simulator"].contains(
+                                   "DRIVER_INFO");
+         ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_FALSE(client.devices()["CCD Simulator"].contains("DRIVER_INFO"));
+}
+
+TEST(INDIClientTest, SetsValuesWithOneMessage) {
+    MockINDIServer server;
+    INDIClient client("127.0.0.1", server.port);
+    ASSERT_TRUE(client.connect());
+
+    EXPECT_FALSE(client.setValue("CCD Simulator", "DRIVER_INFO", "DRIVER_NAME",
+                                 "x"));
+    EXPECT_FALSE(client.setValue("CCD Simulator", "CCD_TEMPERATURE", "NOPE",
+                                 "1"));
+    ASSERT_TRUE(client.setValue("CCD Simulator", "CCD_TEMPERATURE",
+                                "CCD_TEMPERATURE_VALUE", "-20"));
+    for (int i = 0; i < 100 && client.getValue("CCD Simulator",
+                                               "CCD_TEMPERATURE",
+                                               "CCD_TEMPERATURE_VALUE") !=
+                                   "-20";
+         ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_EQ(client.getValue("CCD Simulator", "CCD_TEMPERATURE",
+                              "CCD_TEMPERATURE_VALUE"),
+              "-20");
+    EXPECT_NE(server.received().find(
+                  "<oneNumber name=\"CCD_TEMPERATURE_VALUE\">-20</oneNumber>"),
+              std::string::npos);
+}
+
+TEST(INDIClientTest, ReconnectsAfterTheServerDropsTheConnection) {
+    MockINDIServer server;
+    INDIClient client("127.0.0.1", server.port);
+    ASSERT_TRUE(client.connect());
+    ASSERT_TRUE(client.getState("CCD Simulator", "CONNECTION"));
+
+    server.dropClient();
+    for (int i = 0; i < 100 && client.isConnected(); ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_FALSE(client.isConnected());
+    EXPECT_TRUE(client.devices().empty());
+
+    // 下一次读取重新连接并重新获取属性
+    EXPECT_EQ(client.getState("CCD Simulator", "CCD_TEMPERATURE"), "Ok");
+    EXPECT_EQ(server.connections, 2);
+}
+
+TEST(INDIClientTest, SendsWhileReconnecting) {
+    MockINDIServer server;
+    INDIClient client("127.0.0.1", server.port);
+    ASSERT_TRUE(client.connect());
+    ASSERT_TRUE(client.getState("CCD Simulator", "CCD_TEMPERATURE"));
+
+    // 断开时关闭套接字与其他线程中的写入互斥
+    std::atomic<bool> sending{true};
+    std::thread writer([&] {
+        while (sending) {
+            client.setValue("CCD Simulator", "CCD_TEMPERATURE",
+                            "CCD_TEMPERATURE_VALUE", "-10");
+        }
+    });
+    for (int i = 0; i < 5; ++i) {
+        client.disconnect();
+        ASSERT_TRUE(client.connect());
+        std::this_thread::sleep_for(10ms);
+    }
+    sending = false;
+    writer.join();
+}
@@ -0,0 +1,382 @@
+#include "solve_service.hpp"
+#include <gtest/gtest.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace {
+// 模拟 ASTAP：图像内容决定行为，写出 .ini 结果
+constexpr const char *FAKE_ASTAP = R"(#!/bin/sh
+log="@LOG@"
+echo "start" >> "$log"
+echo "args $*" >> "$log"
+image=""; out=""; hinted=0
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -f) image="$2"; shift ;;
+        -o) out="$2"; shift ;;
+        -ra) hinted=1; shift ;;
+    esac
+    shift
+done
+content=$(cat "$image")
+case "$content" in
+    *hang*) sleep 10 ;;
+    *slow*) sleep 0.3 ;;
+esac
+echo "end" >> "$log"
+case "$content" in
+    *nosolve*) hinted=1 ;;
+    *blindonly*) ;;
+    *) hinted=0 ;;
+esac
+if [ $hinted = 1 ]; then
+    printf 'PLTSOLVD=F\nERROR=No solution found\n' > "$out.ini"
+    exit 1
+fi
+printf 'PLTSOLVD=T\nCRVAL1=83.8\nCRVAL2=-5.4\n' > "$out.ini"
+printf 'CDELT1=-0.000277778\nCDELT2=0.000277778\nCROTA2=12.5\n' >> "$out.ini"
+)";
+
+// 模拟 solve-field：保存收到的星表，写出 .wcs 结果
+constexpr const char *FAKE_ASTROMETRY = R"(#!/bin/sh
+log="@LOG@"
+echo "args $*" >> "$log"
+input="$1"; shift
+dir=""; out=""
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --dir) dir="$2"; shift ;;
+        --out) out="$2"; shift ;;
+    esac
+    shift
+done
+cp "$input" "@COPY@"
+card() { printf '%-80s' "$1"; }
+{
+    card "SIMPLE  =                    T"
+    card "CRVAL1  =                 10.5 / RA"
+    card "CRVAL2  =                 41.2"
+    card "CD1_1   =              -0.0005"
+    card "CD1_2   =                  0.0"
+    card "CD2_1   =                  0.0"
+    card "CD2_2   =               0.0005"
+    card "END"
+} > "$dir/$out.wcs"
+)";
+}  // namespace
+
+class SolveServiceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir = fs::temp_directory_path() /
+              ("solve-service-test-" + std::to_string(::getpid()));
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        log = dir / "solver.log";
+    }
+
+    void TearDown() override { fs::remove_all(dir); }
+
+    std::string script(std::string text, const std::string &name) {
+        auto replace = [&](const std::string &from, const std::string &to) {
+            for (auto pos = text.find(from); pos != std::string::npos;
+                 pos = text.find(from)) {
+                text.replace(pos, from.size(), to);
+            }
+        };
+        replace("@LOG@", log.string());
+        replace("@COPY@", (dir / "received.xyls").string());
+        auto path = dir / name;
+        std::ofstream(path) << text;
+        ::chmod(path.c_str(), 0755);
+        return path.string();
+    }
+
+    std::string image(const std::string &name, const std::string &content) {
+        auto path = dir / name;
+        std::ofstream(path) << content;
+        return path.string();
+    }
+
+    SolveService::Options options(SolverKind kind = SolverKind::Astap) {
+        SolveService::Options options;
+        options.kind = kind;
+        options.solver_path = kind == SolverKind::Astap
+                                  ? script(FAKE_ASTAP, "astap")
+                                  : script(FAKE_ASTROMETRY, "solve-field");
+        options.work_dir = dir / "work";
+        return options;
+    }
+
+    std::vector<std::string> logLines() const {
+        std::vector<std::string> lines;
+        std::ifstream file(log);
+        for (std::string line; std::getline(file, line);) {
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    std::vector<std::string> commands() const {
+        std::vector<std::string> args;
+        for (const auto &line : logLines()) {
+            if (line.starts_with("args ")) {
+                args.push_back(line.substr(5));
+            }
+        }
+        return args;
+    }
+
+    static SolveRequest request(const std::string &path) {
+        SolveRequest request;
+        request.image = path;
+        request.timeout = 10s;
+        return request;
+    }
+
+    fs::path dir;
+    fs::path log;
+};
+
+TEST_F(SolveServiceTest, CachesSolutionsByImageContent) {
+    SolveService service(options());
+    ASSERT_TRUE(service.start());
+
+    auto path = image("a.fits", "frame a");
+    auto solution = service.solve(request(path));
+    ASSERT_TRUE(solution.solved) << solution.error;
+    EXPECT_FALSE(solution.cached);
+    EXPECT_DOUBLE_EQ(solution.ra, 83.8);
+    EXPECT_DOUBLE_EQ(solution.dec, -5.4);
+    EXPECT_NEAR(solution.scale, 1.0, 1e-3);
+    EXPECT_DOUBLE_EQ(solution.rotation, 12.5);
+
+    // 同一张图像直接从缓存返回，上一次的解作为提示时也是如此
+    auto again = service.solve(request(path));
+    ASSERT_TRUE(again.solved);
+    EXPECT_TRUE(again.cached);
+    EXPECT_EQ(service.statistics().runs, 1u);
+    EXPECT_EQ(service.statistics().cache_hits, 1u);
+
+    // 内容改变后重新求解
+    image("a.fits", "frame a, exposed again");
+    EXPECT_FALSE(service.solve(request(path)).cached);
+    EXPECT_EQ(service.statistics().runs, 2u);
+
+    // 临时文件随每次运行一起删除
+    EXPECT_TRUE(fs::is_empty(dir / "work"));
+}
+
+TEST_F(SolveServiceTest, NarrowsTheSearchAroundHints) {
+    SolveService service(options());
+    ASSERT_TRUE(service.start());
+
+    ASSERT_TRUE(service.solve(request(image("a.fits", "a"))).solved);
+    ASSERT_TRUE(service.solve(request(image("b.fits", "b"))).solved);
+    auto args = commands();
+    ASSERT_EQ(args.size(), 2u);
+    EXPECT_NE(args[0].find("-r 180"), std::string::npos);
+    EXPECT_EQ(args[0].find("-ra"), std::string::npos);
+    // 第二次以第一次的解为中心，半径缩小到 hint_radius
+    EXPECT_NE(args[1].find("-r 5 "), std::string::npos);
+    EXPECT_NE(args[1].find("-ra 5.586666667 -spd 84.6"), std::string::npos);
+    EXPECT_NE(args[1].find("-fov 0"), std::string::npos);
+
+    // 明确的提示优先于上一次的解，不在提示范围内的缓存结果不会使用
+    auto hinted = request(image("a.fits", "a"));
+    hinted.hint.ra = 200;
+    hinted.hint.dec = 40;
+    hinted.hint.radius = 2;
+    EXPECT_FALSE(service.solve(hinted).cached);
+    args = commands();
+    ASSERT_EQ(args.size(), 3u);
+    EXPECT_NE(args[2].find("-r 2 -ra 13.33333333 -spd 130"),
+              std::string::npos);
+
+    hinted.hint.ra = 84;
+    hinted.hint.dec = -5;
+    EXPECT_TRUE(service.solve(hinted).cached);
+    EXPECT_EQ(service.statistics().runs, 3u);
+}
+
+TEST_F(SolveServiceTest, RetriesBlindWhenTheLastSolutionIsStale) {
+    SolveService service(options());
+    ASSERT_TRUE(service.start());
+    ASSERT_TRUE(service.solve(request(image("a.fits", "a"))).solved);
+
+    auto solution = service.solve(request(image("b.fits", "blindonly")));
+    ASSERT_TRUE(solution.solved) << solution.error;
+    auto args = commands();
+    ASSERT_EQ(args.size(), 3u);
+    EXPECT_NE(args[1].find("-ra"), std::string::npos);
+    EXPECT_NE(args[2].find("-r 180"), std::string::npos);
+
+    // 没有解的结果不缓存
+    auto failed = service.solve(request(image("c.fits", "nosolve")));
+    EXPECT_FALSE(failed.solved);
+    EXPECT_EQ(failed.error, "No solution found");
+    EXPECT_FALSE(service.solve(request(image("c.fits", "nosolve"))).cached);
+}
+
+TEST_F(SolveServiceTest, BoundsSolverProcessesAndTheQueue) {
+    auto opts = options();
+    opts.max_processes = 2;
+    opts.max_queue = 3;
+    SolveService service(opts);
+    ASSERT_TRUE(service.start());
+
+    std::vector<std::shared_future<PlateSolution>> results;
+    for (int i = 0; i < 2; ++i) {
+        results.push_back(service.submit(
+            request(image(std::to_string(i) + ".fits",
+                          "slow " + std::to_string(i)))));
+    }
+    for (int i = 0; i < 200 && service.statistics().runs < 2; ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    for (int i = 2; i < 5; ++i) {
+        results.push_back(service.submit(
+            request(image(std::to_string(i) + ".fits",
+                          "slow " + std::to_string(i)))));
+    }
+    EXPECT_EQ(service.statistics().queued, 3u);
+    auto rejected = service.submit(request(image("5.fits", "slow 5"))).get();
+    EXPECT_EQ(rejected.error, "Solve queue is full");
+
+    for (auto &result : results) {
+        EXPECT_TRUE(result.get().solved) << result.get().error;
+    }
+    int running = 0;
+    int peak = 0;
+    for (const auto &line : logLines()) {
+        running += line == "start" ? 1 : line == "end" ? -1 : 0;
+        peak = std::max(peak, running);
+    }
+    EXPECT_EQ(peak, 2);
+}
+
+TEST_F(SolveServiceTest, SharesOneRunBetweenIdenticalRequests) {
+    auto opts = options();
+    opts.max_processes = 2;
+    SolveService service(opts);
+    ASSERT_TRUE(service.start());
+
+    auto path = image("a.fits", "slow");
+    auto first = service.submit(request(path));
+    auto second = service.submit(request(path));
+    ASSERT_TRUE(first.get().solved);
+    ASSERT_TRUE(second.get().solved);
+    EXPECT_NE(first.get().cached, second.get().cached);
+    EXPECT_EQ(service.statistics().runs, 1u);
+}
+
+TEST_F(SolveServiceTest, KillsSolversThatTimeOut) {
+    SolveService service(options());
+    ASSERT_TRUE(service.start());
+
+    auto hung = request(image("a.fits", "hang"));
+    hung.timeout = 1s;
+    auto start = std::chrono::steady_clock::now();
+    auto solution = service.solve(hung);
+    EXPECT_FALSE(solution.solved);
+    EXPECT_EQ(solution.error, "Solver timed out");
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+
+    auto missing = service.solve(request((dir / "missing.fits").string()));
+    EXPECT_FALSE(missing.solved);
+    EXPECT_EQ(service.statistics().runs, 1u);
+}
+
+TEST_F(SolveServiceTest, PassesExtractedStarsToAstrometry) {
+    auto opts = options(SolverKind::Astrometry);
+    opts.max_stars = 15;
+    opts.extractor = [](const std::string &) -> std::optional<StarList> {
+        StarList list;
+        list.width = 640;
+        list.height = 480;
+        for (int i = 0; i < 20; ++i) {
+            list.stars.push_back({i * 10.0, i * 5.0, static_cast<double>(i)});
+        }
+        return list;
+    };
+    SolveService service(opts);
+    ASSERT_TRUE(service.start());
+
+    auto solution = service.solve(request(image("a.fits", "a")));
+    ASSERT_TRUE(solution.solved) << solution.error;
+    EXPECT_TRUE(solution.used_xylist);
+    EXPECT_DOUBLE_EQ(solution.ra, 10.5);
+    EXPECT_DOUBLE_EQ(solution.dec, 41.2);
+    EXPECT_NEAR(solution.scale, 1.8, 1e-9);
+    EXPECT_NEAR(solution.fov_x, 0.32, 1e-9);
+    EXPECT_NEAR(solution.fov_y, 0.24, 1e-9);
+
+    auto args = commands();
+    ASSERT_EQ(args.size(), 1u);
+    EXPECT_NE(args[0].find(".xyls --overwrite"), std::string::npos);
+    EXPECT_NE(args[0].find("--width 640 --height 480 --sort-column FLUX"),
+              std::string::npos);
+
+    // 星表只保留最亮的 max_stars 颗，按亮度降序，坐标从 1 开始
+    std::ifstream file(dir / "received.xyls", std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    ASSERT_EQ(data.size() % 2880, 0u);
+    EXPECT_NE(data.find("XTENSION= 'BINTABLE'"), std::string::npos);
+    EXPECT_NE(data.find("NAXIS2  =                   15"), std::string::npos);
+    uint32_t bits;
+    std::memcpy(&bits, data.data() + 2 * 2880, sizeof(bits));
+    if constexpr (std::endian::native == std::endian::little) {
+        bits = __builtin_bswap32(bits);
+    }
+    EXPECT_FLOAT_EQ(std::bit_cast<float>(bits), 191.0f);
+}
+
+TEST_F(SolveServiceTest, FallsBackToTheImageWithTooFewStars) {
+    auto opts = options(SolverKind::Astrometry);
+    opts.extractor = [](const std::string &) -> std::optional<StarList> {
+        return StarList{640, 480, {{1, 1, 1}, {2, 2, 2}}};
+    };
+    SolveService service(opts);
+    ASSERT_TRUE(service.start());
+
+    auto path = image("a.fits", "a");
+    auto solution = service.solve(request(path));
+    ASSERT_TRUE(solution.solved);
+    EXPECT_FALSE(solution.used_xylist);
+    auto args = commands();
+    ASSERT_EQ(args.size(), 1u);
+    EXPECT_TRUE(args[0].starts_with(path + " --overwrite"));
+    EXPECT_EQ(args[0].find("--width"), std::string::npos);
+}
+
+TEST(SolveServiceHelperTest, ParsesAnglesAndFitsHeaders) {
+    EXPECT_DOUBLE_EQ(*parseAngle("12:30:00", 15.0), 187.5);
+    EXPECT_DOUBLE_EQ(*parseAngle("-5 30 0"), -5.5);
+    EXPECT_DOUBLE_EQ(*parseAngle(" 10.25 "), 10.25);
+    EXPECT_FALSE(parseAngle("abc"));
+    EXPECT_FALSE(parseAngle("1:2:3:4"));
+    EXPECT_FALSE(parseAngle(""));
+
+    auto path = fs::temp_directory_path() /
+                ("solve-header-" + std::to_string(::getpid()) + ".xyls");
+    StarList list{100, 50, {{1, 2, 3}}};
+    ASSERT_TRUE(writeXYList(path, list));
+    auto header = readFitsHeader(path);
+    EXPECT_EQ(header["SIMPLE"], "T");
+    EXPECT_EQ(header["NAXIS"], "0");
+    fs::remove(path);
+
+    EXPECT_TRUE(readFitsHeader("/nonexistent.fits").empty());
+}
@@ -0,0 +1,235 @@
+#include "components/StaticFileCache.hpp"
+#include <gtest/gtest.h>
+
+#include <zlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+namespace http = oatpp::web::protocol::http;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::shared_ptr<http::incoming::Request> makeRequest(
+    const std::vector<std::pair<std::string, std::string>>& headers = {}) {
+    http::Headers values;
+    for (const auto& [name, value] : headers) {
+        values.put(oatpp::String(name), oatpp::String(value));
+    }
+    return http::incoming::Request::createShared(nullptr, {}, values, nullptr,
+                                                 nullptr);
+}
+
+std::string bodyOf(const std::shared_ptr<http::outgoing::Response>& response) {
+    auto body = response->getBody();
+    return std::string(reinterpret_cast<const char*>(body->getKnownData()),
+                       static_cast<std::size_t>(body->getKnownSize()));
+}
+
+std::string contentTypeOf(
+    const std::shared_ptr<http::outgoing::Response>& response) {
+    http::Headers headers;
+    response->getBody()->declareHeaders(headers);
+    auto value = headers.get(http::Header::CONTENT_TYPE);
+    return value ? std::string(*value) : std::string();
+}
+
+std::string gunzip(const std::string& input) {
+    z_stream zs{};
+    inflateInit2(&zs, 15 + 16);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zs.avail_in = static_cast<uInt>(input.size());
+    std::string output;
+    char chunk[4096];
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef*>(chunk);
+        zs.avail_out = sizeof(chunk);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        output.append(chunk, sizeof(chunk) - zs.avail_out);
+    }
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END ? output : std::string();
+}
+
+class StaticFileCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        root = fs::temp_directory_path() /
+               (std::string("lithium_static_") +
+                ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        fs::remove_all(root);
+        fs::create_directories(root / "js");
+        for (int i = 0; i < 200; ++i) {
+            page += "<p>line " + std::to_string(i % 7) + "</p>\n";
+        }
+        write("index.html", page);
+    }
+
+    void TearDown() override { fs::remove_all(root); }
+
+    void write(const fs::path& relative, const std::string& data) {
+        std::ofstream(root / relative, std::ios::binary) << data;
+    }
+
+    /* Serve until the response is compressed, empty string on timeout. */
+    std::string waitForEncoding(StaticFileCache& cache,
+                                const std::string& path) {
+        auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (std::chrono::steady_clock::now() < deadline) {
+            auto response = cache.serve(
+                makeRequest({{"Accept-Encoding", "gzip"}}), path);
+            if (auto encoding = response->getHeader("Content-Encoding")) {
+                return bodyOf(response);
+            }
+            std::this_thread::sleep_for(10ms);
+        }
+        return {};
+    }
+
+    fs::path root;
+    std::string page;
+};
+
+}  // namespace
+
+TEST(StaticFileCacheEntityTag, WeakComparison) {
+    const std::string etag = "W/\"1a-2b\"";
+    EXPECT_TRUE(StaticFileCache::matchesEntityTag("W/\"1a-2b\"", etag));
+    EXPECT_TRUE(StaticFileCache::matchesEntityTag("\"1a-2b\"", etag));
+    EXPECT_TRUE(StaticFileCache::matchesEntityTag("*", etag));
+    EXPECT_TRUE(StaticFileCache::matchesEntityTag(" * ", etag));
+    EXPECT_TRUE(
+        StaticFileCache::matchesEntityTag("\"x\", W/\"1a-2b\" ,\"y\"", etag));
+    EXPECT_TRUE(
+        StaticFileCache::matchesEntityTag("W/\"a,b\",W/\"1a-2b\"", etag));
+
+    // Substrings of a longer tag and malformed lists never match.
+    EXPECT_FALSE(StaticFileCache::matchesEntityTag("W/\"1a-2b0\"", etag));
+    EXPECT_FALSE(StaticFileCache::matchesEntityTag("W/\"01a-2b\"", etag));
+    EXPECT_FALSE(StaticFileCache::matchesEntityTag("1a-2b", etag));
+    EXPECT_FALSE(StaticFileCache::matchesEntityTag("\"1a-2b", etag));
+    EXPECT_FALSE(StaticFileCache::matchesEntityTag("", etag));
+}
+
+TEST_F(StaticFileCacheTest, ServesAndRevalidates) {
+    StaticFileCache cache({.root = root});
+
+    auto response = cache.serve(makeRequest(), "index.html", {"html"});
+    ASSERT_EQ(response->getStatus().code, 200);
+    EXPECT_EQ(bodyOf(response), page);
+    EXPECT_EQ(contentTypeOf(response), "text/html; charset=utf-8");
+    EXPECT_EQ(std::string(*response->getHeader("Cache-Control")), "no-cache");
+    auto etag = response->getHeader("ETag");
+    ASSERT_TRUE(etag);
+
+    response = cache.serve(makeRequest({{"If-None-Match", *etag}}),
+                           "index.html");
+    EXPECT_EQ(response->getStatus().code, 304);
+
+    response = cache.serve(
+        makeRequest({{"If-None-Match", "W/\"other\", " + *etag}}),
+        "index.html");
+    EXPECT_EQ(response->getStatus().code, 304);
+
+    response = cache.serve(makeRequest({{"If-None-Match", "W/\"other\""}}),
+                           "index.html");
+    EXPECT_EQ(response->getStatus().code, 200);
+
+    // A changed file gets a new validator.
+    write("index.html", page + "<p>more</p>\n");
+    response = cache.serve(makeRequest({{"If-None-Match", *etag}}),
+                           "index.html");
+    EXPECT_EQ(response->getStatus().code, 200);
+    EXPECT_EQ(bodyOf(response), page + "<p>more</p>\n");
+}
+
+TEST_F(StaticFileCacheTest, ErrorsHaveContentType) {
+    StaticFileCache cache({.root = root});
+
+    auto response = cache.serve(makeRequest(), "../index.html");
+    EXPECT_EQ(response->getStatus().code, 403);
+    EXPECT_EQ(contentTypeOf(response), "text/plain; charset=utf-8");
+
+    response = cache.serve(makeRequest(), "index.html", {"js"});
+    EXPECT_EQ(response->getStatus().code, 403);
+    EXPECT_EQ(contentTypeOf(response), "text/plain; charset=utf-8");
+
+    response = cache.serve(makeRequest(), "missing.html");
+    EXPECT_EQ(response->getStatus().code, 404);
+    EXPECT_EQ(contentTypeOf(response), "text/plain; charset=utf-8");
+}
+
+TEST_F(StaticFileCacheTest, CompressesOffTheRequestPath) {
+    StaticFileCache cache({.root = root});
+
+    // The miss is answered uncompressed, the variant follows.
+    auto response = cache.serve(makeRequest({{"Accept-Encoding", "gzip"}}),
+                                "index.html");
+    ASSERT_EQ(response->getStatus().code, 200);
+    EXPECT_EQ(bodyOf(response), page);
+
+    auto compressed = waitForEncoding(cache, "index.html");
+    ASSERT_FALSE(compressed.empty());
+    EXPECT_LT(compressed.size(), page.size());
+    EXPECT_EQ(gunzip(compressed), page);
+
+    // Clients that don't accept it still get the identity body.
+    response = cache.serve(makeRequest(), "index.html");
+    EXPECT_FALSE(response->getHeader("Content-Encoding"));
+    EXPECT_EQ(bodyOf(response), page);
+}
+
+TEST_F(StaticFileCacheTest, ConcurrentMissesShareOneEntry) {
+    std::string script;
+    for (int i = 0; i < 500; ++i) {
+        script += "console.log(" + std::to_string(i % 13) + ");\n";
+    }
+    write("js/app.js", script);
+
+    StaticFileCache cache({.root = root});
+    std::vector<std::thread> threads;
+    std::atomic<int> good{0};
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&] {
+            auto response = cache.serve(makeRequest(), "js/app.js", {"js"});
+            if (response->getStatus().code == 200 &&
+                bodyOf(response) == script) {
+                ++good;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(good.load(), 8);
+
+    auto compressed = waitForEncoding(cache, "js/app.js");
+    ASSERT_FALSE(compressed.empty());
+    EXPECT_EQ(gunzip(compressed), script);
+    auto bytes = cache.cachedBytes();
+    EXPECT_GE(bytes, script.size() + compressed.size());
+    // Only one copy of the file is held.
+    EXPECT_LT(bytes, 2 * script.size() + compressed.size());
+}
+
+TEST_F(StaticFileCacheTest, PrefersPrecompressedSibling) {
+    const std::string sibling = "not really gzip, but newer than the source";
+    write("index.html.gz", sibling);
+    auto source = fs::last_write_time(root / "index.html");
+    fs::last_write_time(root / "index.html.gz", source + 1s);
+
+    StaticFileCache cache({.root = root});
+    auto response = cache.serve(makeRequest({{"Accept-Encoding", "gzip"}}),
+                                "index.html");
+    ASSERT_EQ(response->getStatus().code, 200);
+    EXPECT_EQ(std::string(*response->getHeader("Content-Encoding")), "gzip");
+    EXPECT_EQ(bodyOf(response), sibling);
+}
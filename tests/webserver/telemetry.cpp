@@ -0,0 +1,198 @@
+#include "websocket/Telemetry.hpp"
+#include <gtest/gtest.h>
+
+#include "oatpp/core/base/Environment.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+using json = Telemetry::json;
+using namespace std::chrono_literals;
+
+namespace {
+
+class TestComponents {
+public:
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor)
+    ([] { return std::make_shared<oatpp::async::Executor>(1, 1, 1); }());
+};
+
+/* Records the frames of one subscriber. */
+class Recorder {
+public:
+    std::atomic<bool> accept{true};
+
+    Telemetry::FrameSink sink() {
+        return [this](const oatpp::String& frame, bool binary) {
+            std::lock_guard lock(m_mutex);
+            if (!accept) {
+                ++m_rejected;
+                m_cv.notify_all();
+                return false;
+            }
+            m_frames.push_back({std::string(*frame), binary});
+            m_cv.notify_all();
+            return true;
+        };
+    }
+
+    /* Next frame decoded to JSON, `null` on timeout. */
+    json next(std::chrono::milliseconds timeout = 2s) {
+        std::unique_lock lock(m_mutex);
+        if (!m_cv.wait_for(lock, timeout, [this] { return !m_frames.empty(); })) {
+            return nullptr;
+        }
+        auto [data, binary] = std::move(m_frames.front());
+        m_frames.pop_front();
+        lastBinary = binary;
+        return binary ? json::from_cbor(data, true, false) : json::parse(data);
+    }
+
+    bool waitRejected(int count, std::chrono::milliseconds timeout = 2s) {
+        std::unique_lock lock(m_mutex);
+        return m_cv.wait_for(lock, timeout,
+                             [&] { return m_rejected >= count; });
+    }
+
+    bool lastBinary = false;
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::pair<std::string, bool>> m_frames;
+    int m_rejected = 0;
+};
+
+class TelemetryTest : public ::testing::Test {
+protected:
+    static void SetUpTestSuite() { oatpp::base::Environment::init(); }
+
+    void SetUp() override {
+        components = std::make_unique<TestComponents>();
+        telemetry = std::make_unique<Telemetry>();
+    }
+
+    void TearDown() override {
+        // Ends the subscription, the flusher stops once nobody is left.
+        owner.reset();
+        telemetry.reset();
+        auto executor = components->executor.getObject();
+        executor->waitTasksFinished();
+        executor->stop();
+        executor->join();
+        components.reset();
+    }
+
+    void subscribe(const std::vector<std::string>& paths,
+                   Telemetry::Encoding encoding = Telemetry::Encoding::JSON) {
+        telemetry->subscribe(1, owner, recorder.sink(), paths, encoding, 50ms);
+    }
+
+    Recorder recorder;
+    std::unique_ptr<TestComponents> components;
+    std::unique_ptr<Telemetry> telemetry;
+    std::shared_ptr<int> owner = std::make_shared<int>(0);
+};
+
+}  // namespace
+
+TEST_F(TelemetryTest, FullSnapshotThenOnlyChanges) {
+    telemetry->publish("system.cpu", 10);
+    telemetry->publish("system.memory", 20);
+    telemetry->publish("systemd.units", 5);
+
+    subscribe({"system"});
+    auto frame = recorder.next();
+    ASSERT_TRUE(frame.is_object());
+    const auto& payload = frame["payload"];
+    EXPECT_EQ(payload["seq"], 0);
+    EXPECT_TRUE(payload["full"].get<bool>());
+    EXPECT_EQ(payload["changes"],
+              (json{{"system.cpu", 10}, {"system.memory", 20}}));
+
+    // Republishing an unchanged value is not sent again.
+    telemetry->publish("system.cpu", 10);
+    telemetry->publish("system.memory", 30);
+    frame = recorder.next();
+    ASSERT_TRUE(frame.is_object());
+    EXPECT_EQ(frame["payload"]["seq"], 1);
+    EXPECT_FALSE(frame["payload"]["full"].get<bool>());
+    EXPECT_EQ(frame["payload"]["changes"], (json{{"system.memory", 30}}));
+
+    telemetry->remove("system.cpu");
+    frame = recorder.next();
+    ASSERT_TRUE(frame.is_object());
+    EXPECT_TRUE(frame["payload"]["changes"].empty());
+    EXPECT_EQ(frame["payload"]["removed"], json::array({"system.cpu"}));
+
+    // Nothing changed, nothing sent.
+    EXPECT_TRUE(recorder.next(200ms).is_null());
+}
+
+TEST_F(TelemetryTest, BackpressureKeepsTheDelta) {
+    telemetry->publish("camera.temperature", -10.5);
+
+    recorder.accept = false;
+    subscribe({"camera"});
+    ASSERT_TRUE(recorder.waitRejected(2));
+
+    recorder.accept = true;
+    auto frame = recorder.next();
+    ASSERT_TRUE(frame.is_object());
+    // The rejected frames were not committed, this is still the snapshot.
+    EXPECT_EQ(frame["payload"]["seq"], 0);
+    EXPECT_TRUE(frame["payload"]["full"].get<bool>());
+    EXPECT_EQ(frame["payload"]["changes"]["camera.temperature"], -10.5);
+}
+
+TEST_F(TelemetryTest, BinaryEncoding) {
+    telemetry->publishObject("mount", json{{"ra", 1.5}, {"dec", -20.0}});
+
+    subscribe({"*"}, Telemetry::parseEncoding("cbor"));
+    auto frame = recorder.next();
+    ASSERT_TRUE(frame.is_object());
+    EXPECT_TRUE(recorder.lastBinary);
+    EXPECT_EQ(frame["payload"]["changes"],
+              (json{{"mount.ra", 1.5}, {"mount.dec", -20.0}}));
+
+    EXPECT_EQ(Telemetry::parseEncoding("msgpack"),
+              Telemetry::Encoding::MSGPACK);
+    EXPECT_EQ(Telemetry::parseEncoding("unknown"), Telemetry::Encoding::JSON);
+}
+
+TEST_F(TelemetryTest, SourcesAreSampledWhileSubscribed) {
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    telemetry->addSource(
+        "guider",
+        [calls] {
+            // Samplers run on the sampling thread and may block.
+            std::this_thread::sleep_for(20ms);
+            return json{{"rms", ++*calls}};
+        },
+        50ms);
+    std::this_thread::sleep_for(150ms);
+    EXPECT_EQ(calls->load(), 0);
+
+    subscribe({"guider.rms"});
+    json frame;
+    do {
+        frame = recorder.next();
+        ASSERT_TRUE(frame.is_object());
+    } while (!frame["payload"]["changes"].contains("guider.rms"));
+    EXPECT_GE(calls->load(), 1);
+}
+
+TEST_F(TelemetryTest, SubscriptionEndsWithOwner) {
+    telemetry->publish("focuser.position", 1000);
+
+    subscribe({"focuser"});
+    ASSERT_TRUE(recorder.next().is_object());
+
+    owner.reset();
+    telemetry->publish("focuser.position", 1001);
+    EXPECT_TRUE(recorder.next(300ms).is_null());
+}
@@ -0,0 +1,213 @@
+#include "components/UploadManager.hpp"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string readFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+class UploadManagerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        root = fs::temp_directory_path() /
+               (std::string("lithium_upload_") +
+                ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        fs::remove_all(root);
+        options.directory = root / "upload";
+        options.tempDirectory = root / "tmp";
+        options.bufferSize = 8;
+        options.bufferCount = 1;
+        options.token = "secret";
+        manager = std::make_unique<UploadManager>(options);
+    }
+
+    void TearDown() override {
+        manager.reset();
+        fs::remove_all(root);
+    }
+
+    /* Send `data` as the chunk starting at the current offset. */
+    bool send(UploadManager::Upload& upload, const std::string& data) {
+        auto offset = upload.status().offset;
+        if (!upload.begin(offset, offset + data.size())) {
+            return false;
+        }
+        oatpp::async::Action action;
+        // Uneven pieces exercise the buffered and the direct path.
+        for (std::size_t pos = 0; pos < data.size(); pos += 5) {
+            auto piece = std::min<std::size_t>(5, data.size() - pos);
+            if (upload.write(data.data() + pos, piece, action) !=
+                static_cast<oatpp::v_io_size>(piece)) {
+                upload.end();
+                return false;
+            }
+        }
+        return upload.end();
+    }
+
+    std::size_t tempFiles() const {
+        std::size_t count = 0;
+        for ([[maybe_unused]] const auto& entry :
+             fs::directory_iterator(options.tempDirectory)) {
+            ++count;
+        }
+        return count;
+    }
+
+    fs::path root;
+    UploadManager::Options options;
+    std::unique_ptr<UploadManager> manager;
+};
+
+}  // namespace
+
+TEST_F(UploadManagerTest, ResumableUploadCompletesWithDigest) {
+    auto upload = manager->create("../../notes.txt", 11);
+    ASSERT_TRUE(upload);
+    EXPECT_EQ(upload->status().name, "notes.txt");
+
+    ASSERT_TRUE(send(*upload, "hello"));
+    EXPECT_EQ(upload->status().offset, 5u);
+    EXPECT_FALSE(upload->status().complete);
+
+    // A chunk that doesn't start at the offset is refused.
+    EXPECT_FALSE(upload->begin(3, 11));
+    EXPECT_FALSE(upload->begin(6, 11));
+
+    ASSERT_TRUE(send(*upload, " world"));
+    auto status = upload->status();
+    EXPECT_TRUE(status.complete);
+    EXPECT_EQ(status.size, 11u);
+    EXPECT_EQ(status.md5, "5eb63bbbe01eeed093cb22bb8f5acdc3");
+    EXPECT_EQ(fs::path(status.path), options.directory / "notes.txt");
+    EXPECT_EQ(readFile(status.path), "hello world");
+    EXPECT_EQ(tempFiles(), 0u);
+
+    EXPECT_EQ(manager->find(status.id), upload);
+}
+
+TEST_F(UploadManagerTest, OversizedChunkFails) {
+    auto upload = manager->create("a.bin", 4);
+    ASSERT_TRUE(upload);
+    EXPECT_FALSE(upload->begin(0, 5));
+    ASSERT_TRUE(upload->begin(0, 2));
+    oatpp::async::Action action;
+    EXPECT_LT(upload->write("abc", 3, action), 0);
+    upload->end();
+    EXPECT_FALSE(upload->commit());
+}
+
+TEST_F(UploadManagerTest, ContentRangeTotalSetsSize) {
+    auto upload = manager->create("sized.txt", 0);
+    ASSERT_TRUE(upload);
+    ASSERT_TRUE(upload->begin(0, 5, 11));
+    oatpp::async::Action action;
+    ASSERT_EQ(upload->write("hello", 5, action), 5);
+    ASSERT_TRUE(upload->end());
+    EXPECT_EQ(upload->status().size, 11u);
+
+    // Later chunks can't change the total.
+    EXPECT_FALSE(upload->begin(5, 11, 12));
+    ASSERT_TRUE(send(*upload, " world"));
+    auto status = upload->status();
+    EXPECT_TRUE(status.complete);
+    EXPECT_EQ(readFile(status.path), "hello world");
+}
+
+TEST_F(UploadManagerTest, ChunksStopAtMaxFileSize) {
+    options.maxFileSize = 10;
+    manager = std::make_unique<UploadManager>(options);
+    auto upload = manager->create("open.bin", 0);
+    ASSERT_TRUE(upload);
+    EXPECT_FALSE(upload->begin(0, 5, 11));
+
+    // An open-ended chunk ends at the limit.
+    ASSERT_TRUE(
+        upload->begin(0, std::numeric_limits<std::uintmax_t>::max()));
+    oatpp::async::Action action;
+    EXPECT_EQ(upload->write("0123456789", 10, action), 10);
+    EXPECT_LT(upload->write("x", 1, action), 0);
+    upload->end();
+    EXPECT_FALSE(upload->commit());
+}
+
+TEST_F(UploadManagerTest, ExistingFileIsNotReplaced) {
+    fs::create_directories(options.directory);
+    std::ofstream(options.directory / "image.fits") << "original";
+    std::ofstream(options.directory / "image (1).fits") << "first copy";
+
+    auto upload = manager->create("image.fits", 0);
+    ASSERT_TRUE(upload);
+    ASSERT_TRUE(send(*upload, "new frame"));
+    ASSERT_TRUE(upload->commit());
+
+    auto status = upload->status();
+    EXPECT_EQ(status.name, "image (2).fits");
+    EXPECT_EQ(fs::path(status.path), options.directory / "image (2).fits");
+    EXPECT_EQ(readFile(status.path), "new frame");
+    EXPECT_EQ(readFile(options.directory / "image.fits"), "original");
+    EXPECT_EQ(readFile(options.directory / "image (1).fits"), "first copy");
+    EXPECT_EQ(tempFiles(), 0u);
+}
+
+TEST_F(UploadManagerTest, CancelRemovesPartialFile) {
+    auto upload = manager->create("partial.bin", 100);
+    ASSERT_TRUE(upload);
+    ASSERT_TRUE(send(*upload, "some bytes"));
+    EXPECT_EQ(tempFiles(), 1u);
+
+    auto id = upload->status().id;
+    EXPECT_TRUE(manager->cancel(id));
+    EXPECT_FALSE(manager->find(id));
+    EXPECT_FALSE(manager->cancel(id));
+    EXPECT_FALSE(upload->begin(10, 20));
+
+    upload.reset();
+    EXPECT_EQ(tempFiles(), 0u);
+    EXPECT_TRUE(fs::is_empty(options.directory));
+}
+
+TEST_F(UploadManagerTest, RejectsTooLarge) {
+    options.maxFileSize = 10;
+    manager = std::make_unique<UploadManager>(options);
+    EXPECT_FALSE(manager->create("big.bin", 11));
+    EXPECT_TRUE(manager->create("small.bin", 10));
+}
+
+TEST_F(UploadManagerTest, Token) {
+    EXPECT_TRUE(manager->authorize("secret"));
+    EXPECT_FALSE(manager->authorize("secret2"));
+    EXPECT_FALSE(manager->authorize("secre"));
+    EXPECT_FALSE(manager->authorize(""));
+
+    // Without a configured token nothing is accepted.
+    options.token.clear();
+    manager = std::make_unique<UploadManager>(options);
+    EXPECT_FALSE(manager->authorize(""));
+}
+
+TEST(UploadManagerContentRange, Parse) {
+    auto range = UploadManager::parseContentRange("bytes 0-99/200");
+    ASSERT_TRUE(range);
+    EXPECT_EQ(*range, std::make_tuple(0u, 100u, 200u));
+
+    range = UploadManager::parseContentRange("bytes 100-199/*");
+    ASSERT_TRUE(range);
+    EXPECT_EQ(*range, std::make_tuple(100u, 200u, 0u));
+
+    EXPECT_FALSE(UploadManager::parseContentRange("bytes 10-5/200"));
+    EXPECT_FALSE(UploadManager::parseContentRange("bytes 0-200/200"));
+    EXPECT_FALSE(UploadManager::parseContentRange("items 0-1/2"));
+}